@@ -0,0 +1,744 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "mock_compositor.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <wayland-server.h>
+
+#include "xdg-shell-server-protocol.h"
+
+namespace {
+
+// the highest versions Display and XdgWm bind, capped at what libwayland-server knows
+constexpr int kCompositorVersion = 6;
+constexpr int kOutputVersion = 4;
+constexpr int kSeatVersion = 7;
+constexpr int kXdgWmBaseVersion = 6;
+
+// KEY_A, <AC01> in the keymap
+constexpr uint32_t kKey = 30;
+
+// self-contained, so xkbcommon compiles it without include files
+constexpr char kKeymap[] =
+        "xkb_keymap {\n"
+        "    xkb_keycodes \"waypp\" { minimum = 8; maximum = 255; <AC01> = 38; };\n"
+        "    xkb_types \"waypp\" { type \"ONE_LEVEL\" { modifiers = none; level_name[Level1] = \"Any\"; }; };\n"
+        "    xkb_compatibility \"waypp\" { };\n"
+        "    xkb_symbols \"waypp\" { key <AC01> { [ a ] }; };\n"
+        "};\n";
+
+uint32_t now_ms() {
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint32_t>(ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
+
+// for objects whose requests change nothing the benchmarks look at
+int ignore_requests(const void * /* implementation */, void *target, uint32_t /* opcode */,
+                    const struct wl_message *message, union wl_argument * /* args */) {
+    if (strcmp(message->name, "destroy") == 0 || strcmp(message->name, "release") == 0) {
+        wl_resource_destroy(static_cast<struct wl_resource *>(target));
+    }
+    return 0;
+}
+
+template<typename... Args>
+void ignore(struct wl_client * /* client */, struct wl_resource * /* resource */, Args... /* args */) {}
+
+void destroy_resource(struct wl_client * /* client */, struct wl_resource *resource) {
+    wl_resource_destroy(resource);
+}
+
+void create_global(struct wl_display *display, const struct wl_interface *interface, int version, void *data,
+                   wl_global_bind_func_t bind) {
+    if (!wl_global_create(display, interface, std::min(version, interface->version), data, bind)) {
+        throw std::runtime_error(std::string("MockCompositor: cannot create ") + interface->name);
+    }
+}
+
+struct wl_resource *create_resource(struct wl_client *client, const struct wl_interface *interface, int version,
+                                    uint32_t id) {
+    const auto resource = wl_resource_create(client, interface, version, id);
+    if (!resource) {
+        wl_client_post_no_memory(client);
+    }
+    return resource;
+}
+
+void create_inert(struct wl_client *client, const struct wl_interface *interface, struct wl_resource *parent,
+                  uint32_t id) {
+    if (const auto resource = create_resource(client, interface, wl_resource_get_version(parent), id)) {
+        wl_resource_set_dispatcher(resource, ignore_requests, nullptr, nullptr, nullptr);
+    }
+}
+
+}  // namespace
+
+struct MockCompositor::State {
+    struct Surface {
+        // first, so the listener's address is the Surface's
+        struct wl_listener buffer_destroy;
+        State *state;
+        struct wl_resource *resource;
+        // attached since the last commit
+        struct wl_resource *buffer;
+        std::vector<struct wl_resource *> frames;
+        struct wl_resource *xdg_surface;
+        struct wl_resource *toplevel;
+        bool configure_sent;
+    };
+
+    State();
+
+    ~State();
+
+    // runs task on the compositor thread and returns once its events are flushed
+    void run(const std::function<void()> &task);
+
+    [[nodiscard]] bool focused(struct wl_resource *device) const {
+        return focus && wl_resource_get_client(device) == wl_resource_get_client(focus->resource);
+    }
+
+    void set_focus(Surface *surface);
+
+    // the surface goes out of the mapped toplevels, a focused one hands focus to the last mapped
+    void unmap(Surface *surface);
+
+    void enter_pointer(struct wl_resource *pointer);
+
+    void enter_keyboard(struct wl_resource *keyboard);
+
+    static int handle_wake(int fd, uint32_t mask, void *data);
+
+    static void bind_compositor(struct wl_client *client, void *data, uint32_t version, uint32_t id);
+
+    static void create_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id);
+
+    static void create_region(struct wl_client *client, struct wl_resource *resource, uint32_t id);
+
+    static void surface_destroyed(struct wl_resource *resource);
+
+    static void surface_attach(struct wl_client *client, struct wl_resource *resource, struct wl_resource *buffer,
+                               int32_t x, int32_t y);
+
+    static void buffer_destroyed(struct wl_listener *listener, void *data);
+
+    static void surface_frame(struct wl_client *client, struct wl_resource *resource, uint32_t callback);
+
+    static void frame_destroyed(struct wl_resource *resource);
+
+    static void surface_commit(struct wl_client *client, struct wl_resource *resource);
+
+    static void bind_subcompositor(struct wl_client *client, void *data, uint32_t version, uint32_t id);
+
+    static void get_subsurface(struct wl_client *client, struct wl_resource *resource, uint32_t id,
+                               struct wl_resource *surface, struct wl_resource *parent);
+
+    static void bind_output(struct wl_client *client, void *data, uint32_t version, uint32_t id);
+
+    static void bind_seat(struct wl_client *client, void *data, uint32_t version, uint32_t id);
+
+    static void get_pointer(struct wl_client *client, struct wl_resource *resource, uint32_t id);
+
+    static void pointer_destroyed(struct wl_resource *resource);
+
+    static void get_keyboard(struct wl_client *client, struct wl_resource *resource, uint32_t id);
+
+    static void keyboard_destroyed(struct wl_resource *resource);
+
+    static void get_touch(struct wl_client *client, struct wl_resource *resource, uint32_t id);
+
+    static void bind_wm_base(struct wl_client *client, void *data, uint32_t version, uint32_t id);
+
+    static void create_positioner(struct wl_client *client, struct wl_resource *resource, uint32_t id);
+
+    static void get_xdg_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id,
+                                struct wl_resource *surface);
+
+    static void xdg_surface_destroyed(struct wl_resource *resource);
+
+    static void get_toplevel(struct wl_client *client, struct wl_resource *resource, uint32_t id);
+
+    static void toplevel_destroyed(struct wl_resource *resource);
+
+    static void get_popup(struct wl_client *client, struct wl_resource *resource, uint32_t id,
+                          struct wl_resource *parent, struct wl_resource *positioner);
+
+    static void ack_configure(struct wl_client *client, struct wl_resource *resource, uint32_t serial);
+
+    static const struct wl_compositor_interface compositor_impl;
+    static const struct wl_surface_interface surface_impl;
+    static const struct wl_subcompositor_interface subcompositor_impl;
+    static const struct wl_seat_interface seat_impl;
+    static const struct xdg_wm_base_interface wm_base_impl;
+    static const struct xdg_surface_interface xdg_surface_impl;
+
+    // set if XDG_RUNTIME_DIR was not, removed again with the socket
+    std::string runtime_dir;
+    struct wl_display *display{};
+    const char *socket{};
+    int wake_fd{-1};
+    struct wl_event_source *wake_source{};
+    // only touched on the compositor thread
+    bool running{true};
+    std::thread thread;
+
+    std::mutex mutex;
+    std::condition_variable done;
+    std::vector<std::function<void()>> tasks;
+    uint64_t queued{};
+    uint64_t completed{};
+
+    std::vector<struct wl_resource *> pointers;
+    std::vector<struct wl_resource *> keyboards;
+    // toplevels that acked a configure, in the order they did
+    std::vector<Surface *> mapped;
+    Surface *focus{};
+};
+
+MockCompositor::State::State() {
+    if (!getenv("XDG_RUNTIME_DIR")) {
+        char dir[] = "/tmp/waypp-bench-XXXXXX";
+        if (!mkdtemp(dir)) {
+            throw std::runtime_error(std::string("mkdtemp: ") + strerror(errno));
+        }
+        runtime_dir = dir;
+        setenv("XDG_RUNTIME_DIR", dir, 1);
+    }
+
+    display = wl_display_create();
+    if (!display) {
+        throw std::runtime_error("wl_display_create failed");
+    }
+    try {
+        socket = wl_display_add_socket_auto(display);
+        if (!socket) {
+            throw std::runtime_error(std::string("wl_display_add_socket_auto: ") + strerror(errno));
+        }
+        create_global(display, &wl_compositor_interface, kCompositorVersion, this, bind_compositor);
+        create_global(display, &wl_subcompositor_interface, 1, this, bind_subcompositor);
+        // libwayland-server's own wl_shm, with real pools, e.g. for a cursor or an shm window
+        wl_display_init_shm(display);
+        create_global(display, &wl_output_interface, kOutputVersion, this, bind_output);
+        create_global(display, &wl_seat_interface, kSeatVersion, this, bind_seat);
+        create_global(display, &xdg_wm_base_interface, kXdgWmBaseVersion, this, bind_wm_base);
+
+        wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (wake_fd < 0) {
+            throw std::runtime_error(std::string("eventfd: ") + strerror(errno));
+        }
+    } catch (...) {
+        wl_display_destroy(display);
+        throw;
+    }
+    wake_source = wl_event_loop_add_fd(wl_display_get_event_loop(display), wake_fd, WL_EVENT_READABLE, handle_wake,
+                                       this);
+
+    thread = std::thread([this] {
+        const auto loop = wl_display_get_event_loop(display);
+        while (running) {
+            wl_event_loop_dispatch(loop, -1);
+            wl_display_flush_clients(display);
+        }
+    });
+}
+
+MockCompositor::State::~State() {
+    run([this] { running = false; });
+    thread.join();
+    wl_display_destroy_clients(display);
+    wl_event_source_remove(wake_source);
+    wl_display_destroy(display);
+    close(wake_fd);
+    if (!runtime_dir.empty()) {
+        rmdir(runtime_dir.c_str());
+        unsetenv("XDG_RUNTIME_DIR");
+    }
+}
+
+void MockCompositor::State::run(const std::function<void()> &task) {
+    std::unique_lock<std::mutex> lock(mutex);
+    tasks.push_back(task);
+    const uint64_t ticket = ++queued;
+    const uint64_t value = 1;
+    (void) !write(wake_fd, &value, sizeof(value));
+    done.wait(lock, [this, ticket] { return completed >= ticket; });
+}
+
+int MockCompositor::State::handle_wake(int fd, uint32_t /* mask */, void *data) {
+    const auto state = static_cast<State *>(data);
+    uint64_t value;
+    (void) !read(fd, &value, sizeof(value));
+    std::vector<std::function<void()>> pending;
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        pending.swap(state->tasks);
+    }
+    for (const auto &task: pending) {
+        task();
+    }
+    wl_display_flush_clients(state->display);
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        state->completed += pending.size();
+    }
+    state->done.notify_all();
+    return 0;
+}
+
+void MockCompositor::State::set_focus(Surface *surface) {
+    focus = surface;
+    for (const auto pointer: pointers) {
+        if (focused(pointer)) {
+            enter_pointer(pointer);
+        }
+    }
+    for (const auto keyboard: keyboards) {
+        if (focused(keyboard)) {
+            enter_keyboard(keyboard);
+        }
+    }
+}
+
+void MockCompositor::State::unmap(Surface *surface) {
+    mapped.erase(std::remove(mapped.begin(), mapped.end(), surface), mapped.end());
+    if (focus == surface) {
+        set_focus(mapped.empty() ? nullptr : mapped.back());
+    }
+}
+
+void MockCompositor::State::enter_pointer(struct wl_resource *pointer) {
+    wl_pointer_send_enter(pointer, wl_display_next_serial(display), focus->resource, 0, 0);
+    if (wl_resource_get_version(pointer) >= WL_POINTER_FRAME_SINCE_VERSION) {
+        wl_pointer_send_frame(pointer);
+    }
+}
+
+void MockCompositor::State::enter_keyboard(struct wl_resource *keyboard) {
+    struct wl_array keys{};
+    wl_array_init(&keys);
+    const uint32_t serial = wl_display_next_serial(display);
+    wl_keyboard_send_enter(keyboard, serial, focus->resource, &keys);
+    wl_array_release(&keys);
+    wl_keyboard_send_modifiers(keyboard, serial, 0, 0, 0, 0);
+}
+
+void MockCompositor::State::bind_compositor(struct wl_client *client, void *data, uint32_t version, uint32_t id) {
+    if (const auto resource = create_resource(client, &wl_compositor_interface, static_cast<int>(version), id)) {
+        wl_resource_set_implementation(resource, &compositor_impl, data, nullptr);
+    }
+}
+
+void MockCompositor::State::create_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id) {
+    const auto surface_resource = create_resource(client, &wl_surface_interface, wl_resource_get_version(resource),
+                                                  id);
+    if (!surface_resource) {
+        return;
+    }
+    auto surface = new Surface();
+    surface->state = static_cast<State *>(wl_resource_get_user_data(resource));
+    surface->resource = surface_resource;
+    wl_resource_set_implementation(surface_resource, &surface_impl, surface, surface_destroyed);
+}
+
+void MockCompositor::State::create_region(struct wl_client *client, struct wl_resource *resource, uint32_t id) {
+    create_inert(client, &wl_region_interface, resource, id);
+}
+
+void MockCompositor::State::surface_destroyed(struct wl_resource *resource) {
+    const auto surface = static_cast<Surface *>(wl_resource_get_user_data(resource));
+    surface->state->unmap(surface);
+    if (surface->buffer) {
+        wl_list_remove(&surface->buffer_destroy.link);
+    }
+    // a disconnecting client's objects go in any order
+    for (const auto frame: surface->frames) {
+        wl_resource_set_user_data(frame, nullptr);
+    }
+    if (surface->xdg_surface) {
+        wl_resource_set_user_data(surface->xdg_surface, nullptr);
+    }
+    if (surface->toplevel) {
+        wl_resource_set_user_data(surface->toplevel, nullptr);
+    }
+    delete surface;
+}
+
+void MockCompositor::State::surface_attach(struct wl_client * /* client */, struct wl_resource *resource,
+                                           struct wl_resource *buffer, int32_t /* x */, int32_t /* y */) {
+    const auto surface = static_cast<Surface *>(wl_resource_get_user_data(resource));
+    if (surface->buffer) {
+        wl_list_remove(&surface->buffer_destroy.link);
+    }
+    surface->buffer = buffer;
+    if (buffer) {
+        surface->buffer_destroy.notify = buffer_destroyed;
+        wl_resource_add_destroy_listener(buffer, &surface->buffer_destroy);
+    }
+}
+
+void MockCompositor::State::buffer_destroyed(struct wl_listener *listener, void * /* data */) {
+    reinterpret_cast<Surface *>(listener)->buffer = nullptr;
+}
+
+void MockCompositor::State::surface_frame(struct wl_client *client, struct wl_resource *resource, uint32_t callback) {
+    const auto surface = static_cast<Surface *>(wl_resource_get_user_data(resource));
+    if (const auto frame = create_resource(client, &wl_callback_interface, 1, callback)) {
+        wl_resource_set_implementation(frame, nullptr, surface, frame_destroyed);
+        surface->frames.push_back(frame);
+    }
+}
+
+void MockCompositor::State::frame_destroyed(struct wl_resource *resource) {
+    if (const auto surface = static_cast<Surface *>(wl_resource_get_user_data(resource))) {
+        auto &frames = surface->frames;
+        frames.erase(std::remove(frames.begin(), frames.end(), resource), frames.end());
+    }
+}
+
+/**
+ * @brief Applies a commit the way a compositor done with it right away would.
+ *
+ * The attached buffer is released and the frame callbacks are done at once. The
+ * first commit of a toplevel is answered with an activated configure of no size.
+ */
+void MockCompositor::State::surface_commit(struct wl_client * /* client */, struct wl_resource *resource) {
+    const auto surface = static_cast<Surface *>(wl_resource_get_user_data(resource));
+    if (surface->buffer) {
+        wl_buffer_send_release(surface->buffer);
+        wl_list_remove(&surface->buffer_destroy.link);
+        surface->buffer = nullptr;
+    }
+
+    const auto frames = std::move(surface->frames);
+    surface->frames.clear();
+    const uint32_t time = now_ms();
+    for (const auto frame: frames) {
+        wl_resource_set_user_data(frame, nullptr);
+        wl_callback_send_done(frame, time);
+        wl_resource_destroy(frame);
+    }
+
+    if (surface->toplevel && surface->xdg_surface && !surface->configure_sent) {
+        struct wl_array states{};
+        wl_array_init(&states);
+        if (const auto state = static_cast<uint32_t *>(wl_array_add(&states, sizeof(uint32_t)))) {
+            *state = XDG_TOPLEVEL_STATE_ACTIVATED;
+        }
+        xdg_toplevel_send_configure(surface->toplevel, 0, 0, &states);
+        wl_array_release(&states);
+        xdg_surface_send_configure(surface->xdg_surface, wl_display_next_serial(surface->state->display));
+        surface->configure_sent = true;
+    }
+}
+
+void MockCompositor::State::bind_subcompositor(struct wl_client *client, void *data, uint32_t version, uint32_t id) {
+    if (const auto resource = create_resource(client, &wl_subcompositor_interface, static_cast<int>(version), id)) {
+        wl_resource_set_implementation(resource, &subcompositor_impl, data, nullptr);
+    }
+}
+
+void MockCompositor::State::get_subsurface(struct wl_client *client, struct wl_resource *resource, uint32_t id,
+                                           struct wl_resource * /* surface */, struct wl_resource * /* parent */) {
+    create_inert(client, &wl_subsurface_interface, resource, id);
+}
+
+void MockCompositor::State::bind_output(struct wl_client *client, void * /* data */, uint32_t version, uint32_t id) {
+    const auto resource = create_resource(client, &wl_output_interface, static_cast<int>(version), id);
+    if (!resource) {
+        return;
+    }
+    wl_resource_set_dispatcher(resource, ignore_requests, nullptr, nullptr, nullptr);
+    wl_output_send_geometry(resource, 0, 0, 527, 296, WL_OUTPUT_SUBPIXEL_UNKNOWN, "waypp", "mock",
+                            WL_OUTPUT_TRANSFORM_NORMAL);
+    wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT | WL_OUTPUT_MODE_PREFERRED, 1920, 1080, 60000);
+    if (version >= WL_OUTPUT_SCALE_SINCE_VERSION) {
+        wl_output_send_scale(resource, 1);
+    }
+    if (version >= WL_OUTPUT_NAME_SINCE_VERSION) {
+        wl_output_send_name(resource, "MOCK-1");
+        wl_output_send_description(resource, "waypp benchmark output");
+    }
+    if (version >= WL_OUTPUT_DONE_SINCE_VERSION) {
+        wl_output_send_done(resource);
+    }
+}
+
+void MockCompositor::State::bind_seat(struct wl_client *client, void *data, uint32_t version, uint32_t id) {
+    const auto resource = create_resource(client, &wl_seat_interface, static_cast<int>(version), id);
+    if (!resource) {
+        return;
+    }
+    wl_resource_set_implementation(resource, &seat_impl, data, nullptr);
+    wl_seat_send_capabilities(resource, WL_SEAT_CAPABILITY_POINTER | WL_SEAT_CAPABILITY_KEYBOARD);
+    if (version >= WL_SEAT_NAME_SINCE_VERSION) {
+        wl_seat_send_name(resource, "seat0");
+    }
+}
+
+void MockCompositor::State::get_pointer(struct wl_client *client, struct wl_resource *resource, uint32_t id) {
+    const auto state = static_cast<State *>(wl_resource_get_user_data(resource));
+    const auto pointer = create_resource(client, &wl_pointer_interface, wl_resource_get_version(resource), id);
+    if (!pointer) {
+        return;
+    }
+    wl_resource_set_dispatcher(pointer, ignore_requests, nullptr, state, pointer_destroyed);
+    state->pointers.push_back(pointer);
+    if (state->focused(pointer)) {
+        state->enter_pointer(pointer);
+    }
+}
+
+void MockCompositor::State::pointer_destroyed(struct wl_resource *resource) {
+    auto &pointers = static_cast<State *>(wl_resource_get_user_data(resource))->pointers;
+    pointers.erase(std::remove(pointers.begin(), pointers.end(), resource), pointers.end());
+}
+
+void MockCompositor::State::get_keyboard(struct wl_client *client, struct wl_resource *resource, uint32_t id) {
+    const auto state = static_cast<State *>(wl_resource_get_user_data(resource));
+    const auto keyboard = create_resource(client, &wl_keyboard_interface, wl_resource_get_version(resource), id);
+    if (!keyboard) {
+        return;
+    }
+    wl_resource_set_dispatcher(keyboard, ignore_requests, nullptr, state, keyboard_destroyed);
+    state->keyboards.push_back(keyboard);
+
+    const int fd = memfd_create("waypp-bench-keymap", MFD_CLOEXEC);
+    if (fd < 0 || write(fd, kKeymap, sizeof(kKeymap)) != static_cast<ssize_t>(sizeof(kKeymap))) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        wl_resource_post_no_memory(keyboard);
+        return;
+    }
+    wl_keyboard_send_keymap(keyboard, WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1, fd, sizeof(kKeymap));
+    close(fd);
+    // no repeat, so a held key creates no events of its own
+    if (wl_resource_get_version(keyboard) >= WL_KEYBOARD_REPEAT_INFO_SINCE_VERSION) {
+        wl_keyboard_send_repeat_info(keyboard, 0, 0);
+    }
+    if (state->focused(keyboard)) {
+        state->enter_keyboard(keyboard);
+    }
+}
+
+void MockCompositor::State::keyboard_destroyed(struct wl_resource *resource) {
+    auto &keyboards = static_cast<State *>(wl_resource_get_user_data(resource))->keyboards;
+    keyboards.erase(std::remove(keyboards.begin(), keyboards.end(), resource), keyboards.end());
+}
+
+void MockCompositor::State::get_touch(struct wl_client *client, struct wl_resource *resource, uint32_t id) {
+    create_inert(client, &wl_touch_interface, resource, id);
+}
+
+void MockCompositor::State::bind_wm_base(struct wl_client *client, void *data, uint32_t version, uint32_t id) {
+    if (const auto resource = create_resource(client, &xdg_wm_base_interface, static_cast<int>(version), id)) {
+        wl_resource_set_implementation(resource, &wm_base_impl, data, nullptr);
+    }
+}
+
+void MockCompositor::State::create_positioner(struct wl_client *client, struct wl_resource *resource, uint32_t id) {
+    create_inert(client, &xdg_positioner_interface, resource, id);
+}
+
+void MockCompositor::State::get_xdg_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id,
+                                            struct wl_resource *surface_resource) {
+    const auto surface = static_cast<Surface *>(wl_resource_get_user_data(surface_resource));
+    if (const auto xdg_surface = create_resource(client, &xdg_surface_interface, wl_resource_get_version(resource),
+                                                 id)) {
+        wl_resource_set_implementation(xdg_surface, &xdg_surface_impl, surface, xdg_surface_destroyed);
+        surface->xdg_surface = xdg_surface;
+    }
+}
+
+void MockCompositor::State::xdg_surface_destroyed(struct wl_resource *resource) {
+    if (const auto surface = static_cast<Surface *>(wl_resource_get_user_data(resource))) {
+        surface->xdg_surface = nullptr;
+    }
+}
+
+void MockCompositor::State::get_toplevel(struct wl_client *client, struct wl_resource *resource, uint32_t id) {
+    const auto surface = static_cast<Surface *>(wl_resource_get_user_data(resource));
+    const auto toplevel = create_resource(client, &xdg_toplevel_interface, wl_resource_get_version(resource), id);
+    if (!toplevel) {
+        return;
+    }
+    wl_resource_set_dispatcher(toplevel, ignore_requests, nullptr, surface, toplevel_destroyed);
+    if (surface) {
+        surface->toplevel = toplevel;
+        surface->configure_sent = false;
+    }
+}
+
+void MockCompositor::State::toplevel_destroyed(struct wl_resource *resource) {
+    if (const auto surface = static_cast<Surface *>(wl_resource_get_user_data(resource))) {
+        surface->toplevel = nullptr;
+        surface->state->unmap(surface);
+    }
+}
+
+void MockCompositor::State::get_popup(struct wl_client *client, struct wl_resource *resource, uint32_t id,
+                                      struct wl_resource * /* parent */, struct wl_resource * /* positioner */) {
+    create_inert(client, &xdg_popup_interface, resource, id);
+}
+
+void MockCompositor::State::ack_configure(struct wl_client * /* client */, struct wl_resource *resource,
+                                          uint32_t /* serial */) {
+    const auto surface = static_cast<Surface *>(wl_resource_get_user_data(resource));
+    if (!surface || !surface->toplevel) {
+        return;
+    }
+    const auto state = surface->state;
+    if (std::find(state->mapped.begin(), state->mapped.end(), surface) == state->mapped.end()) {
+        state->mapped.push_back(surface);
+    }
+    if (!state->focus) {
+        state->set_focus(surface);
+    }
+}
+
+const struct wl_compositor_interface MockCompositor::State::compositor_impl = {
+        .create_surface = create_surface,
+        .create_region = create_region,
+};
+
+const struct wl_surface_interface MockCompositor::State::surface_impl = {
+        .destroy = destroy_resource,
+        .attach = surface_attach,
+        .damage = ignore<int32_t, int32_t, int32_t, int32_t>,
+        .frame = surface_frame,
+        .set_opaque_region = ignore<struct wl_resource *>,
+        .set_input_region = ignore<struct wl_resource *>,
+        .commit = surface_commit,
+        .set_buffer_transform = ignore<int32_t>,
+        .set_buffer_scale = ignore<int32_t>,
+        .damage_buffer = ignore<int32_t, int32_t, int32_t, int32_t>,
+        .offset = ignore<int32_t, int32_t>,
+};
+
+const struct wl_subcompositor_interface MockCompositor::State::subcompositor_impl = {
+        .destroy = destroy_resource,
+        .get_subsurface = get_subsurface,
+};
+
+const struct wl_seat_interface MockCompositor::State::seat_impl = {
+        .get_pointer = get_pointer,
+        .get_keyboard = get_keyboard,
+        .get_touch = get_touch,
+        .release = destroy_resource,
+};
+
+const struct xdg_wm_base_interface MockCompositor::State::wm_base_impl = {
+        .destroy = destroy_resource,
+        .create_positioner = create_positioner,
+        .get_xdg_surface = get_xdg_surface,
+        .pong = ignore<uint32_t>,
+};
+
+const struct xdg_surface_interface MockCompositor::State::xdg_surface_impl = {
+        .destroy = destroy_resource,
+        .get_toplevel = get_toplevel,
+        .get_popup = get_popup,
+        .set_window_geometry = ignore<int32_t, int32_t, int32_t, int32_t>,
+        .ack_configure = ack_configure,
+};
+
+/**
+ * @brief Starts the compositor thread listening on a new socket.
+ *
+ * @throws std::runtime_error if the display or its socket cannot be created.
+ */
+MockCompositor::MockCompositor() : state_(std::make_unique<State>()) {
+}
+
+/**
+ * @brief Disconnects the remaining clients and removes the socket.
+ */
+MockCompositor::~MockCompositor() = default;
+
+const char *MockCompositor::get_socket_name() const {
+    return state_->socket;
+}
+
+/**
+ * @brief Sends pointer motion to the focused surface, each event in its own frame.
+ *
+ * Keep count small enough for the events to fit the connection buffer, e.g. 64.
+ *
+ * @param count The number of motion events.
+ * @return count, or 0 if no pointer of the focused client is there to send them to.
+ */
+uint32_t MockCompositor::send_pointer_motion(uint32_t count) {
+    uint32_t sent = 0;
+    state_->run([this, count, &sent] {
+        const auto state = state_.get();
+        for (const auto pointer: state->pointers) {
+            if (!state->focused(pointer)) {
+                continue;
+            }
+            const bool frames = wl_resource_get_version(pointer) >= WL_POINTER_FRAME_SINCE_VERSION;
+            for (uint32_t i = 0; i < count; i++) {
+                const auto position = wl_fixed_from_int(static_cast<int>(i & 0xff));
+                wl_pointer_send_motion(pointer, now_ms(), position, position);
+                if (frames) {
+                    wl_pointer_send_frame(pointer);
+                }
+            }
+            sent = count;
+        }
+    });
+    return sent;
+}
+
+/**
+ * @brief Sends key events of one key to the focused surface, a press followed by a release.
+ *
+ * @param count The number of key events, even to end up with the key released.
+ * @return count, or 0 if no keyboard of the focused client is there to send them to.
+ */
+uint32_t MockCompositor::send_keys(uint32_t count) {
+    uint32_t sent = 0;
+    state_->run([this, count, &sent] {
+        const auto state = state_.get();
+        for (const auto keyboard: state->keyboards) {
+            if (!state->focused(keyboard)) {
+                continue;
+            }
+            for (uint32_t i = 0; i < count; i++) {
+                wl_keyboard_send_key(keyboard, wl_display_next_serial(state->display), now_ms(), kKey,
+                                     i & 1 ? WL_KEYBOARD_KEY_STATE_RELEASED : WL_KEYBOARD_KEY_STATE_PRESSED);
+            }
+            sent = count;
+        }
+    });
+    return sent;
+}
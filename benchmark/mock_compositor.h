@@ -0,0 +1,64 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BENCHMARK_MOCK_COMPOSITOR_H_
+#define BENCHMARK_MOCK_COMPOSITOR_H_
+
+#include <memory>
+
+
+/**
+ * @brief A minimal Wayland compositor running on its own thread in the benchmark process.
+ *
+ * Advertises the globals Display binds eagerly: wl_compositor, wl_subcompositor,
+ * wl_shm, one wl_output at 60 Hz, a wl_seat with pointer and keyboard, and
+ * xdg_wm_base. Nothing is drawn; buffers are released and frame callbacks are
+ * done on the commit that requested them, so the numbers are what waypp and
+ * libwayland spend, not a repaint cycle. The first toplevel to ack its configure
+ * gets pointer and keyboard focus, passed on to the last one mapped once it goes;
+ * no leave events are sent.
+ *
+ * Keeps the libwayland-server types out of this header, so it can be included
+ * next to the client headers.
+ */
+class MockCompositor {
+public:
+    MockCompositor();
+
+    ~MockCompositor();
+
+    MockCompositor(const MockCompositor &) = delete;
+
+    MockCompositor &operator=(const MockCompositor &) = delete;
+
+    // pass as the Display name; the socket is in XDG_RUNTIME_DIR, a temporary one if unset
+    [[nodiscard]] const char *get_socket_name() const;
+
+    // count wl_pointer.motion, each in its own frame, to the focused surface;
+    // returns once they are flushed, with the number sent, 0 without focus
+    uint32_t send_pointer_motion(uint32_t count);
+
+    // count wl_keyboard.key of one key, pressed and released in turn, as above
+    uint32_t send_keys(uint32_t count);
+
+private:
+    struct State;
+
+    std::unique_ptr<State> state_;
+};
+
+#endif // BENCHMARK_MOCK_COMPOSITOR_H_
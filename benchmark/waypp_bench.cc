@@ -0,0 +1,162 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <memory>
+
+#include <benchmark/benchmark.h>
+
+#include "mock_compositor.h"
+#include "window_manager/window_manager.h"
+
+namespace {
+
+// fits the connection buffer and a window's InputRing with room to spare
+constexpr uint32_t kBatch = 64;
+
+MockCompositor &compositor() {
+    static MockCompositor instance;
+    return instance;
+}
+
+/**
+ * @brief Connects a window to the mock and waits until its input arrives.
+ *
+ * The window renders on demand, so no frame loop runs beside the benchmark. Focus
+ * is probed with pointer motion rather than asked for, as the mock may still hold
+ * the focus of a window whose disconnect it has not seen yet.
+ *
+ * @return The window, or nullptr with the benchmark skipped.
+ */
+std::unique_ptr<WindowManager> create_focused_window(benchmark::State &state) {
+    auto wm = std::make_unique<WindowManager>(Window::XDG, nullptr, false, compositor().get_socket_name());
+    wm->set_render_on_demand(true);
+    for (int i = 0; i < 100; i++) {
+        const bool sent = compositor().send_pointer_motion(1) != 0;
+        if (wl_display_roundtrip(wm->get_display()) < 0) {
+            break;
+        }
+        if (sent && wm->get_input_ring().drain([](const InputEvent &) {}) != 0) {
+            return wm;
+        }
+    }
+    state.SkipWithError("the window got no input focus");
+    return nullptr;
+}
+
+/**
+ * @brief Display construction: connect, enumerate the registry, bind, and the two roundtrips.
+ */
+void BM_RegistryRoundTrip(benchmark::State &state) {
+    for (auto _: state) {
+        Display display(nullptr, false, compositor().get_socket_name());
+        benchmark::DoNotOptimize(display.get_compositor());
+    }
+}
+
+/**
+ * @brief Runs count input events through the seat into the window's InputRing per iteration.
+ *
+ * Only the client side is timed: reading the events, dispatching them through the
+ * device and pushing them to the ring, and the roundtrip that ends the batch.
+ */
+template<typename Send>
+void run_input_batches(benchmark::State &state, Send send, InputEvent::Type type) {
+    const auto wm = create_focused_window(state);
+    if (!wm) {
+        return;
+    }
+    uint64_t events = 0;
+    for (auto _: state) {
+        state.PauseTiming();
+        const uint32_t sent = send(kBatch);
+        state.ResumeTiming();
+        if (sent != kBatch || wl_display_roundtrip(wm->get_display()) < 0) {
+            state.SkipWithError("the compositor lost the window");
+            break;
+        }
+        size_t received = 0;
+        (void) wm->get_input_ring().drain([&received, type](const InputEvent &event) {
+            received += event.type == type;
+        });
+        if (received != kBatch) {
+            state.SkipWithError("input events were dropped");
+            break;
+        }
+        events += received;
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(events));
+}
+
+void BM_PointerDispatch(benchmark::State &state) {
+    run_input_batches(state, [](uint32_t count) { return compositor().send_pointer_motion(count); },
+                      InputEvent::POINTER_MOTION);
+}
+
+// each press and release is translated through the keymap
+void BM_KeyboardDispatch(benchmark::State &state) {
+    run_input_batches(state, [](uint32_t count) { return compositor().send_keys(count); }, InputEvent::KEY);
+}
+
+/**
+ * @brief From request_redraw() to the draw the frame callback starts, over the event loop.
+ */
+void BM_FrameCallback(benchmark::State &state) {
+    const auto wm = create_focused_window(state);
+    if (!wm) {
+        return;
+    }
+    for (auto _: state) {
+        bool drawn = false;
+        wm->on_next_frame([&drawn](uint32_t /* time */) { drawn = true; });
+        while (!drawn && wm->poll_events(1000) > 0) {
+        }
+        if (!drawn) {
+            state.SkipWithError("no frame callback arrived");
+            break;
+        }
+    }
+}
+
+/**
+ * @brief An xdg toplevel created, configured and destroyed again.
+ */
+void BM_WindowCreation(benchmark::State &state) {
+    const auto wm = create_focused_window(state);
+    if (!wm) {
+        return;
+    }
+    for (auto _: state) {
+        const auto toplevel = wm->create_toplevel(320, 240);
+        while (!toplevel->get_xdg_wm().configured() && wl_display_roundtrip(wm->get_display()) >= 0) {
+        }
+        const bool configured = toplevel->get_xdg_wm().configured();
+        wm->destroy_toplevel(toplevel);
+        if (!configured) {
+            state.SkipWithError("the toplevel got no configure");
+            break;
+        }
+    }
+    (void) wl_display_roundtrip(wm->get_display());
+}
+
+BENCHMARK(BM_RegistryRoundTrip)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_PointerDispatch);
+BENCHMARK(BM_KeyboardDispatch);
+BENCHMARK(BM_FrameCallback)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_WindowCreation)->Unit(benchmark::kMicrosecond);
+
+}  // namespace
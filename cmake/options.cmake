@@ -20,6 +20,61 @@
 option(BUILD_UNIT_TESTS "Build Unit Tests" OFF)
 MESSAGE(STATUS "Build Unit Tests ....... ${BUILD_UNIT_TESTS}")
 
+#
+# Benchmarks
+#
+option(BUILD_BENCHMARKS "Build waypp_bench, needs Google Benchmark and wayland-server" OFF)
+MESSAGE(STATUS "Build Benchmarks ....... ${BUILD_BENCHMARKS}")
+
+#
+# Shared library
+#
+option(BUILD_SHARED_LIBS "Build waypp as a shared library exporting only its public classes" OFF)
+MESSAGE(STATUS "Shared Library ......... ${BUILD_SHARED_LIBS}")
+
+#
+# Link time and profile guided optimization
+#
+option(ENABLE_LTO "Build waypp with link time optimization" OFF)
+MESSAGE(STATUS "LTO .................... ${ENABLE_LTO}")
+
+# GENERATE instruments the build, run the pgo-train target, then reconfigure with USE
+set(PGO "OFF" CACHE STRING "Profile guided optimization: OFF, GENERATE or USE")
+set_property(CACHE PGO PROPERTY STRINGS OFF GENERATE USE)
+set(PGO_PROFILE_DIR "${CMAKE_BINARY_DIR}/pgo-profile" CACHE PATH "Where pgo-train writes and USE reads the profile")
+MESSAGE(STATUS "PGO .................... ${PGO}")
+
+#
+# Vulkan
+#
+option(ENABLE_VULKAN "Enable Vulkan windows" OFF)
+MESSAGE(STATUS "Vulkan ................. ${ENABLE_VULKAN}")
+
+#
+# Tracing
+#
+option(ENABLE_TRACING "Emit trace events to the ftrace trace_marker for Perfetto" OFF)
+MESSAGE(STATUS "Tracing ................ ${ENABLE_TRACING}")
+
+#
+# Protocol statistics
+#
+option(ENABLE_PROTOCOL_STATS "Count Wayland requests, events and bytes per interface" OFF)
+MESSAGE(STATUS "Protocol Stats ......... ${ENABLE_PROTOCOL_STATS}")
+
+#
+# Realtime scheduling through rtkit
+#
+option(ENABLE_RTKIT "Request realtime thread priority from rtkit over D-Bus" OFF)
+MESSAGE(STATUS "rtkit .................. ${ENABLE_RTKIT}")
+
+#
+# Logging
+#
+set(LOG_LEVEL "INFO" CACHE STRING "Lowest log level compiled in: TRACE, DEBUG, INFO, WARN, ERROR or OFF")
+set_property(CACHE LOG_LEVEL PROPERTY STRINGS TRACE DEBUG INFO WARN ERROR OFF)
+MESSAGE(STATUS "Log Level .............. ${LOG_LEVEL}")
+
 #
 # Sanitizers
 #
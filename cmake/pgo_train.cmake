@@ -0,0 +1,67 @@
+#
+# Copyright 2024 Joel Winarske
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+#
+# Runs the bundled workloads against a PGO=GENERATE build, in script mode:
+#
+#   cmake -DWORKLOAD=... -DSTRESS=... -DDEMO=... -DPROFILE_DIR=... -DCOMPILER_ID=... -P pgo_train.cmake
+#
+# The headless runs cover the frame and upload paths. With a compositor, i.e.
+# WAYLAND_DISPLAY set, the windowed workloads and the multi-window stress run add
+# registry, configure, frame callback and input dispatch. Every run is fixed in
+# length and scene, so the profile is the same from one training to the next.
+#
+
+file(MAKE_DIRECTORY ${PROFILE_DIR})
+if (COMPILER_ID MATCHES "Clang")
+    file(GLOB STALE_PROFILES ${PROFILE_DIR}/*.profraw)
+else ()
+    file(GLOB_RECURSE STALE_PROFILES ${PROFILE_DIR}/*.gcda)
+endif ()
+if (STALE_PROFILES)
+    file(REMOVE ${STALE_PROFILES})
+endif ()
+
+macro(train)
+    string(REPLACE ";" " " TRAIN_COMMAND "${ARGN}")
+    message(STATUS "pgo-train: ${TRAIN_COMMAND}")
+    execute_process(COMMAND ${ARGN} RESULT_VARIABLE TRAIN_RESULT)
+    if (NOT TRAIN_RESULT EQUAL 0)
+        message(FATAL_ERROR "pgo-train: ${TRAIN_COMMAND} failed: ${TRAIN_RESULT}")
+    endif ()
+endmacro()
+
+foreach (SCENARIO fill draws upload overdraw)
+    train(${WORKLOAD} --headless --scenario ${SCENARIO} --seconds 5)
+endforeach ()
+train(${DEMO} --headless 600)
+
+if (DEFINED ENV{WAYLAND_DISPLAY})
+    foreach (SCENARIO fill draws upload)
+        train(${WORKLOAD} --scenario ${SCENARIO} --seconds 5)
+    endforeach ()
+    train(${STRESS} 16 10)
+else ()
+    message(WARNING "pgo-train: WAYLAND_DISPLAY is not set, the profile only covers the headless paths")
+endif ()
+
+if (COMPILER_ID MATCHES "Clang")
+    file(GLOB PROFILES ${PROFILE_DIR}/*.profraw)
+    find_program(LLVM_PROFDATA NAMES llvm-profdata REQUIRED)
+    train(${LLVM_PROFDATA} merge -output=${PROFILE_DIR}/waypp.profdata ${PROFILES})
+endif ()
+
+message(STATUS "pgo-train: profile written to ${PROFILE_DIR}, reconfigure with -DPGO=USE")
@@ -18,22 +18,84 @@
 #
 # Client Options
 #
+# Each protocol below an option is only generated, compiled and linked when it is on,
+# together with the code using it. xdg-shell is the default shell and always built.
+#
 option(ENABLE_XDG_CLIENT "Enable XDG Client" ON)
-option(ENABLE_AGL_SHELL_CLIENT "Enable AGL shell Client" OFF)
-option(ENABLE_IVI_SHELL_CLIENT "Enable ivi-shell Client" OFF)
+option(ENABLE_XDG_DECORATION "Negotiate server-side decorations over xdg-decoration" ON)
+option(ENABLE_AGL_SHELL_CLIENT "Enable AGL shell Client" ON)
+option(ENABLE_IVI_SHELL_CLIENT "Enable ivi-shell Client" ON)
+option(ENABLE_IMAGE_CAPTURE "Enable output and toplevel capture over ext-image-copy-capture" ON)
+option(ENABLE_TEARING_CONTROL "Allow tearing presentation over tearing-control" ON)
+option(ENABLE_CONTENT_TYPE "Hint the surface content type over content-type" ON)
+option(ENABLE_IDLE_NOTIFY "Report user idle time over ext-idle-notify" ON)
+option(ENABLE_ALPHA_MODIFIER "Fade surfaces in the compositor over alpha-modifier" ON)
+option(ENABLE_FIFO "Queue frames in the compositor over fifo" ON)
+option(ENABLE_COMMIT_TIMING "Time commits to their presentation over commit-timing" ON)
+option(ENABLE_SINGLE_PIXEL_BUFFER "Draw solid colors without buffer memory over single-pixel-buffer" ON)
+option(ENABLE_COLOR_MANAGEMENT "Describe buffer color spaces over color-management" ON)
+option(ENABLE_OUTPUT_POWER "Track output power over wlr-output-power-management" ON)
+
+if (NOT ENABLE_XDG_CLIENT)
+    message(FATAL_ERROR "ENABLE_XDG_CLIENT cannot be turned off, xdg-shell is the default shell")
+endif ()
 
 find_package(PkgConfig REQUIRED)
 pkg_check_modules(WAYLAND REQUIRED IMPORTED_TARGET wayland-client wayland-egl wayland-cursor xkbcommon)
 
-set(MIN_PROTOCOL_VER 1.13)
-if (BUILD_BACKEND_WAYLAND_DRM)
-    set(MIN_PROTOCOL_VER 1.22)
-endif ()
+# what the protocols built into every configuration need: fractional-scale 1.31, cursor-shape 1.32,
+# linux-drm-syncobj 1.34
+set(MIN_PROTOCOL_VER 1.34)
 pkg_check_modules(WAYLAND_PROTOCOLS REQUIRED wayland-protocols>=${MIN_PROTOCOL_VER})
 pkg_get_variable(WAYLAND_PROTOCOLS_BASE wayland-protocols pkgdatadir)
 
+# optional protocols newer than that are left out when the wayland-protocols found predates them
+foreach (protocol_requirement ENABLE_ALPHA_MODIFIER:1.35 ENABLE_IMAGE_CAPTURE:1.37 ENABLE_FIFO:1.38
+        ENABLE_COMMIT_TIMING:1.38 ENABLE_COLOR_MANAGEMENT:1.41)
+    string(REPLACE ":" ";" protocol_requirement ${protocol_requirement})
+    list(GET protocol_requirement 0 protocol_option)
+    list(GET protocol_requirement 1 protocol_version)
+    if (${protocol_option} AND WAYLAND_PROTOCOLS_VERSION VERSION_LESS ${protocol_version})
+        message(STATUS "${protocol_option} needs wayland-protocols ${protocol_version}, "
+                "found ${WAYLAND_PROTOCOLS_VERSION}, turned off")
+        set(${protocol_option} OFF)
+    endif ()
+endforeach ()
+
+MESSAGE(STATUS "xdg-decoration ......... ${ENABLE_XDG_DECORATION}")
+MESSAGE(STATUS "AGL shell .............. ${ENABLE_AGL_SHELL_CLIENT}")
+MESSAGE(STATUS "ivi-shell .............. ${ENABLE_IVI_SHELL_CLIENT}")
+MESSAGE(STATUS "Image capture .......... ${ENABLE_IMAGE_CAPTURE}")
+MESSAGE(STATUS "Tearing control ........ ${ENABLE_TEARING_CONTROL}")
+MESSAGE(STATUS "Content type ........... ${ENABLE_CONTENT_TYPE}")
+MESSAGE(STATUS "Idle notify ............ ${ENABLE_IDLE_NOTIFY}")
+MESSAGE(STATUS "Alpha modifier ......... ${ENABLE_ALPHA_MODIFIER}")
+MESSAGE(STATUS "FIFO ................... ${ENABLE_FIFO}")
+MESSAGE(STATUS "Commit timing .......... ${ENABLE_COMMIT_TIMING}")
+MESSAGE(STATUS "Single pixel buffer .... ${ENABLE_SINGLE_PIXEL_BUFFER}")
+MESSAGE(STATUS "Color management ....... ${ENABLE_COLOR_MANAGEMENT}")
+MESSAGE(STATUS "Output power ........... ${ENABLE_OUTPUT_POWER}")
+
 find_program(WAYLAND_SCANNER_EXECUTABLE NAMES wayland-scanner REQUIRED)
 
+# wlcpp:: RAII wrappers with typed requests and listeners, see wayland_cpp_scanner.py
+option(ENABLE_CPP_PROTOCOLS "Generate header-only C++ wrappers for every protocol" OFF)
+MESSAGE(STATUS "C++ protocol wrappers .. ${ENABLE_CPP_PROTOCOLS}")
+if (ENABLE_CPP_PROTOCOLS)
+    find_package(Python3 REQUIRED COMPONENTS Interpreter)
+    set(WAYLAND_CPP_SCANNER ${CMAKE_CURRENT_LIST_DIR}/wayland_cpp_scanner.py)
+endif ()
+
+macro(wayland_generate_cpp protocol_file c_header output_file)
+    if (ENABLE_CPP_PROTOCOLS)
+        add_custom_command(OUTPUT ${output_file}-cpp.h
+                COMMAND ${Python3_EXECUTABLE} ${WAYLAND_CPP_SCANNER} ${protocol_file} ${c_header} ${output_file}-cpp.h
+                DEPENDS ${protocol_file} ${WAYLAND_CPP_SCANNER})
+        list(APPEND WAYLAND_PROTOCOL_SOURCES ${output_file}-cpp.h)
+        list(APPEND WAYLAND_CPP_HEADERS ${output_file}-cpp.h)
+    endif ()
+endmacro()
+
 macro(wayland_generate protocol_file output_file)
     add_custom_command(OUTPUT ${output_file}.h
             COMMAND ${WAYLAND_SCANNER_EXECUTABLE} client-header < ${protocol_file} > ${output_file}.h
@@ -44,35 +106,186 @@ macro(wayland_generate protocol_file output_file)
             COMMAND ${WAYLAND_SCANNER_EXECUTABLE} private-code < ${protocol_file} > ${output_file}.c
             DEPENDS ${protocol_file})
     list(APPEND WAYLAND_PROTOCOL_SOURCES ${output_file}.c)
+
+    get_filename_component(c_header_name ${output_file}.h NAME)
+    wayland_generate_cpp(${protocol_file} ${c_header_name} ${output_file})
 endmacro()
 
 set(WAYLAND_PROTOCOL_SOURCES)
+set(WAYLAND_CPP_HEADERS)
+
+# the core protocol's C header and code come with libwayland, only the wrappers are generated
+pkg_get_variable(WAYLAND_SCANNER_DATADIR wayland-scanner pkgdatadir)
+wayland_generate_cpp(${WAYLAND_SCANNER_DATADIR}/wayland.xml wayland-client-protocol.h
+        ${CMAKE_CURRENT_BINARY_DIR}/wayland-client-protocol)
 
 wayland_generate(
         ${WAYLAND_PROTOCOLS_BASE}/stable/xdg-shell/xdg-shell.xml
         ${CMAKE_CURRENT_BINARY_DIR}/xdg-shell-client-protocol)
 
 wayland_generate(
-        ${WAYLAND_PROTOCOLS_BASE}/unstable/xdg-decoration/xdg-decoration-unstable-v1.xml
-        ${CMAKE_CURRENT_BINARY_DIR}/xdg-decoration-unstable-client-protocol)
+        ${WAYLAND_PROTOCOLS_BASE}/stable/presentation-time/presentation-time.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/presentation-time-client-protocol)
 
 wayland_generate(
-        ${CMAKE_SOURCE_DIR}/third_party/agl/protocol/agl-shell.xml
-        ${CMAKE_CURRENT_BINARY_DIR}/agl-shell-client-protocol)
+        ${WAYLAND_PROTOCOLS_BASE}/stable/viewporter/viewporter.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/viewporter-client-protocol)
+
 wayland_generate(
-        ${CMAKE_SOURCE_DIR}/third_party/agl/protocol/agl-shell-desktop.xml
-        ${CMAKE_CURRENT_BINARY_DIR}/agl-shell-desktop-client-protocol)
+        ${WAYLAND_PROTOCOLS_BASE}/staging/fractional-scale/fractional-scale-v1.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/fractional-scale-v1-client-protocol)
+
 wayland_generate(
-        ${CMAKE_SOURCE_DIR}/third_party/agl/protocol/agl-screenshooter.xml
-        ${CMAKE_CURRENT_BINARY_DIR}/agl-screenshooter-client-protocol)
+        ${WAYLAND_PROTOCOLS_BASE}/staging/linux-drm-syncobj/linux-drm-syncobj-v1.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/linux-drm-syncobj-v1-client-protocol)
+
+if (ENABLE_TEARING_CONTROL)
+    wayland_generate(
+            ${WAYLAND_PROTOCOLS_BASE}/staging/tearing-control/tearing-control-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/tearing-control-v1-client-protocol)
+endif ()
 
+if (ENABLE_CONTENT_TYPE)
+    wayland_generate(
+            ${WAYLAND_PROTOCOLS_BASE}/staging/content-type/content-type-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/content-type-v1-client-protocol)
+endif ()
+
+# tablet input, also referenced by cursor-shape-v1
 wayland_generate(
-        ${CMAKE_SOURCE_DIR}/third_party/weston/protocol/ivi-application.xml
-        ${CMAKE_CURRENT_BINARY_DIR}/ivi-application-client-protocol)
+        ${WAYLAND_PROTOCOLS_BASE}/unstable/tablet/tablet-unstable-v2.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/tablet-unstable-v2-client-protocol)
+
 wayland_generate(
-        ${CMAKE_SOURCE_DIR}/third_party/weston/protocol/ivi-wm.xml
-        ${CMAKE_CURRENT_BINARY_DIR}/ivi-wm-client-protocol)
+        ${WAYLAND_PROTOCOLS_BASE}/staging/cursor-shape/cursor-shape-v1.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/cursor-shape-v1-client-protocol)
+
+if (ENABLE_IMAGE_CAPTURE)
+    wayland_generate(
+            ${WAYLAND_PROTOCOLS_BASE}/staging/ext-image-capture-source/ext-image-capture-source-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/ext-image-capture-source-v1-client-protocol)
+
+    wayland_generate(
+            ${WAYLAND_PROTOCOLS_BASE}/staging/ext-image-copy-capture/ext-image-copy-capture-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/ext-image-copy-capture-v1-client-protocol)
+endif ()
+
+if (ENABLE_IDLE_NOTIFY)
+    wayland_generate(
+            ${WAYLAND_PROTOCOLS_BASE}/staging/ext-idle-notify/ext-idle-notify-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/ext-idle-notify-v1-client-protocol)
+endif ()
+
+if (ENABLE_ALPHA_MODIFIER)
+    wayland_generate(
+            ${WAYLAND_PROTOCOLS_BASE}/staging/alpha-modifier/alpha-modifier-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/alpha-modifier-v1-client-protocol)
+endif ()
+
+if (ENABLE_FIFO)
+    wayland_generate(
+            ${WAYLAND_PROTOCOLS_BASE}/staging/fifo/fifo-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/fifo-v1-client-protocol)
+endif ()
+
+if (ENABLE_COMMIT_TIMING)
+    wayland_generate(
+            ${WAYLAND_PROTOCOLS_BASE}/staging/commit-timing/commit-timing-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/commit-timing-v1-client-protocol)
+endif ()
+
+if (ENABLE_SINGLE_PIXEL_BUFFER)
+    wayland_generate(
+            ${WAYLAND_PROTOCOLS_BASE}/staging/single-pixel-buffer/single-pixel-buffer-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/single-pixel-buffer-v1-client-protocol)
+endif ()
 
+if (ENABLE_COLOR_MANAGEMENT)
+    wayland_generate(
+            ${WAYLAND_PROTOCOLS_BASE}/staging/color-management/color-management-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/color-management-v1-client-protocol)
+endif ()
+
+if (ENABLE_OUTPUT_POWER)
+    # output power state, so windows on a blanked output stop drawing
+    wayland_generate(
+            ${CMAKE_SOURCE_DIR}/third_party/wlr/protocol/wlr-output-power-management-unstable-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/wlr-output-power-management-unstable-v1-client-protocol)
+endif ()
+
+wayland_generate(
+        ${WAYLAND_PROTOCOLS_BASE}/staging/xdg-activation/xdg-activation-v1.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/xdg-activation-v1-client-protocol)
+
+wayland_generate(
+        ${WAYLAND_PROTOCOLS_BASE}/unstable/xdg-output/xdg-output-unstable-v1.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/xdg-output-unstable-v1-client-protocol)
+
+wayland_generate(
+        ${WAYLAND_PROTOCOLS_BASE}/unstable/input-timestamps/input-timestamps-unstable-v1.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/input-timestamps-unstable-v1-client-protocol)
+
+wayland_generate(
+        ${WAYLAND_PROTOCOLS_BASE}/unstable/relative-pointer/relative-pointer-unstable-v1.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/relative-pointer-unstable-v1-client-protocol)
+
+wayland_generate(
+        ${WAYLAND_PROTOCOLS_BASE}/unstable/pointer-constraints/pointer-constraints-unstable-v1.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/pointer-constraints-unstable-v1-client-protocol)
+
+wayland_generate(
+        ${WAYLAND_PROTOCOLS_BASE}/unstable/pointer-gestures/pointer-gestures-unstable-v1.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/pointer-gestures-unstable-v1-client-protocol)
+
+wayland_generate(
+        ${WAYLAND_PROTOCOLS_BASE}/unstable/primary-selection/primary-selection-unstable-v1.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/primary-selection-unstable-v1-client-protocol)
+
+wayland_generate(
+        ${WAYLAND_PROTOCOLS_BASE}/unstable/text-input/text-input-unstable-v3.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/text-input-unstable-v3-client-protocol)
+
+wayland_generate(
+        ${WAYLAND_PROTOCOLS_BASE}/unstable/linux-dmabuf/linux-dmabuf-unstable-v1.xml
+        ${CMAKE_CURRENT_BINARY_DIR}/linux-dmabuf-unstable-v1-client-protocol)
+
+if (ENABLE_XDG_DECORATION)
+    wayland_generate(
+            ${WAYLAND_PROTOCOLS_BASE}/unstable/xdg-decoration/xdg-decoration-unstable-v1.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/xdg-decoration-unstable-client-protocol)
+endif ()
+
+if (ENABLE_AGL_SHELL_CLIENT)
+    wayland_generate(
+            ${CMAKE_SOURCE_DIR}/third_party/agl/protocol/agl-shell.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/agl-shell-client-protocol)
+    wayland_generate(
+            ${CMAKE_SOURCE_DIR}/third_party/agl/protocol/agl-shell-desktop.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/agl-shell-desktop-client-protocol)
+    wayland_generate(
+            ${CMAKE_SOURCE_DIR}/third_party/agl/protocol/agl-screenshooter.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/agl-screenshooter-client-protocol)
+endif ()
+
+if (ENABLE_IVI_SHELL_CLIENT)
+    wayland_generate(
+            ${CMAKE_SOURCE_DIR}/third_party/weston/protocol/ivi-application.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/ivi-application-client-protocol)
+    wayland_generate(
+            ${CMAKE_SOURCE_DIR}/third_party/weston/protocol/ivi-wm.xml
+            ${CMAKE_CURRENT_BINARY_DIR}/ivi-wm-client-protocol)
+endif ()
+
+if (ENABLE_CPP_PROTOCOLS)
+    # includes every wrapper, so their static_asserts against the C stubs are checked by each build
+    set(WAYLAND_CPP_INCLUDES)
+    foreach (header ${WAYLAND_CPP_HEADERS})
+        get_filename_component(header_name ${header} NAME)
+        string(APPEND WAYLAND_CPP_INCLUDES "#include \"${header_name}\"\n")
+    endforeach ()
+    file(GENERATE OUTPUT ${CMAKE_CURRENT_BINARY_DIR}/wayland-cpp-protocols.cc CONTENT "${WAYLAND_CPP_INCLUDES}")
+    list(APPEND WAYLAND_PROTOCOL_SOURCES ${CMAKE_CURRENT_BINARY_DIR}/wayland-cpp-protocols.cc)
+endif ()
 
 add_library(wayland-gen STATIC ${WAYLAND_PROTOCOL_SOURCES})
 target_link_libraries(wayland-gen PUBLIC PkgConfig::WAYLAND)
@@ -81,12 +294,24 @@ target_link_libraries(wayland-gen PUBLIC PkgConfig::WAYLAND)
 if (ENABLE_XDG_CLIENT)
     target_compile_definitions(wayland-gen PUBLIC ENABLE_XDG_CLIENT)
 endif ()
+if (ENABLE_XDG_DECORATION)
+    target_compile_definitions(wayland-gen PUBLIC ENABLE_XDG_DECORATION)
+endif ()
 if (ENABLE_AGL_SHELL_CLIENT)
     target_compile_definitions(wayland-gen PUBLIC ENABLE_AGL_SHELL_CLIENT)
 endif ()
 if (ENABLE_IVI_SHELL_CLIENT)
     target_compile_definitions(wayland-gen PUBLIC ENABLE_IVI_SHELL_CLIENT)
 endif ()
+if (ENABLE_IMAGE_CAPTURE)
+    target_compile_definitions(wayland-gen PUBLIC ENABLE_IMAGE_CAPTURE)
+endif ()
+foreach (protocol_option ENABLE_TEARING_CONTROL ENABLE_CONTENT_TYPE ENABLE_IDLE_NOTIFY ENABLE_ALPHA_MODIFIER ENABLE_FIFO
+        ENABLE_COMMIT_TIMING ENABLE_SINGLE_PIXEL_BUFFER ENABLE_COLOR_MANAGEMENT ENABLE_OUTPUT_POWER)
+    if (${protocol_option})
+        target_compile_definitions(wayland-gen PUBLIC ${protocol_option})
+    endif ()
+endforeach ()
 
 target_include_directories(wayland-gen PUBLIC ${CMAKE_CURRENT_BINARY_DIR})
 
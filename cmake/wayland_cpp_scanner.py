@@ -0,0 +1,402 @@
+#!/usr/bin/env python3
+#
+# Copyright 2024 Joel Winarske
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+
+"""
+Generates header-only C++ wrappers for a Wayland protocol XML, next to the
+wayland-scanner client header they include:
+
+    wayland_cpp_scanner.py <protocol.xml> <c header> <output header>
+
+Every interface becomes a move-only RAII class in namespace wlcpp, named like
+the interface, owning one proxy. Requests are inline member functions with the
+protocol's argument types; they fill the wl_argument array themselves and call
+wl_proxy_marshal_array_flags(), so no va_list is walked per request. Opcodes
+are checked against the C header at compile time. Requests creating objects
+return the owning wrapper of the new object.
+
+add_listener(T *) builds the C listener table once per T: event "name" calls
+T::on_name(proxy, args...) if T has it, signatures are checked when the table
+is instantiated, events T has no member for are ignored.
+"""
+
+import sys
+import xml.etree.ElementTree as ET
+
+# C++ keywords that are valid protocol names
+KEYWORDS = {'class', 'default', 'delete', 'new', 'operator', 'private', 'protected', 'public', 'register',
+            'template', 'this', 'union', 'namespace', 'export', 'explicit', 'virtual', 'switch', 'case'}
+
+# members of every wrapper, a request of the same name gets a _request suffix
+HELPERS = {'get', 'take', 'reset', 'get_version', 'set_queue', 'add_listener', 'interface'}
+
+# libwayland's WL_CLOSURE_MAX_ARGS, a message cannot carry more
+MAX_ARGS = 20
+
+ARG_UNION = {'int': 'i', 'uint': 'u', 'fixed': 'f', 'string': 's', 'object': 'o', 'new_id': 'o',
+             'array': 'a', 'fd': 'h'}
+
+
+def ident(name):
+    return name + '_' if name in KEYWORDS else name
+
+
+class Arg:
+    def __init__(self, node):
+        self.name = ident(node.get('name'))
+        self.type = node.get('type')
+        self.interface = node.get('interface')
+
+    def c_type(self):
+        if self.type == 'int' or self.type == 'fd':
+            return 'int32_t'
+        if self.type == 'uint':
+            return 'uint32_t'
+        if self.type == 'fixed':
+            return 'wl_fixed_t'
+        if self.type == 'string':
+            return 'const char *'
+        if self.type == 'array':
+            return 'struct wl_array *'
+        if self.interface:
+            return 'struct ::%s *' % self.interface
+        return 'void *'
+
+
+class Message:
+    def __init__(self, interface, node):
+        self.interface = interface
+        self.name = node.get('name')
+        self.since = int(node.get('since', '1'))
+        self.destructor = node.get('type') == 'destructor'
+        self.args = [Arg(a) for a in node.findall('arg')]
+        self.new_id = next((a for a in self.args if a.type == 'new_id'), None)
+
+    @property
+    def member(self):
+        return self.name + '_request' if self.name in HELPERS else ident(self.name)
+
+    @property
+    def c_function(self):
+        return '%s_%s' % (self.interface.name, self.name)
+
+    @property
+    def opcode(self):
+        return ('%s_%s' % (self.interface.name, self.name)).upper()
+
+
+class Interface:
+    def __init__(self, node):
+        self.name = node.get('name')
+        self.version = int(node.get('version'))
+        self.requests = [Message(self, r) for r in node.findall('request')]
+        self.events = [Message(self, e) for e in node.findall('event')]
+        # what the wrapper's destructor sends, a destructor request without arguments
+        self.destructor = next((r for r in self.requests if r.destructor and not r.args), None)
+
+
+def proxy(expression):
+    return 'reinterpret_cast<struct wl_proxy *>(%s)' % expression
+
+
+class Generator:
+    def __init__(self, interfaces):
+        self.interfaces = [i for i in interfaces if i.name != 'wl_display']
+        self.names = {i.name for i in self.interfaces}
+        self.out = []
+
+    def emit(self, line=''):
+        self.out.append(line)
+
+    def request_params(self, request):
+        params = []
+        for arg in request.args:
+            if arg.type == 'new_id':
+                continue
+            params.append('%s%s' % (arg.c_type(), arg.name) if arg.c_type().endswith('*')
+                          else '%s %s' % (arg.c_type(), arg.name))
+        return params
+
+    def request_return(self, request):
+        if not request.new_id:
+            return 'void'
+        if not request.new_id.interface:
+            return 'P'
+        if request.new_id.interface in self.names:
+            return request.new_id.interface
+        return 'struct ::%s *' % request.new_id.interface
+
+    def declare_request(self, request):
+        ret = self.request_return(request)
+        params = self.request_params(request)
+        if request.new_id and not request.new_id.interface:
+            params.append('uint32_t version')
+            self.emit('    // %s.%s, P is the wlcpp wrapper of the interface bound' % (request.interface.name, request.name))
+            self.emit('    template<typename P>')
+        else:
+            self.emit('    // %s.%s, since %d' % (request.interface.name, request.name, request.since))
+        const = '' if request.destructor else ' const'
+        self.emit('    %s%s%s(%s)%s;' % (ret, '' if ret.endswith('*') else ' ', request.member, ', '.join(params),
+                                        const))
+        self.emit()
+
+    def c_signature(self, request):
+        """The type of the wayland-scanner stub the wrapper must agree with."""
+        ret = 'void'
+        if request.new_id:
+            ret = 'void *' if not request.new_id.interface else 'struct ::%s *' % request.new_id.interface
+        params = ['struct ::%s *' % request.interface.name]
+        for arg in request.args:
+            if arg.type == 'new_id':
+                if not arg.interface:
+                    params += ['const struct wl_interface *', 'uint32_t']
+                continue
+            params.append(arg.c_type().rstrip())
+        return '%s (*)(%s)' % (ret.rstrip(), ', '.join(params))
+
+    def define_request(self, interface, request):
+        ret = self.request_return(request)
+        params = self.request_params(request)
+        untyped = request.new_id is not None and not request.new_id.interface
+        if untyped:
+            params.append('uint32_t version')
+            self.emit('template<typename P>')
+        const = '' if request.destructor else ' const'
+        self.emit('inline %s%s%s::%s(%s)%s {' % (ret, '' if ret.endswith('*') else ' ', interface.name,
+                                               request.member, ', '.join(params), const))
+        self.emit('    static_assert(%s == %d, "%s.%s opcode");' % (request.opcode, interface.requests.index(request),
+                                                                    interface.name, request.name))
+        self.emit('    static_assert(std::is_same_v<decltype(&::%s), %s>, "%s.%s signature");'
+                  % (request.c_function, self.c_signature(request), interface.name, request.name))
+        names = [a.name for a in request.args if a.type != 'new_id']
+        if untyped:
+            names += ['P::interface', 'version']
+        stub = '::%s(%s)' % (request.c_function, ', '.join(['proxy_'] + names))
+
+        # an untyped new_id is sent as interface name, version and id
+        count = len(request.args) + (2 if untyped else 0)
+        if count > MAX_ARGS:
+            raise ValueError('%s.%s has more than %d arguments' % (interface.name, request.name, MAX_ARGS))
+        lines = []
+        if count:
+            lines.append('union wl_argument args[%d];' % count)
+        index = 0
+        for arg in request.args:
+            if arg.type == 'new_id':
+                if untyped:
+                    lines.append('args[%d].s = P::interface->name;' % index)
+                    lines.append('args[%d].u = version;' % (index + 1))
+                    index += 2
+                lines.append('args[%d].o = nullptr;' % index)
+            elif arg.type == 'object':
+                lines.append('args[%d].o = reinterpret_cast<struct wl_object *>(%s);' % (index, arg.name))
+            else:
+                lines.append('args[%d].%s = %s;' % (index, ARG_UNION[arg.type], arg.name))
+            index += 1
+        child = 'nullptr'
+        version = 'wl_proxy_get_version(%s)' % proxy('proxy_')
+        if untyped:
+            child, version = 'P::interface', 'version'
+        elif request.new_id:
+            child = '&::%s_interface' % request.new_id.interface
+        flags = 'WL_MARSHAL_FLAG_DESTROY' if request.destructor else '0'
+        call = 'wl_proxy_marshal_array_flags(%s, %s, %s, %s, %s, %s)' % (proxy('proxy_'), request.opcode, child,
+                                                                        version, flags, 'args' if count else 'nullptr')
+
+        def result(expression, cast):
+            if not request.new_id:
+                return ['%s;' % expression] + (['proxy_ = nullptr;'] if request.destructor else [])
+            if untyped:
+                return ['return P(%s<typename P::proxy_type *>(%s));' % (cast, expression)]
+            if ret.endswith('*'):
+                return ['return %s<%s>(%s);' % (cast, ret, expression)]
+            return ['return %s(%s<struct ::%s *>(%s));' % (ret, cast, request.new_id.interface, expression)]
+
+        # the stub goes through wl_proxy_marshal_flags, which the statistics wrap
+        self.emit('#if defined(ENABLE_PROTOCOL_STATS)')
+        for line in result(stub, 'static_cast'):
+            self.emit('    ' + line)
+        self.emit('#else')
+        for line in lines + result(call, 'reinterpret_cast'):
+            self.emit('    ' + line)
+        self.emit('#endif')
+        self.emit('}')
+        self.emit()
+
+    def declare_class(self, interface):
+        name = interface.name
+        self.emit('class %s {' % name)
+        self.emit('public:')
+        self.emit('    using proxy_type = struct ::%s;' % name)
+        self.emit()
+        self.emit('    static constexpr const struct wl_interface *interface = &::%s_interface;' % name)
+        self.emit()
+        self.emit('    %s() = default;' % name)
+        self.emit()
+        self.emit('    explicit %s(struct ::%s *proxy) : proxy_(proxy) {}' % (name, name))
+        self.emit()
+        self.emit('    ~%s() { reset(); }' % name)
+        self.emit()
+        self.emit('    %s(%s &&other) noexcept : proxy_(other.take()) {}' % (name, name))
+        self.emit()
+        self.emit('    %s &operator=(%s &&other) noexcept {' % (name, name))
+        self.emit('        if (this != &other) {')
+        self.emit('            reset(other.take());')
+        self.emit('        }')
+        self.emit('        return *this;')
+        self.emit('    }')
+        self.emit()
+        self.emit('    %s(const %s &) = delete;' % (name, name))
+        self.emit()
+        self.emit('    %s &operator=(const %s &) = delete;' % (name, name))
+        self.emit()
+        self.emit('    [[nodiscard]] struct ::%s *get() const { return proxy_; }' % name)
+        self.emit()
+        self.emit('    // passes as the C proxy, e.g. as an object argument')
+        self.emit('    operator struct ::%s *() const { return proxy_; }' % name)
+        self.emit()
+        self.emit('    // gives up ownership, the caller destroys the proxy')
+        self.emit('    [[nodiscard]] struct ::%s *take() {' % name)
+        self.emit('        auto proxy = proxy_;')
+        self.emit('        proxy_ = nullptr;')
+        self.emit('        return proxy;')
+        self.emit('    }')
+        self.emit()
+        if interface.destructor:
+            self.emit('    // sends %s.%s for the proxy owned so far, if its version has it'
+                      % (name, interface.destructor.name))
+        else:
+            self.emit('    // destroys the proxy owned so far, there is no destructor request')
+        self.emit('    void reset(struct ::%s *proxy = nullptr);' % name)
+        self.emit()
+        self.emit('    [[nodiscard]] uint32_t get_version() const { return wl_proxy_get_version(%s); }'
+                  % proxy('proxy_'))
+        self.emit()
+        self.emit('    void set_queue(struct wl_event_queue *queue) const { wl_proxy_set_queue(%s, queue); }'
+                  % proxy('proxy_'))
+        self.emit()
+        for request in interface.requests:
+            self.declare_request(request)
+        if interface.events:
+            self.emit('    // T::on_<event>(struct ::%s *, args...) handles an event, T is the user data' % name)
+            self.emit('    template<typename T>')
+            self.emit('    int add_listener(T *target) const;')
+            self.emit()
+        self.emit('private:')
+        self.emit('    struct ::%s *proxy_{};' % name)
+        if interface.events:
+            self.emit()
+            for event in interface.events:
+                member = 'on_' + event.name
+                self.emit('    template<typename T, typename = void>')
+                self.emit('    struct has_%s : std::false_type {};' % member)
+                self.emit()
+                self.emit('    template<typename T>')
+                self.emit('    struct has_%s<T, std::void_t<decltype(&T::%s)>> : std::true_type {};' % (member, member))
+                self.emit()
+            self.emit('    template<typename T>')
+            self.emit('    struct Listener {')
+            self.emit('        static const struct ::%s_listener table;' % name)
+            self.emit('    };')
+        self.emit('};')
+        self.emit()
+
+    def define_class(self, interface):
+        name = interface.name
+        self.emit('inline void %s::reset(struct ::%s *proxy) {' % (name, name))
+        self.emit('    if (proxy_) {')
+        if interface.destructor and interface.destructor.since > 1:
+            # bound below the version adding the destructor, the proxy can only be dropped
+            self.emit('        if (get_version() < %d) {' % interface.destructor.since)
+            self.emit('            wl_proxy_destroy(%s);' % proxy('proxy_'))
+            self.emit('        } else {')
+            self.emit('            %s();' % interface.destructor.member)
+            self.emit('        }')
+        elif interface.destructor:
+            self.emit('        %s();' % interface.destructor.member)
+        else:
+            self.emit('        wl_proxy_destroy(%s);' % proxy('proxy_'))
+        self.emit('    }')
+        self.emit('    proxy_ = proxy;')
+        self.emit('}')
+        self.emit()
+        for request in interface.requests:
+            self.define_request(interface, request)
+        if not interface.events:
+            return
+        self.emit('template<typename T>')
+        self.emit('const struct ::%s_listener %s::Listener<T>::table = {' % (name, name))
+        for event in interface.events:
+            params = ['void *data', 'struct ::%s *proxy' % name]
+            params += ['%s%s' % (a.c_type(), a.name) if a.c_type().endswith('*')
+                       else '%s %s' % (a.c_type(), a.name) for a in event.args]
+            member = 'on_' + event.name
+            args = ', '.join(['proxy'] + [a.name for a in event.args])
+            self.emit('        .%s = [](%s) {' % (ident(event.name), ', '.join('[[maybe_unused]] ' + p for p in params)))
+            self.emit('            if constexpr (has_%s<T>::value) {' % member)
+            self.emit('                static_cast<T *>(data)->%s(%s);' % (member, args))
+            self.emit('            }')
+            self.emit('        },')
+        self.emit('};')
+        self.emit()
+        self.emit('template<typename T>')
+        self.emit('inline int %s::add_listener(T *target) const {' % name)
+        self.emit('    return ::%s_add_listener(proxy_, &Listener<T>::table, target);' % name)
+        self.emit('}')
+        self.emit()
+
+    def generate(self, c_header, guard):
+        self.emit('// Generated by wayland_cpp_scanner.py, do not edit.')
+        self.emit()
+        self.emit('#ifndef %s' % guard)
+        self.emit('#define %s' % guard)
+        self.emit()
+        self.emit('#include <cstdint>')
+        self.emit('#include <type_traits>')
+        self.emit()
+        self.emit('#include <wayland-client-core.h>')
+        self.emit()
+        self.emit('#include "%s"' % c_header)
+        self.emit()
+        self.emit('namespace wlcpp {')
+        self.emit()
+        for interface in self.interfaces:
+            self.emit('class %s;' % interface.name)
+        self.emit()
+        for interface in self.interfaces:
+            self.declare_class(interface)
+        for interface in self.interfaces:
+            self.define_class(interface)
+        self.emit('} // namespace wlcpp')
+        self.emit()
+        self.emit('#endif // %s' % guard)
+        return '\n'.join(self.out) + '\n'
+
+
+def main(argv):
+    if len(argv) != 4:
+        sys.stderr.write('usage: %s <protocol.xml> <c header> <output header>\n' % argv[0])
+        return 1
+    root = ET.parse(argv[1]).getroot()
+    interfaces = [Interface(i) for i in root.findall('interface')]
+    guard = 'WLCPP_%s_H_' % root.get('name').upper().replace('-', '_')
+    with open(argv[3], 'w') as out:
+        out.write(Generator(interfaces).generate(argv[2], guard))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv))
@@ -14,16 +14,19 @@
  * limitations under the License.
  */
 
-#include <chrono>
 #include <csignal>
+#include <cstring>
 #include <iostream>
 
 #include <GLES2/gl2.h>
 
 #include "window/window_egl.h"
+#include "window/window_headless.h"
 #include "window_manager/window_manager.h"
 
 static volatile bool keep_running = true;
+// of the window being drawn, the predicted presentation time of its frame
+static const AnimationClock *animation_clock = nullptr;
 constexpr int WINDOW_HEIGHT = 200;
 constexpr int WINDOW_WIDTH = 200;
 
@@ -66,21 +69,17 @@ static void hue_to_rgb(const float *const hue, float (*rgb)[3]) {
 }
 
 /**
- * Calculate the current hue value based on the current time.
+ * Calculate the hue value of the frame being drawn.
  *
- * The hue value is calculated using the current system time, and a constant value for hue change.
- * The current time is obtained using std::chrono library, which provides utilities for time-related operations.
- * The hue change is a constant value calculated as (2 * M_PI) / 10, where M_PI is the mathematical constant pi.
+ * The hue turns once every 10 seconds of the animation clock, which reads the time the
+ * frame is predicted to be shown, so the colour steps evenly from vblank to vblank
+ * however long each frame took to draw.
  *
  * @return The calculated hue value as a float.
  */
 static float calculate_hue() {
-    static const auto hue_change = static_cast<const float>((2 * M_PI) / 10);
-    auto tp = std::chrono::system_clock::now();
-    auto tp_sec = std::chrono::time_point_cast<std::chrono::seconds>(tp);
-    std::chrono::nanoseconds ns = tp - tp_sec;
-    auto t = static_cast<double>(tp_sec.time_since_epoch().count()) +
-             static_cast<double>(ns.count()) * 1e-9;
+    static const auto hue_change = (2 * M_PI) / 10;
+    const double t = animation_clock ? animation_clock->get_seconds() : 0;
     return static_cast<float>(fmod(t * hue_change, 2 * M_PI));
 }
 
@@ -88,14 +87,14 @@ static float calculate_hue() {
  * @brief Updates the frame by drawing it.
  *
  * This function updates the frame by drawing it on the screen. It sets the OpenGL clear color based on the calculated hue,
- * clears the color buffer, swaps the buffers to display the updated frame, and clears the current rendering context.
+ * clears the color buffer and swaps the buffers to display the updated frame. The context stays current between
+ * frames, so make_current() is free from the second frame on.
  *
- * @param data A pointer to the WindowEgl object.
+ * @param data A pointer to the Egl of the window, a WindowEgl or a WindowHeadless.
  * @param time The current time in milliseconds.
  */
-void frame_update(void *data, uint32_t time) {
-    std::cout << "draw_frame: " << time << std::endl;
-    auto obj = static_cast<WindowEgl *>(data);
+void frame_update(void *data, uint32_t /* time */) {
+    auto obj = static_cast<Egl *>(data);
     (void) obj->make_current();
 
     auto hue = calculate_hue();
@@ -103,10 +102,26 @@ void frame_update(void *data, uint32_t time) {
     hue_to_rgb(&hue, &rgb);
     glClearColor(rgb[0], rgb[1], rgb[2], 1);
     glClear(GL_COLOR_BUFFER_BIT);
-    glFinish();
 
     (void) obj->swap_buffers();
-    (void) obj->clear_current();
+}
+
+/**
+ * @brief Prints a summary of the frame statistics.
+ */
+static void print_stats(const FrameStats &stats) {
+    const auto snapshot = stats.get_snapshot();
+    const auto ms = [](uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+    std::cout << "frames: " << snapshot.frames << ", fps: " << snapshot.fps
+              << ", frame time p50/p95/p99: " << ms(snapshot.frame_time.p50_ns) << "/"
+              << ms(snapshot.frame_time.p95_ns) << "/" << ms(snapshot.frame_time.p99_ns) << " ms"
+              << ", render time p99: " << ms(snapshot.render_time.p99_ns) << " ms"
+              << ", missed vblanks: " << snapshot.missed_vblanks << std::endl;
+    if (snapshot.inputs) {
+        std::cout << "inputs: " << snapshot.inputs << ", input to photon p50/p95/p99: "
+                  << ms(snapshot.input_latency.p50_ns) << "/" << ms(snapshot.input_latency.p95_ns) << "/"
+                  << ms(snapshot.input_latency.p99_ns) << " ms" << std::endl;
+    }
 }
 
 /**
@@ -114,17 +129,43 @@ void frame_update(void *data, uint32_t time) {
  *
  * This function initializes the window manager and creates a window with the specified dimensions and type.
  * It sets up a signal handler for SIGINT (Ctrl+C) to stop the program, and then enters a loop to handle window events.
+ * The loop blocks in poll_events() until the compositor sends events, so an idle client sleeps instead of spinning.
+ *
+ * With --headless [frames] the same frame callback renders into a pbuffer without a
+ * compositor, at 60 frames per second, until the frame count or SIGINT. With
+ * --fullscreen [output] the window maps fullscreen, on the named output if given.
  *
  * @param argc The number of command line arguments.
  * @param argv An array of strings representing the command line arguments.
  * @return An integer representing the exit status of the program.
  */
-int main(int /* argc */, char ** /* argv */) {
+int main(int argc, char **argv) {
     std::signal(SIGINT, handle_signal);
-    WindowManager wm(Window::ShellType::XDG);
+
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0) {
+        const auto frames = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 0;
+        auto egl_display = EglDisplay::create_headless();
+        WindowHeadless window(egl_display.get(), WINDOW_WIDTH, WINDOW_HEIGHT, frame_update);
+        animation_clock = &window.get_animation_clock();
+        while (keep_running && (frames == 0 || window.get_frame_count() < frames) && window.run_frame());
+        print_stats(window.get_frame_stats());
+        return EXIT_SUCCESS;
+    }
+
+    // --fullscreen [output] maps at the output size, so the first buffers need no reallocation
+    XdgWm::InitialState initial_state{};
+    if (argc > 1 && strcmp(argv[1], "--fullscreen") == 0) {
+        initial_state.fullscreen = true;
+        initial_state.output_name = argc > 2 ? argv[2] : nullptr;
+    }
+
+    WindowManager wm(Window::ShellType::XDG, nullptr, true, nullptr, true, INPUT_DEVICE_ALL, 0, Display::BIND_EAGER,
+                     initial_state);
+    animation_clock = &wm.get_animation_clock();
     wm.create_window(WINDOW_WIDTH, WINDOW_HEIGHT,
                      WindowManager::WindowType::EGL, frame_update);
 
-    while (keep_running && wm.poll_events(0) >= 0);
+    while (keep_running && wm.poll_events(-1) >= 0);
+    print_stats(wm.get_frame_stats());
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,234 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+#include <GLES2/gl2.h>
+
+#include "window/window_egl.h"
+#include "window_manager/window_manager.h"
+
+static volatile bool keep_running = true;
+constexpr int WINDOW_HEIGHT = 64;
+constexpr int WINDOW_WIDTH = 64;
+
+/**
+ * @brief Stops the run on SIGINT.
+ */
+void handle_signal(int /* signal */) {
+    keep_running = false;
+}
+
+/**
+ * @brief One toplevel with its own connection, driven by a thread of its own.
+ */
+struct Client {
+    std::unique_ptr<WindowManager> wm;
+    WindowEgl *egl{};
+    float phase{};
+    std::thread thread;
+    // set when warm-up is over, the statistics are reset by the thread recording them
+    std::atomic<bool> reset{};
+    // events dispatched by the thread and the time spent dispatching them
+    uint64_t events{};
+    uint64_t dispatch_ns{};
+
+    /**
+     * @brief Clears the window to a color cycling with time, offset per window.
+     */
+    void draw(uint32_t time) {
+        if (!egl) {
+            return;
+        }
+        (void) egl->make_current();
+        const float t = static_cast<float>(time % 4000) / 4000.0f + phase;
+        glClearColor(0.5f + 0.5f * std::sin(6.2832f * t), 0.5f + 0.5f * std::sin(6.2832f * (t + 0.33f)),
+                     0.5f + 0.5f * std::sin(6.2832f * (t + 0.67f)), 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        (void) egl->swap_buffers();
+    }
+
+    /**
+     * @brief Waits for the display fd, then times dispatching what arrived.
+     */
+    void run(const std::atomic<bool> &running) {
+        struct pollfd fd{wl_display_get_fd(wm->get_display()), POLLIN, 0};
+        while (running) {
+            if (reset.exchange(false)) {
+                wm->reset_frame_stats();
+                events = 0;
+                dispatch_ns = 0;
+            }
+            // commits made while dispatching are still buffered
+            wl_display_flush(wm->get_display());
+            if (poll(&fd, 1, 100) < 0) {
+                break;
+            }
+            const auto start = std::chrono::steady_clock::now();
+            const int count = wm->poll_events(0);
+            const auto elapsed = std::chrono::steady_clock::now() - start;
+            if (count < 0) {
+                break;
+            }
+            if (count > 0) {
+                events += static_cast<uint64_t>(count);
+                dispatch_ns += static_cast<uint64_t>(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+            }
+        }
+    }
+};
+
+/**
+ * @return The resident set size of the process in bytes.
+ */
+static uint64_t resident_bytes() {
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file) {
+        return 0;
+    }
+    unsigned long size = 0;
+    unsigned long resident = 0;
+    if (fscanf(file, "%lu %lu", &size, &resident) != 2) {
+        resident = 0;
+    }
+    fclose(file);
+    return static_cast<uint64_t>(resident) * static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+}
+
+/**
+ * @brief Opens many animated windows at once and reports how the library scales.
+ *
+ * Every window is a WindowManager of its own, with its own connection, EGL display
+ * and dispatch thread, so Display's per-connection state, the per-window EGL setup
+ * and the frame loop are all exercised N times. Reported are the memory each window
+ * costs, the dispatch time per event and how stable the frame rate of the windows is.
+ *
+ * Usage: stress [windows] [seconds]
+ *
+ * @param argc The number of command line arguments.
+ * @param argv The window count, default 16, and the run time in seconds, default 10.
+ * @return An integer representing the exit status of the program.
+ */
+int main(int argc, char **argv) {
+    std::signal(SIGINT, handle_signal);
+
+    const auto count = static_cast<size_t>(argc > 1 ? std::max(1L, std::strtol(argv[1], nullptr, 10)) : 16);
+    const auto seconds = argc > 2 ? std::max(1L, std::strtol(argv[2], nullptr, 10)) : 10;
+
+    const uint64_t resident_before = resident_bytes();
+    const auto setup_start = std::chrono::steady_clock::now();
+
+    // all toplevels are created before waiting, so their configure round trips overlap
+    std::vector<std::unique_ptr<Client>> clients;
+    for (size_t i = 0; i < count && keep_running; i++) {
+        auto client = std::make_unique<Client>();
+        client->wm = std::make_unique<WindowManager>(Window::ShellType::XDG, nullptr, false, nullptr, false);
+        client->phase = static_cast<float>(i) / static_cast<float>(count);
+        client->wm->set_frame_handler<&Client::draw>(client.get());
+        clients.push_back(std::move(client));
+    }
+    for (auto &client: clients) {
+        if (!client->wm->wait_for_configure(5000)) {
+            std::cerr << "a window was not configured" << std::endl;
+            return EXIT_FAILURE;
+        }
+        client->egl = client->wm->create_window(WINDOW_WIDTH, WINDOW_HEIGHT, WindowManager::WindowType::EGL);
+    }
+
+    if (clients.empty()) {
+        return EXIT_SUCCESS;
+    }
+
+    const auto setup_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - setup_start);
+    const uint64_t resident_after = resident_bytes();
+
+    std::atomic<bool> running{true};
+    for (auto &client: clients) {
+        client->thread = std::thread([&client, &running]() { client->run(running); });
+    }
+
+    // the first second is warm-up: EGL buffers being allocated, shaders compiled by the driver
+    std::this_thread::sleep_for(std::chrono::seconds(1));
+    for (auto &client: clients) {
+        client->reset = true;
+    }
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+    while (keep_running && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    running = false;
+    for (auto &client: clients) {
+        client->thread.join();
+    }
+
+    uint64_t events = 0;
+    uint64_t dispatch_ns = 0;
+    uint64_t missed = 0;
+    std::vector<double> fps;
+    std::vector<uint64_t> p99;
+    for (const auto &client: clients) {
+        const auto snapshot = client->wm->get_frame_stats().get_snapshot();
+        events += client->events;
+        dispatch_ns += client->dispatch_ns;
+        missed += snapshot.missed_vblanks;
+        fps.push_back(snapshot.fps);
+        p99.push_back(snapshot.frame_time.p99_ns);
+    }
+    std::sort(fps.begin(), fps.end());
+    std::sort(p99.begin(), p99.end());
+
+    double mean = 0;
+    for (const auto value: fps) {
+        mean += value;
+    }
+    mean /= static_cast<double>(fps.size());
+    double variance = 0;
+    for (const auto value: fps) {
+        variance += (value - mean) * (value - mean);
+    }
+    variance /= static_cast<double>(fps.size());
+
+    const auto ms = [](uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+    std::cout << "windows: " << clients.size() << ", setup: " << setup_ms.count() << " ms"
+              << ", memory per window: "
+              << static_cast<double>(resident_after > resident_before ? resident_after - resident_before : 0) /
+                 static_cast<double>(clients.size()) / 1024.0 << " KiB" << std::endl;
+    std::cout << "events: " << events << ", dispatch per event: "
+              << (events ? static_cast<double>(dispatch_ns) / static_cast<double>(events) / 1000.0 : 0.0) << " us"
+              << std::endl;
+    std::cout << "fps min/median/max: " << fps.front() << "/" << fps[fps.size() / 2] << "/" << fps.back()
+              << ", stddev: " << std::sqrt(variance)
+              << ", frame time p99 median/worst: " << ms(p99[p99.size() / 2]) << "/" << ms(p99.back()) << " ms"
+              << ", missed vblanks: " << missed << std::endl;
+
+    clients.clear();
+    return EXIT_SUCCESS;
+}
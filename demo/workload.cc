@@ -0,0 +1,386 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+
+#include <GLES2/gl2.h>
+
+#include "window/window_egl.h"
+#include "window/window_headless.h"
+#include "window_manager/window_manager.h"
+
+static volatile bool keep_running = true;
+
+/**
+ * @brief Stops the run on SIGINT.
+ */
+void handle_signal(int /* signal */) {
+    keep_running = false;
+}
+
+static const char *kVertexShader =
+        "attribute vec2 position;\n"
+        "uniform vec4 rect;\n"
+        "varying vec2 uv;\n"
+        "void main() {\n"
+        "    uv = position;\n"
+        "    gl_Position = vec4(rect.xy + position * rect.zw, 0.0, 1.0);\n"
+        "}\n";
+
+static const char *kFragmentShader =
+        "precision mediump float;\n"
+        "uniform vec4 color;\n"
+        "uniform sampler2D tex;\n"
+        "uniform float textured;\n"
+        "varying vec2 uv;\n"
+        "void main() {\n"
+        "    gl_FragColor = mix(color, texture2D(tex, uv), textured);\n"
+        "}\n";
+
+/**
+ * @brief Renders one of the benchmark scenarios every frame.
+ */
+struct Workload {
+    typedef enum {
+        // opaque fullscreen quads, pure fill rate
+        FILL,
+        // many small quads, each its own draw call
+        DRAWS,
+        // a full size texture re-uploaded every frame
+        UPLOAD,
+        // blended fullscreen quads on top of each other
+        OVERDRAW,
+    } Scenario;
+
+    Scenario scenario{FILL};
+    int count{4};
+    int width{640};
+    int height{480};
+    Egl *egl{};
+
+    GLuint program{};
+    GLuint buffer{};
+    GLuint texture{};
+    GLint rect{};
+    GLint color{};
+    GLint textured{};
+    std::vector<uint8_t> pixels;
+    uint32_t frame{};
+    std::vector<uint64_t> gpu_samples;
+
+    /**
+     * @brief The frame handler of the window.
+     */
+    void draw(uint32_t /* time */) {
+        if (egl) {
+            render(egl);
+        }
+    }
+
+    static GLuint compile(GLenum type, const char *source) {
+        const GLuint shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, nullptr);
+        glCompileShader(shader);
+        GLint ok = GL_FALSE;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+        if (!ok) {
+            char log[512];
+            glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+            std::cerr << "shader: " << log << std::endl;
+        }
+        return shader;
+    }
+
+    void init() {
+        program = glCreateProgram();
+        const GLuint vertex = compile(GL_VERTEX_SHADER, kVertexShader);
+        const GLuint fragment = compile(GL_FRAGMENT_SHADER, kFragmentShader);
+        glAttachShader(program, vertex);
+        glAttachShader(program, fragment);
+        glBindAttribLocation(program, 0, "position");
+        glLinkProgram(program);
+        glDeleteShader(vertex);
+        glDeleteShader(fragment);
+        rect = glGetUniformLocation(program, "rect");
+        color = glGetUniformLocation(program, "color");
+        textured = glGetUniformLocation(program, "textured");
+
+        static const GLfloat quad[] = {0, 0, 1, 0, 0, 1, 1, 1};
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+
+        if (scenario == UPLOAD) {
+            pixels.resize(static_cast<size_t>(width) * static_cast<size_t>(height) * 4);
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        }
+        (void) egl->enable_gpu_timer();
+    }
+
+    /**
+     * @brief Draws the scenario into the current surface of e and swaps.
+     */
+    void render(Egl *e) {
+        egl = e;
+        (void) egl->make_current();
+        if (!program) {
+            init();
+        }
+        frame++;
+
+        glViewport(0, 0, width, height);
+        glClearColor(0, 0, 0, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glUseProgram(program);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glUniform1f(textured, 0);
+
+        switch (scenario) {
+            case FILL:
+            case OVERDRAW:
+                if (scenario == OVERDRAW) {
+                    glEnable(GL_BLEND);
+                    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+                }
+                glUniform4f(rect, -1, -1, 2, 2);
+                for (int i = 0; i < count; i++) {
+                    const float shade = static_cast<float>((frame + static_cast<uint32_t>(i)) % 64) / 64.0f;
+                    glUniform4f(color, shade, 1 - shade, 0.5f, scenario == OVERDRAW ? 0.25f : 1.0f);
+                    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                }
+                glDisable(GL_BLEND);
+                break;
+
+            case DRAWS: {
+                // a grid of small quads, count of them
+                int columns = 1;
+                while (columns * columns < count) {
+                    columns++;
+                }
+                const float size = 2.0f / static_cast<float>(columns);
+                for (int i = 0; i < count; i++) {
+                    glUniform4f(rect, -1 + size * static_cast<float>(i % columns),
+                                -1 + size * static_cast<float>(i / columns), size * 0.8f, size * 0.8f);
+                    glUniform4f(color, static_cast<float>(i % 7) / 7.0f, static_cast<float>(frame % 64) / 64.0f,
+                                0.5f, 1);
+                    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                }
+                break;
+            }
+
+            case UPLOAD:
+                glBindTexture(GL_TEXTURE_2D, texture);
+                for (int i = 0; i < count; i++) {
+                    std::fill(pixels.begin(), pixels.end(), static_cast<uint8_t>(frame + static_cast<uint32_t>(i)));
+                    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE,
+                                    pixels.data());
+                }
+                glUniform1f(textured, 1);
+                glUniform4f(rect, -1, -1, 2, 2);
+                glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+                break;
+        }
+
+        (void) egl->swap_buffers();
+        // results are a few frames behind; 0 until the first one is available
+        if (const auto gpu = egl->get_last_gpu_time_ns()) {
+            gpu_samples.push_back(gpu);
+        }
+    }
+};
+
+/**
+ * @return User plus system CPU time of the process, in seconds.
+ */
+static double cpu_seconds() {
+    struct rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/**
+ * @return The value below which fraction of the sorted samples fall, in milliseconds.
+ */
+static double percentile_ms(const std::vector<uint64_t> &sorted, double fraction) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    const auto index = std::min(sorted.size() - 1, static_cast<size_t>(fraction * static_cast<double>(sorted.size())));
+    return static_cast<double>(sorted[index]) / 1e6;
+}
+
+static const char *scenario_name(Workload::Scenario scenario) {
+    switch (scenario) {
+        case Workload::FILL:
+            return "fill";
+        case Workload::DRAWS:
+            return "draws";
+        case Workload::UPLOAD:
+            return "upload";
+        case Workload::OVERDRAW:
+            return "overdraw";
+    }
+    return "";
+}
+
+/**
+ * @brief Prints the results as one JSON object.
+ */
+static void print_json(const Workload &workload, const FrameStats &stats, double seconds, double cpu) {
+    const auto snapshot = stats.get_snapshot();
+    const auto ms = [](uint64_t ns) { return static_cast<double>(ns) / 1e6; };
+    auto gpu = workload.gpu_samples;
+    std::sort(gpu.begin(), gpu.end());
+
+    char buffer[1024];
+    snprintf(buffer, sizeof(buffer),
+             "{\"scenario\":\"%s\",\"count\":%d,\"width\":%d,\"height\":%d,\"seconds\":%.3f,"
+             "\"frames\":%llu,\"fps\":%.2f,"
+             "\"frame_time_ms\":{\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f},"
+             "\"render_time_ms\":{\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f},"
+             "\"gpu_time_ms\":{\"samples\":%zu,\"p50\":%.3f,\"p95\":%.3f,\"p99\":%.3f},"
+             "\"cpu_percent\":%.1f,\"missed_vblanks\":%llu}",
+             scenario_name(workload.scenario), workload.count, workload.width, workload.height, seconds,
+             static_cast<unsigned long long>(snapshot.frames), snapshot.fps,
+             ms(snapshot.frame_time.p50_ns), ms(snapshot.frame_time.p95_ns), ms(snapshot.frame_time.p99_ns),
+             ms(snapshot.render_time.p50_ns), ms(snapshot.render_time.p95_ns), ms(snapshot.render_time.p99_ns),
+             gpu.size(), percentile_ms(gpu, 0.50), percentile_ms(gpu, 0.95), percentile_ms(gpu, 0.99),
+             seconds > 0 ? 100.0 * cpu / seconds : 0.0, static_cast<unsigned long long>(snapshot.missed_vblanks));
+    std::cout << buffer << std::endl;
+}
+
+/**
+ * @brief A GPU workload generator for comparing boards and compositor builds.
+ *
+ * Renders one scenario for a fixed time after a second of warm-up, then prints frame
+ * and render time percentiles, GPU time from GL_EXT_disjoint_timer_query, CPU usage and
+ * missed vblanks as JSON. With --headless it renders into a pbuffer at --rate frames
+ * per second, 0 for as fast as possible, without a compositor.
+ *
+ * Usage: workload [--scenario fill|draws|upload|overdraw] [--count N] [--size WxH]
+ *                 [--seconds S] [--headless] [--rate FPS]
+ *
+ * @param argc The number of command line arguments.
+ * @param argv The options above.
+ * @return An integer representing the exit status of the program.
+ */
+int main(int argc, char **argv) {
+    std::signal(SIGINT, handle_signal);
+
+    Workload workload;
+    double seconds = 10;
+    bool headless = false;
+    uint32_t rate = 0;
+    bool count_set = false;
+    for (int i = 1; i < argc; i++) {
+        const bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--scenario") == 0 && has_value) {
+            const std::string name = argv[++i];
+            if (name == "fill") {
+                workload.scenario = Workload::FILL;
+            } else if (name == "draws") {
+                workload.scenario = Workload::DRAWS;
+            } else if (name == "upload") {
+                workload.scenario = Workload::UPLOAD;
+            } else if (name == "overdraw") {
+                workload.scenario = Workload::OVERDRAW;
+            } else {
+                std::cerr << "unknown scenario " << name << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--count") == 0 && has_value) {
+            workload.count = std::max(1, atoi(argv[++i]));
+            count_set = true;
+        } else if (strcmp(argv[i], "--size") == 0 && has_value) {
+            if (sscanf(argv[++i], "%dx%d", &workload.width, &workload.height) != 2 ||
+                workload.width <= 0 || workload.height <= 0) {
+                std::cerr << "--size takes WIDTHxHEIGHT" << std::endl;
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--seconds") == 0 && has_value) {
+            seconds = std::max(1.0, atof(argv[++i]));
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--rate") == 0 && has_value) {
+            rate = static_cast<uint32_t>(std::max(0, atoi(argv[++i])));
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--scenario fill|draws|upload|overdraw] [--count N] "
+                      << "[--size WxH] [--seconds S] [--headless] [--rate FPS]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (!count_set && workload.scenario == Workload::DRAWS) {
+        workload.count = 1000;
+    } else if (!count_set && workload.scenario == Workload::UPLOAD) {
+        workload.count = 1;
+    }
+
+    const auto run = [&](auto &&step, auto &&reset) {
+        const auto warm_up = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (keep_running && std::chrono::steady_clock::now() < warm_up && step());
+        reset();
+        workload.gpu_samples.clear();
+
+        const auto start = std::chrono::steady_clock::now();
+        const double cpu_start = cpu_seconds();
+        const auto deadline = start + std::chrono::duration<double>(seconds);
+        while (keep_running && std::chrono::steady_clock::now() < deadline && step());
+        return std::make_pair(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(),
+                              cpu_seconds() - cpu_start);
+    };
+
+    if (headless) {
+        auto egl_display = EglDisplay::create_headless();
+        WindowHeadlessConfig config;
+        config.frame_rate = rate;
+        WindowHeadless window(egl_display.get(), workload.width, workload.height,
+                              [&workload](void *data, uint32_t /* time */) {
+                                  workload.render(static_cast<Egl *>(data));
+                              }, config);
+        const auto [elapsed, cpu] = run([&window]() { return window.run_frame(); },
+                                        [&window]() { window.reset_frame_stats(); });
+        print_json(workload, window.get_frame_stats(), elapsed, cpu);
+        return EXIT_SUCCESS;
+    }
+
+    WindowManager wm(Window::ShellType::XDG);
+    wm.set_frame_handler<&Workload::draw>(&workload);
+    workload.egl = wm.create_window(workload.width, workload.height, WindowManager::WindowType::EGL);
+    const auto [elapsed, cpu] = run([&wm]() { return wm.poll_events(100) >= 0; },
+                                    [&wm]() { wm.reset_frame_stats(); });
+    print_json(workload, wm.get_frame_stats(), elapsed, cpu);
+    return EXIT_SUCCESS;
+}
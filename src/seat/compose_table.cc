@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "compose_table.h"
+
+#include <cstdlib>
+
+#include "utils/logging.h"
+
+namespace {
+const char *default_locale() {
+    for (const auto name: {"LC_ALL", "LC_CTYPE", "LANG"}) {
+        const auto value = getenv(name);
+        if (value && *value) {
+            return value;
+        }
+    }
+    return "C";
+}
+}
+
+/**
+ * @class ComposeTable
+ * @brief The XKB compose table of a locale, for dead keys and compose sequences.
+ *
+ * Parsing the locale's Compose file takes tens of milliseconds, so it is done once,
+ * on a thread of its own started by the constructor, and the table is shared by every
+ * keyboard; each keeps only an xkb_compose_state. Keys typed before the table is
+ * ready are delivered uncomposed.
+ */
+ComposeTable::ComposeTable(const char *locale) : locale_(locale ? locale : default_locale()) {
+    thread_ = std::thread(&ComposeTable::compile, this);
+}
+
+ComposeTable::~ComposeTable() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    if (table_) {
+        xkb_compose_table_unref(table_);
+    }
+}
+
+/**
+ * @brief The table of the process's locale, shared by every Display so it survives reconnects.
+ */
+ComposeTable &ComposeTable::get_default() {
+    static ComposeTable table;
+    return table;
+}
+
+void ComposeTable::compile() {
+    // a context of its own, the KeymapCache one is serialized with keymap compiles
+    const auto context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    if (context) {
+        table_ = xkb_compose_table_new_from_locale(context, locale_.c_str(), XKB_COMPOSE_COMPILE_NO_FLAGS);
+        xkb_context_unref(context);
+    }
+    if (!table_) {
+        LOG_DEBUG("ComposeTable: no compose table for locale %s", locale_.c_str());
+    }
+    ready_.store(true, std::memory_order_release);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_COMPOSE_TABLE_H_
+#define SRC_SEAT_COMPOSE_TABLE_H_
+
+#include <atomic>
+#include <string>
+#include <thread>
+
+#include <xkbcommon/xkbcommon-compose.h>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT ComposeTable {
+public:
+    // locale nullptr takes LC_ALL, LC_CTYPE or LANG, like libxkbcommon's own lookup
+    explicit ComposeTable(const char *locale = nullptr);
+
+    ~ComposeTable();
+
+    ComposeTable(const ComposeTable &) = delete;
+
+    ComposeTable &operator=(const ComposeTable &) = delete;
+
+    static ComposeTable &get_default();
+
+    // nullptr while compiling, and if the locale has no compose table
+    [[nodiscard]] struct xkb_compose_table *get() const {
+        return ready_.load(std::memory_order_acquire) ? table_ : nullptr;
+    }
+
+    [[nodiscard]] bool is_ready() const { return ready_.load(std::memory_order_acquire); }
+
+    [[nodiscard]] const std::string &get_locale() const { return locale_; }
+
+private:
+    std::string locale_;
+    // written by thread_ before ready_ is set
+    struct xkb_compose_table *table_{};
+    std::atomic<bool> ready_{};
+    std::thread thread_;
+
+    void compile();
+};
+
+#endif // SRC_SEAT_COMPOSE_TABLE_H_
@@ -16,7 +16,10 @@
 
 #include "cursor.h"
 
-#include <wayland-cursor.h>
+#include <algorithm>
+#include <cstring>
+
+#include "utils/listener.h"
 
 constexpr int kCursorSize = 24;
 constexpr char kCursorKindBasic[] = "left_ptr";
@@ -24,9 +27,27 @@ constexpr char kCursorKindClick[] = "hand";
 constexpr char kCursorKindText[] = "left_ptr";
 constexpr char kCursorKindForbidden[] = "pirate";
 
+namespace {
+uint32_t shape_for_kind(const char *kind) {
+    if (strcmp(kind, "basic") == 0) {
+        return WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_DEFAULT;
+    } else if (strcmp(kind, "click") == 0) {
+        return WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_POINTER;
+    } else if (strcmp(kind, "text") == 0) {
+        return WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_TEXT;
+    } else if (strcmp(kind, "forbidden") == 0) {
+        return WP_CURSOR_SHAPE_DEVICE_V1_SHAPE_NOT_ALLOWED;
+    }
+    return 0;
+}
+}
+
 /**
  * @class Cursor
  * @brief Represents a cursor for a Pointer.
+ *
+ * The theme is not loaded here but on the first enable(), from the
+ * CursorThemeCache set with set_theme_cache().
  */
 Cursor::Cursor(Pointer *parent, struct wl_pointer *pointer, struct wl_shm *shm, struct wl_compositor *compositor,
                bool enable, const char *theme_name)
@@ -36,21 +57,20 @@ Cursor::Cursor(Pointer *parent, struct wl_pointer *pointer, struct wl_shm *shm,
           wl_surface_(wl_compositor_create_surface(compositor)),
           theme_name_(theme_name),
           enable_(enable) {
-    if (enable) {
-        theme_ = wl_cursor_theme_load(theme_name_.c_str(), kCursorSize, wl_shm_);
-    }
+    // the cursor surface is sized for the outputs it enters itself
+    wl_surface_add_listener(wl_surface_, &surface_listener_, this);
 }
 
 /**
  * @brief Destructor for the Cursor class.
  *
- * This function destroys the Cursor object by freeing any allocated resources.
- * It destroys the wl_cursor_theme object pointed to by the theme_ pointer.
- * It also destroys the wl_surface object pointed to by the wl_surface_ pointer.
+ * This function destroys the wl_surface object pointed to by the wl_surface_ pointer.
+ * The theme and its buffers belong to the CursorThemeCache.
  */
 Cursor::~Cursor() {
-    if (theme_)
-        wl_cursor_theme_destroy(theme_);
+    stop_animation();
+    if (shape_device_)
+        wp_cursor_shape_device_v1_destroy(shape_device_);
 
     if (wl_surface_)
         wl_surface_destroy(wl_surface_);
@@ -65,12 +85,14 @@ Cursor::~Cursor() {
  *
  * This function sets the cursor for the specified device and kind. If the enable flag is false,
  * the default cursor is set. If the enable flag is true, the cursor is set based on the specified kind.
+ * The cursor surface is only committed when the buffer changes.
  *
  * If the specified kind is not found or if an invalid cursor buffer is encountered, the function returns false.
  * If the cursor is successfully set, the function returns true.
  */
-bool Cursor::enable(const int32_t device, const char *kind) const {
+bool Cursor::enable(const int32_t device, const char *kind) {
     (void) device;
+    kind_ = kind;
     if (!enable_) {
         wl_pointer_set_cursor(wl_pointer_, parent_->get_serial(),
                               wl_surface_, 0, 0);
@@ -79,6 +101,15 @@ bool Cursor::enable(const int32_t device, const char *kind) const {
         return true;
     }
 
+    if (wl_pointer_ && shape_device_) {
+        const uint32_t shape = shape_for_kind(kind);
+        if (shape == 0) {
+            return false;
+        }
+        wp_cursor_shape_device_v1_set_shape(shape_device_, parent_->get_serial(), shape);
+        return true;
+    }
+
     if (wl_pointer_) {
         const char *cursor_name;
         if (strcmp(kind, "basic") == 0) {
@@ -94,28 +125,238 @@ bool Cursor::enable(const int32_t device, const char *kind) const {
             return false;
         }
 
-        const auto cursor = wl_cursor_theme_get_cursor(theme_, cursor_name);
-        if (cursor == nullptr) {
-            // not found
+        if (!themes_) {
+            if (!own_themes_) {
+                own_themes_ = std::make_unique<CursorThemeCache>();
+            }
+            themes_ = own_themes_.get();
+        }
+        const auto images = themes_->get(wl_shm_, theme_name_, kCursorSize * scale_, cursor_name);
+        if (images == nullptr || !wl_surface_) {
+            // not found, or Invalid Cursor Buffer
             return false;
         }
-        const auto cursor_buffer = wl_cursor_image_get_buffer(cursor->images[0]);
-        if (cursor_buffer && wl_surface_) {
-
-            wl_pointer_set_cursor(wl_pointer_, parent_->get_serial(),
-                                  wl_surface_,
-                                  static_cast<int32_t>(cursor->images[0]->hotspot_x),
-                                  static_cast<int32_t>(cursor->images[0]->hotspot_y));
-            wl_surface_attach(wl_surface_, cursor_buffer, 0, 0);
-            wl_surface_damage(wl_surface_, 0, 0,
-                              static_cast<int32_t>(cursor->images[0]->width),
-                              static_cast<int32_t>(cursor->images[0]->height));
+
+        // the hotspot is in surface coordinates, the images are scale_ times larger
+        const auto &image = images == images_ ? (*images_)[image_index_] : images->front();
+        hotspot_x_ = image.hotspot_x / scale_;
+        hotspot_y_ = image.hotspot_y / scale_;
+        wl_pointer_set_cursor(wl_pointer_, parent_->get_serial(), wl_surface_, hotspot_x_, hotspot_y_);
+        bool commit = false;
+        if (images != images_) {
+            stop_animation();
+            images_ = images;
+            image_index_ = 0;
+            attach_image(image);
+            commit = true;
+        }
+        if (images_->size() > 1 && !frame_callback_) {
+            request_frame();
+            commit = true;
+        }
+        if (commit) {
             wl_surface_commit(wl_surface_);
-        } else {
-            // Failed to set cursor: Invalid Cursor Buffer
-            return false;
         }
     }
 
     return true;
 }
+
+/**
+ * @brief Lets the compositor draw the cursor from its own cache, by shape.
+ *
+ * The cursor surface is no longer committed and no theme is loaded.
+ *
+ * @param manager The compositor's wp_cursor_shape_manager_v1.
+ */
+void Cursor::set_shape_manager(struct wp_cursor_shape_manager_v1 *manager) {
+    if (!shape_device_ && manager && wl_pointer_) {
+        shape_device_ = wp_cursor_shape_manager_v1_get_pointer(manager, wl_pointer_);
+    }
+}
+
+/**
+ * @brief Stops advancing an animated cursor, e.g. when the pointer leaves.
+ *
+ * The next enable() resumes the animation.
+ */
+void Cursor::stop_animation() {
+    if (frame_callback_) {
+        wl_callback_destroy(frame_callback_);
+        frame_callback_ = nullptr;
+    }
+    image_time_ = 0;
+}
+
+/**
+ * @brief Attaches a cursor image, moving the surface by the change of the hotspot.
+ *
+ * Frames of an animated cursor may have hotspots of their own; the offset keeps the
+ * hotspot under the pointer without another wl_pointer.set_cursor, which needs the
+ * serial of the last enter.
+ */
+void Cursor::attach_image(const CursorThemeCache::Image &image) {
+    const int32_t hotspot_x = image.hotspot_x / scale_;
+    const int32_t hotspot_y = image.hotspot_y / scale_;
+    const int32_t dx = hotspot_x_ - hotspot_x;
+    const int32_t dy = hotspot_y_ - hotspot_y;
+    hotspot_x_ = hotspot_x;
+    hotspot_y_ = hotspot_y;
+
+    const uint32_t version = wl_surface_get_version(wl_surface_);
+#if defined(WL_SURFACE_OFFSET_SINCE_VERSION)
+    if (version >= WL_SURFACE_OFFSET_SINCE_VERSION) {
+        wl_surface_attach(wl_surface_, image.buffer, 0, 0);
+        if (dx || dy) {
+            wl_surface_offset(wl_surface_, dx, dy);
+        }
+    } else
+#endif
+    {
+        wl_surface_attach(wl_surface_, image.buffer, dx, dy);
+    }
+    // buffer damage needs no conversion by the buffer scale
+    if (version >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+        wl_surface_damage_buffer(wl_surface_, 0, 0, image.width, image.height);
+    } else {
+        wl_surface_damage(wl_surface_, 0, 0, image.width / scale_, image.height / scale_);
+    }
+}
+
+void Cursor::request_frame() {
+    frame_callback_ = wl_surface_frame(wl_surface_);
+    wl_callback_add_listener(frame_callback_, &frame_listener_, this);
+}
+
+/**
+ * @brief Shows the next image of an animated cursor once the delay of the current one passed.
+ *
+ * The compositor only sends frame callbacks while the cursor is visible, so a
+ * hidden cursor costs nothing.
+ */
+void Cursor::handle_frame_done(struct wl_callback *callback, uint32_t time) {
+    wl_callback_destroy(callback);
+    frame_callback_ = nullptr;
+    if (!images_ || images_->size() < 2) {
+        return;
+    }
+    if (image_time_ == 0) {
+        image_time_ = time;
+    } else if (time - image_time_ >= (*images_)[image_index_].delay) {
+        image_index_ = (image_index_ + 1) % images_->size();
+        image_time_ = time;
+        attach_image((*images_)[image_index_]);
+    }
+    request_frame();
+    wl_surface_commit(wl_surface_);
+}
+
+const struct wl_callback_listener Cursor::frame_listener_ = {
+        .done = listener_thunk<&Cursor::handle_frame_done>,
+};
+
+void Cursor::handle_surface_enter(struct wl_surface * /* surface */, struct wl_output *output) {
+    entered_outputs_.push_back(output);
+    (void) apply_scale(get_output_scale());
+}
+
+void Cursor::handle_surface_leave(struct wl_surface * /* surface */, struct wl_output *output) {
+    remove_output(output);
+}
+
+/**
+ * @brief Forgets an output the cursor surface is on, e.g. one that is unplugged.
+ *
+ * @param output The output that is left or going away.
+ */
+void Cursor::remove_output(struct wl_output *output) {
+    const auto it = std::remove(entered_outputs_.begin(), entered_outputs_.end(), output);
+    if (it == entered_outputs_.end()) {
+        return;
+    }
+    entered_outputs_.erase(it, entered_outputs_.end());
+    (void) apply_scale(get_output_scale());
+}
+
+#if defined(WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION)
+void Cursor::handle_preferred_buffer_scale(struct wl_surface * /* surface */, int32_t factor) {
+    preferred_scale_ = factor;
+    (void) apply_scale(get_output_scale());
+}
+
+void Cursor::handle_preferred_buffer_transform(struct wl_surface * /* surface */, uint32_t /* transform */) {
+}
+#endif
+
+const struct wl_surface_listener Cursor::surface_listener_ = {
+        .enter = listener_thunk<&Cursor::handle_surface_enter>,
+        .leave = listener_thunk<&Cursor::handle_surface_leave>,
+#if defined(WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION)
+        .preferred_buffer_scale = listener_thunk<&Cursor::handle_preferred_buffer_scale>,
+        .preferred_buffer_transform = listener_thunk<&Cursor::handle_preferred_buffer_transform>,
+#endif
+};
+
+/**
+ * @brief Sets the scale of the window the pointer is on.
+ *
+ * Only used as long as the cursor surface has not entered an output, the scale of
+ * the outputs under the cursor itself takes precedence.
+ *
+ * @param scale The integer scale of the window's output.
+ * @return false if the cursor is disabled or the surface cannot be scaled.
+ */
+bool Cursor::set_scale(int scale) {
+    if (scale < 1) {
+        return false;
+    }
+    window_scale_ = scale;
+    return apply_scale(get_output_scale());
+}
+
+/**
+ * @return The scale to load the cursor at: the compositor's preferred scale, else the
+ * largest scale of the outputs the cursor is on, else the window's.
+ */
+int Cursor::get_output_scale() const {
+    if (preferred_scale_ > 0) {
+        return preferred_scale_;
+    }
+    int scale = 0;
+    for (const auto output: entered_outputs_) {
+        // set by Output as its listener data
+        if (const auto entered = static_cast<const Output *>(wl_output_get_user_data(output))) {
+            scale = std::max(scale, entered->get_scale());
+        }
+    }
+    return scale > 0 ? scale : window_scale_;
+}
+
+/**
+ * @brief Switches to the theme size of an output scale, so the cursor keeps its size on high density outputs.
+ *
+ * The theme for each scale stays in the CursorThemeCache, moving back and forth
+ * between outputs does not load it again. The current cursor is set again at the new size.
+ *
+ * @param scale The integer scale of the output the cursor is on.
+ * @return false if the cursor is disabled or the surface cannot be scaled.
+ */
+bool Cursor::apply_scale(int scale) {
+    if (shape_device_) {
+        // the compositor sizes shapes for the output
+        return enable_;
+    }
+    if (!enable_ || scale < 1 || wl_surface_get_version(wl_surface_) < WL_SURFACE_SET_BUFFER_SCALE_SINCE_VERSION) {
+        return false;
+    }
+    if (scale == scale_) {
+        return true;
+    }
+    scale_ = scale;
+    wl_surface_set_buffer_scale(wl_surface_, scale_);
+    // the scale only applies with a new commit
+    stop_animation();
+    images_ = nullptr;
+    const auto kind = kind_;
+    return enable(0, kind.c_str());
+}
@@ -18,17 +18,24 @@
 #define SRC_SEAT_CURSOR_H_
 
 #include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
 
 #include <wayland-client.h>
 
+#include "cursor-shape-v1-client-protocol.h"
+
 #include "window_manager/display.h"
+#include "cursor_theme_cache.h"
 #include "pointer.h"
+#include "utils/export.h"
 
 class Display;
 
 class Pointer;
 
-class Cursor {
+class WAYPP_EXPORT Cursor {
 public:
     Cursor(Pointer *parent, struct wl_pointer *pointer, struct wl_shm *shm, struct wl_compositor *compositor,
            bool enable,
@@ -36,17 +43,81 @@ public:
 
     ~Cursor();
 
-    bool enable(int32_t device, const char *kind) const;
+    bool enable(int32_t device, const char *kind);
+
+    bool set_scale(int scale);
+
+    void set_theme_cache(CursorThemeCache *cache) { themes_ = cache; }
+
+    void set_shape_manager(struct wp_cursor_shape_manager_v1 *manager);
+
+    void stop_animation();
+
+    void remove_output(struct wl_output *output);
+
+    [[nodiscard]] const std::string &get_kind() const { return kind_; }
+
+    // takes effect with the next enter
+    void set_kind(const std::string &kind) { kind_ = kind; }
+
+    [[nodiscard]] int get_scale() const { return scale_; }
 
 private:
     Pointer *parent_;
     struct wl_pointer *wl_pointer_;
-    struct wl_surface *wl_surface_;
-    struct wl_cursor_theme *theme_;
     struct wl_shm *wl_shm_;
+    struct wl_surface *wl_surface_;
+    std::string theme_name_;
     bool enable_;
+    // cursor images are loaded at kCursorSize * scale_
+    int scale_{1};
+    // scale of the window the pointer is on, used until the cursor surface enters an output
+    int window_scale_{1};
+    // outputs the cursor surface is on
+    std::vector<struct wl_output *> entered_outputs_;
+    // wl_surface v6, overrides the output scales
+    int32_t preferred_scale_{};
 
-    std::string theme_name_;
+    std::string kind_{"basic"};
+    // shared with the other pointers of the Display, own_themes_ without one
+    CursorThemeCache *themes_{};
+    std::unique_ptr<CursorThemeCache> own_themes_;
+    // the compositor draws the cursor by shape, no theme is loaded then
+    struct wp_cursor_shape_device_v1 *shape_device_{};
+    // images on wl_surface_, a new enter only needs set_cursor
+    const CursorThemeCache::Images *images_{};
+    size_t image_index_{};
+    // hotspot of the image shown, in surface coordinates; animation frames move it with an offset
+    int32_t hotspot_x_{};
+    int32_t hotspot_y_{};
+    // animated cursors advance from frame callbacks of wl_surface_ while the pointer is inside
+    struct wl_callback *frame_callback_{};
+    // frame callback time the current image was shown at, zero before the first callback
+    uint32_t image_time_{};
+
+    bool apply_scale(int scale);
+
+    [[nodiscard]] int get_output_scale() const;
+
+    void attach_image(const CursorThemeCache::Image &image);
+
+    void request_frame();
+
+    void handle_frame_done(struct wl_callback *callback, uint32_t time);
+
+    static const struct wl_callback_listener frame_listener_;
+
+    void handle_surface_enter(struct wl_surface *surface, struct wl_output *output);
+
+    void handle_surface_leave(struct wl_surface *surface, struct wl_output *output);
+
+#if defined(WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION)
+    void handle_preferred_buffer_scale(struct wl_surface *surface, int32_t factor);
+
+    void handle_preferred_buffer_transform(struct wl_surface *surface, uint32_t transform);
+#endif
+
+    static const struct wl_surface_listener surface_listener_;
 };
 
 #endif // SRC_SEAT_CURSOR_H_
\ No newline at end of file
@@ -0,0 +1,116 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "cursor_theme_cache.h"
+
+#include <wayland-cursor.h>
+
+#include "utils/logging.h"
+
+/**
+ * @class CursorThemeCache
+ * @brief Cursor themes and their cursor buffers, shared by the pointers of a Display.
+ *
+ * wl_cursor_theme_load() parses the theme files and allocates a shm pool, so
+ * each theme is loaded once per size, on the first pointer enter that needs it.
+ * Cursor names are resolved to the buffers of all their images once per theme;
+ * changing the cursor shape afterwards is a single hash lookup.
+ */
+CursorThemeCache::~CursorThemeCache() {
+    clear();
+}
+
+/**
+ * @brief Destroys every theme and its buffers, they are loaded again on the next get().
+ */
+void CursorThemeCache::clear() {
+    for (const auto &[key, theme]: themes_) {
+        if (theme.theme) {
+            wl_cursor_theme_destroy(theme.theme);
+        }
+    }
+    themes_.clear();
+}
+
+/**
+ * @brief Returns the images of a cursor, loading the theme on first use.
+ *
+ * @param shm The wl_shm to load the theme with.
+ * @param theme_name The cursor theme name.
+ * @param size The cursor size in buffer pixels.
+ * @param name The cursor name in the theme, e.g. left_ptr.
+ * @return The images, nullptr if the theme cannot be loaded or has no such cursor.
+ */
+const CursorThemeCache::Images *CursorThemeCache::get(struct wl_shm *shm, const std::string &theme_name, int size,
+                                                     const char *name) {
+    auto [it, inserted] = themes_.try_emplace({theme_name, size});
+    Theme &theme = it->second;
+    if (inserted) {
+        theme.theme = wl_cursor_theme_load(theme_name.c_str(), size, shm);
+        if (!theme.theme) {
+            LOG_ERROR("CursorThemeCache: failed to load theme %s at size %d", theme_name.c_str(), size);
+        }
+    }
+    if (!theme.theme) {
+        return nullptr;
+    }
+
+    auto images = theme.cursors.find(name);
+    if (images == theme.cursors.end()) {
+        Images entry;
+        if (const auto cursor = wl_cursor_theme_get_cursor(theme.theme, name)) {
+            entry.reserve(cursor->image_count);
+            for (unsigned int i = 0; i < cursor->image_count; i++) {
+                const auto cursor_image = cursor->images[i];
+                const auto buffer = wl_cursor_image_get_buffer(cursor_image);
+                if (!buffer) {
+                    // Invalid Cursor Buffer
+                    entry.clear();
+                    break;
+                }
+                entry.push_back({
+                        .buffer = buffer,
+                        .hotspot_x = static_cast<int32_t>(cursor_image->hotspot_x),
+                        .hotspot_y = static_cast<int32_t>(cursor_image->hotspot_y),
+                        .width = static_cast<int32_t>(cursor_image->width),
+                        .height = static_cast<int32_t>(cursor_image->height),
+                        .delay = cursor_image->delay,
+                });
+            }
+        }
+        images = theme.cursors.emplace(name, std::move(entry)).first;
+    }
+    return images->second.empty() ? nullptr : &images->second;
+}
+
+/**
+ * @brief Estimates the shm the cached cursors occupy, 4 bytes a pixel of every image resolved so far.
+ *
+ * A theme's pool also holds the cursors that were never asked for, libwayland-cursor
+ * does not tell its size; this is the part a pointer can have on screen.
+ */
+uint64_t CursorThemeCache::get_memory_usage() const {
+    uint64_t bytes = 0;
+    for (const auto &[key, theme]: themes_) {
+        for (const auto &[name, images]: theme.cursors) {
+            for (const auto &image: images) {
+                bytes += static_cast<uint64_t>(image.width) * static_cast<uint64_t>(image.height) * 4;
+            }
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_CURSOR_THEME_CACHE_H_
+#define SRC_SEAT_CURSOR_THEME_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT CursorThemeCache {
+public:
+    struct Image {
+        // owned by the theme
+        struct wl_buffer *buffer;
+        int32_t hotspot_x;
+        int32_t hotspot_y;
+        int32_t width;
+        int32_t height;
+        // milliseconds to show the image for in an animated cursor
+        uint32_t delay;
+    };
+
+    // the images of a cursor, more than one if it is animated
+    typedef std::vector<Image> Images;
+
+    CursorThemeCache() = default;
+
+    ~CursorThemeCache();
+
+    CursorThemeCache(const CursorThemeCache &) = delete;
+
+    CursorThemeCache &operator=(const CursorThemeCache &) = delete;
+
+    [[nodiscard]] const Images *get(struct wl_shm *shm, const std::string &theme_name, int size, const char *name);
+
+    [[nodiscard]] size_t get_theme_count() const { return themes_.size(); }
+
+    [[nodiscard]] uint64_t get_memory_usage() const;
+
+    // the buffers belong to the connection, so the themes go before it is closed
+    void clear();
+
+private:
+    struct Theme {
+        struct wl_cursor_theme *theme;
+        // empty if the theme has no such cursor
+        std::unordered_map<std::string, Images> cursors;
+    };
+
+    // keyed by theme name and pixel size, loaded on first use
+    std::map<std::pair<std::string, int>, Theme> themes_;
+};
+
+#endif // SRC_SEAT_CURSOR_THEME_CACHE_H_
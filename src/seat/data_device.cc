@@ -0,0 +1,771 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "data_device.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+#include <glib-2.0/glib-unix.h>
+
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+namespace {
+// a memfd holding data, positioned at its start
+int create_memfd(const char *name, const void *data, size_t size) {
+    int fd = memfd_create(name, MFD_CLOEXEC);
+    if (fd < 0) {
+        return -1;
+    }
+    auto bytes = static_cast<const char *>(data);
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = write(fd, bytes + written, size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        written += static_cast<size_t>(n);
+    }
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
+
+// a peer closing its end of a transfer pipe must fail the write, not kill the process
+void ignore_sigpipe() {
+    struct sigaction action{};
+    if (sigaction(SIGPIPE, nullptr, &action) == 0 && action.sa_handler == SIG_DFL) {
+        signal(SIGPIPE, SIG_IGN);
+    }
+}
+}
+
+/**
+ * @class DataTransfer
+ * @brief One clipboard or drag-and-drop transfer, driven by the event loop.
+ *
+ * A receive moves the pipe handed to the source client into the destination
+ * with splice(), a send streams a file or memfd into the pipe with sendfile(),
+ * so the data does not pass through a userspace buffer. Where the kernel
+ * refuses that pairing of descriptors the transfer falls back to read and
+ * write. The pipe is non-blocking and watched by a GSource; each wakeup moves
+ * what is available, up to kMaxPerDispatch, and returns to the loop, so a slow
+ * peer never blocks the thread. Bytes the fallback read but could not write yet
+ * are kept and written before the next read.
+ *
+ * The transfer deletes itself after reporting the result to the callback.
+ */
+DataTransfer::DataTransfer(GMainContext *context, int from_fd, int to_fd, off_t from_offset,
+                           const DoneCallback &done, std::list<DataTransfer *> *registry) :
+        context_(context), from_fd_(from_fd), to_fd_(to_fd), offset_(from_offset), done_(done), registry_(registry) {
+    registry_->push_back(this);
+    watch(is_send());
+}
+
+/**
+ * @brief Cancels a transfer still running, without calling its callback.
+ */
+DataTransfer::~DataTransfer() {
+    registry_->remove(this);
+    if (source_) {
+        g_source_destroy(source_);
+        g_source_unref(source_);
+    }
+    close(from_fd_);
+    close(to_fd_);
+}
+
+/**
+ * @brief Starts receiving from a source client into fd.
+ *
+ * @param request Passes the write end of the pipe to the source, e.g. with
+ *                wl_data_offer_receive(); it is closed once request returns.
+ * @param fd The destination, duplicated; the caller keeps its own.
+ * @return The transfer, or nullptr if fd could not be duplicated or the pipe created.
+ */
+DataTransfer *DataTransfer::receive(GMainContext *context, const std::function<void(int pipe_fd)> &request, int fd,
+                                    const DoneCallback &done, std::list<DataTransfer *> *registry) {
+    int dest = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (dest < 0) {
+        return nullptr;
+    }
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+        close(dest);
+        return nullptr;
+    }
+    request(fds[1]);
+    close(fds[1]);
+    return new DataTransfer(context, fds[0], dest, -1, done, registry);
+}
+
+/**
+ * @brief Starts sending content_fd to a receiving client.
+ *
+ * @param content_fd A file or memfd, duplicated; sent from offset 0 without moving its file offset.
+ * @param pipe_fd The pipe the receiver reads, owned by the transfer from here on.
+ * @return The transfer, or nullptr if content_fd could not be duplicated.
+ */
+DataTransfer *DataTransfer::send(GMainContext *context, int content_fd, int pipe_fd,
+                                 std::list<DataTransfer *> *registry) {
+    int content = fcntl(content_fd, F_DUPFD_CLOEXEC, 0);
+    if (content < 0) {
+        close(pipe_fd);
+        return nullptr;
+    }
+    int flags = fcntl(pipe_fd, F_GETFL);
+    fcntl(pipe_fd, F_SETFL, flags | O_NONBLOCK);
+    return new DataTransfer(context, content, pipe_fd, 0, nullptr, registry);
+}
+
+/**
+ * @brief Waits for the destination to take more, or for the source to have more.
+ */
+void DataTransfer::watch(bool output) {
+    if (source_) {
+        g_source_destroy(source_);
+        g_source_unref(source_);
+    }
+    watching_output_ = output;
+    source_ = output ? g_unix_fd_source_new(to_fd_, static_cast<GIOCondition>(G_IO_OUT | G_IO_ERR))
+                     : g_unix_fd_source_new(from_fd_, static_cast<GIOCondition>(G_IO_IN | G_IO_HUP | G_IO_ERR));
+    g_source_set_callback(source_, G_SOURCE_FUNC(handle_ready), this, nullptr);
+    g_source_set_name(source_, "waypp data transfer");
+    g_source_attach(source_, context_);
+}
+
+ssize_t DataTransfer::move_chunk(size_t size) {
+    if (!use_copy_) {
+        ssize_t n = is_send() ? sendfile(to_fd_, from_fd_, &offset_, size)
+                              : splice(from_fd_, nullptr, to_fd_, nullptr, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n >= 0 || (errno != EINVAL && errno != ENOSYS)) {
+            return n;
+        }
+        use_copy_ = true;
+    }
+
+    return copy_chunk(size);
+}
+
+/**
+ * @brief The read and write fallback; what the destination did not take is written first next time.
+ *
+ * @return The bytes written, 0 at the end of the source, or -1 with errno set; EAGAIN
+ *         while the source is empty or the destination is full.
+ */
+ssize_t DataTransfer::copy_chunk(size_t size) {
+    if (buffer_pos_ == buffer_end_) {
+        buffer_.resize(64 * 1024);
+        const size_t count = std::min(size, buffer_.size());
+        ssize_t n = is_send() ? pread(from_fd_, buffer_.data(), count, offset_)
+                              : read(from_fd_, buffer_.data(), count);
+        if (n <= 0) {
+            return n;
+        }
+        if (is_send()) {
+            offset_ += n;
+        }
+        buffer_pos_ = 0;
+        buffer_end_ = static_cast<size_t>(n);
+    }
+    ssize_t written = 0;
+    while (buffer_pos_ < buffer_end_) {
+        ssize_t w = write(to_fd_, buffer_.data() + buffer_pos_, buffer_end_ - buffer_pos_);
+        if (w < 0 && errno == EINTR) {
+            continue;
+        }
+        if (w < 0) {
+            // EAGAIN keeps the tail for the next wakeup
+            if (errno == EAGAIN && written > 0) {
+                break;
+            }
+            return -1;
+        }
+        written += w;
+        buffer_pos_ += static_cast<size_t>(w);
+    }
+    return written;
+}
+
+void DataTransfer::finish(bool ok) {
+    auto done = std::move(done_);
+    auto bytes = bytes_;
+    delete this;
+    if (done) {
+        done(ok, bytes);
+    }
+}
+
+gboolean DataTransfer::handle_ready(gint /* fd */, GIOCondition /* condition */, gpointer data) {
+    auto transfer = static_cast<DataTransfer *>(data);
+    size_t moved = 0;
+    while (moved < kMaxPerDispatch) {
+        ssize_t n = transfer->move_chunk(kMaxPerDispatch - moved);
+        if (n > 0) {
+            moved += static_cast<size_t>(n);
+            transfer->bytes_ += static_cast<size_t>(n);
+            continue;
+        }
+        if (n == 0) {
+            transfer->finish(true);
+            return G_SOURCE_REMOVE;
+        }
+        if (errno == EINTR) {
+            continue;
+        }
+        if (errno == EAGAIN) {
+            // a receive with a full destination waits for it instead of the pipe
+            const bool output = transfer->is_send() || transfer->buffer_pos_ < transfer->buffer_end_;
+            if (output != transfer->watching_output_) {
+                transfer->watch(output);
+            }
+            break;
+        }
+        LOG_WARN("Data transfer failed after %zu bytes: errno %d", transfer->bytes_, errno);
+        transfer->finish(false);
+        return G_SOURCE_REMOVE;
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @class OfferCache
+ * @brief Lazily received representations of one offer.
+ *
+ * Nothing is read when the offer arrives. The first fetch() of a type
+ * receives it into a memfd, callers asking again while it is in flight wait
+ * for the same transfer, and later ones get the memfd right away. The cache
+ * lives as long as its offer, so a new selection starts empty.
+ */
+OfferCache::OfferCache(GMainContext *context, std::list<DataTransfer *> *transfers) :
+        context_(context), transfers_(transfers) {
+}
+
+OfferCache::~OfferCache() {
+    for (auto &[mime_type, entry]: entries_) {
+        delete entry.transfer;
+        if (entry.fd >= 0) {
+            close(entry.fd);
+        }
+    }
+}
+
+/**
+ * @brief Whether mime_type has been received completely and is kept.
+ */
+bool OfferCache::is_cached(const std::string &mime_type) const {
+    auto it = entries_.find(mime_type);
+    return it != entries_.end() && !it->second.transfer;
+}
+
+/**
+ * @brief Hands the content of mime_type to callback, receiving it first if needed.
+ *
+ * callback runs right away when the type is cached, otherwise once the
+ * transfer completes; on failure it gets fd -1 and the next fetch tries again.
+ *
+ * @param request Asks the source for mime_type through the pipe fd it is given.
+ * @return false if the transfer could not be started.
+ */
+bool OfferCache::fetch(const std::string &mime_type, const ReceiveRequest &request, const FetchCallback &callback) {
+    auto it = entries_.find(mime_type);
+    if (it != entries_.end()) {
+        if (it->second.transfer) {
+            it->second.waiters.push_back(callback);
+        } else {
+            callback(it->second.fd, it->second.size);
+        }
+        return true;
+    }
+
+    int memfd = memfd_create("waypp-offer-cache", MFD_CLOEXEC);
+    if (memfd < 0) {
+        return false;
+    }
+    auto transfer = DataTransfer::receive(
+            context_, [&](int pipe_fd) { request(mime_type.c_str(), pipe_fd); }, memfd,
+            [this, mime_type](bool ok, size_t size) { complete(mime_type, ok, size); }, transfers_);
+    if (!transfer) {
+        close(memfd);
+        return false;
+    }
+    auto &entry = entries_[mime_type];
+    entry.fd = memfd;
+    entry.transfer = transfer;
+    entry.waiters.push_back(callback);
+    return true;
+}
+
+void OfferCache::complete(const std::string &mime_type, bool ok, size_t size) {
+    auto it = entries_.find(mime_type);
+    if (it == entries_.end()) {
+        return;
+    }
+    auto waiters = std::move(it->second.waiters);
+    int fd = it->second.fd;
+    bool keep = ok && cached_bytes_ + size <= kMaxCachedBytes;
+    if (keep) {
+        it->second.size = size;
+        it->second.transfer = nullptr;
+        cached_bytes_ += size;
+    } else {
+        entries_.erase(it);
+    }
+    for (const auto &waiter: waiters) {
+        waiter(ok ? fd : -1, ok ? size : 0);
+    }
+    if (!keep) {
+        close(fd);
+    }
+}
+
+/**
+ * @class SourceContents
+ * @brief What a source offers, a file or memfd per mime type.
+ *
+ * Every request for a type sendfile()s its content from the start, so one
+ * copy serves any number of receivers.
+ */
+SourceContents::SourceContents(GMainContext *context, std::list<DataTransfer *> *transfers) :
+        context_(context), transfers_(transfers) {
+}
+
+SourceContents::~SourceContents() {
+    for (auto &content: contents_) {
+        close(content.second);
+    }
+}
+
+/**
+ * @brief Sets the content of mime_type to a duplicate of fd.
+ *
+ * The content is read from offset 0 each time it is requested, so it should
+ * not change while offered.
+ *
+ * @return false if fd could not be duplicated.
+ */
+bool SourceContents::set(const std::string &mime_type, int fd) {
+    int content = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (content < 0) {
+        return false;
+    }
+    auto it = contents_.find(mime_type);
+    if (it != contents_.end()) {
+        close(it->second);
+        it->second = content;
+    } else {
+        contents_[mime_type] = content;
+    }
+    return true;
+}
+
+/**
+ * @brief Sets the content of mime_type to a copy of data, held in a memfd.
+ *
+ * @return false if the memfd could not be created.
+ */
+bool SourceContents::set(const std::string &mime_type, const void *data, size_t size) {
+    int content = create_memfd("waypp-data-source", data, size);
+    if (content < 0) {
+        return false;
+    }
+    bool ok = set(mime_type, content);
+    close(content);
+    return ok;
+}
+
+/**
+ * @brief Streams the content of mime_type into the receiver's pipe fd, which it takes.
+ */
+void SourceContents::send(const char *mime_type, int fd) {
+    auto it = contents_.find(mime_type);
+    if (it == contents_.end() || !DataTransfer::send(context_, it->second, fd, transfers_)) {
+        LOG_WARN("No content to send for %s", mime_type);
+        if (it == contents_.end()) {
+            close(fd);
+        }
+    }
+}
+
+/**
+ * @class DataOffer
+ * @brief Data another client offers, as the selection or in a drag.
+ *
+ * Collects the mime types and the drag-and-drop actions of the offer. Nothing
+ * is read until asked for: fetch() receives a representation once and keeps
+ * it for repeated requests, receive() streams one into a descriptor of the
+ * caller's or a new memfd each time.
+ */
+DataOffer::DataOffer(struct wl_data_offer *offer, GMainContext *context, std::list<DataTransfer *> *transfers) :
+        wl_data_offer_(offer), context_(context), transfers_(transfers), cache_(context, transfers) {
+    wl_data_offer_add_listener(wl_data_offer_, &listener_, this);
+}
+
+DataOffer::~DataOffer() {
+    wl_data_offer_destroy(wl_data_offer_);
+}
+
+/**
+ * @brief Whether the source offers the mime type.
+ */
+bool DataOffer::has_mime_type(const std::string &mime_type) const {
+    return std::find(mime_types_.begin(), mime_types_.end(), mime_type) != mime_types_.end();
+}
+
+/**
+ * @brief Streams one representation into fd, in the background of the event loop.
+ *
+ * A regular file or memfd takes the data with splice(); other descriptors are
+ * written with a copy. fd is duplicated, the caller keeps its own.
+ *
+ * @param mime_type One of get_mime_types().
+ * @param fd The destination.
+ * @param done Called with the outcome and the byte count once the source closes the pipe.
+ * @return false if the pipe could not be created.
+ */
+bool DataOffer::receive(const std::string &mime_type, int fd, const DataTransfer::DoneCallback &done) {
+    return DataTransfer::receive(
+            context_, [&](int pipe_fd) { wl_data_offer_receive(wl_data_offer_, mime_type.c_str(), pipe_fd); }, fd,
+            done, transfers_) != nullptr;
+}
+
+/**
+ * @brief Receives one representation into a new memfd.
+ *
+ * @param mime_type One of get_mime_types().
+ * @param done Called with the memfd, positioned at its start and owned by the
+ *             callback, and the size; fd is -1 if the transfer failed.
+ * @return false if the memfd or the pipe could not be created.
+ */
+bool DataOffer::receive(const std::string &mime_type, const std::function<void(int fd, size_t size)> &done) {
+    int memfd = memfd_create("waypp-data-offer", MFD_CLOEXEC);
+    if (memfd < 0) {
+        return false;
+    }
+    bool started = receive(mime_type, memfd, [memfd, done](bool ok, size_t bytes) {
+        if (!ok) {
+            close(memfd);
+            done(-1, 0);
+            return;
+        }
+        lseek(memfd, 0, SEEK_SET);
+        done(memfd, bytes);
+    });
+    if (!started) {
+        close(memfd);
+    }
+    return started;
+}
+
+/**
+ * @brief Hands one representation to callback, receiving it only on the first request.
+ *
+ * @param mime_type One of get_mime_types().
+ * @param callback Gets a memfd owned by the offer and the size, fd -1 on failure.
+ * @return false if the transfer could not be started.
+ */
+bool DataOffer::fetch(const std::string &mime_type, const OfferCache::FetchCallback &callback) {
+    return cache_.fetch(
+            mime_type,
+            [this](const char *type, int pipe_fd) { wl_data_offer_receive(wl_data_offer_, type, pipe_fd); },
+            callback);
+}
+
+/**
+ * @brief Tells the drag source whether the surface under the pointer takes the data.
+ *
+ * @param serial The serial of the enter event.
+ * @param mime_type The type a drop would receive, nullptr to refuse.
+ */
+void DataOffer::accept(uint32_t serial, const char *mime_type) {
+    wl_data_offer_accept(wl_data_offer_, serial, mime_type);
+}
+
+/**
+ * @brief Sets the drag-and-drop actions the destination supports.
+ */
+void DataOffer::set_actions(uint32_t actions, uint32_t preferred) {
+    if (wl_proxy_get_version(reinterpret_cast<struct wl_proxy *>(wl_data_offer_)) >=
+        WL_DATA_OFFER_SET_ACTIONS_SINCE_VERSION) {
+        wl_data_offer_set_actions(wl_data_offer_, actions, preferred);
+    }
+}
+
+/**
+ * @brief Ends a drop once the data has been received.
+ */
+void DataOffer::finish() {
+    if (wl_proxy_get_version(reinterpret_cast<struct wl_proxy *>(wl_data_offer_)) >=
+        WL_DATA_OFFER_FINISH_SINCE_VERSION) {
+        wl_data_offer_finish(wl_data_offer_);
+    }
+}
+
+void DataOffer::handle_offer(struct wl_data_offer * /* offer */, const char *mime_type) {
+    mime_types_.emplace_back(mime_type);
+}
+
+void DataOffer::handle_source_actions(struct wl_data_offer * /* offer */, uint32_t source_actions) {
+    source_actions_ = source_actions;
+}
+
+void DataOffer::handle_action(struct wl_data_offer * /* offer */, uint32_t dnd_action) {
+    action_ = dnd_action;
+}
+
+const struct wl_data_offer_listener DataOffer::listener_ = {
+        .offer = listener_thunk<&DataOffer::handle_offer>,
+        .source_actions = listener_thunk<&DataOffer::handle_source_actions>,
+        .action = listener_thunk<&DataOffer::handle_action>,
+};
+
+/**
+ * @class DataSource
+ * @brief Data the client offers as the selection or in a drag.
+ *
+ * Each mime type is backed by a file or memfd. Every request for the data
+ * sendfile()s it from the start into the receiver's pipe on the event loop, so
+ * a large paste neither copies through userspace nor blocks the thread.
+ */
+DataSource::DataSource(struct wl_data_device_manager *manager, GMainContext *context,
+                       std::list<DataTransfer *> *transfers) :
+        wl_data_source_(wl_data_device_manager_create_data_source(manager)), contents_(context, transfers) {
+    wl_data_source_add_listener(wl_data_source_, &listener_, this);
+}
+
+DataSource::~DataSource() {
+    wl_data_source_destroy(wl_data_source_);
+}
+
+/**
+ * @brief Offers the content of a file or memfd as mime_type.
+ *
+ * fd is duplicated, the caller keeps its own; the content is read from offset 0
+ * each time the data is requested, so it should not change while offered.
+ *
+ * @return false if fd could not be duplicated.
+ */
+bool DataSource::offer(const std::string &mime_type, int fd) {
+    bool added = !contents_.has(mime_type);
+    if (!contents_.set(mime_type, fd)) {
+        return false;
+    }
+    if (added) {
+        wl_data_source_offer(wl_data_source_, mime_type.c_str());
+    }
+    return true;
+}
+
+/**
+ * @brief Offers a copy of data as mime_type, held in a memfd.
+ *
+ * @return false if the memfd could not be created.
+ */
+bool DataSource::offer(const std::string &mime_type, const void *data, size_t size) {
+    bool added = !contents_.has(mime_type);
+    if (!contents_.set(mime_type, data, size)) {
+        return false;
+    }
+    if (added) {
+        wl_data_source_offer(wl_data_source_, mime_type.c_str());
+    }
+    return true;
+}
+
+/**
+ * @brief Sets the drag-and-drop actions the source supports, before start_drag().
+ */
+void DataSource::set_actions(uint32_t actions) {
+    if (wl_proxy_get_version(reinterpret_cast<struct wl_proxy *>(wl_data_source_)) >=
+        WL_DATA_SOURCE_SET_ACTIONS_SINCE_VERSION) {
+        wl_data_source_set_actions(wl_data_source_, actions);
+    }
+}
+
+void DataSource::handle_target(struct wl_data_source * /* source */, const char * /* mime_type */) {
+}
+
+void DataSource::handle_send(struct wl_data_source * /* source */, const char *mime_type, int32_t fd) {
+    contents_.send(mime_type, fd);
+}
+
+void DataSource::handle_cancelled(struct wl_data_source * /* source */) {
+    if (cancelled_callback_) {
+        cancelled_callback_();
+    }
+}
+
+void DataSource::handle_dnd_drop_performed(struct wl_data_source * /* source */) {
+}
+
+void DataSource::handle_dnd_finished(struct wl_data_source * /* source */) {
+    if (finished_callback_) {
+        finished_callback_(action_);
+    }
+}
+
+void DataSource::handle_action(struct wl_data_source * /* source */, uint32_t dnd_action) {
+    action_ = dnd_action;
+}
+
+const struct wl_data_source_listener DataSource::listener_ = {
+        .target = listener_thunk<&DataSource::handle_target>,
+        .send = listener_thunk<&DataSource::handle_send>,
+        .cancelled = listener_thunk<&DataSource::handle_cancelled>,
+        .dnd_drop_performed = listener_thunk<&DataSource::handle_dnd_drop_performed>,
+        .dnd_finished = listener_thunk<&DataSource::handle_dnd_finished>,
+        .action = listener_thunk<&DataSource::handle_action>,
+};
+
+/**
+ * @class DataDevice
+ * @brief wl_data_device of a seat: the clipboard and drag-and-drop.
+ *
+ * Transfers run on context, the GMainContext the display dispatches. Sources
+ * and offers handed out must not outlive the device.
+ */
+DataDevice::DataDevice(struct wl_data_device_manager *manager, struct wl_seat *seat, GMainContext *context) :
+        wl_data_device_manager_(manager),
+        wl_data_device_(wl_data_device_manager_get_data_device(manager, seat)),
+        context_(context) {
+    wl_data_device_add_listener(wl_data_device_, &listener_, this);
+    ignore_sigpipe();
+}
+
+DataDevice::~DataDevice() {
+    // offer caches delete their own transfers, so the offers go first
+    new_offers_.clear();
+    selection_.reset();
+    drag_offer_.reset();
+    dropped_offer_.reset();
+    while (!transfers_.empty()) {
+        delete transfers_.front();
+    }
+    if (wl_proxy_get_version(reinterpret_cast<struct wl_proxy *>(wl_data_device_)) >=
+        WL_DATA_DEVICE_RELEASE_SINCE_VERSION) {
+        wl_data_device_release(wl_data_device_);
+    } else {
+        wl_data_device_destroy(wl_data_device_);
+    }
+}
+
+/**
+ * @brief A source to fill with offer() and pass to set_selection() or start_drag().
+ */
+std::unique_ptr<DataSource> DataDevice::create_source() const {
+    return std::make_unique<DataSource>(wl_data_device_manager_, context_,
+                                        const_cast<std::list<DataTransfer *> *>(&transfers_));
+}
+
+/**
+ * @brief Makes source the clipboard content, nullptr clears it.
+ *
+ * @param serial The serial of the input event that triggered the copy.
+ */
+void DataDevice::set_selection(const DataSource *source, uint32_t serial) {
+    wl_data_device_set_selection(wl_data_device_, source ? source->get_source() : nullptr, serial);
+}
+
+/**
+ * @brief Starts a drag from origin with the implicit grab of serial.
+ *
+ * @param icon A surface drawn under the pointer during the drag, or nullptr.
+ */
+void DataDevice::start_drag(const DataSource *source, struct wl_surface *origin, struct wl_surface *icon,
+                            uint32_t serial) {
+    wl_data_device_start_drag(wl_data_device_, source ? source->get_source() : nullptr, origin, icon, serial);
+}
+
+std::unique_ptr<DataOffer> DataDevice::claim_offer(struct wl_data_offer *offer) {
+    auto it = new_offers_.find(offer);
+    if (it == new_offers_.end()) {
+        return nullptr;
+    }
+    auto claimed = std::move(it->second);
+    new_offers_.erase(it);
+    return claimed;
+}
+
+void DataDevice::handle_data_offer(struct wl_data_device * /* device */, struct wl_data_offer *offer) {
+    new_offers_[offer] = std::make_unique<DataOffer>(offer, context_, &transfers_);
+}
+
+void DataDevice::handle_enter(struct wl_data_device * /* device */, uint32_t serial, struct wl_surface *surface,
+                              wl_fixed_t x, wl_fixed_t y, struct wl_data_offer *offer) {
+    drag_offer_ = claim_offer(offer);
+    drag_ = {
+            .offer = drag_offer_.get(),
+            .surface = surface,
+            .serial = serial,
+            .x = wl_fixed_to_double(x),
+            .y = wl_fixed_to_double(y),
+    };
+    if (drag_callback_) {
+        drag_callback_(drag_, false);
+    }
+}
+
+void DataDevice::handle_leave(struct wl_data_device * /* device */) {
+    drag_.offer = nullptr;
+    if (drag_callback_) {
+        drag_callback_(drag_, false);
+    }
+    drag_offer_.reset();
+    drag_ = {};
+}
+
+void DataDevice::handle_motion(struct wl_data_device * /* device */, uint32_t /* time */, wl_fixed_t x,
+                               wl_fixed_t y) {
+    drag_.x = wl_fixed_to_double(x);
+    drag_.y = wl_fixed_to_double(y);
+    if (drag_callback_) {
+        drag_callback_(drag_, false);
+    }
+}
+
+void DataDevice::handle_drop(struct wl_data_device * /* device */) {
+    if (drag_callback_) {
+        drag_callback_(drag_, true);
+    }
+    dropped_offer_ = std::move(drag_offer_);
+}
+
+void DataDevice::handle_selection(struct wl_data_device * /* device */, struct wl_data_offer *offer) {
+    selection_ = claim_offer(offer);
+    if (selection_callback_) {
+        selection_callback_(selection_.get());
+    }
+}
+
+const struct wl_data_device_listener DataDevice::listener_ = {
+        .data_offer = listener_thunk<&DataDevice::handle_data_offer>,
+        .enter = listener_thunk<&DataDevice::handle_enter>,
+        .leave = listener_thunk<&DataDevice::handle_leave>,
+        .motion = listener_thunk<&DataDevice::handle_motion>,
+        .drop = listener_thunk<&DataDevice::handle_drop>,
+        .selection = listener_thunk<&DataDevice::handle_selection>,
+};
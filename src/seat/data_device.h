@@ -0,0 +1,327 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_DATA_DEVICE_H_
+#define SRC_SEAT_DATA_DEVICE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <wayland-client.h>
+#include <glib-2.0/glib.h>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT DataTransfer {
+public:
+    typedef std::function<void(bool ok, size_t bytes)> DoneCallback;
+
+    // from_offset < 0 splices a pipe into to_fd, otherwise sendfile()s from_fd from that offset into a pipe;
+    // owns both descriptors
+    DataTransfer(GMainContext *context, int from_fd, int to_fd, off_t from_offset, const DoneCallback &done,
+                 std::list<DataTransfer *> *registry);
+
+    ~DataTransfer();
+
+    DataTransfer(const DataTransfer &) = delete;
+
+    DataTransfer &operator=(const DataTransfer &) = delete;
+
+    // asks the source to write into the pipe handed to request, and splices it into a duplicate of fd
+    static DataTransfer *receive(GMainContext *context, const std::function<void(int pipe_fd)> &request, int fd,
+                                 const DoneCallback &done, std::list<DataTransfer *> *registry);
+
+    // sends a duplicate of content_fd from its start into pipe_fd, which the transfer takes
+    static DataTransfer *send(GMainContext *context, int content_fd, int pipe_fd,
+                              std::list<DataTransfer *> *registry);
+
+private:
+    // bytes moved per wakeup at most, so a large paste does not starve the loop
+    static constexpr size_t kMaxPerDispatch = 4 * 1024 * 1024;
+
+    GMainContext *context_;
+    int from_fd_;
+    int to_fd_;
+    off_t offset_;
+    size_t bytes_{};
+    bool use_copy_{};
+    // the read and write fallback's buffer; [buffer_pos_, buffer_end_) is read but not yet written
+    std::vector<char> buffer_;
+    size_t buffer_pos_{};
+    size_t buffer_end_{};
+    bool watching_output_{};
+    DoneCallback done_;
+    std::list<DataTransfer *> *registry_;
+    GSource *source_{};
+
+    [[nodiscard]] bool is_send() const { return offset_ >= 0; }
+
+    void watch(bool output);
+
+    ssize_t move_chunk(size_t size);
+
+    ssize_t copy_chunk(size_t size);
+
+    void finish(bool ok);
+
+    static gboolean handle_ready(gint fd, GIOCondition condition, gpointer data);
+};
+
+// the representations of one offer, each received once on first request and shared by later ones
+class WAYPP_EXPORT OfferCache {
+public:
+    // fd belongs to the cache and stays valid until the offer goes away; read it with pread() or mmap()
+    typedef std::function<void(int fd, size_t size)> FetchCallback;
+    typedef std::function<void(const char *mime_type, int pipe_fd)> ReceiveRequest;
+
+    OfferCache(GMainContext *context, std::list<DataTransfer *> *transfers);
+
+    ~OfferCache();
+
+    OfferCache(const OfferCache &) = delete;
+
+    OfferCache &operator=(const OfferCache &) = delete;
+
+    bool fetch(const std::string &mime_type, const ReceiveRequest &request, const FetchCallback &callback);
+
+    [[nodiscard]] bool is_cached(const std::string &mime_type) const;
+
+private:
+    // content beyond this is handed to the callbacks once and not kept
+    static constexpr size_t kMaxCachedBytes = 16 * 1024 * 1024;
+
+    struct Entry {
+        int fd = -1;
+        size_t size{};
+        DataTransfer *transfer{};
+        std::vector<FetchCallback> waiters;
+    };
+
+    GMainContext *context_;
+    std::list<DataTransfer *> *transfers_;
+    std::map<std::string, Entry> entries_;
+    size_t cached_bytes_{};
+
+    void complete(const std::string &mime_type, bool ok, size_t size);
+};
+
+// the content a source offers, one file or memfd per mime type
+class WAYPP_EXPORT SourceContents {
+public:
+    SourceContents(GMainContext *context, std::list<DataTransfer *> *transfers);
+
+    ~SourceContents();
+
+    SourceContents(const SourceContents &) = delete;
+
+    SourceContents &operator=(const SourceContents &) = delete;
+
+    [[nodiscard]] bool has(const std::string &mime_type) const { return contents_.find(mime_type) != contents_.end(); }
+
+    bool set(const std::string &mime_type, int fd);
+
+    bool set(const std::string &mime_type, const void *data, size_t size);
+
+    void send(const char *mime_type, int fd);
+
+private:
+    GMainContext *context_;
+    std::list<DataTransfer *> *transfers_;
+    std::map<std::string, int> contents_;
+};
+
+class WAYPP_EXPORT DataOffer {
+public:
+    DataOffer(struct wl_data_offer *offer, GMainContext *context, std::list<DataTransfer *> *transfers);
+
+    ~DataOffer();
+
+    DataOffer(const DataOffer &) = delete;
+
+    DataOffer &operator=(const DataOffer &) = delete;
+
+    [[nodiscard]] struct wl_data_offer *get_offer() const { return wl_data_offer_; }
+
+    [[nodiscard]] const std::vector<std::string> &get_mime_types() const { return mime_types_; }
+
+    [[nodiscard]] bool has_mime_type(const std::string &mime_type) const;
+
+    // WL_DATA_DEVICE_MANAGER_DND_ACTION_* the source allows, and the one the compositor chose
+    [[nodiscard]] uint32_t get_source_actions() const { return source_actions_; }
+
+    [[nodiscard]] uint32_t get_action() const { return action_; }
+
+    bool receive(const std::string &mime_type, int fd, const DataTransfer::DoneCallback &done);
+
+    bool receive(const std::string &mime_type, const std::function<void(int fd, size_t size)> &done);
+
+    bool fetch(const std::string &mime_type, const OfferCache::FetchCallback &callback);
+
+    void accept(uint32_t serial, const char *mime_type);
+
+    void set_actions(uint32_t actions, uint32_t preferred);
+
+    void finish();
+
+private:
+    struct wl_data_offer *wl_data_offer_;
+    GMainContext *context_;
+    std::list<DataTransfer *> *transfers_;
+    std::vector<std::string> mime_types_;
+    uint32_t source_actions_{};
+    uint32_t action_{};
+    OfferCache cache_;
+
+    void handle_offer(struct wl_data_offer *offer, const char *mime_type);
+
+    void handle_source_actions(struct wl_data_offer *offer, uint32_t source_actions);
+
+    void handle_action(struct wl_data_offer *offer, uint32_t dnd_action);
+
+    static const struct wl_data_offer_listener listener_;
+};
+
+class WAYPP_EXPORT DataSource {
+public:
+    DataSource(struct wl_data_device_manager *manager, GMainContext *context, std::list<DataTransfer *> *transfers);
+
+    ~DataSource();
+
+    DataSource(const DataSource &) = delete;
+
+    DataSource &operator=(const DataSource &) = delete;
+
+    [[nodiscard]] struct wl_data_source *get_source() const { return wl_data_source_; }
+
+    bool offer(const std::string &mime_type, int fd);
+
+    bool offer(const std::string &mime_type, const void *data, size_t size);
+
+    void set_actions(uint32_t actions);
+
+    // the compositor replaced the selection or ended the drag; the source may be destroyed
+    void set_cancelled_callback(const std::function<void()> &callback) { cancelled_callback_ = callback; }
+
+    // the drop target finished, with the action it took
+    void set_finished_callback(const std::function<void(uint32_t action)> &callback) {
+        finished_callback_ = callback;
+    }
+
+private:
+    struct wl_data_source *wl_data_source_;
+    SourceContents contents_;
+    uint32_t action_{};
+    std::function<void()> cancelled_callback_;
+    std::function<void(uint32_t action)> finished_callback_;
+
+    void handle_target(struct wl_data_source *source, const char *mime_type);
+
+    void handle_send(struct wl_data_source *source, const char *mime_type, int32_t fd);
+
+    void handle_cancelled(struct wl_data_source *source);
+
+    void handle_dnd_drop_performed(struct wl_data_source *source);
+
+    void handle_dnd_finished(struct wl_data_source *source);
+
+    void handle_action(struct wl_data_source *source, uint32_t dnd_action);
+
+    static const struct wl_data_source_listener listener_;
+};
+
+// a drag entering or moving over one of the client's surfaces
+struct DataDrag {
+    DataOffer *offer;
+    struct wl_surface *surface;
+    uint32_t serial;
+    double x;
+    double y;
+};
+
+class WAYPP_EXPORT DataDevice {
+public:
+    DataDevice(struct wl_data_device_manager *manager, struct wl_seat *seat, GMainContext *context);
+
+    ~DataDevice();
+
+    DataDevice(const DataDevice &) = delete;
+
+    DataDevice &operator=(const DataDevice &) = delete;
+
+    // the clipboard content changed, nullptr when it is empty; the offer lives until the next selection
+    void set_selection_callback(const std::function<void(DataOffer *offer)> &callback) {
+        selection_callback_ = callback;
+    }
+
+    // enter, motion and drop carry the drag; leave passes an offer of nullptr
+    void set_drag_callback(const std::function<void(const DataDrag &drag, bool dropped)> &callback) {
+        drag_callback_ = callback;
+    }
+
+    [[nodiscard]] DataOffer *get_selection() const { return selection_.get(); }
+
+    [[nodiscard]] std::unique_ptr<DataSource> create_source() const;
+
+    void set_selection(const DataSource *source, uint32_t serial);
+
+    void start_drag(const DataSource *source, struct wl_surface *origin, struct wl_surface *icon, uint32_t serial);
+
+    [[nodiscard]] size_t get_transfer_count() const { return transfers_.size(); }
+
+private:
+    struct wl_data_device_manager *wl_data_device_manager_;
+    struct wl_data_device *wl_data_device_;
+    GMainContext *context_;
+    // running transfers, each frees itself as it completes
+    std::list<DataTransfer *> transfers_;
+    // announced by data_offer, until enter or selection claims them
+    std::map<struct wl_data_offer *, std::unique_ptr<DataOffer>> new_offers_;
+    std::unique_ptr<DataOffer> selection_;
+    std::unique_ptr<DataOffer> drag_offer_;
+    // kept past the leave following a drop, so the receiver can read it and finish()
+    std::unique_ptr<DataOffer> dropped_offer_;
+    DataDrag drag_{};
+    std::function<void(DataOffer *offer)> selection_callback_;
+    std::function<void(const DataDrag &drag, bool dropped)> drag_callback_;
+
+    [[nodiscard]] std::unique_ptr<DataOffer> claim_offer(struct wl_data_offer *offer);
+
+    void handle_data_offer(struct wl_data_device *device, struct wl_data_offer *offer);
+
+    void handle_enter(struct wl_data_device *device, uint32_t serial, struct wl_surface *surface, wl_fixed_t x,
+                      wl_fixed_t y, struct wl_data_offer *offer);
+
+    void handle_leave(struct wl_data_device *device);
+
+    void handle_motion(struct wl_data_device *device, uint32_t time, wl_fixed_t x, wl_fixed_t y);
+
+    void handle_drop(struct wl_data_device *device);
+
+    void handle_selection(struct wl_data_device *device, struct wl_data_offer *offer);
+
+    static const struct wl_data_device_listener listener_;
+};
+
+#endif // SRC_SEAT_DATA_DEVICE_H_
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "gesture.h"
+
+#include <cmath>
+
+namespace {
+struct Centroid {
+    double x;
+    double y;
+    // mean distance of the fingers from the centroid
+    double spread;
+    // angle of the line from the first to the second finger, in degrees
+    double angle;
+    size_t fingers;
+};
+
+/**
+ * @brief Summarizes the points of frame that are still down.
+ */
+Centroid centroid(const TouchFrame &frame) {
+    Centroid c{};
+    const TouchSlot *first = nullptr;
+    const TouchSlot *second = nullptr;
+    for (size_t i = 0; i < frame.count; i++) {
+        const auto &slot = frame.slots[i];
+        if (slot.ended) {
+            continue;
+        }
+        c.x += slot.x;
+        c.y += slot.y;
+        c.fingers++;
+        if (!first) {
+            first = &slot;
+        } else if (!second) {
+            second = &slot;
+        }
+    }
+    if (!c.fingers) {
+        return c;
+    }
+    c.x /= static_cast<double>(c.fingers);
+    c.y /= static_cast<double>(c.fingers);
+    for (size_t i = 0; i < frame.count; i++) {
+        const auto &slot = frame.slots[i];
+        if (!slot.ended) {
+            c.spread += std::hypot(slot.x - c.x, slot.y - c.y);
+        }
+    }
+    c.spread /= static_cast<double>(c.fingers);
+    if (second) {
+        c.angle = std::atan2(second->y - first->y, second->x - first->x) * 180.0 / M_PI;
+    }
+    return c;
+}
+}
+
+/**
+ * @brief Merges UPDATE steps until flush(); other phases flush and pass straight through.
+ *
+ * @param coalesce true to deliver at most one update per flush(), e.g. per render frame.
+ */
+void GestureSink::set_coalesce(bool coalesce) {
+    coalesce_ = coalesce;
+    if (!coalesce) {
+        flush();
+    }
+}
+
+/**
+ * @brief Delivers gesture, or merges it into the pending update.
+ */
+void GestureSink::emit(const Gesture &gesture) {
+    if (coalesce_ && gesture.phase == Gesture::UPDATE) {
+        if (pending_ && update_.type == gesture.type) {
+            const double dx = update_.dx + gesture.dx;
+            const double dy = update_.dy + gesture.dy;
+            const double rotation = update_.rotation + gesture.rotation;
+            update_ = gesture;
+            update_.dx = dx;
+            update_.dy = dy;
+            update_.rotation = rotation;
+        } else {
+            flush();
+            update_ = gesture;
+            pending_ = true;
+        }
+        return;
+    }
+    flush();
+    if (callback_) {
+        callback_(gesture);
+    }
+}
+
+/**
+ * @brief Delivers the pending merged update, if any.
+ */
+void GestureSink::flush() {
+    if (!pending_) {
+        return;
+    }
+    pending_ = false;
+    if (callback_) {
+        callback_(update_);
+    }
+}
+
+/**
+ * @class TouchGestures
+ * @brief Turns touch frames into gestures once, instead of every application redoing the math.
+ *
+ * One finger pans; when it is lifted fast a SWIPE END with the release velocity follows
+ * the PAN END. Two or more fingers pinch: translation of the centroid, scale of the finger
+ * spread and rotation of the first two fingers. A change in the number of fingers ends
+ * the gesture, and the next frames start a new one.
+ */
+
+/**
+ * @brief Feeds the snapshot of one wl_touch.frame.
+ */
+void TouchGestures::feed(const TouchFrame &frame) {
+    if (frame.cancelled) {
+        if (active_) {
+            end(frame, true);
+        }
+        return;
+    }
+
+    const Centroid c = centroid(frame);
+    if (active_ && c.fingers != fingers_) {
+        end(frame, false);
+    }
+    if (!c.fingers) {
+        fingers_ = 0;
+        return;
+    }
+
+    if (!active_) {
+        if (fingers_ != c.fingers) {
+            // new baseline for the finger count
+            fingers_ = c.fingers;
+            start_x_ = c.x;
+            start_y_ = c.y;
+            start_spread_ = c.spread;
+            last_x_ = c.x;
+            last_y_ = c.y;
+            last_angle_ = c.angle;
+            last_scale_ = 1.0;
+            last_time_ns_ = frame.time_ns;
+            velocity_x_ = velocity_y_ = 0;
+            return;
+        }
+        const bool moved = std::hypot(c.x - start_x_, c.y - start_y_) > kSlop;
+        const bool spread = c.fingers > 1 && std::fabs(c.spread - start_spread_) > kSlop;
+        if (!moved && !spread) {
+            return;
+        }
+        active_ = true;
+        type_ = c.fingers > 1 ? Gesture::PINCH : Gesture::PAN;
+        sink_.emit({.type = type_, .phase = Gesture::BEGIN, .fingers = static_cast<uint32_t>(c.fingers),
+                    .time_ns = frame.time_ns, .scale = 1.0, .x = c.x, .y = c.y});
+    }
+
+    double rotation = c.angle - last_angle_;
+    if (rotation > 180.0) {
+        rotation -= 360.0;
+    } else if (rotation < -180.0) {
+        rotation += 360.0;
+    }
+    const double dx = c.x - last_x_;
+    const double dy = c.y - last_y_;
+    if (frame.time_ns > last_time_ns_) {
+        // smoothed, so one jittery frame does not decide the release velocity
+        const double dt = static_cast<double>(frame.time_ns - last_time_ns_) / 1e9;
+        velocity_x_ = 0.6 * velocity_x_ + 0.4 * dx / dt;
+        velocity_y_ = 0.6 * velocity_y_ + 0.4 * dy / dt;
+    }
+    last_scale_ = start_spread_ > 0 ? c.spread / start_spread_ : 1.0;
+    sink_.emit({.type = type_, .phase = Gesture::UPDATE, .fingers = static_cast<uint32_t>(c.fingers),
+                .time_ns = frame.time_ns, .dx = dx, .dy = dy, .scale = last_scale_,
+                .rotation = c.fingers > 1 ? rotation : 0.0, .x = c.x, .y = c.y});
+    last_x_ = c.x;
+    last_y_ = c.y;
+    last_angle_ = c.angle;
+    last_time_ns_ = frame.time_ns;
+}
+
+/**
+ * @brief Ends the active gesture, with a swipe for a fast one finger release.
+ */
+void TouchGestures::end(const TouchFrame &frame, bool cancelled) {
+    const Gesture last{.type = type_, .phase = cancelled ? Gesture::CANCEL : Gesture::END,
+                       .fingers = static_cast<uint32_t>(fingers_), .time_ns = frame.time_ns,
+                       .scale = last_scale_, .x = last_x_, .y = last_y_, .velocity_x = velocity_x_, .velocity_y = velocity_y_};
+    sink_.emit(last);
+    if (!cancelled && type_ == Gesture::PAN && std::hypot(velocity_x_, velocity_y_) > kSwipeVelocity) {
+        Gesture swipe = last;
+        swipe.type = Gesture::SWIPE;
+        sink_.emit(swipe);
+    }
+    active_ = false;
+    fingers_ = 0;
+}
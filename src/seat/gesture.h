@@ -0,0 +1,127 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_GESTURE_H_
+#define SRC_SEAT_GESTURE_H_
+
+#include <cstdint>
+#include <functional>
+
+#include "touch.h"
+#include "utils/export.h"
+
+/**
+ * @brief One step of a touchpad or touchscreen gesture.
+ */
+struct Gesture {
+    typedef enum {
+        // several fingers moving together
+        SWIPE,
+        // fingers moving apart or together, and rotating
+        PINCH,
+        // fingers resting, touchpads only
+        HOLD,
+        // one finger dragging, touchscreens only
+        PAN,
+    } Type;
+
+    typedef enum {
+        BEGIN,
+        UPDATE,
+        END,
+        CANCEL,
+    } Phase;
+
+    Type type;
+    Phase phase;
+    uint32_t fingers;
+    // CLOCK_MONOTONIC time of the latest event
+    uint64_t time_ns;
+    // translation since the previous delivered step, in surface local coordinates
+    double dx;
+    double dy;
+    // distance between the fingers relative to the begin
+    double scale;
+    // rotation since the previous delivered step, in degrees clockwise
+    double rotation;
+    // centroid of the fingers, touchscreens only
+    double x;
+    double y;
+    // velocity in surface coordinates per second at the end of a touchscreen gesture
+    double velocity_x;
+    double velocity_y;
+};
+
+/**
+ * @brief Passes gestures to a callback, optionally merging updates until flush().
+ */
+class WAYPP_EXPORT GestureSink {
+public:
+    void set_callback(const std::function<void(const Gesture &gesture)> &callback) { callback_ = callback; }
+
+    void set_coalesce(bool coalesce);
+
+    void emit(const Gesture &gesture);
+
+    void flush();
+
+private:
+    std::function<void(const Gesture &gesture)> callback_;
+    bool coalesce_{};
+    bool pending_{};
+    Gesture update_{};
+};
+
+/**
+ * @brief Recognizes pan, swipe and pinch gestures from TouchFrame snapshots.
+ */
+class WAYPP_EXPORT TouchGestures {
+public:
+    void set_callback(const std::function<void(const Gesture &gesture)> &callback) { sink_.set_callback(callback); }
+
+    void set_coalesce(bool coalesce) { sink_.set_coalesce(coalesce); }
+
+    void flush() { sink_.flush(); }
+
+    void feed(const TouchFrame &frame);
+
+private:
+    // movement before a gesture begins, so taps are not reported as gestures
+    static constexpr double kSlop = 8.0;
+    // release speed above which a pan also ends in a swipe
+    static constexpr double kSwipeVelocity = 800.0;
+
+    GestureSink sink_;
+    bool active_{};
+    Gesture::Type type_{Gesture::PAN};
+    size_t fingers_{};
+    // state at the begin of the gesture and at the previous frame
+    double start_x_{};
+    double start_y_{};
+    double start_spread_{};
+    double last_x_{};
+    double last_y_{};
+    double last_angle_{};
+    double last_scale_{1.0};
+    uint64_t last_time_ns_{};
+    double velocity_x_{};
+    double velocity_y_{};
+
+    void end(const TouchFrame &frame, bool cancelled);
+};
+
+#endif // SRC_SEAT_GESTURE_H_
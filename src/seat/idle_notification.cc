@@ -0,0 +1,73 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "idle_notification.h"
+
+#include "utils/listener.h"
+
+/**
+ * @class IdleNotification
+ * @brief Tells when a seat has seen no input for a while, and when input resumes.
+ *
+ * Wraps an ext_idle_notification_v1. From version 2 of the notifier the notification
+ * follows input alone unless respect_inhibitors is set, which is what a kiosk or
+ * signage player dimming its animations needs: a surface inhibiting idle, e.g. its
+ * own video, does not make the screen count as touched. A version 1 notifier always
+ * honours inhibitors.
+ *
+ * @param notifier           The compositor's ext_idle_notifier_v1.
+ * @param version            The version notifier is bound at.
+ * @param seat               The seat whose input is followed.
+ * @param timeout_ms         The time without input after which the seat is idle.
+ * @param respect_inhibitors true to stay active while an idle inhibitor is in place.
+ * @param callback           Invoked with true when the seat becomes idle, false on the next input.
+ */
+IdleNotification::IdleNotification(struct ext_idle_notifier_v1 *notifier, uint32_t version, struct wl_seat *seat,
+                                   uint32_t timeout_ms, bool respect_inhibitors,
+                                   const std::function<void(bool idle)> &callback) :
+        timeout_ms_(timeout_ms),
+        respect_inhibitors_(respect_inhibitors || version < EXT_IDLE_NOTIFIER_V1_GET_INPUT_IDLE_NOTIFICATION_SINCE_VERSION),
+        callback_(callback) {
+    if (respect_inhibitors_) {
+        ext_idle_notification_ = ext_idle_notifier_v1_get_idle_notification(notifier, timeout_ms, seat);
+    } else {
+        ext_idle_notification_ = ext_idle_notifier_v1_get_input_idle_notification(notifier, timeout_ms, seat);
+    }
+    ext_idle_notification_v1_add_listener(ext_idle_notification_, &listener_, this);
+}
+
+IdleNotification::~IdleNotification() {
+    ext_idle_notification_v1_destroy(ext_idle_notification_);
+}
+
+void IdleNotification::handle_idled(struct ext_idle_notification_v1 * /* notification */) {
+    idle_ = true;
+    if (callback_) {
+        callback_(true);
+    }
+}
+
+void IdleNotification::handle_resumed(struct ext_idle_notification_v1 * /* notification */) {
+    idle_ = false;
+    if (callback_) {
+        callback_(false);
+    }
+}
+
+const struct ext_idle_notification_v1_listener IdleNotification::listener_ = {
+        .idled = listener_thunk<&IdleNotification::handle_idled>,
+        .resumed = listener_thunk<&IdleNotification::handle_resumed>,
+};
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_SEAT_IDLE_NOTIFICATION_H_
+#define SRC_SEAT_IDLE_NOTIFICATION_H_
+
+#include <cstdint>
+#include <functional>
+
+#include <wayland-client.h>
+
+#if defined(ENABLE_IDLE_NOTIFY)
+#include "ext-idle-notify-v1-client-protocol.h"
+#endif
+#include "utils/export.h"
+
+class WAYPP_EXPORT IdleNotification {
+public:
+    explicit IdleNotification(struct ext_idle_notifier_v1 *notifier, uint32_t version, struct wl_seat *seat,
+                              uint32_t timeout_ms, bool respect_inhibitors,
+                              const std::function<void(bool idle)> &callback);
+
+    ~IdleNotification();
+
+    IdleNotification(const IdleNotification &) = delete;
+
+    IdleNotification &operator=(const IdleNotification &) = delete;
+
+    [[nodiscard]] bool is_idle() const { return idle_; }
+
+    [[nodiscard]] uint32_t get_timeout_ms() const { return timeout_ms_; }
+
+    // idle inhibitors, e.g. a video player's, only hold the notification off when true
+    [[nodiscard]] bool respects_inhibitors() const { return respect_inhibitors_; }
+
+private:
+    struct ext_idle_notification_v1 *ext_idle_notification_{};
+    uint32_t timeout_ms_;
+    bool respect_inhibitors_;
+    bool idle_{};
+    std::function<void(bool idle)> callback_;
+
+    void handle_idled(struct ext_idle_notification_v1 *notification);
+
+    void handle_resumed(struct ext_idle_notification_v1 *notification);
+
+    static const struct ext_idle_notification_v1_listener listener_;
+};
+
+#endif // SRC_SEAT_IDLE_NOTIFICATION_H_
@@ -0,0 +1,33 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_INPUT_DEVICES_H_
+#define SRC_SEAT_INPUT_DEVICES_H_
+
+// input devices an application uses, the others are never created
+typedef enum {
+    INPUT_DEVICE_KEYBOARD = 1 << 0,
+    INPUT_DEVICE_POINTER = 1 << 1,
+    INPUT_DEVICE_TOUCH = 1 << 2,
+    // the pointer's cursor surface and theme
+    INPUT_DEVICE_CURSOR = 1 << 3,
+    INPUT_DEVICE_TABLET = 1 << 4,
+    INPUT_DEVICE_ALL = INPUT_DEVICE_KEYBOARD | INPUT_DEVICE_POINTER | INPUT_DEVICE_TOUCH | INPUT_DEVICE_CURSOR |
+                       INPUT_DEVICE_TABLET,
+} InputDevices;
+
+#endif // SRC_SEAT_INPUT_DEVICES_H_
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_INPUT_EVENT_H_
+#define SRC_SEAT_INPUT_EVENT_H_
+
+#include <array>
+#include <cstdint>
+#include <type_traits>
+
+#include <wayland-client.h>
+
+#include "utils/spsc_ring.h"
+#include "utils/export.h"
+
+/**
+ * @brief A compact copy of one pointer, keyboard or touch event, for handing to a render thread.
+ *
+ * Fixed size and free of pointers and strings, so queues and batches of events are
+ * copied with plain memory copies; see MotionBatch for motion samples as arrays.
+ */
+struct InputEvent {
+    typedef enum : uint8_t {
+        POINTER_ENTER,
+        POINTER_LEAVE,
+        POINTER_MOTION,
+        // code is the button, value the wl_pointer_button_state
+        POINTER_BUTTON,
+        // code is the wl_pointer_axis, x the wl_fixed_t value
+        POINTER_AXIS,
+        // a wl_pointer.frame, closing the pointer events before it
+        POINTER_FRAME,
+        // x and y are the unaccelerated wl_fixed_t deltas
+        POINTER_RELATIVE_MOTION,
+        KEYBOARD_ENTER,
+        KEYBOARD_LEAVE,
+        // code is the evdev key code, value the wl_keyboard_key_state, keysym the xkb keysym after compose,
+        // XKB_KEY_NoSymbol for a key that is part of an unfinished sequence
+        KEY,
+        // code is the touch point id
+        TOUCH_DOWN,
+        TOUCH_UP,
+        TOUCH_MOTION,
+        TOUCH_FRAME,
+        TOUCH_CANCEL,
+    } Type;
+
+    // CLOCK_MONOTONIC nanoseconds, precise with zwp_input_timestamps_manager_v1; 0 for events without a time
+    uint64_t time_ns;
+    // surface local wl_fixed_t coordinates
+    wl_fixed_t x;
+    wl_fixed_t y;
+    int32_t code;
+    uint32_t value;
+    uint32_t keysym;
+    // last, so the event packs into 32 bytes
+    Type type;
+    // the seat the event came from, see Seat::get_device_index()
+    uint8_t device;
+};
+
+static_assert(sizeof(InputEvent) == 32, "InputEvent should stay two to a cache line");
+static_assert(std::is_trivially_copyable_v<InputEvent>, "InputEvent is copied between threads as plain memory");
+
+typedef SpscRing<InputEvent, 256> InputRing;
+
+/**
+ * @brief Maps input focus surfaces to the InputRing of the window that owns them.
+ *
+ * Each surface subscribes to some input sources; devices find a ring only for those,
+ * so e.g. a keyboard focused on a surface not taking keys skips its XKB processing.
+ * Devices look the ring up on focus and keep it until get_generation() changes.
+ *
+ * Used on the thread dispatching the default queue only; windows add and remove
+ * their surfaces from that thread, or before it starts dispatching.
+ */
+class WAYPP_EXPORT InputRouter {
+public:
+    typedef enum : uint8_t {
+        SOURCE_POINTER = 1 << 0,
+        SOURCE_KEYBOARD = 1 << 1,
+        SOURCE_TOUCH = 1 << 2,
+        SOURCE_ALL = SOURCE_POINTER | SOURCE_KEYBOARD | SOURCE_TOUCH,
+    } Source;
+
+    /**
+     * @param sources The Source bits the ring receives events of.
+     * @return false if kMaxSurfaces surfaces are already routed.
+     */
+    bool add(struct wl_surface *surface, InputRing *ring, uint8_t sources = SOURCE_ALL) {
+        for (auto &entry: entries_) {
+            if (!entry.surface || entry.surface == surface) {
+                entry = {surface, ring, sources};
+                generation_++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void remove(struct wl_surface *surface) {
+        for (auto &entry: entries_) {
+            if (entry.surface == surface) {
+                entry = {};
+                generation_++;
+            }
+        }
+    }
+
+    /**
+     * @return false if surface is not routed.
+     */
+    bool set_sources(struct wl_surface *surface, uint8_t sources) {
+        for (auto &entry: entries_) {
+            if (entry.surface == surface) {
+                entry.sources = sources;
+                generation_++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // the ring of surface if it subscribed to source, nullptr otherwise
+    [[nodiscard]] InputRing *find(struct wl_surface *surface, uint8_t source = SOURCE_ALL) const {
+        if (!surface) {
+            return nullptr;
+        }
+        for (const auto &entry: entries_) {
+            if (entry.surface == surface) {
+                return entry.sources & source ? entry.ring : nullptr;
+            }
+        }
+        return nullptr;
+    }
+
+    // changes whenever a lookup could give a different result
+    [[nodiscard]] uint32_t get_generation() const { return generation_; }
+
+private:
+    static constexpr size_t kMaxSurfaces = 16;
+
+    struct Entry {
+        struct wl_surface *surface;
+        InputRing *ring;
+        uint8_t sources;
+    };
+
+    std::array<Entry, kMaxSurfaces> entries_{};
+    uint32_t generation_{};
+};
+
+#endif // SRC_SEAT_INPUT_EVENT_H_
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "input_timestamps.h"
+
+#include <ctime>
+
+#include "utils/listener.h"
+
+/**
+ * @class InputTimestamps
+ * @brief Nanosecond timestamps of the events of one input device.
+ *
+ * wl_pointer, wl_keyboard and wl_touch events carry a 32 bit millisecond time.
+ * With zwp_input_timestamps_v1 the compositor sends the full CLOCK_MONOTONIC time
+ * right before each event, which take() then returns instead.
+ */
+InputTimestamps::~InputTimestamps() {
+    if (zwp_input_timestamps_) {
+        zwp_input_timestamps_v1_destroy(zwp_input_timestamps_);
+    }
+}
+
+/**
+ * @brief Starts receiving precise timestamps.
+ *
+ * @param timestamps Created with the zwp_input_timestamps_manager_v1 request matching the device.
+ */
+void InputTimestamps::enable(struct zwp_input_timestamps_v1 *timestamps) {
+    if (zwp_input_timestamps_) {
+        zwp_input_timestamps_v1_destroy(zwp_input_timestamps_);
+    }
+    zwp_input_timestamps_ = timestamps;
+    pending_ns_ = 0;
+    zwp_input_timestamps_v1_add_listener(zwp_input_timestamps_, &listener_, this);
+}
+
+/**
+ * @brief Returns the time of the event being dispatched.
+ *
+ * @param time_ms The time argument of the event.
+ * @return The CLOCK_MONOTONIC time in nanoseconds: precise if the compositor sent it, else from time_ms.
+ */
+uint64_t InputTimestamps::take(uint32_t time_ms) {
+    if (pending_ns_) {
+        const uint64_t time_ns = pending_ns_;
+        pending_ns_ = 0;
+        return time_ns;
+    }
+    return from_ms(time_ms);
+}
+
+/**
+ * @brief Extends a 32 bit millisecond event time to an absolute time.
+ *
+ * Assumes, like most clients, that the compositor's clock is CLOCK_MONOTONIC and
+ * that the event is less than 49 days old.
+ *
+ * @param time_ms The time argument of an event.
+ * @return The CLOCK_MONOTONIC time in nanoseconds, millisecond precision.
+ */
+uint64_t InputTimestamps::from_ms(uint32_t time_ms) {
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    const uint64_t now_ms = static_cast<uint64_t>(ts.tv_sec) * 1000ULL + static_cast<uint64_t>(ts.tv_nsec) / 1000000ULL;
+    const auto age_ms = static_cast<uint32_t>(static_cast<uint32_t>(now_ms) - time_ms);
+    return now_ms > age_ms ? (now_ms - age_ms) * 1000000ULL : 0;
+}
+
+/**
+ * @brief Handles the precise time of the next input event.
+ */
+void InputTimestamps::handle_timestamp(struct zwp_input_timestamps_v1 * /* timestamps */,
+                                       uint32_t tv_sec_hi,
+                                       uint32_t tv_sec_lo,
+                                       uint32_t tv_nsec) {
+    const uint64_t tv_sec = (static_cast<uint64_t>(tv_sec_hi) << 32) | tv_sec_lo;
+    pending_ns_ = tv_sec * 1000000000ULL + tv_nsec;
+}
+
+const struct zwp_input_timestamps_v1_listener InputTimestamps::listener_ = {
+        .timestamp = listener_thunk<&InputTimestamps::handle_timestamp>,
+};
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_INPUT_TIMESTAMPS_H_
+#define SRC_SEAT_INPUT_TIMESTAMPS_H_
+
+#include <cstdint>
+
+#include <wayland-client.h>
+
+#include "input-timestamps-unstable-v1-client-protocol.h"
+#include "utils/export.h"
+
+class WAYPP_EXPORT InputTimestamps {
+public:
+    InputTimestamps() = default;
+
+    ~InputTimestamps();
+
+    InputTimestamps(const InputTimestamps &) = delete;
+
+    InputTimestamps &operator=(const InputTimestamps &) = delete;
+
+    void enable(struct zwp_input_timestamps_v1 *timestamps);
+
+    [[nodiscard]] bool is_enabled() const { return zwp_input_timestamps_ != nullptr; }
+
+    uint64_t take(uint32_t time_ms);
+
+    [[nodiscard]] static uint64_t from_ms(uint32_t time_ms);
+
+private:
+    struct zwp_input_timestamps_v1 *zwp_input_timestamps_{};
+    // sent right before the input event it belongs to, 0 once taken
+    uint64_t pending_ns_{};
+
+    void handle_timestamp(struct zwp_input_timestamps_v1 *timestamps,
+                          uint32_t tv_sec_hi,
+                          uint32_t tv_sec_lo,
+                          uint32_t tv_nsec);
+
+    static const struct zwp_input_timestamps_v1_listener listener_;
+};
+
+#endif // SRC_SEAT_INPUT_TIMESTAMPS_H_
@@ -16,13 +16,19 @@
 
 #include "keyboard.h"
 
-#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
 
 #include <wayland-client.h>
 #include <sys/mman.h>
+#include <sys/timerfd.h>
 #include <unistd.h>
 #include <xkbcommon/xkbcommon.h>
 
+#include "utils/logging.h"
+#include "utils/trace.h"
+
 
 /**
  * @class Keyboard
@@ -31,9 +37,21 @@
  * The Keyboard class provides a wrapper for a keyboard device,
  * which interacts with the Wayland compositor.
  */
-Keyboard::Keyboard(struct wl_keyboard *keyboard) : keyboard_(keyboard),
-                                                   xkb_context_(xkb_context_new(XKB_CONTEXT_NO_FLAGS)) {
+Keyboard::Keyboard(struct wl_keyboard *keyboard, GMainContext *context) :
+        keyboard_(keyboard),
+        context_(context) {
     wl_keyboard_add_listener(keyboard, &listener_, this);
+
+    repeat_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (repeat_fd_ < 0) {
+        LOG_ERROR("Keyboard: timerfd_create failed, key repeat disabled");
+        return;
+    }
+    repeat_source_ = g_source_new(&repeat_source_funcs_, sizeof(GSource));
+    g_source_add_unix_fd(repeat_source_, repeat_fd_, G_IO_IN);
+    g_source_set_callback(repeat_source_, reinterpret_cast<GSourceFunc>(handle_repeat), this, nullptr);
+    g_source_set_name(repeat_source_, "waypp key repeat");
+    g_source_attach(repeat_source_, context_);
 }
 
 /**
@@ -43,8 +61,84 @@ Keyboard::Keyboard(struct wl_keyboard *keyboard) : keyboard_(keyboard),
  * The Keyboard class manages the interaction with a Wayland keyboard input device.
  */
 Keyboard::~Keyboard() {
-    wl_keyboard_release(keyboard_);
-    wl_keyboard_destroy(keyboard_);
+    if (repeat_source_) {
+        g_source_destroy(repeat_source_);
+        g_source_unref(repeat_source_);
+    }
+    if (repeat_fd_ >= 0) {
+        close(repeat_fd_);
+    }
+    cancel_keymap_compile();
+    if (wl_keyboard_get_version(keyboard_) >= WL_KEYBOARD_RELEASE_SINCE_VERSION) {
+        wl_keyboard_release(keyboard_);
+    } else {
+        wl_keyboard_destroy(keyboard_);
+    }
+    xkb_state_unref(xkb_state_);
+    xkb_keymap_unref(keymap_);
+    if (compose_state_) {
+        xkb_compose_state_unref(compose_state_);
+    }
+}
+
+/**
+ * @brief Composes dead keys and compose sequences with table, shared with the other keyboards.
+ *
+ * @param table The compose table, owned by the Display; nullptr delivers keysyms uncomposed.
+ */
+void Keyboard::set_compose_table(ComposeTable *table) {
+    compose_table_ = table;
+    if (compose_state_) {
+        xkb_compose_state_unref(compose_state_);
+        compose_state_ = nullptr;
+    }
+}
+
+/**
+ * @brief Receives precise timestamps for the events of this keyboard.
+ *
+ * @param manager The compositor's zwp_input_timestamps_manager_v1.
+ */
+void Keyboard::enable_timestamps(struct zwp_input_timestamps_manager_v1 *manager) {
+    timestamps_.enable(zwp_input_timestamps_manager_v1_get_keyboard_timestamps(manager, keyboard_));
+}
+
+/**
+ * @brief Passes the time of the event being dispatched to the input callback.
+ *
+ * @return The CLOCK_MONOTONIC time of the event in nanoseconds.
+ */
+uint64_t Keyboard::report_input(uint32_t time) {
+    const uint64_t time_ns = timestamps_.take(time);
+    if (input_callback_) {
+        input_callback_(time_ns);
+    }
+    return time_ns;
+}
+
+/**
+ * @brief Looks up the ring of the focused surface's window, if it takes key events.
+ *
+ * Done on enter and again once the router changed, e.g. a window subscribing to keys
+ * while it has focus, or going away.
+ */
+void Keyboard::update_route() {
+    if (!input_router_) {
+        return;
+    }
+    route_generation_ = input_router_->get_generation();
+    input_ring_ = input_router_->find(active_surface_, InputRouter::SOURCE_KEYBOARD);
+}
+
+/**
+ * @brief Applies a modifiers event, or defers it while a keymap compiles.
+ */
+void Keyboard::queue_modifiers(const DeferredEvent &event) {
+    if (keymap_pending_) {
+        deferred_events_.push_back(event);
+        return;
+    }
+    process_modifiers(event.mods_depressed, event.mods_latched, event.mods_locked, event.group);
 }
 
 /**
@@ -65,9 +159,14 @@ void Keyboard::handle_enter(void *data,
                             uint32_t /* serial */,
                             struct wl_surface *surface,
                             struct wl_array * /* keys */) {
-    std::cerr << "handle_enter" << std::endl;
+    TRACE_TRACK_SCOPE(static_cast<Keyboard *>(data)->trace_track_, "Keyboard::handle_enter");
     const auto obj = static_cast<Keyboard *>(data);
     obj->active_surface_ = surface;
+    obj->update_route();
+    obj->push_event({.type = InputEvent::KEYBOARD_ENTER});
+    if (obj->focus_callback_) {
+        obj->focus_callback_(surface, true);
+    }
 }
 
 /**
@@ -84,10 +183,20 @@ void Keyboard::handle_enter(void *data,
 void Keyboard::handle_leave(void *data,
                             struct wl_keyboard * /* keyboard */,
                             uint32_t /* serial */,
-                            struct wl_surface * /* surface */) {
-    std::cerr << "handle_leave" << std::endl;
+                            struct wl_surface *surface) {
+    TRACE_TRACK_SCOPE(static_cast<Keyboard *>(data)->trace_track_, "Keyboard::handle_leave");
     const auto obj = static_cast<Keyboard *>(data);
+    obj->stop_repeat();
+    // a sequence is not continued in another window
+    if (obj->compose_state_) {
+        xkb_compose_state_reset(obj->compose_state_);
+    }
     obj->active_surface_ = nullptr;
+    obj->push_event({.type = InputEvent::KEYBOARD_LEAVE});
+    obj->input_ring_ = nullptr;
+    if (obj->focus_callback_) {
+        obj->focus_callback_(surface, false);
+    }
 }
 
 /**
@@ -95,22 +204,148 @@ void Keyboard::handle_leave(void *data,
  * @brief The Keyboard class handles keyboard input events.
  *
  * This class provides functionality to handle keyboard events such as keymap changes.
+ * A keymap found in the KeymapCache is installed right away. Any other keymap is
+ * compiled on a worker thread so the dispatch thread keeps delivering frame
+ * callbacks and pointer input; key and modifier events arriving in the meantime
+ * are deferred and replayed against the new keymap once it is installed.
  */
 void Keyboard::handle_keymap(void *data,
                              struct wl_keyboard * /* keyboard */,
-                             uint32_t /* format */,
+                             uint32_t format,
                              int fd,
                              uint32_t size) {
+    TRACE_TRACK_SCOPE(static_cast<Keyboard *>(data)->trace_track_, "Keyboard::handle_keymap");
     const auto obj = static_cast<Keyboard *>(data);
-    char *keymap_string = static_cast<char *>(mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0));
-    xkb_keymap_unref(obj->keymap_);
-    obj->keymap_ = xkb_keymap_new_from_string(obj->xkb_context_, keymap_string,
-                                              XKB_KEYMAP_FORMAT_TEXT_V1,
-                                              XKB_KEYMAP_COMPILE_NO_FLAGS);
-    munmap(keymap_string, size);
+    if (format != WL_KEYBOARD_KEYMAP_FORMAT_XKB_V1) {
+        close(fd);
+        return;
+    }
+    // MAP_PRIVATE, the fd is read-only from wl_seat v7 on
+    auto keymap_string = static_cast<char *>(mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0));
     close(fd);
-    xkb_state_unref(obj->xkb_state_);
-    obj->xkb_state_ = xkb_state_new(obj->keymap_);
+    if (keymap_string == MAP_FAILED) {
+        LOG_ERROR("Keyboard: failed to map keymap");
+        return;
+    }
+    std::string text(keymap_string, strnlen(keymap_string, size));
+    munmap(keymap_string, size);
+
+    // a keymap still compiling is superseded by this one
+    obj->install_pending_keymap(true);
+    if (struct xkb_keymap *keymap = obj->keymap_cache_->find(text.data(), text.size())) {
+        obj->install_keymap(keymap);
+        return;
+    }
+    obj->compile_keymap(std::move(text));
+}
+
+/**
+ * @brief Compiles text on keymap_thread_ and wakes the context once it is done.
+ *
+ * @param text The keymap text, moved to the worker.
+ */
+void Keyboard::compile_keymap(std::string text) {
+    keymap_pending_ = true;
+    keymap_ready_.store(false, std::memory_order_relaxed);
+    keymap_thread_ = std::thread([this, text = std::move(text)] {
+        TRACE_TRACK_SCOPE(trace_track_, "Keyboard::compile_keymap");
+        compiled_keymap_ = keymap_cache_->get(text.data(), text.size());
+        GSource *source = g_idle_source_new();
+        g_source_set_callback(source, reinterpret_cast<GSourceFunc>(handle_keymap_ready), this, nullptr);
+        g_source_attach(source, context_);
+        keymap_source_ = source;
+        keymap_ready_.store(true, std::memory_order_release);
+    });
+}
+
+/**
+ * @brief Waits for a running compile and drops its result and deferred events.
+ */
+void Keyboard::cancel_keymap_compile() {
+    if (keymap_thread_.joinable()) {
+        keymap_thread_.join();
+    }
+    if (keymap_source_) {
+        g_source_destroy(keymap_source_);
+        g_source_unref(keymap_source_);
+        keymap_source_ = nullptr;
+    }
+    if (compiled_keymap_) {
+        xkb_keymap_unref(compiled_keymap_);
+        compiled_keymap_ = nullptr;
+    }
+    keymap_pending_ = false;
+    deferred_events_.clear();
+}
+
+/**
+ * @brief Installs the keymap compiled on keymap_thread_ and replays the deferred events.
+ *
+ * Called from the idle source the worker attaches and, so that a Display dispatched
+ * without a GMainContext loop is not held up, from the keyboard handlers.
+ *
+ * @param wait Whether to wait for a compile that has not finished yet.
+ */
+void Keyboard::install_pending_keymap(bool wait) {
+    if (!keymap_pending_ || (!wait && !keymap_ready_.load(std::memory_order_acquire))) {
+        return;
+    }
+    keymap_thread_.join();
+    keymap_pending_ = false;
+    if (keymap_source_) {
+        g_source_destroy(keymap_source_);
+        g_source_unref(keymap_source_);
+        keymap_source_ = nullptr;
+    }
+    if (compiled_keymap_) {
+        install_keymap(compiled_keymap_);
+        compiled_keymap_ = nullptr;
+    }
+    std::vector<DeferredEvent> events;
+    events.swap(deferred_events_);
+    for (const auto &event: events) {
+        if (event.modifiers) {
+            process_modifiers(event.mods_depressed, event.mods_latched, event.mods_locked, event.group);
+        } else {
+            process_key(event.time_ns, event.key, event.state);
+        }
+    }
+}
+
+/**
+ * @brief Makes keymap current with a fresh state.
+ *
+ * @param keymap The keymap, the reference is taken over.
+ */
+void Keyboard::install_keymap(struct xkb_keymap *keymap) {
+    stop_repeat();
+    xkb_keymap_unref(keymap_);
+    keymap_ = keymap;
+    xkb_state_unref(xkb_state_);
+    xkb_state_ = xkb_state_new(keymap_);
+    keysym_table_.invalidate();
+    if (compose_state_) {
+        xkb_compose_state_reset(compose_state_);
+    }
+}
+
+/**
+ * @brief Installs a keymap compiled before, e.g. by a keyboard of the same seat that went away.
+ *
+ * Replaced by the keymap the compositor sends for this keyboard.
+ *
+ * @param keymap The keymap, a reference is taken.
+ */
+void Keyboard::set_keymap(struct xkb_keymap *keymap) {
+    install_keymap(xkb_keymap_ref(keymap));
+}
+
+/**
+ * @brief Idle callback on the keyboard's context, the worker attaches it when a compile finishes.
+ */
+gboolean Keyboard::handle_keymap_ready(Keyboard *keyboard) {
+    keyboard->install_pending_keymap(true);
+    return G_SOURCE_REMOVE;
 }
 
 /**
@@ -128,40 +363,136 @@ void Keyboard::handle_keymap(void *data,
 void Keyboard::handle_key(void *data,
                           struct wl_keyboard * /* keyboard */,
                           uint32_t /* serial */,
-                          uint32_t /* time */,
+                          uint32_t time,
                           uint32_t key,
                           uint32_t state) {
+    TRACE_TRACK_SCOPE(static_cast<Keyboard *>(data)->trace_track_, "Keyboard::handle_key");
     const auto obj = static_cast<Keyboard *>(data);
+    const uint64_t time_ns = obj->report_input(time);
+    if (obj->route_changed()) {
+        obj->update_route();
+    }
+    if (!obj->input_ring_) {
+        // no window takes it, the keysym, compose sequence and repeat are not worked out
+        obj->stop_repeat();
+        return;
+    }
+    obj->install_pending_keymap(false);
+    if (obj->modifiers_unrouted_) {
+        obj->modifiers_unrouted_ = false;
+        obj->queue_modifiers(obj->unrouted_modifiers_);
+    }
+    if (obj->keymap_pending_) {
+        obj->deferred_events_.push_back({.modifiers = false, .time_ns = time_ns, .key = key, .state = state});
+        return;
+    }
+    obj->process_key(time_ns, key, state);
+}
+
+/**
+ * @brief Translates a key with the current keymap state and pushes it to the focused window.
+ *
+ * @param time_ns The CLOCK_MONOTONIC time of the event in nanoseconds.
+ * @param key The evdev scancode.
+ * @param state The wl_keyboard_key_state.
+ */
+void Keyboard::process_key(uint64_t time_ns, uint32_t key, uint32_t state) {
+    InputEvent event{.time_ns = time_ns, .code = static_cast<int32_t>(key), .value = state,
+                     .type = InputEvent::KEY};
 
-    if (!obj->xkb_state_)
+    if (!xkb_state_) {
+        push_event(event);
         return;
+    }
 
     // translate scancode to XKB scancode
     const uint32_t xkb_scancode = key + 8;
+    xkb_keysym_t keysym = get_keysym(xkb_scancode);
+    // releases are not fed, the press decided what the key produced
+    const bool composed = state == WL_KEYBOARD_KEY_STATE_PRESSED && compose(keysym);
+    event.keysym = keysym;
+    push_event(event);
 
-    // Gets the single keysym obtained from pressing a particular key in a given
-    // keyboard state.
-    xkb_keysym_t keysym = xkb_state_key_get_one_sym(obj->xkb_state_, xkb_scancode);
-    if (keysym == XKB_KEY_NoSymbol) {
-        const xkb_keysym_t *key_symbols;
-        const int res =
-                xkb_state_key_get_syms(obj->xkb_state_, xkb_scancode, &key_symbols);
-        if (res == 0) {
-            keysym = XKB_KEY_NoSymbol;
-        } else {
-            // only use the first symbol until the use case for two is clarified
-            keysym = key_symbols[0];
-            for (int i = 0; i < res; i++) {
-                std::cerr << "xkb keysym: 0x" << std::hex << key_symbols[i] << std::dec << std::endl;
-            }
+    if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+        if (!composed && xkb_keymap_key_repeats(keymap_, xkb_scancode)) {
+            start_repeat(key);
         }
+    } else if (state == WL_KEYBOARD_KEY_STATE_RELEASED && repeating_ && key == repeat_key_) {
+        stop_repeat();
     }
+}
 
-    if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
-        if (xkb_keymap_key_repeats(obj->keymap_, xkb_scancode)) {
+/**
+ * @brief Feeds a pressed key's keysym to the compose state.
+ *
+ * A key that starts or continues a sequence, e.g. a dead key, yields XKB_KEY_NoSymbol,
+ * the key completing it the composed keysym, and a key cancelling it NoSymbol too.
+ * Keys outside any sequence keep their keysym.
+ *
+ * @param keysym The keysym of the key, replaced by what the sequence produced.
+ * @return true if the key took part in a sequence, so it must not repeat.
+ */
+bool Keyboard::compose(xkb_keysym_t &keysym) {
+    if (!compose_state_) {
+        const auto table = compose_table_ ? compose_table_->get() : nullptr;
+        if (!table) {
+            return false;
         }
-    } else if (state == WL_KEYBOARD_KEY_STATE_RELEASED) {
+        compose_state_ = xkb_compose_state_new(table, XKB_COMPOSE_STATE_NO_FLAGS);
+        if (!compose_state_) {
+            compose_table_ = nullptr;
+            return false;
+        }
+    }
+    if (keysym == XKB_KEY_NoSymbol ||
+        xkb_compose_state_feed(compose_state_, keysym) != XKB_COMPOSE_FEED_ACCEPTED) {
+        return false;
+    }
+    switch (xkb_compose_state_get_status(compose_state_)) {
+        case XKB_COMPOSE_COMPOSING:
+            keysym = XKB_KEY_NoSymbol;
+            return true;
+        case XKB_COMPOSE_COMPOSED:
+            // results of several keysyms are rare, their text is dropped with the sequence
+            keysym = xkb_compose_state_get_one_sym(compose_state_);
+            xkb_compose_state_reset(compose_state_);
+            return true;
+        case XKB_COMPOSE_CANCELLED:
+            keysym = XKB_KEY_NoSymbol;
+            xkb_compose_state_reset(compose_state_);
+            return true;
+        case XKB_COMPOSE_NOTHING:
+            break;
     }
+    return false;
+}
+
+/**
+ * @brief Looks up the keysym of a key in the current keymap state.
+ *
+ * @param xkb_scancode The XKB scancode, the evdev scancode plus 8.
+ * @return The first keysym of the key, XKB_KEY_NoSymbol if it has none.
+ */
+xkb_keysym_t Keyboard::get_keysym(uint32_t xkb_scancode) {
+    return keysym_table_.lookup(xkb_state_, xkb_scancode).keysym;
+}
+
+/**
+ * @brief Returns the text a key produces in the current keymap state.
+ *
+ * @param key The evdev scancode, as in InputEvent::code.
+ * @return NUL terminated UTF-8, empty if the key produces no text or no keymap is installed.
+ */
+const char *Keyboard::get_utf8(uint32_t key) {
+    if (!xkb_state_) {
+        return "";
+    }
+    if (modifiers_unrouted_ && !keymap_pending_) {
+        modifiers_unrouted_ = false;
+        process_modifiers(unrouted_modifiers_.mods_depressed, unrouted_modifiers_.mods_latched,
+                          unrouted_modifiers_.mods_locked, unrouted_modifiers_.group);
+    }
+    return keysym_table_.lookup(xkb_state_, key + 8).utf8;
 }
 
 /***************************************************************************/
@@ -172,54 +503,144 @@ void Keyboard::handle_modifiers(void *data,
                                 uint32_t mods_latched,
                                 uint32_t mods_locked,
                                 uint32_t group) {
+    TRACE_TRACK_SCOPE(static_cast<Keyboard *>(data)->trace_track_, "Keyboard::handle_modifiers");
     const auto obj = static_cast<Keyboard *>(data);
-    xkb_state_update_mask(obj->xkb_state_, mods_depressed, mods_latched, mods_locked, 0, 0, group);
+    const DeferredEvent event{.modifiers = true, .time_ns = 0, .key = 0, .state = 0,
+                              .mods_depressed = mods_depressed, .mods_latched = mods_latched,
+                              .mods_locked = mods_locked, .group = group};
+    if (obj->route_changed()) {
+        obj->update_route();
+    }
+    if (!obj->input_ring_) {
+        // kept for the first key a window takes, the compositor sends modifiers on every enter anyway
+        obj->unrouted_modifiers_ = event;
+        obj->modifiers_unrouted_ = true;
+        return;
+    }
+    obj->modifiers_unrouted_ = false;
+    obj->install_pending_keymap(false);
+    obj->queue_modifiers(event);
+}
+
+/**
+ * @brief Applies the modifier state sent by the compositor to the keymap state.
+ */
+void Keyboard::process_modifiers(uint32_t mods_depressed, uint32_t mods_latched, uint32_t mods_locked,
+                                 uint32_t group) {
+    if (xkb_state_) {
+        xkb_state_update_mask(xkb_state_, mods_depressed, mods_latched, mods_locked, 0, 0, group);
+        keysym_table_.update(xkb_state_);
+    }
+}
+
+/**
+ * @brief Starts repeating key after the repeat delay.
+ *
+ * The timerfd is armed once with the delay and the repeat interval, the kernel
+ * keeps it ticking at the rate until the key is released.
+ *
+ * @param key The evdev scancode of the pressed key.
+ */
+void Keyboard::start_repeat(uint32_t key) {
+    if (repeat_fd_ < 0 || repeat_rate_ <= 0) {
+        return;
+    }
+    repeat_key_ = key;
+    repeating_ = true;
+    const int64_t interval_ns = 1000000000LL / repeat_rate_;
+    const int64_t delay_ns = std::max<int64_t>(repeat_delay_, 1) * 1000000LL;
+    itimerspec spec{
+            .it_interval = {.tv_sec = interval_ns / 1000000000LL, .tv_nsec = interval_ns % 1000000000LL},
+            .it_value = {.tv_sec = delay_ns / 1000000000LL, .tv_nsec = delay_ns % 1000000000LL},
+    };
+    timerfd_settime(repeat_fd_, 0, &spec, nullptr);
+}
+
+/**
+ * @brief Disarms the repeat timer.
+ */
+void Keyboard::stop_repeat() {
+    if (!repeating_) {
+        return;
+    }
+    repeating_ = false;
+    const itimerspec spec{};
+    timerfd_settime(repeat_fd_, 0, &spec, nullptr);
+}
+
+/**
+ * @brief Dispatches the repeat source to its callback when the timerfd is readable.
+ */
+gboolean Keyboard::repeat_source_dispatch(GSource * /* source */, GSourceFunc callback, gpointer user_data) {
+    return callback ? callback(user_data) : G_SOURCE_CONTINUE;
 }
 
+GSourceFuncs Keyboard::repeat_source_funcs_ = {
+        .prepare = nullptr,
+        .check = nullptr,
+        .dispatch = repeat_source_dispatch,
+        .finalize = nullptr,
+        .closure_callback = nullptr,
+        .closure_marshal = nullptr,
+};
+
 /**
  * @brief Handles the repeated key events for the Keyboard.
  *
  * This function is called when a key is being held down and needs to be repeated.
+ * Ticks missed while the loop was busy are dropped instead of replayed as a burst.
  *
  * @param keyboard A pointer to the Keyboard instance.
  *
- * @return TRUE if the key repeat rate is set, FALSE otherwise.
+ * @return G_SOURCE_CONTINUE, the source lives as long as the keyboard.
  */
 gboolean Keyboard::handle_repeat(Keyboard *keyboard) {
-
-    if (keyboard) {
-        if (keyboard->key_repeat_rate_) {
-            keyboard->key_timeout_id_ = g_timeout_add(static_cast<guint>(keyboard->key_repeat_rate_),
-                                                      reinterpret_cast<GSourceFunc>(handle_repeat), keyboard);
-            return TRUE;
-        } else {
-            g_source_remove(keyboard->key_timeout_id_);
-            return FALSE;
-        }
+    uint64_t expirations;
+    if (read(keyboard->repeat_fd_, &expirations, sizeof(expirations)) != sizeof(expirations) ||
+        !keyboard->repeating_) {
+        return G_SOURCE_CONTINUE;
+    }
+    if (keyboard->route_changed()) {
+        keyboard->update_route();
     }
-    return TRUE;
+    if (!keyboard->input_ring_) {
+        keyboard->stop_repeat();
+        return G_SOURCE_CONTINUE;
+    }
+    TRACE_TRACK_SCOPE(keyboard->trace_track_, "Keyboard::handle_repeat");
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const uint32_t key = keyboard->repeat_key_;
+    keyboard->push_event({.time_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000ULL +
+                                     static_cast<uint64_t>(now.tv_nsec),
+                          .code = static_cast<int32_t>(key), .value = kKeyStateRepeated,
+                          .keysym = keyboard->xkb_state_ ? keyboard->get_keysym(key + 8) : XKB_KEY_NoSymbol,
+                          .type = InputEvent::KEY});
+    return G_SOURCE_CONTINUE;
 }
 
 /**
 * @brief Handles repeat info for the Keyboard class.
 *
 * This function is called when repeat rate and delay of key repeats are received.
-* It creates a timeout to call the handle_repeat function at the specified delay.
+* Applies from the next key press on.
 *
 * @param data A pointer to the Keyboard object.
 * @param wl_keyboard A pointer to the wl_keyboard object.
-* @param rate The repeat rate of key events in milliseconds.
+* @param rate The repeat rate in characters per second, 0 disables repeat.
 * @param delay The delay before key repeat starts in milliseconds.
 */
 void Keyboard::handle_repeat_info(void *data,
                                   struct wl_keyboard * /* wl_keyboard */,
                                   int32_t rate,
                                   int32_t delay) {
+    TRACE_TRACK_SCOPE(static_cast<Keyboard *>(data)->trace_track_, "Keyboard::handle_repeat_info");
     const auto obj = static_cast<Keyboard *>(data);
-    obj->key_timeout_id_ = g_timeout_add(static_cast<guint>(delay), reinterpret_cast<GSourceFunc>(handle_repeat), obj);
-    obj->key_repeat_rate_ = rate;
-    obj->key_timeout_id_ = g_timeout_add(static_cast<guint>(delay),
-                                         reinterpret_cast<GSourceFunc>(handle_repeat), obj);
+    obj->repeat_rate_ = rate;
+    obj->repeat_delay_ = delay;
+    if (rate <= 0) {
+        obj->stop_repeat();
+    }
 }
 
 const struct wl_keyboard_listener Keyboard::listener_ = {
@@ -17,31 +17,166 @@
 #ifndef SRC_SEAT_KEYBOARD_H_
 #define SRC_SEAT_KEYBOARD_H_
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <glib-2.0/glib.h>
 #include <xkbcommon/xkbcommon.h>
 
-class Keyboard {
+#include "compose_table.h"
+#include "input_event.h"
+#include "input_timestamps.h"
+#include "keymap_cache.h"
+#include "keysym_table.h"
+#include "utils/export.h"
+
+class WAYPP_EXPORT Keyboard {
 public:
-    explicit Keyboard(struct wl_keyboard *keyboard);
+    // InputEvent::value of a key repeated by the client, wl_keyboard.key_state.repeated of v10
+    static constexpr uint32_t kKeyStateRepeated = 2;
+
+    explicit Keyboard(struct wl_keyboard *keyboard, GMainContext *context = nullptr);
 
     ~Keyboard();
 
+    void set_trace_track(const std::string &track) { trace_track_ = track; }
+
+    void enable_timestamps(struct zwp_input_timestamps_manager_v1 *manager);
+
+    void set_input_callback(const std::function<void(uint64_t time_ns)> &callback) { input_callback_ = callback; }
+
+    // invoked on enter and leave with the surface gaining or losing focus
+    void set_focus_callback(const std::function<void(struct wl_surface *surface, bool focused)> &callback) {
+        focus_callback_ = callback;
+    }
+
+    // surface with this keyboard's focus, nullptr if none
+    [[nodiscard]] struct wl_surface *get_focus() const { return active_surface_; }
+
+    // the focused surface's window takes key events, see InputRouter::SOURCE_KEYBOARD
+    [[nodiscard]] bool is_routed() const { return input_ring_ != nullptr; }
+
+    // device stamps every event pushed, see InputEvent::device
+    void set_input_router(const InputRouter *router, uint8_t device = 0) {
+        input_router_ = router;
+        device_index_ = device;
+    }
+
+    void set_keymap_cache(KeymapCache *cache) { keymap_cache_ = cache; }
+
+    void set_compose_table(ComposeTable *table);
+
+    [[nodiscard]] const char *get_utf8(uint32_t key);
+
+    [[nodiscard]] struct xkb_keymap *get_keymap() const { return keymap_; }
+
+    void set_keymap(struct xkb_keymap *keymap);
+
 private:
     struct wl_keyboard *keyboard_;
+    std::string trace_track_;
+    InputTimestamps timestamps_;
+    std::function<void(uint64_t time_ns)> input_callback_;
+    std::function<void(struct wl_surface *surface, bool focused)> focus_callback_;
+    GMainContext *context_;
     struct wl_surface *active_surface_{};
-    struct xkb_context *xkb_context_;
+    const InputRouter *input_router_{};
+    uint8_t device_index_{};
+    // ring of the window with keyboard focus, if it takes key events
+    InputRing *input_ring_{};
+    // input_router_ generation input_ring_ was looked up at
+    uint32_t route_generation_{};
+    KeymapCache *keymap_cache_{&KeymapCache::get_default()};
     struct xkb_keymap *keymap_{};
     struct xkb_state *xkb_state_{};
+    KeysymTable keysym_table_;
+    ComposeTable *compose_table_{};
+    // created once the shared table is compiled
+    struct xkb_compose_state *compose_state_{};
+
+    // key and modifier events received while a keymap compiles
+    struct DeferredEvent {
+        bool modifiers;
+        uint64_t time_ns;
+        uint32_t key;
+        uint32_t state;
+        uint32_t mods_depressed;
+        uint32_t mods_latched;
+        uint32_t mods_locked;
+        uint32_t group;
+    };
+
+    // keymaps missing from the cache compile on keymap_thread_
+    std::thread keymap_thread_;
+    bool keymap_pending_{};
+    // written by keymap_thread_, read after joining it
+    std::atomic<bool> keymap_ready_{};
+    struct xkb_keymap *compiled_keymap_{};
+    GSource *keymap_source_{};
+    std::vector<DeferredEvent> deferred_events_;
+    // the latest modifiers, not applied while no window takes key events
+    DeferredEvent unrouted_modifiers_{.modifiers = true};
+    bool modifiers_unrouted_{};
+
+    // one timerfd per keyboard, armed with the delay and the rate as its interval
+    int repeat_fd_{-1};
+    GSource *repeat_source_{};
+    // keys per second and milliseconds until the first repeat, a rate of 0 disables repeat
+    int32_t repeat_rate_{25};
+    int32_t repeat_delay_{600};
+    // evdev scancode of the repeating key
+    uint32_t repeat_key_{};
+    bool repeating_{};
 
-    xkb_keysym_t keysym_pressed_{};
-    guint key_timeout_id_{};
+    uint64_t report_input(uint32_t time);
 
-    int32_t key_repeat_rate_{};
+    [[nodiscard]] bool route_changed() const {
+        return input_router_ && input_router_->get_generation() != route_generation_;
+    }
+
+    void update_route();
+
+    void queue_modifiers(const DeferredEvent &event);
+
+    void push_event(InputEvent event) const {
+        if (input_ring_) {
+            event.device = device_index_;
+            (void) input_ring_->push(event);
+        }
+    }
+
+    void compile_keymap(std::string text);
+
+    void cancel_keymap_compile();
+
+    void install_pending_keymap(bool wait);
+
+    void install_keymap(struct xkb_keymap *keymap);
+
+    static gboolean handle_keymap_ready(Keyboard *keyboard);
+
+    void process_key(uint64_t time_ns, uint32_t key, uint32_t state);
+
+    void process_modifiers(uint32_t mods_depressed, uint32_t mods_latched, uint32_t mods_locked, uint32_t group);
+
+    [[nodiscard]] xkb_keysym_t get_keysym(uint32_t xkb_scancode);
+
+    [[nodiscard]] bool compose(xkb_keysym_t &keysym);
+
+    void start_repeat(uint32_t key);
+
+    void stop_repeat();
 
     static gboolean handle_repeat(Keyboard *keyboard);
 
+    static gboolean repeat_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data);
+
+    static GSourceFuncs repeat_source_funcs_;
+
     static void handle_enter(void * /* data */,
                              struct wl_keyboard * /* keyboard */,
                              uint32_t /* serial */,
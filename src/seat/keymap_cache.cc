@@ -0,0 +1,131 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "keymap_cache.h"
+
+#include <functional>
+#include <string_view>
+
+#include "utils/logging.h"
+
+/**
+ * @class KeymapCache
+ * @brief Compiled XKB keymaps, keyed by the keymap text.
+ *
+ * Compositors send the same keymap to every seat's keyboard and again on every
+ * reconnect or focus change in some cases. Compiling one takes several milliseconds
+ * on small ARM cores, so each distinct text is compiled once with one shared
+ * xkb_context and handed out by reference afterwards.
+ */
+KeymapCache::KeymapCache() : xkb_context_(xkb_context_new(XKB_CONTEXT_NO_FLAGS)) {
+    entries_.reserve(kMaxEntries);
+}
+
+KeymapCache::~KeymapCache() {
+    clear();
+    xkb_context_unref(xkb_context_);
+}
+
+/**
+ * @brief The cache shared by every Display of the process, so it survives reconnects.
+ */
+KeymapCache &KeymapCache::get_default() {
+    static KeymapCache cache;
+    return cache;
+}
+
+/**
+ * @brief Returns the compiled keymap for text if it is cached, without compiling.
+ *
+ * Never waits for a compile running on another thread.
+ *
+ * @param text XKB_KEYMAP_FORMAT_TEXT_V1 keymap, as sent by wl_keyboard.keymap.
+ * @param length Length of text without the terminating NUL.
+ * @return A new reference the caller releases with xkb_keymap_unref(), nullptr if text is not cached.
+ */
+struct xkb_keymap *KeymapCache::find(const char *text, size_t length) {
+    const std::string_view key(text, length);
+    const size_t hash = std::hash<std::string_view>{}(key);
+
+    std::lock_guard<std::mutex> lock(entries_mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->hash == hash && it->text == key) {
+            Entry entry = std::move(*it);
+            entries_.erase(it);
+            entries_.push_back(std::move(entry));
+            return xkb_keymap_ref(entries_.back().keymap);
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Returns the compiled keymap for text, compiling it on first use.
+ *
+ * Safe to call from any thread. Compiles are serialized on the shared context,
+ * while find() keeps answering from the entries in the meantime.
+ *
+ * @param text XKB_KEYMAP_FORMAT_TEXT_V1 keymap, as sent by wl_keyboard.keymap.
+ * @param length Length of text without the terminating NUL.
+ * @return A new reference the caller releases with xkb_keymap_unref(), nullptr if text does not compile.
+ */
+struct xkb_keymap *KeymapCache::get(const char *text, size_t length) {
+    if (auto keymap = find(text, length)) {
+        return keymap;
+    }
+
+    std::lock_guard<std::mutex> compile_lock(context_mutex_);
+    // another thread may have compiled the same text while this one waited
+    if (auto keymap = find(text, length)) {
+        return keymap;
+    }
+    const std::string owned(text, length);
+    struct xkb_keymap *keymap = xkb_keymap_new_from_string(xkb_context_, owned.c_str(), XKB_KEYMAP_FORMAT_TEXT_V1,
+                                                           XKB_KEYMAP_COMPILE_NO_FLAGS);
+    if (!keymap) {
+        LOG_ERROR("KeymapCache: failed to compile keymap");
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(entries_mutex_);
+    if (entries_.size() == kMaxEntries) {
+        xkb_keymap_unref(entries_.front().keymap);
+        entries_.erase(entries_.begin());
+    }
+    entries_.push_back({std::hash<std::string_view>{}(owned), owned, keymap});
+    return xkb_keymap_ref(keymap);
+}
+
+/**
+ * @brief Drops the cached keymaps; keyboards keep the references they hold.
+ */
+void KeymapCache::clear() {
+    std::lock_guard<std::mutex> lock(entries_mutex_);
+    for (const auto &entry: entries_) {
+        xkb_keymap_unref(entry.keymap);
+    }
+    entries_.clear();
+}
+
+uint64_t KeymapCache::get_memory_usage() {
+    std::lock_guard<std::mutex> lock(entries_mutex_);
+    uint64_t bytes = 0;
+    for (const auto &entry: entries_) {
+        bytes += entry.text.capacity();
+    }
+    return bytes;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_KEYMAP_CACHE_H_
+#define SRC_SEAT_KEYMAP_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <xkbcommon/xkbcommon.h>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT KeymapCache {
+public:
+    KeymapCache();
+
+    ~KeymapCache();
+
+    KeymapCache(const KeymapCache &) = delete;
+
+    KeymapCache &operator=(const KeymapCache &) = delete;
+
+    static KeymapCache &get_default();
+
+    [[nodiscard]] struct xkb_keymap *find(const char *text, size_t length);
+
+    [[nodiscard]] struct xkb_keymap *get(const char *text, size_t length);
+
+    void clear();
+
+    // bytes of the keymap text the entries are keyed by, the compiled keymaps come on top
+    [[nodiscard]] uint64_t get_memory_usage();
+
+private:
+    // a handful covers every layout a session switches between
+    static constexpr size_t kMaxEntries = 4;
+
+    struct Entry {
+        size_t hash;
+        std::string text;
+        struct xkb_keymap *keymap;
+    };
+
+    // xkb_context is not thread safe, compiles are serialized
+    std::mutex context_mutex_;
+    struct xkb_context *xkb_context_;
+    std::mutex entries_mutex_;
+    // most recently used last
+    std::vector<Entry> entries_;
+};
+
+#endif // SRC_SEAT_KEYMAP_CACHE_H_
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "keysym_table.h"
+
+#include "utils/logging.h"
+
+/**
+ * @class KeysymTable
+ * @brief Keysym and UTF-8 text of every key for the current keymap and modifier state.
+ *
+ * xkb_state key lookups walk the key type and level tables on each call. Keys
+ * are looked up here once per keymap and effective modifier/layout state, so a
+ * burst of keys, e.g. from a barcode scanner emulating a keyboard, costs a
+ * single array access per key.
+ */
+
+/**
+ * @brief Forgets every entry, called when a new keymap is installed.
+ */
+void KeysymTable::invalidate() {
+    if (++generation_ == 0) {
+        entries_.fill({});
+        generation_ = 1;
+    }
+    mods_ = 0;
+    layout_ = 0;
+}
+
+/**
+ * @brief Invalidates the entries if the effective modifiers or layout of state changed.
+ *
+ * Called after every wl_keyboard.modifiers, most of which leave the level of
+ * every key as it was.
+ */
+void KeysymTable::update(struct xkb_state *state) {
+    const xkb_mod_mask_t mods = xkb_state_serialize_mods(state, XKB_STATE_MODS_EFFECTIVE);
+    const xkb_layout_index_t layout = xkb_state_serialize_layout(state, XKB_STATE_LAYOUT_EFFECTIVE);
+    if (mods != mods_ || layout != layout_) {
+        invalidate();
+        mods_ = mods;
+        layout_ = layout;
+    }
+}
+
+/**
+ * @brief Returns the keysym and text of key in state.
+ *
+ * @param state The keymap state update() was last called with.
+ * @param key The XKB keycode, the evdev scancode plus 8.
+ * @return The entry, valid until the next lookup of a keycode past the table.
+ */
+const KeysymTable::Entry &KeysymTable::lookup(struct xkb_state *state, xkb_keycode_t key) {
+    if (key >= kSize) {
+        fill(overflow_, state, key);
+        return overflow_;
+    }
+    Entry &entry = entries_[key];
+    if (entry.generation != generation_) {
+        fill(entry, state, key);
+        entry.generation = generation_;
+    }
+    return entry;
+}
+
+void KeysymTable::fill(Entry &entry, struct xkb_state *state, xkb_keycode_t key) {
+    // Gets the single keysym obtained from pressing a particular key in a given
+    // keyboard state.
+    entry.keysym = xkb_state_key_get_one_sym(state, key);
+    if (entry.keysym == XKB_KEY_NoSymbol) {
+        const xkb_keysym_t *key_symbols;
+        const int res = xkb_state_key_get_syms(state, key, &key_symbols);
+        if (res > 0) {
+            // only use the first symbol until the use case for two is clarified
+            entry.keysym = key_symbols[0];
+            for (int i = 0; i < res; i++) {
+                LOG_TRACE("xkb keysym: 0x%x", key_symbols[i]);
+            }
+        }
+    }
+    xkb_state_key_get_utf8(state, key, entry.utf8, sizeof(entry.utf8));
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_KEYSYM_TABLE_H_
+#define SRC_SEAT_KEYSYM_TABLE_H_
+
+#include <array>
+#include <cstdint>
+
+#include <xkbcommon/xkbcommon.h>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT KeysymTable {
+public:
+    struct Entry {
+        uint32_t generation;
+        xkb_keysym_t keysym;
+        // NUL terminated, empty if the key produces no text
+        char utf8[16];
+    };
+
+    void invalidate();
+
+    void update(struct xkb_state *state);
+
+    [[nodiscard]] const Entry &lookup(struct xkb_state *state, xkb_keycode_t key);
+
+private:
+    // covers the evdev keycodes plus the XKB offset of 8
+    static constexpr size_t kSize = 256;
+
+    // entries with another generation are filled on their next lookup
+    uint32_t generation_{1};
+    xkb_mod_mask_t mods_{};
+    xkb_layout_index_t layout_{};
+    std::array<Entry, kSize> entries_{};
+    // result for keycodes past the table
+    Entry overflow_{};
+
+    static void fill(Entry &entry, struct xkb_state *state, xkb_keycode_t key);
+};
+
+#endif // SRC_SEAT_KEYSYM_TABLE_H_
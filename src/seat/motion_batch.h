@@ -0,0 +1,99 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_MOTION_BATCH_H_
+#define SRC_SEAT_MOTION_BATCH_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "input_event.h"
+
+/**
+ * @brief The motion samples of a run of InputEvents, as structure-of-arrays.
+ *
+ * A consumer smoothing or predicting a stroke walks one field at a time, e.g. all x
+ * then all y, so a batch of samples stays in a few cache lines per field instead of
+ * striding over whole events. Samples keep their order; the other events of the run
+ * are left to the caller.
+ *
+ * @code
+ * for (size_t i = 0; i < frame.motion->size(); i++) {
+ *     stroke.add(frame.motion->get_time_ns()[i], frame.motion->get_x()[i], frame.motion->get_y()[i]);
+ * }
+ * @endcode
+ */
+class MotionBatch {
+public:
+    static constexpr size_t kCapacity = InputRing::capacity();
+
+    [[nodiscard]] static bool is_motion(InputEvent::Type type) {
+        return type == InputEvent::POINTER_MOTION || type == InputEvent::POINTER_RELATIVE_MOTION ||
+               type == InputEvent::TOUCH_MOTION;
+    }
+
+    /**
+     * @return false if the event is no motion sample, or the batch is full.
+     */
+    bool append(const InputEvent &event) {
+        if (!is_motion(event.type) || size_ == kCapacity) {
+            return false;
+        }
+        time_ns_[size_] = event.time_ns;
+        x_[size_] = event.x;
+        y_[size_] = event.y;
+        code_[size_] = event.code;
+        type_[size_] = event.type;
+        device_[size_] = event.device;
+        size_++;
+        return true;
+    }
+
+    void clear() { size_ = 0; }
+
+    [[nodiscard]] size_t size() const { return size_; }
+
+    [[nodiscard]] bool empty() const { return size_ == 0; }
+
+    [[nodiscard]] const uint64_t *get_time_ns() const { return time_ns_.data(); }
+
+    // surface local wl_fixed_t coordinates, deltas for POINTER_RELATIVE_MOTION
+    [[nodiscard]] const wl_fixed_t *get_x() const { return x_.data(); }
+
+    [[nodiscard]] const wl_fixed_t *get_y() const { return y_.data(); }
+
+    // the touch point id of TOUCH_MOTION samples
+    [[nodiscard]] const int32_t *get_code() const { return code_.data(); }
+
+    [[nodiscard]] const InputEvent::Type *get_type() const { return type_.data(); }
+
+    [[nodiscard]] const uint8_t *get_device() const { return device_.data(); }
+
+private:
+    static constexpr size_t kCacheLine = 64;
+
+    size_t size_{};
+    alignas(kCacheLine) std::array<uint64_t, kCapacity> time_ns_{};
+    alignas(kCacheLine) std::array<wl_fixed_t, kCapacity> x_{};
+    alignas(kCacheLine) std::array<wl_fixed_t, kCapacity> y_{};
+    alignas(kCacheLine) std::array<int32_t, kCapacity> code_{};
+    alignas(kCacheLine) std::array<InputEvent::Type, kCapacity> type_{};
+    alignas(kCacheLine) std::array<uint8_t, kCapacity> device_{};
+};
+
+#endif // SRC_SEAT_MOTION_BATCH_H_
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "motion_predictor.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @class MotionPredictor
+ * @brief Extrapolates a pointer or touch position to a future time.
+ *
+ * Content that follows the position predicted for the frame's presentation time
+ * instead of the last reported one hides one to two frames of latency in drags
+ * and pans. The fit only uses the last kWindowNs of samples, so it tracks changes
+ * of direction quickly, and a stationary or lifted contact is not extrapolated.
+ */
+
+/**
+ * @brief Adds a reported position.
+ *
+ * @param time_ns The event time in nanoseconds, e.g. from InputTimestamps.
+ * @param x The surface local x coordinate.
+ * @param y The surface local y coordinate.
+ */
+void MotionPredictor::add(uint64_t time_ns, double x, double y) {
+    if (count_ && time_ns <= newest().time_ns) {
+        // several events with one millisecond timestamp: keep the latest position only
+        samples_[(next_ + kMaxSamples - 1) % kMaxSamples] = {newest().time_ns, x, y};
+        return;
+    }
+    samples_[next_] = {time_ns, x, y};
+    next_ = (next_ + 1) % kMaxSamples;
+    count_ = std::min(count_ + 1, kMaxSamples);
+}
+
+/**
+ * @brief Predicts the position at target_ns.
+ *
+ * @param target_ns The time to predict for, in the clock domain of the samples, e.g. the
+ *                  Window::FrameInput::target_present_ns of the frame being drawn.
+ * @param x Receives the predicted x coordinate.
+ * @param y Receives the predicted y coordinate.
+ * @return false if there are no samples; x and y are left unchanged.
+ */
+bool MotionPredictor::predict(uint64_t target_ns, double &x, double &y) const {
+    if (!count_) {
+        return false;
+    }
+    const Sample &last = newest();
+    x = last.x;
+    y = last.y;
+    if (target_ns <= last.time_ns || target_ns - last.time_ns > kWindowNs) {
+        // nothing to extrapolate, or the contact stopped moving a while ago
+        return true;
+    }
+
+    // times in seconds relative to the newest sample keep the sums well conditioned
+    std::array<double, kMaxSamples> t{};
+    std::array<const Sample *, kMaxSamples> s{};
+    size_t n = 0;
+    for (size_t i = 0; i < count_; i++) {
+        const Sample &sample = samples_[(next_ + kMaxSamples - 1 - i) % kMaxSamples];
+        if (last.time_ns - sample.time_ns > kWindowNs) {
+            break;
+        }
+        t[n] = -static_cast<double>(last.time_ns - sample.time_ns) / 1e9;
+        s[n] = &sample;
+        n++;
+    }
+    if (n < 2) {
+        return true;
+    }
+    const double horizon = static_cast<double>(std::min(target_ns - last.time_ns, kMaxHorizonNs)) / 1e9;
+
+    // normal equations of the least squares fit p(t) = a + b t + c t^2
+    double s0 = 0, s1 = 0, s2 = 0, s3 = 0, s4 = 0;
+    double sx = 0, stx = 0, st2x = 0, sy = 0, sty = 0, st2y = 0;
+    for (size_t i = 0; i < n; i++) {
+        const double ti = t[i];
+        const double t2 = ti * ti;
+        s0 += 1;
+        s1 += ti;
+        s2 += t2;
+        s3 += t2 * ti;
+        s4 += t2 * t2;
+        sx += s[i]->x;
+        stx += ti * s[i]->x;
+        st2x += t2 * s[i]->x;
+        sy += s[i]->y;
+        sty += ti * s[i]->y;
+        st2y += t2 * s[i]->y;
+    }
+
+    if (model_ == QUADRATIC && n >= 3) {
+        const double det = s0 * (s2 * s4 - s3 * s3) - s1 * (s1 * s4 - s3 * s2) + s2 * (s1 * s3 - s2 * s2);
+        if (std::fabs(det) > 1e-18) {
+            const auto solve = [&](double b0, double b1, double b2) {
+                const double a = (b0 * (s2 * s4 - s3 * s3) - s1 * (b1 * s4 - s3 * b2) + s2 * (b1 * s3 - s2 * b2)) / det;
+                const double b = (s0 * (b1 * s4 - s3 * b2) - b0 * (s1 * s4 - s3 * s2) + s2 * (s1 * b2 - b1 * s2)) / det;
+                const double c = (s0 * (s2 * b2 - b1 * s3) - s1 * (s1 * b2 - b1 * s2) + b0 * (s1 * s3 - s2 * s2)) / det;
+                return a + b * horizon + c * horizon * horizon;
+            };
+            x = solve(sx, stx, st2x);
+            y = solve(sy, sty, st2y);
+            return true;
+        }
+    }
+
+    const double denominator = s0 * s2 - s1 * s1;
+    if (std::fabs(denominator) < 1e-18) {
+        return true;
+    }
+    const double bx = (s0 * stx - s1 * sx) / denominator;
+    const double by = (s0 * sty - s1 * sy) / denominator;
+    x = (sx - bx * s1) / s0 + bx * horizon;
+    y = (sy - by * s1) / s0 + by * horizon;
+    return true;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_MOTION_PREDICTOR_H_
+#define SRC_SEAT_MOTION_PREDICTOR_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT MotionPredictor {
+public:
+    typedef enum {
+        // least squares line through the recent samples, robust against noise
+        LINEAR,
+        // least squares parabola, follows acceleration but overshoots more
+        QUADRATIC,
+    } Model;
+
+    MotionPredictor() = default;
+
+    explicit MotionPredictor(Model model) : model_(model) {}
+
+    void set_model(Model model) { model_ = model; }
+
+    void add(uint64_t time_ns, double x, double y);
+
+    void reset() { count_ = 0; }
+
+    bool predict(uint64_t target_ns, double &x, double &y) const;
+
+private:
+    static constexpr size_t kMaxSamples = 8;
+    // samples older than this, relative to the newest, are not fitted
+    static constexpr uint64_t kWindowNs = 80000000;
+    // never extrapolate further than this past the newest sample
+    static constexpr uint64_t kMaxHorizonNs = 50000000;
+
+    struct Sample {
+        uint64_t time_ns;
+        double x;
+        double y;
+    };
+
+    Model model_{LINEAR};
+    std::array<Sample, kMaxSamples> samples_{};
+    // index of the next sample to write
+    size_t next_{};
+    size_t count_{};
+
+    [[nodiscard]] const Sample &newest() const { return samples_[(next_ + kMaxSamples - 1) % kMaxSamples]; }
+};
+
+#endif // SRC_SEAT_MOTION_PREDICTOR_H_
@@ -17,11 +17,13 @@
 #include "pointer.h"
 #include "xdg-shell-client-protocol.h"
 
-#include <iostream>
-
 #include <linux/input-event-codes.h>
 #include <wayland-client.h>
 
+#include "utils/listener.h"
+#include "utils/logging.h"
+#include "utils/trace.h"
+
 /**
  * @brief Pointer class represents a Wayland pointer device.
  *
@@ -33,8 +35,8 @@ Pointer::Pointer(struct wl_pointer *pointer, struct wl_shm *shm, struct wl_compo
         enable_cursor_(enable_cursor) {
     wl_pointer_add_listener(pointer, &listener_, this);
     if (enable_cursor_) {
+        // the cursor is set, and its theme loaded, on the first enter
         cursor_ = std::make_unique<Cursor>(this, pointer_, shm_, compositor, enable_cursor_);
-        cursor_->enable(0, "basic");
     }
 }
 
@@ -53,8 +55,258 @@ Pointer::~Pointer() {
     if (cursor_)
         cursor_.reset();
 
-    wl_pointer_release(pointer_);
-    wl_pointer_destroy(pointer_);
+    release_constraint();
+    destroy_gestures();
+    if (zwp_relative_pointer_) {
+        zwp_relative_pointer_v1_destroy(zwp_relative_pointer_);
+    }
+
+    if (wl_pointer_get_version(pointer_) >= WL_POINTER_RELEASE_SINCE_VERSION) {
+        wl_pointer_release(pointer_);
+    } else {
+        wl_pointer_destroy(pointer_);
+    }
+}
+
+/**
+ * @brief Sizes the cursor for the scale of the output it is shown on.
+ *
+ * @param scale The integer output scale.
+ * @return false if the cursor is disabled.
+ */
+bool Pointer::set_cursor_scale(int scale) {
+    return cursor_ && cursor_->set_scale(scale);
+}
+
+/**
+ * @brief Loads cursor themes through cache, shared with the other pointers of the Display.
+ *
+ * @param cache The Display's cursor theme cache.
+ */
+void Pointer::set_cursor_theme_cache(CursorThemeCache *cache) {
+    if (cursor_) {
+        cursor_->set_theme_cache(cache);
+    }
+}
+
+/**
+ * @brief Sets the cursor by shape instead of theme buffers, see Cursor::set_shape_manager().
+ *
+ * @param manager The compositor's wp_cursor_shape_manager_v1.
+ */
+void Pointer::set_cursor_shape_manager(struct wp_cursor_shape_manager_v1 *manager) {
+    if (cursor_) {
+        cursor_->set_shape_manager(manager);
+    }
+}
+
+/**
+ * @brief Receives precise timestamps for the events of this pointer.
+ *
+ * @param manager The compositor's zwp_input_timestamps_manager_v1.
+ */
+void Pointer::enable_timestamps(struct zwp_input_timestamps_manager_v1 *manager) {
+    timestamps_.enable(zwp_input_timestamps_manager_v1_get_pointer_timestamps(manager, pointer_));
+}
+
+/**
+ * @brief Passes the time of the event being dispatched to the input callback.
+ *
+ * @return The CLOCK_MONOTONIC time of the event in nanoseconds.
+ */
+uint64_t Pointer::report_input(uint32_t time) {
+    const uint64_t time_ns = timestamps_.take(time);
+    if (input_callback_) {
+        input_callback_(time_ns);
+    }
+    return time_ns;
+}
+
+/**
+ * @brief Receives unaccelerated relative motion at the full device rate.
+ *
+ * Relative motion keeps arriving while the pointer is locked or at the edge of the
+ * screen, where the absolute position stops changing.
+ *
+ * @param manager The compositor's zwp_relative_pointer_manager_v1.
+ */
+void Pointer::enable_relative_motion(struct zwp_relative_pointer_manager_v1 *manager) {
+    if (zwp_relative_pointer_) {
+        zwp_relative_pointer_v1_destroy(zwp_relative_pointer_);
+    }
+    zwp_relative_pointer_ = zwp_relative_pointer_manager_v1_get_relative_pointer(manager, pointer_);
+    zwp_relative_pointer_v1_add_listener(zwp_relative_pointer_, &relative_pointer_listener_, this);
+}
+
+/**
+ * @brief Locks the pointer in place while it is over surface, e.g. for mouse look.
+ *
+ * The lock is applied once the pointer is over surface and the compositor agrees, see
+ * is_constraint_active(). Motion is then only reported as relative motion.
+ *
+ * @param surface The surface the pointer is locked to.
+ * @param persistent true to reapply the lock whenever the pointer enters surface again,
+ *                   false to release it once the lock ends.
+ * @return false without zwp_pointer_constraints_v1.
+ */
+bool Pointer::lock(struct wl_surface *surface, bool persistent) {
+    if (!zwp_pointer_constraints_) {
+        LOG_WARN("Pointer::lock: compositor has no zwp_pointer_constraints_v1");
+        return false;
+    }
+    release_constraint();
+    zwp_locked_pointer_ = zwp_pointer_constraints_v1_lock_pointer(
+            zwp_pointer_constraints_, surface, pointer_, nullptr,
+            persistent ? ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_PERSISTENT : ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_ONESHOT);
+    zwp_locked_pointer_v1_add_listener(zwp_locked_pointer_, &locked_pointer_listener_, this);
+    constraint_ = CONSTRAINT_LOCK;
+    return true;
+}
+
+/**
+ * @brief Keeps the pointer inside region of surface.
+ *
+ * @param surface The surface the pointer is confined to.
+ * @param region The area in surface local coordinates, nullptr for the whole input region.
+ * @param persistent true to reapply the confinement whenever the pointer enters surface again.
+ * @return false without zwp_pointer_constraints_v1.
+ */
+bool Pointer::confine(struct wl_surface *surface, struct wl_region *region, bool persistent) {
+    if (!zwp_pointer_constraints_) {
+        LOG_WARN("Pointer::confine: compositor has no zwp_pointer_constraints_v1");
+        return false;
+    }
+    release_constraint();
+    zwp_confined_pointer_ = zwp_pointer_constraints_v1_confine_pointer(
+            zwp_pointer_constraints_, surface, pointer_, region,
+            persistent ? ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_PERSISTENT : ZWP_POINTER_CONSTRAINTS_V1_LIFETIME_ONESHOT);
+    zwp_confined_pointer_v1_add_listener(zwp_confined_pointer_, &confined_pointer_listener_, this);
+    constraint_ = CONSTRAINT_CONFINE;
+    return true;
+}
+
+/**
+ * @brief Ends the lock or confinement, if any.
+ */
+void Pointer::release_constraint() {
+    if (zwp_locked_pointer_) {
+        zwp_locked_pointer_v1_destroy(zwp_locked_pointer_);
+        zwp_locked_pointer_ = nullptr;
+    }
+    if (zwp_confined_pointer_) {
+        zwp_confined_pointer_v1_destroy(zwp_confined_pointer_);
+        zwp_confined_pointer_ = nullptr;
+    }
+    constraint_ = CONSTRAINT_NONE;
+    constraint_active_ = false;
+}
+
+/**
+ * @brief Fits the recent timestamped motion of the pointer, for predict_position().
+ *
+ * @param enable true to record motion.
+ * @param model The fit extrapolated from.
+ */
+void Pointer::enable_prediction(bool enable, MotionPredictor::Model model) {
+    predict_ = enable;
+    predictor_.set_model(model);
+    predictor_.reset();
+}
+
+/**
+ * @brief Extrapolates where the pointer will be at target_ns.
+ *
+ * @param target_ns CLOCK_MONOTONIC nanoseconds, e.g. Window::FrameInput::target_present_ns.
+ * @param x Receives the surface local x coordinate.
+ * @param y Receives the surface local y coordinate.
+ * @return false if prediction is disabled or there was no motion over the current surface.
+ */
+bool Pointer::predict_position(uint64_t target_ns, double &x, double &y) const {
+    return predict_ && predictor_.predict(target_ns, x, y);
+}
+
+/**
+ * @brief Receives touchpad swipe, pinch and, from version 3, hold gestures.
+ *
+ * @param gestures The compositor's zwp_pointer_gestures_v1.
+ * @param version The bound version of gestures.
+ */
+void Pointer::enable_gestures(struct zwp_pointer_gestures_v1 *gestures, uint32_t version) {
+    destroy_gestures();
+    zwp_pointer_gesture_swipe_ = zwp_pointer_gestures_v1_get_swipe_gesture(gestures, pointer_);
+    zwp_pointer_gesture_swipe_v1_add_listener(zwp_pointer_gesture_swipe_, &swipe_listener_, this);
+    zwp_pointer_gesture_pinch_ = zwp_pointer_gestures_v1_get_pinch_gesture(gestures, pointer_);
+    zwp_pointer_gesture_pinch_v1_add_listener(zwp_pointer_gesture_pinch_, &pinch_listener_, this);
+    if (version >= ZWP_POINTER_GESTURES_V1_GET_HOLD_GESTURE_SINCE_VERSION) {
+        zwp_pointer_gesture_hold_ = zwp_pointer_gestures_v1_get_hold_gesture(gestures, pointer_);
+        zwp_pointer_gesture_hold_v1_add_listener(zwp_pointer_gesture_hold_, &hold_listener_, this);
+    }
+}
+
+void Pointer::destroy_gestures() {
+    if (zwp_pointer_gesture_swipe_) {
+        zwp_pointer_gesture_swipe_v1_destroy(zwp_pointer_gesture_swipe_);
+        zwp_pointer_gesture_swipe_ = nullptr;
+    }
+    if (zwp_pointer_gesture_pinch_) {
+        zwp_pointer_gesture_pinch_v1_destroy(zwp_pointer_gesture_pinch_);
+        zwp_pointer_gesture_pinch_ = nullptr;
+    }
+    if (zwp_pointer_gesture_hold_) {
+        zwp_pointer_gesture_hold_v1_destroy(zwp_pointer_gesture_hold_);
+        zwp_pointer_gesture_hold_ = nullptr;
+    }
+}
+
+/**
+ * @brief Holds frames that only contain motion until the next flush_frame() or non-motion frame.
+ *
+ * The held motion is merged into the next frame, so at most one motion is delivered per
+ * render frame when the application calls flush_frame() before drawing.
+ *
+ * @param coalesce true to hold motion-only frames.
+ */
+void Pointer::set_coalesce_motion(bool coalesce) {
+    coalesce_motion_ = coalesce;
+    if (!coalesce) {
+        flush_frame();
+    }
+}
+
+/**
+ * @brief Holds scroll frames until the next flush_frame() or a frame with other events.
+ *
+ * High resolution wheels send many small axis_value120 frames per detent; held frames
+ * are summed per axis, so scroll physics sees one delta per render frame. A frame with
+ * axis_stop is never held, so the end of a kinetic scroll arrives right away.
+ *
+ * @param coalesce true to hold scroll frames, together with motion if motion is coalesced.
+ */
+void Pointer::set_coalesce_scroll(bool coalesce) {
+    coalesce_scroll_ = coalesce;
+    if (!coalesce) {
+        flush_frame();
+    }
+}
+
+/**
+ * @brief Delivers a held motion or scroll frame and a merged gesture update, if there are any.
+ */
+void Pointer::flush_frame() {
+    if (!in_frame_ && event_.mask) {
+        deliver_frame();
+    }
+    gesture_sink_.flush();
+}
+
+/**
+ * @brief Passes the accumulated frame to the frame callback and starts a new one.
+ */
+void Pointer::deliver_frame() {
+    if (frame_callback_) {
+        frame_callback_(event_);
+    }
+    event_ = {};
 }
 
 /**
@@ -65,13 +317,32 @@ Pointer::~Pointer() {
  * such as enter, leave, motion, button, axis, frame, axis source, axis stop,
  * and axis discrete events.
  */
-void Pointer::handle_enter(void * /* data */,
+void Pointer::handle_enter(void *data,
                            struct wl_pointer * /* pointer */,
-                           uint32_t /* serial */,
-                           struct wl_surface * /* surface */,
-                           wl_fixed_t /* sx */,
-                           wl_fixed_t /* sy */) {
-    std::cerr << "Pointer::handle_enter" << std::endl;
+                           uint32_t serial,
+                           struct wl_surface *surface,
+                           wl_fixed_t sx,
+                           wl_fixed_t sy) {
+    TRACE_TRACK_SCOPE(static_cast<Pointer *>(data)->trace_track_, "Pointer::handle_enter");
+    LOG_DEBUG("Pointer::handle_enter");
+    const auto obj = static_cast<Pointer *>(data);
+    obj->in_frame_ = true;
+    obj->event_.mask |= PointerEvent::ENTER;
+    obj->event_.serial = serial;
+    obj->event_.surface = surface;
+    obj->event_.sx = sx;
+    obj->event_.sy = sy;
+    obj->focus_ = {surface, sx, sy};
+    obj->input_ring_ = obj->input_router_ ? obj->input_router_->find(surface, InputRouter::SOURCE_POINTER) : nullptr;
+    obj->push_event({.x = sx, .y = sy, .type = InputEvent::POINTER_ENTER});
+    // positions on another surface are not comparable
+    obj->predictor_.reset();
+    // wl_pointer.set_cursor is only honoured with the serial of the latest enter
+    obj->serial_ = serial;
+    if (obj->cursor_) {
+        const auto kind = obj->cursor_->get_kind();
+        obj->cursor_->enable(0, kind.c_str());
+    }
 }
 
 /**
@@ -85,11 +356,23 @@ void Pointer::handle_enter(void * /* data */,
  * @param serial The serial number of the event.
  * @param surface The surface that the pointer left.
  */
-void Pointer::handle_leave(void * /* data */,
+void Pointer::handle_leave(void *data,
                            struct wl_pointer * /* pointer */,
-                           uint32_t /* serial */,
-                           struct wl_surface * /* surface */) {
-    std::cerr << "Pointer::handle_leave" << std::endl;
+                           uint32_t serial,
+                           struct wl_surface *surface) {
+    TRACE_TRACK_SCOPE(static_cast<Pointer *>(data)->trace_track_, "Pointer::handle_leave");
+    LOG_DEBUG("Pointer::handle_leave");
+    const auto obj = static_cast<Pointer *>(data);
+    obj->in_frame_ = true;
+    obj->event_.mask |= PointerEvent::LEAVE;
+    obj->event_.serial = serial;
+    obj->event_.surface = surface;
+    obj->focus_ = {};
+    // the closing frame still goes to the window that was left
+    obj->push_event({.type = InputEvent::POINTER_LEAVE});
+    if (obj->cursor_) {
+        obj->cursor_->stop_animation();
+    }
 }
 
 /**
@@ -104,54 +387,27 @@ void Pointer::handle_leave(void * /* data */,
  * @param sx The X coordinate of the pointer's absolute position.
  * @param sy The Y coordinate of the pointer's absolute position.
  */
-void Pointer::handle_motion(void * /* data */,
+void Pointer::handle_motion(void *data,
                             struct wl_pointer * /* pointer */,
-                            uint32_t /* time */,
-                            wl_fixed_t /* sx */,
-                            wl_fixed_t /* sy */) {
-    std::cerr << "Pointer::handle_motion" << std::endl;
-}
-
-/**
- * @brief Determines the resize edge of a component based on the given parameters.
- *
- * @param width The width of the component.
- * @param height The height of the component.
- * @param pointer_x The x-coordinate of the pointer.
- * @param pointer_y The y-coordinate of the pointer.
- * @param margin The margin around the component.
- *
- * @return The resize edge of the component.
- */
-enum xdg_toplevel_resize_edge component_edge(const int width, const int height,
-                                             const int pointer_x,
-                                             const int pointer_y,
-                                             const int margin) {
-    const bool top = pointer_y < margin;
-    const bool bottom = pointer_y > (height - margin);
-    const bool left = pointer_x < margin;
-    const bool right = pointer_x > (width - margin);
-
-    if (top)
-        if (left)
-            return XDG_TOPLEVEL_RESIZE_EDGE_TOP_LEFT;
-        else if (right)
-            return XDG_TOPLEVEL_RESIZE_EDGE_TOP_RIGHT;
-        else
-            return XDG_TOPLEVEL_RESIZE_EDGE_TOP;
-    else if (bottom)
-        if (left)
-            return XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM_LEFT;
-        else if (right)
-            return XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM_RIGHT;
-        else
-            return XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM;
-    else if (left)
-        return XDG_TOPLEVEL_RESIZE_EDGE_LEFT;
-    else if (right)
-        return XDG_TOPLEVEL_RESIZE_EDGE_RIGHT;
-    else
-        return XDG_TOPLEVEL_RESIZE_EDGE_NONE;
+                            uint32_t time,
+                            wl_fixed_t sx,
+                            wl_fixed_t sy) {
+    TRACE_TRACK_SCOPE(static_cast<Pointer *>(data)->trace_track_, "Pointer::handle_motion");
+    LOG_TRACE("Pointer::handle_motion");
+    const auto obj = static_cast<Pointer *>(data);
+    const uint64_t time_ns = obj->report_input(time);
+    obj->push_event({.time_ns = time_ns, .x = sx, .y = sy, .type = InputEvent::POINTER_MOTION});
+    obj->focus_.sx = sx;
+    obj->focus_.sy = sy;
+    if (obj->predict_) {
+        obj->predictor_.add(time_ns, wl_fixed_to_double(sx), wl_fixed_to_double(sy));
+    }
+    obj->in_frame_ = true;
+    obj->event_.mask |= PointerEvent::MOTION;
+    obj->event_.time = time;
+    obj->event_.time_ns = time_ns;
+    obj->event_.sx = sx;
+    obj->event_.sy = sy;
 }
 
 /**
@@ -163,16 +419,31 @@ enum xdg_toplevel_resize_edge component_edge(const int width, const int height,
  * @param button The button that triggered the event
  * @param state The state of the button (pressed or released)
  */
-void Pointer::handle_button(void * /* data */,
+void Pointer::handle_button(void *data,
                             struct wl_pointer * /* wl_pointer */,
-                            uint32_t /* serial */,
-                            uint32_t /* time */,
+                            uint32_t serial,
+                            uint32_t time,
                             uint32_t button,
                             uint32_t state) {
-    std::cerr << "Pointer::handle_button" << std::endl;
-    if (button == BTN_LEFT) {
-        if (state == WL_POINTER_BUTTON_STATE_PRESSED) {
-        }
+    TRACE_TRACK_SCOPE(static_cast<Pointer *>(data)->trace_track_, "Pointer::handle_button");
+    LOG_DEBUG("Pointer::handle_button");
+    const auto obj = static_cast<Pointer *>(data);
+    const uint64_t time_ns = obj->report_input(time);
+    obj->push_event({.time_ns = time_ns, .code = static_cast<int32_t>(button), .value = state,
+                     .type = InputEvent::POINTER_BUTTON});
+    obj->in_frame_ = true;
+    obj->event_.mask |= PointerEvent::BUTTON;
+    obj->event_.time = time;
+    obj->event_.time_ns = time_ns;
+    obj->event_.serial = serial;
+    obj->event_.button = button;
+    obj->event_.state = state;
+    // right away, a move or resize has to start while the button is still held
+    if (obj->button_callback_) {
+        obj->button_callback_({.surface = obj->focus_.surface, .serial = serial, .time = time,
+                               .time_ns = time_ns, .button = button,
+                               .state = state, .x = wl_fixed_to_double(obj->focus_.sx),
+                               .y = wl_fixed_to_double(obj->focus_.sy)});
     }
 }
 
@@ -189,12 +460,26 @@ void Pointer::handle_button(void * /* data */,
  *
  * @details Prints "Pointer::handle_axis" to the standard error output.
  */
-void Pointer::handle_axis(void * /* data */,
+void Pointer::handle_axis(void *data,
                           struct wl_pointer * /* wl_pointer */,
-                          uint32_t /* time */,
-                          uint32_t /* axis */,
-                          wl_fixed_t /* value */) {
-    std::cerr << "Pointer::handle_axis" << std::endl;
+                          uint32_t time,
+                          uint32_t axis,
+                          wl_fixed_t value) {
+    TRACE_TRACK_SCOPE(static_cast<Pointer *>(data)->trace_track_, "Pointer::handle_axis");
+    LOG_TRACE("Pointer::handle_axis");
+    const auto obj = static_cast<Pointer *>(data);
+    const uint64_t time_ns = obj->report_input(time);
+    obj->push_event({.time_ns = time_ns, .x = value, .code = static_cast<int32_t>(axis),
+                     .type = InputEvent::POINTER_AXIS});
+    obj->in_frame_ = true;
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL) {
+        return;
+    }
+    obj->event_.mask |= PointerEvent::AXIS;
+    obj->event_.time = time;
+    obj->event_.time_ns = time_ns;
+    obj->event_.axes[axis].valid = true;
+    obj->event_.axes[axis].value += value;
 }
 
 /**
@@ -205,9 +490,23 @@ void Pointer::handle_axis(void * /* data */,
  * @param data The user data associated with the pointer.
  * @param wl_pointer The pointer object.
  */
-void Pointer::handle_frame(void * /* data */,
+void Pointer::handle_frame(void *data,
                            struct wl_pointer * /* wl_pointer */) {
-    std::cerr << "Pointer::handle_frame" << std::endl;
+    TRACE_TRACK_SCOPE(static_cast<Pointer *>(data)->trace_track_, "Pointer::handle_frame");
+    LOG_TRACE("Pointer::handle_frame");
+    const auto obj = static_cast<Pointer *>(data);
+    obj->in_frame_ = false;
+    obj->push_event({.type = InputEvent::POINTER_FRAME});
+    if (obj->event_.mask & PointerEvent::LEAVE) {
+        obj->input_ring_ = nullptr;
+    }
+    const uint32_t holdable = (obj->coalesce_motion_ ? static_cast<uint32_t>(PointerEvent::MOTION) : 0U) |
+                              (obj->coalesce_scroll_ ? PointerEvent::kScrollMask : 0U);
+    if (obj->event_.mask && !(obj->event_.mask & ~holdable)) {
+        // keep accumulating; the next frame or flush_frame() delivers it
+        return;
+    }
+    obj->deliver_frame();
 }
 
 /**
@@ -220,10 +519,15 @@ void Pointer::handle_frame(void * /* data */,
  * This function is called when the axis source event is received for the Pointer object.
  * It prints a message to the standard error stream.
  */
-void Pointer::handle_axis_source(void * /* data */,
+void Pointer::handle_axis_source(void *data,
                                  struct wl_pointer * /* wl_pointer */,
-                                 uint32_t /* axis_source */) {
-    std::cerr << "Pointer::handle_axis_source" << std::endl;
+                                 uint32_t axis_source) {
+    TRACE_TRACK_SCOPE(static_cast<Pointer *>(data)->trace_track_, "Pointer::handle_axis_source");
+    LOG_TRACE("Pointer::handle_axis_source");
+    const auto obj = static_cast<Pointer *>(data);
+    obj->in_frame_ = true;
+    obj->event_.mask |= PointerEvent::AXIS_SOURCE;
+    obj->event_.axis_source = axis_source;
 }
 
 /**
@@ -236,11 +540,22 @@ void Pointer::handle_axis_source(void * /* data */,
  * @param time      The timestamp of the event.
  * @param axis      The axis that stopped.
  */
-void Pointer::handle_axis_stop(void * /* data */,
+void Pointer::handle_axis_stop(void *data,
                                struct wl_pointer * /* wl_pointer */,
-                               uint32_t /* time */,
-                               uint32_t /* axis */) {
-    std::cerr << "Pointer::handle_axis_stop" << std::endl;
+                               uint32_t time,
+                               uint32_t axis) {
+    TRACE_TRACK_SCOPE(static_cast<Pointer *>(data)->trace_track_, "Pointer::handle_axis_stop");
+    LOG_TRACE("Pointer::handle_axis_stop");
+    const auto obj = static_cast<Pointer *>(data);
+    obj->in_frame_ = true;
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL) {
+        return;
+    }
+    obj->event_.mask |= PointerEvent::AXIS_STOP;
+    obj->event_.time = time;
+    obj->event_.time_ns = obj->timestamps_.take(time);
+    obj->event_.axes[axis].valid = true;
+    obj->event_.axes[axis].stopped = true;
 }
 
 /**
@@ -253,13 +568,242 @@ void Pointer::handle_axis_stop(void * /* data */,
  * @param axis The axis value.
  * @param discrete The discrete value.
  */
-void Pointer::handle_axis_discrete(void * /* data */,
+void Pointer::handle_axis_discrete(void *data,
+                                   struct wl_pointer * /* wl_pointer */,
+                                   uint32_t axis,
+                                   int32_t discrete) {
+    TRACE_TRACK_SCOPE(static_cast<Pointer *>(data)->trace_track_, "Pointer::handle_axis_discrete");
+    LOG_TRACE("Pointer::handle_axis_discrete");
+    const auto obj = static_cast<Pointer *>(data);
+    obj->in_frame_ = true;
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL) {
+        return;
+    }
+    obj->event_.mask |= PointerEvent::AXIS_DISCRETE;
+    obj->event_.axes[axis].valid = true;
+    obj->event_.axes[axis].discrete += discrete;
+    // seats before v8 send no axis_value120, one detent is 120
+    obj->event_.axes[axis].value120 += discrete * 120;
+}
+
+/**
+ * @brief Handles high resolution wheel scrolling, wl_seat v8 and later.
+ *
+ * Replaces axis_discrete: a fraction or multiple of 120 per event, where 120 is one detent.
+ *
+ * @param data The user data associated with the Pointer.
+ * @param wl_pointer The pointer object.
+ * @param axis The axis.
+ * @param value120 The scroll distance in 1/120 detents.
+ */
+void Pointer::handle_axis_value120(void *data,
                                    struct wl_pointer * /* wl_pointer */,
-                                   uint32_t /* axis */,
-                                   int32_t /* discrete */) {
-    std::cerr << "Pointer::handle_axis_discrete" << std::endl;
+                                   uint32_t axis,
+                                   int32_t value120) {
+    TRACE_TRACK_SCOPE(static_cast<Pointer *>(data)->trace_track_, "Pointer::handle_axis_value120");
+    LOG_TRACE("Pointer::handle_axis_value120");
+    const auto obj = static_cast<Pointer *>(data);
+    obj->in_frame_ = true;
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL) {
+        return;
+    }
+    obj->event_.mask |= PointerEvent::AXIS_VALUE120;
+    obj->event_.axes[axis].valid = true;
+    obj->event_.axes[axis].value120 += value120;
 }
 
+/**
+ * @brief Handles the physical direction of a scroll, wl_seat v9 and later.
+ *
+ * @param data The user data associated with the Pointer.
+ * @param wl_pointer The pointer object.
+ * @param axis The axis.
+ * @param direction WL_POINTER_AXIS_RELATIVE_DIRECTION_INVERTED if the axis values are inverted, e.g. natural scrolling.
+ */
+void Pointer::handle_axis_relative_direction(void *data,
+                                             struct wl_pointer * /* wl_pointer */,
+                                             uint32_t axis,
+                                             uint32_t direction) {
+    TRACE_TRACK_SCOPE(static_cast<Pointer *>(data)->trace_track_, "Pointer::handle_axis_relative_direction");
+    LOG_TRACE("Pointer::handle_axis_relative_direction");
+    const auto obj = static_cast<Pointer *>(data);
+    obj->in_frame_ = true;
+    if (axis > WL_POINTER_AXIS_HORIZONTAL_SCROLL) {
+        return;
+    }
+    obj->event_.mask |= PointerEvent::AXIS_RELATIVE_DIRECTION;
+    obj->event_.axes[axis].relative_direction = direction;
+}
+
+/**
+ * @brief Handles relative motion, passing it to the relative motion callback and the input ring.
+ */
+void Pointer::handle_relative_motion(struct zwp_relative_pointer_v1 * /* relative_pointer */,
+                                     uint32_t utime_hi,
+                                     uint32_t utime_lo,
+                                     wl_fixed_t dx,
+                                     wl_fixed_t dy,
+                                     wl_fixed_t dx_unaccel,
+                                     wl_fixed_t dy_unaccel) {
+    TRACE_TRACK_SCOPE(trace_track_, "Pointer::handle_relative_motion");
+    const uint64_t time_us = (static_cast<uint64_t>(utime_hi) << 32) | utime_lo;
+    push_event({.time_ns = time_us * 1000, .x = dx_unaccel, .y = dy_unaccel,
+                .type = InputEvent::POINTER_RELATIVE_MOTION});
+    if (relative_motion_callback_) {
+        relative_motion_callback_({
+                .time_us = time_us,
+                .dx = wl_fixed_to_double(dx),
+                .dy = wl_fixed_to_double(dy),
+                .dx_unaccel = wl_fixed_to_double(dx_unaccel),
+                .dy_unaccel = wl_fixed_to_double(dy_unaccel),
+        });
+    }
+}
+
+void Pointer::handle_swipe_begin(struct zwp_pointer_gesture_swipe_v1 * /* swipe */,
+                                 uint32_t /* serial */,
+                                 uint32_t time,
+                                 struct wl_surface * /* surface */,
+                                 uint32_t fingers) {
+    gesture_fingers_ = fingers;
+    gesture_sink_.emit({.type = Gesture::SWIPE, .phase = Gesture::BEGIN, .fingers = fingers,
+                        .time_ns = InputTimestamps::from_ms(time), .scale = 1.0});
+}
+
+void Pointer::handle_swipe_update(struct zwp_pointer_gesture_swipe_v1 * /* swipe */,
+                                  uint32_t time,
+                                  wl_fixed_t dx,
+                                  wl_fixed_t dy) {
+    gesture_sink_.emit({.type = Gesture::SWIPE, .phase = Gesture::UPDATE, .fingers = gesture_fingers_,
+                        .time_ns = InputTimestamps::from_ms(time), .dx = wl_fixed_to_double(dx),
+                        .dy = wl_fixed_to_double(dy), .scale = 1.0});
+}
+
+void Pointer::handle_swipe_end(struct zwp_pointer_gesture_swipe_v1 * /* swipe */,
+                               uint32_t /* serial */,
+                               uint32_t time,
+                               int32_t cancelled) {
+    gesture_sink_.emit({.type = Gesture::SWIPE, .phase = cancelled ? Gesture::CANCEL : Gesture::END,
+                        .fingers = gesture_fingers_, .time_ns = InputTimestamps::from_ms(time), .scale = 1.0});
+}
+
+void Pointer::handle_pinch_begin(struct zwp_pointer_gesture_pinch_v1 * /* pinch */,
+                                 uint32_t /* serial */,
+                                 uint32_t time,
+                                 struct wl_surface * /* surface */,
+                                 uint32_t fingers) {
+    gesture_fingers_ = fingers;
+    gesture_sink_.emit({.type = Gesture::PINCH, .phase = Gesture::BEGIN, .fingers = fingers,
+                        .time_ns = InputTimestamps::from_ms(time), .scale = 1.0});
+}
+
+/**
+ * @brief Handles a pinch step; scale is relative to the begin and rotation to the previous step.
+ */
+void Pointer::handle_pinch_update(struct zwp_pointer_gesture_pinch_v1 * /* pinch */,
+                                  uint32_t time,
+                                  wl_fixed_t dx,
+                                  wl_fixed_t dy,
+                                  wl_fixed_t scale,
+                                  wl_fixed_t rotation) {
+    gesture_sink_.emit({.type = Gesture::PINCH, .phase = Gesture::UPDATE, .fingers = gesture_fingers_,
+                        .time_ns = InputTimestamps::from_ms(time), .dx = wl_fixed_to_double(dx),
+                        .dy = wl_fixed_to_double(dy), .scale = wl_fixed_to_double(scale),
+                        .rotation = wl_fixed_to_double(rotation)});
+}
+
+void Pointer::handle_pinch_end(struct zwp_pointer_gesture_pinch_v1 * /* pinch */,
+                               uint32_t /* serial */,
+                               uint32_t time,
+                               int32_t cancelled) {
+    gesture_sink_.emit({.type = Gesture::PINCH, .phase = cancelled ? Gesture::CANCEL : Gesture::END,
+                        .fingers = gesture_fingers_, .time_ns = InputTimestamps::from_ms(time), .scale = 1.0});
+}
+
+void Pointer::handle_hold_begin(struct zwp_pointer_gesture_hold_v1 * /* hold */,
+                                uint32_t /* serial */,
+                                uint32_t time,
+                                struct wl_surface * /* surface */,
+                                uint32_t fingers) {
+    gesture_fingers_ = fingers;
+    gesture_sink_.emit({.type = Gesture::HOLD, .phase = Gesture::BEGIN, .fingers = fingers,
+                        .time_ns = InputTimestamps::from_ms(time), .scale = 1.0});
+}
+
+/**
+ * @brief Handles the end of a hold; cancelled if the fingers started moving, e.g. into a swipe.
+ */
+void Pointer::handle_hold_end(struct zwp_pointer_gesture_hold_v1 * /* hold */,
+                              uint32_t /* serial */,
+                              uint32_t time,
+                              int32_t cancelled) {
+    gesture_sink_.emit({.type = Gesture::HOLD, .phase = cancelled ? Gesture::CANCEL : Gesture::END,
+                        .fingers = gesture_fingers_, .time_ns = InputTimestamps::from_ms(time), .scale = 1.0});
+}
+
+/**
+ * @brief The lock took effect.
+ */
+void Pointer::handle_locked(struct zwp_locked_pointer_v1 * /* locked_pointer */) {
+    LOG_DEBUG("Pointer::handle_locked");
+    constraint_active_ = true;
+}
+
+/**
+ * @brief The lock ended; a oneshot lock is not applied again.
+ */
+void Pointer::handle_unlocked(struct zwp_locked_pointer_v1 * /* locked_pointer */) {
+    LOG_DEBUG("Pointer::handle_unlocked");
+    constraint_active_ = false;
+}
+
+/**
+ * @brief The confinement took effect.
+ */
+void Pointer::handle_confined(struct zwp_confined_pointer_v1 * /* confined_pointer */) {
+    LOG_DEBUG("Pointer::handle_confined");
+    constraint_active_ = true;
+}
+
+/**
+ * @brief The confinement ended; a oneshot confinement is not applied again.
+ */
+void Pointer::handle_unconfined(struct zwp_confined_pointer_v1 * /* confined_pointer */) {
+    LOG_DEBUG("Pointer::handle_unconfined");
+    constraint_active_ = false;
+}
+
+const struct zwp_relative_pointer_v1_listener Pointer::relative_pointer_listener_ = {
+        .relative_motion = listener_thunk<&Pointer::handle_relative_motion>,
+};
+
+const struct zwp_pointer_gesture_swipe_v1_listener Pointer::swipe_listener_ = {
+        .begin = listener_thunk<&Pointer::handle_swipe_begin>,
+        .update = listener_thunk<&Pointer::handle_swipe_update>,
+        .end = listener_thunk<&Pointer::handle_swipe_end>,
+};
+
+const struct zwp_pointer_gesture_pinch_v1_listener Pointer::pinch_listener_ = {
+        .begin = listener_thunk<&Pointer::handle_pinch_begin>,
+        .update = listener_thunk<&Pointer::handle_pinch_update>,
+        .end = listener_thunk<&Pointer::handle_pinch_end>,
+};
+
+const struct zwp_pointer_gesture_hold_v1_listener Pointer::hold_listener_ = {
+        .begin = listener_thunk<&Pointer::handle_hold_begin>,
+        .end = listener_thunk<&Pointer::handle_hold_end>,
+};
+
+const struct zwp_locked_pointer_v1_listener Pointer::locked_pointer_listener_ = {
+        .locked = listener_thunk<&Pointer::handle_locked>,
+        .unlocked = listener_thunk<&Pointer::handle_unlocked>,
+};
+
+const struct zwp_confined_pointer_v1_listener Pointer::confined_pointer_listener_ = {
+        .confined = listener_thunk<&Pointer::handle_confined>,
+        .unconfined = listener_thunk<&Pointer::handle_unconfined>,
+};
+
 const struct wl_pointer_listener Pointer::listener_ = {
         .enter = handle_enter,
         .leave = handle_leave,
@@ -270,4 +814,6 @@ const struct wl_pointer_listener Pointer::listener_ = {
         .axis_source = handle_axis_source,
         .axis_stop = handle_axis_stop,
         .axis_discrete = handle_axis_discrete,
+        .axis_value120 = handle_axis_value120,
+        .axis_relative_direction = handle_axis_relative_direction,
 };
@@ -17,19 +17,187 @@
 #ifndef SRC_SEAT_POINTER_H_
 #define SRC_SEAT_POINTER_H_
 
+#include <functional>
+#include <memory>
+#include <string>
+
 #include <wayland-client.h>
 
+#include "pointer-constraints-unstable-v1-client-protocol.h"
+#include "pointer-gestures-unstable-v1-client-protocol.h"
+#include "relative-pointer-unstable-v1-client-protocol.h"
+
 #include "cursor.h"
+#include "cursor_theme_cache.h"
+#include "gesture.h"
+#include "input_event.h"
+#include "input_timestamps.h"
+#include "motion_predictor.h"
+#include "utils/export.h"
 
 class Cursor;
 
-class Pointer {
+/**
+ * @brief Everything a wl_pointer reported between two wl_pointer.frame events.
+ */
+struct PointerEvent {
+    typedef enum {
+        ENTER = 1 << 0,
+        LEAVE = 1 << 1,
+        MOTION = 1 << 2,
+        BUTTON = 1 << 3,
+        AXIS = 1 << 4,
+        AXIS_SOURCE = 1 << 5,
+        AXIS_STOP = 1 << 6,
+        AXIS_DISCRETE = 1 << 7,
+        AXIS_VALUE120 = 1 << 8,
+        AXIS_RELATIVE_DIRECTION = 1 << 9,
+    } Mask;
+
+    // the bits a held scroll frame may contain
+    static constexpr uint32_t kScrollMask = AXIS | AXIS_SOURCE | AXIS_DISCRETE | AXIS_VALUE120 |
+                                            AXIS_RELATIVE_DIRECTION;
+
+    // the Mask bits of the fields below that were set in this frame
+    uint32_t mask{};
+    // time of the latest timestamped event, in milliseconds
+    uint32_t time{};
+    // the same in CLOCK_MONOTONIC nanoseconds, precise with zwp_input_timestamps_manager_v1
+    uint64_t time_ns{};
+    // serial of the latest enter, leave or button
+    uint32_t serial{};
+    struct wl_surface *surface{};
+    wl_fixed_t sx{};
+    wl_fixed_t sy{};
+    uint32_t button{};
+    uint32_t state{};
+    uint32_t axis_source{};
+
+    // indexed by wl_pointer_axis; values are summed over the frame, and over held frames
+    struct {
+        bool valid;
+        bool stopped;
+        wl_fixed_t value;
+        int32_t discrete;
+        // 120 per wheel detent, from axis_value120 or axis_discrete on older seats
+        int32_t value120;
+        // wl_pointer_axis_relative_direction, inverted for natural scrolling
+        uint32_t relative_direction;
+    } axes[2]{};
+};
+
+// a wl_pointer.button, with where the pointer was
+struct PointerButton {
+    // the surface the pointer is over, nullptr if it left
+    struct wl_surface *surface;
+    // for requests the press authorizes, like xdg_toplevel.move
+    uint32_t serial;
+    uint32_t time;
+    // CLOCK_MONOTONIC nanoseconds
+    uint64_t time_ns;
+    uint32_t button;
+    // wl_pointer_button_state
+    uint32_t state;
+    // surface coordinates
+    double x;
+    double y;
+};
+
+// one zwp_relative_pointer_v1.relative_motion
+struct RelativeMotion {
+    // microseconds, in the compositor's clock domain
+    uint64_t time_us;
+    // accelerated, as the cursor would move
+    double dx;
+    double dy;
+    // raw device deltas, for camera and game controls
+    double dx_unaccel;
+    double dy_unaccel;
+};
+
+class WAYPP_EXPORT Pointer {
 public:
+    typedef enum {
+        CONSTRAINT_NONE,
+        CONSTRAINT_LOCK,
+        CONSTRAINT_CONFINE,
+    } ConstraintType;
+
     explicit Pointer(struct wl_pointer *pointer_, struct wl_shm *shm, struct wl_compositor *compositor,
                      bool enable_cursor = true);
 
     ~Pointer();
 
+    bool set_cursor_scale(int scale);
+
+    [[nodiscard]] Cursor *get_cursor() const { return cursor_.get(); }
+
+    void set_cursor_theme_cache(CursorThemeCache *cache);
+
+    void set_cursor_shape_manager(struct wp_cursor_shape_manager_v1 *manager);
+
+    void set_trace_track(const std::string &track) { trace_track_ = track; }
+
+    void enable_timestamps(struct zwp_input_timestamps_manager_v1 *manager);
+
+    void set_input_callback(const std::function<void(uint64_t time_ns)> &callback) { input_callback_ = callback; }
+
+    void set_frame_callback(const std::function<void(const PointerEvent &event)> &callback) {
+        frame_callback_ = callback;
+    }
+
+    // every button as it arrives, ahead of the frame callback
+    void set_button_callback(const std::function<void(const PointerButton &button)> &callback) {
+        button_callback_ = callback;
+    }
+
+    void set_coalesce_motion(bool coalesce);
+
+    void set_coalesce_scroll(bool coalesce);
+
+    // device stamps every event pushed, see InputEvent::device
+    void set_input_router(const InputRouter *router, uint8_t device = 0) {
+        input_router_ = router;
+        device_index_ = device;
+    }
+
+    void enable_relative_motion(struct zwp_relative_pointer_manager_v1 *manager);
+
+    void set_relative_motion_callback(const std::function<void(const RelativeMotion &motion)> &callback) {
+        relative_motion_callback_ = callback;
+    }
+
+    void set_pointer_constraints(struct zwp_pointer_constraints_v1 *constraints) {
+        zwp_pointer_constraints_ = constraints;
+    }
+
+    bool lock(struct wl_surface *surface, bool persistent = false);
+
+    bool confine(struct wl_surface *surface, struct wl_region *region = nullptr, bool persistent = false);
+
+    void release_constraint();
+
+    void enable_prediction(bool enable, MotionPredictor::Model model = MotionPredictor::LINEAR);
+
+    void enable_gestures(struct zwp_pointer_gestures_v1 *gestures, uint32_t version);
+
+    void set_gesture_callback(const std::function<void(const Gesture &gesture)> &callback) {
+        gesture_sink_.set_callback(callback);
+    }
+
+    void set_coalesce_gestures(bool coalesce) { gesture_sink_.set_coalesce(coalesce); }
+
+    bool predict_position(uint64_t target_ns, double &x, double &y) const;
+
+    [[nodiscard]] ConstraintType get_constraint() const { return constraint_; }
+
+    /**
+     * @brief true while the compositor applies the lock or confinement.
+     */
+    [[nodiscard]] bool is_constraint_active() const { return constraint_active_; }
+
+    void flush_frame();
+
     friend class Cursor;
 
 private:
@@ -39,9 +207,60 @@ private:
     bool enable_cursor_{};
     std::unique_ptr<Cursor> cursor_;
     uint32_t serial_{};
+    std::string trace_track_;
+    InputTimestamps timestamps_;
+    std::function<void(uint64_t time_ns)> input_callback_;
+    std::function<void(const PointerEvent &event)> frame_callback_;
+    std::function<void(const PointerButton &button)> button_callback_;
+    // where the pointer is, kept across frames for button_callback_
+    struct {
+        struct wl_surface *surface;
+        wl_fixed_t sx;
+        wl_fixed_t sy;
+    } focus_{};
+    // accumulated until the next wl_pointer.frame
+    PointerEvent event_;
+    // set from the first event of a frame until its wl_pointer.frame
+    bool in_frame_{};
+    bool coalesce_motion_{};
+    bool coalesce_scroll_{};
+    const InputRouter *input_router_{};
+    uint8_t device_index_{};
+    // ring of the window under the pointer
+    InputRing *input_ring_{};
+
+    struct zwp_relative_pointer_v1 *zwp_relative_pointer_{};
+    std::function<void(const RelativeMotion &motion)> relative_motion_callback_;
+    struct zwp_pointer_constraints_v1 *zwp_pointer_constraints_{};
+    struct zwp_locked_pointer_v1 *zwp_locked_pointer_{};
+    struct zwp_confined_pointer_v1 *zwp_confined_pointer_{};
+    ConstraintType constraint_{CONSTRAINT_NONE};
+    bool constraint_active_{};
+
+    bool predict_{};
+    MotionPredictor predictor_;
+
+    struct zwp_pointer_gesture_swipe_v1 *zwp_pointer_gesture_swipe_{};
+    struct zwp_pointer_gesture_pinch_v1 *zwp_pointer_gesture_pinch_{};
+    struct zwp_pointer_gesture_hold_v1 *zwp_pointer_gesture_hold_{};
+    GestureSink gesture_sink_;
+    uint32_t gesture_fingers_{};
+
+    void destroy_gestures();
 
     [[nodiscard]] uint32_t get_serial() const { return serial_; }
 
+    uint64_t report_input(uint32_t time);
+
+    void push_event(InputEvent event) const {
+        if (input_ring_) {
+            event.device = device_index_;
+            (void) input_ring_->push(event);
+        }
+    }
+
+    void deliver_frame();
+
     static void handle_enter(void * /* data */,
                              struct wl_pointer * /* pointer */,
                              uint32_t /* serial */,
@@ -90,7 +309,90 @@ private:
                                      uint32_t /* axis */,
                                      int32_t /* discrete */);
 
+    static void handle_axis_value120(void * /* data */,
+                                     struct wl_pointer * /* wl_pointer */,
+                                     uint32_t /* axis */,
+                                     int32_t /* value120 */);
+
+    static void handle_axis_relative_direction(void * /* data */,
+                                               struct wl_pointer * /* wl_pointer */,
+                                               uint32_t /* axis */,
+                                               uint32_t /* direction */);
+
+    void handle_relative_motion(struct zwp_relative_pointer_v1 *relative_pointer,
+                                uint32_t utime_hi,
+                                uint32_t utime_lo,
+                                wl_fixed_t dx,
+                                wl_fixed_t dy,
+                                wl_fixed_t dx_unaccel,
+                                wl_fixed_t dy_unaccel);
+
+    void handle_swipe_begin(struct zwp_pointer_gesture_swipe_v1 *swipe,
+                            uint32_t serial,
+                            uint32_t time,
+                            struct wl_surface *surface,
+                            uint32_t fingers);
+
+    void handle_swipe_update(struct zwp_pointer_gesture_swipe_v1 *swipe,
+                             uint32_t time,
+                             wl_fixed_t dx,
+                             wl_fixed_t dy);
+
+    void handle_swipe_end(struct zwp_pointer_gesture_swipe_v1 *swipe,
+                          uint32_t serial,
+                          uint32_t time,
+                          int32_t cancelled);
+
+    void handle_pinch_begin(struct zwp_pointer_gesture_pinch_v1 *pinch,
+                            uint32_t serial,
+                            uint32_t time,
+                            struct wl_surface *surface,
+                            uint32_t fingers);
+
+    void handle_pinch_update(struct zwp_pointer_gesture_pinch_v1 *pinch,
+                             uint32_t time,
+                             wl_fixed_t dx,
+                             wl_fixed_t dy,
+                             wl_fixed_t scale,
+                             wl_fixed_t rotation);
+
+    void handle_pinch_end(struct zwp_pointer_gesture_pinch_v1 *pinch,
+                          uint32_t serial,
+                          uint32_t time,
+                          int32_t cancelled);
+
+    void handle_hold_begin(struct zwp_pointer_gesture_hold_v1 *hold,
+                           uint32_t serial,
+                           uint32_t time,
+                           struct wl_surface *surface,
+                           uint32_t fingers);
+
+    void handle_hold_end(struct zwp_pointer_gesture_hold_v1 *hold,
+                         uint32_t serial,
+                         uint32_t time,
+                         int32_t cancelled);
+
+    void handle_locked(struct zwp_locked_pointer_v1 *locked_pointer);
+
+    void handle_unlocked(struct zwp_locked_pointer_v1 *locked_pointer);
+
+    void handle_confined(struct zwp_confined_pointer_v1 *confined_pointer);
+
+    void handle_unconfined(struct zwp_confined_pointer_v1 *confined_pointer);
+
     static const struct wl_pointer_listener listener_;
+
+    static const struct zwp_relative_pointer_v1_listener relative_pointer_listener_;
+
+    static const struct zwp_locked_pointer_v1_listener locked_pointer_listener_;
+
+    static const struct zwp_pointer_gesture_swipe_v1_listener swipe_listener_;
+
+    static const struct zwp_pointer_gesture_pinch_v1_listener pinch_listener_;
+
+    static const struct zwp_pointer_gesture_hold_v1_listener hold_listener_;
+
+    static const struct zwp_confined_pointer_v1_listener confined_pointer_listener_;
 };
 
 #endif // SRC_SEAT_POINTER_H_
\ No newline at end of file
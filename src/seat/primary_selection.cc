@@ -0,0 +1,208 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "primary_selection.h"
+
+#include <algorithm>
+
+#include "utils/listener.h"
+
+/**
+ * @class PrimarySelectionOffer
+ * @brief The primary selection of another client, the text to middle-click paste.
+ *
+ * Selecting text makes a new offer on every change, so nothing is received
+ * until asked for: fetch() reads a type once and serves repeated requests
+ * from the offer's cache.
+ */
+PrimarySelectionOffer::PrimarySelectionOffer(struct zwp_primary_selection_offer_v1 *offer, GMainContext *context,
+                                             std::list<DataTransfer *> *transfers) :
+        offer_(offer), context_(context), transfers_(transfers), cache_(context, transfers) {
+    zwp_primary_selection_offer_v1_add_listener(offer_, &listener_, this);
+}
+
+PrimarySelectionOffer::~PrimarySelectionOffer() {
+    zwp_primary_selection_offer_v1_destroy(offer_);
+}
+
+/**
+ * @brief Whether the source offers the mime type.
+ */
+bool PrimarySelectionOffer::has_mime_type(const std::string &mime_type) const {
+    return std::find(mime_types_.begin(), mime_types_.end(), mime_type) != mime_types_.end();
+}
+
+/**
+ * @brief Hands one representation to callback, receiving it only on the first request.
+ *
+ * @param mime_type One of get_mime_types().
+ * @param callback Gets a memfd owned by the offer and the size, fd -1 on failure.
+ * @return false if the transfer could not be started.
+ */
+bool PrimarySelectionOffer::fetch(const std::string &mime_type, const OfferCache::FetchCallback &callback) {
+    return cache_.fetch(
+            mime_type,
+            [this](const char *type, int pipe_fd) { zwp_primary_selection_offer_v1_receive(offer_, type, pipe_fd); },
+            callback);
+}
+
+/**
+ * @brief Streams one representation into fd, duplicated, without caching it.
+ *
+ * @return false if the pipe could not be created.
+ */
+bool PrimarySelectionOffer::receive(const std::string &mime_type, int fd, const DataTransfer::DoneCallback &done) {
+    return DataTransfer::receive(
+            context_,
+            [&](int pipe_fd) { zwp_primary_selection_offer_v1_receive(offer_, mime_type.c_str(), pipe_fd); }, fd,
+            done, transfers_) != nullptr;
+}
+
+void PrimarySelectionOffer::handle_offer(struct zwp_primary_selection_offer_v1 * /* offer */,
+                                         const char *mime_type) {
+    mime_types_.emplace_back(mime_type);
+}
+
+const struct zwp_primary_selection_offer_v1_listener PrimarySelectionOffer::listener_ = {
+        .offer = listener_thunk<&PrimarySelectionOffer::handle_offer>,
+};
+
+/**
+ * @class PrimarySelectionSource
+ * @brief Text the client offers as the primary selection.
+ *
+ * Like DataSource, each mime type is a file or memfd sendfile()d to every
+ * receiver on the event loop.
+ */
+PrimarySelectionSource::PrimarySelectionSource(struct zwp_primary_selection_device_manager_v1 *manager,
+                                               GMainContext *context, std::list<DataTransfer *> *transfers) :
+        source_(zwp_primary_selection_device_manager_v1_create_source(manager)), contents_(context, transfers) {
+    zwp_primary_selection_source_v1_add_listener(source_, &listener_, this);
+}
+
+PrimarySelectionSource::~PrimarySelectionSource() {
+    zwp_primary_selection_source_v1_destroy(source_);
+}
+
+/**
+ * @brief Offers the content of a file or memfd as mime_type, see SourceContents::set().
+ */
+bool PrimarySelectionSource::offer(const std::string &mime_type, int fd) {
+    bool added = !contents_.has(mime_type);
+    if (!contents_.set(mime_type, fd)) {
+        return false;
+    }
+    if (added) {
+        zwp_primary_selection_source_v1_offer(source_, mime_type.c_str());
+    }
+    return true;
+}
+
+/**
+ * @brief Offers a copy of data as mime_type, held in a memfd.
+ */
+bool PrimarySelectionSource::offer(const std::string &mime_type, const void *data, size_t size) {
+    bool added = !contents_.has(mime_type);
+    if (!contents_.set(mime_type, data, size)) {
+        return false;
+    }
+    if (added) {
+        zwp_primary_selection_source_v1_offer(source_, mime_type.c_str());
+    }
+    return true;
+}
+
+void PrimarySelectionSource::handle_send(struct zwp_primary_selection_source_v1 * /* source */,
+                                         const char *mime_type, int32_t fd) {
+    contents_.send(mime_type, fd);
+}
+
+void PrimarySelectionSource::handle_cancelled(struct zwp_primary_selection_source_v1 * /* source */) {
+    if (cancelled_callback_) {
+        cancelled_callback_();
+    }
+}
+
+const struct zwp_primary_selection_source_v1_listener PrimarySelectionSource::listener_ = {
+        .send = listener_thunk<&PrimarySelectionSource::handle_send>,
+        .cancelled = listener_thunk<&PrimarySelectionSource::handle_cancelled>,
+};
+
+/**
+ * @class PrimarySelectionDevice
+ * @brief zwp_primary_selection_device_v1 of a seat.
+ *
+ * Sources and offers handed out must not outlive the device.
+ */
+PrimarySelectionDevice::PrimarySelectionDevice(struct zwp_primary_selection_device_manager_v1 *manager,
+                                               struct wl_seat *seat, GMainContext *context) :
+        manager_(manager),
+        device_(zwp_primary_selection_device_manager_v1_get_device(manager, seat)),
+        context_(context) {
+    zwp_primary_selection_device_v1_add_listener(device_, &listener_, this);
+}
+
+PrimarySelectionDevice::~PrimarySelectionDevice() {
+    // offer caches delete their own transfers, so the offers go first
+    new_offers_.clear();
+    selection_.reset();
+    while (!transfers_.empty()) {
+        delete transfers_.front();
+    }
+    zwp_primary_selection_device_v1_destroy(device_);
+}
+
+/**
+ * @brief A source to fill with offer() and pass to set_selection().
+ */
+std::unique_ptr<PrimarySelectionSource> PrimarySelectionDevice::create_source() const {
+    return std::make_unique<PrimarySelectionSource>(manager_, context_,
+                                                    const_cast<std::list<DataTransfer *> *>(&transfers_));
+}
+
+/**
+ * @brief Makes source the primary selection, nullptr clears it.
+ *
+ * @param serial The serial of the input event that selected the text.
+ */
+void PrimarySelectionDevice::set_selection(const PrimarySelectionSource *source, uint32_t serial) {
+    zwp_primary_selection_device_v1_set_selection(device_, source ? source->get_source() : nullptr, serial);
+}
+
+void PrimarySelectionDevice::handle_data_offer(struct zwp_primary_selection_device_v1 * /* device */,
+                                               struct zwp_primary_selection_offer_v1 *offer) {
+    new_offers_[offer] = std::make_unique<PrimarySelectionOffer>(offer, context_, &transfers_);
+}
+
+void PrimarySelectionDevice::handle_selection(struct zwp_primary_selection_device_v1 * /* device */,
+                                              struct zwp_primary_selection_offer_v1 *offer) {
+    auto it = new_offers_.find(offer);
+    if (it != new_offers_.end()) {
+        selection_ = std::move(it->second);
+        new_offers_.erase(it);
+    } else {
+        selection_.reset();
+    }
+    if (selection_callback_) {
+        selection_callback_(selection_.get());
+    }
+}
+
+const struct zwp_primary_selection_device_v1_listener PrimarySelectionDevice::listener_ = {
+        .data_offer = listener_thunk<&PrimarySelectionDevice::handle_data_offer>,
+        .selection = listener_thunk<&PrimarySelectionDevice::handle_selection>,
+};
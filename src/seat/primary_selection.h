@@ -0,0 +1,141 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_PRIMARY_SELECTION_H_
+#define SRC_SEAT_PRIMARY_SELECTION_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <wayland-client.h>
+#include <glib-2.0/glib.h>
+
+#include "data_device.h"
+
+#include "primary-selection-unstable-v1-client-protocol.h"
+#include "utils/export.h"
+
+class WAYPP_EXPORT PrimarySelectionOffer {
+public:
+    PrimarySelectionOffer(struct zwp_primary_selection_offer_v1 *offer, GMainContext *context,
+                          std::list<DataTransfer *> *transfers);
+
+    ~PrimarySelectionOffer();
+
+    PrimarySelectionOffer(const PrimarySelectionOffer &) = delete;
+
+    PrimarySelectionOffer &operator=(const PrimarySelectionOffer &) = delete;
+
+    [[nodiscard]] const std::vector<std::string> &get_mime_types() const { return mime_types_; }
+
+    [[nodiscard]] bool has_mime_type(const std::string &mime_type) const;
+
+    bool fetch(const std::string &mime_type, const OfferCache::FetchCallback &callback);
+
+    bool receive(const std::string &mime_type, int fd, const DataTransfer::DoneCallback &done);
+
+private:
+    struct zwp_primary_selection_offer_v1 *offer_;
+    GMainContext *context_;
+    std::list<DataTransfer *> *transfers_;
+    std::vector<std::string> mime_types_;
+    OfferCache cache_;
+
+    void handle_offer(struct zwp_primary_selection_offer_v1 *offer, const char *mime_type);
+
+    static const struct zwp_primary_selection_offer_v1_listener listener_;
+};
+
+class WAYPP_EXPORT PrimarySelectionSource {
+public:
+    PrimarySelectionSource(struct zwp_primary_selection_device_manager_v1 *manager, GMainContext *context,
+                           std::list<DataTransfer *> *transfers);
+
+    ~PrimarySelectionSource();
+
+    PrimarySelectionSource(const PrimarySelectionSource &) = delete;
+
+    PrimarySelectionSource &operator=(const PrimarySelectionSource &) = delete;
+
+    [[nodiscard]] struct zwp_primary_selection_source_v1 *get_source() const { return source_; }
+
+    bool offer(const std::string &mime_type, int fd);
+
+    bool offer(const std::string &mime_type, const void *data, size_t size);
+
+    // another client took the primary selection; the source may be destroyed
+    void set_cancelled_callback(const std::function<void()> &callback) { cancelled_callback_ = callback; }
+
+private:
+    struct zwp_primary_selection_source_v1 *source_;
+    SourceContents contents_;
+    std::function<void()> cancelled_callback_;
+
+    void handle_send(struct zwp_primary_selection_source_v1 *source, const char *mime_type, int32_t fd);
+
+    void handle_cancelled(struct zwp_primary_selection_source_v1 *source);
+
+    static const struct zwp_primary_selection_source_v1_listener listener_;
+};
+
+class WAYPP_EXPORT PrimarySelectionDevice {
+public:
+    PrimarySelectionDevice(struct zwp_primary_selection_device_manager_v1 *manager, struct wl_seat *seat,
+                           GMainContext *context);
+
+    ~PrimarySelectionDevice();
+
+    PrimarySelectionDevice(const PrimarySelectionDevice &) = delete;
+
+    PrimarySelectionDevice &operator=(const PrimarySelectionDevice &) = delete;
+
+    // the primary selection changed, nullptr when it is empty; the offer lives until the next selection
+    void set_selection_callback(const std::function<void(PrimarySelectionOffer *offer)> &callback) {
+        selection_callback_ = callback;
+    }
+
+    [[nodiscard]] PrimarySelectionOffer *get_selection() const { return selection_.get(); }
+
+    [[nodiscard]] std::unique_ptr<PrimarySelectionSource> create_source() const;
+
+    void set_selection(const PrimarySelectionSource *source, uint32_t serial);
+
+private:
+    struct zwp_primary_selection_device_manager_v1 *manager_;
+    struct zwp_primary_selection_device_v1 *device_;
+    GMainContext *context_;
+    std::list<DataTransfer *> transfers_;
+    std::map<struct zwp_primary_selection_offer_v1 *, std::unique_ptr<PrimarySelectionOffer>> new_offers_;
+    std::unique_ptr<PrimarySelectionOffer> selection_;
+    std::function<void(PrimarySelectionOffer *offer)> selection_callback_;
+
+    void handle_data_offer(struct zwp_primary_selection_device_v1 *device,
+                           struct zwp_primary_selection_offer_v1 *offer);
+
+    void handle_selection(struct zwp_primary_selection_device_v1 *device,
+                          struct zwp_primary_selection_offer_v1 *offer);
+
+    static const struct zwp_primary_selection_device_v1_listener listener_;
+};
+
+#endif // SRC_SEAT_PRIMARY_SELECTION_H_
@@ -17,6 +17,7 @@
 #include "seat.h"
 
 #include <cassert>
+#include <string>
 
 /**
  * @class Seat
@@ -26,16 +27,415 @@
  * devices such as keyboards, pointers, and touchscreens.
  */
 Seat::Seat(struct wl_seat *seat, struct wl_shm *shm, struct wl_compositor *compositor, bool enable_cursor,
-           uint32_t version) :
+           uint32_t version, GMainContext *context, uint32_t input_devices) :
         wl_seat_(seat),
         wl_shm_(shm),
         wl_compositor_(compositor),
         enable_cursor_(enable_cursor),
         version_(version),
-        capabilities_() {
+        context_(context),
+        capabilities_(),
+        input_devices_(input_devices),
+        trace_track_("seat " + std::to_string(wl_proxy_get_id(reinterpret_cast<struct wl_proxy *>(seat)))) {
     wl_seat_add_listener(seat, &listener_, this);
 }
 
+Seat::~Seat() {
+    // the devices are children of the seat, and go first
+#if defined(ENABLE_IDLE_NOTIFY)
+    idle_notification_.reset();
+#endif
+    tablet_seat_.reset();
+    text_input_.reset();
+    data_device_.reset();
+    primary_selection_device_.reset();
+    touch_.reset();
+    keyboard_.reset();
+    pointer_.reset();
+    xkb_keymap_unref(keymap_);
+    if (version_ >= WL_SEAT_RELEASE_SINCE_VERSION) {
+        wl_seat_release(wl_seat_);
+    } else {
+        wl_seat_destroy(wl_seat_);
+    }
+}
+
+/**
+ * @brief Drops an output that is going away from the outputs the seat's cursor is on.
+ *
+ * @param output The unplugged output.
+ */
+void Seat::remove_output(struct wl_output *output) {
+    if (pointer_ && pointer_->get_cursor()) {
+        pointer_->get_cursor()->remove_output(output);
+    }
+}
+
+/**
+ * @brief Requests nanosecond timestamps for the seat's input devices.
+ *
+ * @param manager The compositor's zwp_input_timestamps_manager_v1.
+ */
+void Seat::set_input_timestamps_manager(struct zwp_input_timestamps_manager_v1 *manager) {
+    zwp_input_timestamps_manager_ = manager;
+    if (pointer_) {
+        pointer_->enable_timestamps(manager);
+    }
+    if (keyboard_) {
+        keyboard_->enable_timestamps(manager);
+    }
+    if (touch_) {
+        touch_->enable_timestamps(manager);
+    }
+}
+
+/**
+ * @brief Sets a callback invoked with the CLOCK_MONOTONIC time of every pointer, key and touch event.
+ *
+ * @param callback The function to invoke, on the thread dispatching the default queue.
+ */
+void Seat::set_input_callback(const std::function<void(uint64_t time_ns)> &callback) {
+    input_callback_ = callback;
+    if (pointer_) {
+        pointer_->set_input_callback(callback);
+    }
+    if (keyboard_) {
+        keyboard_->set_input_callback(callback);
+    }
+    if (touch_) {
+        touch_->set_input_callback(callback);
+    }
+}
+
+/**
+ * @brief Routes the events of the seat's input devices to the InputRing of the focused window.
+ *
+ * @param router The surface to ring map, owned by the Display.
+ * @param device Stamped on the seat's events as InputEvent::device.
+ */
+void Seat::set_input_router(const InputRouter *router, uint8_t device) {
+    input_router_ = router;
+    device_index_ = device;
+    if (pointer_) {
+        pointer_->set_input_router(router, device);
+    }
+    if (keyboard_) {
+        keyboard_->set_input_router(router, device);
+    }
+    if (touch_) {
+        touch_->set_input_router(router, device);
+    }
+}
+
+/**
+ * @brief Compiles keyboard keymaps through cache, shared with the other seats.
+ *
+ * @param cache The keymap cache, owned by the Display.
+ */
+void Seat::set_keymap_cache(KeymapCache *cache) {
+    keymap_cache_ = cache;
+    if (keyboard_) {
+        keyboard_->set_keymap_cache(cache);
+    }
+}
+
+/**
+ * @brief Sets a callback invoked once per wl_touch.frame and wl_touch.cancel with all touch points.
+ *
+ * @param callback The function to invoke, on the thread dispatching the default queue.
+ */
+void Seat::set_touch_frame_callback(const std::function<void(const TouchFrame &frame)> &callback) {
+    touch_frame_callback_ = callback;
+}
+
+/**
+ * @brief Feeds the touch gesture recognizer, then the touch frame callback.
+ */
+void Seat::handle_touch_frame(const TouchFrame &frame) {
+    touch_gestures_.feed(frame);
+    if (touch_frame_callback_) {
+        touch_frame_callback_(frame);
+    }
+}
+
+/**
+ * @brief Enables touchpad gestures on the seat's pointer, see Pointer::enable_gestures().
+ *
+ * @param gestures The compositor's zwp_pointer_gestures_v1.
+ * @param version The bound version of gestures.
+ */
+void Seat::set_pointer_gestures(struct zwp_pointer_gestures_v1 *gestures, uint32_t version) {
+    zwp_pointer_gestures_ = gestures;
+    pointer_gestures_version_ = version;
+    if (pointer_) {
+        pointer_->enable_gestures(gestures, version);
+    }
+}
+
+/**
+ * @brief Sets a callback invoked with touchpad gestures and with gestures recognized from touch.
+ *
+ * @param callback The function to invoke, on the thread dispatching the default queue.
+ * @param coalesce true to merge gesture updates until flush_frame(), e.g. once per render frame.
+ */
+void Seat::set_gesture_callback(const std::function<void(const Gesture &gesture)> &callback, bool coalesce) {
+    gesture_callback_ = callback;
+    coalesce_gestures_ = coalesce;
+    touch_gestures_.set_callback(callback);
+    touch_gestures_.set_coalesce(coalesce);
+    if (pointer_) {
+        pointer_->set_gesture_callback(callback);
+        pointer_->set_coalesce_gestures(coalesce);
+    }
+}
+
+/**
+ * @brief Delivers the pointer frame and gesture updates held back by coalescing.
+ *
+ * Call before drawing, so input reaches the application at most once per render frame.
+ */
+void Seat::flush_frame() {
+    if (pointer_) {
+        pointer_->flush_frame();
+    }
+    touch_gestures_.flush();
+}
+
+/**
+ * @brief Composes the keys of the seat's keyboard with table, shared with the other seats.
+ *
+ * @param table The compose table, owned by the Display.
+ */
+void Seat::set_compose_table(ComposeTable *table) {
+    compose_table_ = table;
+    if (keyboard_) {
+        keyboard_->set_compose_table(table);
+    }
+}
+
+/**
+ * @brief Loads the cursor themes of the seat's pointer through cache.
+ *
+ * @param cache The cursor theme cache, owned by the Display.
+ */
+void Seat::set_cursor_theme_cache(CursorThemeCache *cache) {
+    cursor_theme_cache_ = cache;
+    if (pointer_) {
+        pointer_->set_cursor_theme_cache(cache);
+    }
+}
+
+/**
+ * @brief Sets the cursor of the seat's pointer by shape, see Cursor::set_shape_manager().
+ *
+ * @param manager The compositor's wp_cursor_shape_manager_v1.
+ */
+void Seat::set_cursor_shape_manager(struct wp_cursor_shape_manager_v1 *manager) {
+    wp_cursor_shape_manager_ = manager;
+    if (pointer_) {
+        pointer_->set_cursor_shape_manager(manager);
+    }
+}
+
+/**
+ * @brief Creates the seat's TextInput, see get_text_input().
+ *
+ * @param manager The compositor's zwp_text_input_manager_v3.
+ */
+void Seat::set_text_input_manager(struct zwp_text_input_manager_v3 *manager) {
+    if (!text_input_) {
+        text_input_ = std::make_unique<TextInput>(manager, wl_seat_);
+    }
+}
+
+/**
+ * @brief Creates the seat's DataDevice, see get_data_device().
+ *
+ * @param manager The compositor's wl_data_device_manager.
+ */
+void Seat::set_data_device_manager(struct wl_data_device_manager *manager) {
+    if (!data_device_) {
+        data_device_ = std::make_unique<DataDevice>(manager, wl_seat_, context_);
+    }
+}
+
+/**
+ * @brief Creates the seat's PrimarySelectionDevice, see get_primary_selection_device().
+ *
+ * @param manager The compositor's zwp_primary_selection_device_manager_v1.
+ */
+void Seat::set_primary_selection_manager(struct zwp_primary_selection_device_manager_v1 *manager) {
+    if (!primary_selection_device_) {
+        primary_selection_device_ = std::make_unique<PrimarySelectionDevice>(manager, wl_seat_, context_);
+    }
+}
+
+/**
+ * @brief Receives the seat's tablets, tools and pads, unless INPUT_DEVICE_TABLET is deselected.
+ *
+ * @param manager The compositor's zwp_tablet_manager_v2.
+ */
+void Seat::set_tablet_manager(struct zwp_tablet_manager_v2 *manager) {
+    zwp_tablet_manager_ = manager;
+    update_devices();
+}
+
+/**
+ * @brief Sets a callback invoked once per zwp_tablet_tool_v2.frame with the tool's state.
+ *
+ * @param callback The function to invoke, on the thread dispatching the default queue.
+ */
+void Seat::set_tablet_tool_callback(
+        const std::function<void(const TabletTool &tool, const TabletToolEvent &event)> &callback) {
+    tablet_tool_callback_ = callback;
+    if (tablet_seat_) {
+        tablet_seat_->set_tool_callback(callback);
+    }
+}
+
+/**
+ * @brief Sets a callback invoked for every pad button and every ring, strip or mode frame.
+ *
+ * @param callback The function to invoke, on the thread dispatching the default queue.
+ */
+void Seat::set_tablet_pad_callback(
+        const std::function<void(const TabletPad &pad, const TabletPadEvent &event)> &callback) {
+    tablet_pad_callback_ = callback;
+    if (tablet_seat_) {
+        tablet_seat_->set_pad_callback(callback);
+    }
+}
+
+/**
+ * @brief Records tablet tool motion for TabletTool::predict_position().
+ *
+ * @param enable true to record motion.
+ * @param model The fit extrapolated from.
+ */
+void Seat::enable_tablet_prediction(bool enable, MotionPredictor::Model model) {
+    predict_tablet_ = enable;
+    tablet_predict_model_ = model;
+    if (tablet_seat_) {
+        tablet_seat_->enable_prediction(enable, model);
+    }
+}
+
+/**
+ * @brief Enables relative motion on the seat's pointer, see Pointer::enable_relative_motion().
+ *
+ * @param manager The compositor's zwp_relative_pointer_manager_v1.
+ */
+void Seat::set_relative_pointer_manager(struct zwp_relative_pointer_manager_v1 *manager) {
+    zwp_relative_pointer_manager_ = manager;
+    if (pointer_) {
+        pointer_->enable_relative_motion(manager);
+    }
+}
+
+/**
+ * @brief Lets the seat's pointer be locked or confined, see Pointer::lock().
+ *
+ * @param constraints The compositor's zwp_pointer_constraints_v1.
+ */
+void Seat::set_pointer_constraints(struct zwp_pointer_constraints_v1 *constraints) {
+    zwp_pointer_constraints_ = constraints;
+    if (pointer_) {
+        pointer_->set_pointer_constraints(constraints);
+    }
+}
+
+/**
+ * @brief Sets a callback invoked once per wl_pointer.frame with everything the pointer reported in it.
+ *
+ * @param callback The function to invoke, on the thread dispatching the default queue.
+ * @param coalesce_motion true to merge motion-only frames until Pointer::flush_frame() or the next
+ *                        frame with other events.
+ * @param coalesce_scroll true to merge scroll frames the same way, see Pointer::set_coalesce_scroll().
+ */
+void Seat::set_pointer_frame_callback(const std::function<void(const PointerEvent &event)> &callback,
+                                      bool coalesce_motion, bool coalesce_scroll) {
+    pointer_frame_callback_ = callback;
+    coalesce_motion_ = coalesce_motion;
+    coalesce_scroll_ = coalesce_scroll;
+    if (pointer_) {
+        pointer_->set_frame_callback(callback);
+        pointer_->set_coalesce_motion(coalesce_motion);
+        pointer_->set_coalesce_scroll(coalesce_scroll);
+    }
+}
+
+/**
+ * @brief Sets a callback invoked with every pointer button as it arrives, with the seat it came from.
+ *
+ * Meant for requests a press authorizes, such as an interactive move, which need the
+ * seat and the button's serial.
+ *
+ * @param callback The function to invoke, on the thread dispatching the default queue.
+ */
+void Seat::set_pointer_button_callback(const std::function<void(Seat &seat, const PointerButton &button)> &callback) {
+    pointer_button_callback_ = callback;
+    if (pointer_) {
+        pointer_->set_button_callback(make_pointer_button_callback());
+    }
+}
+
+/**
+ * @brief Follows the seat's idle state, once set_idle_callback() gave a timeout.
+ *
+ * @param notifier The compositor's ext_idle_notifier_v1.
+ * @param version  The version notifier is bound at; version 2 adds input-only idle.
+ */
+void Seat::set_idle_notifier(struct ext_idle_notifier_v1 *notifier, uint32_t version) {
+    ext_idle_notifier_ = notifier;
+    idle_notifier_version_ = version;
+    update_idle_notification();
+}
+
+/**
+ * @brief Sets a callback invoked as the seat goes idle after timeout_ms without input, and on its next input.
+ *
+ * A new timeout restarts the count; a seat that was idle reports input first.
+ *
+ * @param timeout_ms         The time without input before the seat is idle.
+ * @param callback           The function to invoke, on the thread dispatching the default queue; nullptr to stop.
+ * @param respect_inhibitors true to stay active while a surface inhibits idle, see IdleNotification.
+ */
+void Seat::set_idle_callback(uint32_t timeout_ms, const std::function<void(Seat &seat, bool idle)> &callback,
+                             bool respect_inhibitors) {
+    idle_timeout_ms_ = timeout_ms;
+    idle_respect_inhibitors_ = respect_inhibitors;
+    idle_callback_ = callback;
+    update_idle_notification();
+}
+
+void Seat::update_idle_notification() {
+#if defined(ENABLE_IDLE_NOTIFY)
+    const bool was_idle = is_idle();
+    idle_notification_.reset();
+    if (was_idle && idle_callback_) {
+        idle_callback_(*this, false);
+    }
+    if (!ext_idle_notifier_ || !idle_callback_) {
+        return;
+    }
+    idle_notification_ = std::make_unique<IdleNotification>(
+            ext_idle_notifier_, idle_notifier_version_, wl_seat_, idle_timeout_ms_, idle_respect_inhibitors_,
+            [this](bool idle) { idle_callback_(*this, idle); });
+#endif
+}
+
+/**
+ * @brief Sets a callback invoked as the keyboard enters or leaves a surface.
+ *
+ * @param callback The function to invoke, on the thread dispatching the default queue.
+ */
+void Seat::set_keyboard_focus_callback(const std::function<void(struct wl_surface *surface, bool focused)> &callback) {
+    keyboard_focus_callback_ = callback;
+    if (keyboard_) {
+        keyboard_->set_focus_callback(callback);
+    }
+}
+
 /**
  * @class Seat
  * @brief Represents a seat in the Wayland protocol.
@@ -49,24 +449,172 @@ void Seat::handle_capabilities(void *data,
     const auto obj = static_cast<Seat *>(data);
     assert(obj->wl_seat_ == seat);
     obj->capabilities_ = caps;
+    obj->update_devices();
+}
+
+/**
+ * @brief Selects the input devices the application uses, see InputDevices.
+ *
+ * Devices left out are destroyed, or never created: their wl_pointer, wl_keyboard
+ * or wl_touch is not requested, so the compositor sends them no events. May be
+ * changed at any time.
+ *
+ * @param input_devices A mask of InputDevices.
+ */
+void Seat::set_input_devices(uint32_t input_devices) {
+    const uint32_t changed = input_devices ^ input_devices_;
+    input_devices_ = input_devices;
+    // the cursor is created with the pointer
+    if ((changed & INPUT_DEVICE_CURSOR) && pointer_) {
+        destroy_pointer();
+    }
+    update_devices();
+}
+
+/**
+ * @brief Creates or destroys the devices whose capability or selection changed.
+ *
+ * A re-announcement leaves the other devices, with their keymap and cursor, as they are.
+ */
+void Seat::update_devices() {
+    const bool pointer = (capabilities_ & WL_SEAT_CAPABILITY_POINTER) && (input_devices_ & INPUT_DEVICE_POINTER);
+    if (pointer && !pointer_) {
+        create_pointer();
+    } else if (!pointer && pointer_) {
+        destroy_pointer();
+    }
+
+    const bool keyboard = (capabilities_ & WL_SEAT_CAPABILITY_KEYBOARD) && (input_devices_ & INPUT_DEVICE_KEYBOARD);
+    if (keyboard && !keyboard_) {
+        create_keyboard();
+    } else if (!keyboard && keyboard_) {
+        destroy_keyboard();
+    }
+
+    const bool touch = (capabilities_ & WL_SEAT_CAPABILITY_TOUCH) && (input_devices_ & INPUT_DEVICE_TOUCH);
+    if (touch && !touch_) {
+        create_touch();
+    } else if (!touch && touch_) {
+        touch_.reset();
+    }
 
-    if (caps & WL_SEAT_CAPABILITY_POINTER && !obj->pointer_) {
-        obj->pointer_ = std::make_unique<Pointer>(wl_seat_get_pointer(seat), obj->wl_shm_, obj->wl_compositor_,
-                                                  obj->enable_cursor_);
-    } else if (!(caps & WL_SEAT_CAPABILITY_POINTER) && obj->pointer_) {
-        obj->pointer_.reset();
+    const bool tablet = zwp_tablet_manager_ && (input_devices_ & INPUT_DEVICE_TABLET);
+    if (tablet && !tablet_seat_) {
+        create_tablet_seat();
+    } else if (!tablet && tablet_seat_) {
+        tablet_seat_.reset();
     }
+}
 
-    if ((caps & WL_SEAT_CAPABILITY_KEYBOARD) && !obj->keyboard_) {
-        obj->keyboard_ = std::make_unique<Keyboard>(wl_seat_get_keyboard(seat));
-    } else if (!(caps & WL_SEAT_CAPABILITY_KEYBOARD) && obj->keyboard_) {
-        obj->keyboard_.reset();
+/**
+ * @brief Creates the seat's TabletSeat with the seat's callbacks.
+ */
+void Seat::create_tablet_seat() {
+    tablet_seat_ = std::make_unique<TabletSeat>(zwp_tablet_manager_, wl_seat_);
+    tablet_seat_->set_trace_track(trace_track_);
+    tablet_seat_->set_tool_callback(tablet_tool_callback_);
+    tablet_seat_->set_pad_callback(tablet_pad_callback_);
+    if (predict_tablet_) {
+        tablet_seat_->enable_prediction(true, tablet_predict_model_);
     }
+}
+
+std::function<void(const PointerButton &button)> Seat::make_pointer_button_callback() {
+    if (!pointer_button_callback_) {
+        return nullptr;
+    }
+    return [this](const PointerButton &button) { pointer_button_callback_(*this, button); };
+}
 
-    if ((caps & WL_SEAT_CAPABILITY_TOUCH) && !obj->touch_) {
-        obj->touch_ = std::make_unique<Touch>(wl_seat_get_touch(seat));
-    } else if (!(caps & WL_SEAT_CAPABILITY_TOUCH) && obj->touch_) {
-        obj->touch_.reset();
+/**
+ * @brief Creates the pointer with the seat's settings and the cursor of the pointer before it.
+ */
+void Seat::create_pointer() {
+    pointer_ = std::make_unique<Pointer>(wl_seat_get_pointer(wl_seat_), wl_shm_, wl_compositor_,
+                                         enable_cursor_ && (input_devices_ & INPUT_DEVICE_CURSOR));
+    pointer_->set_trace_track(trace_track_);
+    pointer_->set_input_callback(input_callback_);
+    pointer_->set_input_router(input_router_, device_index_);
+    pointer_->set_cursor_theme_cache(cursor_theme_cache_);
+    pointer_->set_cursor_shape_manager(wp_cursor_shape_manager_);
+    pointer_->set_pointer_constraints(zwp_pointer_constraints_);
+    if (zwp_relative_pointer_manager_) {
+        pointer_->enable_relative_motion(zwp_relative_pointer_manager_);
+    }
+    pointer_->set_frame_callback(pointer_frame_callback_);
+    pointer_->set_button_callback(make_pointer_button_callback());
+    pointer_->set_coalesce_motion(coalesce_motion_);
+    pointer_->set_coalesce_scroll(coalesce_scroll_);
+    pointer_->set_gesture_callback(gesture_callback_);
+    pointer_->set_coalesce_gestures(coalesce_gestures_);
+    if (zwp_pointer_gestures_) {
+        pointer_->enable_gestures(zwp_pointer_gestures_, pointer_gestures_version_);
+    }
+    if (zwp_input_timestamps_manager_) {
+        pointer_->enable_timestamps(zwp_input_timestamps_manager_);
+    }
+    if (pointer_->get_cursor() && !cursor_kind_.empty()) {
+        pointer_->get_cursor()->set_kind(cursor_kind_);
+        (void) pointer_->set_cursor_scale(cursor_scale_);
+    }
+}
+
+/**
+ * @brief Destroys the pointer, keeping its cursor kind and scale for the next one.
+ */
+void Seat::destroy_pointer() {
+    if (const auto cursor = pointer_ ? pointer_->get_cursor() : nullptr) {
+        cursor_kind_ = cursor->get_kind();
+        cursor_scale_ = cursor->get_scale();
+    }
+    pointer_.reset();
+}
+
+/**
+ * @brief Creates the keyboard with the seat's settings and the keymap of the keyboard before it.
+ */
+void Seat::create_keyboard() {
+    keyboard_ = std::make_unique<Keyboard>(wl_seat_get_keyboard(wl_seat_), context_);
+    keyboard_->set_trace_track(trace_track_);
+    keyboard_->set_input_callback(input_callback_);
+    keyboard_->set_focus_callback(keyboard_focus_callback_);
+    keyboard_->set_input_router(input_router_, device_index_);
+    keyboard_->set_keymap_cache(keymap_cache_);
+    keyboard_->set_compose_table(compose_table_);
+    if (zwp_input_timestamps_manager_) {
+        keyboard_->enable_timestamps(zwp_input_timestamps_manager_);
+    }
+    if (keymap_) {
+        keyboard_->set_keymap(keymap_);
+    }
+}
+
+/**
+ * @brief Destroys the keyboard, keeping a reference to its keymap for the next one.
+ */
+void Seat::destroy_keyboard() {
+    if (keyboard_ && keyboard_->get_keymap()) {
+        xkb_keymap_unref(keymap_);
+        keymap_ = xkb_keymap_ref(keyboard_->get_keymap());
+    }
+    // no leave event follows once the capability is gone
+    if (keyboard_ && keyboard_->get_focus() && keyboard_focus_callback_) {
+        keyboard_focus_callback_(keyboard_->get_focus(), false);
+    }
+    keyboard_.reset();
+}
+
+/**
+ * @brief Creates the touch device with the seat's settings.
+ */
+void Seat::create_touch() {
+    touch_ = std::make_unique<Touch>(wl_seat_get_touch(wl_seat_));
+    touch_->set_trace_track(trace_track_);
+    touch_->set_input_callback(input_callback_);
+    touch_->set_input_router(input_router_, device_index_);
+    touch_->set_frame_callback([this](const TouchFrame &frame) { handle_touch_frame(frame); });
+    if (zwp_input_timestamps_manager_) {
+        touch_->enable_timestamps(zwp_input_timestamps_manager_);
     }
 }
 
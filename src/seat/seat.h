@@ -17,25 +17,47 @@
 #ifndef SRC_SEAT_SEAT_H_
 #define SRC_SEAT_SEAT_H_
 
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
 
 #include <wayland-client.h>
 
+#include "data_device.h"
 #include "keyboard.h"
+#include "gesture.h"
+#include "idle_notification.h"
+#include "input_devices.h"
 #include "pointer.h"
+#include "primary_selection.h"
+#include "tablet.h"
+#include "text_input.h"
 #include "touch.h"
+#include "utils/export.h"
 
 class Keyboard;
 
 class Pointer;
 
+struct PointerEvent;
+
+struct PointerButton;
+
+struct TouchFrame;
+
 class Touch;
 
-class Seat {
+class WAYPP_EXPORT Seat {
 public:
     explicit Seat(struct wl_seat *seat, struct wl_shm *shm, struct wl_compositor *compositor, bool enable_cursor,
-                  uint32_t version);
+                  uint32_t version, GMainContext *context = nullptr, uint32_t input_devices = INPUT_DEVICE_ALL);
+
+    ~Seat();
+
+    Seat(const Seat &) = delete;
+
+    Seat &operator=(const Seat &) = delete;
 
     [[nodiscard]] struct wl_seat *get_seat() const { return wl_seat_; };
 
@@ -45,18 +67,174 @@ public:
 
     [[nodiscard]] const uint32_t get_version() const { return version_; }
 
+    [[nodiscard]] Pointer *get_pointer() const { return pointer_.get(); }
+
+    [[nodiscard]] TextInput *get_text_input() const { return text_input_.get(); }
+
+    [[nodiscard]] DataDevice *get_data_device() const { return data_device_.get(); }
+
+    [[nodiscard]] PrimarySelectionDevice *get_primary_selection_device() const {
+        return primary_selection_device_.get();
+    }
+
+    [[nodiscard]] TabletSeat *get_tablet_seat() const { return tablet_seat_.get(); }
+
+    void set_input_devices(uint32_t input_devices);
+
+    [[nodiscard]] uint32_t get_input_devices() const { return input_devices_; }
+
+    void set_input_timestamps_manager(struct zwp_input_timestamps_manager_v1 *manager);
+
+    void set_input_callback(const std::function<void(uint64_t time_ns)> &callback);
+
+    void set_input_router(const InputRouter *router, uint8_t device = 0);
+
+    // tells the seat's events apart in an InputRing, in the order the seats were bound
+    [[nodiscard]] uint8_t get_device_index() const { return device_index_; }
+
+    void set_keymap_cache(KeymapCache *cache);
+
+    void set_compose_table(ComposeTable *table);
+
+    void set_cursor_theme_cache(CursorThemeCache *cache);
+
+    void set_cursor_shape_manager(struct wp_cursor_shape_manager_v1 *manager);
+
+    void set_touch_frame_callback(const std::function<void(const TouchFrame &frame)> &callback);
+
+    void set_pointer_gestures(struct zwp_pointer_gestures_v1 *gestures, uint32_t version);
+
+    void set_gesture_callback(const std::function<void(const Gesture &gesture)> &callback, bool coalesce = false);
+
+    void flush_frame();
+
+    void remove_output(struct wl_output *output);
+
+    void set_relative_pointer_manager(struct zwp_relative_pointer_manager_v1 *manager);
+
+    void set_pointer_constraints(struct zwp_pointer_constraints_v1 *constraints);
+
+    void set_text_input_manager(struct zwp_text_input_manager_v3 *manager);
+
+    void set_data_device_manager(struct wl_data_device_manager *manager);
+
+    void set_primary_selection_manager(struct zwp_primary_selection_device_manager_v1 *manager);
+
+    void set_tablet_manager(struct zwp_tablet_manager_v2 *manager);
+
+    void set_tablet_tool_callback(
+            const std::function<void(const TabletTool &tool, const TabletToolEvent &event)> &callback);
+
+    void set_tablet_pad_callback(const std::function<void(const TabletPad &pad, const TabletPadEvent &event)> &callback);
+
+    void enable_tablet_prediction(bool enable, MotionPredictor::Model model = MotionPredictor::LINEAR);
+
+    void set_pointer_frame_callback(const std::function<void(const PointerEvent &event)> &callback,
+                                    bool coalesce_motion = false, bool coalesce_scroll = false);
+
+    void set_pointer_button_callback(const std::function<void(Seat &seat, const PointerButton &button)> &callback);
+
+    void set_keyboard_focus_callback(const std::function<void(struct wl_surface *surface, bool focused)> &callback);
+
+    [[nodiscard]] Keyboard *get_keyboard() const { return keyboard_.get(); }
+
+    void set_idle_notifier(struct ext_idle_notifier_v1 *notifier, uint32_t version);
+
+    void set_idle_callback(uint32_t timeout_ms, const std::function<void(Seat &seat, bool idle)> &callback,
+                           bool respect_inhibitors = false);
+
+    // false without an idle notifier or callback
+#if defined(ENABLE_IDLE_NOTIFY)
+    [[nodiscard]] bool is_idle() const { return idle_notification_ && idle_notification_->is_idle(); }
+#else
+    [[nodiscard]] bool is_idle() const { return false; }
+#endif
+
 private:
     struct wl_seat *wl_seat_;
     struct wl_shm *wl_shm_;
     struct wl_compositor *wl_compositor_;
     bool enable_cursor_;
     uint32_t version_;
+    GMainContext *context_;
     uint32_t capabilities_;
+    uint32_t input_devices_;
     std::string name_;
+    // name of the seat's trace track, shared by its input devices
+    std::string trace_track_;
+    // applied to input devices as they appear
+    struct zwp_input_timestamps_manager_v1 *zwp_input_timestamps_manager_{};
+    std::function<void(uint64_t time_ns)> input_callback_;
+    std::function<void(const PointerEvent &event)> pointer_frame_callback_;
+    std::function<void(Seat &seat, const PointerButton &button)> pointer_button_callback_;
+    std::function<void(struct wl_surface *surface, bool focused)> keyboard_focus_callback_;
+    const InputRouter *input_router_{};
+    uint8_t device_index_{};
+    KeymapCache *keymap_cache_{};
+    ComposeTable *compose_table_{};
+    CursorThemeCache *cursor_theme_cache_{};
+    struct wp_cursor_shape_manager_v1 *wp_cursor_shape_manager_{};
+    struct zwp_relative_pointer_manager_v1 *zwp_relative_pointer_manager_{};
+    struct zwp_pointer_constraints_v1 *zwp_pointer_constraints_{};
+    bool coalesce_motion_{};
+    bool coalesce_scroll_{};
+    std::function<void(const TouchFrame &frame)> touch_frame_callback_;
+    struct zwp_pointer_gestures_v1 *zwp_pointer_gestures_{};
+    uint32_t pointer_gestures_version_{};
+    std::function<void(const Gesture &gesture)> gesture_callback_;
+    bool coalesce_gestures_{};
+    struct zwp_tablet_manager_v2 *zwp_tablet_manager_{};
+    std::function<void(const TabletTool &tool, const TabletToolEvent &event)> tablet_tool_callback_;
+    std::function<void(const TabletPad &pad, const TabletPadEvent &event)> tablet_pad_callback_;
+    bool predict_tablet_{};
+    MotionPredictor::Model tablet_predict_model_{MotionPredictor::LINEAR};
+    // fed by every touch frame of the seat
+    TouchGestures touch_gestures_;
+    struct ext_idle_notifier_v1 *ext_idle_notifier_{};
+    uint32_t idle_notifier_version_{};
+    uint32_t idle_timeout_ms_{};
+    bool idle_respect_inhibitors_{};
+    std::function<void(Seat &seat, bool idle)> idle_callback_;
+
+    // kept while a capability is withdrawn, restored when it comes back
+    struct xkb_keymap *keymap_{};
+    std::string cursor_kind_;
+    int cursor_scale_{};
+
+    void handle_touch_frame(const TouchFrame &frame);
+
+    void update_devices();
+
+    void create_pointer();
+
+    [[nodiscard]] std::function<void(const PointerButton &button)> make_pointer_button_callback();
+
+    void destroy_pointer();
+
+    void create_keyboard();
+
+    void destroy_keyboard();
+
+    void create_touch();
+
+    void create_tablet_seat();
+
+    void update_idle_notification();
 
     std::unique_ptr<Keyboard> keyboard_;
     std::unique_ptr<Pointer> pointer_;
     std::unique_ptr<Touch> touch_;
+    // per seat rather than per device, present while the compositor has an input method
+    std::unique_ptr<TextInput> text_input_;
+    // the clipboard and drag-and-drop, present while the compositor has a data device manager
+    std::unique_ptr<DataDevice> data_device_;
+    std::unique_ptr<PrimarySelectionDevice> primary_selection_device_;
+    // tablets are not a wl_seat capability, present while the compositor has a tablet manager
+    std::unique_ptr<TabletSeat> tablet_seat_;
+    // present while the compositor has an idle notifier and set_idle_callback() was given one
+#if defined(ENABLE_IDLE_NOTIFY)
+    std::unique_ptr<IdleNotification> idle_notification_;
+#endif
 
     static void handle_capabilities(void * /* data */,
                                     struct wl_seat * /* seat */,
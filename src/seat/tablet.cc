@@ -0,0 +1,528 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "tablet.h"
+
+#include <algorithm>
+
+#include "input_timestamps.h"
+#include "utils/listener.h"
+#include "utils/logging.h"
+#include "utils/trace.h"
+
+namespace {
+// pressure, distance and strip position are sent in 0 to 65535
+constexpr double kAxisMax = 65535.0;
+}
+
+/**
+ * @class TabletTool
+ * @brief A zwp_tablet_tool_v2, a pen, eraser, airbrush or puck of a tablet seat.
+ *
+ * A tablet reports at 200 Hz or more and each report is several axis events
+ * closed by a frame. The axes are folded into one TabletToolEvent held by the
+ * tool and the callback sees it once per frame, so per event there is no
+ * allocation, no queueing and no std::function call.
+ */
+TabletTool::TabletTool(TabletSeat *seat, struct zwp_tablet_tool_v2 *tool) :
+        seat_(seat),
+        tool_(tool) {
+    zwp_tablet_tool_v2_add_listener(tool_, &listener_, this);
+}
+
+TabletTool::~TabletTool() {
+    zwp_tablet_tool_v2_destroy(tool_);
+}
+
+/**
+ * @brief Fits the recent timestamped motion of the tool, for predict_position().
+ *
+ * @param enable true to record motion.
+ * @param model The fit extrapolated from.
+ */
+void TabletTool::enable_prediction(bool enable, MotionPredictor::Model model) {
+    predict_ = enable;
+    predictor_.set_model(model);
+    predictor_.reset();
+}
+
+/**
+ * @brief Extrapolates where the tool will be at target_ns.
+ *
+ * @param target_ns CLOCK_MONOTONIC nanoseconds, e.g. Window::FrameInput::target_present_ns.
+ * @param x Receives the surface local x coordinate.
+ * @param y Receives the surface local y coordinate.
+ * @return false if prediction is disabled or the tool did not move since it came into proximity.
+ */
+bool TabletTool::predict_position(uint64_t target_ns, double &x, double &y) const {
+    return predict_ && predictor_.predict(target_ns, x, y);
+}
+
+void TabletTool::handle_type(struct zwp_tablet_tool_v2 * /* tool */, uint32_t tool_type) {
+    type_ = tool_type;
+}
+
+void TabletTool::handle_hardware_serial(struct zwp_tablet_tool_v2 * /* tool */, uint32_t hi, uint32_t lo) {
+    hardware_serial_ = static_cast<uint64_t>(hi) << 32 | lo;
+}
+
+void TabletTool::handle_hardware_id_wacom(struct zwp_tablet_tool_v2 * /* tool */, uint32_t /* hi */,
+                                          uint32_t /* lo */) {
+}
+
+void TabletTool::handle_capability(struct zwp_tablet_tool_v2 * /* tool */, uint32_t capability) {
+    if (capability < 32) {
+        capabilities_ |= 1u << capability;
+    }
+}
+
+void TabletTool::handle_done(struct zwp_tablet_tool_v2 * /* tool */) {
+    LOG_DEBUG("TabletTool: type 0x%x, serial 0x%llx, capabilities 0x%x", type_,
+              static_cast<unsigned long long>(hardware_serial_), capabilities_);
+}
+
+void TabletTool::handle_removed(struct zwp_tablet_tool_v2 * /* tool */) {
+    // destroys this
+    TabletSeat::remove(seat_->tools_, this);
+}
+
+void TabletTool::handle_proximity_in(struct zwp_tablet_tool_v2 * /* tool */, uint32_t serial,
+                                     struct zwp_tablet_v2 * /* tablet */, struct wl_surface *surface) {
+    event_.mask |= TabletToolEvent::PROXIMITY_IN;
+    event_.serial = serial;
+    event_.surface = surface;
+    predictor_.reset();
+}
+
+void TabletTool::handle_proximity_out(struct zwp_tablet_tool_v2 * /* tool */) {
+    event_.mask |= TabletToolEvent::PROXIMITY_OUT;
+}
+
+void TabletTool::handle_down(struct zwp_tablet_tool_v2 * /* tool */, uint32_t serial) {
+    event_.mask |= TabletToolEvent::DOWN;
+    event_.serial = serial;
+    event_.down = true;
+}
+
+void TabletTool::handle_up(struct zwp_tablet_tool_v2 * /* tool */) {
+    event_.mask |= TabletToolEvent::UP;
+    event_.down = false;
+}
+
+void TabletTool::handle_motion(struct zwp_tablet_tool_v2 * /* tool */, wl_fixed_t x, wl_fixed_t y) {
+    event_.mask |= TabletToolEvent::MOTION;
+    event_.x = wl_fixed_to_double(x);
+    event_.y = wl_fixed_to_double(y);
+}
+
+void TabletTool::handle_pressure(struct zwp_tablet_tool_v2 * /* tool */, uint32_t pressure) {
+    event_.mask |= TabletToolEvent::PRESSURE;
+    event_.pressure = pressure / kAxisMax;
+}
+
+void TabletTool::handle_distance(struct zwp_tablet_tool_v2 * /* tool */, uint32_t distance) {
+    event_.mask |= TabletToolEvent::DISTANCE;
+    event_.distance = distance / kAxisMax;
+}
+
+void TabletTool::handle_tilt(struct zwp_tablet_tool_v2 * /* tool */, wl_fixed_t tilt_x, wl_fixed_t tilt_y) {
+    event_.mask |= TabletToolEvent::TILT;
+    event_.tilt_x = wl_fixed_to_double(tilt_x);
+    event_.tilt_y = wl_fixed_to_double(tilt_y);
+}
+
+void TabletTool::handle_rotation(struct zwp_tablet_tool_v2 * /* tool */, wl_fixed_t degrees) {
+    event_.mask |= TabletToolEvent::ROTATION;
+    event_.rotation = wl_fixed_to_double(degrees);
+}
+
+void TabletTool::handle_slider(struct zwp_tablet_tool_v2 * /* tool */, int32_t position) {
+    event_.mask |= TabletToolEvent::SLIDER;
+    event_.slider = position / kAxisMax;
+}
+
+void TabletTool::handle_wheel(struct zwp_tablet_tool_v2 * /* tool */, wl_fixed_t degrees, int32_t clicks) {
+    event_.mask |= TabletToolEvent::WHEEL;
+    event_.wheel_degrees += wl_fixed_to_double(degrees);
+    event_.wheel_clicks += clicks;
+}
+
+void TabletTool::handle_button(struct zwp_tablet_tool_v2 * /* tool */, uint32_t serial, uint32_t button,
+                               uint32_t state) {
+    event_.mask |= TabletToolEvent::BUTTON;
+    event_.serial = serial;
+    event_.button = button;
+    event_.button_state = state;
+}
+
+/**
+ * @brief Delivers the axes accumulated since the last frame.
+ *
+ * Axis values stay for the next frame, which only repeats the ones that changed.
+ */
+void TabletTool::handle_frame(struct zwp_tablet_tool_v2 * /* tool */, uint32_t time) {
+    TRACE_TRACK_SCOPE(seat_->trace_track_, "TabletTool::handle_frame");
+    event_.time_ns = InputTimestamps::from_ms(time);
+    if (predict_ && (event_.mask & TabletToolEvent::MOTION)) {
+        predictor_.add(event_.time_ns, event_.x, event_.y);
+    }
+    if (event_.mask && seat_->tool_callback_) {
+        seat_->tool_callback_(*this, event_);
+    }
+    if (event_.mask & TabletToolEvent::PROXIMITY_OUT) {
+        event_.surface = nullptr;
+        event_.down = false;
+        predictor_.reset();
+    }
+    event_.mask = 0;
+    event_.wheel_degrees = 0;
+    event_.wheel_clicks = 0;
+}
+
+const struct zwp_tablet_tool_v2_listener TabletTool::listener_ = {
+        .type = listener_thunk<&TabletTool::handle_type>,
+        .hardware_serial = listener_thunk<&TabletTool::handle_hardware_serial>,
+        .hardware_id_wacom = listener_thunk<&TabletTool::handle_hardware_id_wacom>,
+        .capability = listener_thunk<&TabletTool::handle_capability>,
+        .done = listener_thunk<&TabletTool::handle_done>,
+        .removed = listener_thunk<&TabletTool::handle_removed>,
+        .proximity_in = listener_thunk<&TabletTool::handle_proximity_in>,
+        .proximity_out = listener_thunk<&TabletTool::handle_proximity_out>,
+        .down = listener_thunk<&TabletTool::handle_down>,
+        .up = listener_thunk<&TabletTool::handle_up>,
+        .motion = listener_thunk<&TabletTool::handle_motion>,
+        .pressure = listener_thunk<&TabletTool::handle_pressure>,
+        .distance = listener_thunk<&TabletTool::handle_distance>,
+        .tilt = listener_thunk<&TabletTool::handle_tilt>,
+        .rotation = listener_thunk<&TabletTool::handle_rotation>,
+        .slider = listener_thunk<&TabletTool::handle_slider>,
+        .wheel = listener_thunk<&TabletTool::handle_wheel>,
+        .button = listener_thunk<&TabletTool::handle_button>,
+        .frame = listener_thunk<&TabletTool::handle_frame>,
+};
+
+/**
+ * @class Tablet
+ * @brief A zwp_tablet_v2, the description of one graphics tablet of the seat.
+ */
+Tablet::Tablet(TabletSeat *seat, struct zwp_tablet_v2 *tablet) :
+        seat_(seat),
+        tablet_(tablet) {
+    zwp_tablet_v2_add_listener(tablet_, &listener_, this);
+}
+
+Tablet::~Tablet() {
+    zwp_tablet_v2_destroy(tablet_);
+}
+
+void Tablet::handle_name(struct zwp_tablet_v2 * /* tablet */, const char *name) {
+    name_ = name;
+}
+
+void Tablet::handle_id(struct zwp_tablet_v2 * /* tablet */, uint32_t vid, uint32_t pid) {
+    vid_ = vid;
+    pid_ = pid;
+}
+
+void Tablet::handle_path(struct zwp_tablet_v2 * /* tablet */, const char *path) {
+    path_ = path;
+}
+
+void Tablet::handle_done(struct zwp_tablet_v2 * /* tablet */) {
+    LOG_DEBUG("Tablet: %s (%04x:%04x) %s", name_.c_str(), vid_, pid_, path_.c_str());
+}
+
+void Tablet::handle_removed(struct zwp_tablet_v2 * /* tablet */) {
+    // destroys this
+    TabletSeat::remove(seat_->tablets_, this);
+}
+
+const struct zwp_tablet_v2_listener Tablet::listener_ = {
+        .name = listener_thunk<&Tablet::handle_name>,
+        .id = listener_thunk<&Tablet::handle_id>,
+        .path = listener_thunk<&Tablet::handle_path>,
+        .done = listener_thunk<&Tablet::handle_done>,
+        .removed = listener_thunk<&Tablet::handle_removed>,
+};
+
+/**
+ * @class TabletPad
+ * @brief A zwp_tablet_pad_v2, the buttons, rings and strips of a tablet.
+ *
+ * Ring and strip axes are, like tool axes, collected until their frame and
+ * delivered as one TabletPadEvent.
+ */
+TabletPad::TabletPad(TabletSeat *seat, struct zwp_tablet_pad_v2 *pad) :
+        seat_(seat),
+        pad_(pad) {
+    zwp_tablet_pad_v2_add_listener(pad_, &listener_, this);
+}
+
+TabletPad::~TabletPad() {
+    // groups first, their rings and strips are children of the pad
+    groups_.clear();
+    zwp_tablet_pad_v2_destroy(pad_);
+}
+
+void TabletPad::emit(const TabletPadEvent &event) const {
+    if (seat_->pad_callback_) {
+        seat_->pad_callback_(*this, event);
+    }
+}
+
+void TabletPad::handle_group(struct zwp_tablet_pad_v2 * /* pad */, struct zwp_tablet_pad_group_v2 *group) {
+    groups_.push_back(std::make_unique<Group>(this, group, static_cast<uint32_t>(groups_.size())));
+}
+
+void TabletPad::handle_path(struct zwp_tablet_pad_v2 * /* pad */, const char * /* path */) {
+}
+
+void TabletPad::handle_buttons(struct zwp_tablet_pad_v2 * /* pad */, uint32_t buttons) {
+    buttons_ = buttons;
+}
+
+void TabletPad::handle_done(struct zwp_tablet_pad_v2 * /* pad */) {
+    LOG_DEBUG("TabletPad: %u buttons, %zu groups", buttons_, groups_.size());
+}
+
+void TabletPad::handle_button(struct zwp_tablet_pad_v2 * /* pad */, uint32_t time, uint32_t button,
+                              uint32_t state) {
+    emit({.type = TabletPadEvent::BUTTON, .time_ns = InputTimestamps::from_ms(time), .group = 0, .index = button,
+          .state = state, .value = 0, .stopped = false, .source = 0, .mode = 0});
+}
+
+void TabletPad::handle_enter(struct zwp_tablet_pad_v2 * /* pad */, uint32_t /* serial */,
+                             struct zwp_tablet_v2 * /* tablet */, struct wl_surface *surface) {
+    focus_ = surface;
+}
+
+void TabletPad::handle_leave(struct zwp_tablet_pad_v2 * /* pad */, uint32_t /* serial */,
+                             struct wl_surface * /* surface */) {
+    focus_ = nullptr;
+}
+
+void TabletPad::handle_removed(struct zwp_tablet_pad_v2 * /* pad */) {
+    // destroys this
+    TabletSeat::remove(seat_->pads_, this);
+}
+
+const struct zwp_tablet_pad_v2_listener TabletPad::listener_ = {
+        .group = listener_thunk<&TabletPad::handle_group>,
+        .path = listener_thunk<&TabletPad::handle_path>,
+        .buttons = listener_thunk<&TabletPad::handle_buttons>,
+        .done = listener_thunk<&TabletPad::handle_done>,
+        .button = listener_thunk<&TabletPad::handle_button>,
+        .enter = listener_thunk<&TabletPad::handle_enter>,
+        .leave = listener_thunk<&TabletPad::handle_leave>,
+        .removed = listener_thunk<&TabletPad::handle_removed>,
+};
+
+TabletPad::Group::Group(TabletPad *pad, struct zwp_tablet_pad_group_v2 *group, uint32_t index) :
+        pad_(pad),
+        group_(group),
+        index_(index) {
+    zwp_tablet_pad_group_v2_add_listener(group_, &listener_, this);
+}
+
+TabletPad::Group::~Group() {
+    rings_.clear();
+    strips_.clear();
+    zwp_tablet_pad_group_v2_destroy(group_);
+}
+
+/**
+ * @brief Stamps a ring or strip frame with the group and its mode and delivers it.
+ */
+void TabletPad::Group::emit(TabletPadEvent &event) {
+    event.group = index_;
+    event.mode = mode_;
+    pad_->emit(event);
+}
+
+void TabletPad::Group::handle_buttons(struct zwp_tablet_pad_group_v2 * /* group */, struct wl_array * /* buttons */) {
+}
+
+void TabletPad::Group::handle_ring(struct zwp_tablet_pad_group_v2 * /* group */, struct zwp_tablet_pad_ring_v2 *ring) {
+    rings_.push_back(std::make_unique<Ring>(this, ring, static_cast<uint32_t>(rings_.size())));
+}
+
+void TabletPad::Group::handle_strip(struct zwp_tablet_pad_group_v2 * /* group */,
+                                    struct zwp_tablet_pad_strip_v2 *strip) {
+    strips_.push_back(std::make_unique<Strip>(this, strip, static_cast<uint32_t>(strips_.size())));
+}
+
+void TabletPad::Group::handle_modes(struct zwp_tablet_pad_group_v2 * /* group */, uint32_t /* modes */) {
+}
+
+void TabletPad::Group::handle_done(struct zwp_tablet_pad_group_v2 * /* group */) {
+}
+
+void TabletPad::Group::handle_mode_switch(struct zwp_tablet_pad_group_v2 * /* group */, uint32_t time,
+                                          uint32_t /* serial */, uint32_t mode) {
+    mode_ = mode;
+    TabletPadEvent event{.type = TabletPadEvent::MODE, .time_ns = InputTimestamps::from_ms(time), .group = 0,
+                         .index = 0, .state = 0, .value = 0, .stopped = false, .source = 0, .mode = 0};
+    emit(event);
+}
+
+const struct zwp_tablet_pad_group_v2_listener TabletPad::Group::listener_ = {
+        .buttons = listener_thunk<&TabletPad::Group::handle_buttons>,
+        .ring = listener_thunk<&TabletPad::Group::handle_ring>,
+        .strip = listener_thunk<&TabletPad::Group::handle_strip>,
+        .modes = listener_thunk<&TabletPad::Group::handle_modes>,
+        .done = listener_thunk<&TabletPad::Group::handle_done>,
+        .mode_switch = listener_thunk<&TabletPad::Group::handle_mode_switch>,
+};
+
+TabletPad::Ring::Ring(Group *group, struct zwp_tablet_pad_ring_v2 *ring, uint32_t index) :
+        group_(group),
+        ring_(ring),
+        event_{.type = TabletPadEvent::RING, .time_ns = 0, .group = 0, .index = index, .state = 0, .value = 0,
+               .stopped = false, .source = 0, .mode = 0} {
+    zwp_tablet_pad_ring_v2_add_listener(ring_, &listener_, this);
+}
+
+TabletPad::Ring::~Ring() {
+    zwp_tablet_pad_ring_v2_destroy(ring_);
+}
+
+void TabletPad::Ring::handle_source(struct zwp_tablet_pad_ring_v2 * /* ring */, uint32_t source) {
+    event_.source = source;
+}
+
+void TabletPad::Ring::handle_angle(struct zwp_tablet_pad_ring_v2 * /* ring */, wl_fixed_t degrees) {
+    event_.value = wl_fixed_to_double(degrees);
+}
+
+void TabletPad::Ring::handle_stop(struct zwp_tablet_pad_ring_v2 * /* ring */) {
+    event_.stopped = true;
+}
+
+void TabletPad::Ring::handle_frame(struct zwp_tablet_pad_ring_v2 * /* ring */, uint32_t time) {
+    event_.time_ns = InputTimestamps::from_ms(time);
+    group_->emit(event_);
+    // source is only sent when the interaction starts
+    if (event_.stopped) {
+        event_.source = 0;
+    }
+    event_.stopped = false;
+}
+
+const struct zwp_tablet_pad_ring_v2_listener TabletPad::Ring::listener_ = {
+        .source = listener_thunk<&TabletPad::Ring::handle_source>,
+        .angle = listener_thunk<&TabletPad::Ring::handle_angle>,
+        .stop = listener_thunk<&TabletPad::Ring::handle_stop>,
+        .frame = listener_thunk<&TabletPad::Ring::handle_frame>,
+};
+
+TabletPad::Strip::Strip(Group *group, struct zwp_tablet_pad_strip_v2 *strip, uint32_t index) :
+        group_(group),
+        strip_(strip),
+        event_{.type = TabletPadEvent::STRIP, .time_ns = 0, .group = 0, .index = index, .state = 0, .value = 0,
+               .stopped = false, .source = 0, .mode = 0} {
+    zwp_tablet_pad_strip_v2_add_listener(strip_, &listener_, this);
+}
+
+TabletPad::Strip::~Strip() {
+    zwp_tablet_pad_strip_v2_destroy(strip_);
+}
+
+void TabletPad::Strip::handle_source(struct zwp_tablet_pad_strip_v2 * /* strip */, uint32_t source) {
+    event_.source = source;
+}
+
+void TabletPad::Strip::handle_position(struct zwp_tablet_pad_strip_v2 * /* strip */, uint32_t position) {
+    event_.value = position / kAxisMax;
+}
+
+void TabletPad::Strip::handle_stop(struct zwp_tablet_pad_strip_v2 * /* strip */) {
+    event_.stopped = true;
+}
+
+void TabletPad::Strip::handle_frame(struct zwp_tablet_pad_strip_v2 * /* strip */, uint32_t time) {
+    event_.time_ns = InputTimestamps::from_ms(time);
+    group_->emit(event_);
+    if (event_.stopped) {
+        event_.source = 0;
+    }
+    event_.stopped = false;
+}
+
+const struct zwp_tablet_pad_strip_v2_listener TabletPad::Strip::listener_ = {
+        .source = listener_thunk<&TabletPad::Strip::handle_source>,
+        .position = listener_thunk<&TabletPad::Strip::handle_position>,
+        .stop = listener_thunk<&TabletPad::Strip::handle_stop>,
+        .frame = listener_thunk<&TabletPad::Strip::handle_frame>,
+};
+
+/**
+ * @class TabletSeat
+ * @brief The zwp_tablet_seat_v2 of a seat, owner of its tablets, tools and pads.
+ */
+TabletSeat::TabletSeat(struct zwp_tablet_manager_v2 *manager, struct wl_seat *seat) :
+        tablet_seat_(zwp_tablet_manager_v2_get_tablet_seat(manager, seat)) {
+    zwp_tablet_seat_v2_add_listener(tablet_seat_, &listener_, this);
+}
+
+TabletSeat::~TabletSeat() {
+    pads_.clear();
+    tools_.clear();
+    tablets_.clear();
+    zwp_tablet_seat_v2_destroy(tablet_seat_);
+}
+
+/**
+ * @brief Records tool motion for TabletTool::predict_position(), on current and future tools.
+ *
+ * @param enable true to record motion.
+ * @param model The fit extrapolated from.
+ */
+void TabletSeat::enable_prediction(bool enable, MotionPredictor::Model model) {
+    predict_ = enable;
+    predict_model_ = model;
+    for (const auto &tool: tools_) {
+        tool->enable_prediction(enable, model);
+    }
+}
+
+template<typename T>
+void TabletSeat::remove(std::vector<std::unique_ptr<T>> &devices, const T *device) {
+    devices.erase(std::remove_if(devices.begin(), devices.end(),
+                                 [device](const std::unique_ptr<T> &d) { return d.get() == device; }),
+                  devices.end());
+}
+
+void TabletSeat::handle_tablet_added(struct zwp_tablet_seat_v2 * /* seat */, struct zwp_tablet_v2 *tablet) {
+    tablets_.push_back(std::make_unique<Tablet>(this, tablet));
+}
+
+void TabletSeat::handle_tool_added(struct zwp_tablet_seat_v2 * /* seat */, struct zwp_tablet_tool_v2 *tool) {
+    tools_.push_back(std::make_unique<TabletTool>(this, tool));
+    if (predict_) {
+        tools_.back()->enable_prediction(true, predict_model_);
+    }
+}
+
+void TabletSeat::handle_pad_added(struct zwp_tablet_seat_v2 * /* seat */, struct zwp_tablet_pad_v2 *pad) {
+    pads_.push_back(std::make_unique<TabletPad>(this, pad));
+}
+
+const struct zwp_tablet_seat_v2_listener TabletSeat::listener_ = {
+        .tablet_added = listener_thunk<&TabletSeat::handle_tablet_added>,
+        .tool_added = listener_thunk<&TabletSeat::handle_tool_added>,
+        .pad_added = listener_thunk<&TabletSeat::handle_pad_added>,
+};
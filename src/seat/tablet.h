@@ -0,0 +1,410 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_TABLET_H_
+#define SRC_SEAT_TABLET_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "tablet-unstable-v2-client-protocol.h"
+
+#include "motion_predictor.h"
+#include "utils/export.h"
+
+class TabletSeat;
+
+/**
+ * @brief The state of a tablet tool after one zwp_tablet_tool_v2.frame.
+ *
+ * Axis values persist across frames, mask tells which of them the frame changed.
+ */
+struct TabletToolEvent {
+    typedef enum {
+        PROXIMITY_IN = 1 << 0,
+        PROXIMITY_OUT = 1 << 1,
+        DOWN = 1 << 2,
+        UP = 1 << 3,
+        MOTION = 1 << 4,
+        PRESSURE = 1 << 5,
+        DISTANCE = 1 << 6,
+        TILT = 1 << 7,
+        ROTATION = 1 << 8,
+        SLIDER = 1 << 9,
+        WHEEL = 1 << 10,
+        BUTTON = 1 << 11,
+    } Mask;
+
+    // the Mask bits of the fields below that were set in this frame
+    uint32_t mask{};
+    // CLOCK_MONOTONIC time of the frame in nanoseconds
+    uint64_t time_ns{};
+    // serial of the latest proximity_in, down or button
+    uint32_t serial{};
+    // surface the tool is in proximity of, nullptr after proximity_out
+    struct wl_surface *surface{};
+    // the tip touches the tablet
+    bool down{};
+    // surface local coordinates
+    double x{};
+    double y{};
+    // 0 to 1
+    double pressure{};
+    double distance{};
+    // degrees
+    double tilt_x{};
+    double tilt_y{};
+    double rotation{};
+    // -1 to 1
+    double slider{};
+    // summed over the frame
+    double wheel_degrees{};
+    int32_t wheel_clicks{};
+    // the latest button of the frame
+    uint32_t button{};
+    uint32_t button_state{};
+};
+
+/**
+ * @brief One zwp_tablet_pad_v2 button press, or one frame of a ring, strip or mode switch.
+ */
+struct TabletPadEvent {
+    typedef enum {
+        BUTTON,
+        RING,
+        STRIP,
+        MODE,
+    } Type;
+
+    Type type;
+    uint64_t time_ns;
+    // index of the pad group, for RING, STRIP and MODE
+    uint32_t group;
+    // button number, or ring or strip index in the group
+    uint32_t index;
+    // zwp_tablet_pad_v2_button_state for BUTTON
+    uint32_t state;
+    // ring angle in degrees, or strip position from 0 to 1
+    double value;
+    // the finger left the ring or strip
+    bool stopped;
+    // zwp_tablet_pad_ring_v2_source or zwp_tablet_pad_strip_v2_source, 0 if unknown
+    uint32_t source;
+    // the group's mode
+    uint32_t mode;
+};
+
+class WAYPP_EXPORT TabletTool {
+public:
+    TabletTool(TabletSeat *seat, struct zwp_tablet_tool_v2 *tool);
+
+    ~TabletTool();
+
+    TabletTool(const TabletTool &) = delete;
+
+    TabletTool &operator=(const TabletTool &) = delete;
+
+    // zwp_tablet_tool_v2_type
+    [[nodiscard]] uint32_t get_type() const { return type_; }
+
+    [[nodiscard]] uint64_t get_hardware_serial() const { return hardware_serial_; }
+
+    [[nodiscard]] bool has_capability(uint32_t capability) const { return capabilities_ & (1u << capability); }
+
+    [[nodiscard]] const TabletToolEvent &get_state() const { return event_; }
+
+    void enable_prediction(bool enable, MotionPredictor::Model model = MotionPredictor::LINEAR);
+
+    bool predict_position(uint64_t target_ns, double &x, double &y) const;
+
+private:
+    TabletSeat *seat_;
+    struct zwp_tablet_tool_v2 *tool_;
+    uint32_t type_{};
+    uint64_t hardware_serial_{};
+    // bits of zwp_tablet_tool_v2_capability
+    uint32_t capabilities_{};
+    TabletToolEvent event_;
+    bool predict_{};
+    MotionPredictor predictor_;
+
+    void handle_type(struct zwp_tablet_tool_v2 *tool, uint32_t tool_type);
+
+    void handle_hardware_serial(struct zwp_tablet_tool_v2 *tool, uint32_t hi, uint32_t lo);
+
+    void handle_hardware_id_wacom(struct zwp_tablet_tool_v2 *tool, uint32_t hi, uint32_t lo);
+
+    void handle_capability(struct zwp_tablet_tool_v2 *tool, uint32_t capability);
+
+    void handle_done(struct zwp_tablet_tool_v2 *tool);
+
+    void handle_removed(struct zwp_tablet_tool_v2 *tool);
+
+    void handle_proximity_in(struct zwp_tablet_tool_v2 *tool, uint32_t serial, struct zwp_tablet_v2 *tablet,
+                             struct wl_surface *surface);
+
+    void handle_proximity_out(struct zwp_tablet_tool_v2 *tool);
+
+    void handle_down(struct zwp_tablet_tool_v2 *tool, uint32_t serial);
+
+    void handle_up(struct zwp_tablet_tool_v2 *tool);
+
+    void handle_motion(struct zwp_tablet_tool_v2 *tool, wl_fixed_t x, wl_fixed_t y);
+
+    void handle_pressure(struct zwp_tablet_tool_v2 *tool, uint32_t pressure);
+
+    void handle_distance(struct zwp_tablet_tool_v2 *tool, uint32_t distance);
+
+    void handle_tilt(struct zwp_tablet_tool_v2 *tool, wl_fixed_t tilt_x, wl_fixed_t tilt_y);
+
+    void handle_rotation(struct zwp_tablet_tool_v2 *tool, wl_fixed_t degrees);
+
+    void handle_slider(struct zwp_tablet_tool_v2 *tool, int32_t position);
+
+    void handle_wheel(struct zwp_tablet_tool_v2 *tool, wl_fixed_t degrees, int32_t clicks);
+
+    void handle_button(struct zwp_tablet_tool_v2 *tool, uint32_t serial, uint32_t button, uint32_t state);
+
+    void handle_frame(struct zwp_tablet_tool_v2 *tool, uint32_t time);
+
+    static const struct zwp_tablet_tool_v2_listener listener_;
+};
+
+class WAYPP_EXPORT Tablet {
+public:
+    Tablet(TabletSeat *seat, struct zwp_tablet_v2 *tablet);
+
+    ~Tablet();
+
+    Tablet(const Tablet &) = delete;
+
+    Tablet &operator=(const Tablet &) = delete;
+
+    [[nodiscard]] const std::string &get_name() const { return name_; }
+
+    [[nodiscard]] uint32_t get_vendor_id() const { return vid_; }
+
+    [[nodiscard]] uint32_t get_product_id() const { return pid_; }
+
+    [[nodiscard]] const std::string &get_path() const { return path_; }
+
+private:
+    TabletSeat *seat_;
+    struct zwp_tablet_v2 *tablet_;
+    std::string name_;
+    uint32_t vid_{};
+    uint32_t pid_{};
+    std::string path_;
+
+    void handle_name(struct zwp_tablet_v2 *tablet, const char *name);
+
+    void handle_id(struct zwp_tablet_v2 *tablet, uint32_t vid, uint32_t pid);
+
+    void handle_path(struct zwp_tablet_v2 *tablet, const char *path);
+
+    void handle_done(struct zwp_tablet_v2 *tablet);
+
+    void handle_removed(struct zwp_tablet_v2 *tablet);
+
+    static const struct zwp_tablet_v2_listener listener_;
+};
+
+class WAYPP_EXPORT TabletPad {
+public:
+    TabletPad(TabletSeat *seat, struct zwp_tablet_pad_v2 *pad);
+
+    ~TabletPad();
+
+    TabletPad(const TabletPad &) = delete;
+
+    TabletPad &operator=(const TabletPad &) = delete;
+
+    [[nodiscard]] uint32_t get_button_count() const { return buttons_; }
+
+    [[nodiscard]] struct wl_surface *get_focus() const { return focus_; }
+
+private:
+    class Group;
+
+    // a ring or strip, accumulated per frame
+    class Ring {
+    public:
+        Ring(Group *group, struct zwp_tablet_pad_ring_v2 *ring, uint32_t index);
+
+        ~Ring();
+
+    private:
+        Group *group_;
+        struct zwp_tablet_pad_ring_v2 *ring_;
+        TabletPadEvent event_;
+
+        void handle_source(struct zwp_tablet_pad_ring_v2 *ring, uint32_t source);
+
+        void handle_angle(struct zwp_tablet_pad_ring_v2 *ring, wl_fixed_t degrees);
+
+        void handle_stop(struct zwp_tablet_pad_ring_v2 *ring);
+
+        void handle_frame(struct zwp_tablet_pad_ring_v2 *ring, uint32_t time);
+
+        static const struct zwp_tablet_pad_ring_v2_listener listener_;
+    };
+
+    class Strip {
+    public:
+        Strip(Group *group, struct zwp_tablet_pad_strip_v2 *strip, uint32_t index);
+
+        ~Strip();
+
+    private:
+        Group *group_;
+        struct zwp_tablet_pad_strip_v2 *strip_;
+        TabletPadEvent event_;
+
+        void handle_source(struct zwp_tablet_pad_strip_v2 *strip, uint32_t source);
+
+        void handle_position(struct zwp_tablet_pad_strip_v2 *strip, uint32_t position);
+
+        void handle_stop(struct zwp_tablet_pad_strip_v2 *strip);
+
+        void handle_frame(struct zwp_tablet_pad_strip_v2 *strip, uint32_t time);
+
+        static const struct zwp_tablet_pad_strip_v2_listener listener_;
+    };
+
+    class Group {
+    public:
+        Group(TabletPad *pad, struct zwp_tablet_pad_group_v2 *group, uint32_t index);
+
+        ~Group();
+
+        void emit(TabletPadEvent &event);
+
+    private:
+        TabletPad *pad_;
+        struct zwp_tablet_pad_group_v2 *group_;
+        uint32_t index_;
+        uint32_t mode_{};
+        std::vector<std::unique_ptr<Ring>> rings_;
+        std::vector<std::unique_ptr<Strip>> strips_;
+
+        void handle_buttons(struct zwp_tablet_pad_group_v2 *group, struct wl_array *buttons);
+
+        void handle_ring(struct zwp_tablet_pad_group_v2 *group, struct zwp_tablet_pad_ring_v2 *ring);
+
+        void handle_strip(struct zwp_tablet_pad_group_v2 *group, struct zwp_tablet_pad_strip_v2 *strip);
+
+        void handle_modes(struct zwp_tablet_pad_group_v2 *group, uint32_t modes);
+
+        void handle_done(struct zwp_tablet_pad_group_v2 *group);
+
+        void handle_mode_switch(struct zwp_tablet_pad_group_v2 *group, uint32_t time, uint32_t serial,
+                                uint32_t mode);
+
+        static const struct zwp_tablet_pad_group_v2_listener listener_;
+    };
+
+    TabletSeat *seat_;
+    struct zwp_tablet_pad_v2 *pad_;
+    uint32_t buttons_{};
+    struct wl_surface *focus_{};
+    std::vector<std::unique_ptr<Group>> groups_;
+
+    void emit(const TabletPadEvent &event) const;
+
+    void handle_group(struct zwp_tablet_pad_v2 *pad, struct zwp_tablet_pad_group_v2 *group);
+
+    void handle_path(struct zwp_tablet_pad_v2 *pad, const char *path);
+
+    void handle_buttons(struct zwp_tablet_pad_v2 *pad, uint32_t buttons);
+
+    void handle_done(struct zwp_tablet_pad_v2 *pad);
+
+    void handle_button(struct zwp_tablet_pad_v2 *pad, uint32_t time, uint32_t button, uint32_t state);
+
+    void handle_enter(struct zwp_tablet_pad_v2 *pad, uint32_t serial, struct zwp_tablet_v2 *tablet,
+                      struct wl_surface *surface);
+
+    void handle_leave(struct zwp_tablet_pad_v2 *pad, uint32_t serial, struct wl_surface *surface);
+
+    void handle_removed(struct zwp_tablet_pad_v2 *pad);
+
+    static const struct zwp_tablet_pad_v2_listener listener_;
+};
+
+class WAYPP_EXPORT TabletSeat {
+public:
+    TabletSeat(struct zwp_tablet_manager_v2 *manager, struct wl_seat *seat);
+
+    ~TabletSeat();
+
+    TabletSeat(const TabletSeat &) = delete;
+
+    TabletSeat &operator=(const TabletSeat &) = delete;
+
+    void set_trace_track(const std::string &track) { trace_track_ = track; }
+
+    void set_tool_callback(const std::function<void(const TabletTool &tool, const TabletToolEvent &event)> &callback) {
+        tool_callback_ = callback;
+    }
+
+    void set_pad_callback(const std::function<void(const TabletPad &pad, const TabletPadEvent &event)> &callback) {
+        pad_callback_ = callback;
+    }
+
+    void enable_prediction(bool enable, MotionPredictor::Model model = MotionPredictor::LINEAR);
+
+    [[nodiscard]] const std::vector<std::unique_ptr<Tablet>> &get_tablets() const { return tablets_; }
+
+    [[nodiscard]] const std::vector<std::unique_ptr<TabletTool>> &get_tools() const { return tools_; }
+
+    [[nodiscard]] const std::vector<std::unique_ptr<TabletPad>> &get_pads() const { return pads_; }
+
+    friend class TabletTool;
+
+    friend class Tablet;
+
+    friend class TabletPad;
+
+private:
+    struct zwp_tablet_seat_v2 *tablet_seat_;
+    std::string trace_track_;
+    std::function<void(const TabletTool &tool, const TabletToolEvent &event)> tool_callback_;
+    std::function<void(const TabletPad &pad, const TabletPadEvent &event)> pad_callback_;
+    bool predict_{};
+    MotionPredictor::Model predict_model_{MotionPredictor::LINEAR};
+    std::vector<std::unique_ptr<Tablet>> tablets_;
+    std::vector<std::unique_ptr<TabletTool>> tools_;
+    std::vector<std::unique_ptr<TabletPad>> pads_;
+
+    template<typename T>
+    static void remove(std::vector<std::unique_ptr<T>> &devices, const T *device);
+
+    void handle_tablet_added(struct zwp_tablet_seat_v2 *seat, struct zwp_tablet_v2 *tablet);
+
+    void handle_tool_added(struct zwp_tablet_seat_v2 *seat, struct zwp_tablet_tool_v2 *tool);
+
+    void handle_pad_added(struct zwp_tablet_seat_v2 *seat, struct zwp_tablet_pad_v2 *pad);
+
+    static const struct zwp_tablet_seat_v2_listener listener_;
+};
+
+#endif // SRC_SEAT_TABLET_H_
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "text_input.h"
+
+#include <algorithm>
+
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+namespace {
+// set_surrounding_text must fit a wayland message
+constexpr size_t kMaxSurroundingBytes = 4000;
+
+bool is_continuation(char c) {
+    return (static_cast<unsigned char>(c) & 0xc0) == 0x80;
+}
+}
+
+/**
+ * @class TextInput
+ * @brief zwp_text_input_v3 of a seat, the link to the compositor's input method.
+ *
+ * Both directions are batched. The input method's preedit, commit and delete
+ * events are collected until done and handed to the callback as one
+ * TextInputEvent, so a renderer lays the text out once per change. The client
+ * state set between two commit() calls is sent once, and only the parts that
+ * changed since the last commit.
+ */
+TextInput::TextInput(struct zwp_text_input_manager_v3 *manager, struct wl_seat *seat) :
+        text_input_(zwp_text_input_manager_v3_get_text_input(manager, seat)) {
+    zwp_text_input_v3_add_listener(text_input_, &listener_, this);
+    reset_pending();
+}
+
+TextInput::~TextInput() {
+    zwp_text_input_v3_destroy(text_input_);
+}
+
+/**
+ * @brief Requests input method support for the focused surface from the next commit() on.
+ *
+ * Resets the state on the compositor side, commit() sends all of it again.
+ */
+void TextInput::enable() {
+    state_.enabled = true;
+    enable_pending_ = true;
+    disable_pending_ = false;
+}
+
+/**
+ * @brief Ends input method support with the next commit().
+ */
+void TextInput::disable() {
+    state_.enabled = false;
+    disable_pending_ = true;
+    enable_pending_ = false;
+}
+
+/**
+ * @brief Sets the text around the cursor, sent on the next commit() if it changed.
+ *
+ * Text longer than a wayland message allows is trimmed to a window around the
+ * cursor, on UTF-8 character boundaries.
+ *
+ * @param text The paragraph containing the cursor, UTF-8.
+ * @param cursor Byte offset of the cursor in text.
+ * @param anchor Byte offset of the other end of the selection, cursor if there is none.
+ * @param cause A zwp_text_input_v3_change_cause, input_method when applying a TextInputEvent.
+ */
+void TextInput::set_surrounding_text(const std::string &text, int32_t cursor, int32_t anchor, uint32_t cause) {
+    state_.cause = cause;
+    if (text.size() < kMaxSurroundingBytes) {
+        state_.surrounding_text = text;
+        state_.cursor = cursor;
+        state_.anchor = anchor;
+        return;
+    }
+    const auto length = static_cast<int32_t>(text.size());
+    const auto window = static_cast<int32_t>(kMaxSurroundingBytes - 1);
+    int32_t begin = std::clamp(cursor - window / 2, 0, length - window);
+    int32_t end = begin + window;
+    while (begin < length && is_continuation(text[static_cast<size_t>(begin)])) {
+        ++begin;
+    }
+    while (end > begin && end < length && is_continuation(text[static_cast<size_t>(end)])) {
+        --end;
+    }
+    state_.surrounding_text = text.substr(static_cast<size_t>(begin), static_cast<size_t>(end - begin));
+    state_.cursor = std::clamp(cursor - begin, 0, end - begin);
+    state_.anchor = std::clamp(anchor - begin, 0, end - begin);
+}
+
+/**
+ * @brief Sets the content hint and purpose, sent on the next commit() if they changed.
+ */
+void TextInput::set_content_type(uint32_t hint, uint32_t purpose) {
+    state_.hint = hint;
+    state_.purpose = purpose;
+}
+
+/**
+ * @brief Sets where the input method may place its popup, in surface local coordinates.
+ */
+void TextInput::set_cursor_rectangle(int32_t x, int32_t y, int32_t width, int32_t height) {
+    state_.x = x;
+    state_.y = y;
+    state_.width = width;
+    state_.height = height;
+}
+
+/**
+ * @brief Sends the client state changed since the last commit and commits it.
+ */
+void TextInput::commit() {
+    // enable and disable reset the compositor side state
+    const bool resend = enable_pending_;
+    if (enable_pending_) {
+        zwp_text_input_v3_enable(text_input_);
+        enable_pending_ = false;
+    } else if (disable_pending_) {
+        zwp_text_input_v3_disable(text_input_);
+        disable_pending_ = false;
+        sent_ = state_;
+    }
+    if (state_.enabled) {
+        if (resend || state_.surrounding_text != sent_.surrounding_text || state_.cursor != sent_.cursor ||
+            state_.anchor != sent_.anchor) {
+            zwp_text_input_v3_set_surrounding_text(text_input_, state_.surrounding_text.c_str(), state_.cursor,
+                                                   state_.anchor);
+            zwp_text_input_v3_set_text_change_cause(text_input_, state_.cause);
+        }
+        if (resend || state_.hint != sent_.hint || state_.purpose != sent_.purpose) {
+            zwp_text_input_v3_set_content_type(text_input_, state_.hint, state_.purpose);
+        }
+        if (resend || state_.x != sent_.x || state_.y != sent_.y || state_.width != sent_.width ||
+            state_.height != sent_.height) {
+            zwp_text_input_v3_set_cursor_rectangle(text_input_, state_.x, state_.y, state_.width, state_.height);
+        }
+        sent_ = state_;
+    }
+    zwp_text_input_v3_commit(text_input_);
+    ++commit_count_;
+}
+
+void TextInput::reset_pending() {
+    pending_.delete_before = 0;
+    pending_.delete_after = 0;
+    pending_.commit.clear();
+    pending_.preedit.clear();
+    pending_.preedit_cursor_begin = 0;
+    pending_.preedit_cursor_end = 0;
+}
+
+void TextInput::handle_enter(struct zwp_text_input_v3 * /* text_input */, struct wl_surface *surface) {
+    LOG_DEBUG("TextInput: enter");
+    focus_ = surface;
+}
+
+void TextInput::handle_leave(struct zwp_text_input_v3 * /* text_input */, struct wl_surface * /* surface */) {
+    LOG_DEBUG("TextInput: leave");
+    focus_ = nullptr;
+    reset_pending();
+}
+
+void TextInput::handle_preedit_string(struct zwp_text_input_v3 * /* text_input */,
+                                      const char *text,
+                                      int32_t cursor_begin,
+                                      int32_t cursor_end) {
+    pending_.preedit = text ? text : "";
+    pending_.preedit_cursor_begin = cursor_begin;
+    pending_.preedit_cursor_end = cursor_end;
+}
+
+void TextInput::handle_commit_string(struct zwp_text_input_v3 * /* text_input */, const char *text) {
+    pending_.commit = text ? text : "";
+}
+
+void TextInput::handle_delete_surrounding_text(struct zwp_text_input_v3 * /* text_input */,
+                                               uint32_t before_length,
+                                               uint32_t after_length) {
+    pending_.delete_before = before_length;
+    pending_.delete_after = after_length;
+}
+
+/**
+ * @brief Hands the changes collected since the previous done to the callback.
+ */
+void TextInput::handle_done(struct zwp_text_input_v3 * /* text_input */, uint32_t serial) {
+    pending_.serial = serial;
+    pending_.current = serial == commit_count_;
+    if (callback_) {
+        callback_(pending_);
+    }
+    reset_pending();
+}
+
+const struct zwp_text_input_v3_listener TextInput::listener_ = {
+        .enter = listener_thunk<&TextInput::handle_enter>,
+        .leave = listener_thunk<&TextInput::handle_leave>,
+        .preedit_string = listener_thunk<&TextInput::handle_preedit_string>,
+        .commit_string = listener_thunk<&TextInput::handle_commit_string>,
+        .delete_surrounding_text = listener_thunk<&TextInput::handle_delete_surrounding_text>,
+        .done = listener_thunk<&TextInput::handle_done>,
+};
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_SEAT_TEXT_INPUT_H_
+#define SRC_SEAT_TEXT_INPUT_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <wayland-client.h>
+
+#include "text-input-unstable-v3-client-protocol.h"
+#include "utils/export.h"
+
+/**
+ * @brief The input method changes applied by one zwp_text_input_v3.done.
+ *
+ * Apply in the order delete_surrounding, commit, preedit, like the protocol does.
+ */
+struct TextInputEvent {
+    uint32_t serial;
+    // false if the compositor had not seen the latest commit() yet
+    bool current;
+    // bytes around the cursor to delete, zero if none
+    uint32_t delete_before;
+    uint32_t delete_after;
+    // text to insert at the cursor, empty if none
+    std::string commit;
+    // replaces the previous preedit, empty clears it
+    std::string preedit;
+    // byte offsets into preedit, -1 for both hides the cursor
+    int32_t preedit_cursor_begin;
+    int32_t preedit_cursor_end;
+};
+
+class WAYPP_EXPORT TextInput {
+public:
+    explicit TextInput(struct zwp_text_input_manager_v3 *manager, struct wl_seat *seat);
+
+    ~TextInput();
+
+    TextInput(const TextInput &) = delete;
+
+    TextInput &operator=(const TextInput &) = delete;
+
+    void set_callback(const std::function<void(const TextInputEvent &event)> &callback) { callback_ = callback; }
+
+    [[nodiscard]] struct wl_surface *get_focus() const { return focus_; }
+
+    void enable();
+
+    void disable();
+
+    void set_surrounding_text(const std::string &text, int32_t cursor, int32_t anchor,
+                              uint32_t cause = ZWP_TEXT_INPUT_V3_CHANGE_CAUSE_OTHER);
+
+    void set_content_type(uint32_t hint, uint32_t purpose);
+
+    void set_cursor_rectangle(int32_t x, int32_t y, int32_t width, int32_t height);
+
+    void commit();
+
+private:
+    struct zwp_text_input_v3 *text_input_;
+    struct wl_surface *focus_{};
+    std::function<void(const TextInputEvent &event)> callback_;
+    // commit() calls so far, matched against the serial of done
+    uint32_t commit_count_{};
+
+    // client state, sent on the next commit() if it changed
+    struct {
+        bool enabled;
+        std::string surrounding_text;
+        int32_t cursor;
+        int32_t anchor;
+        uint32_t cause;
+        uint32_t hint;
+        uint32_t purpose;
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    } state_{}, sent_{};
+    bool enable_pending_{};
+    bool disable_pending_{};
+
+    // server state, accumulated until done
+    TextInputEvent pending_{};
+
+    void reset_pending();
+
+    void handle_enter(struct zwp_text_input_v3 *text_input, struct wl_surface *surface);
+
+    void handle_leave(struct zwp_text_input_v3 *text_input, struct wl_surface *surface);
+
+    void handle_preedit_string(struct zwp_text_input_v3 *text_input, const char *text, int32_t cursor_begin,
+                               int32_t cursor_end);
+
+    void handle_commit_string(struct zwp_text_input_v3 *text_input, const char *text);
+
+    void handle_delete_surrounding_text(struct zwp_text_input_v3 *text_input, uint32_t before_length,
+                                        uint32_t after_length);
+
+    void handle_done(struct zwp_text_input_v3 *text_input, uint32_t serial);
+
+    static const struct zwp_text_input_v3_listener listener_;
+};
+
+#endif // SRC_SEAT_TEXT_INPUT_H_
@@ -16,7 +16,8 @@
 
 #include "touch.h"
 
-#include <iostream>
+#include "utils/logging.h"
+#include "utils/trace.h"
 
 /**
  * @class Touch
@@ -30,11 +31,116 @@ Touch::Touch(struct wl_touch *touch) : touch_(touch) {
 /**
  * @brief Destructor for the Touch class.
  *
- * This destructor releases and destroys the `wl_touch` object associated with the Touch instance.
+ * This destructor releases the `wl_touch` object associated with the Touch instance, or destroys it on seats older than
+ * version 3.
  */
 Touch::~Touch() {
-    wl_touch_release(touch_);
-    wl_touch_destroy(touch_);
+    if (wl_touch_get_version(touch_) >= WL_TOUCH_RELEASE_SINCE_VERSION) {
+        wl_touch_release(touch_);
+    } else {
+        wl_touch_destroy(touch_);
+    }
+}
+
+/**
+ * @brief Receives precise timestamps for the events of this touch.
+ *
+ * @param manager The compositor's zwp_input_timestamps_manager_v1.
+ */
+void Touch::enable_timestamps(struct zwp_input_timestamps_manager_v1 *manager) {
+    timestamps_.enable(zwp_input_timestamps_manager_v1_get_touch_timestamps(manager, touch_));
+}
+
+/**
+ * @brief Fits the recent timestamped motion of every touch point, for predict_position().
+ *
+ * @param enable true to record touch motion.
+ * @param model The fit extrapolated from.
+ */
+void Touch::enable_prediction(bool enable, MotionPredictor::Model model) {
+    predict_ = enable;
+    for (auto &point: points_) {
+        point.predictor.set_model(model);
+        point.predictor.reset();
+    }
+}
+
+/**
+ * @brief Extrapolates where touch point id will be at target_ns.
+ *
+ * @param id The touch point id from the down event.
+ * @param target_ns CLOCK_MONOTONIC nanoseconds, e.g. Window::FrameInput::target_present_ns.
+ * @param x Receives the surface local x coordinate.
+ * @param y Receives the surface local y coordinate.
+ * @return false if prediction is disabled or id is not down.
+ */
+bool Touch::predict_position(int32_t id, uint64_t target_ns, double &x, double &y) const {
+    if (!predict_) {
+        return false;
+    }
+    const auto point = find_point(id);
+    return point && point->predictor.predict(target_ns, x, y);
+}
+
+/**
+ * @return The active touch point id, nullptr if it is not down.
+ */
+Touch::TouchPoint *Touch::find_point(int32_t id) {
+    for (auto &point: points_) {
+        if (point.active && !point.slot.ended && point.slot.id == id) {
+            return &point;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @return The active touch point id, nullptr if it is not down.
+ */
+const Touch::TouchPoint *Touch::find_point(int32_t id) const {
+    return const_cast<Touch *>(this)->find_point(id);
+}
+
+/**
+ * @brief Passes the snapshot of all touch points to the frame callback and starts the next frame.
+ *
+ * Points lifted in this frame are delivered once with ended set, then freed.
+ *
+ * @param cancelled true for wl_touch.cancel, which ends every point without a frame.
+ */
+void Touch::deliver_frame(bool cancelled) {
+    frame_.time_ns = frame_time_ns_;
+    frame_.cancelled = cancelled;
+    frame_.count = 0;
+    for (auto &point: points_) {
+        if (!point.active) {
+            continue;
+        }
+        if (!cancelled) {
+            frame_.slots[frame_.count++] = point.slot;
+        }
+        if (cancelled || point.slot.ended) {
+            point.active = false;
+        }
+        point.slot.began = false;
+        point.slot.moved = false;
+    }
+    if (frame_callback_) {
+        frame_callback_(frame_);
+    }
+}
+
+/**
+ * @brief Passes the time of the event being dispatched to the input callback.
+ *
+ * @return The CLOCK_MONOTONIC time of the event in nanoseconds.
+ */
+uint64_t Touch::report_input(uint32_t time) {
+    const uint64_t time_ns = timestamps_.take(time);
+    if (input_callback_) {
+        input_callback_(time_ns);
+    }
+    return time_ns;
 }
 
 /**
@@ -51,15 +157,47 @@ Touch::~Touch() {
  * @param x_w The X coordinate of the touch point in wl_fixed_t format.
  * @param y_w The Y coordinate of the touch point in wl_fixed_t format.
  */
-void Touch::handle_down(void * /* data */,
+void Touch::handle_down(void *data,
                         struct wl_touch * /* wl_touch */,
                         uint32_t /* serial */,
-                        uint32_t /* time */,
-                        struct wl_surface * /* surface */,
-                        int32_t /* id */,
-                        wl_fixed_t /* x_w */,
-                        wl_fixed_t /* y_w */) {
-    std::cerr << "Touch::handle_down" << std::endl;
+                        uint32_t time,
+                        struct wl_surface *surface,
+                        int32_t id,
+                        wl_fixed_t x_w,
+                        wl_fixed_t y_w) {
+    TRACE_TRACK_SCOPE(static_cast<Touch *>(data)->trace_track_, "Touch::handle_down");
+    LOG_DEBUG("Touch::handle_down");
+    const auto obj = static_cast<Touch *>(data);
+    const uint64_t time_ns = obj->report_input(time);
+    if (obj->input_router_) {
+        obj->input_ring_ = obj->input_router_->find(surface, InputRouter::SOURCE_TOUCH);
+    }
+    obj->push_event({.time_ns = time_ns, .x = x_w, .y = y_w, .code = id, .type = InputEvent::TOUCH_DOWN});
+    obj->frame_time_ns_ = time_ns;
+
+    const double x = wl_fixed_to_double(x_w);
+    const double y = wl_fixed_to_double(y_w);
+    for (auto &point: obj->points_) {
+        if (!point.active) {
+            point.active = true;
+            point.slot = {
+                    .id = id,
+                    .began = true,
+                    .surface = surface,
+                    .x = x,
+                    .y = y,
+                    .start_x = x,
+                    .start_y = y,
+                    .time_ns = time_ns,
+            };
+            if (obj->predict_) {
+                point.predictor.reset();
+                point.predictor.add(time_ns, x, y);
+            }
+            return;
+        }
+    }
+    LOG_WARN("Touch::handle_down: more than %zu touch points, %d ignored", TouchFrame::kMaxSlots, id);
 }
 
 /**
@@ -75,12 +213,22 @@ void Touch::handle_down(void * /* data */,
  *
  * @return None.
  */
-void Touch::handle_up(void * /* data */,
+void Touch::handle_up(void *data,
                       struct wl_touch * /* wl_touch */,
                       uint32_t /* serial */,
-                      uint32_t /* time */,
-                      int32_t /* id */) {
-    std::cerr << "Touch::handle_up" << std::endl;
+                      uint32_t time,
+                      int32_t id) {
+    TRACE_TRACK_SCOPE(static_cast<Touch *>(data)->trace_track_, "Touch::handle_up");
+    LOG_DEBUG("Touch::handle_up");
+    const auto obj = static_cast<Touch *>(data);
+    const uint64_t time_ns = obj->report_input(time);
+    obj->push_event({.time_ns = time_ns, .code = id, .type = InputEvent::TOUCH_UP});
+    obj->frame_time_ns_ = time_ns;
+    if (const auto point = obj->find_point(id)) {
+        // freed once the frame is delivered
+        point->slot.ended = true;
+        point->slot.time_ns = time_ns;
+    }
 }
 
 /**
@@ -98,13 +246,27 @@ void Touch::handle_up(void * /* data */,
  *
  * @return None.
  */
-void Touch::handle_motion(void * /* data */,
+void Touch::handle_motion(void *data,
                           struct wl_touch * /* wl_touch */,
-                          uint32_t /* time */,
-                          int32_t /* id */,
-                          wl_fixed_t /* x_w */,
-                          wl_fixed_t /* y_w */) {
-    std::cerr << "Touch::handle_motion" << std::endl;
+                          uint32_t time,
+                          int32_t id,
+                          wl_fixed_t x_w,
+                          wl_fixed_t y_w) {
+    TRACE_TRACK_SCOPE(static_cast<Touch *>(data)->trace_track_, "Touch::handle_motion");
+    LOG_TRACE("Touch::handle_motion");
+    const auto obj = static_cast<Touch *>(data);
+    const uint64_t time_ns = obj->report_input(time);
+    obj->push_event({.time_ns = time_ns, .x = x_w, .y = y_w, .code = id, .type = InputEvent::TOUCH_MOTION});
+    obj->frame_time_ns_ = time_ns;
+    if (const auto point = obj->find_point(id)) {
+        point->slot.moved = true;
+        point->slot.x = wl_fixed_to_double(x_w);
+        point->slot.y = wl_fixed_to_double(y_w);
+        point->slot.time_ns = time_ns;
+        if (obj->predict_) {
+            point->predictor.add(time_ns, point->slot.x, point->slot.y);
+        }
+    }
 }
 
 /**
@@ -118,8 +280,12 @@ void Touch::handle_motion(void * /* data */,
  *
  * @return void
  */
-void Touch::handle_cancel(void * /* data */, struct wl_touch * /* wl_touch */) {
-    std::cerr << "Touch::handle_cancel" << std::endl;
+void Touch::handle_cancel(void *data, struct wl_touch * /* wl_touch */) {
+    TRACE_TRACK_SCOPE(static_cast<Touch *>(data)->trace_track_, "Touch::handle_cancel");
+    LOG_DEBUG("Touch::handle_cancel");
+    const auto obj = static_cast<Touch *>(data);
+    obj->push_event({.type = InputEvent::TOUCH_CANCEL});
+    obj->deliver_frame(true);
 }
 
 /**
@@ -128,9 +294,43 @@ void Touch::handle_cancel(void * /* data */, struct wl_touch * /* wl_touch */) {
  *
  * It handles touch events from a wl_touch object and provides callback functions for various touch events.
  */
-void Touch::handle_frame(void * /* data */,
+void Touch::handle_frame(void *data,
                          struct wl_touch * /* wl_touch */) {
-    std::cerr << "Touch::handle_frame" << std::endl;
+    TRACE_TRACK_SCOPE(static_cast<Touch *>(data)->trace_track_, "Touch::handle_frame");
+    LOG_TRACE("Touch::handle_frame");
+    const auto obj = static_cast<Touch *>(data);
+    obj->push_event({.type = InputEvent::TOUCH_FRAME});
+    obj->deliver_frame(false);
+}
+
+/**
+ * @brief Handles the size of a touch point's contact area, wl_seat v6 and later.
+ */
+void Touch::handle_shape(void *data,
+                         struct wl_touch * /* wl_touch */,
+                         int32_t id,
+                         wl_fixed_t major,
+                         wl_fixed_t minor) {
+    TRACE_TRACK_SCOPE(static_cast<Touch *>(data)->trace_track_, "Touch::handle_shape");
+    LOG_TRACE("Touch::handle_shape");
+    if (const auto point = static_cast<Touch *>(data)->find_point(id)) {
+        point->slot.major = wl_fixed_to_double(major);
+        point->slot.minor = wl_fixed_to_double(minor);
+    }
+}
+
+/**
+ * @brief Handles the angle of a touch point's contact area, wl_seat v6 and later.
+ */
+void Touch::handle_orientation(void *data,
+                               struct wl_touch * /* wl_touch */,
+                               int32_t id,
+                               wl_fixed_t orientation) {
+    TRACE_TRACK_SCOPE(static_cast<Touch *>(data)->trace_track_, "Touch::handle_orientation");
+    LOG_TRACE("Touch::handle_orientation");
+    if (const auto point = static_cast<Touch *>(data)->find_point(id)) {
+        point->slot.orientation = wl_fixed_to_double(orientation);
+    }
 }
 
 const struct wl_touch_listener Touch::listener_ = {
@@ -139,4 +339,6 @@ const struct wl_touch_listener Touch::listener_ = {
         .motion = handle_motion,
         .frame = handle_frame,
         .cancel = handle_cancel,
+        .shape = handle_shape,
+        .orientation = handle_orientation,
 };
\ No newline at end of file
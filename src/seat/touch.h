@@ -17,18 +17,115 @@
 #ifndef SRC_SEAT_TOUCH_H_
 #define SRC_SEAT_TOUCH_H_
 
+#include <array>
 #include <cstdint>
+#include <functional>
+#include <string>
 
 #include <wayland-client.h>
 
-class Touch {
+#include "input_event.h"
+#include "input_timestamps.h"
+#include "motion_predictor.h"
+#include "utils/export.h"
+
+// one touch point as of the latest wl_touch.frame
+struct TouchSlot {
+    int32_t id;
+    // went down or was lifted in this frame
+    bool began;
+    bool ended;
+    // moved in this frame
+    bool moved;
+    struct wl_surface *surface;
+    // surface local coordinates of the latest position and of the down
+    double x;
+    double y;
+    double start_x;
+    double start_y;
+    // contact ellipse from wl_touch.shape and orientation, 0 if not reported
+    double major;
+    double minor;
+    double orientation;
+    // CLOCK_MONOTONIC time of the latest down, up or motion
+    uint64_t time_ns;
+};
+
+// every touch point that was down during a wl_touch.frame
+struct TouchFrame {
+    static constexpr size_t kMaxSlots = 10;
+
+    // time of the latest event of the frame
+    uint64_t time_ns;
+    // the compositor took the sequence over, e.g. for a global gesture; slots are empty
+    bool cancelled;
+    size_t count;
+    std::array<TouchSlot, kMaxSlots> slots;
+};
+
+class WAYPP_EXPORT Touch {
 public:
     explicit Touch(struct wl_touch *touch);
 
     ~Touch();
 
+    void set_trace_track(const std::string &track) { trace_track_ = track; }
+
+    void enable_timestamps(struct zwp_input_timestamps_manager_v1 *manager);
+
+    void set_input_callback(const std::function<void(uint64_t time_ns)> &callback) { input_callback_ = callback; }
+
+    // device stamps every event pushed, see InputEvent::device
+    void set_input_router(const InputRouter *router, uint8_t device = 0) {
+        input_router_ = router;
+        device_index_ = device;
+    }
+
+    void enable_prediction(bool enable, MotionPredictor::Model model = MotionPredictor::LINEAR);
+
+    bool predict_position(int32_t id, uint64_t target_ns, double &x, double &y) const;
+
+    void set_frame_callback(const std::function<void(const TouchFrame &frame)> &callback) {
+        frame_callback_ = callback;
+    }
+
 private:
     struct wl_touch *touch_;
+    std::string trace_track_;
+    InputTimestamps timestamps_;
+    std::function<void(uint64_t time_ns)> input_callback_;
+    const InputRouter *input_router_{};
+    uint8_t device_index_{};
+    // ring of the window touched by the latest down, the whole touch sequence goes there
+    InputRing *input_ring_{};
+
+    struct TouchPoint {
+        // down, or lifted in the current frame
+        bool active{};
+        TouchSlot slot{};
+        MotionPredictor predictor;
+    };
+    bool predict_{};
+    std::array<TouchPoint, TouchFrame::kMaxSlots> points_;
+    std::function<void(const TouchFrame &frame)> frame_callback_;
+    // built in place on every frame, so delivery does not allocate
+    TouchFrame frame_{};
+    uint64_t frame_time_ns_{};
+
+    [[nodiscard]] TouchPoint *find_point(int32_t id);
+
+    [[nodiscard]] const TouchPoint *find_point(int32_t id) const;
+
+    void deliver_frame(bool cancelled);
+
+    uint64_t report_input(uint32_t time);
+
+    void push_event(InputEvent event) const {
+        if (input_ring_) {
+            event.device = device_index_;
+            (void) input_ring_->push(event);
+        }
+    }
 
     static void handle_down(void *data,
                             struct wl_touch * /* wl_touch */,
@@ -54,6 +151,17 @@ private:
 
     static void handle_cancel(void *data, struct wl_touch * /* wl_touch */);
 
+    static void handle_shape(void *data,
+                             struct wl_touch * /* wl_touch */,
+                             int32_t id,
+                             wl_fixed_t major,
+                             wl_fixed_t minor);
+
+    static void handle_orientation(void *data,
+                                   struct wl_touch * /* wl_touch */,
+                                   int32_t id,
+                                   wl_fixed_t orientation);
+
     static void handle_frame(void * /* data */,
                              struct wl_touch * /* wl_touch */);
 
@@ -0,0 +1,28 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_UTILS_EXPORT_H_
+#define SRC_UTILS_EXPORT_H_
+
+// the shared library is compiled with -fvisibility=hidden, only what carries this is exported
+#if defined(WAYPP_SHARED)
+#define WAYPP_EXPORT __attribute__((visibility("default")))
+#else
+#define WAYPP_EXPORT
+#endif
+
+#endif // SRC_UTILS_EXPORT_H_
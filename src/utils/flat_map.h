@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_UTILS_FLAT_MAP_H_
+#define SRC_UTILS_FLAT_MAP_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief A map kept in one vector, in insertion order, for the handful of entries a display has.
+ *
+ * With a few outputs or seats a linear scan over contiguous pairs beats walking a
+ * std::map's nodes, both for lookups and for the per-event loops over every entry.
+ * The subset of std::map used by Display is provided, so iteration with structured
+ * bindings and find()->second read the same. Inserting or erasing invalidates
+ * iterators; keep values behind std::unique_ptr for addresses that stay put.
+ *
+ * @tparam K The key, compared with ==.
+ * @tparam V The value.
+ */
+template<typename K, typename V>
+class FlatMap {
+public:
+    using value_type = std::pair<K, V>;
+    using iterator = typename std::vector<value_type>::iterator;
+    using const_iterator = typename std::vector<value_type>::const_iterator;
+
+    [[nodiscard]] iterator begin() { return entries_.begin(); }
+
+    [[nodiscard]] iterator end() { return entries_.end(); }
+
+    [[nodiscard]] const_iterator begin() const { return entries_.begin(); }
+
+    [[nodiscard]] const_iterator end() const { return entries_.end(); }
+
+    [[nodiscard]] bool empty() const { return entries_.empty(); }
+
+    [[nodiscard]] size_t size() const { return entries_.size(); }
+
+    [[nodiscard]] iterator find(const K &key) {
+        return std::find_if(entries_.begin(), entries_.end(),
+                            [&key](const value_type &entry) { return entry.first == key; });
+    }
+
+    [[nodiscard]] const_iterator find(const K &key) const {
+        return std::find_if(entries_.begin(), entries_.end(),
+                            [&key](const value_type &entry) { return entry.first == key; });
+    }
+
+    /**
+     * @brief Returns the value for key, appending a default constructed one if there is none.
+     */
+    V &operator[](const K &key) {
+        if (auto it = find(key); it != entries_.end()) {
+            return it->second;
+        }
+        return entries_.emplace_back(key, V{}).second;
+    }
+
+    iterator erase(const_iterator it) { return entries_.erase(it); }
+
+    size_t erase(const K &key) {
+        const auto it = find(key);
+        if (it == entries_.end()) {
+            return 0;
+        }
+        entries_.erase(it);
+        return 1;
+    }
+
+    void clear() { entries_.clear(); }
+
+private:
+    std::vector<value_type> entries_;
+};
+
+#endif // SRC_UTILS_FLAT_MAP_H_
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_UTILS_LISTENER_H_
+#define SRC_UTILS_LISTENER_H_
+
+/**
+ * @brief Generates a C listener entry point from a member function pointer.
+ *
+ * Wayland listeners are tables of plain function pointers taking the user data
+ * as their first argument. ListenerThunk<decltype(&C::fn)>::call<&C::fn> is such a
+ * function: it casts the data back to C and calls the member directly, so the
+ * compiler inlines the member into the thunk and no std::function is involved.
+ *
+ * @code
+ * const struct wl_callback_listener Window::frame_listener_ = {
+ *         .done = listener_thunk<&Window::handle_frame>,
+ * };
+ * @endcode
+ */
+template<typename F>
+struct ListenerThunk;
+
+template<typename C, typename R, typename... Args>
+struct ListenerThunk<R (C::*)(Args...)> {
+    template<R (C::*Fn)(Args...)>
+    static R call(void *data, Args... args) {
+        return (static_cast<C *>(data)->*Fn)(args...);
+    }
+};
+
+template<typename C, typename R, typename... Args>
+struct ListenerThunk<R (C::*)(Args...) const> {
+    template<R (C::*Fn)(Args...) const>
+    static R call(void *data, Args... args) {
+        return (static_cast<const C *>(data)->*Fn)(args...);
+    }
+};
+
+/**
+ * @brief The listener entry point for member function Fn.
+ */
+template<auto Fn>
+constexpr auto listener_thunk = &ListenerThunk<decltype(Fn)>::template call<Fn>;
+
+/**
+ * @brief Like ListenerThunk, for user data pointing at base class B of C.
+ *
+ * With multiple inheritance a B pointer differs from the C pointer, so the data is
+ * cast back to B first, then down to C.
+ */
+template<typename B, typename F>
+struct BaseListenerThunk;
+
+template<typename B, typename C, typename R, typename... Args>
+struct BaseListenerThunk<B, R (C::*)(Args...)> {
+    template<R (C::*Fn)(Args...)>
+    static R call(void *data, Args... args) {
+        return (static_cast<C *>(static_cast<B *>(data))->*Fn)(args...);
+    }
+};
+
+/**
+ * @brief The listener entry point for member function Fn, with a B pointer as user data.
+ */
+template<typename B, auto Fn>
+constexpr auto base_listener_thunk = &BaseListenerThunk<B, decltype(Fn)>::template call<Fn>;
+
+#endif // SRC_UTILS_LISTENER_H_
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "logging.h"
+
+#include <algorithm>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+
+namespace {
+/**
+ * @brief A bounded multi-producer ring of preformatted messages, drained by one thread.
+ *
+ * Producers claim a slot with a compare-exchange on head_ and publish it through the
+ * slot's sequence number, so logging from event handlers never takes a lock or makes
+ * a syscall. A full ring drops the message and counts it instead of blocking.
+ */
+class LogRing {
+public:
+    LogRing() {
+        for (size_t i = 0; i < kSlotCount; i++) {
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+        thread_ = std::thread(&LogRing::drain, this);
+    }
+
+    ~LogRing() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            running_ = false;
+        }
+        wake_.notify_one();
+        thread_.join();
+    }
+
+    LogRing(const LogRing &) = delete;
+
+    LogRing &operator=(const LogRing &) = delete;
+
+    void write(int level, const char *format, va_list args) {
+        auto pos = head_.load(std::memory_order_relaxed);
+        Slot *slot;
+        for (;;) {
+            slot = &slots_[pos % kSlotCount];
+            const auto sequence = slot->sequence.load(std::memory_order_acquire);
+            const auto diff = static_cast<int64_t>(sequence - pos);
+            if (diff == 0) {
+                if (head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->level = level;
+        const auto length = vsnprintf(slot->text, sizeof(slot->text), format, args);
+        slot->length = length < 0 ? 0 : std::min(static_cast<size_t>(length), sizeof(slot->text) - 1);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+
+        if (level >= LOG_LEVEL_ERROR) {
+            wake_.notify_one();
+        }
+    }
+
+    /**
+     * @brief Waits until every message written before the call is on stderr.
+     */
+    void flush() {
+        const auto target = head_.load(std::memory_order_acquire);
+        wake_.notify_one();
+        while (written_.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    [[nodiscard]] uint64_t get_dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    static constexpr size_t kSlotCount = 1024;
+    static constexpr size_t kMessageSize = 240;
+    // an idle ring is checked this often, errors wake the thread at once
+    static constexpr auto kDrainInterval = std::chrono::milliseconds(10);
+
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        int level;
+        size_t length;
+        char text[kMessageSize];
+    };
+
+    std::array<Slot, kSlotCount> slots_{};
+    alignas(64) std::atomic<uint64_t> head_{};
+    alignas(64) std::atomic<uint64_t> written_{};
+    std::atomic<uint64_t> dropped_{};
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool running_{true};
+
+    // only touched by the drain thread
+    uint64_t tail_{};
+
+    /**
+     * @return false if the ring was empty.
+     */
+    bool drain_once() {
+        bool any = false;
+        for (;;) {
+            auto &slot = slots_[tail_ % kSlotCount];
+            if (slot.sequence.load(std::memory_order_acquire) != tail_ + 1) {
+                break;
+            }
+            static constexpr char kPrefix[] = "TDIWE";
+            fprintf(stderr, "[%c] %.*s\n", kPrefix[std::clamp(slot.level, LOG_LEVEL_TRACE, LOG_LEVEL_ERROR)],
+                    static_cast<int>(slot.length), slot.text);
+            slot.sequence.store(tail_ + kSlotCount, std::memory_order_release);
+            tail_++;
+            any = true;
+        }
+        if (any) {
+            fflush(stderr);
+            written_.store(tail_, std::memory_order_release);
+        }
+        return any;
+    }
+
+    void drain() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (running_) {
+            lock.unlock();
+            const bool any = drain_once();
+            lock.lock();
+            if (!any) {
+                wake_.wait_for(lock, kDrainInterval);
+            }
+        }
+        lock.unlock();
+        drain_once();
+    }
+};
+
+LogRing &ring() {
+    static LogRing instance;
+    return instance;
+}
+}
+
+/**
+ * @class Logger
+ * @brief Asynchronous logging for the library.
+ *
+ * Use the LOG_* macros. Messages are formatted on the calling thread into a lock-free
+ * ring and written to stderr by a background thread, so a log call on the input or
+ * frame path costs a vsnprintf instead of a flushed write. Messages longer than
+ * 239 characters are truncated, and under sustained overload messages are dropped,
+ * see get_dropped(). Levels below LOG_LEVEL do not exist in the binary at all.
+ */
+
+/**
+ * @brief Queues a message, use the LOG_* macros instead.
+ *
+ * @param level  One of the LOG_LEVEL_* values, LOG_LEVEL_TRACE to LOG_LEVEL_ERROR.
+ * @param format The printf format.
+ */
+void Logger::write(int level, const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    ring().write(level, format, args);
+    va_end(args);
+}
+
+/**
+ * @brief Blocks until every message queued so far has been written, e.g. before abort().
+ */
+void Logger::flush() {
+    ring().flush();
+}
+
+/**
+ * @return The number of messages dropped because the ring was full.
+ */
+uint64_t Logger::get_dropped() {
+    return ring().get_dropped();
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_UTILS_LOGGING_H_
+#define SRC_UTILS_LOGGING_H_
+
+#include <cstdint>
+
+#include "utils/export.h"
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+#define LOG_LEVEL_OFF 5
+
+// messages below LOG_LEVEL are compiled out, set with -DLOG_LEVEL=<TRACE|DEBUG|...> at configure time
+#if !defined(LOG_LEVEL)
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/**
+ * @brief Logs a printf style message unless level is below LOG_LEVEL.
+ *
+ * Below the level the call compiles to nothing, its arguments are not evaluated.
+ */
+#define LOG_AT(level, ...) \
+    do { \
+        if constexpr ((level) >= LOG_LEVEL) { \
+            Logger::write(level, __VA_ARGS__); \
+        } \
+    } while (0)
+
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+
+class WAYPP_EXPORT Logger {
+public:
+    static void write(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+    static void flush();
+
+    [[nodiscard]] static uint64_t get_dropped();
+};
+
+#endif // SRC_UTILS_LOGGING_H_
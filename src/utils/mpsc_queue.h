@@ -0,0 +1,96 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_UTILS_MPSC_QUEUE_H_
+#define SRC_UTILS_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <type_traits>
+#include <utility>
+
+/**
+ * @brief An unbounded, lock-free multi-producer/single-consumer queue.
+ *
+ * Any number of threads call push(), a single thread calls pop(). Producers never wait
+ * on each other or on the consumer: a push is one allocation and one atomic exchange.
+ * Nodes form a singly linked list, the consumer owning a stub node at its end. A push
+ * that has swapped the head but not yet linked its node is briefly invisible to pop(),
+ * which then reports the queue empty; the producer's next step makes it visible.
+ *
+ * @tparam T The element type, default constructible and movable.
+ */
+template<typename T>
+class MpscQueue {
+    static_assert(std::is_default_constructible_v<T>, "MpscQueue keeps a default constructed stub");
+
+public:
+    MpscQueue() : head_(new Node), tail_(head_.load(std::memory_order_relaxed)) {}
+
+    ~MpscQueue() {
+        while (tail_) {
+            Node *next = tail_->next.load(std::memory_order_relaxed);
+            delete tail_;
+            tail_ = next;
+        }
+    }
+
+    MpscQueue(const MpscQueue &) = delete;
+
+    MpscQueue &operator=(const MpscQueue &) = delete;
+
+    /**
+     * @brief Appends value, from any thread.
+     */
+    void push(T value) {
+        auto *node = new Node;
+        node->value = std::move(value);
+        Node *prev = head_.exchange(node, std::memory_order_acq_rel);
+        prev->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     * @brief Removes the oldest value, from the consumer thread.
+     *
+     * @return false if the queue is empty.
+     */
+    bool pop(T &value) {
+        Node *next = tail_->next.load(std::memory_order_acquire);
+        if (!next) {
+            return false;
+        }
+        // next becomes the stub, its value is handed out
+        value = std::move(next->value);
+        next->value = T();
+        delete tail_;
+        tail_ = next;
+        return true;
+    }
+
+    [[nodiscard]] bool empty() const { return !tail_->next.load(std::memory_order_acquire); }
+
+private:
+    struct Node {
+        std::atomic<Node *> next{};
+        T value{};
+    };
+
+    // producers swap in new nodes at the head, the consumer releases them from the tail
+    std::atomic<Node *> head_;
+    Node *tail_;
+};
+
+#endif // SRC_UTILS_MPSC_QUEUE_H_
@@ -0,0 +1,123 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_UTILS_SPSC_RING_H_
+#define SRC_UTILS_SPSC_RING_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/**
+ * @brief A bounded, lock-free single-producer/single-consumer queue of trivially copyable values.
+ *
+ * One thread calls push(), one other thread calls pop() or drain(). Storage is inline, so
+ * neither side allocates; when the ring is full push() drops the value and counts it.
+ * The producer and consumer indices live on their own cache lines so the two threads do
+ * not invalidate each other's line on every operation.
+ *
+ * @tparam T The element type.
+ * @tparam N The capacity, a power of two.
+ */
+template<typename T, size_t N>
+class SpscRing {
+    static_assert(std::is_trivially_copyable_v<T>, "SpscRing elements are copied with plain stores");
+    static_assert(N && (N & (N - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+    static constexpr size_t kCacheLine = 64;
+
+    /**
+     * @brief Appends value, from the producer thread.
+     *
+     * @return false if the ring is full and the value was dropped.
+     */
+    bool push(const T &value) {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_cache_ == N) {
+            tail_cache_ = tail_.load(std::memory_order_acquire);
+            if (head - tail_cache_ == N) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        slots_[head & (N - 1)] = value;
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest value, from the consumer thread.
+     *
+     * @return false if the ring is empty.
+     */
+    bool pop(T &value) {
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_cache_) {
+            head_cache_ = head_.load(std::memory_order_acquire);
+            if (tail == head_cache_) {
+                return false;
+            }
+        }
+        value = slots_[tail & (N - 1)];
+        tail_.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief Passes every value pushed so far to fn, oldest first, from the consumer thread.
+     *
+     * Values pushed while draining are left for the next call.
+     *
+     * @return The number of values passed to fn.
+     */
+    template<typename F>
+    size_t drain(F &&fn) {
+        const uint64_t tail = tail_.load(std::memory_order_relaxed);
+        head_cache_ = head_.load(std::memory_order_acquire);
+        for (uint64_t i = tail; i != head_cache_; i++) {
+            fn(static_cast<const T &>(slots_[i & (N - 1)]));
+        }
+        tail_.store(head_cache_, std::memory_order_release);
+        return static_cast<size_t>(head_cache_ - tail);
+    }
+
+    [[nodiscard]] bool empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    [[nodiscard]] static constexpr size_t capacity() { return N; }
+
+    /**
+     * @brief Number of values push() dropped because the consumer fell behind.
+     */
+    [[nodiscard]] uint64_t get_dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    // written by the producer; tail_cache_ is its last view of tail_
+    alignas(kCacheLine) std::atomic<uint64_t> head_{};
+    uint64_t tail_cache_{};
+    std::atomic<uint64_t> dropped_{};
+    // written by the consumer; head_cache_ is its last view of head_
+    alignas(kCacheLine) std::atomic<uint64_t> tail_{};
+    uint64_t head_cache_{};
+    alignas(kCacheLine) std::array<T, N> slots_{};
+};
+
+#endif // SRC_UTILS_SPSC_RING_H_
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "startup_profiler.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+
+#include <unistd.h>
+
+#include "utils/logging.h"
+
+namespace {
+constexpr std::array<const char *, StartupProfiler::PHASE_COUNT> kPhaseNames = {
+        "connect",
+        "registry_roundtrip",
+        "configure_wait",
+        "egl_initialize",
+        "egl_choose_config",
+        "egl_create_context",
+        "egl_create_surface",
+        "first_frame",
+};
+
+struct PhaseTimes {
+    uint64_t begin_ns;
+    uint64_t end_ns;
+};
+
+struct State {
+    std::mutex mutex;
+    std::function<void(const std::string &record)> callback;
+    uint64_t origin_ns{};
+    // CLOCK_BOOTTIME at the origin minus the process start time, 0 if unknown
+    uint64_t process_age_ns{};
+    std::array<PhaseTimes, StartupProfiler::PHASE_COUNT> phases{};
+    bool reported{};
+};
+
+std::atomic<bool> enabled{};
+
+State &state() {
+    static State instance;
+    return instance;
+}
+
+uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts{};
+    clock_gettime(clock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/**
+ * @return How long the process has been running, from the start time in /proc/self/stat.
+ */
+uint64_t process_age_ns() {
+    FILE *file = fopen("/proc/self/stat", "r");
+    if (!file) {
+        return 0;
+    }
+    char buffer[1024];
+    const size_t length = fread(buffer, 1, sizeof(buffer) - 1, file);
+    fclose(file);
+    buffer[length] = '\0';
+
+    // the command name may contain spaces, the fields after it do not; starttime is field 22
+    const char *field = strrchr(buffer, ')');
+    for (int i = 2; field && i < 22; i++) {
+        field = strchr(field + 1, ' ');
+    }
+    const long ticks = sysconf(_SC_CLK_TCK);
+    if (!field || ticks <= 0) {
+        return 0;
+    }
+    const uint64_t start_ns = strtoull(field + 1, nullptr, 10) * 1000000000ULL / static_cast<uint64_t>(ticks);
+    const uint64_t now_ns = clock_ns(CLOCK_BOOTTIME);
+    return now_ns > start_ns ? now_ns - start_ns : 0;
+}
+
+void set_origin(State &s) {
+    if (!s.origin_ns) {
+        s.origin_ns = clock_ns(CLOCK_MONOTONIC);
+        s.process_age_ns = process_age_ns();
+    }
+}
+
+double to_ms(uint64_t ns) {
+    return static_cast<double>(ns) / 1e6;
+}
+
+/**
+ * @brief Builds the record, called with the state locked.
+ */
+std::string format_record(const State &s) {
+    std::string record = "{\"startup\":{";
+    char buffer[160];
+    uint64_t last_ns = s.origin_ns;
+    std::string phases;
+    for (size_t i = 0; i < kPhaseNames.size(); i++) {
+        const auto &phase = s.phases[i];
+        if (!phase.begin_ns || !phase.end_ns) {
+            continue;
+        }
+        snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"start_ms\":%.3f,\"duration_ms\":%.3f}",
+                 phases.empty() ? "" : ",", kPhaseNames[i], to_ms(phase.begin_ns - s.origin_ns),
+                 to_ms(phase.end_ns - phase.begin_ns));
+        phases += buffer;
+        last_ns = std::max(last_ns, phase.end_ns);
+    }
+    snprintf(buffer, sizeof(buffer), "\"pid\":%d,\"process_age_ms\":%.3f,\"total_ms\":%.3f,\"phases\":{",
+             static_cast<int>(getpid()), to_ms(s.process_age_ns), to_ms(last_ns - s.origin_ns));
+    record += buffer;
+    record += phases;
+    record += "}}}";
+    return record;
+}
+}
+
+/**
+ * @class StartupProfiler
+ * @brief Times the phases from connecting to the compositor until the first frame is on screen.
+ *
+ * Opt-in, either with enable() before the WindowManager is created or by setting
+ * WAYPP_STARTUP_PROFILE in the environment. Times are CLOCK_MONOTONIC and relative to
+ * the first phase, or to enable(); process_age_ms tells how long the process had been
+ * running by then, so the time spent before the library, e.g. in the dynamic loader,
+ * shows as well. Only the first occurrence of each phase is kept.
+ *
+ * Once the first frame is presented the record is handed, as one line of JSON, to
+ * the callback, or logged at INFO level without one:
+ *
+ * @code
+ * {"startup":{"pid":812,"process_age_ms":41.2,"total_ms":96.4,"phases":{"connect":{"start_ms":0.000,"duration_ms":0.412},...}}}
+ * @endcode
+ */
+
+/**
+ * @brief Starts profiling.
+ *
+ * @param callback Receives the record once the first frame was presented, nullptr to log it.
+ */
+void StartupProfiler::enable(const std::function<void(const std::string &record)> &callback) {
+    auto &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.callback = callback;
+    set_origin(s);
+    enabled.store(true, std::memory_order_release);
+}
+
+/**
+ * @return true if enable() was called or WAYPP_STARTUP_PROFILE is set.
+ */
+bool StartupProfiler::is_enabled() {
+    static const bool from_environment = getenv("WAYPP_STARTUP_PROFILE") != nullptr;
+    return from_environment || enabled.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Marks the start of a phase.
+ */
+void StartupProfiler::begin(Phase phase) {
+    if (!is_enabled()) {
+        return;
+    }
+    auto &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    set_origin(s);
+    if (!s.phases[phase].begin_ns) {
+        s.phases[phase].begin_ns = clock_ns(CLOCK_MONOTONIC);
+    }
+}
+
+/**
+ * @brief Marks the end of a phase, and reports the record once the first frame is done.
+ */
+void StartupProfiler::end(Phase phase) {
+    if (!is_enabled()) {
+        return;
+    }
+    std::string record;
+    std::function<void(const std::string &record)> callback;
+    {
+        auto &s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto &times = s.phases[phase];
+        if (!times.begin_ns || times.end_ns) {
+            return;
+        }
+        times.end_ns = clock_ns(CLOCK_MONOTONIC);
+        if (phase != FIRST_FRAME || s.reported) {
+            return;
+        }
+        s.reported = true;
+        record = format_record(s);
+        callback = s.callback;
+    }
+    if (callback) {
+        callback(record);
+    } else {
+        LOG_INFO("%s", record.c_str());
+    }
+}
+
+/**
+ * @return The record of the phases measured so far.
+ */
+std::string StartupProfiler::get_record() {
+    auto &s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    return format_record(s);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_UTILS_STARTUP_PROFILER_H_
+#define SRC_UTILS_STARTUP_PROFILER_H_
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT StartupProfiler {
+public:
+    typedef enum {
+        CONNECT,
+        REGISTRY_ROUNDTRIP,
+        CONFIGURE_WAIT,
+        EGL_INITIALIZE,
+        EGL_CHOOSE_CONFIG,
+        EGL_CREATE_CONTEXT,
+        EGL_CREATE_SURFACE,
+        // from the start of the first frame until it was presented
+        FIRST_FRAME,
+        PHASE_COUNT,
+    } Phase;
+
+    static void enable(const std::function<void(const std::string &record)> &callback = nullptr);
+
+    [[nodiscard]] static bool is_enabled();
+
+    static void begin(Phase phase);
+
+    static void end(Phase phase);
+
+    [[nodiscard]] static std::string get_record();
+};
+
+class WAYPP_EXPORT StartupScope {
+public:
+    explicit StartupScope(StartupProfiler::Phase phase) : phase_(phase) { StartupProfiler::begin(phase_); }
+
+    ~StartupScope() { StartupProfiler::end(phase_); }
+
+    StartupScope(const StartupScope &) = delete;
+
+    StartupScope &operator=(const StartupScope &) = delete;
+
+private:
+    StartupProfiler::Phase phase_;
+};
+
+#endif // SRC_UTILS_STARTUP_PROFILER_H_
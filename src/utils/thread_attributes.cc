@@ -0,0 +1,149 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "thread_attributes.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <pthread.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(ENABLE_RTKIT)
+#include <gio/gio.h>
+#endif
+
+#include "logging.h"
+
+namespace {
+
+pid_t current_tid() {
+    return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+#if defined(ENABLE_RTKIT)
+
+constexpr char kRtkitName[] = "org.freedesktop.RealtimeKit1";
+constexpr char kRtkitPath[] = "/org/freedesktop/RealtimeKit1";
+
+/**
+ * rtkit only hands out realtime to processes that cap their CPU time with RLIMIT_RTTIME;
+ * 200 ms is the largest it accepts.
+ */
+void limit_rttime() {
+    struct rlimit limit{};
+    if (getrlimit(RLIMIT_RTTIME, &limit) == 0 && limit.rlim_max <= 200000) {
+        return;
+    }
+    limit.rlim_cur = limit.rlim_max = 200000;
+    (void) setrlimit(RLIMIT_RTTIME, &limit);
+}
+
+bool rtkit_call(const char *method, GVariant *parameters) {
+    GError *error = nullptr;
+    auto bus = g_bus_get_sync(G_BUS_TYPE_SYSTEM, nullptr, &error);
+    if (!bus) {
+        LOG_WARN("rtkit: %s", error->message);
+        g_error_free(error);
+        g_variant_unref(g_variant_ref_sink(parameters));
+        return false;
+    }
+    auto reply = g_dbus_connection_call_sync(bus, kRtkitName, kRtkitPath, kRtkitName, method, parameters,
+                                             nullptr, G_DBUS_CALL_FLAGS_NONE, 1000, nullptr, &error);
+    g_object_unref(bus);
+    if (!reply) {
+        LOG_WARN("rtkit %s: %s", method, error->message);
+        g_error_free(error);
+        return false;
+    }
+    g_variant_unref(reply);
+    return true;
+}
+
+bool rtkit_make_realtime(pid_t tid, int priority) {
+    limit_rttime();
+    return rtkit_call("MakeThreadRealtime",
+                      g_variant_new("(tu)", static_cast<guint64>(tid), static_cast<guint32>(priority)));
+}
+
+bool rtkit_make_high_priority(pid_t tid, int nice) {
+    return rtkit_call("MakeThreadHighPriority",
+                      g_variant_new("(ti)", static_cast<guint64>(tid), static_cast<gint32>(nice)));
+}
+
+#endif
+
+}
+
+/**
+ * @brief Applies the attributes to the calling thread.
+ *
+ * Call it first thing on the new thread. A realtime policy is tried with
+ * pthread_setschedparam(), then, lacking CAP_SYS_NICE or an RLIMIT_RTPRIO,
+ * through rtkit; if both fail the nice value is applied instead, so a thread is
+ * never left unprioritized just because realtime was refused.
+ *
+ * @return false if any part could not be applied, the reason is logged.
+ */
+bool ThreadAttributes::apply() const {
+    bool result = true;
+    const pid_t tid = current_tid();
+
+    if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (const int cpu: cpus) {
+            CPU_SET(cpu, &set);
+        }
+        if (const int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); error != 0) {
+            LOG_WARN("ThreadAttributes: affinity: %s", strerror(error));
+            result = false;
+        }
+    }
+
+    if (policy == SCHED_FIFO || policy == SCHED_RR) {
+        struct sched_param param{};
+        param.sched_priority = priority;
+        const int error = pthread_setschedparam(pthread_self(), policy, &param);
+        if (error == 0) {
+            return result;
+        }
+#if defined(ENABLE_RTKIT)
+        // rtkit only grants SCHED_RR
+        if (use_rtkit && rtkit_make_realtime(tid, priority)) {
+            return result;
+        }
+#endif
+        LOG_WARN("ThreadAttributes: realtime priority %d: %s, using nice %d", priority, strerror(error), nice);
+        result = false;
+    }
+
+    if (nice != 0 && setpriority(PRIO_PROCESS, static_cast<id_t>(tid), nice) != 0) {
+        const int error = errno;
+#if defined(ENABLE_RTKIT)
+        if (use_rtkit && rtkit_make_high_priority(tid, nice)) {
+            return result;
+        }
+#endif
+        LOG_WARN("ThreadAttributes: nice %d: %s", nice, strerror(error));
+        result = false;
+    }
+    return result;
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_UTILS_THREAD_ATTRIBUTES_H_
+#define SRC_UTILS_THREAD_ATTRIBUTES_H_
+
+#include <vector>
+
+#include <sched.h>
+
+#include "utils/export.h"
+
+// scheduling for a thread the library creates, e.g. the event thread or render workers
+struct WAYPP_EXPORT ThreadAttributes {
+    // SCHED_OTHER leaves the policy alone, SCHED_FIFO or SCHED_RR with priority ask for realtime
+    int policy{SCHED_OTHER};
+    int priority{};
+    // used when realtime is not requested or could not be had; negative values need CAP_SYS_NICE or rtkit
+    int nice{};
+    // CPUs the thread may run on, empty for no restriction
+    std::vector<int> cpus;
+    // ask rtkit over D-Bus when the process may not raise its own priority, needs ENABLE_RTKIT
+    bool use_rtkit{};
+
+    [[nodiscard]] bool is_default() const {
+        return policy == SCHED_OTHER && nice == 0 && cpus.empty();
+    }
+
+    bool apply() const;
+};
+
+#endif // SRC_UTILS_THREAD_ATTRIBUTES_H_
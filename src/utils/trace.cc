@@ -0,0 +1,112 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+/**
+ * @return The trace_marker fd, -1 if tracefs is not accessible.
+ */
+int marker_fd() {
+    static const int fd = [] {
+        int result = open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+        if (result < 0) {
+            result = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+        }
+        return result;
+    }();
+    return fd;
+}
+
+const int process_id = getpid();
+
+std::atomic<uint64_t> cookies{};
+
+/**
+ * @brief Writes one atrace formatted event, truncated to the buffer.
+ */
+__attribute__((format(printf, 1, 2)))
+void emit(const char *format, ...) {
+    char buffer[256];
+    va_list args;
+    va_start(args, format);
+    const auto length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length > 0) {
+        const auto size = std::min(static_cast<size_t>(length), sizeof(buffer) - 1);
+        (void) !write(marker_fd(), buffer, size);
+    }
+}
+}
+
+/**
+ * @class Trace
+ * @brief Userspace trace events for Perfetto, in the atrace format on the ftrace trace_marker.
+ *
+ * Built with ENABLE_TRACING the TRACE_* macros mark dispatch, frame, draw, swap,
+ * registry and input work. A system-wide Perfetto trace with the ftrace data source,
+ * or trace-cmd, records the events on the same timeline as the compositor and the
+ * kernel's scheduling, which is what correlating a late frame needs. Thread slices
+ * use B/E events; window and seat tracks are async tracks, G/H events, named after
+ * the object. Without tracefs write access every call is a no-op. Without
+ * ENABLE_TRACING the macros compile to nothing.
+ */
+
+/**
+ * @return true if events can be written.
+ */
+bool Trace::is_enabled() {
+    return marker_fd() >= 0;
+}
+
+void Trace::begin(const char *name) {
+    emit("B|%d|%s", process_id, name);
+}
+
+void Trace::end() {
+    emit("E|%d", process_id);
+}
+
+/**
+ * @brief Begins a slice on a named async track; slices on a track must not overlap unless their cookies differ.
+ */
+void Trace::begin_track(const std::string &track, const char *name, uint64_t cookie) {
+    emit("G|%d|%s|%s|%llu", process_id, track.c_str(), name, static_cast<unsigned long long>(cookie));
+}
+
+void Trace::end_track(const std::string &track, uint64_t cookie) {
+    emit("H|%d|%s|%llu", process_id, track.c_str(), static_cast<unsigned long long>(cookie));
+}
+
+/**
+ * @brief Sets the value of a process-scoped counter track.
+ */
+void Trace::counter(const char *name, int64_t value) {
+    emit("C|%d|%s|%lld", process_id, name, static_cast<long long>(value));
+}
+
+uint64_t Trace::next_cookie() {
+    return cookies.fetch_add(1, std::memory_order_relaxed) + 1;
+}
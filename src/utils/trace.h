@@ -0,0 +1,89 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_UTILS_TRACE_H_
+#define SRC_UTILS_TRACE_H_
+
+#include <cstdint>
+#include <string>
+
+#include "utils/export.h"
+
+#if defined(ENABLE_TRACING)
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+// a slice on the calling thread's track, from here to the end of the scope
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(nullptr, name)
+// a slice on a named track, e.g. the window's or the seat's
+#define TRACE_TRACK_SCOPE(track, name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(&(track), name)
+#define TRACE_COUNTER(name, value) Trace::counter(name, static_cast<int64_t>(value))
+#else
+#define TRACE_SCOPE(name) do {} while (0)
+#define TRACE_TRACK_SCOPE(track, name) (void) (track)
+#define TRACE_COUNTER(name, value) do {} while (0)
+#endif
+
+class WAYPP_EXPORT Trace {
+public:
+    [[nodiscard]] static bool is_enabled();
+
+    static void begin(const char *name);
+
+    static void end();
+
+    static void begin_track(const std::string &track, const char *name, uint64_t cookie);
+
+    static void end_track(const std::string &track, uint64_t cookie);
+
+    static void counter(const char *name, int64_t value);
+
+    [[nodiscard]] static uint64_t next_cookie();
+};
+
+class WAYPP_EXPORT TraceScope {
+public:
+    TraceScope(const std::string *track, const char *name) : track_(track) {
+        if (!Trace::is_enabled()) {
+            track_ = nullptr;
+            active_ = false;
+        } else if (track_) {
+            cookie_ = Trace::next_cookie();
+            Trace::begin_track(*track_, name, cookie_);
+        } else {
+            Trace::begin(name);
+        }
+    }
+
+    ~TraceScope() {
+        if (track_) {
+            Trace::end_track(*track_, cookie_);
+        } else if (active_) {
+            Trace::end();
+        }
+    }
+
+    TraceScope(const TraceScope &) = delete;
+
+    TraceScope &operator=(const TraceScope &) = delete;
+
+private:
+    const std::string *track_;
+    uint64_t cookie_{};
+    bool active_{true};
+};
+
+#endif // SRC_UTILS_TRACE_H_
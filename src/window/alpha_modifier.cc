@@ -0,0 +1,58 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "alpha_modifier.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @class AlphaModifier
+ * @brief Has the compositor multiply a surface's alpha with wp_alpha_modifier_v1.
+ *
+ * Fades are done by the compositor, often on the display plane, instead of the client
+ * rendering its content again with a different alpha every frame. The multiplier
+ * applies to the whole surface, on top of the buffer's own alpha, from its next commit.
+ *
+ * @param manager The wp_alpha_modifier_v1 global, see Display::get_alpha_modifier().
+ * @param surface The surface; it may have only one alpha modifier.
+ */
+AlphaModifier::AlphaModifier(struct wp_alpha_modifier_v1 *manager, struct wl_surface *surface) :
+        wp_alpha_modifier_surface_(wp_alpha_modifier_v1_get_surface(manager, surface)) {
+}
+
+/**
+ * @brief Destroys the alpha modifier; the surface is opaque again from its next commit.
+ */
+AlphaModifier::~AlphaModifier() {
+    wp_alpha_modifier_surface_v1_destroy(wp_alpha_modifier_surface_);
+}
+
+/**
+ * @brief Sets the alpha multiplier of the surface.
+ *
+ * @param opacity 0 for fully transparent to 1 for the buffer's own alpha.
+ */
+bool AlphaModifier::set_opacity(float opacity) {
+    opacity_ = std::clamp(opacity, 0.0f, 1.0f);
+    const auto factor = static_cast<uint32_t>(std::llround(static_cast<double>(opacity_) * UINT32_MAX));
+    if (factor == factor_) {
+        return false;
+    }
+    factor_ = factor;
+    wp_alpha_modifier_surface_v1_set_multiplier(wp_alpha_modifier_surface_, factor);
+    return true;
+}
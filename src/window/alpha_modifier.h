@@ -0,0 +1,51 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_ALPHA_MODIFIER_H_
+#define SRC_WINDOW_ALPHA_MODIFIER_H_
+
+#include <cstdint>
+
+#include <wayland-client.h>
+
+#if defined(ENABLE_ALPHA_MODIFIER)
+#include "alpha-modifier-v1-client-protocol.h"
+#endif
+#include "utils/export.h"
+
+class WAYPP_EXPORT AlphaModifier {
+public:
+    explicit AlphaModifier(struct wp_alpha_modifier_v1 *manager, struct wl_surface *surface);
+
+    ~AlphaModifier();
+
+    AlphaModifier(const AlphaModifier &) = delete;
+
+    AlphaModifier &operator=(const AlphaModifier &) = delete;
+
+    // false if the multiplier did not change
+    bool set_opacity(float opacity);
+
+    [[nodiscard]] float get_opacity() const { return opacity_; }
+
+private:
+    struct wp_alpha_modifier_surface_v1 *wp_alpha_modifier_surface_;
+    float opacity_{1.0f};
+    // last multiplier sent, opaque until the first set_opacity()
+    uint32_t factor_{UINT32_MAX};
+};
+
+#endif // SRC_WINDOW_ALPHA_MODIFIER_H_
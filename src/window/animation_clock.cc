@@ -0,0 +1,59 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "animation_clock.h"
+
+/**
+ * @class AnimationClock
+ * @brief The time a frame's animations should show, the frame's predicted presentation.
+ *
+ * Sampling a clock inside the draw callback gives the time the frame is drawn, which
+ * wanders against the vblank it lands on with every change in render time, and a wall
+ * clock jumps with every adjustment. The window instead sets the clock once per frame,
+ * before drawing, to the vblank it predicts the frame for, so objects move by exactly
+ * the time between the frames as they appear. The time never goes backwards: a new
+ * prediction earlier than the last one, e.g. after a mode change, repeats the last.
+ * Read it from the drawing thread only.
+ */
+
+/**
+ * @brief Advances the clock to the frame about to be drawn.
+ *
+ * @param start_ns          When the frame started, in the presentation clock domain.
+ * @param target_present_ns The predicted presentation time, 0 if unknown.
+ */
+void AnimationClock::begin_frame(uint64_t start_ns, uint64_t target_present_ns) {
+    predicted_ = target_present_ns != 0;
+    uint64_t time = predicted_ ? target_present_ns : start_ns;
+    if (time < now_ns_) {
+        time = now_ns_;
+    }
+    if (frames_ == 0) {
+        first_ns_ = time;
+        delta_ns_ = 0;
+    } else {
+        delta_ns_ = time - now_ns_;
+    }
+    now_ns_ = time;
+    frames_++;
+}
+
+/**
+ * @brief Starts over, the next frame is at seconds 0 again.
+ */
+void AnimationClock::reset() {
+    *this = {};
+}
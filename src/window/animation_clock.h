@@ -0,0 +1,54 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_ANIMATION_CLOCK_H_
+#define SRC_WINDOW_ANIMATION_CLOCK_H_
+
+#include <cstdint>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT AnimationClock {
+public:
+    AnimationClock() = default;
+
+    // when the frame being drawn is expected on screen, in monotonic nanoseconds; 0 before the first frame
+    [[nodiscard]] uint64_t now() const { return now_ns_; }
+
+    // since the first frame, for animations driven by a float time
+    [[nodiscard]] double get_seconds() const { return static_cast<double>(now_ns_ - first_ns_) * 1e-9; }
+
+    // between the presentation times of the previous frame and this one, 0 on the first frame
+    [[nodiscard]] uint64_t get_delta_ns() const { return delta_ns_; }
+
+    // false while no vblank can be predicted, now() is the start of the frame then
+    [[nodiscard]] bool is_predicted() const { return predicted_; }
+
+    [[nodiscard]] uint64_t get_frame_count() const { return frames_; }
+
+    void begin_frame(uint64_t start_ns, uint64_t target_present_ns);
+
+    void reset();
+
+private:
+    uint64_t now_ns_{};
+    uint64_t first_ns_{};
+    uint64_t delta_ns_{};
+    uint64_t frames_{};
+    bool predicted_{};
+};
+
+#endif // SRC_WINDOW_ANIMATION_CLOCK_H_
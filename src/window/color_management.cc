@@ -0,0 +1,315 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "color_management.h"
+
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+/**
+ * @class ColorManager
+ * @brief What the compositor's wp_color_manager_v1 can convert from, and image descriptions for it.
+ *
+ * A client that describes its buffers hands HDR and wide gamut content to the compositor
+ * as it is, instead of tone mapping or converting it to sRGB in a shader pass of its own.
+ * The compositor often converts on the display plane, or not at all when the output
+ * already is in that color space. The supported transfer functions, primaries, intents
+ * and features arrive right after the bind, before Display's constructor returns.
+ *
+ * @param manager The wp_color_manager_v1 global, destroyed with this object.
+ */
+ColorManager::ColorManager(struct wp_color_manager_v1 *manager) :
+        manager_(manager) {
+    wp_color_manager_v1_add_listener(manager_, &listener_, this);
+}
+
+ColorManager::~ColorManager() {
+    wp_color_manager_v1_destroy(manager_);
+}
+
+bool ColorManager::supports(ColorDescription::TransferFunction tf) const {
+    return (tfs_ >> to_protocol(tf)) & 1;
+}
+
+bool ColorManager::supports(ColorDescription::Primaries primaries) const {
+    return (primaries_ >> to_protocol(primaries)) & 1;
+}
+
+bool ColorManager::supports(ColorDescription::RenderIntent intent) const {
+    return (intents_ >> to_protocol(intent)) & 1;
+}
+
+/**
+ * @brief Checks whether create() can describe the content to this compositor.
+ *
+ * The mastering metadata is a hint and left out where unsupported, it does not count.
+ *
+ * @param description The buffer's color space.
+ * @return false if the compositor lacks parametric descriptions, the transfer function,
+ *         the primaries, the intent, or custom luminances while they are set; also for
+ *         luminances the protocol would reject.
+ */
+bool ColorManager::supports(const ColorDescription &description) const {
+    if (!has_feature(WP_COLOR_MANAGER_V1_FEATURE_PARAMETRIC) || !supports(description.tf) ||
+        !supports(description.primaries) || !supports(description.intent)) {
+        return false;
+    }
+    if (description.max_lum) {
+        if (!has_feature(WP_COLOR_MANAGER_V1_FEATURE_SET_LUMINANCES)) {
+            return false;
+        }
+        // min_lum is in 0.0001 cd/m², both others have to be above it
+        const auto min_lum = static_cast<uint64_t>(description.min_lum);
+        if (static_cast<uint64_t>(description.max_lum) * 10000 <= min_lum ||
+            static_cast<uint64_t>(description.reference_lum) * 10000 <= min_lum) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Creates a parametric image description, see ColorSurface for setting it.
+ *
+ * The description is not usable before its ready event arrives.
+ *
+ * @param description The buffer's color space, supports() must accept it.
+ * @param queue       The queue its events are dispatched on, nullptr for the display's.
+ * @return The image description, owned by the caller.
+ */
+struct wp_image_description_v1 *ColorManager::create(const ColorDescription &description,
+                                                     struct wl_event_queue *queue) const {
+    auto manager = manager_;
+    if (queue) {
+        // objects created from the wrapper, and from those, dispatch on queue
+        manager = static_cast<struct wp_color_manager_v1 *>(wl_proxy_create_wrapper(manager_));
+        wl_proxy_set_queue(reinterpret_cast<struct wl_proxy *>(manager), queue);
+    }
+    auto params = wp_color_manager_v1_create_parametric_creator(manager);
+    if (queue) {
+        wl_proxy_wrapper_destroy(manager);
+    }
+
+    wp_image_description_creator_params_v1_set_tf_named(params, to_protocol(description.tf));
+    wp_image_description_creator_params_v1_set_primaries_named(params, to_protocol(description.primaries));
+    if (description.max_lum) {
+        wp_image_description_creator_params_v1_set_luminances(params, description.min_lum, description.max_lum,
+                                                              description.reference_lum);
+    }
+    if (description.mastering_max_lum && has_feature(WP_COLOR_MANAGER_V1_FEATURE_SET_MASTERING_DISPLAY_PRIMARIES)) {
+        wp_image_description_creator_params_v1_set_mastering_luminance(params, description.mastering_min_lum,
+                                                                       description.mastering_max_lum);
+    }
+    if (description.max_cll) {
+        wp_image_description_creator_params_v1_set_max_cll(params, description.max_cll);
+    }
+    if (description.max_fall) {
+        wp_image_description_creator_params_v1_set_max_fall(params, description.max_fall);
+    }
+    // also destroys the creator
+    return wp_image_description_creator_params_v1_create(params);
+}
+
+uint32_t ColorManager::to_protocol(ColorDescription::TransferFunction tf) {
+    switch (tf) {
+        case ColorDescription::TF_GAMMA22:
+            return WP_COLOR_MANAGER_V1_TRANSFER_FUNCTION_GAMMA22;
+        case ColorDescription::TF_BT1886:
+            return WP_COLOR_MANAGER_V1_TRANSFER_FUNCTION_BT1886;
+        case ColorDescription::TF_EXT_LINEAR:
+            return WP_COLOR_MANAGER_V1_TRANSFER_FUNCTION_EXT_LINEAR;
+        case ColorDescription::TF_PQ:
+            return WP_COLOR_MANAGER_V1_TRANSFER_FUNCTION_ST2084_PQ;
+        case ColorDescription::TF_HLG:
+            return WP_COLOR_MANAGER_V1_TRANSFER_FUNCTION_HLG;
+        case ColorDescription::TF_SRGB:
+            break;
+    }
+    return WP_COLOR_MANAGER_V1_TRANSFER_FUNCTION_SRGB;
+}
+
+uint32_t ColorManager::to_protocol(ColorDescription::Primaries primaries) {
+    switch (primaries) {
+        case ColorDescription::PRIMARIES_BT2020:
+            return WP_COLOR_MANAGER_V1_PRIMARIES_BT2020;
+        case ColorDescription::PRIMARIES_DCI_P3:
+            return WP_COLOR_MANAGER_V1_PRIMARIES_DCI_P3;
+        case ColorDescription::PRIMARIES_DISPLAY_P3:
+            return WP_COLOR_MANAGER_V1_PRIMARIES_DISPLAY_P3;
+        case ColorDescription::PRIMARIES_ADOBE_RGB:
+            return WP_COLOR_MANAGER_V1_PRIMARIES_ADOBE_RGB;
+        case ColorDescription::PRIMARIES_SRGB:
+            break;
+    }
+    return WP_COLOR_MANAGER_V1_PRIMARIES_SRGB;
+}
+
+uint32_t ColorManager::to_protocol(ColorDescription::RenderIntent intent) {
+    switch (intent) {
+        case ColorDescription::INTENT_RELATIVE:
+            return WP_COLOR_MANAGER_V1_RENDER_INTENT_RELATIVE;
+        case ColorDescription::INTENT_SATURATION:
+            return WP_COLOR_MANAGER_V1_RENDER_INTENT_SATURATION;
+        case ColorDescription::INTENT_ABSOLUTE:
+            return WP_COLOR_MANAGER_V1_RENDER_INTENT_ABSOLUTE;
+        case ColorDescription::INTENT_RELATIVE_BPC:
+            return WP_COLOR_MANAGER_V1_RENDER_INTENT_RELATIVE_BPC;
+        case ColorDescription::INTENT_PERCEPTUAL:
+            break;
+    }
+    return WP_COLOR_MANAGER_V1_RENDER_INTENT_PERCEPTUAL;
+}
+
+void ColorManager::handle_supported_intent(struct wp_color_manager_v1 * /* manager */, uint32_t render_intent) {
+    if (render_intent < 32) {
+        intents_ |= 1u << render_intent;
+    }
+}
+
+void ColorManager::handle_supported_feature(struct wp_color_manager_v1 * /* manager */, uint32_t feature) {
+    if (feature < 32) {
+        features_ |= 1u << feature;
+    }
+}
+
+void ColorManager::handle_supported_tf_named(struct wp_color_manager_v1 * /* manager */, uint32_t tf) {
+    if (tf < 32) {
+        tfs_ |= 1u << tf;
+    }
+}
+
+void ColorManager::handle_supported_primaries_named(struct wp_color_manager_v1 * /* manager */,
+                                                    uint32_t primaries) {
+    if (primaries < 32) {
+        primaries_ |= 1u << primaries;
+    }
+}
+
+void ColorManager::handle_done(struct wp_color_manager_v1 * /* manager */) {
+    done_ = true;
+}
+
+const struct wp_color_manager_v1_listener ColorManager::listener_ = {
+        .supported_intent = listener_thunk<&ColorManager::handle_supported_intent>,
+        .supported_feature = listener_thunk<&ColorManager::handle_supported_feature>,
+        .supported_tf_named = listener_thunk<&ColorManager::handle_supported_tf_named>,
+        .supported_primaries_named = listener_thunk<&ColorManager::handle_supported_primaries_named>,
+        .done = listener_thunk<&ColorManager::handle_done>,
+};
+
+/**
+ * @class ColorSurface
+ * @brief The color space of one surface's buffers, with wp_color_management_surface_v1.
+ *
+ * Without a description the compositor takes buffers as sRGB. Descriptions are created
+ * asynchronously; each is set on the surface once the compositor reports it ready, and
+ * takes effect with the surface's next commit. Until then the previous one stays.
+ *
+ * @param manager The color manager, see Display::get_color_manager().
+ * @param surface The surface; it may have only one color management object.
+ * @param queue   The queue the surface's events are dispatched on, nullptr for the display's.
+ */
+ColorSurface::ColorSurface(const ColorManager *manager, struct wl_surface *surface, struct wl_event_queue *queue) :
+        manager_(manager),
+        queue_(queue),
+        surface_(wp_color_manager_v1_get_surface(manager->get_manager(), surface)) {
+}
+
+/**
+ * @brief Destroys the color management object; buffers are sRGB again from the surface's next commit.
+ */
+ColorSurface::~ColorSurface() {
+    if (pending_) {
+        wp_image_description_v1_destroy(pending_);
+    }
+    if (current_) {
+        wp_image_description_v1_destroy(current_);
+    }
+    wp_color_management_surface_v1_destroy(surface_);
+}
+
+/**
+ * @brief Describes the color space of the surface's buffers, replacing a pending description.
+ *
+ * The buffers must hold what the description says, e.g. PQ encoded BT.2020 content in a
+ * 10 bit per channel EGL config or dmabuf format; nothing is converted on the client.
+ *
+ * @param description The buffers' color space.
+ * @return false if the compositor cannot convert from it, the client has to.
+ */
+bool ColorSurface::set_description(const ColorDescription &description) {
+    if (!manager_->supports(description)) {
+        return false;
+    }
+    if (pending_ ? description == pending_description_ : current_ && description == description_) {
+        return true;
+    }
+    if (pending_) {
+        wp_image_description_v1_destroy(pending_);
+    }
+    pending_description_ = description;
+    pending_ = manager_->create(description, queue_);
+    wp_image_description_v1_add_listener(pending_, &listener_, this);
+    return true;
+}
+
+/**
+ * @brief Goes back to sRGB buffers, from the surface's next commit.
+ */
+void ColorSurface::unset_description() {
+    if (pending_) {
+        wp_image_description_v1_destroy(pending_);
+        pending_ = nullptr;
+    }
+    if (current_) {
+        wp_image_description_v1_destroy(current_);
+        current_ = nullptr;
+        wp_color_management_surface_v1_unset_image_description(surface_);
+    }
+    description_ = {};
+    pending_description_ = {};
+}
+
+void ColorSurface::handle_failed(struct wp_image_description_v1 * /* description */, uint32_t cause,
+                                 const char *msg) {
+    LOG_WARN("image description failed (%u): %s", cause, msg);
+    wp_image_description_v1_destroy(pending_);
+    pending_ = nullptr;
+    if (ready_callback_) {
+        ready_callback_(false);
+    }
+}
+
+void ColorSurface::handle_ready(struct wp_image_description_v1 * /* description */, uint32_t /* identity */) {
+    wp_color_management_surface_v1_set_image_description(surface_, pending_,
+                                                         ColorManager::to_protocol(pending_description_.intent));
+    // the surface holds on to what was set, current_ only marks that something is
+    if (current_) {
+        wp_image_description_v1_destroy(current_);
+    }
+    current_ = pending_;
+    pending_ = nullptr;
+    description_ = pending_description_;
+    if (ready_callback_) {
+        ready_callback_(true);
+    }
+}
+
+const struct wp_image_description_v1_listener ColorSurface::listener_ = {
+        .failed = listener_thunk<&ColorSurface::handle_failed>,
+        .ready = listener_thunk<&ColorSurface::handle_ready>,
+};
@@ -0,0 +1,197 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_COLOR_MANAGEMENT_H_
+#define SRC_WINDOW_COLOR_MANAGEMENT_H_
+
+#include <cstdint>
+#include <functional>
+
+#include <wayland-client.h>
+
+#if defined(ENABLE_COLOR_MANAGEMENT)
+#include "color-management-v1-client-protocol.h"
+#endif
+#include "utils/export.h"
+
+/**
+ * @brief What the pixels of a buffer are, for the compositor to convert instead of the client.
+ *
+ * A literal type like WindowConfig, so descriptions can be constants:
+ *
+ * @code
+ * static constexpr ColorDescription kHdr10{.tf = ColorDescription::TF_PQ,
+ *                                          .primaries = ColorDescription::PRIMARIES_BT2020,
+ *                                          .mastering_max_lum = 1000, .max_cll = 1000, .max_fall = 400};
+ * @endcode
+ */
+struct ColorDescription {
+    typedef enum {
+        TF_SRGB,
+        TF_GAMMA22,
+        TF_BT1886,
+        // linear light, values beyond 1.0 allowed, e.g. scRGB-like half float buffers
+        TF_EXT_LINEAR,
+        // SMPTE ST 2084, HDR10
+        TF_PQ,
+        // ARIB STD-B67 hybrid log-gamma
+        TF_HLG,
+    } TransferFunction;
+
+    typedef enum {
+        PRIMARIES_SRGB,
+        PRIMARIES_BT2020,
+        PRIMARIES_DCI_P3,
+        PRIMARIES_DISPLAY_P3,
+        PRIMARIES_ADOBE_RGB,
+    } Primaries;
+
+    typedef enum {
+        INTENT_PERCEPTUAL,
+        INTENT_RELATIVE,
+        INTENT_SATURATION,
+        INTENT_ABSOLUTE,
+        INTENT_RELATIVE_BPC,
+    } RenderIntent;
+
+    TransferFunction tf{TF_SRGB};
+    Primaries primaries{PRIMARIES_SRGB};
+    RenderIntent intent{INTENT_PERCEPTUAL};
+
+    // the luminance range the encoding maps to, 0 max_lum for the transfer function's default;
+    // min_lum in 0.0001 cd/m², max_lum and reference_lum (diffuse white) in cd/m²
+    uint32_t min_lum{};
+    uint32_t max_lum{};
+    uint32_t reference_lum{};
+
+    // HDR static metadata of the content, 0 for unknown; mastering_min_lum in 0.0001 cd/m², the rest in cd/m²
+    uint32_t mastering_min_lum{};
+    uint32_t mastering_max_lum{};
+    uint32_t max_cll{};
+    uint32_t max_fall{};
+
+    [[nodiscard]] constexpr bool operator==(const ColorDescription &other) const {
+        return tf == other.tf && primaries == other.primaries && intent == other.intent &&
+               min_lum == other.min_lum && max_lum == other.max_lum && reference_lum == other.reference_lum &&
+               mastering_min_lum == other.mastering_min_lum && mastering_max_lum == other.mastering_max_lum &&
+               max_cll == other.max_cll && max_fall == other.max_fall;
+    }
+
+    [[nodiscard]] constexpr bool operator!=(const ColorDescription &other) const { return !(*this == other); }
+};
+
+class WAYPP_EXPORT ColorManager {
+public:
+    explicit ColorManager(struct wp_color_manager_v1 *manager);
+
+    ~ColorManager();
+
+    ColorManager(const ColorManager &) = delete;
+
+    ColorManager &operator=(const ColorManager &) = delete;
+
+    [[nodiscard]] struct wp_color_manager_v1 *get_manager() const { return manager_; }
+
+    // the supported_* events were all received
+    [[nodiscard]] bool is_done() const { return done_; }
+
+    [[nodiscard]] bool supports(ColorDescription::TransferFunction tf) const;
+
+    [[nodiscard]] bool supports(ColorDescription::Primaries primaries) const;
+
+    [[nodiscard]] bool supports(ColorDescription::RenderIntent intent) const;
+
+    [[nodiscard]] bool supports(const ColorDescription &description) const;
+
+    [[nodiscard]] struct wp_image_description_v1 *create(const ColorDescription &description,
+                                                         struct wl_event_queue *queue = nullptr) const;
+
+    static uint32_t to_protocol(ColorDescription::TransferFunction tf);
+
+    static uint32_t to_protocol(ColorDescription::Primaries primaries);
+
+    static uint32_t to_protocol(ColorDescription::RenderIntent intent);
+
+private:
+    struct wp_color_manager_v1 *manager_;
+
+    // bit n set for protocol value n of each enum
+    uint32_t features_{};
+    uint32_t intents_{};
+    uint32_t tfs_{};
+    uint32_t primaries_{};
+    bool done_{};
+
+    [[nodiscard]] bool has_feature(uint32_t feature) const { return feature < 32 && (features_ >> feature) & 1; }
+
+    void handle_supported_intent(struct wp_color_manager_v1 *manager, uint32_t render_intent);
+
+    void handle_supported_feature(struct wp_color_manager_v1 *manager, uint32_t feature);
+
+    void handle_supported_tf_named(struct wp_color_manager_v1 *manager, uint32_t tf);
+
+    void handle_supported_primaries_named(struct wp_color_manager_v1 *manager, uint32_t primaries);
+
+    void handle_done(struct wp_color_manager_v1 *manager);
+
+    static const struct wp_color_manager_v1_listener listener_;
+};
+
+class WAYPP_EXPORT ColorSurface {
+public:
+    explicit ColorSurface(const ColorManager *manager, struct wl_surface *surface,
+                          struct wl_event_queue *queue = nullptr);
+
+    ~ColorSurface();
+
+    ColorSurface(const ColorSurface &) = delete;
+
+    ColorSurface &operator=(const ColorSurface &) = delete;
+
+    bool set_description(const ColorDescription &description);
+
+    void unset_description();
+
+    // the compositor accepted the description and it is set on the surface, for its next commit
+    [[nodiscard]] bool is_set() const { return current_ != nullptr; }
+
+    // the description set, sRGB before one is
+    [[nodiscard]] const ColorDescription &get_description() const { return description_; }
+
+    // runs once the description was set on the surface, false if the compositor refused it
+    void set_ready_callback(const std::function<void(bool ready)> &callback) { ready_callback_ = callback; }
+
+private:
+    const ColorManager *manager_;
+    struct wl_event_queue *queue_;
+    struct wp_color_management_surface_v1 *surface_;
+    // created, waiting for ready or failed
+    struct wp_image_description_v1 *pending_{};
+    // set on the surface
+    struct wp_image_description_v1 *current_{};
+    ColorDescription description_{};
+    ColorDescription pending_description_{};
+    std::function<void(bool ready)> ready_callback_;
+
+    void handle_failed(struct wp_image_description_v1 *description, uint32_t cause, const char *msg);
+
+    void handle_ready(struct wp_image_description_v1 *description, uint32_t identity);
+
+    static const struct wp_image_description_v1_listener listener_;
+};
+
+#endif // SRC_WINDOW_COLOR_MANAGEMENT_H_
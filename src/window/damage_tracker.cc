@@ -0,0 +1,99 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "damage_tracker.h"
+
+#include "region.h"
+
+/**
+ * @class DamageTracker
+ * @brief The damage of the last frames, so a back buffer of known age is only partially repainted.
+ *
+ * Shared by every backend that reuses buffers: EGL with EGL_EXT_buffer_age, Vulkan
+ * swapchain images, and the wl_shm ring. Each tracks the age of the buffer it is about
+ * to render, 1 for one holding the previous frame, and 0 if the contents are undefined.
+ */
+
+/**
+ * @brief Computes the region to repaint for a buffer about to be rendered.
+ *
+ * A buffer of age N missed the damage of the N - 1 frames presented since it was
+ * shown, so the result is the union of that damage and this frame's, clipped to the
+ * buffer, with overlaps repainted once. An unknown age, or one older than the history,
+ * yields the full buffer.
+ *
+ * @param damage The regions that change in this frame, empty for all of it.
+ * @param age    The age of the buffer, 0 if unknown.
+ * @param width  The buffer width.
+ * @param height The buffer height.
+ * @return The regions of the buffer the frame must repaint.
+ */
+std::vector<DamageRect> DamageTracker::get_repaint(const std::vector<DamageRect> &damage, int age,
+                                                   int32_t width, int32_t height) const {
+    std::vector<DamageRect> repaint;
+    if (damage.empty() || age <= 0 || static_cast<size_t>(age) > frames_ + 1 ||
+        static_cast<size_t>(age) > kMaxBufferAge) {
+        repaint.push_back({0, 0, width, height});
+        return repaint;
+    }
+    Region region(damage);
+    for (size_t i = 0; i + 1 < static_cast<size_t>(age); i++) {
+        const auto &frame = history_[(head_ + kMaxBufferAge - i) % kMaxBufferAge];
+        if (frame.empty()) {
+            repaint.push_back({0, 0, width, height});
+            return repaint;
+        }
+        region.unite(Region(frame));
+    }
+    region.intersect(Region(0, 0, width, height));
+
+    if (region.empty()) {
+        // damage only outside the buffer; an empty list would read as full damage anyway
+        repaint.push_back({0, 0, width, height});
+        return repaint;
+    }
+    if (region.get_box_count() > kMaxDamageRects) {
+        const auto &extents = region.get_extents();
+        repaint.push_back({extents.x1, extents.y1, extents.x2 - extents.x1, extents.y2 - extents.y1});
+        return repaint;
+    }
+    return region.get_rects();
+}
+
+/**
+ * @brief Pushes the damage of the frame being presented into the history ring.
+ *
+ * An empty list records full damage.
+ */
+void DamageTracker::record(const std::vector<DamageRect> &damage) {
+    head_ = (head_ + 1) % kMaxBufferAge;
+    history_[head_] = damage;
+    if (frames_ < kMaxBufferAge) {
+        frames_++;
+    }
+}
+
+/**
+ * @brief Forgets the history, e.g. after the buffers were reallocated.
+ */
+void DamageTracker::reset() {
+    for (auto &frame: history_) {
+        frame.clear();
+    }
+    head_ = 0;
+    frames_ = 0;
+}
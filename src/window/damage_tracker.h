@@ -0,0 +1,59 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_DAMAGE_TRACKER_H_
+#define SRC_WINDOW_DAMAGE_TRACKER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "utils/export.h"
+
+// damage rectangle in buffer coordinates, origin top-left
+struct DamageRect {
+    int32_t x;
+    int32_t y;
+    int32_t width;
+    int32_t height;
+};
+
+class WAYPP_EXPORT DamageTracker {
+public:
+    // damage history for buffer age, older buffers are repainted in full
+    static constexpr size_t kMaxBufferAge = 4;
+    // repaint regions with more rectangles than this are collapsed to their bounding box
+    static constexpr size_t kMaxDamageRects = 8;
+
+    DamageTracker() = default;
+
+    [[nodiscard]] std::vector<DamageRect> get_repaint(const std::vector<DamageRect> &damage, int age,
+                                                      int32_t width, int32_t height) const;
+
+    void record(const std::vector<DamageRect> &damage);
+
+    void reset();
+
+private:
+    // the newest frame at head_
+    std::array<std::vector<DamageRect>, kMaxBufferAge> history_{};
+    size_t head_{};
+    size_t frames_{};
+};
+
+#endif // SRC_WINDOW_DAMAGE_TRACKER_H_
@@ -0,0 +1,272 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "decorations.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+#include "pixel_kernels.h"
+
+namespace {
+// 5x7 glyphs for ASCII 0x20 to 0x7e, one byte per column, least significant bit on top
+constexpr uint8_t kFont[95][5] = {
+        {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5f, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00},
+        {0x14, 0x7f, 0x14, 0x7f, 0x14}, {0x24, 0x2a, 0x7f, 0x2a, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+        {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, {0x00, 0x1c, 0x22, 0x41, 0x00},
+        {0x00, 0x41, 0x22, 0x1c, 0x00}, {0x08, 0x2a, 0x1c, 0x2a, 0x08}, {0x08, 0x08, 0x3e, 0x08, 0x08},
+        {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00},
+        {0x20, 0x10, 0x08, 0x04, 0x02}, {0x3e, 0x51, 0x49, 0x45, 0x3e}, {0x00, 0x42, 0x7f, 0x40, 0x00},
+        {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4b, 0x31}, {0x18, 0x14, 0x12, 0x7f, 0x10},
+        {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3c, 0x4a, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+        {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1e}, {0x00, 0x36, 0x36, 0x00, 0x00},
+        {0x00, 0x56, 0x36, 0x00, 0x00}, {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+        {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, {0x32, 0x49, 0x79, 0x41, 0x3e},
+        {0x7e, 0x11, 0x11, 0x11, 0x7e}, {0x7f, 0x49, 0x49, 0x49, 0x36}, {0x3e, 0x41, 0x41, 0x41, 0x22},
+        {0x7f, 0x41, 0x41, 0x22, 0x1c}, {0x7f, 0x49, 0x49, 0x49, 0x41}, {0x7f, 0x09, 0x09, 0x09, 0x01},
+        {0x3e, 0x41, 0x49, 0x49, 0x7a}, {0x7f, 0x08, 0x08, 0x08, 0x7f}, {0x00, 0x41, 0x7f, 0x41, 0x00},
+        {0x20, 0x40, 0x41, 0x3f, 0x01}, {0x7f, 0x08, 0x14, 0x22, 0x41}, {0x7f, 0x40, 0x40, 0x40, 0x40},
+        {0x7f, 0x02, 0x0c, 0x02, 0x7f}, {0x7f, 0x04, 0x08, 0x10, 0x7f}, {0x3e, 0x41, 0x41, 0x41, 0x3e},
+        {0x7f, 0x09, 0x09, 0x09, 0x06}, {0x3e, 0x41, 0x51, 0x21, 0x5e}, {0x7f, 0x09, 0x19, 0x29, 0x46},
+        {0x46, 0x49, 0x49, 0x49, 0x31}, {0x01, 0x01, 0x7f, 0x01, 0x01}, {0x3f, 0x40, 0x40, 0x40, 0x3f},
+        {0x1f, 0x20, 0x40, 0x20, 0x1f}, {0x3f, 0x40, 0x38, 0x40, 0x3f}, {0x63, 0x14, 0x08, 0x14, 0x63},
+        {0x07, 0x08, 0x70, 0x08, 0x07}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7f, 0x41, 0x41, 0x00},
+        {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7f, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04},
+        {0x40, 0x40, 0x40, 0x40, 0x40}, {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+        {0x7f, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20}, {0x38, 0x44, 0x44, 0x48, 0x7f},
+        {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7e, 0x09, 0x01, 0x02}, {0x0c, 0x52, 0x52, 0x52, 0x3e},
+        {0x7f, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7d, 0x40, 0x00}, {0x20, 0x40, 0x44, 0x3d, 0x00},
+        {0x7f, 0x10, 0x28, 0x44, 0x00}, {0x00, 0x41, 0x7f, 0x40, 0x00}, {0x7c, 0x04, 0x18, 0x04, 0x78},
+        {0x7c, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, {0x7c, 0x14, 0x14, 0x14, 0x08},
+        {0x08, 0x14, 0x14, 0x18, 0x7c}, {0x7c, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+        {0x04, 0x3f, 0x44, 0x40, 0x20}, {0x3c, 0x40, 0x40, 0x20, 0x7c}, {0x1c, 0x20, 0x40, 0x20, 0x1c},
+        {0x3c, 0x40, 0x30, 0x40, 0x3c}, {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0c, 0x50, 0x50, 0x50, 0x3c},
+        {0x44, 0x64, 0x54, 0x4c, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, {0x00, 0x00, 0x7f, 0x00, 0x00},
+        {0x00, 0x41, 0x36, 0x08, 0x00}, {0x10, 0x08, 0x08, 0x10, 0x08},
+};
+constexpr int kGlyphWidth = 5;
+constexpr int kGlyphHeight = 7;
+// a column of space after every glyph
+constexpr int kGlyphAdvance = kGlyphWidth + 1;
+
+void fill_rect(std::vector<uint32_t> &pixels, int stride, int x, int y, int width, int height, uint32_t color) {
+    for (int row = y; row < y + height; row++) {
+        std::fill_n(pixels.begin() + row * stride + x, width, color);
+    }
+}
+}
+
+/**
+ * @class Decorations
+ *
+ * @brief Client-side titlebar for compositors without server-side decorations.
+ *
+ * The titlebar lives on a synchronized subsurface above the parent, software
+ * rendered into SHM buffers. The application's surface and draw are untouched,
+ * the titlebar costs nothing per frame: title and button textures are rendered
+ * only when the title or the activated and maximized state change, and the
+ * titlebar is composed from them and attached only on those changes or a width
+ * change. Being synchronized, each update is shown with the parent's next commit.
+ *
+ * The parent's window geometry should include the titlebar, see get_height().
+ */
+Decorations::Decorations(struct wl_compositor *compositor, struct wl_subcompositor *subcompositor,
+                         struct wl_shm *shm, struct wl_surface *parent, const DecorationsConfig &config) :
+        config_(config),
+        subsurface_(compositor, subcompositor, parent, true),
+        wl_shm_(shm) {
+    subsurface_.set_position(0, -config_.titlebar_height);
+}
+
+void Decorations::set_title(const std::string &title) {
+    if (title == title_) {
+        return;
+    }
+    title_ = title;
+    title_dirty_ = dirty_ = true;
+}
+
+/**
+ * @brief Sets the toplevel state the titlebar reflects, from the latest configure.
+ */
+void Decorations::set_state(bool activated, bool maximized) {
+    if (activated != activated_) {
+        // the title is drawn on the background, which follows the activated state
+        title_dirty_ = buttons_dirty_ = dirty_ = true;
+    }
+    if (maximized != maximized_) {
+        buttons_dirty_ = dirty_ = true;
+    }
+    activated_ = activated;
+    maximized_ = maximized;
+}
+
+/**
+ * @brief Shows or hides the titlebar, e.g. hidden while fullscreen.
+ */
+void Decorations::set_visible(bool visible) {
+    if (visible == visible_) {
+        return;
+    }
+    visible_ = visible;
+    dirty_ = true;
+}
+
+/**
+ * @brief Brings the titlebar up to date for a parent of the given width.
+ *
+ * Cheap when nothing changed, so it can be called before every frame.
+ *
+ * @return true if a new titlebar was attached, to be shown with the parent's next commit.
+ */
+bool Decorations::update(int width) {
+    if (width <= 0 || (width == width_ && !dirty_)) {
+        return false;
+    }
+    if (!visible_) {
+        wl_surface_attach(subsurface_.get_surface(), nullptr, 0, 0);
+        subsurface_.commit();
+        width_ = width;
+        dirty_ = false;
+        return true;
+    }
+    if (!shm_) {
+        shm_ = subsurface_.create_shm_window(wl_shm_, width, config_.titlebar_height, {WL_SHM_FORMAT_XRGB8888, 2});
+    } else {
+        shm_->resize(width, config_.titlebar_height);
+    }
+    if (title_dirty_) {
+        render_title();
+    }
+    if (buttons_dirty_) {
+        render_buttons();
+    }
+    width_ = width;
+    compose();
+    return !dirty_;
+}
+
+/**
+ * @brief Finds what the point x, y in the titlebar's surface coordinates is on.
+ */
+Decorations::Part Decorations::hit_test(int x, int y) const {
+    const int size = config_.titlebar_height;
+    if (!visible_ || x < 0 || y < 0 || x >= width_ || y >= size) {
+        return PART_NONE;
+    }
+    // buttons from the right: close, maximize, minimize
+    const int from_right = (width_ - 1 - x) / size;
+    switch (from_right) {
+        case 0:
+            return PART_CLOSE;
+        case 1:
+            return PART_MAXIMIZE;
+        case 2:
+            return PART_MINIMIZE;
+        default:
+            return PART_TITLEBAR;
+    }
+}
+
+void Decorations::render_title() {
+    title_dirty_ = false;
+    const int scale = std::max(1, config_.titlebar_height / 16);
+    auto &texture = title_texture_;
+    texture.width = static_cast<int>(title_.size()) * kGlyphAdvance * scale;
+    texture.height = kGlyphHeight * scale;
+    texture.pixels.assign(static_cast<size_t>(texture.width) * texture.height, 0);
+
+    int pen = 0;
+    for (const char c: title_) {
+        const auto index = (c >= 0x20 && c <= 0x7e) ? c - 0x20 : '?' - 0x20;
+        for (int column = 0; column < kGlyphWidth; column++) {
+            for (int row = 0; row < kGlyphHeight; row++) {
+                if (kFont[index][column] & (1 << row)) {
+                    fill_rect(texture.pixels, texture.width, pen + column * scale, row * scale, scale, scale,
+                              config_.title_color);
+                }
+            }
+        }
+        pen += kGlyphAdvance * scale;
+    }
+}
+
+void Decorations::render_buttons() {
+    buttons_dirty_ = false;
+    const int size = config_.titlebar_height;
+    const int inset = size / 3;
+    const int extent = size - 2 * inset;
+    const int line = std::max(1, size / 16);
+    const uint32_t color = activated_ ? config_.button_color : config_.button_color & 0x7f7f7f7f;
+
+    for (auto &texture: button_textures_) {
+        texture.width = texture.height = size;
+        texture.pixels.assign(static_cast<size_t>(size) * size, 0);
+    }
+    // minimize: a bar at the bottom
+    fill_rect(button_textures_[0].pixels, size, inset, size - inset - line, extent, line, color);
+    // maximize: a box, with a second one behind it when maximized, the restore icon
+    auto box = [&](std::vector<uint32_t> &pixels, int x, int y, int side) {
+        fill_rect(pixels, size, x, y, side, line, color);
+        fill_rect(pixels, size, x, y + side - line, side, line, color);
+        fill_rect(pixels, size, x, y, line, side, color);
+        fill_rect(pixels, size, x + side - line, y, line, side, color);
+    };
+    if (maximized_) {
+        const int offset = std::max(2, extent / 4);
+        box(button_textures_[1].pixels, inset + offset, inset, extent - offset);
+        box(button_textures_[1].pixels, inset, inset + offset, extent - offset);
+    } else {
+        box(button_textures_[1].pixels, inset, inset, extent);
+    }
+    // close: both diagonals
+    for (int i = 0; i < extent; i++) {
+        fill_rect(button_textures_[2].pixels, size, inset + i, inset + i, line, line, color);
+        fill_rect(button_textures_[2].pixels, size, inset + extent - line - i, inset + i, line, line, color);
+    }
+}
+
+void Decorations::compose() {
+    auto *buffer = shm_->acquire();
+    if (!buffer) {
+        // both buffers still held, dirty_ stays set and the next update() retries
+        return;
+    }
+    const auto &kernels = get_pixel_kernels();
+    const int height = config_.titlebar_height;
+    kernels.fill(buffer->data, buffer->stride, buffer->width, buffer->height,
+                 activated_ ? config_.active_color : config_.inactive_color);
+
+    auto blit = [&](const Texture &texture, int x, int y, int max_width) {
+        const int width = std::min(texture.width, max_width);
+        if (width <= 0 || x < 0 || y < 0 || y + texture.height > buffer->height) {
+            return;
+        }
+        auto *dst = static_cast<uint8_t *>(buffer->data) + static_cast<size_t>(y) * buffer->stride + x * 4;
+        kernels.blend_over(dst, buffer->stride, texture.pixels.data(), texture.width * 4, width, texture.height);
+    };
+    const int buttons_x = width_ - static_cast<int>(button_textures_.size()) * height;
+    for (size_t i = 0; i < button_textures_.size(); i++) {
+        blit(button_textures_[i], buttons_x + static_cast<int>(i) * height, 0, height);
+    }
+    const int margin = height / 4;
+    blit(title_texture_, margin, (height - title_texture_.height) / 2, buttons_x - 2 * margin);
+
+    shm_->attach(buffer);
+    subsurface_.commit();
+    dirty_ = false;
+}
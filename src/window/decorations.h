@@ -0,0 +1,110 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_DECORATIONS_H_
+#define SRC_WINDOW_DECORATIONS_H_
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "subsurface.h"
+#include "utils/export.h"
+
+struct DecorationsConfig {
+    // titlebar height in surface coordinates, the buttons are square
+    int titlebar_height{32};
+    // ARGB8888
+    uint32_t active_color{0xff303030};
+    uint32_t inactive_color{0xff585858};
+    uint32_t title_color{0xffe0e0e0};
+    uint32_t button_color{0xffc0c0c0};
+};
+
+class WAYPP_EXPORT Decorations {
+public:
+    // what a point on the titlebar belongs to
+    typedef enum {
+        PART_NONE,
+        PART_TITLEBAR,
+        PART_MINIMIZE,
+        PART_MAXIMIZE,
+        PART_CLOSE,
+    } Part;
+
+    Decorations(struct wl_compositor *compositor, struct wl_subcompositor *subcompositor, struct wl_shm *shm,
+                struct wl_surface *parent, const DecorationsConfig &config = {});
+
+    Decorations(const Decorations &) = delete;
+
+    Decorations &operator=(const Decorations &) = delete;
+
+    void set_title(const std::string &title);
+
+    void set_state(bool activated, bool maximized);
+
+    void set_visible(bool visible);
+
+    [[nodiscard]] bool is_visible() const { return visible_; }
+
+    bool update(int width);
+
+    [[nodiscard]] Part hit_test(int x, int y) const;
+
+    // space taken above the parent surface, 0 while hidden
+    [[nodiscard]] int get_height() const { return visible_ ? config_.titlebar_height : 0; }
+
+    [[nodiscard]] struct wl_surface *get_surface() const { return subsurface_.get_surface(); }
+
+private:
+    // premultiplied ARGB8888, rendered once and blended into the titlebar on every update
+    struct Texture {
+        std::vector<uint32_t> pixels;
+        int width;
+        int height;
+    };
+
+    DecorationsConfig config_;
+    SubSurface subsurface_;
+    struct wl_shm *wl_shm_;
+    // created by the first update(), once the width is known
+    WindowShm *shm_{};
+
+    std::string title_;
+    bool activated_{};
+    bool maximized_{};
+    bool visible_{true};
+    int width_{};
+
+    Texture title_texture_{};
+    // minimize, maximize, close
+    std::array<Texture, 3> button_textures_{};
+    bool title_dirty_{true};
+    bool buttons_dirty_{true};
+    // the titlebar needs composing and attaching
+    bool dirty_{true};
+
+    void render_title();
+
+    void render_buttons();
+
+    void compose();
+};
+
+#endif // SRC_WINDOW_DECORATIONS_H_
@@ -0,0 +1,205 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "drm_syncobj.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <xf86drm.h>
+
+#include "utils/logging.h"
+
+/**
+ * @class DrmSyncobjTimeline
+ * @brief A DRM timeline syncobj shared with the compositor through wp_linux_drm_syncobj_v1.
+ *
+ * Each point on the timeline is a fence: GPU work is attached to a point by importing
+ * its sync_file, and the compositor signals release points once it is done with a
+ * buffer. Unlike implicit sync nothing is tracked per dmabuf by the kernel, and the
+ * client never stalls in glFinish().
+ *
+ * @param manager The wp_linux_drm_syncobj_manager_v1 global.
+ * @param device  The DRM device, e.g. the dmabuf feedback main device.
+ * @throws std::runtime_error if the device has no render node or no timeline syncobjs.
+ */
+DrmSyncobjTimeline::DrmSyncobjTimeline(struct wp_linux_drm_syncobj_manager_v1 *manager, dev_t device) {
+    drmDevicePtr drm_device = nullptr;
+    if (drmGetDeviceFromDevId(device, 0, &drm_device) != 0) {
+        throw std::runtime_error("drmGetDeviceFromDevId failed.");
+    }
+    if (drm_device->available_nodes & (1 << DRM_NODE_RENDER)) {
+        drm_fd_ = open(drm_device->nodes[DRM_NODE_RENDER], O_RDWR | O_CLOEXEC);
+    }
+    drmFreeDevice(&drm_device);
+    if (drm_fd_ < 0) {
+        throw std::runtime_error("No DRM render node for the syncobj timeline.");
+    }
+
+    uint64_t timeline_cap = 0;
+    if (drmGetCap(drm_fd_, DRM_CAP_SYNCOBJ_TIMELINE, &timeline_cap) != 0 || !timeline_cap ||
+        drmSyncobjCreate(drm_fd_, 0, &handle_) != 0) {
+        close(drm_fd_);
+        throw std::runtime_error("DRM timeline syncobjs are not supported.");
+    }
+
+    int syncobj_fd = -1;
+    if (drmSyncobjHandleToFD(drm_fd_, handle_, &syncobj_fd) != 0) {
+        drmSyncobjDestroy(drm_fd_, handle_);
+        close(drm_fd_);
+        throw std::runtime_error(std::string("drmSyncobjHandleToFD failed: ") + strerror(errno));
+    }
+    wp_timeline_ = wp_linux_drm_syncobj_manager_v1_import_timeline(manager, syncobj_fd);
+    close(syncobj_fd);
+}
+
+DrmSyncobjTimeline::~DrmSyncobjTimeline() {
+    if (wp_timeline_) {
+        wp_linux_drm_syncobj_timeline_v1_destroy(wp_timeline_);
+    }
+    drmSyncobjDestroy(drm_fd_, handle_);
+    close(drm_fd_);
+}
+
+/**
+ * @brief Makes a point signal together with a sync_file, e.g. from Egl::create_native_fence().
+ *
+ * @param point        The timeline point.
+ * @param sync_file_fd The fence, always consumed.
+ * @return false if the fence could not be imported.
+ */
+bool DrmSyncobjTimeline::import_sync_file(uint64_t point, int sync_file_fd) const {
+    if (sync_file_fd < 0) {
+        return false;
+    }
+    // sync_files only import into binary syncobjs, transfer from one into the point
+    uint32_t binary = 0;
+    bool result = drmSyncobjCreate(drm_fd_, 0, &binary) == 0;
+    if (result) {
+        result = drmSyncobjImportSyncFile(drm_fd_, binary, sync_file_fd) == 0 &&
+                 drmSyncobjTransfer(drm_fd_, handle_, point, binary, 0, 0) == 0;
+        drmSyncobjDestroy(drm_fd_, binary);
+    }
+    close(sync_file_fd);
+    return result;
+}
+
+/**
+ * @brief Exports the fence of a point, to wait for it on the GPU with Egl::wait_native_fence().
+ *
+ * A point whose fence has not been submitted yet, e.g. by a producer on another
+ * thread, is waited for, up to the kernel's submit timeout.
+ *
+ * @param point The timeline point.
+ * @return A sync_file fd owned by the caller, or -1 on failure; errno is ETIME if
+ *         no fence was submitted for the point in time.
+ */
+int DrmSyncobjTimeline::export_sync_file(uint64_t point) const {
+    uint32_t binary = 0;
+    if (drmSyncobjCreate(drm_fd_, 0, &binary) != 0) {
+        return -1;
+    }
+    int fd = -1;
+    if (drmSyncobjTransfer(drm_fd_, binary, 0, handle_, point, DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT) != 0 ||
+        drmSyncobjExportSyncFile(drm_fd_, binary, &fd) != 0) {
+        const int error = errno;
+        if (error == ETIME) {
+            LOG_WARN("DrmSyncobjTimeline: no fence submitted for point %llu", static_cast<unsigned long long>(point));
+        }
+        drmSyncobjDestroy(drm_fd_, binary);
+        errno = error;
+        return -1;
+    }
+    drmSyncobjDestroy(drm_fd_, binary);
+    return fd;
+}
+
+/**
+ * @brief Signals a point from the CPU, for buffers written without the GPU.
+ */
+bool DrmSyncobjTimeline::signal(uint64_t point) const {
+    return drmSyncobjTimelineSignal(drm_fd_, &handle_, &point, 1) == 0;
+}
+
+/**
+ * @return true if the timeline has reached point.
+ */
+bool DrmSyncobjTimeline::is_signaled(uint64_t point) const {
+    uint32_t handle = handle_;
+    uint64_t value = 0;
+    return drmSyncobjQuery(drm_fd_, &handle, &value, 1) == 0 && value >= point;
+}
+
+/**
+ * @brief Blocks until the timeline reaches point.
+ *
+ * @param point      The timeline point.
+ * @param timeout_ns The relative timeout in nanoseconds.
+ * @return false on timeout or error.
+ */
+bool DrmSyncobjTimeline::wait(uint64_t point, int64_t timeout_ns) const {
+    timespec now{};
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int64_t deadline = static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec + timeout_ns;
+    uint32_t handle = handle_;
+    return drmSyncobjTimelineWait(drm_fd_, &handle, &point, 1, deadline,
+                                  DRM_SYNCOBJ_WAIT_FLAGS_WAIT_FOR_SUBMIT, nullptr) == 0;
+}
+
+/**
+ * @class DrmSyncobjSurface
+ * @brief The explicit synchronization state of a surface.
+ *
+ * Once created, every commit that attaches a buffer must carry an acquire and a release
+ * point, the compositor no longer relies on implicit fences in the dmabuf. Points are
+ * double-buffered state, applied with the next commit.
+ *
+ * @param manager The wp_linux_drm_syncobj_manager_v1 global.
+ * @param surface The surface; it may have only one syncobj surface.
+ */
+DrmSyncobjSurface::DrmSyncobjSurface(struct wp_linux_drm_syncobj_manager_v1 *manager,
+                                     struct wl_surface *surface) :
+        wp_syncobj_surface_(wp_linux_drm_syncobj_manager_v1_get_surface(manager, surface)) {
+}
+
+DrmSyncobjSurface::~DrmSyncobjSurface() {
+    wp_linux_drm_syncobj_surface_v1_destroy(wp_syncobj_surface_);
+}
+
+/**
+ * @brief Sets the point the compositor waits for before reading the attached buffer.
+ */
+void DrmSyncobjSurface::set_acquire_point(const DrmSyncobjTimeline &timeline, uint64_t point) const {
+    wp_linux_drm_syncobj_surface_v1_set_acquire_point(wp_syncobj_surface_, timeline.get_timeline(),
+                                                      static_cast<uint32_t>(point >> 32),
+                                                      static_cast<uint32_t>(point));
+}
+
+/**
+ * @brief Sets the point the compositor signals once it is done with the attached buffer.
+ */
+void DrmSyncobjSurface::set_release_point(const DrmSyncobjTimeline &timeline, uint64_t point) const {
+    wp_linux_drm_syncobj_surface_v1_set_release_point(wp_syncobj_surface_, timeline.get_timeline(),
+                                                      static_cast<uint32_t>(point >> 32),
+                                                      static_cast<uint32_t>(point));
+}
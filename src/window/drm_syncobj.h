@@ -0,0 +1,76 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_DRM_SYNCOBJ_H_
+#define SRC_WINDOW_DRM_SYNCOBJ_H_
+
+#include <cstdint>
+
+#include <sys/types.h>
+
+#include <wayland-client.h>
+
+#include "linux-drm-syncobj-v1-client-protocol.h"
+#include "utils/export.h"
+
+class WAYPP_EXPORT DrmSyncobjTimeline {
+public:
+    explicit DrmSyncobjTimeline(struct wp_linux_drm_syncobj_manager_v1 *manager, dev_t device);
+
+    ~DrmSyncobjTimeline();
+
+    DrmSyncobjTimeline(const DrmSyncobjTimeline &) = delete;
+
+    DrmSyncobjTimeline &operator=(const DrmSyncobjTimeline &) = delete;
+
+    [[nodiscard]] struct wp_linux_drm_syncobj_timeline_v1 *get_timeline() const { return wp_timeline_; }
+
+    bool import_sync_file(uint64_t point, int sync_file_fd) const;
+
+    [[nodiscard]] int export_sync_file(uint64_t point) const;
+
+    bool signal(uint64_t point) const;
+
+    [[nodiscard]] bool is_signaled(uint64_t point) const;
+
+    bool wait(uint64_t point, int64_t timeout_ns) const;
+
+private:
+    int drm_fd_{-1};
+    uint32_t handle_{};
+    struct wp_linux_drm_syncobj_timeline_v1 *wp_timeline_{};
+};
+
+class WAYPP_EXPORT DrmSyncobjSurface {
+public:
+    explicit DrmSyncobjSurface(struct wp_linux_drm_syncobj_manager_v1 *manager, struct wl_surface *surface);
+
+    ~DrmSyncobjSurface();
+
+    DrmSyncobjSurface(const DrmSyncobjSurface &) = delete;
+
+    DrmSyncobjSurface &operator=(const DrmSyncobjSurface &) = delete;
+
+    void set_acquire_point(const DrmSyncobjTimeline &timeline, uint64_t point) const;
+
+    void set_release_point(const DrmSyncobjTimeline &timeline, uint64_t point) const;
+
+private:
+    struct wp_linux_drm_syncobj_surface_v1 *wp_syncobj_surface_;
+};
+
+#endif // SRC_WINDOW_DRM_SYNCOBJ_H_
@@ -16,125 +16,165 @@
 
 #include "egl.h"
 
-#include <iostream>
+#include <algorithm>
+#include <ctime>
+#include <stdexcept>
 
-#include <cstdlib>
-#include <cstring>
+#include <unistd.h>
 
+#include <wayland-client.h>
+
+#include "utils/logging.h"
+#include "utils/trace.h"
+
+namespace {
+// what this thread last bound through Egl::bind_current(), trusted until invalidate_current()
+struct Binding {
+    EGLDisplay display;
+    EGLSurface draw;
+    EGLSurface read;
+    EGLContext context;
+    bool valid;
+};
+
+thread_local Binding current_binding{};
+
+uint64_t monotonic_ns() {
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+}
 
 /**
- * @brief The Egl class represents an EGL object used for OpenGL rendering.
+ * @brief The Egl class represents the per-window EGL state used for OpenGL rendering.
  *
- * This class provides functionality for initializing EGL, choosing an EGL configuration,
- * creating an EGL context, and managing various EGL extensions.
+ * Display initialization and the shared contexts live in EglDisplay, which also
+ * caches the config chosen for each attribute set. An Egl renders with the display's
+ * shared context unless own_context is set, or the shared context cannot render to
+ * the chosen config, in which case it creates a context sharing objects with it. In
+ * single context mode, see EglDisplay::set_single_context(), the latter case falls
+ * back to the display's config instead, so all windows render with one context and
+ * switching windows only rebinds the surface.
+ *
+ * @param display     The process-wide EGL display state.
+ * @param attribs     The config attributes of the window surface.
+ * @param own_context Whether to create a context for this window, e.g. for a render thread.
  */
-Egl::Egl(struct wl_display *display) {
-    dpy_ = eglGetDisplay(display);
-    EGLBoolean ret = eglInitialize(dpy_, &major_, &minor_);
-    if (ret == EGL_FALSE) {
-        throw std::runtime_error("eglInitialize failed.");
+Egl::Egl(const EglDisplay *display, const EglConfigAttribs &attribs, bool own_context) :
+        egl_display_(display),
+        dpy_(display->get_display()),
+        config_(display->choose_config(attribs)),
+        context_(display->get_context()),
+        owns_context_(false) {
+    if (!config_) {
+        throw std::runtime_error("eglChooseConfig failed.");
     }
-
-    ret = eglBindAPI(EGL_OPENGL_ES_API);
-    if (ret == EGL_FALSE) {
-        throw std::runtime_error("eglBindAPI failed.");
+    if (!own_context && display->is_single_context() && config_ != display->get_config() &&
+        !display->has_no_config_context()) {
+        // the shared context can only render to surfaces of its own config
+        LOG_INFO("single context mode: rendering with the display's default EGL config");
+        config_ = display->get_config();
     }
-
-    EGLint count;
-    ret = eglGetConfigs(dpy_, nullptr, 0, &count);
-    if (ret == EGL_FALSE) {
-        throw std::runtime_error("eglGetConfigs failed.");
+    if (own_context || (config_ != display->get_config() && !display->has_no_config_context())) {
+        const auto context = display->create_context(config_);
+        if (context == EGL_NO_CONTEXT) {
+            throw std::runtime_error("eglCreateContext failed.");
+        }
+        context_ = context;
+        owns_context_ = true;
     }
+}
 
-    auto *configs = static_cast<EGLConfig *>(
-            calloc(static_cast<size_t>(count), sizeof(EGLConfig)));
-
-    EGLint n;
-    ret = eglChooseConfig(dpy_, kEglConfigAttribs.data(), configs, count, &n);
-    if (ret == EGL_FALSE) {
-        throw std::runtime_error("eglChooseConfig failed");
+/**
+ * @brief Destructor for the Egl class.
+ *
+ * Destroys the window's own context, if any. The EGL display is terminated by EglDisplay.
+ */
+Egl::~Egl() {
+    if (gpu_timer_) {
+        // the surface is gone, the subclass disables the timer while it still exists
+        gpu_timer_->abandon();
     }
-
-    EGLint size;
-    for (EGLint i = 0; i < n; i++) {
-        ret = eglGetConfigAttrib(dpy_, configs[i], EGL_BUFFER_SIZE, &size);
-        if (ret == EGL_FALSE) {
-            throw std::runtime_error("eglGetConfigAttrib failed");
-        }
-        if (buffer_size_ <= size) {
-            std::memcpy(&config_, &configs[i], sizeof(EGLConfig));
-            break;
-        }
+    if (owns_context_) {
+        release_current(EGL_NO_SURFACE, context_);
+        eglDestroyContext(dpy_, context_);
     }
-    free(configs);
-
-    context_ = eglCreateContext(dpy_, config_, EGL_NO_CONTEXT,
-                                kEglContextAttribs.data());
-
-    resource_context_ =
-            eglCreateContext(dpy_, config_, context_, kEglContextAttribs.data());
-
-    texture_context_ =
-            eglCreateContext(dpy_, config_, context_, kEglContextAttribs.data());
+}
 
-    // frame callback requires non-blocking
-#if 0 // Failing
-    ret = eglSwapInterval(dpy_, 0);
-    if (ret == EGL_FALSE) {
-        throw std::runtime_error("eglSwapInterval failed");
+/**
+ * @brief Binds a context and surfaces to the calling thread unless they are bound already.
+ *
+ * eglMakeCurrent takes a driver lock and can cost 50-200 us even when nothing changes,
+ * and so can querying the current binding. The binding made last on each thread is
+ * therefore cached, and a call matching it returns without entering EGL. Code that
+ * binds through EGL directly must call invalidate_current() afterwards.
+ *
+ * @return false if eglMakeCurrent failed.
+ */
+bool Egl::bind_current(EGLDisplay display, EGLSurface draw, EGLSurface read, EGLContext context) {
+    auto &binding = current_binding;
+    if (binding.valid && binding.context == context &&
+        (context == EGL_NO_CONTEXT ||
+         (binding.display == display && binding.draw == draw && binding.read == read))) {
+        return true;
     }
-#endif
-
-    (void) make_current();
-
-#if !defined(NDEBUG)
-    egl_khr_debug_init();
-#endif
-
-    const auto extensions = eglQueryString(dpy_, EGL_EXTENSIONS);
-
-    // setup for Damage Region Management
-    if (has_egl_extension(extensions, "EGL_EXT_swap_buffers_with_damage")) {
-        pfSwapBufferWithDamage_ =
-                reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC>(
-                        eglGetProcAddress("eglSwapBuffersWithDamageEXT"));
-    } else if (has_egl_extension(extensions, "EGL_KHR_swap_buffers_with_damage")) {
-        pfSwapBufferWithDamage_ =
-                reinterpret_cast<PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC>(
-                        eglGetProcAddress("eglSwapBuffersWithDamageKHR"));
+    if (eglMakeCurrent(display, draw, read, context) != EGL_TRUE) {
+        binding.valid = false;
+        return false;
     }
+    binding = {display, draw, read, context, true};
+    return true;
+}
 
-    if (has_egl_extension(extensions, "EGL_KHR_partial_update")) {
-        pfSetDamageRegion_ = reinterpret_cast<PFNEGLSETDAMAGEREGIONKHRPROC>(
-                eglGetProcAddress("eglSetDamageRegionKHR"));
+/**
+ * @brief Unbinds the calling thread if it uses surface or context, before they are destroyed.
+ *
+ * Also keeps the cache from matching a new object that reuses a destroyed handle.
+ */
+void Egl::release_current(EGLSurface surface, EGLContext context) {
+    const auto &binding = current_binding;
+    bool bound;
+    if (binding.valid) {
+        bound = (surface != EGL_NO_SURFACE && (binding.draw == surface || binding.read == surface)) ||
+                (context != EGL_NO_CONTEXT && binding.context == context);
+    } else {
+        bound = (surface != EGL_NO_SURFACE &&
+                 (eglGetCurrentSurface(EGL_DRAW) == surface || eglGetCurrentSurface(EGL_READ) == surface)) ||
+                (context != EGL_NO_CONTEXT && eglGetCurrentContext() == context);
+    }
+    if (bound) {
+        const auto display = binding.valid ? binding.display : eglGetCurrentDisplay();
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        current_binding = {display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT, true};
     }
-
-    has_egl_ext_buffer_age_ = has_egl_extension(extensions, "EGL_EXT_buffer_age");
-
-    (void) clear_current();
 }
 
 /**
- * @brief Destructor for the Egl class.
+ * @brief Forgets the cached binding of the calling thread.
  *
- * This destructor terminates the EGL display and releases resources associated with the EGL thread.
+ * Call after binding through EGL directly, e.g. from a toolkit sharing the thread, so the
+ * next bind_current() enters EGL again.
  */
-Egl::~Egl() {
-    eglTerminate(dpy_);
-    eglReleaseThread();
+void Egl::invalidate_current() {
+    current_binding.valid = false;
 }
 
 /**
  * \brief Make the EGL context current.
  *
- * This function checks if the current EGL context is different from the stored context_.
- * If it is different, it calls eglMakeCurrent to make the stored context_ the current context.
+ * Binds context_ with this window's surface, skipping EGL entirely when the calling
+ * thread already has exactly that binding, see bind_current().
  *
  * \return True if the context was made current successfully, false otherwise.
  */
 bool Egl::make_current() const {
-    if (eglGetCurrentContext() != context_) {
-        eglMakeCurrent(dpy_, egl_surface_, egl_surface_, context_);
+    // the shared context is current on several surfaces in turn, so the surface is part of the binding
+    if (!bind_current(dpy_, egl_surface_, egl_surface_, context_)) {
+        return false;
+    }
+    if (gpu_timer_ && !gpu_timer_->is_active()) {
+        (void) gpu_timer_->begin();
     }
     return true;
 }
@@ -142,17 +182,13 @@ bool Egl::make_current() const {
 /**
  * @brief Clears the current EGL context.
  *
- * This function checks if there is a current EGL context using `eglGetCurrentContext()`.
- * If a current context exists, it calls `eglMakeCurrent()` with
- * `EGL_NO_SURFACE`, `EGL_NO_SURFACE`, and `EGL_NO_CONTEXT` as parameters to clear the current context.
+ * Releases the calling thread's context and surfaces, unless nothing is bound.
+ * Rendering threads that only ever use one window need not call it between frames.
  *
  * @return true if the current context was cleared successfully, false otherwise.
  */
 bool Egl::clear_current() const {
-    if (eglGetCurrentContext() != EGL_NO_CONTEXT) {
-        eglMakeCurrent(dpy_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
-    }
-    return true;
+    return bind_current(dpy_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
 }
 
 /**
@@ -163,158 +199,274 @@ bool Egl::clear_current() const {
  * @return True if the swap was successful, false otherwise.
  */
 bool Egl::swap_buffers() const {
+    TRACE_SCOPE("eglSwapBuffers");
+    if (gpu_timer_) {
+        gpu_timer_->end();
+    }
+    const auto start = monotonic_ns();
     eglSwapBuffers(dpy_, egl_surface_);
+    record_swap_time(monotonic_ns() - start);
     return true;
 }
 
 /**
- * @brief Checks if the resource context is currently active and makes it current if not.
+ * @brief Swaps buffers, limiting the damage posted to the compositor to the given rectangles.
  *
- * This function checks if the resource context is currently active using eglGetCurrentContext().
- * If the current context is not equal to the resource context, it calls eglMakeCurrent() to make
- * the resource context current. Finally, it returns true to indicate that the operation was successful.
+ * Uses eglSwapBuffersWithDamage{EXT,KHR} when available; otherwise the rectangles are
+ * posted on the wl_surface before a plain eglSwapBuffers. An empty damage list means
+ * full damage. The damage is recorded for begin_frame() of later frames.
  *
- * @return true if the resource context is successfully made current, false otherwise.
+ * @param damage The changed regions of the buffer, in buffer coordinates with a top-left origin.
+ * @return True if the swap was successful, false otherwise.
  */
-bool Egl::make_resource_current() const {
-    if (eglGetCurrentContext() != context_) {
-        eglMakeCurrent(dpy_, EGL_NO_SURFACE, EGL_NO_SURFACE, resource_context_);
+bool Egl::swap_buffers(const std::vector<Rect> &damage) {
+    TRACE_SCOPE("Egl::swap_buffers");
+    damage_tracker_.record(damage);
+
+    if (damage.empty()) {
+        return swap_buffers();
     }
-    return true;
+
+    if (gpu_timer_) {
+        gpu_timer_->end();
+    }
+
+    if (const auto swap_buffers_with_damage = egl_display_->get_swap_buffers_with_damage()) {
+        auto rects = to_egl_rects(damage);
+        const auto start = monotonic_ns();
+        const auto result = swap_buffers_with_damage(dpy_, egl_surface_, rects.data(),
+                                                     static_cast<EGLint>(damage.size()));
+        record_swap_time(monotonic_ns() - start);
+        return result == EGL_TRUE;
+    }
+
+    if (wl_surface_) {
+        const bool buffer_damage = wl_surface_get_version(wl_surface_) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+        for (const auto &rect: damage) {
+            if (buffer_damage) {
+                wl_surface_damage_buffer(wl_surface_, rect.x, rect.y, rect.width, rect.height);
+            } else {
+                wl_surface_damage(wl_surface_, rect.x, rect.y, rect.width, rect.height);
+            }
+        }
+    }
+    const auto start = monotonic_ns();
+    const auto result = eglSwapBuffers(dpy_, egl_surface_);
+    record_swap_time(monotonic_ns() - start);
+    return result == EGL_TRUE;
 }
 
 /**
- * @brief Checks if the texture context is the current context and makes it the current context if not.
+ * @brief Makes the driver dequeue the next back buffer, waiting for the compositor to release one if need be.
  *
- * This function checks if the texture context is the current context using eglGetCurrentContext() function. If it is not,
- * it calls eglMakeCurrent() function to set the texture context as the current context.
+ * With EGL_EXT_buffer_age, querying the age is what dequeues the buffer, so a present
+ * thread can take the wait instead of the thread drawing the next frame. The time it
+ * took is kept as get_last_acquire_time_ns(). Without the extension the wait happens at
+ * the first draw of the next frame.
+ */
+void Egl::acquire_back_buffer() const {
+    if (!egl_display_->has_ext_buffer_age()) {
+        return;
+    }
+    TRACE_SCOPE("Egl::acquire_back_buffer");
+    const auto start = monotonic_ns();
+    EGLint age = 0;
+    eglQuerySurface(dpy_, egl_surface_, EGL_BUFFER_AGE_EXT, &age);
+    const auto elapsed = monotonic_ns() - start;
+    last_acquire_ns_.store(elapsed, std::memory_order_relaxed);
+    if (elapsed > kBlockedSwapNs) {
+        blocked_swaps_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Keeps the time spent in eglSwapBuffers, counting swaps long enough to have waited.
+ */
+void Egl::record_swap_time(uint64_t elapsed_ns) const {
+    last_swap_ns_.store(elapsed_ns, std::memory_order_relaxed);
+    if (elapsed_ns > max_swap_ns_.load(std::memory_order_relaxed)) {
+        max_swap_ns_.store(elapsed_ns, std::memory_order_relaxed);
+    }
+    if (elapsed_ns > kBlockedSwapNs) {
+        blocked_swaps_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Computes the region to repaint for the back buffer about to be rendered.
  *
- * @return true if the texture context is made the current context or if it is already the current context, false otherwise.
+ * Must be called with the surface current, before any rendering of the frame. The
+ * back buffer's age (EGL_EXT_buffer_age) selects how many previous frames of
+ * damage it is missing; the result is that damage plus this frame's damage. An
+ * unknown age, or one older than the history, yields the full surface. With
+ * EGL_KHR_partial_update the region is also passed to eglSetDamageRegionKHR so
+ * tilers only load and store the affected tiles.
+ *
+ * @param damage The regions that change in this frame, the same list later given to swap_buffers().
+ * @return The regions of the back buffer the frame must repaint.
  */
-bool Egl::make_texture_current() const {
-    if (eglGetCurrentContext() != texture_context_) {
-        eglMakeCurrent(dpy_, EGL_NO_SURFACE, EGL_NO_SURFACE, texture_context_);
+std::vector<Egl::Rect> Egl::begin_frame(const std::vector<Rect> &damage) {
+    EGLint width = 0;
+    EGLint height = 0;
+    eglQuerySurface(dpy_, egl_surface_, EGL_WIDTH, &width);
+    eglQuerySurface(dpy_, egl_surface_, EGL_HEIGHT, &height);
+
+    EGLint age = 0;
+    if (egl_display_->has_ext_buffer_age()) {
+        const auto start = monotonic_ns();
+        eglQuerySurface(dpy_, egl_surface_, EGL_BUFFER_AGE_EXT, &age);
+        // dequeues the back buffer, unless a present thread already did
+        const auto elapsed = monotonic_ns() - start;
+        if (elapsed > kBlockedSwapNs) {
+            last_acquire_ns_.store(elapsed, std::memory_order_relaxed);
+            blocked_swaps_.fetch_add(1, std::memory_order_relaxed);
+        }
     }
-    return true;
+
+    last_buffer_age_ = age;
+    // a buffer older than the rotation seen so far: the compositor held the others longer
+    if (age > max_buffer_age_) {
+        max_buffer_age_ = age;
+    }
+
+    const auto repaint = damage_tracker_.get_repaint(damage, age, width, height);
+
+    if (const auto set_damage_region = egl_display_->get_set_damage_region()) {
+        auto rects = to_egl_rects(repaint);
+        set_damage_region(dpy_, egl_surface_, rects.data(), static_cast<EGLint>(repaint.size()));
+    }
+    return repaint;
 }
 
 /**
- * @brief Checks if a given EGL extension is supported.
+ * @brief Converts top-left origin rectangles to the bottom-left origin EGL expects.
+ */
+std::vector<EGLint> Egl::to_egl_rects(const std::vector<Rect> &damage) const {
+    EGLint height = 0;
+    eglQuerySurface(dpy_, egl_surface_, EGL_HEIGHT, &height);
+
+    std::vector<EGLint> rects;
+    rects.reserve(damage.size() * 4);
+    for (const auto &rect: damage) {
+        rects.push_back(rect.x);
+        rects.push_back(height - rect.y - rect.height);
+        rects.push_back(rect.width);
+        rects.push_back(rect.height);
+    }
+    return rects;
+}
+
+/**
+ * @brief Makes the resource context current without a surface, unless it already is.
  *
- * This function searches for the specified extension name within the provided extensions string.
- * The extensions string is expected to be in a space-separated format, with each extension name
- * terminated by a space character or a null terminator.
+ * @return true if the resource context is successfully made current, false otherwise.
+ */
+bool Egl::make_resource_current() const {
+    return bind_current(dpy_, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_display_->get_resource_context());
+}
+
+/**
+ * @brief Makes the texture context current without a surface, unless it already is.
  *
- * @param extensions The extensions string to search within.
- * @param name The name of the extension to check for.
- * @return true if the extension is found, false otherwise.
+ * @return true if the texture context is made the current context or if it is already the current context, false otherwise.
  */
-bool Egl::has_egl_extension(const char *extensions, const char *name) {
-    const char *r = strstr(extensions, name);
-    const auto len = strlen(name);
-    // check that the extension name is terminated by space or null terminator
-    return r != nullptr && (r[len] == ' ' || r[len] == 0);
+bool Egl::make_texture_current() const {
+    return bind_current(dpy_, EGL_NO_SURFACE, EGL_NO_SURFACE, egl_display_->get_texture_context());
 }
 
 /**
- * @brief Debug callback for EGL errors.
+ * @brief Starts measuring the GPU time of each frame.
  *
- * This function is called when an EGL error occurs. It prints the error details and additional
- * information to the standard error stream (std::cerr).
+ * From now on the commands issued between make_current() and swap_buffers() are
+ * timed with GL_EXT_disjoint_timer_query. Results arrive a frame or two late and are
+ * never waited for; compare get_last_gpu_time_ns() with the CPU time of the draw,
+ * Window::get_last_render_time_ns(), to tell whether a slow frame was GPU-bound.
+ *
+ * @return false if the context lacks GL_EXT_disjoint_timer_query or cannot be made current.
+ */
+bool Egl::enable_gpu_timer() {
+    if (gpu_timer_) {
+        return true;
+    }
+    if (!make_current()) {
+        return false;
+    }
+    auto timer = std::make_unique<GpuTimer>();
+    if (!timer->is_supported()) {
+        return false;
+    }
+    gpu_timer_ = std::move(timer);
+    return true;
+}
+
+/**
+ * @brief Stops measuring GPU time and deletes the queries.
+ */
+void Egl::disable_gpu_timer() {
+    if (!gpu_timer_) {
+        return;
+    }
+    // moved out first, so make_current() does not start another query
+    const auto timer = std::move(gpu_timer_);
+    if (!make_current()) {
+        // the queries go with the context
+        timer->abandon();
+    }
+}
+
+/**
+ * @brief Exports a fence that signals once the GPU has executed the commands issued so far.
  *
- * @param error The EGL error code.
- * @param command The EGL command associated with the error.
- * @param messageType The EGL message type.
- * @param threadLabel The EGL thread label.
- * @param objectLabel The EGL object label.
- * @param message The error message.
+ * Use it instead of glFinish() when handing a rendered buffer to another consumer, e.g.
+ * as the acquire fence of WindowDmabuf::attach(): the CPU continues immediately and the
+ * consumer waits on the GPU.
  *
- * @return None.
+ * @return A sync_file fd owned by the caller, or -1 without EGL_ANDROID_native_fence_sync.
  */
-void Egl::debug_callback(EGLenum error,
-                         const char *command,
-                         EGLint messageType,
-                         EGLLabelKHR threadLabel,
-                         EGLLabelKHR objectLabel,
-                         const char *message) {
-    std::cerr << "**** EGL Error" << std::endl;
-    std::cerr << "\terror: " << error << std::endl;
-    std::cerr << "\tcommand: " << command << std::endl;
-    switch (error) {
-        case EGL_BAD_ACCESS:
-            std::cerr << "\terror: EGL_BAD_ACCESS" << std::endl;
-            break;
-        case EGL_BAD_ALLOC:
-            std::cerr << "\terror: EGL_BAD_ALLOC" << std::endl;
-            break;
-        case EGL_BAD_ATTRIBUTE:
-            std::cerr << "\terror: EGL_BAD_ATTRIBUTE" << std::endl;
-            break;
-        case EGL_BAD_CONFIG:
-            std::cerr << "\terror: EGL_BAD_CONFIG" << std::endl;
-            break;
-        case EGL_BAD_CONTEXT:
-            std::cerr << "\terror: EGL_BAD_CONTEXT" << std::endl;
-            break;
-        case EGL_BAD_CURRENT_SURFACE:
-            std::cerr << "\terror: EGL_BAD_CURRENT_SURFACE" << std::endl;
-            break;
-        case EGL_BAD_DISPLAY:
-            std::cerr << "\terror: EGL_BAD_DISPLAY" << std::endl;
-            break;
-        case EGL_BAD_MATCH:
-            std::cerr << "\terror: EGL_BAD_MATCH" << std::endl;
-            break;
-        case EGL_BAD_NATIVE_PIXMAP:
-            std::cerr << "\terror: EGL_BAD_NATIVE_PIXMAP" << std::endl;
-            break;
-        case EGL_BAD_NATIVE_WINDOW:
-            std::cerr << "\terror: EGL_BAD_NATIVE_WINDOW" << std::endl;
-            break;
-        case EGL_BAD_PARAMETER:
-            std::cerr << "\terror: EGL_BAD_PARAMETER" << std::endl;
-            break;
-        case EGL_BAD_SURFACE:
-            std::cerr << "\terror: EGL_BAD_SURFACE" << std::endl;
-            break;
-        default:
-            std::cerr << "\terror: " << error << std::endl;
-            break;
-    }
-    std::cerr << "\tmessageType: " << messageType << std::endl;
-    std::cerr << "\tthreadLabel: " << threadLabel << std::endl;
-    std::cerr << "\tobjectLabel: " << objectLabel << std::endl;
-    std::cerr << "\tmessage: " << ((message == nullptr) ? "" : message) << std::endl;
+int Egl::create_native_fence() const {
+    if (!egl_display_->has_native_fence_sync()) {
+        return -1;
+    }
+    const EGLint attribs[] = {EGL_SYNC_NATIVE_FENCE_FD_ANDROID, EGL_NO_NATIVE_FENCE_FD_ANDROID, EGL_NONE};
+    auto sync = egl_display_->get_create_sync()(dpy_, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+    if (sync == EGL_NO_SYNC_KHR) {
+        return -1;
+    }
+    // the fence only gets an fd once it has been flushed; a zero timeout flushes without waiting
+    (void) egl_display_->get_client_wait_sync()(dpy_, sync, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, 0);
+    const auto fd = egl_display_->get_dup_native_fence_fd()(dpy_, sync);
+    egl_display_->get_destroy_sync()(dpy_, sync);
+    return fd == EGL_NO_NATIVE_FENCE_FD_ANDROID ? -1 : fd;
 }
 
 /**
- * @brief Initialize the EGL debugging functionality.
+ * @brief Makes the commands issued after this call wait for a fence, e.g. a buffer release fence.
  *
- * This function initializes the EGL debugging functionality by calling the eglDebugMessageControlKHR function
- * if it is available. The debug_callback function is set as the callback function for EGL debug messages.
+ * The wait happens on the GPU with EGL_KHR_wait_sync, on the CPU otherwise.
  *
- * @note This function requires that the EGL extension EGL_KHR_debug is supported.
+ * @param fence_fd A sync_file fd, always consumed.
+ * @return false if the fence could not be imported.
  */
-void Egl::egl_khr_debug_init() {
-    auto pfDebugMessageControl =
-            reinterpret_cast<PFNEGLDEBUGMESSAGECONTROLKHRPROC>(
-                    eglGetProcAddress("eglDebugMessageControlKHR"));
-
-    if (pfDebugMessageControl) {
-
-        const EGLAttrib sDebugAttribList[] = {
-                EGL_DEBUG_MSG_CRITICAL_KHR,
-                EGL_TRUE,
-                EGL_DEBUG_MSG_ERROR_KHR,
-                EGL_TRUE,
-                EGL_DEBUG_MSG_WARN_KHR,
-                EGL_TRUE,
-                EGL_DEBUG_MSG_INFO_KHR,
-                EGL_TRUE,
-                EGL_NONE,
-                0
-        };
-
-        pfDebugMessageControl(debug_callback, sDebugAttribList);
+bool Egl::wait_native_fence(int fence_fd) const {
+    if (fence_fd < 0) {
+        return false;
+    }
+    if (!egl_display_->has_native_fence_sync()) {
+        close(fence_fd);
+        return false;
     }
+    const EGLint attribs[] = {EGL_SYNC_NATIVE_FENCE_FD_ANDROID, fence_fd, EGL_NONE};
+    auto sync = egl_display_->get_create_sync()(dpy_, EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+    if (sync == EGL_NO_SYNC_KHR) {
+        // EGL only takes ownership of the fd on success
+        close(fence_fd);
+        return false;
+    }
+    if (egl_display_->get_wait_sync()) {
+        (void) egl_display_->get_wait_sync()(dpy_, sync, 0);
+    } else {
+        (void) egl_display_->get_client_wait_sync()(dpy_, sync, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, EGL_FOREVER_KHR);
+    }
+    egl_display_->get_destroy_sync()(dpy_, sync);
+    return true;
 }
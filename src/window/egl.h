@@ -18,13 +18,28 @@
 #define SRC_WINDOW_EGL_H_
 
 #include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
-class Egl {
+#include "damage_tracker.h"
+#include "egl_display.h"
+#include "gpu_timer.h"
+#include "utils/export.h"
+
+class WAYPP_EXPORT Egl {
 public:
-    explicit Egl(struct wl_display *display);
+    typedef DamageRect Rect;
+
+    // a swap or buffer dequeue taking longer waited on the compositor rather than the driver
+    static constexpr uint64_t kBlockedSwapNs = 2000000;
+
+    explicit Egl(const EglDisplay *display, const EglConfigAttribs &attribs = {}, bool own_context = false);
 
     ~Egl();
 
@@ -34,80 +49,99 @@ public:
 
     [[nodiscard]] bool swap_buffers() const;
 
+    [[nodiscard]] bool swap_buffers(const std::vector<Rect> &damage);
+
+    [[nodiscard]] std::vector<Rect> begin_frame(const std::vector<Rect> &damage);
+
+    // age of the last back buffer begin_frame() got, 0 if unknown
+    [[nodiscard]] EGLint get_buffer_age() const { return last_buffer_age_; }
+
+    // the most buffers seen in rotation, more than the buffering asked for means the driver allocated extra ones
+    [[nodiscard]] EGLint get_max_buffer_age() const { return max_buffer_age_; }
+
+    void acquire_back_buffer() const;
+
+    // time spent in eglSwapBuffers by the last swap, readable from any thread
+    [[nodiscard]] uint64_t get_last_swap_time_ns() const { return last_swap_ns_.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] uint64_t get_max_swap_time_ns() const { return max_swap_ns_.load(std::memory_order_relaxed); }
+
+    // time the last dequeue of a back buffer waited, see acquire_back_buffer()
+    [[nodiscard]] uint64_t get_last_acquire_time_ns() const {
+        return last_acquire_ns_.load(std::memory_order_relaxed);
+    }
+
+    // swaps and buffer dequeues that took longer than kBlockedSwapNs
+    [[nodiscard]] uint64_t get_blocked_swap_count() const { return blocked_swaps_.load(std::memory_order_relaxed); }
+
     [[nodiscard]] bool make_resource_current() const;
 
     [[nodiscard]] bool make_texture_current() const;
 
+    static bool bind_current(EGLDisplay display, EGLSurface draw, EGLSurface read, EGLContext context);
+
+    static void release_current(EGLSurface surface, EGLContext context);
+
+    static void invalidate_current();
+
     [[nodiscard]] PFNEGLSETDAMAGEREGIONKHRPROC get_set_damage_region() const {
-        return pfSetDamageRegion_;
+        return egl_display_->get_set_damage_region();
     }
 
     [[nodiscard]] PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC
     get_swap_buffers_with_damage() const {
-        return pfSwapBufferWithDamage_;
+        return egl_display_->get_swap_buffers_with_damage();
     }
 
-    [[maybe_unused]] [[nodiscard]] bool has_ext_buffer_age() const { return has_egl_ext_buffer_age_; }
+    [[maybe_unused]] [[nodiscard]] bool has_ext_buffer_age() const { return egl_display_->has_ext_buffer_age(); }
 
-    [[maybe_unused]] EGLDisplay get_display() { return dpy_; }
+    bool enable_gpu_timer();
 
-    [[maybe_unused]] EGLContext get_texture_context() { return texture_context_; }
+    void disable_gpu_timer();
 
-    friend class WindowEgl;
+    [[nodiscard]] uint64_t get_gpu_time_ns() const { return gpu_timer_ ? gpu_timer_->get_time_ns() : 0; }
 
-private:
-    static constexpr std::array<EGLint, 5> kEglContextAttribs = {
-            {
-                    EGL_CONTEXT_MAJOR_VERSION, 3,
-                    EGL_CONTEXT_MAJOR_VERSION, 2,
-                    EGL_NONE
-            }
-    };
-
-    static constexpr std::array<EGLint, 27> kEglConfigAttribs = {
-            {
-                    EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
-                    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES3_BIT,
-                    EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
-                    EGL_RED_SIZE, 8,
-                    EGL_GREEN_SIZE, 8,
-                    EGL_BLUE_SIZE, 8,
-                    EGL_ALPHA_SIZE, 8,
-                    EGL_STENCIL_SIZE, 8,
-                    EGL_DEPTH_SIZE, 16,
-                    EGL_SAMPLE_BUFFERS, 1,
-                    EGL_SAMPLES, 4,
-                    EGL_NONE // termination sentinel
-            }
-    };
+    [[nodiscard]] uint64_t get_last_gpu_time_ns() const { return gpu_timer_ ? gpu_timer_->get_last_time_ns() : 0; }
 
-    EGLSurface egl_surface_{};
-    EGLConfig config_{};
-    EGLContext texture_context_{};
+    [[nodiscard]] int create_native_fence() const;
 
-    int buffer_size_ = 24;
+    [[nodiscard]] bool wait_native_fence(int fence_fd) const;
 
-    EGLDisplay dpy_{};
-    EGLContext context_{};
-    EGLContext resource_context_{};
+    [[maybe_unused]] EGLDisplay get_display() { return dpy_; }
 
-    EGLint major_{};
-    EGLint minor_{};
+    [[maybe_unused]] EGLContext get_texture_context() { return egl_display_->get_texture_context(); }
 
-    PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC pfSwapBufferWithDamage_{};
-    PFNEGLSETDAMAGEREGIONKHRPROC pfSetDamageRegion_{};
-    bool has_egl_ext_buffer_age_{};
+    friend class WindowEgl;
+
+    friend class WindowHeadless;
+
+private:
+    DamageTracker damage_tracker_;
+    EGLint last_buffer_age_{};
+    EGLint max_buffer_age_{};
+    // written by whichever thread swaps, e.g. a PresentThread
+    mutable std::atomic<uint64_t> last_swap_ns_{};
+    mutable std::atomic<uint64_t> max_swap_ns_{};
+    mutable std::atomic<uint64_t> last_acquire_ns_{};
+    mutable std::atomic<uint64_t> blocked_swaps_{};
+
+    const EglDisplay *egl_display_;
+    EGLDisplay dpy_;
+    EGLConfig config_;
+    // the display's shared context unless this window owns one
+    EGLContext context_;
+    bool owns_context_;
+
+    EGLSurface egl_surface_{};
+    // surface backing egl_surface_; receives the damage when the swap extensions are missing
+    struct wl_surface *wl_surface_{};
 
-    static bool has_egl_extension(const char *extensions, const char *name);
+    // times the GPU work from make_current() to the swap, see enable_gpu_timer()
+    std::unique_ptr<GpuTimer> gpu_timer_;
 
-    static void debug_callback(EGLenum error,
-                               const char *command,
-                               EGLint messageType,
-                               EGLLabelKHR threadLabel,
-                               EGLLabelKHR objectLabel,
-                               const char *message);
+    [[nodiscard]] std::vector<EGLint> to_egl_rects(const std::vector<Rect> &damage) const;
 
-    static void egl_khr_debug_init();
+    void record_swap_time(uint64_t elapsed_ns) const;
 };
 
-#endif // SRC_WINDOW_EGL_H_
\ No newline at end of file
+#endif // SRC_WINDOW_EGL_H_
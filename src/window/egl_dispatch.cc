@@ -0,0 +1,119 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "egl_dispatch.h"
+
+#include <mutex>
+
+namespace {
+template<typename T>
+T get_proc(const char *name) {
+    return reinterpret_cast<T>(eglGetProcAddress(name));
+}
+}
+
+/**
+ * @brief Looks up the entry points of the extensions a display has.
+ *
+ * Called by EglDisplay once it is initialized; the GLES part is copied from get_gles().
+ *
+ * @param extensions The display's extensions.
+ */
+void EglDispatch::resolve(const EglExtensions &extensions) {
+    *this = get_gles();
+
+    // a client extension; without it eglGetProcAddress may still return a stub
+    if (EglExtensions::get_client().has(EglExtensions::EXT_PLATFORM_BASE)) {
+        create_platform_window_surface = get_proc<PFNEGLCREATEPLATFORMWINDOWSURFACEEXTPROC>(
+                "eglCreatePlatformWindowSurfaceEXT");
+    }
+
+    if (extensions.has(EglExtensions::EXT_SWAP_BUFFERS_WITH_DAMAGE)) {
+        swap_buffers_with_damage = get_proc<PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC>("eglSwapBuffersWithDamageEXT");
+    } else if (extensions.has(EglExtensions::KHR_SWAP_BUFFERS_WITH_DAMAGE)) {
+        swap_buffers_with_damage = get_proc<PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC>("eglSwapBuffersWithDamageKHR");
+    }
+
+    if (extensions.has(EglExtensions::KHR_PARTIAL_UPDATE)) {
+        set_damage_region = get_proc<PFNEGLSETDAMAGEREGIONKHRPROC>("eglSetDamageRegionKHR");
+    }
+
+    // fences for handing GPU work between contexts, and exported as sync_file fds for explicit sync
+    if (extensions.has(EglExtensions::KHR_FENCE_SYNC)) {
+        create_sync = get_proc<PFNEGLCREATESYNCKHRPROC>("eglCreateSyncKHR");
+        destroy_sync = get_proc<PFNEGLDESTROYSYNCKHRPROC>("eglDestroySyncKHR");
+        client_wait_sync = get_proc<PFNEGLCLIENTWAITSYNCKHRPROC>("eglClientWaitSyncKHR");
+        if (!create_sync || !destroy_sync || !client_wait_sync) {
+            create_sync = nullptr;
+            destroy_sync = nullptr;
+            client_wait_sync = nullptr;
+        } else {
+            if (extensions.has(EglExtensions::ANDROID_NATIVE_FENCE_SYNC)) {
+                dup_native_fence_fd = get_proc<PFNEGLDUPNATIVEFENCEFDANDROIDPROC>("eglDupNativeFenceFDANDROID");
+            }
+            if (extensions.has(EglExtensions::KHR_WAIT_SYNC)) {
+                wait_sync = get_proc<PFNEGLWAITSYNCKHRPROC>("eglWaitSyncKHR");
+            }
+        }
+    }
+
+    // dmabufs rendered elsewhere, e.g. by Vulkan, are sampled as EGLImages
+    if (extensions.has(EglExtensions::KHR_IMAGE_BASE) &&
+        extensions.has(EglExtensions::EXT_IMAGE_DMA_BUF_IMPORT)) {
+        create_image = get_proc<PFNEGLCREATEIMAGEKHRPROC>("eglCreateImageKHR");
+        destroy_image = get_proc<PFNEGLDESTROYIMAGEKHRPROC>("eglDestroyImageKHR");
+        if (!create_image || !destroy_image) {
+            create_image = nullptr;
+            destroy_image = nullptr;
+        } else if (extensions.has(EglExtensions::EXT_IMAGE_DMA_BUF_IMPORT_MODIFIERS)) {
+            query_dmabuf_modifiers = get_proc<PFNEGLQUERYDMABUFMODIFIERSEXTPROC>("eglQueryDmaBufModifiersEXT");
+        }
+    }
+}
+
+/**
+ * @brief The GLES entry points, looked up on first use.
+ *
+ * eglGetProcAddress() returns context independent pointers, so one table serves every
+ * display and context of the process.
+ */
+const EglDispatch &EglDispatch::get_gles() {
+    static EglDispatch dispatch{};
+    static std::once_flag once;
+    std::call_once(once, [] { dispatch.resolve_gles(); });
+    return dispatch;
+}
+
+void EglDispatch::resolve_gles() {
+    get_string = get_proc<PFNGLGETSTRINGPROC>("glGetString");
+    get_integerv = get_proc<PFNGLGETINTEGERVPROC>("glGetIntegerv");
+    get_programiv = get_proc<PFNGLGETPROGRAMIVPROC>("glGetProgramiv");
+
+    gen_queries = get_proc<PFNGLGENQUERIESEXTPROC>("glGenQueriesEXT");
+    delete_queries = get_proc<PFNGLDELETEQUERIESEXTPROC>("glDeleteQueriesEXT");
+    begin_query = get_proc<PFNGLBEGINQUERYEXTPROC>("glBeginQueryEXT");
+    end_query = get_proc<PFNGLENDQUERYEXTPROC>("glEndQueryEXT");
+    get_query_objectuiv = get_proc<PFNGLGETQUERYOBJECTUIVEXTPROC>("glGetQueryObjectuivEXT");
+    get_query_objectui64v = get_proc<PFNGLGETQUERYOBJECTUI64VEXTPROC>("glGetQueryObjectui64vEXT");
+
+    get_program_binary_oes = get_proc<PFNGLGETPROGRAMBINARYOESPROC>("glGetProgramBinaryOES");
+    program_binary_oes = get_proc<PFNGLPROGRAMBINARYOESPROC>("glProgramBinaryOES");
+    get_program_binary = get_proc<PFNGLGETPROGRAMBINARYOESPROC>("glGetProgramBinary");
+    program_binary = get_proc<PFNGLPROGRAMBINARYOESPROC>("glProgramBinary");
+
+    egl_image_target_texture_2d = get_proc<PFNGLEGLIMAGETARGETTEXTURE2DOESPROC>("glEGLImageTargetTexture2DOES");
+}
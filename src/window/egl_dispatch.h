@@ -0,0 +1,85 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_EGL_DISPATCH_H_
+#define SRC_WINDOW_EGL_DISPATCH_H_
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "egl_extensions.h"
+#include "utils/export.h"
+
+/**
+ * @brief Extension and GLES entry points, looked up with eglGetProcAddress() once.
+ *
+ * Every EglDisplay resolves its copy when it is initialized, see EglDisplay::get_dispatch();
+ * the code paths using them call through these pointers instead of looking them up
+ * per window, image or frame. An EGL pointer is set only if the display has the
+ * extension. GLES pointers do not say whether a context supports the function, that
+ * is its GL_EXTENSIONS and version, checked with a context current.
+ */
+struct WAYPP_EXPORT EglDispatch {
+    // EGL_EXT_platform_base, nullptr to fall back to eglCreateWindowSurface()
+    PFNEGLCREATEPLATFORMWINDOWSURFACEEXTPROC create_platform_window_surface;
+    // EGL_EXT_swap_buffers_with_damage or EGL_KHR_swap_buffers_with_damage
+    PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC swap_buffers_with_damage;
+    // EGL_KHR_partial_update
+    PFNEGLSETDAMAGEREGIONKHRPROC set_damage_region;
+    // EGL_KHR_fence_sync, all three or none
+    PFNEGLCREATESYNCKHRPROC create_sync;
+    PFNEGLDESTROYSYNCKHRPROC destroy_sync;
+    PFNEGLCLIENTWAITSYNCKHRPROC client_wait_sync;
+    // EGL_KHR_wait_sync and EGL_ANDROID_native_fence_sync, only with fence sync
+    PFNEGLWAITSYNCKHRPROC wait_sync;
+    PFNEGLDUPNATIVEFENCEFDANDROIDPROC dup_native_fence_fd;
+    // EGL_KHR_image_base with EGL_EXT_image_dma_buf_import, both or none
+    PFNEGLCREATEIMAGEKHRPROC create_image;
+    PFNEGLDESTROYIMAGEKHRPROC destroy_image;
+    // EGL_EXT_image_dma_buf_import_modifiers, only with the image functions
+    PFNEGLQUERYDMABUFMODIFIERSEXTPROC query_dmabuf_modifiers;
+
+    PFNGLGETSTRINGPROC get_string;
+    PFNGLGETINTEGERVPROC get_integerv;
+    PFNGLGETPROGRAMIVPROC get_programiv;
+    // GL_EXT_disjoint_timer_query
+    PFNGLGENQUERIESEXTPROC gen_queries;
+    PFNGLDELETEQUERIESEXTPROC delete_queries;
+    PFNGLBEGINQUERYEXTPROC begin_query;
+    PFNGLENDQUERYEXTPROC end_query;
+    PFNGLGETQUERYOBJECTUIVEXTPROC get_query_objectuiv;
+    PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_objectui64v;
+    // GL_OES_get_program_binary; the ES 3.0 core functions have the same signatures
+    PFNGLGETPROGRAMBINARYOESPROC get_program_binary_oes;
+    PFNGLPROGRAMBINARYOESPROC program_binary_oes;
+    PFNGLGETPROGRAMBINARYOESPROC get_program_binary;
+    PFNGLPROGRAMBINARYOESPROC program_binary;
+    // GL_OES_EGL_image
+    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC egl_image_target_texture_2d;
+
+    void resolve(const EglExtensions &extensions);
+
+    // the GLES part, the same for every display; for code that is not given one
+    [[nodiscard]] static const EglDispatch &get_gles();
+
+private:
+    void resolve_gles();
+};
+
+#endif // SRC_WINDOW_EGL_DISPATCH_H_
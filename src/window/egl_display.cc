@@ -0,0 +1,627 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "egl_display.h"
+#include "egl.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include <cstring>
+
+#include <sys/sysmacros.h>
+
+#include <xf86drm.h>
+
+#include "utils/logging.h"
+#include "utils/startup_profiler.h"
+
+namespace {
+// EGL keeps one EGLDisplay per native display, so two EglDisplays on the same wl_display, or two
+// headless ones, share it; it is terminated with the last of them. Only touched on creation and destruction.
+// A display is retained before eglInitialize(), so a concurrent release can't terminate it in between.
+std::mutex display_refs_mutex;
+std::unordered_map<EGLDisplay, uint32_t> display_refs;
+
+void retain_display(EGLDisplay dpy) {
+    std::lock_guard<std::mutex> lock(display_refs_mutex);
+    display_refs[dpy]++;
+}
+
+// terminates the display with its last reference, under the lock so no retain can slip in between
+void release_display(EGLDisplay dpy) {
+    std::lock_guard<std::mutex> lock(display_refs_mutex);
+    const auto it = display_refs.find(dpy);
+    if (it != display_refs.end() && --it->second) {
+        return;
+    }
+    if (it != display_refs.end()) {
+        display_refs.erase(it);
+    }
+    eglTerminate(dpy);
+}
+
+std::once_flag debug_once;
+
+constexpr size_t kDebugSeverities = EglDisplay::DebugStats::kSeverities;
+constexpr const char *kDebugSeverityNames[kDebugSeverities] = {"critical", "error", "warning", "info"};
+
+// the callback is process wide, so are its counters
+std::atomic<uint64_t> debug_messages[kDebugSeverities];
+std::atomic<uint64_t> debug_suppressed[kDebugSeverities];
+
+// the second being rate limited, and the messages of each severity logged and dropped in it
+struct DebugWindow {
+    std::atomic<int64_t> second;
+    std::atomic<uint32_t> count;
+    std::atomic<uint64_t> suppressed;
+};
+
+DebugWindow debug_windows[kDebugSeverities];
+
+size_t debug_severity(EGLint message_type) {
+    switch (message_type) {
+        case EGL_DEBUG_MSG_CRITICAL_KHR:
+            return 0;
+        case EGL_DEBUG_MSG_ERROR_KHR:
+            return 1;
+        case EGL_DEBUG_MSG_WARN_KHR:
+            return 2;
+        default:
+            return 3;
+    }
+}
+
+const char *egl_error_name(EGLenum error) {
+    switch (error) {
+        case EGL_SUCCESS:
+            return "EGL_SUCCESS";
+        case EGL_BAD_ACCESS:
+            return "EGL_BAD_ACCESS";
+        case EGL_BAD_ALLOC:
+            return "EGL_BAD_ALLOC";
+        case EGL_BAD_ATTRIBUTE:
+            return "EGL_BAD_ATTRIBUTE";
+        case EGL_BAD_CONFIG:
+            return "EGL_BAD_CONFIG";
+        case EGL_BAD_CONTEXT:
+            return "EGL_BAD_CONTEXT";
+        case EGL_BAD_CURRENT_SURFACE:
+            return "EGL_BAD_CURRENT_SURFACE";
+        case EGL_BAD_DISPLAY:
+            return "EGL_BAD_DISPLAY";
+        case EGL_BAD_MATCH:
+            return "EGL_BAD_MATCH";
+        case EGL_BAD_NATIVE_PIXMAP:
+            return "EGL_BAD_NATIVE_PIXMAP";
+        case EGL_BAD_NATIVE_WINDOW:
+            return "EGL_BAD_NATIVE_WINDOW";
+        case EGL_BAD_PARAMETER:
+            return "EGL_BAD_PARAMETER";
+        case EGL_BAD_SURFACE:
+            return "EGL_BAD_SURFACE";
+        default:
+            return "unknown error";
+    }
+}
+}
+
+
+/**
+ * @brief The EglDisplay class owns the EGL state of one connection.
+ *
+ * It initializes the EGLDisplay for the Wayland connection once, chooses the EGL
+ * configuration, creates the shared rendering context and resolves the EGL
+ * extensions; the resource and texture contexts are created when first asked for.
+ * Every WindowEgl renders through it, so creating a window only costs an EGL surface.
+ *
+ * In single context mode every window renders with the shared context, even one whose
+ * config would otherwise need a context of its own; see set_single_context().
+ *
+ * With EGL_IMG_context_priority the shared context, and every window context created
+ * from it, asks for context_priority, so UI frames can preempt background GPU work such
+ * as a compute process; the resource context always asks for low priority, uploads must
+ * not delay a frame. The priority is a hint, get_context_priority() reports what the
+ * driver granted. EGL_CONTEXT_PRIORITY_REALTIME_NV needs EGL_NV_context_priority_realtime
+ * and usually CAP_SYS_NICE, otherwise high priority is asked for instead.
+ *
+ * Each EglDisplay is independent of the others, so several connections, e.g. to
+ * different compositors, can each render on a thread of their own. Nothing but
+ * creation and destruction is serialized between them.
+ *
+ * On a system with several GPUs, device selects the one to render on. Passing
+ * the compositor's dmabuf feedback main device renders where the compositor
+ * composites and scans out, instead of copying every frame across devices.
+ * It takes EGL_EXT_device_enumeration and EGL_EXT_explicit_device; without
+ * them, or if no EGL device matches, the driver picks as before.
+ *
+ * @param display          The Wayland display.
+ * @param default_attribs  The attributes of the default config.
+ * @param context_priority One of the EGL_CONTEXT_PRIORITY_*_IMG levels, or EGL_CONTEXT_PRIORITY_REALTIME_NV.
+ * @param device           The DRM device to render on, 0 for the driver's choice.
+ */
+EglDisplay::EglDisplay(struct wl_display *display, const EglConfigAttribs &default_attribs,
+                       EGLint context_priority, dev_t device) :
+        EglDisplay(get_wayland_display(display, device), EGL_WINDOW_BIT, default_attribs, context_priority) {
+}
+
+/**
+ * @brief Finds the EGL device of a DRM device, by its primary or render node.
+ *
+ * @param device The DRM device number, e.g. DmabufFeedback::get_main_device().
+ * @return The device, or EGL_NO_DEVICE_EXT if device enumeration is unavailable or nothing matches.
+ */
+EGLDeviceEXT EglDisplay::find_device(dev_t device) {
+    const auto &client_extensions = EglExtensions::get_client();
+    if (!device || !(client_extensions.has(EglExtensions::EXT_DEVICE_ENUMERATION) ||
+                     client_extensions.has(EglExtensions::EXT_DEVICE_BASE))) {
+        return EGL_NO_DEVICE_EXT;
+    }
+    const auto query_devices = reinterpret_cast<PFNEGLQUERYDEVICESEXTPROC>(eglGetProcAddress("eglQueryDevicesEXT"));
+    const auto query_device_string = reinterpret_cast<PFNEGLQUERYDEVICESTRINGEXTPROC>(
+            eglGetProcAddress("eglQueryDeviceStringEXT"));
+    EGLint count = 0;
+    if (!query_devices || !query_device_string || !query_devices(0, nullptr, &count) || count <= 0) {
+        return EGL_NO_DEVICE_EXT;
+    }
+
+    drmDevicePtr drm_device = nullptr;
+    if (drmGetDeviceFromDevId(device, 0, &drm_device) != 0) {
+        return EGL_NO_DEVICE_EXT;
+    }
+    const auto is_node = [drm_device](const char *path) {
+        for (int node = 0; path && node < DRM_NODE_MAX; node++) {
+            if ((drm_device->available_nodes & (1 << node)) && strcmp(drm_device->nodes[node], path) == 0) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    std::vector<EGLDeviceEXT> devices(static_cast<size_t>(count));
+    query_devices(count, devices.data(), &count);
+    EGLDeviceEXT result = EGL_NO_DEVICE_EXT;
+    for (EGLint i = 0; i < count && result == EGL_NO_DEVICE_EXT; i++) {
+        const EglExtensions extensions(query_device_string(devices[i], EGL_EXTENSIONS));
+        if ((extensions.has(EglExtensions::EXT_DEVICE_DRM) &&
+             is_node(query_device_string(devices[i], EGL_DRM_DEVICE_FILE_EXT))) ||
+            (extensions.has(EglExtensions::EXT_DEVICE_DRM_RENDER_NODE) &&
+             is_node(query_device_string(devices[i], EGL_DRM_RENDER_NODE_FILE_EXT)))) {
+            result = devices[i];
+        }
+    }
+    drmFreeDevice(&drm_device);
+    return result;
+}
+
+/**
+ * @brief The Wayland platform display, on device's GPU where the driver allows choosing.
+ */
+EGLDisplay EglDisplay::get_wayland_display(struct wl_display *display, dev_t device) {
+    const auto egl_device = find_device(device);
+    if (egl_device == EGL_NO_DEVICE_EXT) {
+        if (device) {
+            LOG_DEBUG("No EGL device for DRM device %u:%u, rendering on the default GPU", major(device),
+                      minor(device));
+        }
+        return eglGetDisplay(display);
+    }
+    const auto query_device_string = reinterpret_cast<PFNEGLQUERYDEVICESTRINGEXTPROC>(
+            eglGetProcAddress("eglQueryDeviceStringEXT"));
+    const auto &client_extensions = EglExtensions::get_client();
+    const EglExtensions device_extensions(query_device_string(egl_device, EGL_EXTENSIONS));
+    // EGL 1.5 entry point, its attribute list holds the device pointer
+    const auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYPROC>(
+            eglGetProcAddress("eglGetPlatformDisplay"));
+    if (!get_platform_display || !device_extensions.has(EglExtensions::EXT_EXPLICIT_DEVICE) ||
+        !(client_extensions.has(EglExtensions::EXT_PLATFORM_WAYLAND) ||
+          client_extensions.has(EglExtensions::KHR_PLATFORM_WAYLAND))) {
+        LOG_DEBUG("EGL cannot bind the Wayland display to a device, rendering on the default GPU");
+        return eglGetDisplay(display);
+    }
+    const EGLAttrib attribs[] = {EGL_DEVICE_EXT, reinterpret_cast<EGLAttrib>(egl_device), EGL_NONE};
+    const auto dpy = get_platform_display(EGL_PLATFORM_WAYLAND_KHR, display, attribs);
+    return dpy != EGL_NO_DISPLAY ? dpy : eglGetDisplay(display);
+}
+
+/**
+ * @brief Creates a display that renders without a compositor, for benchmarks and CI.
+ *
+ * Uses EGL_MESA_platform_surfaceless when the client extensions offer it, so no
+ * Wayland or X connection is needed, otherwise the default display. Configs are
+ * chosen for pbuffer surfaces; render with WindowHeadless.
+ *
+ * With device, EGL_EXT_platform_device renders on that GPU instead.
+ *
+ * @param default_attribs  The attributes of the default config.
+ * @param context_priority As for the Wayland display.
+ * @param device           The DRM device to render on, 0 for any.
+ * @return The display; throws std::runtime_error if EGL cannot be initialized.
+ */
+std::unique_ptr<EglDisplay> EglDisplay::create_headless(const EglConfigAttribs &default_attribs,
+                                                        EGLint context_priority, dev_t device) {
+    EGLDisplay dpy = EGL_NO_DISPLAY;
+    // client extensions are queried without a display, there are none before EGL 1.5
+    const auto &client_extensions = EglExtensions::get_client();
+    const auto egl_device = find_device(device);
+    if (egl_device != EGL_NO_DEVICE_EXT && client_extensions.has(EglExtensions::EXT_PLATFORM_DEVICE)) {
+        if (const auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                eglGetProcAddress("eglGetPlatformDisplayEXT"))) {
+            dpy = get_platform_display(EGL_PLATFORM_DEVICE_EXT, egl_device, nullptr);
+        }
+    }
+    if (dpy == EGL_NO_DISPLAY && client_extensions.has(EglExtensions::MESA_PLATFORM_SURFACELESS)) {
+        if (const auto get_platform_display = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(
+                eglGetProcAddress("eglGetPlatformDisplayEXT"))) {
+            dpy = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+    }
+    if (dpy == EGL_NO_DISPLAY) {
+        dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (dpy == EGL_NO_DISPLAY) {
+        throw std::runtime_error("No headless EGL display.");
+    }
+    return std::unique_ptr<EglDisplay>(new EglDisplay(dpy, EGL_PBUFFER_BIT, default_attribs, context_priority));
+}
+
+EglDisplay::EglDisplay(EGLDisplay dpy, EGLint surface_type, const EglConfigAttribs &default_attribs,
+                       EGLint context_priority) : dpy_(dpy), surface_type_(surface_type) {
+    retain_display(dpy_);
+    StartupProfiler::begin(StartupProfiler::EGL_INITIALIZE);
+    EGLBoolean ret = eglInitialize(dpy_, &major_, &minor_);
+    StartupProfiler::end(StartupProfiler::EGL_INITIALIZE);
+    if (ret == EGL_FALSE) {
+        release_display(dpy_);
+        throw std::runtime_error("eglInitialize failed.");
+    }
+
+    ret = eglBindAPI(EGL_OPENGL_ES_API);
+    if (ret == EGL_FALSE) {
+        release_display(dpy_);
+        throw std::runtime_error("eglBindAPI failed.");
+    }
+
+#if !defined(NDEBUG)
+    // the callback is process wide, one registration serves every display
+    std::call_once(debug_once, egl_khr_debug_init);
+#endif
+
+    extensions_.parse(eglQueryString(dpy_, EGL_EXTENSIONS));
+    const auto &extensions = extensions_;
+
+    dispatch_.resolve(extensions);
+
+    has_egl_ext_buffer_age_ = extensions.has(EglExtensions::EXT_BUFFER_AGE);
+    has_surfaceless_context_ = extensions.has(EglExtensions::KHR_SURFACELESS_CONTEXT);
+
+    // which GPU the display ended up on, device selection is a request the driver may ignore
+    const auto &client_extensions = EglExtensions::get_client();
+    if (client_extensions.has(EglExtensions::EXT_DEVICE_QUERY) ||
+        client_extensions.has(EglExtensions::EXT_DEVICE_BASE)) {
+        if (const auto query_display_attrib = reinterpret_cast<PFNEGLQUERYDISPLAYATTRIBEXTPROC>(
+                eglGetProcAddress("eglQueryDisplayAttribEXT"))) {
+            EGLAttrib value = 0;
+            if (query_display_attrib(dpy_, EGL_DEVICE_EXT, &value)) {
+                device_ = reinterpret_cast<EGLDeviceEXT>(value);
+            }
+        }
+    }
+
+    has_context_priority_ = extensions.has(EglExtensions::IMG_CONTEXT_PRIORITY);
+    has_realtime_priority_ = extensions.has(EglExtensions::NV_CONTEXT_PRIORITY_REALTIME);
+
+    // lets the shared contexts render to surfaces of any config
+    has_no_config_context_ = extensions.has(EglExtensions::KHR_NO_CONFIG_CONTEXT) ||
+                             extensions.has(EglExtensions::MESA_CONFIGLESS_CONTEXT);
+
+    if (context_priority == EGL_CONTEXT_PRIORITY_REALTIME_NV && !has_realtime_priority_) {
+        context_priority = EGL_CONTEXT_PRIORITY_HIGH_IMG;
+    }
+    context_priority_ = context_priority;
+
+    // an ES 2 config need not support an ES 3 context, so each version gets a config of its own
+    bool have_config = false;
+    for (const auto &attribs: kEglContextAttribs) {
+        context_attribs_ = attribs.data();
+        renderable_type_ = attribs[1] >= 3 ? EGL_OPENGL_ES3_BIT : EGL_OPENGL_ES2_BIT;
+        configs_.clear();
+
+        StartupProfiler::begin(StartupProfiler::EGL_CHOOSE_CONFIG);
+        config_ = choose_config(default_attribs);
+        StartupProfiler::end(StartupProfiler::EGL_CHOOSE_CONFIG);
+        if (!config_) {
+            continue;
+        }
+        have_config = true;
+
+        StartupProfiler::begin(StartupProfiler::EGL_CREATE_CONTEXT);
+        context_ = eglCreateContext(dpy_, has_no_config_context_ ? EGL_NO_CONFIG_KHR : config_, EGL_NO_CONTEXT,
+                                    context_attribs(context_priority_).data());
+        StartupProfiler::end(StartupProfiler::EGL_CREATE_CONTEXT);
+        if (context_ != EGL_NO_CONTEXT) {
+            break;
+        }
+    }
+    if (!have_config) {
+        release_display(dpy_);
+        throw std::runtime_error("eglChooseConfig failed");
+    }
+    if (context_ == EGL_NO_CONTEXT) {
+        release_display(dpy_);
+        throw std::runtime_error("eglCreateContext failed.");
+    }
+    context_priority_ = query_context_priority(context_);
+
+    // the swap interval applies to the current surface, WindowEgl sets it once its surface exists
+}
+
+/**
+ * @brief Destructor for the EglDisplay class.
+ *
+ * Destroys the shared contexts, then terminates the EGL display unless another
+ * EglDisplay uses the same one. Must outlive every Egl using it.
+ *
+ * Only the contexts of this display are unbound from the calling thread, and the
+ * thread's EGL state is released only if nothing else is current on it, so a thread
+ * rendering for another connection keeps its binding.
+ */
+EglDisplay::~EglDisplay() {
+    for (const auto context: {texture_context_, resource_context_, context_}) {
+        if (context != EGL_NO_CONTEXT) {
+            Egl::release_current(EGL_NO_SURFACE, context);
+            eglDestroyContext(dpy_, context);
+        }
+    }
+    release_display(dpy_);
+    if (eglGetCurrentContext() == EGL_NO_CONTEXT) {
+        eglReleaseThread();
+    }
+}
+
+/**
+ * @brief Returns the context for loading resources off the render thread, creating it on first use.
+ *
+ * It shares objects with the render context and asks for low priority. Thread safe.
+ */
+EGLContext EglDisplay::get_resource_context() const {
+    std::call_once(resource_context_once_,
+                   [this]() { resource_context_ = create_shared_context(EGL_CONTEXT_PRIORITY_LOW_IMG); });
+    return resource_context_;
+}
+
+/**
+ * @brief Creates a context sharing objects with the render context.
+ *
+ * Unlike get_resource_context() every call returns a new context, for callers that keep
+ * one current on a thread of their own. Thread safe.
+ *
+ * @param priority The EGL_IMG_context_priority level to ask for.
+ * @return The context, which the caller destroys with eglDestroyContext(), or EGL_NO_CONTEXT.
+ */
+EGLContext EglDisplay::create_shared_context(EGLint priority) const {
+    return eglCreateContext(dpy_, has_no_config_context_ ? EGL_NO_CONFIG_KHR : config_, context_,
+                            context_attribs(priority).data());
+}
+
+/**
+ * @brief Returns the context for texture updates, creating it on first use.
+ *
+ * It shares objects with the render context. Thread safe.
+ */
+EGLContext EglDisplay::get_texture_context() const {
+    std::call_once(texture_context_once_, [this]() { texture_context_ = create_shared_context(context_priority_); });
+    return texture_context_;
+}
+
+/**
+ * @brief Chooses the EGL config best matching the requested attributes.
+ *
+ * eglChooseConfig treats sizes as minimums and sorts deeper configs first, so the
+ * matches are scanned for one whose color sizes equal the request, e.g. a config
+ * without alpha when alpha_size is 0. Only configs that can render the display's
+ * ES version are considered. Results are cached per attribute set.
+ *
+ * @param attribs The requested attributes.
+ * @return The chosen config, or nullptr if no config matches.
+ */
+EGLConfig EglDisplay::choose_config(const EglConfigAttribs &attribs) const {
+    if (const auto it = configs_.find(attribs); it != configs_.end()) {
+        return it->second;
+    }
+
+    const std::array<EGLint, 21> config_attribs = {
+            {
+                    EGL_SURFACE_TYPE, surface_type_,
+                    EGL_RENDERABLE_TYPE, renderable_type_,
+                    EGL_RED_SIZE, attribs.red_size,
+                    EGL_GREEN_SIZE, attribs.green_size,
+                    EGL_BLUE_SIZE, attribs.blue_size,
+                    EGL_ALPHA_SIZE, attribs.alpha_size,
+                    EGL_STENCIL_SIZE, attribs.stencil_size,
+                    EGL_DEPTH_SIZE, attribs.depth_size,
+                    EGL_SAMPLE_BUFFERS, attribs.samples > 0 ? 1 : 0,
+                    EGL_SAMPLES, attribs.samples,
+                    EGL_NONE // termination sentinel
+            }
+    };
+
+    EGLint count = 0;
+    if (eglChooseConfig(dpy_, config_attribs.data(), nullptr, 0, &count) == EGL_FALSE || count == 0) {
+        return nullptr;
+    }
+
+    std::vector<EGLConfig> configs(static_cast<size_t>(count));
+    if (eglChooseConfig(dpy_, config_attribs.data(), configs.data(), count, &count) == EGL_FALSE) {
+        return nullptr;
+    }
+
+    EGLConfig result = configs[0];
+    for (EGLint i = 0; i < count; i++) {
+        EGLint red, green, blue, alpha;
+        eglGetConfigAttrib(dpy_, configs[i], EGL_RED_SIZE, &red);
+        eglGetConfigAttrib(dpy_, configs[i], EGL_GREEN_SIZE, &green);
+        eglGetConfigAttrib(dpy_, configs[i], EGL_BLUE_SIZE, &blue);
+        eglGetConfigAttrib(dpy_, configs[i], EGL_ALPHA_SIZE, &alpha);
+        if (red == attribs.red_size && green == attribs.green_size && blue == attribs.blue_size &&
+            alpha == attribs.alpha_size) {
+            result = configs[i];
+            break;
+        }
+    }
+
+    configs_[attribs] = result;
+    return result;
+}
+
+/**
+ * @brief Creates a rendering context that shares objects with the shared context.
+ *
+ * @param config The config of the surfaces the context will render to.
+ * @return The new context, owned by the caller, or EGL_NO_CONTEXT on failure.
+ */
+EGLContext EglDisplay::create_context(EGLConfig config) const {
+    return eglCreateContext(dpy_, has_no_config_context_ ? EGL_NO_CONFIG_KHR : config, context_,
+                            context_attribs(context_priority_).data());
+}
+
+/**
+ * @brief Returns the attributes of the chosen ES version, asking for priority if the driver supports it.
+ */
+std::vector<EGLint> EglDisplay::context_attribs(EGLint priority) const {
+    std::vector<EGLint> attribs;
+    for (auto attrib = context_attribs_; *attrib != EGL_NONE; attrib += 2) {
+        attribs.insert(attribs.end(), {attrib[0], attrib[1]});
+    }
+    // medium is the default, leave it out so drivers without the extension see the same list
+    if (has_context_priority_ && priority != EGL_CONTEXT_PRIORITY_MEDIUM_IMG) {
+        attribs.insert(attribs.end(), {EGL_CONTEXT_PRIORITY_LEVEL_IMG, priority});
+    }
+    attribs.push_back(EGL_NONE);
+    return attribs;
+}
+
+/**
+ * @return The priority granted to context, medium without EGL_IMG_context_priority.
+ */
+EGLint EglDisplay::query_context_priority(EGLContext context) const {
+    EGLint priority = EGL_CONTEXT_PRIORITY_MEDIUM_IMG;
+    if (has_context_priority_) {
+        eglQueryContext(dpy_, context, EGL_CONTEXT_PRIORITY_LEVEL_IMG, &priority);
+    }
+    return priority;
+}
+
+/**
+ * @brief Debug callback for EGL errors.
+ *
+ * Runs inside the driver, on whichever thread made the failing call, so it only
+ * formats one line into the asynchronous Logger and never writes to a stream
+ * itself. Each severity is limited to kDebugMessagesPerSecond; what goes over is
+ * counted and summed up once the second is over. get_debug_stats() has the totals.
+ *
+ * @param error The EGL error code.
+ * @param command The EGL command associated with the error.
+ * @param messageType The EGL message type.
+ * @param threadLabel The EGL thread label.
+ * @param objectLabel The EGL object label.
+ * @param message The error message.
+ */
+void EglDisplay::debug_callback(EGLenum error,
+                                const char *command,
+                                EGLint messageType,
+                                EGLLabelKHR threadLabel,
+                                EGLLabelKHR objectLabel,
+                                const char *message) {
+    (void) threadLabel;
+    (void) objectLabel;
+    const size_t severity = debug_severity(messageType);
+    debug_messages[severity].fetch_add(1, std::memory_order_relaxed);
+
+    const auto now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    auto &window = debug_windows[severity];
+    auto second = window.second.load(std::memory_order_relaxed);
+    if (second != now && window.second.compare_exchange_strong(second, now, std::memory_order_relaxed)) {
+        window.count.store(0, std::memory_order_relaxed);
+        if (const auto suppressed = window.suppressed.exchange(0, std::memory_order_relaxed)) {
+            LOG_WARN("EGL: %llu %s messages suppressed", static_cast<unsigned long long>(suppressed),
+                     kDebugSeverityNames[severity]);
+        }
+    }
+    if (window.count.fetch_add(1, std::memory_order_relaxed) >= kDebugMessagesPerSecond) {
+        window.suppressed.fetch_add(1, std::memory_order_relaxed);
+        debug_suppressed[severity].fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const int level = severity <= 1 ? LOG_LEVEL_ERROR : severity == 2 ? LOG_LEVEL_WARN : LOG_LEVEL_INFO;
+    if (level >= LOG_LEVEL) {
+        Logger::write(level, "EGL %s: %s (0x%04x) in %s: %s", kDebugSeverityNames[severity], egl_error_name(error),
+                      error, command ? command : "?", message ? message : "");
+    }
+}
+
+/**
+ * @return The EGL_KHR_debug messages of every display since the process started, by severity.
+ */
+EglDisplay::DebugStats EglDisplay::get_debug_stats() {
+    DebugStats stats{};
+    for (size_t i = 0; i < kDebugSeverities; i++) {
+        stats.messages[i] = debug_messages[i].load(std::memory_order_relaxed);
+        stats.suppressed[i] = debug_suppressed[i].load(std::memory_order_relaxed);
+    }
+    return stats;
+}
+
+/**
+ * @brief Initialize the EGL debugging functionality.
+ *
+ * This function initializes the EGL debugging functionality by calling the eglDebugMessageControlKHR function
+ * if it is available. The debug_callback function is set as the callback function for EGL debug messages.
+ *
+ * @note This function requires that the EGL extension EGL_KHR_debug is supported.
+ */
+void EglDisplay::egl_khr_debug_init() {
+    if (!EglExtensions::get_client().has(EglExtensions::KHR_DEBUG)) {
+        return;
+    }
+    auto pfDebugMessageControl =
+            reinterpret_cast<PFNEGLDEBUGMESSAGECONTROLKHRPROC>(
+                    eglGetProcAddress("eglDebugMessageControlKHR"));
+
+    if (pfDebugMessageControl) {
+
+        const EGLAttrib sDebugAttribList[] = {
+                EGL_DEBUG_MSG_CRITICAL_KHR,
+                EGL_TRUE,
+                EGL_DEBUG_MSG_ERROR_KHR,
+                EGL_TRUE,
+                EGL_DEBUG_MSG_WARN_KHR,
+                EGL_TRUE,
+                EGL_DEBUG_MSG_INFO_KHR,
+                EGL_TRUE,
+                EGL_NONE,
+                0
+        };
+
+        pfDebugMessageControl(debug_callback, sDebugAttribList);
+    }
+}
@@ -0,0 +1,230 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_EGL_DISPLAY_H_
+#define SRC_WINDOW_EGL_DISPLAY_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "egl_dispatch.h"
+#include "egl_extensions.h"
+#include "utils/export.h"
+
+struct EglConfigAttribs {
+    EGLint red_size = 8;
+    EGLint green_size = 8;
+    EGLint blue_size = 8;
+    EGLint alpha_size = 8;
+    EGLint depth_size = 16;
+    EGLint stencil_size = 8;
+    // 0 disables multisampling
+    EGLint samples = 4;
+
+    bool operator<(const EglConfigAttribs &other) const {
+        return std::tie(red_size, green_size, blue_size, alpha_size, depth_size, stencil_size, samples) <
+               std::tie(other.red_size, other.green_size, other.blue_size, other.alpha_size, other.depth_size,
+                        other.stencil_size, other.samples);
+    }
+};
+
+class WAYPP_EXPORT EglDisplay {
+public:
+    // device, e.g. the dmabuf feedback main device, picks the GPU; 0 leaves it to the driver
+    explicit EglDisplay(struct wl_display *display, const EglConfigAttribs &default_attribs = {},
+                        EGLint context_priority = EGL_CONTEXT_PRIORITY_MEDIUM_IMG, dev_t device = 0);
+
+    ~EglDisplay();
+
+    static std::unique_ptr<EglDisplay> create_headless(const EglConfigAttribs &default_attribs = {},
+                                                       EGLint context_priority = EGL_CONTEXT_PRIORITY_MEDIUM_IMG,
+                                                       dev_t device = 0);
+
+    [[nodiscard]] static EGLDeviceEXT find_device(dev_t device);
+
+    // EGL_KHR_debug messages, registered in builds without NDEBUG
+    struct DebugStats {
+        static constexpr size_t kSeverities = 4;
+
+        // by severity: critical, error, warning, info
+        uint64_t messages[kSeverities];
+        // over kDebugMessagesPerSecond, counted but not logged
+        uint64_t suppressed[kSeverities];
+    };
+
+    // messages of each severity logged per second, the rest are counted
+    static constexpr uint32_t kDebugMessagesPerSecond = 10;
+
+    [[nodiscard]] static DebugStats get_debug_stats();
+
+    EglDisplay(const EglDisplay &) = delete;
+
+    EglDisplay &operator=(const EglDisplay &) = delete;
+
+    [[nodiscard]] EGLDisplay get_display() const { return dpy_; }
+
+    [[nodiscard]] EGLConfig get_config() const { return config_; }
+
+    [[nodiscard]] EGLContext get_context() const { return context_; }
+
+    // the GPU the display renders on, EGL_NO_DEVICE_EXT if the driver does not tell
+    [[nodiscard]] EGLDeviceEXT get_device() const { return device_; }
+
+    // no compositor behind it, configs are chosen for pbuffers, see create_headless()
+    [[nodiscard]] bool is_headless() const { return surface_type_ == EGL_PBUFFER_BIT; }
+
+    [[nodiscard]] EGLContext get_resource_context() const;
+
+    // a new context sharing objects with the render context, owned by the caller
+    [[nodiscard]] EGLContext create_shared_context(EGLint priority) const;
+
+    [[nodiscard]] EGLContext get_texture_context() const;
+
+    void set_single_context(bool single_context) { single_context_ = single_context; }
+
+    [[nodiscard]] bool is_single_context() const { return single_context_; }
+
+    [[nodiscard]] EGLConfig choose_config(const EglConfigAttribs &attribs) const;
+
+    [[nodiscard]] EGLContext create_context(EGLConfig config) const;
+
+    [[nodiscard]] bool has_no_config_context() const { return has_no_config_context_; }
+
+    // entry points resolved once at initialization, shared by every window, image and fence of the display
+    [[nodiscard]] const EglDispatch &get_dispatch() const { return dispatch_; }
+
+    [[nodiscard]] PFNEGLSETDAMAGEREGIONKHRPROC get_set_damage_region() const { return dispatch_.set_damage_region; }
+
+    [[nodiscard]] PFNEGLSWAPBUFFERSWITHDAMAGEEXTPROC get_swap_buffers_with_damage() const {
+        return dispatch_.swap_buffers_with_damage;
+    }
+
+    // parsed once, for capabilities without a getter of their own
+    [[nodiscard]] const EglExtensions &get_extensions() const { return extensions_; }
+
+    [[nodiscard]] bool has_ext_buffer_age() const { return has_egl_ext_buffer_age_; }
+
+    // EGL_KHR_fence_sync, plus EGL_KHR_wait_sync for GPU side waits
+    [[nodiscard]] bool has_fence_sync() const { return dispatch_.create_sync != nullptr; }
+
+    // EGL_ANDROID_native_fence_sync
+    [[nodiscard]] bool has_native_fence_sync() const { return dispatch_.dup_native_fence_fd != nullptr; }
+
+    // contexts can be made current without a surface, e.g. on an upload thread
+    [[nodiscard]] bool has_surfaceless_context() const { return has_surfaceless_context_; }
+
+    // EGL_IMG_context_priority
+    [[nodiscard]] bool has_context_priority() const { return has_context_priority_; }
+
+    // the priority the driver granted the shared context, which may be lower than requested
+    [[nodiscard]] EGLint get_context_priority() const { return context_priority_; }
+
+    [[nodiscard]] PFNEGLCREATESYNCKHRPROC get_create_sync() const { return dispatch_.create_sync; }
+
+    [[nodiscard]] PFNEGLDESTROYSYNCKHRPROC get_destroy_sync() const { return dispatch_.destroy_sync; }
+
+    [[nodiscard]] PFNEGLCLIENTWAITSYNCKHRPROC get_client_wait_sync() const { return dispatch_.client_wait_sync; }
+
+    [[nodiscard]] PFNEGLWAITSYNCKHRPROC get_wait_sync() const { return dispatch_.wait_sync; }
+
+    [[nodiscard]] PFNEGLDUPNATIVEFENCEFDANDROIDPROC get_dup_native_fence_fd() const { return dispatch_.dup_native_fence_fd; }
+
+    // EGL_EXT_image_dma_buf_import
+    [[nodiscard]] bool has_dmabuf_import() const { return dispatch_.create_image != nullptr; }
+
+    // EGL_EXT_image_dma_buf_import_modifiers, explicit modifiers can be imported and queried
+    [[nodiscard]] bool has_dmabuf_import_modifiers() const { return dispatch_.query_dmabuf_modifiers != nullptr; }
+
+    [[nodiscard]] PFNEGLCREATEIMAGEKHRPROC get_create_image() const { return dispatch_.create_image; }
+
+    [[nodiscard]] PFNEGLDESTROYIMAGEKHRPROC get_destroy_image() const { return dispatch_.destroy_image; }
+
+    [[nodiscard]] PFNEGLQUERYDMABUFMODIFIERSEXTPROC get_query_dmabuf_modifiers() const {
+        return dispatch_.query_dmabuf_modifiers;
+    }
+
+private:
+    EglDisplay(EGLDisplay dpy, EGLint surface_type, const EglConfigAttribs &default_attribs, EGLint context_priority);
+
+    // ES 3.2 is preferred, falling back to 3.0 and 2.0 on older drivers
+    static constexpr std::array<std::array<EGLint, 5>, 3> kEglContextAttribs = {
+            {
+                    {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 2, EGL_NONE},
+                    {EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 0, EGL_NONE},
+                    {EGL_CONTEXT_MAJOR_VERSION, 2, EGL_CONTEXT_MINOR_VERSION, 0, EGL_NONE},
+            }
+    };
+
+    // configs chosen so far, keyed by the requested attributes
+    mutable std::map<EglConfigAttribs, EGLConfig> configs_;
+    const EGLint *context_attribs_{};
+    // EGL_OPENGL_ES3_BIT for an ES 3 context, configs are chosen for the version being created
+    EGLint renderable_type_{EGL_OPENGL_ES2_BIT};
+    bool has_no_config_context_{};
+    bool has_context_priority_{};
+    bool has_realtime_priority_{};
+    EGLint context_priority_{EGL_CONTEXT_PRIORITY_MEDIUM_IMG};
+
+    EGLConfig config_{};
+
+    EGLDisplay dpy_{};
+    EglExtensions extensions_;
+    EGLDeviceEXT device_{EGL_NO_DEVICE_EXT};
+    // EGL_WINDOW_BIT, or EGL_PBUFFER_BIT for a headless display
+    EGLint surface_type_;
+    EGLContext context_{};
+    // created on first use, most applications never touch them
+    mutable EGLContext resource_context_{};
+    mutable EGLContext texture_context_{};
+    mutable std::once_flag resource_context_once_;
+    mutable std::once_flag texture_context_once_;
+    bool single_context_{};
+
+    EGLint major_{};
+    EGLint minor_{};
+
+    EglDispatch dispatch_{};
+    bool has_egl_ext_buffer_age_{};
+    bool has_surfaceless_context_{};
+
+    [[nodiscard]] std::vector<EGLint> context_attribs(EGLint priority) const;
+
+    EGLint query_context_priority(EGLContext context) const;
+
+    static EGLDisplay get_wayland_display(struct wl_display *display, dev_t device);
+
+    static void debug_callback(EGLenum error,
+                               const char *command,
+                               EGLint messageType,
+                               EGLLabelKHR threadLabel,
+                               EGLLabelKHR objectLabel,
+                               const char *message);
+
+    static void egl_khr_debug_init();
+};
+
+#endif // SRC_WINDOW_EGL_DISPLAY_H_
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "egl_dmabuf.h"
+
+#include <stdexcept>
+#include <string>
+
+#include "egl_display.h"
+#include "utils/logging.h"
+
+namespace {
+// EGL_DMA_BUF_PLANE<n>_* attributes by plane
+constexpr EGLint kPlaneFd[] = {EGL_DMA_BUF_PLANE0_FD_EXT, EGL_DMA_BUF_PLANE1_FD_EXT, EGL_DMA_BUF_PLANE2_FD_EXT,
+                               EGL_DMA_BUF_PLANE3_FD_EXT};
+constexpr EGLint kPlaneOffset[] = {EGL_DMA_BUF_PLANE0_OFFSET_EXT, EGL_DMA_BUF_PLANE1_OFFSET_EXT,
+                                   EGL_DMA_BUF_PLANE2_OFFSET_EXT, EGL_DMA_BUF_PLANE3_OFFSET_EXT};
+constexpr EGLint kPlanePitch[] = {EGL_DMA_BUF_PLANE0_PITCH_EXT, EGL_DMA_BUF_PLANE1_PITCH_EXT,
+                                  EGL_DMA_BUF_PLANE2_PITCH_EXT, EGL_DMA_BUF_PLANE3_PITCH_EXT};
+constexpr EGLint kPlaneModifierLo[] = {EGL_DMA_BUF_PLANE0_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE1_MODIFIER_LO_EXT,
+                                       EGL_DMA_BUF_PLANE2_MODIFIER_LO_EXT, EGL_DMA_BUF_PLANE3_MODIFIER_LO_EXT};
+constexpr EGLint kPlaneModifierHi[] = {EGL_DMA_BUF_PLANE0_MODIFIER_HI_EXT, EGL_DMA_BUF_PLANE1_MODIFIER_HI_EXT,
+                                       EGL_DMA_BUF_PLANE2_MODIFIER_HI_EXT, EGL_DMA_BUF_PLANE3_MODIFIER_HI_EXT};
+}
+
+/**
+ * @class EglDmabufImage
+ * @brief Wraps a dmabuf, e.g. one rendered by Vulkan, in an EGLImage GL can sample.
+ *
+ * The import is zero copy: GL reads the memory the producer rendered into. The
+ * producer's work has to be complete before GL samples it, pass its sync_file to
+ * Egl::wait_native_fence() before drawing, and hand Egl::create_native_fence() back
+ * once GL is done so the producer does not overwrite the image while it is read.
+ *
+ * @param egl_display The display, which needs EGL_EXT_image_dma_buf_import.
+ * @param attributes  The planes; EGL duplicates the fds, they stay owned by the caller.
+ */
+EglDmabufImage::EglDmabufImage(const EglDisplay *egl_display, const DmabufAttributes &attributes) :
+        egl_display_(egl_display) {
+    if (!egl_display_->has_dmabuf_import()) {
+        throw std::runtime_error("EGL_EXT_image_dma_buf_import is not supported");
+    }
+    if (attributes.num_planes == 0 || attributes.num_planes > DmabufAttributes::kMaxPlanes) {
+        throw std::runtime_error("Invalid dmabuf plane count");
+    }
+    const bool explicit_modifier = attributes.modifier != kDrmFormatModInvalid;
+    if (explicit_modifier && !egl_display_->has_dmabuf_import_modifiers()) {
+        throw std::runtime_error("EGL_EXT_image_dma_buf_import_modifiers is not supported");
+    }
+
+    std::vector<EGLint> attribs{
+            EGL_WIDTH, attributes.width,
+            EGL_HEIGHT, attributes.height,
+            EGL_LINUX_DRM_FOURCC_EXT, static_cast<EGLint>(attributes.format),
+            EGL_IMAGE_PRESERVED_KHR, EGL_TRUE,
+    };
+    for (uint32_t i = 0; i < attributes.num_planes; i++) {
+        attribs.insert(attribs.end(), {
+                kPlaneFd[i], attributes.fd[i],
+                kPlaneOffset[i], static_cast<EGLint>(attributes.offset[i]),
+                kPlanePitch[i], static_cast<EGLint>(attributes.stride[i]),
+        });
+        if (explicit_modifier) {
+            attribs.insert(attribs.end(), {
+                    kPlaneModifierLo[i], static_cast<EGLint>(attributes.modifier & 0xffffffff),
+                    kPlaneModifierHi[i], static_cast<EGLint>(attributes.modifier >> 32),
+            });
+        }
+    }
+    attribs.push_back(EGL_NONE);
+
+    // dmabuf imports take no context, the image can be bound in any context of the display
+    image_ = egl_display_->get_create_image()(egl_display_->get_display(), EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+                                              nullptr, attribs.data());
+    if (image_ == EGL_NO_IMAGE_KHR) {
+        throw std::runtime_error("eglCreateImageKHR failed for the dmabuf: " + std::to_string(eglGetError()));
+    }
+    pfImageTargetTexture2D_ = egl_display_->get_dispatch().egl_image_target_texture_2d;
+}
+
+EglDmabufImage::~EglDmabufImage() {
+    if (image_ != EGL_NO_IMAGE_KHR) {
+        egl_display_->get_destroy_image()(egl_display_->get_display(), image_);
+    }
+}
+
+/**
+ * @brief Makes the image the storage of the texture bound to target on the current context.
+ *
+ * @param target GL_TEXTURE_2D, or GL_TEXTURE_EXTERNAL_OES for formats the driver only
+ *               samples through an external texture.
+ */
+void EglDmabufImage::bind(GLenum target) const {
+    if (!pfImageTargetTexture2D_) {
+        LOG_ERROR("glEGLImageTargetTexture2DOES is not available");
+        return;
+    }
+    pfImageTargetTexture2D_(target, image_);
+}
+
+/**
+ * @brief Lists the modifiers the display can import for a format.
+ *
+ * Intersect them with the allocator's, e.g. VulkanDmabuf::get_modifiers(), so the
+ * producer picks a layout EGL can sample.
+ *
+ * @param egl_display The display.
+ * @param format      The DRM fourcc format.
+ * @return The modifiers, empty without EGL_EXT_image_dma_buf_import_modifiers; external
+ *         only modifiers are left out as they cannot be bound to GL_TEXTURE_2D.
+ */
+std::vector<uint64_t> EglDmabufImage::get_modifiers(const EglDisplay *egl_display, uint32_t format) {
+    const auto query = egl_display->get_query_dmabuf_modifiers();
+    if (!query) {
+        return {};
+    }
+    const auto dpy = egl_display->get_display();
+    const auto fourcc = static_cast<EGLint>(format);
+    EGLint count = 0;
+    if (!query(dpy, fourcc, 0, nullptr, nullptr, &count) || count <= 0) {
+        return {};
+    }
+    std::vector<EGLuint64KHR> modifiers(static_cast<size_t>(count));
+    std::vector<EGLBoolean> external_only(static_cast<size_t>(count));
+    if (!query(dpy, fourcc, count, modifiers.data(), external_only.data(), &count)) {
+        return {};
+    }
+    std::vector<uint64_t> result;
+    for (EGLint i = 0; i < count; i++) {
+        if (!external_only[static_cast<size_t>(i)]) {
+            result.push_back(modifiers[static_cast<size_t>(i)]);
+        }
+    }
+    return result;
+}
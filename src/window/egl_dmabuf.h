@@ -0,0 +1,56 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_EGL_DMABUF_H_
+#define SRC_WINDOW_EGL_DMABUF_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "window_dmabuf.h"
+#include "utils/export.h"
+
+class EglDisplay;
+
+class WAYPP_EXPORT EglDmabufImage {
+public:
+    explicit EglDmabufImage(const EglDisplay *egl_display, const DmabufAttributes &attributes);
+
+    ~EglDmabufImage();
+
+    EglDmabufImage(const EglDmabufImage &) = delete;
+
+    EglDmabufImage &operator=(const EglDmabufImage &) = delete;
+
+    void bind(GLenum target = GL_TEXTURE_2D) const;
+
+    [[nodiscard]] EGLImageKHR get_image() const { return image_; }
+
+    [[nodiscard]] static std::vector<uint64_t> get_modifiers(const EglDisplay *egl_display, uint32_t format);
+
+private:
+    const EglDisplay *egl_display_;
+    EGLImageKHR image_{EGL_NO_IMAGE_KHR};
+    PFNGLEGLIMAGETARGETTEXTURE2DOESPROC pfImageTargetTexture2D_{};
+};
+
+#endif // SRC_WINDOW_EGL_DMABUF_H_
@@ -0,0 +1,91 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "egl_extensions.h"
+
+#include <array>
+
+#include <EGL/egl.h>
+
+namespace {
+// in Extension order
+constexpr std::array<const char *, EglExtensions::EXTENSION_COUNT> kNames = {
+        "EGL_ANDROID_native_fence_sync",
+        "EGL_EXT_buffer_age",
+        "EGL_EXT_image_dma_buf_import",
+        "EGL_EXT_image_dma_buf_import_modifiers",
+        "EGL_EXT_swap_buffers_with_damage",
+        "EGL_IMG_context_priority",
+        "EGL_KHR_fence_sync",
+        "EGL_KHR_image_base",
+        "EGL_KHR_no_config_context",
+        "EGL_KHR_partial_update",
+        "EGL_KHR_surfaceless_context",
+        "EGL_KHR_swap_buffers_with_damage",
+        "EGL_KHR_wait_sync",
+        "EGL_MESA_configless_context",
+        "EGL_NV_context_priority_realtime",
+        "EGL_EXT_device_base",
+        "EGL_EXT_device_enumeration",
+        "EGL_EXT_device_query",
+        "EGL_EXT_platform_base",
+        "EGL_EXT_platform_device",
+        "EGL_EXT_platform_wayland",
+        "EGL_KHR_debug",
+        "EGL_KHR_platform_wayland",
+        "EGL_MESA_platform_surfaceless",
+        "EGL_EXT_device_drm",
+        "EGL_EXT_device_drm_render_node",
+        "EGL_EXT_explicit_device",
+};
+}
+
+/**
+ * @brief Splits a space separated extension string, replacing what was parsed before.
+ *
+ * @param extensions The string from eglQueryString() or eglQueryDeviceStringEXT(), nullptr for none.
+ */
+void EglExtensions::parse(const char *extensions) {
+    known_.reset();
+    names_.clear();
+    text_ = extensions ? extensions : "";
+
+    const std::string_view text(text_);
+    size_t begin = 0;
+    while (begin < text.size()) {
+        auto end = text.find(' ', begin);
+        if (end == std::string_view::npos) {
+            end = text.size();
+        }
+        if (end > begin) {
+            names_.insert(text.substr(begin, end - begin));
+        }
+        begin = end + 1;
+    }
+    for (size_t i = 0; i < kNames.size(); i++) {
+        known_[i] = names_.count(kNames[i]) != 0;
+    }
+}
+
+const char *EglExtensions::get_name(Extension extension) {
+    return extension < EXTENSION_COUNT ? kNames[extension] : nullptr;
+}
+
+const EglExtensions &EglExtensions::get_client() {
+    static const EglExtensions client(eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS));
+    return client;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_EGL_EXTENSIONS_H_
+#define SRC_WINDOW_EGL_EXTENSIONS_H_
+
+#include <bitset>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+#include "utils/export.h"
+
+/**
+ * @brief The extensions of an EGL display, client or device, parsed once.
+ *
+ * The extensions the library looks for are bits, testing one is a load. Every
+ * name, known or not, is also kept in a hash set, so has(name) is one lookup
+ * rather than a scan of the whole string.
+ */
+class WAYPP_EXPORT EglExtensions {
+public:
+    typedef enum {
+        // display extensions
+        ANDROID_NATIVE_FENCE_SYNC,
+        EXT_BUFFER_AGE,
+        EXT_IMAGE_DMA_BUF_IMPORT,
+        EXT_IMAGE_DMA_BUF_IMPORT_MODIFIERS,
+        EXT_SWAP_BUFFERS_WITH_DAMAGE,
+        IMG_CONTEXT_PRIORITY,
+        KHR_FENCE_SYNC,
+        KHR_IMAGE_BASE,
+        KHR_NO_CONFIG_CONTEXT,
+        KHR_PARTIAL_UPDATE,
+        KHR_SURFACELESS_CONTEXT,
+        KHR_SWAP_BUFFERS_WITH_DAMAGE,
+        KHR_WAIT_SYNC,
+        MESA_CONFIGLESS_CONTEXT,
+        NV_CONTEXT_PRIORITY_REALTIME,
+        // client extensions
+        EXT_DEVICE_BASE,
+        EXT_DEVICE_ENUMERATION,
+        EXT_DEVICE_QUERY,
+        EXT_PLATFORM_BASE,
+        EXT_PLATFORM_DEVICE,
+        EXT_PLATFORM_WAYLAND,
+        KHR_DEBUG,
+        KHR_PLATFORM_WAYLAND,
+        MESA_PLATFORM_SURFACELESS,
+        // device extensions
+        EXT_DEVICE_DRM,
+        EXT_DEVICE_DRM_RENDER_NODE,
+        EXT_EXPLICIT_DEVICE,
+        EXTENSION_COUNT,
+    } Extension;
+
+    EglExtensions() = default;
+
+    explicit EglExtensions(const char *extensions) { parse(extensions); }
+
+    // the set points into its own copy of the string
+    EglExtensions(const EglExtensions &) = delete;
+
+    EglExtensions &operator=(const EglExtensions &) = delete;
+
+    void parse(const char *extensions);
+
+    [[nodiscard]] bool has(Extension extension) const { return known_[extension]; }
+
+    [[nodiscard]] bool has(std::string_view name) const { return names_.count(name) != 0; }
+
+    [[nodiscard]] size_t size() const { return names_.size(); }
+
+    [[nodiscard]] static const char *get_name(Extension extension);
+
+    // eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS), queried on first use; empty before EGL 1.5
+    [[nodiscard]] static const EglExtensions &get_client();
+
+private:
+    std::bitset<EXTENSION_COUNT> known_;
+    std::string text_;
+    std::unordered_set<std::string_view> names_;
+};
+
+#endif // SRC_WINDOW_EGL_EXTENSIONS_H_
@@ -0,0 +1,175 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "egl_upload_worker.h"
+#include "egl.h"
+
+#include <stdexcept>
+
+/**
+ * @class EglUploadWorker
+ * @brief Runs texture and buffer uploads on a thread of their own.
+ *
+ * The thread owns a low priority context of its own, which shares objects with the render
+ * contexts, so a glTexImage2D of a large image no longer stalls the frame it is issued
+ * in. After each job the worker inserts an EGL fence; process_completed() makes the
+ * render context wait for it on the GPU, then runs the job's completion, from which
+ * point the uploaded objects can be used for drawing.
+ *
+ * The context is not the display's resource context, so Egl::make_resource_current() can
+ * still be used on another thread while the worker runs.
+ *
+ * @code
+ * worker.submit([&]() { glBindTexture(GL_TEXTURE_2D, tex); glTexImage2D(...); },
+ *               [&]() { texture_ready = true; });
+ * // each frame, with the window's context current
+ * worker.process_completed();
+ * @endcode
+ *
+ * @param display The EGL display; it must outlive the worker.
+ * @throws std::runtime_error without EGL_KHR_surfaceless_context or when the context can't be created.
+ */
+EglUploadWorker::EglUploadWorker(const EglDisplay *display) :
+        egl_display_(display),
+        dpy_(display->get_display()),
+        context_(EGL_NO_CONTEXT) {
+    if (!egl_display_->has_surfaceless_context()) {
+        throw std::runtime_error("EglUploadWorker needs EGL_KHR_surfaceless_context.");
+    }
+    context_ = egl_display_->create_shared_context(EGL_CONTEXT_PRIORITY_LOW_IMG);
+    if (context_ == EGL_NO_CONTEXT) {
+        throw std::runtime_error("EglUploadWorker failed to create its context.");
+    }
+    thread_ = std::thread(&EglUploadWorker::run, this);
+}
+
+/**
+ * @brief Finishes the running job, drops the queued ones and joins the thread.
+ *
+ * Completions not yet processed are dropped without being called.
+ */
+EglUploadWorker::~EglUploadWorker() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+        jobs_.clear();
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    for (const auto &completed: completed_) {
+        if (completed.fence != EGL_NO_SYNC_KHR) {
+            egl_display_->get_destroy_sync()(dpy_, completed.fence);
+        }
+    }
+    eglDestroyContext(dpy_, context_);
+}
+
+/**
+ * @brief Queues an upload.
+ *
+ * Thread safe. Jobs run in submission order.
+ *
+ * @param job        The GL commands to run with the worker's context current.
+ * @param completion Called from process_completed() once the results are usable.
+ */
+void EglUploadWorker::submit(Job job, Completion completion) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        jobs_.emplace_back(std::move(job), std::move(completion));
+        pending_++;
+    }
+    cv_.notify_one();
+}
+
+/**
+ * @brief Hands finished uploads over to the calling thread's current context.
+ *
+ * Call on the render thread with its context current, e.g. at the start of each frame.
+ * Never blocks the CPU when EGL_KHR_wait_sync is available: the context's later
+ * commands wait for the upload on the GPU.
+ *
+ * @return The number of completions run.
+ */
+size_t EglUploadWorker::process_completed() {
+    std::deque<Completed> completed;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        completed.swap(completed_);
+        pending_ -= completed.size();
+    }
+    for (auto &item: completed) {
+        if (item.fence != EGL_NO_SYNC_KHR) {
+            if (egl_display_->get_wait_sync()) {
+                (void) egl_display_->get_wait_sync()(dpy_, item.fence, 0);
+            } else {
+                (void) egl_display_->get_client_wait_sync()(dpy_, item.fence, 0, EGL_FOREVER_KHR);
+            }
+            egl_display_->get_destroy_sync()(dpy_, item.fence);
+        }
+        if (item.completion) {
+            item.completion();
+        }
+    }
+    return completed.size();
+}
+
+/**
+ * @return The number of uploads submitted whose completion has not run yet.
+ */
+size_t EglUploadWorker::get_pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_;
+}
+
+void EglUploadWorker::run() {
+    Egl::bind_current(dpy_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this]() { return !running_ || !jobs_.empty(); });
+        if (!running_) {
+            break;
+        }
+        auto [job, completion] = std::move(jobs_.front());
+        jobs_.pop_front();
+        lock.unlock();
+
+        if (job) {
+            job();
+        }
+        EGLSyncKHR fence = EGL_NO_SYNC_KHR;
+        if (egl_display_->has_fence_sync()) {
+            fence = egl_display_->get_create_sync()(dpy_, EGL_SYNC_FENCE_KHR, nullptr);
+        }
+        if (fence != EGL_NO_SYNC_KHR) {
+            // another context can only wait for a fence that has been flushed
+            (void) egl_display_->get_client_wait_sync()(dpy_, fence, EGL_SYNC_FLUSH_COMMANDS_BIT_KHR, 0);
+        } else {
+            // no fences, finish the upload before handing it over
+            eglWaitClient();
+        }
+
+        lock.lock();
+        completed_.push_back({fence, std::move(completion)});
+    }
+    lock.unlock();
+
+    Egl::bind_current(dpy_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglReleaseThread();
+}
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_EGL_UPLOAD_WORKER_H_
+#define SRC_WINDOW_EGL_UPLOAD_WORKER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "egl_display.h"
+#include "utils/export.h"
+
+class WAYPP_EXPORT EglUploadWorker {
+public:
+    // runs on the worker thread with the worker's context current
+    typedef std::function<void()> Job;
+    // runs on the render thread once the job's GL commands can be used
+    typedef std::function<void()> Completion;
+
+    explicit EglUploadWorker(const EglDisplay *display);
+
+    ~EglUploadWorker();
+
+    EglUploadWorker(const EglUploadWorker &) = delete;
+
+    EglUploadWorker &operator=(const EglUploadWorker &) = delete;
+
+    void submit(Job job, Completion completion = nullptr);
+
+    size_t process_completed();
+
+    [[nodiscard]] size_t get_pending() const;
+
+private:
+    struct Completed {
+        EGLSyncKHR fence;
+        Completion completion;
+    };
+
+    const EglDisplay *egl_display_;
+    EGLDisplay dpy_;
+    // shares objects with the render context, only ever current on thread_
+    EGLContext context_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::pair<Job, Completion>> jobs_;
+    std::deque<Completed> completed_;
+    // submitted and not yet handed to process_completed()
+    size_t pending_{};
+    bool running_{true};
+
+    std::thread thread_;
+
+    void run();
+};
+
+#endif // SRC_WINDOW_EGL_UPLOAD_WORKER_H_
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "frame_arena.h"
+
+#include <algorithm>
+
+/**
+ * @class FrameArena
+ * @brief A bump allocator for one frame's temporaries, freed all at once after the commit.
+ *
+ * Vertex staging, command lists and damage rectangles built during a draw are
+ * carved out of one block with a pointer bump instead of going to the heap, and the
+ * window resets the arena after the frame is committed. When a frame needs more than
+ * the block holds, further blocks are chained; the next reset() replaces them with
+ * one block of the combined size, so a steady workload stops allocating after its
+ * first frames.
+ *
+ * Nothing is destructed on reset(); keep to trivially destructible data, or to
+ * containers whose destructors run before the frame ends.
+ *
+ * @param capacity The size of the first block in bytes.
+ */
+FrameArena::FrameArena(size_t capacity) {
+    add_block(std::max<size_t>(capacity, 1));
+}
+
+/**
+ * @brief Returns size bytes aligned to alignment, valid until the next reset().
+ *
+ * @param alignment A power of two.
+ */
+void *FrameArena::allocate(size_t size, size_t alignment) {
+    auto block = &blocks_.back();
+    auto base = reinterpret_cast<uintptr_t>(block->data.get());
+    auto aligned = (base + offset_ + alignment - 1) & ~(alignment - 1);
+    if (aligned + size > base + block->size) {
+        add_block(std::max(size + alignment, block->size));
+        block = &blocks_.back();
+        base = reinterpret_cast<uintptr_t>(block->data.get());
+        aligned = (base + alignment - 1) & ~(alignment - 1);
+    }
+    offset_ = aligned + size - base;
+    used_ += size;
+    return reinterpret_cast<void *>(aligned);
+}
+
+/**
+ * @brief Frees everything allocated since the last reset(), see the class description.
+ */
+void FrameArena::reset() {
+    if (blocks_.size() > 1) {
+        const size_t size = capacity_;
+        blocks_.clear();
+        capacity_ = 0;
+        add_block(size);
+    }
+    offset_ = 0;
+    used_ = 0;
+}
+
+void FrameArena::add_block(size_t size) {
+    blocks_.push_back({std::make_unique<std::byte[]>(size), size});
+    capacity_ += size;
+    offset_ = 0;
+}
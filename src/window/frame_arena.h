@@ -0,0 +1,96 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_FRAME_ARENA_H_
+#define SRC_WINDOW_FRAME_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT FrameArena {
+public:
+    // the first block, grown after a frame needs more
+    static constexpr size_t kDefaultCapacity = 64 * 1024;
+
+    explicit FrameArena(size_t capacity = kDefaultCapacity);
+
+    FrameArena(const FrameArena &) = delete;
+
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    [[nodiscard]] void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // uninitialized storage for count trivially destructible Ts, valid until reset()
+    template<typename T>
+    [[nodiscard]] T *allocate_array(size_t count) {
+        static_assert(std::is_trivially_destructible_v<T>, "FrameArena never runs destructors");
+        return static_cast<T *>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    void reset();
+
+    [[nodiscard]] size_t get_used() const { return used_; }
+
+    [[nodiscard]] size_t get_capacity() const { return capacity_; }
+
+    // for standard containers of frame temporaries, e.g. std::vector<Vertex, FrameArena::Allocator<Vertex>>
+    template<typename T>
+    struct Allocator {
+        using value_type = T;
+
+        FrameArena *arena;
+
+        explicit Allocator(FrameArena *arena) : arena(arena) {}
+
+        template<typename U>
+        Allocator(const Allocator<U> &other) : arena(other.arena) {}
+
+        T *allocate(size_t count) { return static_cast<T *>(arena->allocate(sizeof(T) * count, alignof(T))); }
+
+        // freed all at once by reset()
+        void deallocate(T * /* p */, size_t /* count */) {}
+
+        template<typename U>
+        bool operator==(const Allocator<U> &other) const { return arena == other.arena; }
+
+        template<typename U>
+        bool operator!=(const Allocator<U> &other) const { return arena != other.arena; }
+    };
+
+private:
+    struct Block {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks_;
+    // bump offset into blocks_.back()
+    size_t offset_{};
+    // bytes handed out this frame, and the size of all blocks
+    size_t used_{};
+    size_t capacity_{};
+
+    void add_block(size_t size);
+};
+
+#endif // SRC_WINDOW_FRAME_ARENA_H_
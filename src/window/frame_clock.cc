@@ -0,0 +1,104 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "frame_clock.h"
+
+/**
+ * @brief Sets the period of the output's current mode.
+ *
+ * A different mode invalidates what was observed at the old one, so windows
+ * retime from the next frame on instead of averaging both rates.
+ *
+ * @param refresh_mhz Refresh rate in mHz, as reported by Output::get_mode().
+ */
+void FrameClock::set_nominal_refresh(int refresh_mhz) {
+    const uint64_t period = refresh_mhz > 0 ? 1000000000000ULL / static_cast<uint64_t>(refresh_mhz) : 0;
+    if (nominal_ns_.exchange(period, std::memory_order_relaxed) != period) {
+        observed_ns_.store(0, std::memory_order_relaxed);
+        last_vblank_ns_.store(0, std::memory_order_relaxed);
+        last_msc_.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Records a frame presented on the output.
+ *
+ * Without a refresh interval in the feedback the period is measured from the
+ * presentation times and vblank counters of consecutive feedbacks.
+ *
+ * @param time_ns    Presentation time in the presentation clock domain.
+ * @param refresh_ns Refresh interval from the feedback, 0 if unknown.
+ * @param msc        Vertical retrace counter from the feedback, 0 if unknown.
+ */
+void FrameClock::record_presentation(uint64_t time_ns, uint32_t refresh_ns, uint64_t msc) {
+    const uint64_t last = last_vblank_ns_.load(std::memory_order_relaxed);
+    if (time_ns <= last) {
+        // another window reported a later vblank already
+        return;
+    }
+    const uint64_t last_msc = last_msc_.load(std::memory_order_relaxed);
+    if (refresh_ns) {
+        observed_ns_.store(refresh_ns, std::memory_order_relaxed);
+    } else if (last && last_msc && msc > last_msc) {
+        observed_ns_.store((time_ns - last) / (msc - last_msc), std::memory_order_relaxed);
+    }
+    last_vblank_ns_.store(time_ns, std::memory_order_relaxed);
+    last_msc_.store(msc, std::memory_order_relaxed);
+}
+
+/**
+ * @return The vblank period in nanoseconds, observed if possible, else nominal, 0 if unknown.
+ */
+uint64_t FrameClock::get_period_ns() const {
+    const uint64_t observed = observed_ns_.load(std::memory_order_relaxed);
+    return observed ? observed : nominal_ns_.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Predicts the first vblank after now.
+ *
+ * @param now The current time in the presentation clock domain.
+ * @return The vblank time, or 0 if the period or phase is unknown.
+ */
+uint64_t FrameClock::next_vblank_ns(uint64_t now) const {
+    const uint64_t period = get_period_ns();
+    const uint64_t last = get_last_vblank_ns();
+    if (!period || !last || last > now) {
+        return 0;
+    }
+    return last + ((now - last) / period + 1) * period;
+}
+
+/**
+ * @brief Returns the smallest number of vblanks per frame keeping the rate at or below max_fps.
+ *
+ * Rounds up, so a cap between two divisors draws at the lower rate; a cap only a
+ * sixteenth of a period short of one, e.g. 60 fps on a 59.94 Hz output, still counts
+ * as that one, as vblanks jitter around the nominal period.
+ *
+ * @param period_ns The vblank period, 0 if unknown.
+ * @param max_fps   The highest frame rate, 0 for no cap.
+ * @return The divisor, at least 1.
+ */
+uint32_t FrameClock::frame_divisor(uint64_t period_ns, uint32_t max_fps) {
+    if (!max_fps || !period_ns) {
+        return 1;
+    }
+    const uint64_t interval = 1000000000ULL / max_fps;
+    const uint64_t divisor = (interval + period_ns - period_ns / 16) / period_ns;
+    return static_cast<uint32_t>(divisor > 1 ? divisor : 1);
+}
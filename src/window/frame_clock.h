@@ -0,0 +1,64 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_FRAME_CLOCK_H_
+#define SRC_WINDOW_FRAME_CLOCK_H_
+
+#include <atomic>
+#include <cstdint>
+
+#include "utils/export.h"
+
+/**
+ * @brief The vblank period and phase of one output.
+ *
+ * Windows presenting on the output feed it their presentation feedback, and the
+ * windows whose primary output it is schedule their frames from it. Written from
+ * the threads dispatching the windows' feedback, read from any thread.
+ */
+class WAYPP_EXPORT FrameClock {
+public:
+    FrameClock() = default;
+
+    FrameClock(const FrameClock &) = delete;
+
+    FrameClock &operator=(const FrameClock &) = delete;
+
+    void set_nominal_refresh(int refresh_mhz);
+
+    void record_presentation(uint64_t time_ns, uint32_t refresh_ns, uint64_t msc);
+
+    [[nodiscard]] uint64_t get_period_ns() const;
+
+    // in the presentation clock domain, 0 until a frame was presented on the output
+    [[nodiscard]] uint64_t get_last_vblank_ns() const { return last_vblank_ns_.load(std::memory_order_relaxed); }
+
+    [[nodiscard]] uint64_t next_vblank_ns(uint64_t now) const;
+
+    // vblanks per frame that keep the rate at or below max_fps, 1 without a cap or period
+    [[nodiscard]] static uint32_t frame_divisor(uint64_t period_ns, uint32_t max_fps);
+
+private:
+    // from the output's current mode
+    std::atomic<uint64_t> nominal_ns_{};
+    // reported by presentation feedback, or measured from the vblank counter
+    std::atomic<uint64_t> observed_ns_{};
+    std::atomic<uint64_t> last_vblank_ns_{};
+    std::atomic<uint64_t> last_msc_{};
+};
+
+#endif // SRC_WINDOW_FRAME_CLOCK_H_
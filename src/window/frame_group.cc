@@ -0,0 +1,124 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "frame_group.h"
+
+#include <algorithm>
+
+#include "window.h"
+#include "window_manager/display.h"
+
+/**
+ * @class FrameGroup
+ *
+ * Windows join with add(); create one group per output and add the windows shown on
+ * it, see WindowManager::get_output_frame_group(). Frames drawn by the deadline scheduler
+ * or after request_redraw() outside a frame callback are not grouped.
+ */
+
+/**
+ * @param display The connection flushed once per submission.
+ * @param post    Defers the submission until the callbacks dispatched with the first are done,
+ *                nullptr to draw each frame as its callback arrives.
+ */
+FrameGroup::FrameGroup(struct wl_display *display, Post post) :
+        wl_display_(display),
+        post_(std::move(post)) {
+}
+
+/**
+ * @brief Detaches the members, frames still queued are drawn ungrouped.
+ */
+FrameGroup::~FrameGroup() {
+    while (!members_.empty()) {
+        remove(members_.back());
+    }
+}
+
+/**
+ * @brief Adds a window, taking it out of the group it was in.
+ */
+void FrameGroup::add(Window *window) {
+    if (window->frame_group_ == this) {
+        return;
+    }
+    if (window->frame_group_) {
+        window->frame_group_->remove(window);
+    }
+    window->frame_group_ = this;
+    members_.push_back(window);
+}
+
+/**
+ * @brief Removes a window, drawing its queued frame at once.
+ */
+void FrameGroup::remove(Window *window) {
+    const auto it = std::find(members_.begin(), members_.end(), window);
+    if (it == members_.end()) {
+        return;
+    }
+    members_.erase(it);
+    window->frame_group_ = nullptr;
+    const auto due = std::find(due_.begin(), due_.end(), window);
+    if (due != due_.end()) {
+        due_.erase(due);
+        if (window->group_pending_) {
+            window->group_pending_ = false;
+            window->render_frame(window->group_time_);
+        }
+    }
+}
+
+/**
+ * @brief Queues a member whose frame callback arrived, and schedules the submission.
+ */
+void FrameGroup::queue(Window *window) {
+    due_.push_back(window);
+    if (!post_) {
+        submit();
+        return;
+    }
+    if (!submit_pending_) {
+        submit_pending_ = true;
+        post_([this]() { submit(); });
+    }
+}
+
+/**
+ * @brief Draws the queued members back-to-back, then flushes their commits at once.
+ *
+ * Members paused since their callback arrived are skipped.
+ */
+void FrameGroup::submit() {
+    submit_pending_ = false;
+    if (due_.empty()) {
+        return;
+    }
+    // a draw callback may remove members, taking them out of due_
+    while (!due_.empty()) {
+        auto window = due_.front();
+        due_.erase(due_.begin());
+        if (!window->group_pending_) {
+            continue;
+        }
+        window->group_pending_ = false;
+        window->render_frame(window->group_time_);
+        frames_++;
+    }
+    submits_++;
+    Display::flush(wl_display_);
+}
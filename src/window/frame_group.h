@@ -0,0 +1,82 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_FRAME_GROUP_H_
+#define SRC_WINDOW_FRAME_GROUP_H_
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "utils/export.h"
+
+class Window;
+
+/**
+ * @brief Windows on one output drawn back-to-back and flushed together.
+ *
+ * The compositor sends the frame callbacks of every window it repaints at once, but
+ * each window would draw and commit as its callback is dispatched. A member's frame
+ * is instead queued until the callbacks read together have all been dispatched, then
+ * the queued windows draw one after the other and their commits leave in one flush,
+ * so they reach the same repaint. Members must be dispatched on the thread post runs
+ * tasks on.
+ */
+class WAYPP_EXPORT FrameGroup {
+public:
+    // runs a task once the events being dispatched are done, e.g. WindowManager::post()
+    using Post = std::function<void(std::function<void()> task)>;
+
+    FrameGroup(struct wl_display *display, Post post);
+
+    ~FrameGroup();
+
+    FrameGroup(const FrameGroup &) = delete;
+
+    FrameGroup &operator=(const FrameGroup &) = delete;
+
+    void add(Window *window);
+
+    void remove(Window *window);
+
+    [[nodiscard]] size_t size() const { return members_.size(); }
+
+    // group submissions, and the frames drawn by them
+    [[nodiscard]] uint64_t get_submit_count() const { return submits_; }
+
+    [[nodiscard]] uint64_t get_frame_count() const { return frames_; }
+
+private:
+    friend class Window;
+
+    struct wl_display *wl_display_;
+    Post post_;
+    std::vector<Window *> members_;
+    // members whose frame callback arrived since the last submission, in arrival order
+    std::vector<Window *> due_;
+    bool submit_pending_{};
+    uint64_t submits_{};
+    uint64_t frames_{};
+
+    void queue(Window *window);
+
+    void submit();
+};
+
+#endif // SRC_WINDOW_FRAME_GROUP_H_
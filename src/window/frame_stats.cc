@@ -0,0 +1,152 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "frame_stats.h"
+
+#include <algorithm>
+
+/**
+ * @class FrameStats
+ * @brief Frame time, render time and latency percentiles, missed vblanks and FPS of a window.
+ *
+ * Samples go into fixed-size histograms of relaxed atomic counters, so recording
+ * never allocates or locks and a monitoring thread can take get_snapshot() at any
+ * time. A snapshot taken while frames are recorded may mix two adjacent frames,
+ * which does not matter for percentiles. Recording is done from one thread, the
+ * one rendering the window.
+ */
+
+/**
+ * @brief Records a rendered frame.
+ *
+ * Without presentation feedback a missed vblank is estimated from the interval, a
+ * frame arriving more than half a refresh late missed the vblanks in between.
+ *
+ * @param start_ns   When the frame started, in the presentation clock domain.
+ * @param render_ns  The time spent in the draw callback.
+ * @param refresh_ns The output refresh interval, 0 if unknown.
+ * @param continuous false if the frame does not follow the previous one directly,
+ *                   e.g. in render-on-demand mode or after a pause; its interval is not recorded.
+ */
+void FrameStats::record_frame(uint64_t start_ns, uint64_t render_ns, uint64_t refresh_ns, bool continuous) {
+    frames_.fetch_add(1, std::memory_order_relaxed);
+    render_time_.add(render_ns);
+
+    if (continuous && last_start_ns_ && start_ns > last_start_ns_) {
+        const uint64_t interval = start_ns - last_start_ns_;
+        frame_time_.add(interval);
+
+        auto average = average_interval_ns_.load(std::memory_order_relaxed);
+        average = average ? average - average / 16 + interval / 16 : interval;
+        average_interval_ns_.store(average, std::memory_order_relaxed);
+
+        if (!has_presentation_ && refresh_ns && interval > refresh_ns + refresh_ns / 2) {
+            missed_vblanks_.fetch_add((interval + refresh_ns / 2) / refresh_ns - 1, std::memory_order_relaxed);
+        }
+    } else {
+        last_msc_ = 0;
+    }
+    last_start_ns_ = start_ns;
+}
+
+/**
+ * @brief Records a presented frame from its presentation feedback.
+ *
+ * @param start_ns   When the frame started, in the presentation clock domain.
+ * @param present_ns When it was shown.
+ * @param msc        The output's vertical retrace counter at presentation.
+ */
+void FrameStats::record_presentation(uint64_t start_ns, uint64_t present_ns, uint64_t msc) {
+    has_presentation_ = true;
+    if (present_ns > start_ns) {
+        latency_.add(present_ns - start_ns);
+    }
+    if (last_msc_ && msc > last_msc_ + vblanks_per_frame_) {
+        missed_vblanks_.fetch_add(msc - last_msc_ - vblanks_per_frame_, std::memory_order_relaxed);
+    }
+    last_msc_ = msc;
+}
+
+/**
+ * @return The statistics since the window was created or reset() was called.
+ */
+FrameStats::Snapshot FrameStats::get_snapshot() const {
+    const auto average = average_interval_ns_.load(std::memory_order_relaxed);
+    return {
+            .frames = frames_.load(std::memory_order_relaxed),
+            .fps = average ? 1e9 / static_cast<double>(average) : 0.0,
+            .frame_time = frame_time_.get_percentiles(),
+            .render_time = render_time_.get_percentiles(),
+            .latency = latency_.get_percentiles(),
+            .input_latency = input_latency_.get_percentiles(),
+            .inputs = input_latency_.get_count(),
+            .missed_vblanks = missed_vblanks_.load(std::memory_order_relaxed),
+            .discarded = discarded_.load(std::memory_order_relaxed),
+    };
+}
+
+/**
+ * @brief Clears the statistics, e.g. after warm-up frames. Call from the thread recording frames.
+ */
+void FrameStats::reset() {
+    frame_time_.clear();
+    render_time_.clear();
+    latency_.clear();
+    input_latency_.clear();
+    frames_.store(0, std::memory_order_relaxed);
+    average_interval_ns_.store(0, std::memory_order_relaxed);
+    missed_vblanks_.store(0, std::memory_order_relaxed);
+    discarded_.store(0, std::memory_order_relaxed);
+    last_start_ns_ = 0;
+    last_msc_ = 0;
+}
+
+void FrameStats::Histogram::add(uint64_t value_ns) {
+    const auto bucket = std::min<uint64_t>(value_ns / bucket_width_ns_, kBucketCount - 1);
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+}
+
+FrameStats::Percentiles FrameStats::Histogram::get_percentiles() const {
+    const auto count = count_.load(std::memory_order_relaxed);
+    return {percentile(count, 0.50), percentile(count, 0.95), percentile(count, 0.99)};
+}
+
+void FrameStats::Histogram::clear() {
+    for (auto &bucket: buckets_) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    count_.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * @return The upper edge of the bucket holding the given fraction of the samples, 0 without samples.
+ */
+uint64_t FrameStats::Histogram::percentile(uint64_t count, double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    const auto target = static_cast<uint64_t>(static_cast<double>(count) * fraction + 0.5);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBucketCount; i++) {
+        seen += buckets_[i].load(std::memory_order_relaxed);
+        if (seen >= target && seen > 0) {
+            return (i + 1) * bucket_width_ns_;
+        }
+    }
+    return kBucketCount * bucket_width_ns_;
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_FRAME_STATS_H_
+#define SRC_WINDOW_FRAME_STATS_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT FrameStats {
+public:
+    struct Percentiles {
+        uint64_t p50_ns;
+        uint64_t p95_ns;
+        uint64_t p99_ns;
+    };
+
+    struct Snapshot {
+        uint64_t frames;
+        double fps;
+        // interval between the starts of consecutive frames
+        Percentiles frame_time;
+        // time spent in the draw callback
+        Percentiles render_time;
+        // from the start of a frame until it was presented, all zero without presentation feedback
+        Percentiles latency;
+        // from an input event until the first frame rendered after it was presented
+        Percentiles input_latency;
+        uint64_t inputs;
+        uint64_t missed_vblanks;
+        uint64_t discarded;
+    };
+
+    FrameStats() = default;
+
+    FrameStats(const FrameStats &) = delete;
+
+    FrameStats &operator=(const FrameStats &) = delete;
+
+    void record_frame(uint64_t start_ns, uint64_t render_ns, uint64_t refresh_ns, bool continuous);
+
+    void record_presentation(uint64_t start_ns, uint64_t present_ns, uint64_t msc);
+
+    void record_input_latency(uint64_t latency_ns) { input_latency_.add(latency_ns); }
+
+    // vblanks between consecutive frames that are not missed, e.g. 2 for 30 fps on a 60 Hz output
+    void set_vblanks_per_frame(uint32_t vblanks) { vblanks_per_frame_ = vblanks ? vblanks : 1; }
+
+    void record_discarded() { discarded_.fetch_add(1, std::memory_order_relaxed); }
+
+    [[nodiscard]] Snapshot get_snapshot() const;
+
+    static constexpr size_t kBucketCount = 256;
+    // input latency spans several frames, 1 ms buckets up to 256 ms
+    static constexpr uint64_t kInputBucketWidthNs = 1000000;
+
+    // samples per kInputBucketWidthNs bucket, the last one collects everything slower
+    void get_input_latency_histogram(std::array<uint32_t, kBucketCount> &buckets) const {
+        input_latency_.copy(buckets);
+    }
+
+    void reset();
+
+private:
+    // 0.25 ms buckets up to 64 ms, the last one collects everything slower
+    static constexpr uint64_t kBucketWidthNs = 250000;
+
+    class Histogram {
+    public:
+        explicit Histogram(uint64_t bucket_width_ns = kBucketWidthNs) : bucket_width_ns_(bucket_width_ns) {}
+
+        void add(uint64_t value_ns);
+
+        [[nodiscard]] Percentiles get_percentiles() const;
+
+        [[nodiscard]] uint64_t get_count() const { return count_.load(std::memory_order_relaxed); }
+
+        void copy(std::array<uint32_t, kBucketCount> &buckets) const {
+            for (size_t i = 0; i < kBucketCount; i++) {
+                buckets[i] = buckets_[i].load(std::memory_order_relaxed);
+            }
+        }
+
+        void clear();
+
+    private:
+        uint64_t bucket_width_ns_;
+        std::array<std::atomic<uint32_t>, kBucketCount> buckets_{};
+        std::atomic<uint64_t> count_{};
+
+        [[nodiscard]] uint64_t percentile(uint64_t count, double fraction) const;
+    };
+
+    Histogram frame_time_;
+    Histogram render_time_;
+    Histogram latency_;
+    Histogram input_latency_{kInputBucketWidthNs};
+
+    std::atomic<uint64_t> frames_{};
+    std::atomic<uint64_t> average_interval_ns_{};
+    std::atomic<uint64_t> missed_vblanks_{};
+    std::atomic<uint64_t> discarded_{};
+
+    // only touched by the thread recording frames
+    uint64_t last_start_ns_{};
+    uint64_t last_msc_{};
+    uint32_t vblanks_per_frame_{1};
+    // once presentation feedback arrives, missed vblanks are counted from its msc instead of estimated
+    bool has_presentation_{};
+};
+
+#endif // SRC_WINDOW_FRAME_STATS_H_
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "gpu_timer.h"
+
+#include <cstring>
+
+#include "egl_dispatch.h"
+
+namespace {
+// TIME_ELAPSED queries cannot nest, only one frame per thread is timed at a time
+thread_local const GpuTimer *active_timer{};
+}
+
+/**
+ * @class GpuTimer
+ * @brief Measures the GPU time of frames with GL_EXT_disjoint_timer_query, without stalling.
+ *
+ * Each frame's commands are bracketed by a GL_TIME_ELAPSED_EXT query from a small
+ * ring; results are read once GL_QUERY_RESULT_AVAILABLE_EXT reports them, typically
+ * one or two frames later, so the CPU never waits for the GPU. If the ring is full
+ * the frame goes untimed instead. Results spanning a disjoint event are discarded.
+ * Every method needs the context the timer was first used with current; query
+ * objects are not shared between contexts.
+ */
+GpuTimer::~GpuTimer() {
+    if (owns_queries_) {
+        if (active_) {
+            gl_->end_query(GL_TIME_ELAPSED_EXT);
+            active_timer = nullptr;
+        }
+        gl_->delete_queries(static_cast<GLsizei>(queries_.size()), queries_.data());
+    }
+}
+
+/**
+ * @return true if the current context has GL_EXT_disjoint_timer_query.
+ */
+bool GpuTimer::is_supported() {
+    initialize();
+    return queries_[0] != 0;
+}
+
+/**
+ * @brief Starts timing the commands of a frame.
+ *
+ * @return false if nothing is timed, because the extension is missing, another frame
+ *         is being timed on this thread or all queries still wait for their results.
+ */
+bool GpuTimer::begin() {
+    if (active_ || active_timer || !is_supported()) {
+        return false;
+    }
+    collect();
+    if (pending_ == kQueryCount) {
+        return false;
+    }
+    gl_->begin_query(GL_TIME_ELAPSED_EXT, queries_[head_]);
+    active_ = true;
+    active_timer = this;
+    return true;
+}
+
+/**
+ * @brief Stops timing the frame started by begin(), call before the swap.
+ */
+void GpuTimer::end() {
+    if (!active_) {
+        return;
+    }
+    gl_->end_query(GL_TIME_ELAPSED_EXT);
+    active_ = false;
+    active_timer = nullptr;
+    head_ = (head_ + 1) % kQueryCount;
+    pending_++;
+}
+
+void GpuTimer::initialize() {
+    if (initialized_) {
+        return;
+    }
+    const auto &gl = EglDispatch::get_gles();
+    const auto extensions = gl.get_string ? reinterpret_cast<const char *>(gl.get_string(GL_EXTENSIONS)) : nullptr;
+    if (!extensions) {
+        // no context current yet, try again next time
+        return;
+    }
+    initialized_ = true;
+    if (!strstr(extensions, "GL_EXT_disjoint_timer_query")) {
+        return;
+    }
+
+    if (!gl.gen_queries || !gl.delete_queries || !gl.begin_query || !gl.end_query || !gl.get_query_objectuiv ||
+        !gl.get_query_objectui64v || !gl.get_integerv) {
+        return;
+    }
+
+    gl_ = &gl;
+    gl_->gen_queries(static_cast<GLsizei>(queries_.size()), queries_.data());
+    owns_queries_ = queries_[0] != 0;
+    // reading the flag clears it, so results of earlier work are not discarded by mistake
+    GLint disjoint = 0;
+    gl_->get_integerv(GL_GPU_DISJOINT_EXT, &disjoint);
+}
+
+/**
+ * @brief Reads the results that are available, oldest first, without waiting.
+ */
+void GpuTimer::collect() {
+    while (pending_ > 0) {
+        const auto query = queries_[(head_ + kQueryCount - pending_) % kQueryCount];
+        GLuint available = GL_FALSE;
+        gl_->get_query_objectuiv(query, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 elapsed = 0;
+        gl_->get_query_objectui64v(query, GL_QUERY_RESULT_EXT, &elapsed);
+        pending_--;
+
+        GLint disjoint = 0;
+        gl_->get_integerv(GL_GPU_DISJOINT_EXT, &disjoint);
+        if (disjoint) {
+            // any result in flight may span the event
+            disjoint_count_ += pending_ + 1;
+            pending_ = 0;
+            break;
+        }
+
+        last_time_ns_ = elapsed;
+        if (elapsed > time_ns_) {
+            time_ns_ = elapsed;
+        } else {
+            time_ns_ -= (time_ns_ - elapsed) / 8;
+        }
+    }
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_GPU_TIMER_H_
+#define SRC_WINDOW_GPU_TIMER_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "utils/export.h"
+
+struct EglDispatch;
+
+class WAYPP_EXPORT GpuTimer {
+public:
+    GpuTimer() = default;
+
+    ~GpuTimer();
+
+    GpuTimer(const GpuTimer &) = delete;
+
+    GpuTimer &operator=(const GpuTimer &) = delete;
+
+    [[nodiscard]] bool is_supported();
+
+    bool begin();
+
+    void end();
+
+    // forgets the queries without GL calls, for when their context is gone or cannot be made current
+    void abandon() { owns_queries_ = false; }
+
+    [[nodiscard]] bool is_active() const { return active_; }
+
+    // peak-tracking average and last measured GPU time of a frame, 0 until the first result
+    [[nodiscard]] uint64_t get_time_ns() const { return time_ns_; }
+
+    [[nodiscard]] uint64_t get_last_time_ns() const { return last_time_ns_; }
+
+    // frames whose results were dropped, e.g. after a GPU reset or a power state change
+    [[nodiscard]] uint64_t get_disjoint_count() const { return disjoint_count_; }
+
+private:
+    // results lag by up to the swap chain depth, one more lets the oldest query be read without waiting
+    static constexpr size_t kQueryCount = 4;
+
+    bool initialized_{};
+    // set once the context has the extension, see EglDispatch::get_gles()
+    const EglDispatch *gl_{};
+    bool owns_queries_{};
+
+    std::array<uint32_t, kQueryCount> queries_{};
+    // queries [head_ - pending_, head_) are ended and waiting for their results
+    size_t head_{};
+    size_t pending_{};
+    bool active_{};
+
+    uint64_t time_ns_{};
+    uint64_t last_time_ns_{};
+    uint64_t disjoint_count_{};
+
+    void initialize();
+
+    void collect();
+};
+
+#endif // SRC_WINDOW_GPU_TIMER_H_
@@ -0,0 +1,114 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "input_region.h"
+
+#include <utility>
+
+#include "region.h"
+
+/**
+ * @class InputRegion
+ * @brief The part of a surface that takes pointer and touch input, following its size.
+ *
+ * Outside the region the compositor sends input to whatever is below, so clicks on
+ * a transparent shadow or rounded corner never wake the client: no enter, motion,
+ * leave or button events reach Pointer for them. Rectangles may be anchored to the
+ * right and bottom edges, update() resolves them against the surface size and only
+ * sends a new region when the outcome changed. The region is double-buffered state,
+ * applied with the next commit.
+ *
+ * Without rectangles the whole surface takes input, the Wayland default.
+ *
+ * @param compositor The wl_compositor used to create regions.
+ * @param surface    The surface.
+ */
+InputRegion::InputRegion(struct wl_compositor *compositor, struct wl_surface *surface) :
+        wl_compositor_(compositor),
+        wl_surface_(surface) {
+}
+
+/**
+ * @brief Gives the whole surface back its input.
+ */
+InputRegion::~InputRegion() {
+    if (!rects_.empty()) {
+        wl_surface_set_input_region(wl_surface_, nullptr);
+    }
+}
+
+/**
+ * @brief Sets the rectangles of the region, sent by the next update().
+ *
+ * @param rects The rectangles, empty for the whole surface.
+ */
+void InputRegion::set_rects(const std::vector<Rect> &rects) {
+    rects_ = rects;
+    dirty_ = true;
+}
+
+/**
+ * @brief Resolves rects for a surface of width x height.
+ *
+ * @return The rectangles with a positive size, in the order given.
+ */
+std::vector<InputRegion::Rect> InputRegion::resolve(const std::vector<Rect> &rects, int width, int height) {
+    std::vector<Rect> resolved;
+    resolved.reserve(rects.size());
+    for (const auto &rect: rects) {
+        const Rect r{rect.x, rect.y,
+                     rect.width > 0 ? rect.width : width + rect.width - rect.x,
+                     rect.height > 0 ? rect.height : height + rect.height - rect.y};
+        if (r.width > 0 && r.height > 0) {
+            resolved.push_back(r);
+        }
+    }
+    return resolved;
+}
+
+/**
+ * @brief Resolves the rectangles for a surface of width x height and sends them if they changed.
+ *
+ * Cheap when nothing changed, so it can be called before every frame.
+ *
+ * @return true if a new region was set.
+ */
+bool InputRegion::update(int width, int height) {
+    if (width <= 0 || height <= 0) {
+        return false;
+    }
+    std::vector<Rect> resolved = resolve(rects_, width, height);
+    if (!dirty_ && resolved == applied_) {
+        return false;
+    }
+    dirty_ = false;
+    applied_ = std::move(resolved);
+
+    if (rects_.empty()) {
+        wl_surface_set_input_region(wl_surface_, nullptr);
+        return true;
+    }
+    // overlapping rectangles are sent as their union, an empty region means no input at all
+    Region region;
+    for (const auto &r: applied_) {
+        region.add(r.x, r.y, r.width, r.height);
+    }
+    auto wl_region = region.create_wl_region(wl_compositor_);
+    wl_surface_set_input_region(wl_surface_, wl_region);
+    wl_region_destroy(wl_region);
+    return true;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_INPUT_REGION_H_
+#define SRC_WINDOW_INPUT_REGION_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT InputRegion {
+public:
+    // width or height <= 0 reach to that far in from the surface's right or bottom edge
+    struct Rect {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+
+        bool operator==(const Rect &other) const {
+            return x == other.x && y == other.y && width == other.width && height == other.height;
+        }
+    };
+
+    explicit InputRegion(struct wl_compositor *compositor, struct wl_surface *surface);
+
+    ~InputRegion();
+
+    InputRegion(const InputRegion &) = delete;
+
+    InputRegion &operator=(const InputRegion &) = delete;
+
+    // the surface less a margin on each side, e.g. a drop shadow
+    static Rect inset(int32_t left, int32_t top, int32_t right, int32_t bottom) {
+        return {left, top, -right, -bottom};
+    }
+
+    void set_rects(const std::vector<Rect> &rects);
+
+    // rects with their edge anchored extents made absolute, empty ones dropped
+    static std::vector<Rect> resolve(const std::vector<Rect> &rects, int width, int height);
+
+    bool update(int width, int height);
+
+private:
+    struct wl_compositor *wl_compositor_;
+    struct wl_surface *wl_surface_;
+    std::vector<Rect> rects_;
+    // the rectangles last sent, resolved against the surface size
+    std::vector<Rect> applied_;
+    bool dirty_{};
+};
+
+#endif // SRC_WINDOW_INPUT_REGION_H_
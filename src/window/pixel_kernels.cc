@@ -0,0 +1,441 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "pixel_kernels.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+/**
+ * @brief x * y / 255, rounded, for 8-bit x and y.
+ */
+inline uint32_t mul_div255(uint32_t x, uint32_t y) {
+    uint32_t t = x * y + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+// row kernels, the SIMD variants finish their tails with these
+
+void fill_row_scalar(uint32_t *dst, int width, uint32_t color) {
+    for (int x = 0; x < width; x++) {
+        dst[x] = color;
+    }
+}
+
+void blend_row_scalar(uint32_t *dst, const uint32_t *src, int width) {
+    for (int x = 0; x < width; x++) {
+        const uint32_t s = src[x];
+        const uint32_t inv = 255 - (s >> 24);
+        if (inv == 0) {
+            dst[x] = s;
+            continue;
+        }
+        const uint32_t d = dst[x];
+        uint32_t result = 0;
+        for (int shift = 0; shift < 32; shift += 8) {
+            uint32_t c = ((s >> shift) & 0xff) + mul_div255((d >> shift) & 0xff, inv);
+            result |= (c > 255 ? 255 : c) << shift;
+        }
+        dst[x] = result;
+    }
+}
+
+void xrgb_to_argb_row_scalar(uint32_t *dst, const uint32_t *src, int width) {
+    for (int x = 0; x < width; x++) {
+        dst[x] = src[x] | 0xff000000u;
+    }
+}
+
+void rgb565_to_xrgb_row_scalar(uint32_t *dst, const uint16_t *src, int width) {
+    for (int x = 0; x < width; x++) {
+        const uint32_t p = src[x];
+        const uint32_t r = (p >> 11) & 0x1f;
+        const uint32_t g = (p >> 5) & 0x3f;
+        const uint32_t b = p & 0x1f;
+        dst[x] = 0xff000000u | (((r << 3) | (r >> 2)) << 16) | (((g << 2) | (g >> 4)) << 8) | ((b << 3) | (b >> 2));
+    }
+}
+
+void xrgb_to_rgb565_row_scalar(uint16_t *dst, const uint32_t *src, int width) {
+    for (int x = 0; x < width; x++) {
+        const uint32_t p = src[x];
+        dst[x] = static_cast<uint16_t>(((p >> 8) & 0xf800) | ((p >> 5) & 0x07e0) | ((p >> 3) & 0x001f));
+    }
+}
+
+#if defined(__SSE2__)
+
+void fill_row_sse2(uint32_t *dst, int width, uint32_t color) {
+    const __m128i c = _mm_set1_epi32(static_cast<int>(color));
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), c);
+    }
+    fill_row_scalar(dst + x, width - x, color);
+}
+
+/**
+ * @brief dst * (255 - src alpha) / 255 + src for four premultiplied pixels.
+ */
+inline __m128i blend4_sse2(__m128i s, __m128i d) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i c255 = _mm_set1_epi16(255);
+    const __m128i c128 = _mm_set1_epi16(128);
+    // alpha in both 16-bit halves of each pixel
+    __m128i a = _mm_srli_epi32(s, 24);
+    a = _mm_or_si128(a, _mm_slli_epi32(a, 16));
+    const __m128i inv_lo = _mm_sub_epi16(c255, _mm_unpacklo_epi32(a, a));
+    const __m128i inv_hi = _mm_sub_epi16(c255, _mm_unpackhi_epi32(a, a));
+
+    __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), inv_lo), c128);
+    __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), inv_hi), c128);
+    lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+    hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+    return _mm_adds_epu8(s, _mm_packus_epi16(lo, hi));
+}
+
+void blend_row_sse2(uint32_t *dst, const uint32_t *src, int width) {
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+        const __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i *>(dst + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), blend4_sse2(s, d));
+    }
+    blend_row_scalar(dst + x, src + x, width - x);
+}
+
+void xrgb_to_argb_row_sse2(uint32_t *dst, const uint32_t *src, int width) {
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000u));
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), _mm_or_si128(s, alpha));
+    }
+    xrgb_to_argb_row_scalar(dst + x, src + x, width - x);
+}
+
+void rgb565_to_xrgb_row_sse2(uint32_t *dst, const uint16_t *src, int width) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i mask5 = _mm_set1_epi32(0x1f);
+    const __m128i mask6 = _mm_set1_epi32(0x3f);
+    const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000u));
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m128i p16 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x));
+        for (int half = 0; half < 2; half++) {
+            const __m128i p = half ? _mm_unpackhi_epi16(p16, zero) : _mm_unpacklo_epi16(p16, zero);
+            const __m128i r = _mm_and_si128(_mm_srli_epi32(p, 11), mask5);
+            const __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), mask6);
+            const __m128i b = _mm_and_si128(p, mask5);
+            const __m128i r8 = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+            const __m128i g8 = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+            const __m128i b8 = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+            const __m128i out = _mm_or_si128(_mm_or_si128(alpha, _mm_slli_epi32(r8, 16)),
+                                             _mm_or_si128(_mm_slli_epi32(g8, 8), b8));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x + half * 4), out);
+        }
+    }
+    rgb565_to_xrgb_row_scalar(dst + x, src + x, width - x);
+}
+
+void xrgb_to_rgb565_row_sse2(uint16_t *dst, const uint32_t *src, int width) {
+    const __m128i mask_r = _mm_set1_epi32(0xf800);
+    const __m128i mask_g = _mm_set1_epi32(0x07e0);
+    const __m128i mask_b = _mm_set1_epi32(0x001f);
+    // _mm_packs_epi32 saturates signed, so pack values biased into the signed range
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16(static_cast<short>(0x8000));
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m128i out[2];
+        for (int half = 0; half < 2; half++) {
+            const __m128i p = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + x + half * 4));
+            const __m128i v = _mm_or_si128(_mm_or_si128(_mm_and_si128(_mm_srli_epi32(p, 8), mask_r),
+                                                        _mm_and_si128(_mm_srli_epi32(p, 5), mask_g)),
+                                           _mm_and_si128(_mm_srli_epi32(p, 3), mask_b));
+            out[half] = _mm_sub_epi32(v, bias32);
+        }
+        const __m128i packed = _mm_add_epi16(_mm_packs_epi32(out[0], out[1]), bias16);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + x), packed);
+    }
+    xrgb_to_rgb565_row_scalar(dst + x, src + x, width - x);
+}
+
+__attribute__((target("avx2")))
+void fill_row_avx2(uint32_t *dst, int width, uint32_t color) {
+    const __m256i c = _mm256_set1_epi32(static_cast<int>(color));
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x), c);
+    }
+    fill_row_sse2(dst + x, width - x, color);
+}
+
+__attribute__((target("avx2")))
+void blend_row_avx2(uint32_t *dst, const uint32_t *src, int width) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i c255 = _mm256_set1_epi16(255);
+    const __m256i c128 = _mm256_set1_epi16(128);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x));
+        const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(dst + x));
+        // the unpacks and the pack all work per 128-bit lane, so pixel order is kept
+        __m256i a = _mm256_srli_epi32(s, 24);
+        a = _mm256_or_si256(a, _mm256_slli_epi32(a, 16));
+        const __m256i inv_lo = _mm256_sub_epi16(c255, _mm256_unpacklo_epi32(a, a));
+        const __m256i inv_hi = _mm256_sub_epi16(c255, _mm256_unpackhi_epi32(a, a));
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), inv_lo), c128);
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), inv_hi), c128);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+        const __m256i out = _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x), out);
+    }
+    blend_row_sse2(dst + x, src + x, width - x);
+}
+
+__attribute__((target("avx2")))
+void xrgb_to_argb_row_avx2(uint32_t *dst, const uint32_t *src, int width) {
+    const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xff000000u));
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + x));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + x), _mm256_or_si256(s, alpha));
+    }
+    xrgb_to_argb_row_sse2(dst + x, src + x, width - x);
+}
+
+#endif // __SSE2__
+
+#if defined(__ARM_NEON)
+
+void fill_row_neon(uint32_t *dst, int width, uint32_t color) {
+    const uint32x4_t c = vdupq_n_u32(color);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        vst1q_u32(dst + x, c);
+        vst1q_u32(dst + x + 4, c);
+    }
+    fill_row_scalar(dst + x, width - x, color);
+}
+
+/**
+ * @brief x * y / 255 rounded, the same rounding as mul_div255().
+ */
+inline uint8x8_t mul_div255_neon(uint8x8_t x, uint8x8_t y) {
+    const uint16x8_t t = vmull_u8(x, y);
+    return vrshrn_n_u16(vrsraq_n_u16(t, t, 8), 8);
+}
+
+void blend_row_neon(uint32_t *dst, const uint32_t *src, int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        // deinterleaved: val[0] = b, val[1] = g, val[2] = r, val[3] = a
+        const uint8x8x4_t s = vld4_u8(reinterpret_cast<const uint8_t *>(src + x));
+        uint8x8x4_t d = vld4_u8(reinterpret_cast<const uint8_t *>(dst + x));
+        const uint8x8_t inv = vmvn_u8(s.val[3]);
+        for (int c = 0; c < 4; c++) {
+            d.val[c] = vqadd_u8(s.val[c], mul_div255_neon(d.val[c], inv));
+        }
+        vst4_u8(reinterpret_cast<uint8_t *>(dst + x), d);
+    }
+    blend_row_scalar(dst + x, src + x, width - x);
+}
+
+void xrgb_to_argb_row_neon(uint32_t *dst, const uint32_t *src, int width) {
+    const uint32x4_t alpha = vdupq_n_u32(0xff000000u);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+        vst1q_u32(dst + x, vorrq_u32(vld1q_u32(src + x), alpha));
+    }
+    xrgb_to_argb_row_scalar(dst + x, src + x, width - x);
+}
+
+void rgb565_to_xrgb_row_neon(uint32_t *dst, const uint16_t *src, int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const uint16x8_t p = vld1q_u16(src + x);
+        const uint16x8_t r = vshrq_n_u16(p, 11);
+        const uint16x8_t g = vandq_u16(vshrq_n_u16(p, 5), vdupq_n_u16(0x3f));
+        const uint16x8_t b = vandq_u16(p, vdupq_n_u16(0x1f));
+        uint8x8x4_t out;
+        out.val[0] = vmovn_u16(vorrq_u16(vshlq_n_u16(b, 3), vshrq_n_u16(b, 2)));
+        out.val[1] = vmovn_u16(vorrq_u16(vshlq_n_u16(g, 2), vshrq_n_u16(g, 4)));
+        out.val[2] = vmovn_u16(vorrq_u16(vshlq_n_u16(r, 3), vshrq_n_u16(r, 2)));
+        out.val[3] = vdup_n_u8(0xff);
+        vst4_u8(reinterpret_cast<uint8_t *>(dst + x), out);
+    }
+    rgb565_to_xrgb_row_scalar(dst + x, src + x, width - x);
+}
+
+void xrgb_to_rgb565_row_neon(uint16_t *dst, const uint32_t *src, int width) {
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+        const uint8x8x4_t p = vld4_u8(reinterpret_cast<const uint8_t *>(src + x));
+        const uint16x8_t r = vandq_u16(vshll_n_u8(p.val[2], 8), vdupq_n_u16(0xf800));
+        const uint16x8_t g = vandq_u16(vshrq_n_u16(vshll_n_u8(p.val[1], 8), 5), vdupq_n_u16(0x07e0));
+        const uint16x8_t b = vshrq_n_u16(vmovl_u8(p.val[0]), 3);
+        vst1q_u16(dst + x, vorrq_u16(vorrq_u16(r, g), b));
+    }
+    xrgb_to_rgb565_row_scalar(dst + x, src + x, width - x);
+}
+
+#endif // __ARM_NEON
+
+// rectangle drivers shared by every variant
+
+template<void (*Row)(uint32_t *, int, uint32_t)>
+void fill_rect(void *dst, int32_t dst_stride, int width, int height, uint32_t color) {
+    auto d = static_cast<uint8_t *>(dst);
+    for (int y = 0; y < height; y++, d += dst_stride) {
+        Row(reinterpret_cast<uint32_t *>(d), width, color);
+    }
+}
+
+template<typename D, typename S, void (*Row)(D *, const S *, int)>
+void convert_rect(void *dst, int32_t dst_stride, const void *src, int32_t src_stride, int width, int height) {
+    auto d = static_cast<uint8_t *>(dst);
+    auto s = static_cast<const uint8_t *>(src);
+    for (int y = 0; y < height; y++, d += dst_stride, s += src_stride) {
+        Row(reinterpret_cast<D *>(d), reinterpret_cast<const S *>(s), width);
+    }
+}
+
+// memcpy already is the best row copy on every target
+void copy_rect(void *dst, int32_t dst_stride, const void *src, int32_t src_stride, int width, int height,
+               int bytes_per_pixel) {
+    auto d = static_cast<uint8_t *>(dst);
+    auto s = static_cast<const uint8_t *>(src);
+    const auto row = static_cast<size_t>(width) * static_cast<size_t>(bytes_per_pixel);
+    for (int y = 0; y < height; y++, d += dst_stride, s += src_stride) {
+        memcpy(d, s, row);
+    }
+}
+
+const PixelKernels kScalarKernels = {
+        "scalar",
+        fill_rect<fill_row_scalar>,
+        copy_rect,
+        convert_rect<uint32_t, uint32_t, blend_row_scalar>,
+        convert_rect<uint32_t, uint32_t, xrgb_to_argb_row_scalar>,
+        convert_rect<uint32_t, uint16_t, rgb565_to_xrgb_row_scalar>,
+        convert_rect<uint16_t, uint32_t, xrgb_to_rgb565_row_scalar>,
+};
+
+#if defined(__SSE2__)
+const PixelKernels kSse2Kernels = {
+        "sse2",
+        fill_rect<fill_row_sse2>,
+        copy_rect,
+        convert_rect<uint32_t, uint32_t, blend_row_sse2>,
+        convert_rect<uint32_t, uint32_t, xrgb_to_argb_row_sse2>,
+        convert_rect<uint32_t, uint16_t, rgb565_to_xrgb_row_sse2>,
+        convert_rect<uint16_t, uint32_t, xrgb_to_rgb565_row_sse2>,
+};
+
+// the 565 conversions are shuffle bound, AVX2 gains nothing over SSE2 there
+const PixelKernels kAvx2Kernels = {
+        "avx2",
+        fill_rect<fill_row_avx2>,
+        copy_rect,
+        convert_rect<uint32_t, uint32_t, blend_row_avx2>,
+        convert_rect<uint32_t, uint32_t, xrgb_to_argb_row_avx2>,
+        convert_rect<uint32_t, uint16_t, rgb565_to_xrgb_row_sse2>,
+        convert_rect<uint16_t, uint32_t, xrgb_to_rgb565_row_sse2>,
+};
+#endif
+
+#if defined(__ARM_NEON)
+const PixelKernels kNeonKernels = {
+        "neon",
+        fill_rect<fill_row_neon>,
+        copy_rect,
+        convert_rect<uint32_t, uint32_t, blend_row_neon>,
+        convert_rect<uint32_t, uint32_t, xrgb_to_argb_row_neon>,
+        convert_rect<uint32_t, uint16_t, rgb565_to_xrgb_row_neon>,
+        convert_rect<uint16_t, uint32_t, xrgb_to_rgb565_row_neon>,
+};
+#endif
+
+const PixelKernels &select_pixel_kernels() {
+#if defined(__SSE2__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return kAvx2Kernels;
+    }
+    return kSse2Kernels;
+#elif defined(__ARM_NEON)
+    return kNeonKernels;
+#else
+    return kScalarKernels;
+#endif
+}
+
+}
+
+/**
+ * @brief Returns the fastest kernels the CPU supports.
+ *
+ * On x86 the choice between AVX2 and SSE2 is made at run time, once. NEON is part of
+ * the AArch64 baseline, and of 32-bit ARM builds compiled with -mfpu=neon.
+ */
+const PixelKernels &get_pixel_kernels() {
+    static const PixelKernels &kernels = select_pixel_kernels();
+    return kernels;
+}
+
+/**
+ * @brief Returns the portable reference kernels.
+ */
+const PixelKernels &get_scalar_pixel_kernels() {
+    return kScalarKernels;
+}
+
+/**
+ * @brief Returns a table by name, e.g. to compare each variant with the scalar one.
+ *
+ * @return The kernels, or nullptr if this build or CPU does not have them.
+ */
+const PixelKernels *find_pixel_kernels(const char *name) {
+    if (strcmp(name, kScalarKernels.name) == 0) {
+        return &kScalarKernels;
+    }
+#if defined(__SSE2__)
+    if (strcmp(name, kSse2Kernels.name) == 0) {
+        return &kSse2Kernels;
+    }
+    if (strcmp(name, kAvx2Kernels.name) == 0) {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") ? &kAvx2Kernels : nullptr;
+    }
+#endif
+#if defined(__ARM_NEON)
+    if (strcmp(name, kNeonKernels.name) == 0) {
+        return &kNeonKernels;
+    }
+#endif
+    return nullptr;
+}
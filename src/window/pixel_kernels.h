@@ -0,0 +1,64 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_PIXEL_KERNELS_H_
+#define SRC_WINDOW_PIXEL_KERNELS_H_
+
+#include <cstdint>
+
+#include "utils/export.h"
+
+/**
+ * @brief Pixel kernels for software rendering into mapped buffers, e.g. WindowShm::Buffer.
+ *
+ * Every kernel works on a rectangle given as a pointer to its first pixel, a stride in
+ * bytes and a size in pixels. 32-bit pixels are native-endian ARGB/XRGB words, which is
+ * the WL_SHM_FORMAT_ARGB8888/XRGB8888 memory layout on little-endian machines.
+ */
+struct PixelKernels {
+    // "avx2", "sse2", "neon" or "scalar"
+    const char *name;
+
+    // 32-bit solid fill
+    void (*fill)(void *dst, int32_t dst_stride, int width, int height, uint32_t color);
+
+    // copy of width * bytes_per_pixel bytes per row
+    void (*copy)(void *dst, int32_t dst_stride, const void *src, int32_t src_stride, int width, int height,
+                 int bytes_per_pixel);
+
+    // premultiplied ARGB8888 src over ARGB8888/XRGB8888 dst
+    void (*blend_over)(void *dst, int32_t dst_stride, const void *src, int32_t src_stride, int width, int height);
+
+    // XRGB8888 to ARGB8888 with an opaque alpha
+    void (*xrgb_to_argb)(void *dst, int32_t dst_stride, const void *src, int32_t src_stride, int width, int height);
+
+    // RGB565 to XRGB8888, low bits replicated so white stays white
+    void (*rgb565_to_xrgb)(void *dst, int32_t dst_stride, const void *src, int32_t src_stride, int width,
+                           int height);
+
+    // XRGB8888 to RGB565, truncating
+    void (*xrgb_to_rgb565)(void *dst, int32_t dst_stride, const void *src, int32_t src_stride, int width,
+                           int height);
+};
+
+WAYPP_EXPORT const PixelKernels &get_pixel_kernels();
+
+WAYPP_EXPORT const PixelKernels &get_scalar_pixel_kernels();
+
+WAYPP_EXPORT const PixelKernels *find_pixel_kernels(const char *name);
+
+#endif // SRC_WINDOW_PIXEL_KERNELS_H_
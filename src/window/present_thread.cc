@@ -0,0 +1,119 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "present_thread.h"
+
+#include "egl.h"
+#include "utils/trace.h"
+
+/**
+ * @class PresentThread
+ * @brief Swaps an EGL window's frames on a thread of its own, through a one-frame mailbox.
+ *
+ * Drawing into a back buffer first needs the driver to dequeue one, and with every
+ * buffer still held by the compositor that waits on the display, on the thread that
+ * also dispatches input. Here the thread drawing hands the finished frame over with
+ * present(): this thread makes the context current, swaps, and dequeues the next back
+ * buffer before releasing the context (see Egl::acquire_back_buffer()). present()
+ * returns once the swap has committed, so the frame loop's own commit always follows
+ * the buffer; a wait for a free buffer only holds this thread. Until it is done,
+ * is_busy() tells the drawing thread to skip the frame rather than block.
+ *
+ * The context moves between the two threads, so it must not be current on the drawing
+ * thread while a frame is handed over.
+ *
+ * @param egl        The window whose frames are swapped.
+ * @param attributes Priority and CPUs of the thread.
+ */
+PresentThread::PresentThread(Egl *egl, const ThreadAttributes &attributes) : egl_(egl) {
+    thread_ = std::thread([this, attributes]() {
+        if (!attributes.is_default()) {
+            (void) attributes.apply();
+        }
+        run();
+    });
+}
+
+/**
+ * @brief Finishes the frame in flight and stops the thread.
+ */
+PresentThread::~PresentThread() {
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return state_ == IDLE; });
+        running_ = false;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+/**
+ * @brief Hands a drawn frame over and waits until it is swapped.
+ *
+ * The previous frame must be done, see is_busy(), and the context released on the
+ * calling thread.
+ *
+ * @param damage The damage the frame was drawn with, empty for all of it.
+ * @return false if the swap failed.
+ */
+bool PresentThread::present(const std::vector<DamageRect> &damage) {
+    TRACE_SCOPE("PresentThread::present");
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return state_ == IDLE; });
+    damage_ = damage;
+    state_ = SUBMITTED;
+    cv_.notify_all();
+    cv_.wait(lock, [this]() { return state_ != SUBMITTED; });
+    return swapped_;
+}
+
+bool PresentThread::is_busy() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return state_ != IDLE;
+}
+
+/**
+ * @brief Blocks until the next back buffer is dequeued, e.g. before resizing the window.
+ */
+void PresentThread::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait(lock, [this]() { return state_ == IDLE; });
+}
+
+void PresentThread::run() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        cv_.wait(lock, [this]() { return state_ == SUBMITTED || !running_; });
+        if (!running_) {
+            return;
+        }
+        lock.unlock();
+        const bool swapped = egl_->make_current() && egl_->swap_buffers(damage_);
+        lock.lock();
+        swapped_ = swapped;
+        state_ = ACQUIRING;
+        cv_.notify_all();
+        lock.unlock();
+
+        egl_->acquire_back_buffer();
+        (void) egl_->clear_current();
+
+        lock.lock();
+        state_ = IDLE;
+        cv_.notify_all();
+    }
+}
@@ -0,0 +1,72 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_PRESENT_THREAD_H_
+#define SRC_WINDOW_PRESENT_THREAD_H_
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "damage_tracker.h"
+#include "utils/thread_attributes.h"
+#include "utils/export.h"
+
+class Egl;
+
+class WAYPP_EXPORT PresentThread {
+public:
+    explicit PresentThread(Egl *egl, const ThreadAttributes &attributes = {});
+
+    ~PresentThread();
+
+    PresentThread(const PresentThread &) = delete;
+
+    PresentThread &operator=(const PresentThread &) = delete;
+
+    bool present(const std::vector<DamageRect> &damage);
+
+    // the last frame is still being swapped, or its successor's buffer dequeued
+    [[nodiscard]] bool is_busy() const;
+
+    void wait_idle();
+
+private:
+    typedef enum {
+        IDLE,
+        // a frame is in the mailbox
+        SUBMITTED,
+        // swapped, the next back buffer is being dequeued
+        ACQUIRING,
+    } State;
+
+    Egl *egl_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    State state_{IDLE};
+    std::vector<DamageRect> damage_;
+    bool swapped_{};
+    bool running_{true};
+
+    std::thread thread_;
+
+    void run();
+};
+
+#endif // SRC_WINDOW_PRESENT_THREAD_H_
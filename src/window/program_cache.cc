@@ -0,0 +1,243 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "program_cache.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "egl_dispatch.h"
+#include "utils/logging.h"
+
+namespace {
+constexpr uint32_t kFileMagic = 0x57505042; // "WPPB"
+
+/**
+ * @brief FNV-1a 64-bit hash, continued from hash.
+ */
+uint64_t hash_bytes(std::string_view bytes, uint64_t hash = 14695981039346656037ull) {
+    for (const auto c: bytes) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Creates path and its missing parents.
+ */
+bool make_directories(const std::string &path) {
+    for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+        const auto dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+            return false;
+        }
+        if (pos == std::string::npos) {
+            return true;
+        }
+    }
+}
+}
+
+/**
+ * @class ProgramCache
+ * @brief Keeps linked GL program binaries on disk, so shaders are compiled once per driver.
+ *
+ * Compiling and linking is often the largest part of the time to first frame, hundreds
+ * of milliseconds on some mobile drivers. With GL_OES_get_program_binary, or ES 3.0, a
+ * linked program's binary is stored under a key made of the driver's vendor, renderer
+ * and version strings plus the shader sources, so a driver update or a source change
+ * simply misses. Every method needs a GL context current.
+ *
+ * @code
+ * auto program = glCreateProgram();
+ * if (!cache.load(program, vs, fs)) {
+ *     // compile, attach and link as usual
+ *     cache.store(program, vs, fs);
+ * }
+ * @endcode
+ *
+ * @param directory Where the binaries are kept, created on the first store.
+ */
+ProgramCache::ProgramCache(std::string directory) : directory_(std::move(directory)) {
+}
+
+/**
+ * @return $XDG_CACHE_HOME/waypp/programs, or ~/.cache/waypp/programs.
+ */
+std::string ProgramCache::default_directory() {
+    if (const auto cache_home = getenv("XDG_CACHE_HOME"); cache_home && *cache_home) {
+        return std::string(cache_home) + "/waypp/programs";
+    }
+    if (const auto home = getenv("HOME"); home && *home) {
+        return std::string(home) + "/.cache/waypp/programs";
+    }
+    return "/tmp/waypp/programs";
+}
+
+/**
+ * @return true if the current context can save and load program binaries.
+ */
+bool ProgramCache::is_supported() {
+    initialize();
+    return get_program_binary_ && program_binary_ && get_programiv_ && !directory_.empty();
+}
+
+/**
+ * @brief Links program from a cached binary.
+ *
+ * @param program         A program object without shaders attached.
+ * @param vertex_source   The vertex shader source, part of the key.
+ * @param fragment_source The fragment shader source, part of the key.
+ * @return true if program is linked; false on a miss, or if the driver rejected the
+ *         binary, in which case the entry is removed and program must be built from source.
+ */
+bool ProgramCache::load(uint32_t program, std::string_view vertex_source, std::string_view fragment_source) {
+    if (!is_supported()) {
+        return false;
+    }
+    const auto path = path_for(vertex_source, fragment_source);
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return false;
+    }
+    uint32_t header[2]{};
+    file.read(reinterpret_cast<char *>(header), sizeof(header));
+    std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!file.eof() || header[0] != kFileMagic || binary.empty()) {
+        unlink(path.c_str());
+        return false;
+    }
+
+    program_binary_(program, header[1], binary.data(), static_cast<int32_t>(binary.size()));
+    int32_t linked = GL_FALSE;
+    get_programiv_(program, GL_LINK_STATUS, &linked);
+    if (linked != GL_TRUE) {
+        // the driver may reject binaries of an older build with the same version string
+        unlink(path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Saves the binary of a linked program.
+ *
+ * The file is written next to its final name and renamed, so a concurrent or
+ * interrupted writer never leaves a truncated entry.
+ *
+ * @param program         A linked program.
+ * @param vertex_source   The vertex shader source it was built from.
+ * @param fragment_source The fragment shader source it was built from.
+ * @return false if the binary could not be retrieved or written.
+ */
+bool ProgramCache::store(uint32_t program, std::string_view vertex_source, std::string_view fragment_source) {
+    if (!is_supported()) {
+        return false;
+    }
+    int32_t length = 0;
+    get_programiv_(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0) {
+        return false;
+    }
+    std::vector<char> binary(static_cast<size_t>(length));
+    uint32_t format = 0;
+    get_program_binary_(program, length, &length, &format, binary.data());
+    if (length <= 0) {
+        return false;
+    }
+
+    if (!make_directories(directory_)) {
+        LOG_WARN("Cannot create program cache %s: %s", directory_.c_str(), strerror(errno));
+        return false;
+    }
+    const auto path = path_for(vertex_source, fragment_source);
+    const auto temp = path + "." + std::to_string(getpid());
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        const uint32_t header[2] = {kFileMagic, format};
+        file.write(reinterpret_cast<const char *>(header), sizeof(header));
+        file.write(binary.data(), length);
+        if (!file) {
+            unlink(temp.c_str());
+            return false;
+        }
+    }
+    return rename(temp.c_str(), path.c_str()) == 0;
+}
+
+void ProgramCache::initialize() {
+    if (initialized_) {
+        return;
+    }
+    const auto &gl = EglDispatch::get_gles();
+    const auto get_string = gl.get_string;
+    if (!get_string || !get_string(GL_VERSION)) {
+        // no context current yet, try again next time
+        return;
+    }
+    initialized_ = true;
+
+    for (const auto name: {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+        const auto value = reinterpret_cast<const char *>(get_string(name));
+        driver_ += value ? value : "";
+        driver_ += '\n';
+    }
+
+    const auto extensions = reinterpret_cast<const char *>(get_string(GL_EXTENSIONS));
+    const bool oes = extensions && strstr(extensions, "GL_OES_get_program_binary");
+    const bool es3 = strstr(driver_.c_str(), "OpenGL ES 3") != nullptr;
+    if (oes) {
+        get_program_binary_ = gl.get_program_binary_oes;
+        program_binary_ = gl.program_binary_oes;
+    } else if (es3) {
+        get_program_binary_ = gl.get_program_binary;
+        program_binary_ = gl.program_binary;
+    }
+    get_programiv_ = gl.get_programiv;
+
+    // drivers may expose the entry points without a single binary format
+    const auto get_integerv = gl.get_integerv;
+    GLint formats = 0;
+    if (get_integerv) {
+        get_integerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &formats);
+    }
+    if (formats <= 0) {
+        get_program_binary_ = nullptr;
+        program_binary_ = nullptr;
+    }
+}
+
+/**
+ * @return The cache file for the sources on the current driver.
+ */
+std::string ProgramCache::path_for(std::string_view vertex_source, std::string_view fragment_source) const {
+    auto hash = hash_bytes(driver_);
+    hash = hash_bytes(vertex_source, hash);
+    // separate the sources, so moving text from one shader to the other changes the key
+    hash = hash_bytes(std::string_view("\0", 1), hash);
+    hash = hash_bytes(fragment_source, hash);
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(hash));
+    return directory_ + "/" + name + ".bin";
+}
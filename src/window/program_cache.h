@@ -0,0 +1,67 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_PROGRAM_CACHE_H_
+#define SRC_WINDOW_PROGRAM_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT ProgramCache {
+public:
+    explicit ProgramCache(std::string directory = default_directory());
+
+    ProgramCache(const ProgramCache &) = delete;
+
+    ProgramCache &operator=(const ProgramCache &) = delete;
+
+    [[nodiscard]] bool is_supported();
+
+    [[nodiscard]] bool load(uint32_t program, std::string_view vertex_source, std::string_view fragment_source);
+
+    bool store(uint32_t program, std::string_view vertex_source, std::string_view fragment_source);
+
+    [[nodiscard]] const std::string &get_directory() const { return directory_; }
+
+    static std::string default_directory();
+
+private:
+    typedef void (*GetProgramBinary)(uint32_t program, int32_t buf_size, int32_t *length, uint32_t *format,
+                                     void *binary);
+
+    typedef void (*ProgramBinary)(uint32_t program, uint32_t format, const void *binary, int32_t length);
+
+    typedef void (*GetProgramiv)(uint32_t program, uint32_t pname, int32_t *params);
+
+    std::string directory_;
+
+    // resolved with the first context current, the driver identity is part of every key
+    bool initialized_{};
+    std::string driver_;
+    GetProgramBinary get_program_binary_{};
+    ProgramBinary program_binary_{};
+    GetProgramiv get_programiv_{};
+
+    void initialize();
+
+    [[nodiscard]] std::string path_for(std::string_view vertex_source, std::string_view fragment_source) const;
+};
+
+#endif // SRC_WINDOW_PROGRAM_CACHE_H_
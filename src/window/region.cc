@@ -0,0 +1,459 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "region.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @class Region
+ * @brief A set of pixels kept as y-x banded boxes, for damage, opaque and input regions.
+ *
+ * The boxes are sorted top to bottom into bands of equal y1 and y2, and left to right
+ * within a band, with no two boxes of a band touching; vertically adjacent bands with
+ * the same spans are merged. Every set of pixels thus has exactly one representation,
+ * the same rules pixman follows, so == compares contents, unions of overlapping damage
+ * never repaint a pixel twice, and the operations are a single sweep over both
+ * operands' bands. Up to kInlineBoxes boxes are stored in the object itself, so the
+ * typical few-rectangle damage of a frame costs no allocation.
+ */
+
+/**
+ * @brief A width x height rectangle at x, y; empty unless both are positive.
+ */
+Region::Region(int32_t x, int32_t y, int32_t width, int32_t height) {
+    if (width > 0 && height > 0) {
+        boxes_.push_back({x, y, x + width, y + height});
+        extents_ = boxes_[0];
+    }
+}
+
+/**
+ * @brief The union of rects, which may overlap.
+ */
+Region::Region(const std::vector<DamageRect> &rects) {
+    for (const auto &rect: rects) {
+        add(rect.x, rect.y, rect.width, rect.height);
+    }
+}
+
+/**
+ * @brief Adds a width x height rectangle at x, y to the region.
+ */
+Region &Region::add(int32_t x, int32_t y, int32_t width, int32_t height) {
+    return unite(Region(x, y, width, height));
+}
+
+/**
+ * @brief Adds the pixels of other to the region.
+ */
+Region &Region::unite(const Region &other) {
+    if (other.empty() || this == &other) {
+        return *this;
+    }
+    const auto &a = extents_;
+    const auto &b = other.extents_;
+    if (empty() || (other.get_box_count() == 1 && b.x1 <= a.x1 && b.y1 <= a.y1 && b.x2 >= a.x2 && b.y2 >= a.y2)) {
+        *this = other;
+        return *this;
+    }
+    if (get_box_count() == 1 && a.x1 <= b.x1 && a.y1 <= b.y1 && a.x2 >= b.x2 && a.y2 >= b.y2) {
+        return *this;
+    }
+    combine(other, OP_UNION);
+    return *this;
+}
+
+/**
+ * @brief Keeps only the pixels also in other.
+ */
+Region &Region::intersect(const Region &other) {
+    if (this == &other) {
+        return *this;
+    }
+    const auto &a = extents_;
+    const auto &b = other.extents_;
+    if (empty() || other.empty() || a.x2 <= b.x1 || b.x2 <= a.x1 || a.y2 <= b.y1 || b.y2 <= a.y1) {
+        clear();
+        return *this;
+    }
+    if (other.get_box_count() == 1 && b.x1 <= a.x1 && b.y1 <= a.y1 && b.x2 >= a.x2 && b.y2 >= a.y2) {
+        return *this;
+    }
+    combine(other, OP_INTERSECT);
+    return *this;
+}
+
+/**
+ * @brief Removes the pixels of other from the region.
+ */
+Region &Region::subtract(const Region &other) {
+    if (this == &other) {
+        clear();
+        return *this;
+    }
+    const auto &a = extents_;
+    const auto &b = other.extents_;
+    if (empty() || other.empty() || a.x2 <= b.x1 || b.x2 <= a.x1 || a.y2 <= b.y1 || b.y2 <= a.y1) {
+        return *this;
+    }
+    combine(other, OP_SUBTRACT);
+    return *this;
+}
+
+/**
+ * @brief Moves the region by dx, dy.
+ */
+Region &Region::translate(int32_t dx, int32_t dy) {
+    for (size_t i = 0; i < boxes_.size(); i++) {
+        auto &box = boxes_[i];
+        box = {box.x1 + dx, box.y1 + dy, box.x2 + dx, box.y2 + dy};
+    }
+    if (!empty()) {
+        extents_ = {extents_.x1 + dx, extents_.y1 + dy, extents_.x2 + dx, extents_.y2 + dy};
+    }
+    return *this;
+}
+
+/**
+ * @brief Scales the region about the origin, e.g. from surface to buffer coordinates.
+ *
+ * An integer factor keeps the bands as they are. A fractional one rounds each box
+ * outwards, so neighbouring boxes may now overlap and the result is rebuilt as their
+ * union.
+ *
+ * @param factor The scale, a region scaled by 0 or less is empty.
+ */
+Region &Region::scale(double factor) {
+    if (factor == 1.0 || empty()) {
+        return *this;
+    }
+    if (factor <= 0.0) {
+        clear();
+        return *this;
+    }
+    if (factor == std::floor(factor)) {
+        const auto n = static_cast<int32_t>(factor);
+        for (size_t i = 0; i < boxes_.size(); i++) {
+            auto &box = boxes_[i];
+            box = {box.x1 * n, box.y1 * n, box.x2 * n, box.y2 * n};
+        }
+        extents_ = {extents_.x1 * n, extents_.y1 * n, extents_.x2 * n, extents_.y2 * n};
+        return *this;
+    }
+    Region scaled;
+    for (const auto &box: *this) {
+        const auto x1 = static_cast<int32_t>(std::floor(box.x1 * factor));
+        const auto y1 = static_cast<int32_t>(std::floor(box.y1 * factor));
+        const auto x2 = static_cast<int32_t>(std::ceil(box.x2 * factor));
+        const auto y2 = static_cast<int32_t>(std::ceil(box.y2 * factor));
+        scaled.add(x1, y1, x2 - x1, y2 - y1);
+    }
+    *this = std::move(scaled);
+    return *this;
+}
+
+/**
+ * @brief Empties the region, and hands back any heap storage.
+ */
+void Region::clear() {
+    boxes_.clear();
+    extents_ = {};
+}
+
+/**
+ * @brief Whether the pixel at x, y is in the region.
+ */
+bool Region::contains(int32_t x, int32_t y) const {
+    if (empty() || x < extents_.x1 || x >= extents_.x2 || y < extents_.y1 || y >= extents_.y2) {
+        return false;
+    }
+    for (const auto &box: *this) {
+        if (box.y1 > y) {
+            break;
+        }
+        if (y < box.y2 && x >= box.x1 && x < box.x2) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Compares the pixels of both regions, which have one representation each.
+ */
+bool Region::operator==(const Region &other) const {
+    return get_box_count() == other.get_box_count() && std::equal(begin(), end(), other.begin());
+}
+
+/**
+ * @brief The boxes as x, y, width, height rectangles with a top-left origin.
+ */
+std::vector<DamageRect> Region::get_rects() const {
+    std::vector<DamageRect> rects;
+    rects.reserve(get_box_count());
+    for (const auto &box: *this) {
+        rects.push_back({box.x1, box.y1, box.x2 - box.x1, box.y2 - box.y1});
+    }
+    return rects;
+}
+
+/**
+ * @brief The boxes flipped to the bottom-left origin EGL damage takes.
+ *
+ * @param height The height of the surface.
+ * @return Four values per box, to pass with get_box_count() rectangles.
+ */
+std::vector<int32_t> Region::get_egl_rects(int32_t height) const {
+    std::vector<int32_t> rects;
+    rects.reserve(get_box_count() * 4);
+    for (const auto &box: *this) {
+        rects.push_back(box.x1);
+        rects.push_back(height - box.y2);
+        rects.push_back(box.x2 - box.x1);
+        rects.push_back(box.y2 - box.y1);
+    }
+    return rects;
+}
+
+/**
+ * @brief Adds the boxes to region, e.g. for wl_surface.set_opaque_region or set_input_region.
+ */
+void Region::add_to(struct wl_region *region) const {
+    for (const auto &box: *this) {
+        wl_region_add(region, box.x1, box.y1, box.x2 - box.x1, box.y2 - box.y1);
+    }
+}
+
+/**
+ * @brief Creates a wl_region holding the region, which the caller destroys.
+ */
+struct wl_region *Region::create_wl_region(struct wl_compositor *compositor) const {
+    auto region = wl_compositor_create_region(compositor);
+    add_to(region);
+    return region;
+}
+
+/**
+ * @brief Replaces the region by its union, intersection or difference with other.
+ *
+ * Sweeps both operands top to bottom. A y range covered by only one of them is copied
+ * if the operation keeps it; a range both cover is split into the bands' spans by op.
+ * Each band written is merged into the one above when they touch with equal spans.
+ */
+void Region::combine(const Region &other, Op op) {
+    Boxes out;
+    // union and subtract keep what only this region covers, only union what only other does
+    const bool keep_a = op != OP_INTERSECT;
+    const bool keep_b = op == OP_UNION;
+    size_t previous_band = 0;
+    bool has_previous = false;
+
+    auto band_end = [](const Box *box, const Box *last) {
+        const auto y1 = box->y1;
+        while (box != last && box->y1 == y1) {
+            box++;
+        }
+        return box;
+    };
+
+    auto end_band = [&](size_t start) {
+        const size_t count = out.size() - start;
+        if (count == 0) {
+            return;
+        }
+        if (has_previous && start - previous_band == count && out[previous_band].y2 == out[start].y1) {
+            bool same = true;
+            for (size_t i = 0; i < count && same; i++) {
+                same = out[previous_band + i].x1 == out[start + i].x1 && out[previous_band + i].x2 == out[start + i].x2;
+            }
+            if (same) {
+                const auto y2 = out[start].y2;
+                for (size_t i = 0; i < count; i++) {
+                    out[previous_band + i].y2 = y2;
+                }
+                out.resize(start);
+                return;
+            }
+        }
+        previous_band = start;
+        has_previous = true;
+    };
+
+    auto copy_band = [&](const Box *box, const Box *last, int32_t y1, int32_t y2) {
+        const size_t start = out.size();
+        for (; box != last; box++) {
+            out.push_back({box->x1, y1, box->x2, y2});
+        }
+        end_band(start);
+    };
+
+    auto overlap_band = [&](const Box *a, const Box *a_last, const Box *b, const Box *b_last, int32_t y1, int32_t y2) {
+        const size_t start = out.size();
+        auto push = [&](int32_t x1, int32_t x2) {
+            if (op == OP_UNION && out.size() > start && out[out.size() - 1].x2 >= x1) {
+                auto &last = out[out.size() - 1];
+                last.x2 = std::max(last.x2, x2);
+            } else {
+                out.push_back({x1, y1, x2, y2});
+            }
+        };
+        switch (op) {
+            case OP_UNION:
+                while (a != a_last || b != b_last) {
+                    if (b == b_last || (a != a_last && a->x1 < b->x1)) {
+                        push(a->x1, a->x2);
+                        a++;
+                    } else {
+                        push(b->x1, b->x2);
+                        b++;
+                    }
+                }
+                break;
+            case OP_INTERSECT:
+                while (a != a_last && b != b_last) {
+                    const auto x1 = std::max(a->x1, b->x1);
+                    const auto x2 = std::min(a->x2, b->x2);
+                    if (x1 < x2) {
+                        push(x1, x2);
+                    }
+                    if (a->x2 <= b->x2) {
+                        a++;
+                    }
+                    if (x2 == b->x2) {
+                        b++;
+                    }
+                }
+                break;
+            case OP_SUBTRACT: {
+                auto x1 = a->x1;
+                while (a != a_last) {
+                    if (b == b_last || b->x1 >= a->x2) {
+                        // nothing more to take out of this box
+                        if (x1 < a->x2) {
+                            push(x1, a->x2);
+                        }
+                        if (++a != a_last) {
+                            x1 = a->x1;
+                        }
+                    } else if (b->x2 <= x1) {
+                        b++;
+                    } else {
+                        if (b->x1 > x1) {
+                            push(x1, b->x1);
+                        }
+                        if (b->x2 >= a->x2) {
+                            if (++a != a_last) {
+                                x1 = a->x1;
+                            }
+                        } else {
+                            x1 = b->x2;
+                            b++;
+                        }
+                    }
+                }
+                break;
+            }
+        }
+        end_band(start);
+    };
+
+    const Box *a = begin();
+    const Box *b = other.begin();
+    // the bottom of the last range swept, where partly consumed bands resume
+    int32_t y_bottom = std::min(a->y1, b->y1);
+    while (a != end() && b != other.end()) {
+        const auto a_last = band_end(a, end());
+        const auto b_last = band_end(b, other.end());
+        int32_t y_top;
+        if (a->y1 < b->y1) {
+            const auto top = std::max(a->y1, y_bottom);
+            const auto bottom = std::min(a->y2, b->y1);
+            if (keep_a && top < bottom) {
+                copy_band(a, a_last, top, bottom);
+            }
+            y_top = b->y1;
+        } else if (b->y1 < a->y1) {
+            const auto top = std::max(b->y1, y_bottom);
+            const auto bottom = std::min(b->y2, a->y1);
+            if (keep_b && top < bottom) {
+                copy_band(b, b_last, top, bottom);
+            }
+            y_top = a->y1;
+        } else {
+            y_top = a->y1;
+        }
+        y_bottom = std::min(a->y2, b->y2);
+        if (y_bottom > y_top) {
+            overlap_band(a, a_last, b, b_last, y_top, y_bottom);
+        }
+        if (a->y2 == y_bottom) {
+            a = a_last;
+        }
+        if (b->y2 == y_bottom) {
+            b = b_last;
+        }
+    }
+    if (keep_a) {
+        while (a != end()) {
+            const auto a_last = band_end(a, end());
+            copy_band(a, a_last, std::max(a->y1, y_bottom), a->y2);
+            a = a_last;
+        }
+    }
+    if (keep_b) {
+        while (b != other.end()) {
+            const auto b_last = band_end(b, other.end());
+            copy_band(b, b_last, std::max(b->y1, y_bottom), b->y2);
+            b = b_last;
+        }
+    }
+    boxes_ = std::move(out);
+    update_extents();
+}
+
+void Region::update_extents() {
+    if (empty()) {
+        extents_ = {};
+        return;
+    }
+    extents_ = {boxes_[0].x1, boxes_[0].y1, boxes_[0].x2, boxes_[boxes_.size() - 1].y2};
+    for (const auto &box: *this) {
+        extents_.x1 = std::min(extents_.x1, box.x1);
+        extents_.x2 = std::max(extents_.x2, box.x2);
+    }
+}
+
+void Region::Boxes::push_back(const Box &box) {
+    if (heap_.empty()) {
+        if (size_ < kInlineBoxes) {
+            inline_[size_++] = box;
+            return;
+        }
+        heap_.reserve(kInlineBoxes * 2);
+        heap_.assign(inline_.begin(), inline_.end());
+    }
+    heap_.push_back(box);
+    size_++;
+}
+
+void Region::Boxes::resize(size_t size) {
+    if (!heap_.empty()) {
+        heap_.resize(size);
+    }
+    size_ = size;
+}
@@ -0,0 +1,139 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_REGION_H_
+#define SRC_WINDOW_REGION_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "damage_tracker.h"
+#include "utils/export.h"
+
+class WAYPP_EXPORT Region {
+public:
+    // half-open [x1, x2) x [y1, y2)
+    struct Box {
+        int32_t x1;
+        int32_t y1;
+        int32_t x2;
+        int32_t y2;
+
+        bool operator==(const Box &other) const {
+            return x1 == other.x1 && y1 == other.y1 && x2 == other.x2 && y2 == other.y2;
+        }
+    };
+
+    // regions of up to this many boxes never touch the heap
+    static constexpr size_t kInlineBoxes = 8;
+
+    Region() = default;
+
+    Region(int32_t x, int32_t y, int32_t width, int32_t height);
+
+    explicit Region(const DamageRect &rect) : Region(rect.x, rect.y, rect.width, rect.height) {}
+
+    explicit Region(const std::vector<DamageRect> &rects);
+
+    Region &add(int32_t x, int32_t y, int32_t width, int32_t height);
+
+    Region &unite(const Region &other);
+
+    Region &intersect(const Region &other);
+
+    Region &subtract(const Region &other);
+
+    Region &translate(int32_t dx, int32_t dy);
+
+    // rounds outwards, a scaled region covers at least every pixel it did
+    Region &scale(double factor);
+
+    void clear();
+
+    [[nodiscard]] bool empty() const { return boxes_.size() == 0; }
+
+    [[nodiscard]] size_t get_box_count() const { return boxes_.size(); }
+
+    [[nodiscard]] const Box *begin() const { return boxes_.data(); }
+
+    [[nodiscard]] const Box *end() const { return boxes_.data() + boxes_.size(); }
+
+    // all zero for an empty region
+    [[nodiscard]] const Box &get_extents() const { return extents_; }
+
+    [[nodiscard]] bool contains(int32_t x, int32_t y) const;
+
+    bool operator==(const Region &other) const;
+
+    bool operator!=(const Region &other) const { return !(*this == other); }
+
+    [[nodiscard]] std::vector<DamageRect> get_rects() const;
+
+    // x, y, width, height quadruples with a bottom-left origin, for eglSwapBuffersWithDamage and friends
+    [[nodiscard]] std::vector<int32_t> get_egl_rects(int32_t height) const;
+
+    void add_to(struct wl_region *region) const;
+
+    [[nodiscard]] struct wl_region *create_wl_region(struct wl_compositor *compositor) const;
+
+private:
+    // inline storage, spilling to the heap past kInlineBoxes
+    class Boxes {
+    public:
+        [[nodiscard]] size_t size() const { return size_; }
+
+        [[nodiscard]] Box *data() { return heap_.empty() ? inline_.data() : heap_.data(); }
+
+        [[nodiscard]] const Box *data() const { return heap_.empty() ? inline_.data() : heap_.data(); }
+
+        Box &operator[](size_t index) { return data()[index]; }
+
+        const Box &operator[](size_t index) const { return data()[index]; }
+
+        void push_back(const Box &box);
+
+        void resize(size_t size);
+
+        void clear() {
+            heap_.clear();
+            size_ = 0;
+        }
+
+    private:
+        std::array<Box, kInlineBoxes> inline_{};
+        std::vector<Box> heap_;
+        size_t size_{};
+    };
+
+    typedef enum {
+        OP_UNION,
+        OP_INTERSECT,
+        OP_SUBTRACT,
+    } Op;
+
+    Boxes boxes_;
+    Box extents_{};
+
+    void combine(const Region &other, Op op);
+
+    void update_extents();
+};
+
+#endif // SRC_WINDOW_REGION_H_
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "render_pool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "utils/logging.h"
+#include "window_manager/display.h"
+
+/**
+ * @class RenderPool
+ * @brief Worker threads drawing windows in parallel, each on an event queue of its own.
+ *
+ * A window added to the pool has its frame and presentation events moved to one
+ * worker's queue, so its draws run on that worker and windows on different
+ * workers, e.g. one per output, never wait on each other. New windows go to the
+ * worker with the fewest windows.
+ *
+ * Frame callbacks are bound to the queue they were requested on, so a frame cannot
+ * move to an idle worker once requested; the pool balances windows between workers
+ * instead of stealing individual frames.
+ *
+ * EGL windows drawn by the pool need a context of their own, see
+ * WindowEglConfig::own_context, as a context is current on only one thread.
+ *
+ * @param display The Wayland display the windows belong to.
+ * @param threads    The number of workers.
+ * @param attributes Priority and CPUs of the workers, e.g. SCHED_FIFO on the cores not taken by services.
+ */
+RenderPool::RenderPool(struct wl_display *display, size_t threads, const ThreadAttributes &attributes) :
+        wl_display_(display) {
+    if (threads == 0) {
+        threads = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+    for (size_t i = 0; i < threads; i++) {
+        auto worker = std::make_unique<Worker>();
+        worker->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (worker->wake_fd < 0) {
+            throw std::runtime_error(std::string("eventfd: ") + strerror(errno));
+        }
+        worker->queue = wl_display_create_queue(wl_display_);
+        workers_.emplace_back(std::move(worker));
+    }
+    for (const auto &worker: workers_) {
+        worker->thread = std::thread([this, worker = worker.get(), attributes]() {
+            if (!attributes.is_default()) {
+                (void) attributes.apply();
+            }
+            run(*worker);
+        });
+    }
+}
+
+/**
+ * @brief Stops the workers. Windows still in the pool must not draw afterwards.
+ */
+RenderPool::~RenderPool() {
+    running_ = false;
+    for (const auto &worker: workers_) {
+        wake(*worker);
+    }
+    for (const auto &worker: workers_) {
+        worker->thread.join();
+        wl_event_queue_destroy(worker->queue);
+        close(worker->wake_fd);
+    }
+}
+
+/**
+ * @brief Hands window to the least loaded worker, which draws its frames from now on.
+ *
+ * Call before the window's first frame is drawn elsewhere, and not for windows that
+ * already have an event queue.
+ */
+void RenderPool::add(Window *window) {
+    auto worker = std::min_element(workers_.begin(), workers_.end(), [](const auto &a, const auto &b) {
+        return a->windows.size() < b->windows.size();
+    })->get();
+    {
+        const std::lock_guard lock(worker->mutex);
+        window->set_event_queue(wl_display_, worker->queue);
+        worker->windows.push_back(window);
+    }
+    wake(*worker);
+}
+
+/**
+ * @brief Takes window out of the pool, waiting for a draw in progress; call before destroying it.
+ */
+void RenderPool::remove(Window *window) {
+    for (const auto &worker: workers_) {
+        const std::lock_guard lock(worker->mutex);
+        auto &windows = worker->windows;
+        windows.erase(std::remove(windows.begin(), windows.end(), window), windows.end());
+    }
+}
+
+void RenderPool::wake(const Worker &worker) {
+    const uint64_t one = 1;
+    (void) write(worker.wake_fd, &one, sizeof(one));
+}
+
+/**
+ * @brief A worker's loop, Display::poll_dispatch() over its queue and its windows' frame scheduler timers.
+ */
+void RenderPool::run(Worker &worker) {
+    std::vector<struct pollfd> fds;
+    std::vector<Window *> scheduled;
+    while (running_) {
+        {
+            const std::lock_guard lock(worker.mutex);
+            while (wl_display_prepare_read_queue(wl_display_, worker.queue) != 0) {
+                if (wl_display_dispatch_queue_pending(wl_display_, worker.queue) < 0) {
+                    LOG_ERROR("RenderPool: %s", strerror(errno));
+                    return;
+                }
+            }
+            fds.clear();
+            scheduled.clear();
+            fds.push_back({wl_display_get_fd(wl_display_), POLLIN, 0});
+            fds.push_back({worker.wake_fd, POLLIN, 0});
+            for (const auto window: worker.windows) {
+                if (window->get_schedule_fd() >= 0) {
+                    fds.push_back({window->get_schedule_fd(), POLLIN, 0});
+                    scheduled.push_back(window);
+                }
+            }
+        }
+        Display::flush(wl_display_);
+
+        if (poll(fds.data(), fds.size(), -1) <= 0) {
+            wl_display_cancel_read(wl_display_);
+            continue;
+        }
+        if (fds[0].revents & (POLLIN | POLLERR | POLLHUP)) {
+            if (wl_display_read_events(wl_display_) < 0) {
+                LOG_ERROR("RenderPool: %s", strerror(errno));
+                return;
+            }
+        } else {
+            wl_display_cancel_read(wl_display_);
+        }
+        if (fds[1].revents & POLLIN) {
+            uint64_t count;
+            (void) read(worker.wake_fd, &count, sizeof(count));
+        }
+
+        const std::lock_guard lock(worker.mutex);
+        if (wl_display_dispatch_queue_pending(wl_display_, worker.queue) < 0) {
+            LOG_ERROR("RenderPool: %s", strerror(errno));
+            return;
+        }
+        for (size_t i = 0; i < scheduled.size(); i++) {
+            // the window may have been removed while polling
+            if ((fds[i + 2].revents & POLLIN) &&
+                std::find(worker.windows.begin(), worker.windows.end(), scheduled[i]) != worker.windows.end()) {
+                Window::dispatch_schedule(scheduled[i]);
+            }
+        }
+    }
+}
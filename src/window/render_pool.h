@@ -0,0 +1,71 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_RENDER_POOL_H_
+#define SRC_WINDOW_RENDER_POOL_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "window.h"
+#include "utils/thread_attributes.h"
+#include "utils/export.h"
+
+class WAYPP_EXPORT RenderPool {
+public:
+    // 0 threads picks one per core, less one for the thread dispatching input and outputs
+    explicit RenderPool(struct wl_display *display, size_t threads = 0, const ThreadAttributes &attributes = {});
+
+    ~RenderPool();
+
+    RenderPool(const RenderPool &) = delete;
+
+    RenderPool &operator=(const RenderPool &) = delete;
+
+    void add(Window *window);
+
+    void remove(Window *window);
+
+    [[nodiscard]] size_t get_thread_count() const { return workers_.size(); }
+
+private:
+    struct Worker {
+        struct wl_event_queue *queue{};
+        // wakes the worker when its windows change, or to stop
+        int wake_fd{-1};
+        // guards windows, and is held while they draw
+        std::mutex mutex;
+        std::vector<Window *> windows;
+        std::thread thread;
+    };
+
+    struct wl_display *wl_display_;
+    std::atomic<bool> running_{true};
+    std::vector<std::unique_ptr<Worker>> workers_;
+
+    void run(Worker &worker);
+
+    static void wake(const Worker &worker);
+};
+
+#endif // SRC_WINDOW_RENDER_POOL_H_
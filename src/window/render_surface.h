@@ -0,0 +1,102 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_RENDER_SURFACE_H_
+#define SRC_WINDOW_RENDER_SURFACE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "damage_tracker.h"
+#include "utils/export.h"
+
+class FrameClock;
+class FrameStats;
+
+/**
+ * @brief What the frame loop needs from a window, whatever renders into it.
+ *
+ * Implemented by WindowEgl, WindowVulkan and WindowShm, so resizing, scaling, pacing
+ * and damage are driven the same way for each. A frame is begin_frame(), drawing
+ * with the backend's own API, then end_frame() with the same damage.
+ */
+class WAYPP_EXPORT RenderSurface {
+public:
+    typedef enum {
+        EGL,
+        VULKAN,
+        SHM,
+    } Backend;
+
+    typedef DamageRect Rect;
+
+    // estimated from the buffer size, formats and buffer count in use, what the driver allocates may differ
+    struct MemoryUsage {
+        // the buffers handed to the compositor
+        uint64_t color_bytes;
+        // the multisampled color buffer frames are resolved from
+        uint64_t multisample_bytes;
+        uint64_t depth_stencil_bytes;
+        uint32_t buffers;
+
+        [[nodiscard]] uint64_t total() const { return color_bytes + multisample_bytes + depth_stencil_bytes; }
+
+        MemoryUsage &operator+=(const MemoryUsage &other) {
+            color_bytes += other.color_bytes;
+            multisample_bytes += other.multisample_bytes;
+            depth_stencil_bytes += other.depth_stencil_bytes;
+            buffers += other.buffers;
+            return *this;
+        }
+    };
+
+    virtual ~RenderSurface() = default;
+
+    [[nodiscard]] virtual Backend get_backend() const = 0;
+
+    // returns the region the frame must repaint, empty if there is nothing to draw into
+    [[nodiscard]] virtual std::vector<Rect> begin_frame(const std::vector<Rect> &damage) = 0;
+
+    // damage empty for the whole buffer
+    virtual bool end_frame(const std::vector<Rect> &damage) = 0;
+
+    // in surface coordinates
+    virtual void resize(int width, int height) = 0;
+
+    [[nodiscard]] virtual int get_buffer_width() const = 0;
+
+    [[nodiscard]] virtual int get_buffer_height() const = 0;
+
+    // the output's preferred scale, ignored by backends that render at surface size
+    virtual void set_output_scale(double /* scale */) {}
+
+    // the output the surface is shown on, for presentation statistics
+    virtual void set_frame_clock(const FrameClock * /* clock */) {}
+
+    // statistics from the backend's own present feedback, nullptr when the Window's frame callbacks are the source
+    [[nodiscard]] virtual const FrameStats *get_present_stats() const { return nullptr; }
+
+    // the last frame's time against the refresh interval, for backends that govern their resolution
+    virtual void report_frame_time(uint64_t /* frame_time_ns */, uint64_t /* refresh_ns */) {}
+
+    // 0 if the GPU time is not measured
+    [[nodiscard]] virtual uint64_t get_last_gpu_time_ns() const { return 0; }
+
+    [[nodiscard]] virtual MemoryUsage get_memory_usage() const { return {}; }
+};
+
+#endif // SRC_WINDOW_RENDER_SURFACE_H_
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "resolution_governor.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @class ResolutionGovernor
+ * @brief Picks a render scale that keeps the frame time within the refresh interval.
+ *
+ * Frame time is assumed to scale with the pixel count, i.e. with the square of the
+ * render scale. Overload drops the scale at once to the value predicted to reach
+ * the middle of the hold band; headroom raises it in small steps, and only when the
+ * predicted load stays below the high-water mark. The gap between both marks, the
+ * dwell counts and a cooldown after every change keep the scale from oscillating.
+ *
+ * @param config The bounds, thresholds and timing.
+ */
+ResolutionGovernor::ResolutionGovernor(const ResolutionGovernorConfig &config) :
+        config_(config),
+        scale_(config.max_scale) {
+}
+
+/**
+ * @brief Returns to the maximum scale and forgets the frame history.
+ */
+void ResolutionGovernor::reset() {
+    scale_ = config_.max_scale;
+    load_ = 0;
+    over_ = 0;
+    under_ = 0;
+    cooldown_ = 0;
+}
+
+/**
+ * @brief Feeds the time of the last frame and returns the scale for the next one.
+ *
+ * @param frame_time_ns Time spent rendering the last frame.
+ * @param refresh_ns    The output refresh interval; frames are not judged without it.
+ * @return The render scale, within [min_scale, max_scale].
+ */
+double ResolutionGovernor::update(uint64_t frame_time_ns, uint64_t refresh_ns) {
+    if (!frame_time_ns || !refresh_ns) {
+        return scale_;
+    }
+    const double load = static_cast<double>(frame_time_ns) / static_cast<double>(refresh_ns);
+    // short average, a single outlier frame should not trigger a change
+    load_ = load_ == 0 ? load : load_ + (load - load_) / 4;
+
+    if (cooldown_) {
+        cooldown_--;
+        return scale_;
+    }
+
+    const double target = (config_.high_water + config_.low_water) / 2;
+    if (load_ > config_.high_water && scale_ > config_.min_scale) {
+        under_ = 0;
+        if (++over_ >= config_.down_frames) {
+            const double scale = std::clamp(scale_ * std::sqrt(target / load_), config_.min_scale, scale_);
+            load_ *= (scale / scale_) * (scale / scale_);
+            scale_ = scale;
+            over_ = 0;
+            cooldown_ = config_.cooldown_frames;
+        }
+    } else if (load_ < config_.low_water && scale_ < config_.max_scale) {
+        over_ = 0;
+        if (++under_ >= config_.up_frames) {
+            const double scale = std::min(scale_ + config_.up_step, config_.max_scale);
+            const double predicted = load_ * (scale / scale_) * (scale / scale_);
+            if (predicted < config_.high_water) {
+                load_ = predicted;
+                scale_ = scale;
+                cooldown_ = config_.cooldown_frames;
+            }
+            under_ = 0;
+        }
+    } else {
+        over_ = 0;
+        under_ = 0;
+    }
+    return scale_;
+}
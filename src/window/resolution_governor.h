@@ -0,0 +1,62 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_RESOLUTION_GOVERNOR_H_
+#define SRC_WINDOW_RESOLUTION_GOVERNOR_H_
+
+#include <cstdint>
+
+#include "utils/export.h"
+
+struct ResolutionGovernorConfig {
+    // render scale bounds
+    double min_scale{0.5};
+    double max_scale{1.0};
+    // frame time as a fraction of the refresh interval: above high the scale drops,
+    // below low it may rise, in between it holds
+    double high_water{0.9};
+    double low_water{0.65};
+    // consecutive frames past a threshold before acting
+    uint32_t down_frames{3};
+    uint32_t up_frames{120};
+    // increment when raising the scale
+    double up_step{0.05};
+    // frames to hold the scale after a change, while the new frame times settle
+    uint32_t cooldown_frames{30};
+};
+
+class WAYPP_EXPORT ResolutionGovernor {
+public:
+    explicit ResolutionGovernor(const ResolutionGovernorConfig &config = {});
+
+    double update(uint64_t frame_time_ns, uint64_t refresh_ns);
+
+    [[nodiscard]] double get_scale() const { return scale_; }
+
+    void reset();
+
+private:
+    ResolutionGovernorConfig config_;
+    double scale_;
+    // average frame time over refresh interval
+    double load_{};
+    uint32_t over_{};
+    uint32_t under_{};
+    uint32_t cooldown_{};
+};
+
+#endif // SRC_WINDOW_RESOLUTION_GOVERNOR_H_
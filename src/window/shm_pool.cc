@@ -0,0 +1,227 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "shm_pool.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+namespace {
+constexpr size_t kPageSize = 4096;
+}
+
+/**
+ * @class ShmPool
+ * @brief Sub-allocates wl_shm buffers from one growable memfd.
+ *
+ * Every buffer is a slice of the same memfd and wl_shm_pool, so a long session with
+ * frequent resizes or captures holds one fd and one mapping instead of one per buffer.
+ * Slices are rounded up to size classes, four per doubling, and freed slices are kept in
+ * a free list per class for the next buffer of that class. The pool grows with ftruncate
+ * and wl_shm_pool_resize into address space reserved up front, so buffer pointers stay
+ * valid; it never shrinks, as the compositor maps it too.
+ *
+ * @param shm      The wl_shm global.
+ * @param name     The memfd name, shown in /proc/<pid>/fd.
+ * @param max_size The address space reserved, the largest the pool can grow to.
+ */
+ShmPool::ShmPool(struct wl_shm *shm, const char *name, size_t max_size) :
+        wl_shm_(shm),
+        reserved_(std::min<size_t>((max_size + kPageSize - 1) & ~(kPageSize - 1), INT32_MAX & ~(kPageSize - 1))) {
+    if (!wl_shm_) {
+        throw std::runtime_error("wl_shm is not available.");
+    }
+    fd_ = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd_ < 0) {
+        throw std::runtime_error(std::string("memfd_create failed: ") + strerror(errno));
+    }
+    // the compositor maps the pool too; it must never shrink under it
+    fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK);
+    void *base = mmap(nullptr, reserved_, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd_);
+        throw std::runtime_error(std::string("mmap failed: ") + strerror(errno));
+    }
+    base_ = static_cast<uint8_t *>(base);
+}
+
+/**
+ * @brief Destroys the buffers, busy or not, then the pool and the mapping.
+ */
+ShmPool::~ShmPool() {
+    for (const auto &slot: buffers_) {
+        wl_buffer_destroy(slot.buffer->wl_buffer);
+    }
+    if (pool_) {
+        wl_shm_pool_destroy(pool_);
+    }
+    munmap(base_, reserved_);
+    close(fd_);
+}
+
+/**
+ * @brief Creates a buffer in a free slice of its size class, or in a new one.
+ *
+ * @return The buffer, owned by the pool until destroy_buffer(), or nullptr if the pool is full.
+ */
+ShmPool::Buffer *ShmPool::create_buffer(int32_t width, int32_t height, int32_t stride, uint32_t format) {
+    if (width <= 0 || height <= 0 || stride < width) {
+        return nullptr;
+    }
+    const size_t index = class_index(static_cast<size_t>(stride) * static_cast<size_t>(height));
+    const size_t size = class_size(index);
+    size_t offset;
+    if (index < free_.size() && !free_[index].empty()) {
+        offset = free_[index].back();
+        free_[index].pop_back();
+    } else {
+        if (end_ + size > size_ && !grow(end_ + size)) {
+            return nullptr;
+        }
+        offset = end_;
+        end_ += size;
+    }
+
+    auto buffer = std::make_unique<Buffer>(Buffer{
+            .wl_buffer = wl_shm_pool_create_buffer(pool_, static_cast<int32_t>(offset), width, height, stride, format),
+            .data = base_ + offset,
+            .offset = offset,
+            .size = size,
+            .width = width,
+            .height = height,
+            .stride = stride,
+            .format = format,
+            .busy = false,
+    });
+    wl_buffer_add_listener(buffer->wl_buffer, &buffer_listener_, this);
+    used_ += size;
+    buffers_.push_back({std::move(buffer), false});
+    return buffers_.back().buffer.get();
+}
+
+/**
+ * @brief Returns a buffer's slice to the free list, once the compositor released it.
+ *
+ * A busy buffer stays alive until its wl_buffer.release, so the compositor never reads
+ * a slice that is drawn into again.
+ */
+void ShmPool::destroy_buffer(Buffer *buffer) {
+    const auto slot = std::find_if(buffers_.begin(), buffers_.end(),
+                                   [buffer](const Slot &item) { return item.buffer.get() == buffer; });
+    if (slot == buffers_.end()) {
+        return;
+    }
+    if (buffer->busy) {
+        slot->orphaned = true;
+        return;
+    }
+    reclaim(slot);
+}
+
+/**
+ * @return The bytes of size class index: 1 to 4 pages, then four classes per doubling.
+ */
+size_t ShmPool::class_size(size_t index) {
+    if (index < 4) {
+        return (index + 1) * kPageSize;
+    }
+    const size_t group = (index - 4) / 4;
+    const size_t step = (index - 4) % 4 + 1;
+    return ((size_t{4} << group) + (step << group)) * kPageSize;
+}
+
+/**
+ * @return The smallest size class holding size bytes, wasting at most a quarter.
+ */
+size_t ShmPool::class_index(size_t size) {
+    size_t index = 0;
+    while (class_size(index) < size) {
+        index++;
+    }
+    return index;
+}
+
+/**
+ * @brief Grows the memfd, its mapping and the wl_shm_pool to at least size bytes.
+ *
+ * Doubles the pool where possible, so a series of growing buffers resizes it only a
+ * few times. The memfd is mapped over the reserved range in place, the mapping does
+ * not move.
+ *
+ * @return false if size does not fit the reserved range, or the memfd cannot grow.
+ */
+bool ShmPool::grow(size_t size) {
+    if (size > reserved_) {
+        LOG_ERROR("ShmPool: %zu bytes exceed the pool's %zu", size, reserved_);
+        return false;
+    }
+    const size_t grown = std::min(reserved_, std::max(size, size_ * 2));
+    if (ftruncate(fd_, static_cast<off_t>(grown)) < 0) {
+        LOG_ERROR("ShmPool: ftruncate failed: %s", strerror(errno));
+        return false;
+    }
+    if (mmap(base_, grown, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd_, 0) == MAP_FAILED) {
+        LOG_ERROR("ShmPool: mmap failed: %s", strerror(errno));
+        return false;
+    }
+    if (pool_) {
+        wl_shm_pool_resize(pool_, static_cast<int32_t>(grown));
+    } else {
+        pool_ = wl_shm_create_pool(wl_shm_, fd_, static_cast<int32_t>(grown));
+    }
+    size_ = grown;
+    return true;
+}
+
+void ShmPool::reclaim(std::vector<Slot>::iterator slot) {
+    const auto &buffer = *slot->buffer;
+    wl_buffer_destroy(buffer.wl_buffer);
+    const size_t index = class_index(buffer.size);
+    if (index >= free_.size()) {
+        free_.resize(index + 1);
+    }
+    free_[index].push_back(buffer.offset);
+    used_ -= buffer.size;
+    buffers_.erase(slot);
+}
+
+void ShmPool::handle_release(struct wl_buffer *wl_buffer) {
+    const auto slot = std::find_if(buffers_.begin(), buffers_.end(),
+                                   [wl_buffer](const Slot &item) { return item.buffer->wl_buffer == wl_buffer; });
+    if (slot == buffers_.end()) {
+        return;
+    }
+    slot->buffer->busy = false;
+    if (slot->orphaned) {
+        reclaim(slot);
+    }
+}
+
+const struct wl_buffer_listener ShmPool::buffer_listener_ = {
+        .release = listener_thunk<&ShmPool::handle_release>,
+};
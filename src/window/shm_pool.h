@@ -0,0 +1,107 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_SHM_POOL_H_
+#define SRC_WINDOW_SHM_POOL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT ShmPool {
+public:
+    // address space reserved for the pool, which grows into it without moving
+    static constexpr size_t kDefaultMaxSize = 256u << 20;
+
+    struct Buffer {
+        struct wl_buffer *wl_buffer;
+        // stays valid while the pool grows
+        void *data;
+        // of the slice in the pool's fd, for handing the pixels on without a copy
+        size_t offset;
+        // of the slice, stride * height rounded up to its size class
+        size_t size;
+        int32_t width;
+        int32_t height;
+        int32_t stride;
+        uint32_t format;
+        // attached and not yet released by the compositor
+        bool busy;
+    };
+
+    explicit ShmPool(struct wl_shm *shm, const char *name = "waypp-shm-pool", size_t max_size = kDefaultMaxSize);
+
+    ~ShmPool();
+
+    ShmPool(const ShmPool &) = delete;
+
+    ShmPool &operator=(const ShmPool &) = delete;
+
+    [[nodiscard]] Buffer *create_buffer(int32_t width, int32_t height, int32_t stride, uint32_t format);
+
+    void destroy_buffer(Buffer *buffer);
+
+    [[nodiscard]] int get_fd() const { return fd_; }
+
+    // bytes of the memfd, which only grows
+    [[nodiscard]] size_t get_size() const { return size_; }
+
+    // bytes in slices handed out, including buffers waiting for their release
+    [[nodiscard]] size_t get_used() const { return used_; }
+
+    [[nodiscard]] size_t get_buffer_count() const { return buffers_.size(); }
+
+private:
+    struct Slot {
+        std::unique_ptr<Buffer> buffer;
+        // destroy_buffer() was called while busy, the slice is reclaimed on release
+        bool orphaned;
+    };
+
+    struct wl_shm *wl_shm_;
+    int fd_{-1};
+    struct wl_shm_pool *pool_{};
+    // start of the reserved range; the first size_ bytes map the memfd
+    uint8_t *base_{};
+    size_t reserved_{};
+    size_t size_{};
+    // end of the slices carved so far, freed ones go to free_ instead of moving it back
+    size_t end_{};
+    size_t used_{};
+    std::vector<Slot> buffers_;
+    // offsets of free slices, by size class
+    std::vector<std::vector<size_t>> free_;
+
+    [[nodiscard]] static size_t class_size(size_t index);
+
+    [[nodiscard]] static size_t class_index(size_t size);
+
+    bool grow(size_t size);
+
+    void reclaim(std::vector<Slot>::iterator slot);
+
+    void handle_release(struct wl_buffer *buffer);
+
+    static const struct wl_buffer_listener buffer_listener_;
+};
+
+#endif // SRC_WINDOW_SHM_POOL_H_
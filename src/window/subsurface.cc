@@ -0,0 +1,213 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "subsurface.h"
+
+#include <stdexcept>
+#include <utility>
+
+/**
+ * @class SubSurface
+ * @brief A wl_subsurface with its own surface, hosting EGL, SHM or dmabuf content.
+ *
+ * In desync mode the subsurface's own commits are applied right away, so e.g. a video
+ * layer can update at video rate, and possibly on a plane of its own, without the
+ * parent redrawing. In sync mode its state is applied with the next parent commit.
+ * Position and stacking order are always applied with the parent commit.
+ *
+ * @param compositor    The wl_compositor used to create the surface.
+ * @param subcompositor The wl_subcompositor global.
+ * @param parent        The parent surface, a toplevel or another subsurface.
+ * @param sync          true for synchronized mode, false for desynchronized.
+ */
+SubSurface::SubSurface(struct wl_compositor *compositor, struct wl_subcompositor *subcompositor,
+                       struct wl_surface *parent, bool sync) :
+        SubSurface(compositor, subcompositor, parent, WindowPool::Entry{nullptr, {}}, sync) {
+}
+
+/**
+ * @brief Creates a subsurface on a surface acquired from a WindowPool.
+ *
+ * The pooled EGL window is adopted as the subsurface's content, see get_egl_window().
+ *
+ * @param entry The pooled surface and its EGL window, or no surface to create one.
+ */
+SubSurface::SubSurface(struct wl_compositor *compositor, struct wl_subcompositor *subcompositor,
+                       struct wl_surface *parent, WindowPool::Entry &&entry, bool sync) :
+        wl_compositor_(compositor),
+        parent_(parent),
+        wl_surface_(entry.surface),
+        wl_subsurface_(nullptr),
+        sync_(true),
+        egl_window_(std::move(entry.window)) {
+    if (!subcompositor) {
+        throw std::runtime_error("wl_subcompositor is not available.");
+    }
+    if (!wl_surface_) {
+        wl_surface_ = wl_compositor_create_surface(wl_compositor_);
+    }
+    wl_subsurface_ = wl_subcompositor_get_subsurface(subcompositor, wl_surface_, parent_);
+    // subsurfaces start out synchronized
+    set_sync(sync);
+}
+
+/**
+ * @brief Destroys the content, then the subsurface role and the surface.
+ */
+SubSurface::~SubSurface() {
+    reset_content();
+#if defined(ENABLE_ALPHA_MODIFIER)
+    alpha_modifier_.reset();
+#endif
+    wl_subsurface_destroy(wl_subsurface_);
+    wl_surface_destroy(wl_surface_);
+}
+
+/**
+ * @brief Sets the position relative to the parent's surface origin.
+ *
+ * Applied with the next parent commit.
+ */
+void SubSurface::set_position(int x, int y) {
+    wl_subsurface_set_position(wl_subsurface_, x, y);
+}
+
+/**
+ * @brief Stacks the subsurface right above sibling, the parent or another of its subsurfaces.
+ *
+ * Applied with the next parent commit.
+ */
+void SubSurface::place_above(struct wl_surface *sibling) {
+    wl_subsurface_place_above(wl_subsurface_, sibling);
+}
+
+/**
+ * @brief Stacks the subsurface right below sibling, the parent or another of its subsurfaces.
+ *
+ * Applied with the next parent commit.
+ */
+void SubSurface::place_below(struct wl_surface *sibling) {
+    wl_subsurface_place_below(wl_subsurface_, sibling);
+}
+
+/**
+ * @brief Switches between synchronized and desynchronized mode.
+ *
+ * @param sync true to apply the subsurface's commits with the parent's.
+ */
+void SubSurface::set_sync(bool sync) {
+    if (sync == sync_) {
+        return;
+    }
+    sync_ = sync;
+    if (sync_) {
+        wl_subsurface_set_sync(wl_subsurface_);
+    } else {
+        wl_subsurface_set_desync(wl_subsurface_);
+    }
+}
+
+/**
+ * @brief Commits the subsurface's pending state.
+ *
+ * Needed after attaching SHM or dmabuf content; eglSwapBuffers commits by itself.
+ */
+void SubSurface::commit() {
+    wl_surface_commit(wl_surface_);
+}
+
+/**
+ * @brief Hosts an EGL window on the subsurface, replacing any previous content.
+ *
+ * @return The window, owned by the subsurface.
+ */
+WindowEgl *SubSurface::create_egl_window(const EglDisplay *egl_display, int width, int height,
+                                         const WindowEglConfig &config) {
+    reset_content();
+    egl_window_ = std::make_unique<WindowEgl>(egl_display, wl_compositor_, wl_surface_, width, height,
+                                              Window::ShellType::NONE, nullptr, config);
+    return egl_window_.get();
+}
+
+/**
+ * @brief Hosts an SHM window on the subsurface, replacing any previous content.
+ *
+ * @return The window, owned by the subsurface.
+ */
+WindowShm *SubSurface::create_shm_window(struct wl_shm *shm, int width, int height,
+                                         const WindowShmConfig &config) {
+    reset_content();
+    shm_window_ = std::make_unique<WindowShm>(shm, wl_surface_, width, height, config);
+    return shm_window_.get();
+}
+
+/**
+ * @brief Hosts a dmabuf window on the subsurface, replacing any previous content.
+ *
+ * @return The window, owned by the subsurface.
+ */
+WindowDmabuf *SubSurface::create_dmabuf_window(const Display *display) {
+    reset_content();
+    dmabuf_window_ = std::make_unique<WindowDmabuf>(display, wl_surface_);
+    return dmabuf_window_.get();
+}
+
+/**
+ * @brief Fades the subsurface and its content in the compositor, see Window::set_opacity().
+ *
+ * Applied with the next commit(), and for a synchronized subsurface the parent's.
+ * enable_alpha_modifier() must have been given the global first.
+ *
+ * @param opacity 0 for fully transparent to 1 for opaque.
+ * @return false if there is no wp_alpha_modifier_v1, or it is not built in.
+ */
+bool SubSurface::set_opacity(float opacity) {
+#if defined(ENABLE_ALPHA_MODIFIER)
+    if (!wp_alpha_modifier_) {
+        return false;
+    }
+    if (!alpha_modifier_) {
+        alpha_modifier_ = std::make_unique<AlphaModifier>(wp_alpha_modifier_, wl_surface_);
+    }
+    (void) alpha_modifier_->set_opacity(opacity);
+    return true;
+#else
+    (void) opacity;
+    return false;
+#endif
+}
+
+/**
+ * @brief Fills the subsurface with a color, replacing any previous content.
+ *
+ * For backgrounds, letterbox bars and fade overlays, see WindowSolid.
+ *
+ * @return The window, owned by the subsurface.
+ */
+WindowSolid *SubSurface::create_solid_window(const Display *display, int width, int height,
+                                             const WindowSolid::Color &color) {
+    reset_content();
+    solid_window_ = std::make_unique<WindowSolid>(display, wl_compositor_, wl_surface_, width, height, color);
+    return solid_window_.get();
+}
+
+void SubSurface::reset_content() {
+    egl_window_.reset();
+    shm_window_.reset();
+    dmabuf_window_.reset();
+    solid_window_.reset();
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_SUBSURFACE_H_
+#define SRC_WINDOW_SUBSURFACE_H_
+
+#include <memory>
+
+#include <wayland-client.h>
+
+#include "alpha_modifier.h"
+#include "window_egl.h"
+#include "window_pool.h"
+#include "window_shm.h"
+#include "window_dmabuf.h"
+#include "window_solid.h"
+#include "utils/export.h"
+
+class Display;
+
+class EglDisplay;
+
+class WAYPP_EXPORT SubSurface {
+public:
+    explicit SubSurface(struct wl_compositor *compositor, struct wl_subcompositor *subcompositor,
+                        struct wl_surface *parent, bool sync = true);
+
+    // on a surface from a WindowPool, its EGL window becomes the subsurface's content
+    SubSurface(struct wl_compositor *compositor, struct wl_subcompositor *subcompositor,
+               struct wl_surface *parent, WindowPool::Entry &&entry, bool sync = true);
+
+    ~SubSurface();
+
+    SubSurface(const SubSurface &) = delete;
+
+    SubSurface &operator=(const SubSurface &) = delete;
+
+    void set_position(int x, int y);
+
+    void place_above(struct wl_surface *sibling);
+
+    void place_below(struct wl_surface *sibling);
+
+    void set_sync(bool sync);
+
+    [[nodiscard]] bool is_sync() const { return sync_; }
+
+    void commit();
+
+    void enable_alpha_modifier(struct wp_alpha_modifier_v1 *manager) { wp_alpha_modifier_ = manager; }
+
+    bool set_opacity(float opacity);
+
+#if defined(ENABLE_ALPHA_MODIFIER)
+    [[nodiscard]] float get_opacity() const { return alpha_modifier_ ? alpha_modifier_->get_opacity() : 1.0f; }
+#else
+    [[nodiscard]] float get_opacity() const { return 1.0f; }
+#endif
+
+    [[nodiscard]] struct wl_surface *get_surface() const { return wl_surface_; }
+
+    [[nodiscard]] struct wl_surface *get_parent() const { return parent_; }
+
+    [[nodiscard]] WindowEgl *get_egl_window() const { return egl_window_.get(); }
+
+    WindowEgl *create_egl_window(const EglDisplay *egl_display, int width, int height,
+                                 const WindowEglConfig &config = {});
+
+    WindowShm *create_shm_window(struct wl_shm *shm, int width, int height, const WindowShmConfig &config = {});
+
+    WindowDmabuf *create_dmabuf_window(const Display *display);
+
+    WindowSolid *create_solid_window(const Display *display, int width, int height, const WindowSolid::Color &color);
+
+private:
+    struct wl_compositor *wl_compositor_;
+    struct wl_surface *parent_;
+    struct wl_surface *wl_surface_;
+    struct wl_subsurface *wl_subsurface_;
+    bool sync_;
+    struct wp_alpha_modifier_v1 *wp_alpha_modifier_{};
+#if defined(ENABLE_ALPHA_MODIFIER)
+    std::unique_ptr<AlphaModifier> alpha_modifier_;
+#endif
+
+    // the content hosted on the surface, at most one is set
+    std::unique_ptr<WindowEgl> egl_window_;
+    std::unique_ptr<WindowShm> shm_window_;
+    std::unique_ptr<WindowDmabuf> dmabuf_window_;
+    std::unique_ptr<WindowSolid> solid_window_;
+
+    void reset_content();
+};
+
+#endif // SRC_WINDOW_SUBSURFACE_H_
@@ -0,0 +1,365 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "surface_atlas.h"
+
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "utils/listener.h"
+
+/**
+ * @class SurfaceAtlas
+ * @brief Many small tiles drawn into one shared wl_shm buffer.
+ *
+ * Instead of an EGL or SHM window per tile, every tile is a subsurface showing its
+ * rectangle of one atlas buffer through a wp_viewport. The pool holds
+ * buffer_count copies of the atlas, so a dashboard of dozens of tiles allocates two
+ * buffers rather than two or three per tile, and the compositor imports one buffer
+ * for all of them. Tiles are packed into shelves; a removed tile's rectangle is reused
+ * by the next tile that fits.
+ *
+ * update() draws the invalidated tiles into a free copy, carries the others over from
+ * the copy on screen, and attaches it to every tile. With sync set the tiles change
+ * together with the parent's next commit.
+ *
+ * @param compositor    The wl_compositor the tile surfaces are created with.
+ * @param subcompositor The wl_subcompositor global.
+ * @param viewporter    The wp_viewporter global, required.
+ * @param shm           The wl_shm global.
+ * @param parent        The surface the tiles are placed on.
+ * @param config        The atlas size, pixel format and number of copies.
+ */
+SurfaceAtlas::SurfaceAtlas(struct wl_compositor *compositor, struct wl_subcompositor *subcompositor,
+                           struct wp_viewporter *viewporter, struct wl_shm *shm, struct wl_surface *parent,
+                           const SurfaceAtlasConfig &config) :
+        wl_compositor_(compositor),
+        wl_subcompositor_(subcompositor),
+        wp_viewporter_(viewporter),
+        parent_(parent),
+        width_(config.width),
+        height_(config.height),
+        format_(config.format),
+        stride_(config.width * 4),
+        sync_(config.sync),
+        buffers_(config.buffer_count ? config.buffer_count : 2) {
+    if (!wl_subcompositor_ || !wp_viewporter_) {
+        throw std::runtime_error("SurfaceAtlas needs wl_subcompositor and wp_viewporter.");
+    }
+    if (!shm) {
+        throw std::runtime_error("wl_shm is not available.");
+    }
+    switch (format_) {
+        case WL_SHM_FORMAT_ARGB8888:
+        case WL_SHM_FORMAT_XRGB8888:
+        case WL_SHM_FORMAT_ABGR8888:
+        case WL_SHM_FORMAT_XBGR8888:
+            break;
+        default:
+            throw std::runtime_error("Unsupported atlas format " + std::to_string(format_));
+    }
+    if (width_ <= 0 || height_ <= 0) {
+        throw std::runtime_error("Invalid atlas size");
+    }
+    const size_t buffer_size = static_cast<size_t>(stride_) * static_cast<size_t>(height_);
+    const size_t size = buffer_size * buffers_.size();
+    if (size > INT32_MAX) {
+        throw std::runtime_error("wl_shm pool too large");
+    }
+
+    fd_ = memfd_create("waypp-atlas", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd_ < 0) {
+        throw std::runtime_error(std::string("memfd_create failed: ") + strerror(errno));
+    }
+    if (ftruncate(fd_, static_cast<off_t>(size)) < 0) {
+        close(fd_);
+        throw std::runtime_error(std::string("ftruncate failed: ") + strerror(errno));
+    }
+    // the compositor maps the pool too; it must never shrink under it
+    fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK);
+    pool_data_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (pool_data_ == MAP_FAILED) {
+        close(fd_);
+        throw std::runtime_error(std::string("mmap failed: ") + strerror(errno));
+    }
+    pool_size_ = size;
+    pool_ = wl_shm_create_pool(shm, fd_, static_cast<int32_t>(size));
+
+    for (size_t i = 0; i < buffers_.size(); i++) {
+        const auto offset = i * buffer_size;
+        auto &buffer = buffers_[i];
+        buffer.wl_buffer = wl_shm_pool_create_buffer(pool_, static_cast<int32_t>(offset), width_, height_, stride_,
+                                                     format_);
+        wl_buffer_add_listener(buffer.wl_buffer, &buffer_listener_, this);
+        buffer.data = static_cast<uint8_t *>(pool_data_) + offset;
+        buffer.busy = false;
+    }
+}
+
+/**
+ * @brief Destroys the tiles, then the buffers and the pool.
+ */
+SurfaceAtlas::~SurfaceAtlas() {
+    tiles_.clear();
+    for (auto &buffer: buffers_) {
+        wl_buffer_destroy(buffer.wl_buffer);
+    }
+    wl_shm_pool_destroy(pool_);
+    munmap(pool_data_, pool_size_);
+    close(fd_);
+}
+
+/**
+ * @brief Packs a tile into the atlas and creates its subsurface.
+ *
+ * The tile shows nothing until the next update() draws it.
+ *
+ * @param width  The tile width, in surface and buffer pixels.
+ * @param height The tile height.
+ * @return The tile id, or -1 if the atlas has no room left.
+ */
+int SurfaceAtlas::add_tile(int width, int height) {
+    Rect rect{};
+    if (width <= 0 || height <= 0 || !allocate(width, height, rect)) {
+        return -1;
+    }
+    size_t id = 0;
+    while (id < tiles_.size() && tiles_[id].surface) {
+        id++;
+    }
+    if (id == tiles_.size()) {
+        tiles_.emplace_back();
+    }
+    auto &tile = tiles_[id];
+    tile.surface = std::make_unique<SubSurface>(wl_compositor_, wl_subcompositor_, parent_, sync_);
+    tile.viewport = std::make_unique<Viewport>(wp_viewporter_, tile.surface->get_surface());
+    tile.viewport->set_source(rect.x, rect.y, rect.width, rect.height);
+    tile.viewport->set_destination(rect.width, rect.height);
+    tile.rect = rect;
+    tile.version = ++next_version_;
+    tile.dirty = true;
+    tile_count_++;
+    return static_cast<int>(id);
+}
+
+/**
+ * @brief Destroys a tile's subsurface and returns its rectangle to the atlas.
+ */
+void SurfaceAtlas::remove_tile(int id) {
+    if (id < 0 || static_cast<size_t>(id) >= tiles_.size() || !tiles_[id].surface) {
+        return;
+    }
+    auto &tile = tiles_[id];
+    free_rects_.push_back(tile.rect);
+    tile.viewport.reset();
+    tile.surface.reset();
+    tile.dirty = false;
+    tile_count_--;
+}
+
+/**
+ * @brief Places a tile relative to the parent surface, applied with the parent's next commit.
+ */
+void SurfaceAtlas::set_tile_position(int id, int x, int y) {
+    if (auto surface = get_tile_surface(id)) {
+        surface->set_position(x, y);
+    }
+}
+
+/**
+ * @brief Marks a tile to be drawn by the next update().
+ */
+void SurfaceAtlas::invalidate(int id) {
+    if (id < 0 || static_cast<size_t>(id) >= tiles_.size() || !tiles_[id].surface) {
+        return;
+    }
+    auto &tile = tiles_[id];
+    if (!tile.dirty) {
+        tile.version = ++next_version_;
+        tile.dirty = true;
+    }
+}
+
+/**
+ * @brief Draws the invalidated tiles into a free copy of the atlas and shows it on every tile.
+ *
+ * Tiles that did not change are copied from the atlas on screen, or drawn again if
+ * that copy does not hold them yet. Each tile surface is committed; in sync mode the
+ * result shows with the parent's next commit.
+ *
+ * @param draw Called for each tile to draw, with where it lives in the buffer.
+ * @return false if every copy is still held by the compositor, the tiles stay invalidated.
+ */
+bool SurfaceAtlas::update(const std::function<void(const TileView &view)> &draw) {
+    bool changed = false;
+    for (const auto &tile: tiles_) {
+        changed |= tile.surface && tile.dirty;
+    }
+    if (!changed) {
+        return true;
+    }
+    Buffer *buffer = acquire();
+    if (!buffer) {
+        return false;
+    }
+    buffer->versions.resize(tiles_.size());
+
+    for (size_t i = 0; i < tiles_.size(); i++) {
+        auto &tile = tiles_[i];
+        if (!tile.surface || buffer->versions[i] == tile.version) {
+            continue;
+        }
+        if (front_ && i < front_->versions.size() && front_->versions[i] == tile.version) {
+            copy_tile(*front_, *buffer, tile.rect);
+        } else if (draw) {
+            const TileView view{
+                    .id = static_cast<int>(i),
+                    .data = buffer->data + static_cast<size_t>(tile.rect.y) * stride_ + tile.rect.x * 4,
+                    .stride = stride_,
+                    .width = tile.rect.width,
+                    .height = tile.rect.height,
+                    .format = format_,
+            };
+            draw(view);
+        }
+        buffer->versions[i] = tile.version;
+    }
+
+    for (auto &tile: tiles_) {
+        if (!tile.surface) {
+            continue;
+        }
+        struct wl_surface *surface = tile.surface->get_surface();
+        // every tile moves to the new copy, so the old one is released and can be drawn again
+        wl_surface_attach(surface, buffer->wl_buffer, 0, 0);
+        if (tile.dirty) {
+            if (wl_surface_get_version(surface) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+                wl_surface_damage_buffer(surface, tile.rect.x, tile.rect.y, tile.rect.width, tile.rect.height);
+            } else {
+                wl_surface_damage(surface, 0, 0, INT32_MAX, INT32_MAX);
+            }
+            tile.dirty = false;
+        }
+        tile.surface->commit();
+    }
+    buffer->busy = true;
+    front_ = buffer;
+    return true;
+}
+
+/**
+ * @return The tile's subsurface, nullptr for an unknown id.
+ */
+SubSurface *SurfaceAtlas::get_tile_surface(int id) const {
+    if (id < 0 || static_cast<size_t>(id) >= tiles_.size()) {
+        return nullptr;
+    }
+    return tiles_[id].surface.get();
+}
+
+/**
+ * @return The tile's rectangle in the atlas, empty for an unknown id.
+ */
+SurfaceAtlas::Rect SurfaceAtlas::get_tile_rect(int id) const {
+    if (!get_tile_surface(id)) {
+        return {};
+    }
+    return tiles_[id].rect;
+}
+
+/**
+ * @brief Finds room for a tile, in a freed rectangle first, then on a shelf.
+ *
+ * Freed rectangles are reused by the smallest that fits. Shelves are rows as high as
+ * the tile that opened them; a tile goes on the lowest shelf it fits, or opens a new one.
+ */
+bool SurfaceAtlas::allocate(int width, int height, Rect &rect) {
+    auto best = free_rects_.end();
+    for (auto it = free_rects_.begin(); it != free_rects_.end(); ++it) {
+        if (it->width >= width && it->height >= height &&
+            (best == free_rects_.end() || it->width * it->height < best->width * best->height)) {
+            best = it;
+        }
+    }
+    if (best != free_rects_.end()) {
+        rect = {best->x, best->y, width, height};
+        free_rects_.erase(best);
+        return true;
+    }
+
+    Shelf *fit = nullptr;
+    for (auto &shelf: shelves_) {
+        if (shelf.height >= height && shelf.used + width <= width_ && (!fit || shelf.height < fit->height)) {
+            fit = &shelf;
+        }
+    }
+    if (!fit) {
+        const int y = shelves_.empty() ? 0 : shelves_.back().y + shelves_.back().height;
+        if (width > width_ || y + height > height_) {
+            return false;
+        }
+        shelves_.push_back({y, height, 0});
+        fit = &shelves_.back();
+    }
+    rect = {fit->used, fit->y, width, height};
+    fit->used += width;
+    return true;
+}
+
+/**
+ * @return A copy of the atlas the compositor is not reading, nullptr if all are busy.
+ */
+SurfaceAtlas::Buffer *SurfaceAtlas::acquire() {
+    for (auto &buffer: buffers_) {
+        if (!buffer.busy && &buffer != front_) {
+            return &buffer;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Copies a tile's rectangle between two copies of the atlas.
+ */
+void SurfaceAtlas::copy_tile(const Buffer &from, const Buffer &to, const Rect &rect) const {
+    const size_t offset = static_cast<size_t>(rect.y) * stride_ + static_cast<size_t>(rect.x) * 4;
+    const size_t row = static_cast<size_t>(rect.width) * 4;
+    for (int y = 0; y < rect.height; y++) {
+        memcpy(to.data + offset + static_cast<size_t>(y) * stride_,
+               from.data + offset + static_cast<size_t>(y) * stride_, row);
+    }
+}
+
+void SurfaceAtlas::handle_release(struct wl_buffer *wl_buffer) {
+    for (auto &buffer: buffers_) {
+        if (buffer.wl_buffer == wl_buffer) {
+            buffer.busy = false;
+            return;
+        }
+    }
+}
+
+const struct wl_buffer_listener SurfaceAtlas::buffer_listener_ = {
+        .release = listener_thunk<&SurfaceAtlas::handle_release>,
+};
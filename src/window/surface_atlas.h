@@ -0,0 +1,154 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_SURFACE_ATLAS_H_
+#define SRC_WINDOW_SURFACE_ATLAS_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "damage_tracker.h"
+#include "render_surface.h"
+#include "subsurface.h"
+#include "viewport.h"
+#include "utils/export.h"
+
+struct SurfaceAtlasConfig {
+    // size of the shared buffer in pixels, tiles are packed into it
+    int width{1024};
+    int height{1024};
+    uint32_t format{WL_SHM_FORMAT_ARGB8888};
+    // copies of the atlas, one is drawn while the compositor reads another
+    uint32_t buffer_count{2};
+    // tiles apply their changes with the parent's commit
+    bool sync{true};
+};
+
+class WAYPP_EXPORT SurfaceAtlas {
+public:
+    typedef DamageRect Rect;
+
+    // where the tile lives in the buffer being drawn
+    struct TileView {
+        int id;
+        uint8_t *data;
+        int32_t stride;
+        int width;
+        int height;
+        uint32_t format;
+    };
+
+    SurfaceAtlas(struct wl_compositor *compositor, struct wl_subcompositor *subcompositor,
+                 struct wp_viewporter *viewporter, struct wl_shm *shm, struct wl_surface *parent,
+                 const SurfaceAtlasConfig &config = {});
+
+    ~SurfaceAtlas();
+
+    SurfaceAtlas(const SurfaceAtlas &) = delete;
+
+    SurfaceAtlas &operator=(const SurfaceAtlas &) = delete;
+
+    [[nodiscard]] int add_tile(int width, int height);
+
+    void remove_tile(int id);
+
+    void set_tile_position(int id, int x, int y);
+
+    void invalidate(int id);
+
+    bool update(const std::function<void(const TileView &view)> &draw);
+
+    // the tile's subsurface, e.g. to restack it, nullptr for an unknown id
+    [[nodiscard]] SubSurface *get_tile_surface(int id) const;
+
+    [[nodiscard]] Rect get_tile_rect(int id) const;
+
+    [[nodiscard]] size_t get_tile_count() const { return tile_count_; }
+
+    [[nodiscard]] size_t get_pool_size() const { return pool_size_; }
+
+    [[nodiscard]] RenderSurface::MemoryUsage get_memory_usage() const {
+        return {pool_size_, 0, 0, static_cast<uint32_t>(buffers_.size())};
+    }
+
+private:
+    struct Tile {
+        std::unique_ptr<SubSurface> surface;
+        std::unique_ptr<Viewport> viewport;
+        Rect rect;
+        // bumped by invalidate(), the buffers record the version they hold
+        uint64_t version;
+        bool dirty;
+    };
+
+    struct Buffer {
+        struct wl_buffer *wl_buffer;
+        uint8_t *data;
+        bool busy;
+        // version of every tile slot drawn into this buffer, 0 for none
+        std::vector<uint64_t> versions;
+    };
+
+    // a row of the atlas tiles are packed into left to right
+    struct Shelf {
+        int y;
+        int height;
+        int used;
+    };
+
+    struct wl_compositor *wl_compositor_;
+    struct wl_subcompositor *wl_subcompositor_;
+    struct wp_viewporter *wp_viewporter_;
+    struct wl_surface *parent_;
+    int width_;
+    int height_;
+    uint32_t format_;
+    int32_t stride_;
+    bool sync_;
+
+    int fd_{-1};
+    struct wl_shm_pool *pool_{};
+    void *pool_data_{};
+    size_t pool_size_{};
+    std::vector<Buffer> buffers_;
+    // the buffer the tiles show, the source of what update() does not redraw
+    Buffer *front_{};
+
+    // indexed by tile id; removed tiles leave an empty slot whose rect is reused
+    std::vector<Tile> tiles_;
+    std::vector<Rect> free_rects_;
+    std::vector<Shelf> shelves_;
+    size_t tile_count_{};
+    uint64_t next_version_{};
+
+    [[nodiscard]] bool allocate(int width, int height, Rect &rect);
+
+    [[nodiscard]] Buffer *acquire();
+
+    void copy_tile(const Buffer &from, const Buffer &to, const Rect &rect) const;
+
+    void handle_release(struct wl_buffer *buffer);
+
+    static const struct wl_buffer_listener buffer_listener_;
+};
+
+#endif // SRC_WINDOW_SURFACE_ATLAS_H_
@@ -0,0 +1,235 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "surface_transaction.h"
+
+#include <algorithm>
+
+#include "subsurface.h"
+#include "window_manager/display.h"
+
+/**
+ * @class SurfaceTransaction
+ * @brief Stages attach, damage, offset and position changes for a tree of surfaces.
+ *
+ * Nothing is sent until commit(), which applies the staged state and commits every
+ * surface of the transaction children-first, followed by a single wl_display_flush.
+ * Synchronized subsurfaces thereby land together with their parent's commit, so the
+ * compositor never shows a half-updated tree.
+ *
+ * @code
+ * SurfaceTransaction tx(display);
+ * tx.attach(video, video_buffer)
+ *   .set_position(overlay, 16, 16)
+ *   .attach(overlay, overlay_buffer)
+ *   .commit_surface(toplevel)
+ *   .commit();
+ * @endcode
+ *
+ * @param display The display flushed once per commit(), or nullptr to leave flushing
+ *                to the event loop, as the frame loop does.
+ */
+SurfaceTransaction::SurfaceTransaction(struct wl_display *display) :
+        wl_display_(display) {
+}
+
+/**
+ * @brief Stages attaching buffer to surface.
+ */
+SurfaceTransaction &SurfaceTransaction::attach(struct wl_surface *surface, struct wl_buffer *buffer,
+                                               int32_t x, int32_t y) {
+    auto &e = entry(surface);
+    e.attach = true;
+    e.buffer = buffer;
+    e.x = x;
+    e.y = y;
+    return *this;
+}
+
+/**
+ * @brief Stages damage in surface coordinates.
+ */
+SurfaceTransaction &SurfaceTransaction::damage(struct wl_surface *surface, int32_t x, int32_t y,
+                                               int32_t width, int32_t height) {
+    entry(surface).damage.push_back({x, y, width, height});
+    return *this;
+}
+
+/**
+ * @brief Stages damage in buffer coordinates, the whole surface on surfaces older than wl_surface v4.
+ */
+SurfaceTransaction &SurfaceTransaction::damage_buffer(struct wl_surface *surface, int32_t x, int32_t y,
+                                                      int32_t width, int32_t height) {
+    entry(surface).buffer_damage.push_back({x, y, width, height});
+    return *this;
+}
+
+/**
+ * @brief Stages moving the content by x, y relative to the current one, e.g. a cursor hotspot change.
+ *
+ * Sent as wl_surface.offset on wl_surface v5 and later, so no buffer has to be
+ * attached; older surfaces can only move together with an attach().
+ */
+SurfaceTransaction &SurfaceTransaction::offset(struct wl_surface *surface, int32_t x, int32_t y) {
+    auto &e = entry(surface);
+    e.x = x;
+    e.y = y;
+    return *this;
+}
+
+/**
+ * @brief Stages attaching buffer to a subsurface.
+ */
+SurfaceTransaction &SurfaceTransaction::attach(SubSurface *subsurface, struct wl_buffer *buffer) {
+    entry(subsurface->get_surface(), subsurface);
+    return attach(subsurface->get_surface(), buffer);
+}
+
+/**
+ * @brief Stages damage of a subsurface, in surface coordinates.
+ */
+SurfaceTransaction &SurfaceTransaction::damage(SubSurface *subsurface, int32_t x, int32_t y,
+                                               int32_t width, int32_t height) {
+    entry(subsurface->get_surface(), subsurface);
+    return damage(subsurface->get_surface(), x, y, width, height);
+}
+
+/**
+ * @brief Stages damage of a subsurface, in buffer coordinates.
+ */
+SurfaceTransaction &SurfaceTransaction::damage_buffer(SubSurface *subsurface, int32_t x, int32_t y,
+                                                      int32_t width, int32_t height) {
+    entry(subsurface->get_surface(), subsurface);
+    return damage_buffer(subsurface->get_surface(), x, y, width, height);
+}
+
+/**
+ * @brief Stages a subsurface position; it takes effect with the parent's commit.
+ */
+SurfaceTransaction &SurfaceTransaction::set_position(SubSurface *subsurface, int32_t x, int32_t y) {
+    auto &e = entry(subsurface->get_surface(), subsurface);
+    e.set_position = true;
+    e.position_x = x;
+    e.position_y = y;
+    return *this;
+}
+
+/**
+ * @brief Adds surface to the transaction without staging any change, so it is committed.
+ */
+SurfaceTransaction &SurfaceTransaction::commit_surface(struct wl_surface *surface) {
+    entry(surface);
+    return *this;
+}
+
+/**
+ * @brief Adds a subsurface to the transaction without staging any change.
+ */
+SurfaceTransaction &SurfaceTransaction::commit_surface(SubSurface *subsurface) {
+    entry(subsurface->get_surface(), subsurface);
+    return *this;
+}
+
+/**
+ * @brief Applies and commits the staged state, deepest subsurfaces first.
+ *
+ * The transaction is empty afterwards and can be reused.
+ */
+void SurfaceTransaction::commit() {
+    std::vector<std::pair<int, const Entry *>> order;
+    order.reserve(entries_.size());
+    for (const auto &e: entries_) {
+        order.emplace_back(depth(e), &e);
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const auto &a, const auto &b) { return a.first > b.first; });
+
+    for (const auto &[d, e]: order) {
+        if (e->set_position) {
+            e->subsurface->set_position(e->position_x, e->position_y);
+        }
+        const uint32_t version = wl_surface_get_version(e->surface);
+#if defined(WL_SURFACE_OFFSET_SINCE_VERSION)
+        // from v5 an attach with an offset is a protocol error, the offset is a request of its own
+        if (version >= WL_SURFACE_OFFSET_SINCE_VERSION) {
+            if (e->attach) {
+                wl_surface_attach(e->surface, e->buffer, 0, 0);
+            }
+            if (e->x || e->y) {
+                wl_surface_offset(e->surface, e->x, e->y);
+            }
+        } else
+#endif
+        if (e->attach) {
+            wl_surface_attach(e->surface, e->buffer, e->x, e->y);
+        }
+        for (const auto &rect: e->damage) {
+            wl_surface_damage(e->surface, rect.x, rect.y, rect.width, rect.height);
+        }
+        if (version >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+            for (const auto &rect: e->buffer_damage) {
+                wl_surface_damage_buffer(e->surface, rect.x, rect.y, rect.width, rect.height);
+            }
+        } else if (!e->buffer_damage.empty()) {
+            wl_surface_damage(e->surface, 0, 0, INT32_MAX, INT32_MAX);
+        }
+        wl_surface_commit(e->surface);
+    }
+    entries_.clear();
+
+    if (wl_display_) {
+        Display::flush(wl_display_);
+    }
+}
+
+/**
+ * @brief Returns the entry of surface, adding an empty one if needed.
+ */
+SurfaceTransaction::Entry &SurfaceTransaction::entry(struct wl_surface *surface, SubSurface *subsurface) {
+    for (auto &e: entries_) {
+        if (e.surface == surface) {
+            if (subsurface) {
+                e.subsurface = subsurface;
+            }
+            return e;
+        }
+    }
+    Entry e{};
+    e.surface = surface;
+    e.subsurface = subsurface;
+    return entries_.emplace_back(std::move(e));
+}
+
+/**
+ * @brief Counts the ancestors of entry that are part of the transaction.
+ */
+int SurfaceTransaction::depth(const Entry &entry) const {
+    int result = 0;
+    const auto *current = &entry;
+    // a subsurface tree is acyclic, the bound only guards against misuse
+    while (current->subsurface && result <= static_cast<int>(entries_.size())) {
+        const auto parent = current->subsurface->get_parent();
+        const auto it = std::find_if(entries_.begin(), entries_.end(),
+                                     [parent](const Entry &e) { return e.surface == parent; });
+        if (it == entries_.end()) {
+            break;
+        }
+        current = &*it;
+        result++;
+    }
+    return result;
+}
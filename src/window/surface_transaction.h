@@ -0,0 +1,94 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_SURFACE_TRANSACTION_H_
+#define SRC_WINDOW_SURFACE_TRANSACTION_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "utils/export.h"
+
+class SubSurface;
+
+class WAYPP_EXPORT SurfaceTransaction {
+public:
+    explicit SurfaceTransaction(struct wl_display *display = nullptr);
+
+    SurfaceTransaction &attach(struct wl_surface *surface, struct wl_buffer *buffer, int32_t x = 0, int32_t y = 0);
+
+    SurfaceTransaction &damage(struct wl_surface *surface, int32_t x, int32_t y, int32_t width, int32_t height);
+
+    SurfaceTransaction &damage_buffer(struct wl_surface *surface, int32_t x, int32_t y, int32_t width,
+                                      int32_t height);
+
+    SurfaceTransaction &offset(struct wl_surface *surface, int32_t x, int32_t y);
+
+    SurfaceTransaction &attach(SubSurface *subsurface, struct wl_buffer *buffer);
+
+    SurfaceTransaction &damage(SubSurface *subsurface, int32_t x, int32_t y, int32_t width, int32_t height);
+
+    SurfaceTransaction &damage_buffer(SubSurface *subsurface, int32_t x, int32_t y, int32_t width, int32_t height);
+
+    SurfaceTransaction &set_position(SubSurface *subsurface, int32_t x, int32_t y);
+
+    SurfaceTransaction &commit_surface(struct wl_surface *surface);
+
+    SurfaceTransaction &commit_surface(SubSurface *subsurface);
+
+    [[nodiscard]] bool empty() const { return entries_.empty(); }
+
+    void commit();
+
+    void clear() { entries_.clear(); }
+
+private:
+    struct Rect {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    };
+
+    struct Entry {
+        struct wl_surface *surface;
+        // set for subsurfaces, orders children before their parent
+        SubSurface *subsurface;
+        bool attach;
+        struct wl_buffer *buffer;
+        // offset of the new content from the current one, with attach() or offset()
+        int32_t x;
+        int32_t y;
+        std::vector<Rect> damage;
+        // in buffer coordinates, no conversion by the buffer scale or transform
+        std::vector<Rect> buffer_damage;
+        bool set_position;
+        int32_t position_x;
+        int32_t position_y;
+    };
+
+    struct wl_display *wl_display_;
+    std::vector<Entry> entries_;
+
+    Entry &entry(struct wl_surface *surface, SubSurface *subsurface = nullptr);
+
+    [[nodiscard]] int depth(const Entry &entry) const;
+};
+
+#endif // SRC_WINDOW_SURFACE_TRANSACTION_H_
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "tearing_control.h"
+
+/**
+ * @class TearingControl
+ * @brief Tells the compositor whether a surface's frames may tear.
+ *
+ * With the async hint a fullscreen surface's buffers are flipped as soon as they are
+ * committed instead of at the next vblank, trading tear-free output for up to a frame
+ * of latency. Compositors only honour it where tearing is possible, typically for a
+ * fullscreen surface on a direct scanout plane. The hint is double-buffered state,
+ * applied with the next commit.
+ *
+ * @param manager The wp_tearing_control_manager_v1 global.
+ * @param surface The surface; it may have only one tearing control.
+ */
+TearingControl::TearingControl(struct wp_tearing_control_manager_v1 *manager, struct wl_surface *surface) :
+        wp_tearing_control_(wp_tearing_control_manager_v1_get_tearing_control(manager, surface)) {
+}
+
+TearingControl::~TearingControl() {
+    wp_tearing_control_v1_destroy(wp_tearing_control_);
+}
+
+/**
+ * @brief Sets whether frames are presented at the next vblank or right away.
+ */
+void TearingControl::set_presentation_hint(PresentationHint hint) {
+    if (hint == hint_) {
+        return;
+    }
+    hint_ = hint;
+    wp_tearing_control_v1_set_presentation_hint(wp_tearing_control_, hint == ASYNC
+                                                                     ? WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC
+                                                                     : WP_TEARING_CONTROL_V1_PRESENTATION_HINT_VSYNC);
+}
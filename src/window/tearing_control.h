@@ -0,0 +1,52 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_TEARING_CONTROL_H_
+#define SRC_WINDOW_TEARING_CONTROL_H_
+
+#include <wayland-client.h>
+
+#if defined(ENABLE_TEARING_CONTROL)
+#include "tearing-control-v1-client-protocol.h"
+#endif
+#include "utils/export.h"
+
+class WAYPP_EXPORT TearingControl {
+public:
+    typedef enum {
+        VSYNC,
+        ASYNC,
+    } PresentationHint;
+
+    explicit TearingControl(struct wp_tearing_control_manager_v1 *manager, struct wl_surface *surface);
+
+    ~TearingControl();
+
+    TearingControl(const TearingControl &) = delete;
+
+    TearingControl &operator=(const TearingControl &) = delete;
+
+    void set_presentation_hint(PresentationHint hint);
+
+    [[nodiscard]] PresentationHint get_presentation_hint() const { return hint_; }
+
+private:
+    struct wp_tearing_control_v1 *wp_tearing_control_;
+    PresentationHint hint_{VSYNC};
+};
+
+#endif // SRC_WINDOW_TEARING_CONTROL_H_
@@ -0,0 +1,309 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "video_surface.h"
+
+#include <algorithm>
+#include <ctime>
+#include <stdexcept>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <glib-2.0/glib-unix.h>
+
+#include "subsurface.h"
+#include "window_manager/display.h"
+#include "utils/listener.h"
+
+/**
+ * @class VideoSurface
+ * @brief Paced presentation of decoded dmabuf frames on a desynchronized subsurface.
+ *
+ * Decoder output is imported through linux-dmabuf once per buffer of the
+ * decoder's pool and attached directly, so frames never pass through GL.
+ * Queued frames wait for their presentation time: half a refresh before each
+ * vblank, predicted from the presentation feedback of earlier commits, the
+ * surface commits the latest frame due by that vblank and drops the ones it
+ * superseded. A frame on screen is released once the compositor lets go of
+ * its buffer.
+ *
+ * Until the first feedback arrives, frames are committed as their time
+ * passes. The pacing timer runs on the display's GMainContext; the subsurface
+ * must outlive the VideoSurface.
+ */
+VideoSurface::VideoSurface(const Display *display, SubSurface *subsurface) :
+        display_(display), subsurface_(subsurface), clock_id_(display->get_presentation_clock()) {
+    subsurface_->set_sync(false);
+    dmabuf_ = subsurface_->create_dmabuf_window(display);
+    dmabuf_->set_release_callback([this](struct wl_buffer *buffer) { handle_release(buffer); });
+
+    timer_fd_ = timerfd_create(clock_id_, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer_fd_ < 0) {
+        throw std::runtime_error("timerfd_create failed.");
+    }
+    timer_source_ = g_unix_fd_source_new(timer_fd_, G_IO_IN);
+    GUnixFDSourceFunc callback = [](gint fd, GIOCondition /* condition */, gpointer data) -> gboolean {
+        uint64_t expirations;
+        (void) !read(fd, &expirations, sizeof(expirations));
+        static_cast<VideoSurface *>(data)->tick();
+        return G_SOURCE_CONTINUE;
+    };
+    g_source_set_callback(timer_source_, G_SOURCE_FUNC(callback), this, nullptr);
+    g_source_set_name(timer_source_, "waypp video pacing");
+    g_source_attach(timer_source_, display->get_context());
+}
+
+VideoSurface::~VideoSurface() {
+    flush();
+    g_source_destroy(timer_source_);
+    g_source_unref(timer_source_);
+    close(timer_fd_);
+    for (const auto &pending: feedback_) {
+        wp_presentation_feedback_destroy(pending.feedback);
+    }
+    dmabuf_->set_release_callback(nullptr);
+    for (const auto &[fd, imported]: imports_) {
+        dmabuf_->destroy_buffer(imported.buffer);
+    }
+#if defined(ENABLE_COLOR_MANAGEMENT)
+    color_surface_.reset();
+#endif
+}
+
+/**
+ * @brief Queues a decoded frame for presentation at frame.pts_ns.
+ *
+ * Frames may arrive out of order; a frame already late when its vblank comes
+ * is dropped and released.
+ *
+ * @return false if the compositor cannot import the dmabuf; the frame is not taken.
+ */
+bool VideoSurface::queue(const VideoFrame &frame) {
+    auto buffer = import(frame.attributes);
+    if (!buffer) {
+        if (frame.acquire_fence >= 0) {
+            close(frame.acquire_fence);
+        }
+        return false;
+    }
+    auto it = std::find_if(queue_.begin(), queue_.end(),
+                           [&](const Pending &pending) { return pending.pts_ns > frame.pts_ns; });
+    queue_.insert(it, {buffer, frame.pts_ns, frame.id, frame.acquire_fence});
+    if (!ticking_) {
+        tick();
+    }
+    return true;
+}
+
+/**
+ * @brief Drops every queued frame, e.g. on a seek; the frame on screen stays.
+ */
+void VideoSurface::flush() {
+    auto frames = std::move(queue_);
+    queue_.clear();
+    for (const auto &frame: frames) {
+        drop(frame);
+    }
+    arm(0);
+}
+
+/**
+ * @brief Destroys the imported buffers, after the decoder replaced its buffer pool.
+ *
+ * Queued frames are dropped first.
+ */
+void VideoSurface::forget_buffers() {
+    flush();
+    for (const auto &[fd, imported]: imports_) {
+        dmabuf_->destroy_buffer(imported.buffer);
+    }
+    imports_.clear();
+    on_screen_.clear();
+}
+
+/**
+ * @brief Describes the decoder's output, e.g. BT.2020 PQ for HDR10, for the compositor to map.
+ *
+ * Frames go to the compositor as decoded instead of through a tone mapping pass; see
+ * Window::set_color_description(). The description applies from the first frame presented
+ * after the compositor accepted it. Call it again when the stream's metadata changes.
+ *
+ * @param description The color space of the frames.
+ * @return false if the compositor cannot convert from it, or color management is not built in.
+ */
+bool VideoSurface::set_color_description(const ColorDescription &description) {
+#if defined(ENABLE_COLOR_MANAGEMENT)
+    const auto manager = display_->get_color_manager();
+    if (!manager) {
+        return false;
+    }
+    if (!color_surface_) {
+        color_surface_ = std::make_unique<ColorSurface>(manager, subsurface_->get_surface());
+    }
+    return color_surface_->set_description(description);
+#else
+    (void) description;
+    return false;
+#endif
+}
+
+uint64_t VideoSurface::now_ns() const {
+    struct timespec ts{};
+    clock_gettime(clock_id_, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+struct wl_buffer *VideoSurface::import(const DmabufAttributes &attributes) {
+    auto it = imports_.find(attributes.fd[0]);
+    if (it != imports_.end()) {
+        const auto &known = it->second.attributes;
+        if (known.width == attributes.width && known.height == attributes.height &&
+            known.format == attributes.format && known.modifier == attributes.modifier &&
+            known.offset[0] == attributes.offset[0]) {
+            return it->second.buffer;
+        }
+        // the fd number was reused for another allocation
+        dmabuf_->destroy_buffer(it->second.buffer);
+        on_screen_.erase(it->second.buffer);
+        imports_.erase(it);
+    }
+    auto buffer = dmabuf_->import(attributes);
+    if (buffer) {
+        imports_[attributes.fd[0]] = {buffer, attributes};
+    }
+    return buffer;
+}
+
+/**
+ * @brief Commits the frame due by the coming vblank and sets the timer for the next one.
+ */
+void VideoSurface::tick() {
+    const uint64_t now = now_ns();
+    const uint64_t period = clock_.get_period_ns();
+    const uint64_t vblank = clock_.next_vblank_ns(now);
+
+    // frames due by the deadline compete for one vblank, the latest wins
+    const uint64_t deadline = period && vblank ? vblank + period / 2 : now;
+    while (queue_.size() > 1 && queue_[1].pts_ns <= deadline) {
+        drop(queue_.front());
+        queue_.pop_front();
+    }
+    if (!queue_.empty() && queue_.front().pts_ns <= deadline) {
+        present(queue_.front());
+        queue_.pop_front();
+    }
+
+    if (queue_.empty()) {
+        arm(0);
+        return;
+    }
+    const uint64_t pts = queue_.front().pts_ns;
+    if (period && vblank) {
+        // half a refresh before the vblank nearest to the next frame, never before the next vblank's
+        arm(std::max(vblank + period / 2, pts > period ? pts - period : 0));
+    } else {
+        arm(pts);
+    }
+}
+
+void VideoSurface::arm(uint64_t time_ns) {
+    ticking_ = time_ns != 0;
+    struct itimerspec spec{};
+    if (time_ns) {
+        spec.it_value.tv_sec = static_cast<time_t>(time_ns / 1000000000ULL);
+        spec.it_value.tv_nsec = static_cast<long>(time_ns % 1000000000ULL);
+        if (!spec.it_value.tv_sec && !spec.it_value.tv_nsec) {
+            spec.it_value.tv_nsec = 1;
+        }
+    }
+    timerfd_settime(timer_fd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+
+void VideoSurface::drop(const Pending &frame) {
+    if (frame.acquire_fence >= 0) {
+        close(frame.acquire_fence);
+    }
+    dropped_count_++;
+    if (release_callback_) {
+        release_callback_(frame.id);
+    }
+}
+
+void VideoSurface::present(const Pending &frame) {
+    dmabuf_->attach(frame.buffer, frame.acquire_fence);
+    on_screen_[frame.buffer] = frame.id;
+    if (auto presentation = display_->get_presentation()) {
+        auto feedback = wp_presentation_feedback(presentation, subsurface_->get_surface());
+        wp_presentation_feedback_add_listener(feedback, &feedback_listener_, this);
+        feedback_.push_back({feedback, frame.id, frame.pts_ns});
+    }
+    subsurface_->commit();
+}
+
+void VideoSurface::handle_release(struct wl_buffer *buffer) {
+    auto it = on_screen_.find(buffer);
+    if (it == on_screen_.end()) {
+        return;
+    }
+    auto id = it->second;
+    on_screen_.erase(it);
+    if (release_callback_) {
+        release_callback_(id);
+    }
+}
+
+void VideoSurface::complete_feedback(struct wp_presentation_feedback *feedback, bool presented, uint64_t time_ns) {
+    auto it = std::find_if(feedback_.begin(), feedback_.end(),
+                           [feedback](const Feedback &pending) { return pending.feedback == feedback; });
+    if (it != feedback_.end()) {
+        auto done = *it;
+        feedback_.erase(it);
+        if (presented) {
+            presented_count_++;
+            if (presented_callback_) {
+                presented_callback_(done.id, done.pts_ns, time_ns);
+            }
+        } else {
+            dropped_count_++;
+        }
+    }
+    wp_presentation_feedback_destroy(feedback);
+}
+
+void VideoSurface::handle_sync_output(struct wp_presentation_feedback * /* feedback */,
+                                      struct wl_output * /* output */) {
+}
+
+void VideoSurface::handle_presented(struct wp_presentation_feedback *feedback, uint32_t tv_sec_hi,
+                                    uint32_t tv_sec_lo, uint32_t tv_nsec, uint32_t refresh, uint32_t seq_hi,
+                                    uint32_t seq_lo, uint32_t /* flags */) {
+    const uint64_t tv_sec = (static_cast<uint64_t>(tv_sec_hi) << 32) | tv_sec_lo;
+    const uint64_t time_ns = tv_sec * 1000000000ULL + tv_nsec;
+    clock_.record_presentation(time_ns, refresh, (static_cast<uint64_t>(seq_hi) << 32) | seq_lo);
+    complete_feedback(feedback, true, time_ns);
+}
+
+void VideoSurface::handle_discarded(struct wp_presentation_feedback *feedback) {
+    complete_feedback(feedback, false, 0);
+}
+
+const struct wp_presentation_feedback_listener VideoSurface::feedback_listener_ = {
+        .sync_output = listener_thunk<&VideoSurface::handle_sync_output>,
+        .presented = listener_thunk<&VideoSurface::handle_presented>,
+        .discarded = listener_thunk<&VideoSurface::handle_discarded>,
+};
@@ -0,0 +1,158 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_VIDEO_SURFACE_H_
+#define SRC_WINDOW_VIDEO_SURFACE_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <wayland-client.h>
+#include <glib-2.0/glib.h>
+
+#include "presentation-time-client-protocol.h"
+
+#include "color_management.h"
+#include "frame_clock.h"
+#include "window_dmabuf.h"
+#include "utils/export.h"
+
+class Display;
+
+class SubSurface;
+
+struct VideoFrame {
+    // a decoded picture, e.g. a VA-API surface or V4L2 capture buffer exported as dmabuf
+    DmabufAttributes attributes;
+    // when the frame should be on screen, in the Display::get_presentation_clock() domain
+    uint64_t pts_ns;
+    // the caller's handle, passed back once the frame may be reused
+    uint64_t id;
+    // sync_file the decoder signals when the picture is written, -1 if it already is; taken by queue()
+    int acquire_fence;
+};
+
+class WAYPP_EXPORT VideoSurface {
+public:
+    explicit VideoSurface(const Display *display, SubSurface *subsurface);
+
+    ~VideoSurface();
+
+    VideoSurface(const VideoSurface &) = delete;
+
+    VideoSurface &operator=(const VideoSurface &) = delete;
+
+    bool queue(const VideoFrame &frame);
+
+    void flush();
+
+    void forget_buffers();
+
+    bool set_color_description(const ColorDescription &description);
+
+    // a frame was dropped or replaced on screen; the decoder may write to it again
+    void set_release_callback(const std::function<void(uint64_t id)> &callback) { release_callback_ = callback; }
+
+    // a frame reached the screen, at time_ns; against pts_ns this gives the A/V offset
+    void set_presented_callback(const std::function<void(uint64_t id, uint64_t pts_ns, uint64_t time_ns)> &callback) {
+        presented_callback_ = callback;
+    }
+
+    [[nodiscard]] SubSurface *get_subsurface() const { return subsurface_; }
+
+    [[nodiscard]] size_t get_queued() const { return queue_.size(); }
+
+    [[nodiscard]] uint64_t get_presented_count() const { return presented_count_; }
+
+    [[nodiscard]] uint64_t get_dropped_count() const { return dropped_count_; }
+
+private:
+    struct Pending {
+        struct wl_buffer *buffer;
+        uint64_t pts_ns;
+        uint64_t id;
+        int acquire_fence;
+    };
+
+    struct Imported {
+        struct wl_buffer *buffer;
+        DmabufAttributes attributes;
+    };
+
+    struct Feedback {
+        struct wp_presentation_feedback *feedback;
+        uint64_t id;
+        uint64_t pts_ns;
+    };
+
+    const Display *display_;
+    SubSurface *subsurface_;
+    WindowDmabuf *dmabuf_;
+    clockid_t clock_id_;
+    FrameClock clock_;
+#if defined(ENABLE_COLOR_MANAGEMENT)
+    // created with the first set_color_description()
+    std::unique_ptr<ColorSurface> color_surface_;
+#endif
+
+    // imports by the first plane's fd, decoders cycle through a fixed pool
+    std::map<int, Imported> imports_;
+    std::deque<Pending> queue_;
+    // the frame each attached buffer shows, until the compositor releases it
+    std::map<struct wl_buffer *, uint64_t> on_screen_;
+    std::vector<Feedback> feedback_;
+
+    int timer_fd_{-1};
+    GSource *timer_source_{};
+    bool ticking_{};
+
+    uint64_t presented_count_{};
+    uint64_t dropped_count_{};
+    std::function<void(uint64_t id)> release_callback_;
+    std::function<void(uint64_t id, uint64_t pts_ns, uint64_t time_ns)> presented_callback_;
+
+    [[nodiscard]] uint64_t now_ns() const;
+
+    struct wl_buffer *import(const DmabufAttributes &attributes);
+
+    void tick();
+
+    void arm(uint64_t time_ns);
+
+    void drop(const Pending &frame);
+
+    void present(const Pending &frame);
+
+    void handle_release(struct wl_buffer *buffer);
+
+    void complete_feedback(struct wp_presentation_feedback *feedback, bool presented, uint64_t time_ns);
+
+    void handle_sync_output(struct wp_presentation_feedback *feedback, struct wl_output *output);
+
+    void handle_presented(struct wp_presentation_feedback *feedback, uint32_t tv_sec_hi, uint32_t tv_sec_lo,
+                          uint32_t tv_nsec, uint32_t refresh, uint32_t seq_hi, uint32_t seq_lo, uint32_t flags);
+
+    void handle_discarded(struct wp_presentation_feedback *feedback);
+
+    static const struct wp_presentation_feedback_listener feedback_listener_;
+};
+
+#endif // SRC_WINDOW_VIDEO_SURFACE_H_
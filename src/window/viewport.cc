@@ -0,0 +1,80 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "viewport.h"
+
+/**
+ * @class Viewport
+ * @brief Crops and scales a surface's buffer with wp_viewport.
+ *
+ * Lets a window render into a buffer of a different size than the surface: the
+ * compositor, often a hardware plane, scales the source rectangle of the buffer to the
+ * destination size. Like all surface state, changes apply with the next commit.
+ *
+ * @param viewporter The wp_viewporter global.
+ * @param surface    The surface; it may have only one viewport.
+ */
+Viewport::Viewport(struct wp_viewporter *viewporter, struct wl_surface *surface) :
+        wp_viewport_(wp_viewporter_get_viewport(viewporter, surface)) {
+}
+
+Viewport::~Viewport() {
+    wp_viewport_destroy(wp_viewport_);
+}
+
+/**
+ * @brief Sets the buffer region shown, in surface-local buffer coordinates.
+ */
+void Viewport::set_source(double x, double y, double width, double height) {
+    if (x == source_.x && y == source_.y && width == source_.width && height == source_.height) {
+        return;
+    }
+    source_ = {x, y, width, height};
+    wp_viewport_set_source(wp_viewport_, wl_fixed_from_double(x), wl_fixed_from_double(y),
+                           wl_fixed_from_double(width), wl_fixed_from_double(height));
+}
+
+/**
+ * @brief Shows the whole buffer again.
+ */
+void Viewport::clear_source() {
+    if (source_.width == -1) {
+        return;
+    }
+    source_ = {-1, -1, -1, -1};
+    const auto unset = wl_fixed_from_int(-1);
+    wp_viewport_set_source(wp_viewport_, unset, unset, unset, unset);
+}
+
+/**
+ * @brief Sets the surface size the source region is scaled to.
+ */
+void Viewport::set_destination(int width, int height) {
+    if (width == destination_width_ && height == destination_height_) {
+        return;
+    }
+    destination_width_ = width;
+    destination_height_ = height;
+    wp_viewport_set_destination(wp_viewport_, width, height);
+}
+
+/**
+ * @brief Makes the surface size follow the buffer size again.
+ */
+void Viewport::clear_destination() {
+    set_destination(-1, -1);
+}
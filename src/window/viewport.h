@@ -0,0 +1,54 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_VIEWPORT_H_
+#define SRC_WINDOW_VIEWPORT_H_
+
+#include <wayland-client.h>
+
+#include "viewporter-client-protocol.h"
+#include "utils/export.h"
+
+class WAYPP_EXPORT Viewport {
+public:
+    explicit Viewport(struct wp_viewporter *viewporter, struct wl_surface *surface);
+
+    ~Viewport();
+
+    Viewport(const Viewport &) = delete;
+
+    Viewport &operator=(const Viewport &) = delete;
+
+    void set_source(double x, double y, double width, double height);
+
+    void clear_source();
+
+    void set_destination(int width, int height);
+
+    void clear_destination();
+
+private:
+    struct wp_viewport *wp_viewport_;
+    // last values sent, so unchanged state is not resent every frame
+    struct {
+        double x, y, width, height;
+    } source_{-1, -1, -1, -1};
+    int destination_width_{-1};
+    int destination_height_{-1};
+};
+
+#endif // SRC_WINDOW_VIEWPORT_H_
@@ -0,0 +1,493 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "vulkan_dmabuf.h"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "utils/logging.h"
+
+namespace {
+void check(VkResult result, const char *what) {
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error(std::string(what) + " failed: " + std::to_string(result));
+    }
+}
+
+constexpr uint32_t fourcc(char a, char b, char c, char d) {
+    return static_cast<uint32_t>(a) | static_cast<uint32_t>(b) << 8 | static_cast<uint32_t>(c) << 16 |
+           static_cast<uint32_t>(d) << 24;
+}
+
+template<typename T>
+T get_device_proc(VkDevice device, const char *name) {
+    return reinterpret_cast<T>(vkGetDeviceProcAddr(device, name));
+}
+}
+
+/**
+ * @class VulkanDmabuf
+ * @brief Allocates Vulkan images that other APIs and the compositor can use as dmabufs.
+ *
+ * Images are created with VK_EXT_image_drm_format_modifier from a modifier list the
+ * caller negotiates, e.g. the intersection of get_modifiers() with
+ * EglDmabufImage::get_modifiers() or a dmabuf feedback tranche, and exported with
+ * VK_EXT_external_memory_dma_buf. The attributes can be attached straight to a surface
+ * with WindowDmabuf::import(), or sampled by GL through EglDmabufImage.
+ *
+ * Synchronization is explicit and uses sync_file fds in both directions: a semaphore
+ * signaled by the render submit is exported as the consumer's acquire fence, and the
+ * consumer's release fence is imported into a semaphore the next submit waits on.
+ *
+ * @param vulkan The device, which has to have been created with has_dmabuf_interop().
+ */
+VulkanDmabuf::VulkanDmabuf(const WindowVulkan *vulkan) :
+        vulkan_(vulkan),
+        device_(vulkan->get_device()) {
+    if (!vulkan_->has_dmabuf_interop()) {
+        throw std::runtime_error("The Vulkan device does not support dmabuf interop");
+    }
+    pfGetMemoryFd_ = get_device_proc<PFN_vkGetMemoryFdKHR>(device_, "vkGetMemoryFdKHR");
+    pfGetSemaphoreFd_ = get_device_proc<PFN_vkGetSemaphoreFdKHR>(device_, "vkGetSemaphoreFdKHR");
+    pfImportSemaphoreFd_ = get_device_proc<PFN_vkImportSemaphoreFdKHR>(device_, "vkImportSemaphoreFdKHR");
+    pfGetImageDrmFormatModifierProperties_ = get_device_proc<PFN_vkGetImageDrmFormatModifierPropertiesEXT>(
+            device_, "vkGetImageDrmFormatModifierPropertiesEXT");
+    if (!pfGetMemoryFd_ || !pfGetSemaphoreFd_ || !pfImportSemaphoreFd_ || !pfGetImageDrmFormatModifierProperties_) {
+        throw std::runtime_error("Failed to load the Vulkan dmabuf interop entry points");
+    }
+}
+
+VulkanDmabuf::Image::~Image() {
+    for (uint32_t i = 0; i < attributes_.num_planes; i++) {
+        if (attributes_.fd[i] >= 0) {
+            close(attributes_.fd[i]);
+        }
+    }
+    if (memory_) {
+        vkFreeMemory(device_, memory_, nullptr);
+    }
+    if (image_) {
+        vkDestroyImage(device_, image_, nullptr);
+    }
+}
+
+/**
+ * @brief Maps a DRM fourcc format to the Vulkan format with the same memory layout.
+ *
+ * The X variants map to the alpha format, the padding channel is rendered and ignored.
+ *
+ * @return The format, VK_FORMAT_UNDEFINED if there is no equivalent.
+ */
+VkFormat VulkanDmabuf::to_vk_format(uint32_t drm_format) {
+    switch (drm_format) {
+        case fourcc('A', 'R', '2', '4'):
+        case fourcc('X', 'R', '2', '4'):
+            return VK_FORMAT_B8G8R8A8_UNORM;
+        case fourcc('A', 'B', '2', '4'):
+        case fourcc('X', 'B', '2', '4'):
+            return VK_FORMAT_R8G8B8A8_UNORM;
+        case fourcc('A', 'R', '3', '0'):
+        case fourcc('X', 'R', '3', '0'):
+            return VK_FORMAT_A2R10G10B10_UNORM_PACK32;
+        case fourcc('A', 'B', '3', '0'):
+        case fourcc('X', 'B', '3', '0'):
+            return VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+        case fourcc('A', 'B', '4', 'H'):
+        case fourcc('X', 'B', '4', 'H'):
+            return VK_FORMAT_R16G16B16A16_SFLOAT;
+        default:
+            return VK_FORMAT_UNDEFINED;
+    }
+}
+
+/**
+ * @brief Lists the modifiers images of a format can be allocated and exported with.
+ *
+ * @param drm_format The DRM fourcc format.
+ * @param usage      The usage the images are allocated with.
+ * @return The modifiers in driver order, empty if the format has no Vulkan equivalent.
+ */
+std::vector<uint64_t> VulkanDmabuf::get_modifiers(uint32_t drm_format, VkImageUsageFlags usage) const {
+    std::vector<uint64_t> result;
+    const auto format = to_vk_format(drm_format);
+    if (format == VK_FORMAT_UNDEFINED) {
+        return result;
+    }
+    for (const auto &modifier: query_modifiers(format, usage)) {
+        result.push_back(modifier.modifier);
+    }
+    return result;
+}
+
+/**
+ * @brief Allocates an exportable image.
+ *
+ * The driver picks the layout among the given modifiers. Each image gets a dedicated
+ * allocation, as drivers commonly require for exported memory.
+ *
+ * @param width      The width in pixels.
+ * @param height     The height in pixels.
+ * @param drm_format The DRM fourcc format.
+ * @param modifiers  The modifiers the consumer accepts; ones the device cannot export are skipped.
+ * @param usage      The Vulkan usage of the image.
+ * @return The image, nullptr if no modifier is shared or the allocation failed.
+ */
+std::unique_ptr<VulkanDmabuf::Image> VulkanDmabuf::allocate(int32_t width, int32_t height, uint32_t drm_format,
+                                                            const std::vector<uint64_t> &modifiers,
+                                                            VkImageUsageFlags usage) const {
+    const auto format = to_vk_format(drm_format);
+    if (format == VK_FORMAT_UNDEFINED) {
+        LOG_ERROR("DRM format 0x%08x has no Vulkan equivalent", drm_format);
+        return nullptr;
+    }
+    const auto supported = query_modifiers(format, usage);
+    std::vector<uint64_t> candidates;
+    for (const auto modifier: modifiers) {
+        if (std::any_of(supported.begin(), supported.end(),
+                        [modifier](const Modifier &entry) { return entry.modifier == modifier; })) {
+            candidates.push_back(modifier);
+        }
+    }
+    if (candidates.empty()) {
+        LOG_WARN("No exportable Vulkan modifier for DRM format 0x%08x is accepted by the consumer", drm_format);
+        return nullptr;
+    }
+
+    std::unique_ptr<Image> image(new Image(device_));
+    std::fill(std::begin(image->attributes_.fd), std::end(image->attributes_.fd), -1);
+
+    VkImageDrmFormatModifierListCreateInfoEXT modifier_list{};
+    modifier_list.sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_LIST_CREATE_INFO_EXT;
+    modifier_list.drmFormatModifierCount = static_cast<uint32_t>(candidates.size());
+    modifier_list.pDrmFormatModifiers = candidates.data();
+    VkExternalMemoryImageCreateInfo external_info{};
+    external_info.sType = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_IMAGE_CREATE_INFO;
+    external_info.pNext = &modifier_list;
+    external_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT;
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.pNext = &external_info;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = format;
+    image_info.extent = {static_cast<uint32_t>(width), static_cast<uint32_t>(height), 1};
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT;
+    image_info.usage = usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    if (const auto result = vkCreateImage(device_, &image_info, nullptr, &image->image_); result != VK_SUCCESS) {
+        LOG_ERROR("vkCreateImage failed for a %dx%d dmabuf: %d", width, height, result);
+        return nullptr;
+    }
+    image->format_ = format;
+    image->extent_ = {static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+
+    VkMemoryRequirements requirements{};
+    vkGetImageMemoryRequirements(device_, image->image_, &requirements);
+    uint32_t memory_type = 0;
+    if (!find_memory_type(requirements.memoryTypeBits, &memory_type)) {
+        LOG_ERROR("No memory type can back the dmabuf image");
+        return nullptr;
+    }
+    VkMemoryDedicatedAllocateInfo dedicated_info{};
+    dedicated_info.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+    dedicated_info.image = image->image_;
+    VkExportMemoryAllocateInfo export_info{};
+    export_info.sType = VK_STRUCTURE_TYPE_EXPORT_MEMORY_ALLOCATE_INFO;
+    export_info.pNext = &dedicated_info;
+    export_info.handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT;
+    VkMemoryAllocateInfo allocate_info{};
+    allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocate_info.pNext = &export_info;
+    allocate_info.allocationSize = requirements.size;
+    allocate_info.memoryTypeIndex = memory_type;
+    if (const auto result = vkAllocateMemory(device_, &allocate_info, nullptr, &image->memory_);
+            result != VK_SUCCESS) {
+        LOG_ERROR("vkAllocateMemory failed for the dmabuf image: %d", result);
+        return nullptr;
+    }
+    if (const auto result = vkBindImageMemory(device_, image->image_, image->memory_, 0); result != VK_SUCCESS) {
+        LOG_ERROR("vkBindImageMemory failed for the dmabuf image: %d", result);
+        return nullptr;
+    }
+
+    VkImageDrmFormatModifierPropertiesEXT chosen{};
+    chosen.sType = VK_STRUCTURE_TYPE_IMAGE_DRM_FORMAT_MODIFIER_PROPERTIES_EXT;
+    if (const auto result = pfGetImageDrmFormatModifierProperties_(device_, image->image_, &chosen);
+            result != VK_SUCCESS) {
+        LOG_ERROR("vkGetImageDrmFormatModifierPropertiesEXT failed: %d", result);
+        return nullptr;
+    }
+    const auto entry = std::find_if(supported.begin(), supported.end(), [&chosen](const Modifier &modifier) {
+        return modifier.modifier == chosen.drmFormatModifier;
+    });
+    if (entry == supported.end()) {
+        LOG_ERROR("The driver chose modifier 0x%016llx outside the list",
+                  static_cast<unsigned long long>(chosen.drmFormatModifier));
+        return nullptr;
+    }
+
+    VkMemoryGetFdInfoKHR fd_info{};
+    fd_info.sType = VK_STRUCTURE_TYPE_MEMORY_GET_FD_INFO_KHR;
+    fd_info.memory = image->memory_;
+    fd_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT;
+    int fd = -1;
+    if (const auto result = pfGetMemoryFd_(device_, &fd_info, &fd); result != VK_SUCCESS) {
+        LOG_ERROR("vkGetMemoryFdKHR failed: %d", result);
+        return nullptr;
+    }
+
+    auto &attributes = image->attributes_;
+    attributes.width = width;
+    attributes.height = height;
+    attributes.format = drm_format;
+    attributes.modifier = chosen.drmFormatModifier;
+    attributes.flags = 0;
+    attributes.num_planes = entry->planes;
+    for (uint32_t i = 0; i < entry->planes; i++) {
+        // memory planes of a modifier, not format planes; all of them live in the one allocation
+        VkImageSubresource subresource{};
+        subresource.aspectMask = VK_IMAGE_ASPECT_MEMORY_PLANE_0_BIT_EXT << i;
+        VkSubresourceLayout layout{};
+        vkGetImageSubresourceLayout(device_, image->image_, &subresource, &layout);
+        attributes.offset[i] = static_cast<uint32_t>(layout.offset);
+        attributes.stride[i] = static_cast<uint32_t>(layout.rowPitch);
+        // every plane gets its own fd so each one can be closed independently
+        attributes.fd[i] = i == 0 ? fd : fcntl(fd, F_DUPFD_CLOEXEC, 0);
+        if (attributes.fd[i] < 0) {
+            LOG_ERROR("Failed to duplicate the dmabuf fd");
+            return nullptr;
+        }
+    }
+    return image;
+}
+
+/**
+ * @brief Records the acquire of an image from the consumer, before rendering into it.
+ *
+ * Submit it waiting on the consumer's release fence, see import_sync_file(). The first
+ * acquire of an image discards its undefined contents instead.
+ *
+ * @param command_buffer The command buffer, before the commands that use the image.
+ * @param image          The image.
+ * @param layout         The layout the commands use the image in.
+ */
+void VulkanDmabuf::record_acquire(VkCommandBuffer command_buffer, Image &image, VkImageLayout layout) const {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    barrier.newLayout = layout;
+    if (image.released_) {
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = vulkan_->get_foreign_queue_family();
+        barrier.dstQueueFamilyIndex = vulkan_->get_queue_family();
+    } else {
+        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    }
+    barrier.image = image.image_;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+/**
+ * @brief Records the release of an image to the consumer, after rendering into it.
+ *
+ * Moves the image to the layout and queue family external consumers expect. Submit it
+ * signaling a semaphore from create_semaphore() and hand the consumer export_sync_file().
+ *
+ * @param command_buffer The command buffer, after the commands that use the image.
+ * @param image          The image.
+ * @param layout         The layout the commands left the image in.
+ */
+void VulkanDmabuf::record_release(VkCommandBuffer command_buffer, Image &image, VkImageLayout layout) const {
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+    barrier.oldLayout = layout;
+    barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+    barrier.srcQueueFamilyIndex = vulkan_->get_queue_family();
+    barrier.dstQueueFamilyIndex = vulkan_->get_foreign_queue_family();
+    barrier.image = image.image_;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+                         0, nullptr, 0, nullptr, 1, &barrier);
+    image.released_ = true;
+}
+
+/**
+ * @brief Creates a binary semaphore that can be exported to and imported from a sync_file.
+ *
+ * @return The semaphore, destroyed by the caller with vkDestroySemaphore().
+ */
+VkSemaphore VulkanDmabuf::create_semaphore() const {
+    VkExportSemaphoreCreateInfo export_info{};
+    export_info.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO;
+    export_info.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &export_info;
+    VkSemaphore semaphore{};
+    check(vkCreateSemaphore(device_, &semaphore_info, nullptr, &semaphore), "vkCreateSemaphore");
+    return semaphore;
+}
+
+/**
+ * @brief Exports the pending signal of a semaphore as a sync_file.
+ *
+ * Call it after the submit that signals the semaphore. The export consumes the signal,
+ * the semaphore can be signaled again by the next submit. Pass the fd as the acquire
+ * fence of WindowDmabuf::attach() or to Egl::wait_native_fence().
+ *
+ * @param semaphore A semaphore from create_semaphore().
+ * @return A sync_file fd owned by the caller, or -1 on failure.
+ */
+int VulkanDmabuf::export_sync_file(VkSemaphore semaphore) const {
+    VkSemaphoreGetFdInfoKHR fd_info{};
+    fd_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR;
+    fd_info.semaphore = semaphore;
+    fd_info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+    int fd = -1;
+    if (const auto result = pfGetSemaphoreFd_(device_, &fd_info, &fd); result != VK_SUCCESS) {
+        LOG_ERROR("vkGetSemaphoreFdKHR failed: %d", result);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * @brief Makes the next wait on a semaphore wait for a sync_file, e.g. a release fence.
+ *
+ * The import is temporary: once a submit has waited on it the semaphore reverts to its
+ * own payload. Sources are WindowDmabuf::get_release_fence() and Egl::create_native_fence().
+ *
+ * @param semaphore A semaphore from create_semaphore().
+ * @param fd        A sync_file fd, always consumed.
+ * @return false if the fence could not be imported.
+ */
+bool VulkanDmabuf::import_sync_file(VkSemaphore semaphore, int fd) const {
+    if (fd < 0) {
+        return false;
+    }
+    VkImportSemaphoreFdInfoKHR import_info{};
+    import_info.sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR;
+    import_info.semaphore = semaphore;
+    import_info.flags = VK_SEMAPHORE_IMPORT_TEMPORARY_BIT;
+    import_info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT;
+    import_info.fd = fd;
+    if (const auto result = pfImportSemaphoreFd_(device_, &import_info); result != VK_SUCCESS) {
+        // Vulkan only takes ownership of the fd on success
+        close(fd);
+        LOG_ERROR("vkImportSemaphoreFdKHR failed: %d", result);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Queries the modifiers of a format the device can render with and export.
+ */
+std::vector<VulkanDmabuf::Modifier> VulkanDmabuf::query_modifiers(VkFormat format, VkImageUsageFlags usage) const {
+    const auto physical_device = vulkan_->get_physical_device();
+    VkDrmFormatModifierPropertiesListEXT list{};
+    list.sType = VK_STRUCTURE_TYPE_DRM_FORMAT_MODIFIER_PROPERTIES_LIST_EXT;
+    VkFormatProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_FORMAT_PROPERTIES_2;
+    properties.pNext = &list;
+    vkGetPhysicalDeviceFormatProperties2(physical_device, format, &properties);
+    std::vector<VkDrmFormatModifierPropertiesEXT> entries(list.drmFormatModifierCount);
+    list.pDrmFormatModifierProperties = entries.data();
+    vkGetPhysicalDeviceFormatProperties2(physical_device, format, &properties);
+    entries.resize(list.drmFormatModifierCount);
+
+    VkFormatFeatureFlags required = 0;
+    if (usage & VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) {
+        required |= VK_FORMAT_FEATURE_COLOR_ATTACHMENT_BIT;
+    }
+    if (usage & VK_IMAGE_USAGE_SAMPLED_BIT) {
+        required |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+    }
+
+    std::vector<Modifier> result;
+    for (const auto &entry: entries) {
+        if ((entry.drmFormatModifierTilingFeatures & required) != required ||
+            entry.drmFormatModifierPlaneCount > DmabufAttributes::kMaxPlanes) {
+            continue;
+        }
+        // the format features say nothing about export, the image format query does
+        VkPhysicalDeviceImageDrmFormatModifierInfoEXT modifier_info{};
+        modifier_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_DRM_FORMAT_MODIFIER_INFO_EXT;
+        modifier_info.drmFormatModifier = entry.drmFormatModifier;
+        modifier_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        VkPhysicalDeviceExternalImageFormatInfo external_info{};
+        external_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_IMAGE_FORMAT_INFO;
+        external_info.pNext = &modifier_info;
+        external_info.handleType = VK_EXTERNAL_MEMORY_HANDLE_TYPE_DMA_BUF_BIT_EXT;
+        VkPhysicalDeviceImageFormatInfo2 format_info{};
+        format_info.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_IMAGE_FORMAT_INFO_2;
+        format_info.pNext = &external_info;
+        format_info.format = format;
+        format_info.type = VK_IMAGE_TYPE_2D;
+        format_info.tiling = VK_IMAGE_TILING_DRM_FORMAT_MODIFIER_EXT;
+        format_info.usage = usage;
+        VkExternalImageFormatProperties external_properties{};
+        external_properties.sType = VK_STRUCTURE_TYPE_EXTERNAL_IMAGE_FORMAT_PROPERTIES;
+        VkImageFormatProperties2 image_properties{};
+        image_properties.sType = VK_STRUCTURE_TYPE_IMAGE_FORMAT_PROPERTIES_2;
+        image_properties.pNext = &external_properties;
+        if (vkGetPhysicalDeviceImageFormatProperties2(physical_device, &format_info, &image_properties) !=
+            VK_SUCCESS ||
+            !(external_properties.externalMemoryProperties.externalMemoryFeatures &
+              VK_EXTERNAL_MEMORY_FEATURE_EXPORTABLE_BIT)) {
+            continue;
+        }
+        result.push_back({entry.drmFormatModifier, entry.drmFormatModifierPlaneCount});
+    }
+    return result;
+}
+
+/**
+ * @brief Picks a memory type for the image, device local memory when there is one.
+ */
+bool VulkanDmabuf::find_memory_type(uint32_t type_bits, uint32_t *index) const {
+    VkPhysicalDeviceMemoryProperties properties{};
+    vkGetPhysicalDeviceMemoryProperties(vulkan_->get_physical_device(), &properties);
+    bool found = false;
+    for (uint32_t i = 0; i < properties.memoryTypeCount; i++) {
+        if (!(type_bits & (1u << i))) {
+            continue;
+        }
+        if (properties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT) {
+            *index = i;
+            return true;
+        }
+        if (!found) {
+            *index = i;
+            found = true;
+        }
+    }
+    return found;
+}
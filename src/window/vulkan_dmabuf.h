@@ -0,0 +1,108 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_VULKAN_DMABUF_H_
+#define SRC_WINDOW_VULKAN_DMABUF_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "window_dmabuf.h"
+#include "window_vulkan.h"
+#include "utils/export.h"
+
+class WAYPP_EXPORT VulkanDmabuf {
+public:
+    class Image {
+    public:
+        ~Image();
+
+        Image(const Image &) = delete;
+
+        Image &operator=(const Image &) = delete;
+
+        [[nodiscard]] VkImage get_image() const { return image_; }
+
+        [[nodiscard]] VkDeviceMemory get_memory() const { return memory_; }
+
+        [[nodiscard]] VkFormat get_format() const { return format_; }
+
+        [[nodiscard]] VkExtent2D get_extent() const { return extent_; }
+
+        // the fds stay owned by the image, pass them to WindowDmabuf::import() or EglDmabufImage
+        [[nodiscard]] const DmabufAttributes &get_attributes() const { return attributes_; }
+
+    private:
+        friend class VulkanDmabuf;
+
+        explicit Image(VkDevice device) : device_(device) {}
+
+        VkDevice device_;
+        VkImage image_{};
+        VkDeviceMemory memory_{};
+        VkFormat format_{VK_FORMAT_UNDEFINED};
+        VkExtent2D extent_{};
+        DmabufAttributes attributes_{};
+        // contents are undefined until the first release, there is nothing to acquire
+        bool released_{};
+    };
+
+    explicit VulkanDmabuf(const WindowVulkan *vulkan);
+
+    VulkanDmabuf(const VulkanDmabuf &) = delete;
+
+    VulkanDmabuf &operator=(const VulkanDmabuf &) = delete;
+
+    [[nodiscard]] static VkFormat to_vk_format(uint32_t drm_format);
+
+    [[nodiscard]] std::vector<uint64_t> get_modifiers(uint32_t drm_format, VkImageUsageFlags usage) const;
+
+    [[nodiscard]] std::unique_ptr<Image> allocate(int32_t width, int32_t height, uint32_t drm_format,
+                                                  const std::vector<uint64_t> &modifiers,
+                                                  VkImageUsageFlags usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT) const;
+
+    void record_acquire(VkCommandBuffer command_buffer, Image &image, VkImageLayout layout) const;
+
+    void record_release(VkCommandBuffer command_buffer, Image &image, VkImageLayout layout) const;
+
+    [[nodiscard]] VkSemaphore create_semaphore() const;
+
+    [[nodiscard]] int export_sync_file(VkSemaphore semaphore) const;
+
+    bool import_sync_file(VkSemaphore semaphore, int fd) const;
+
+private:
+    const WindowVulkan *vulkan_;
+    VkDevice device_;
+
+    PFN_vkGetMemoryFdKHR pfGetMemoryFd_{};
+    PFN_vkGetSemaphoreFdKHR pfGetSemaphoreFd_{};
+    PFN_vkImportSemaphoreFdKHR pfImportSemaphoreFd_{};
+    PFN_vkGetImageDrmFormatModifierPropertiesEXT pfGetImageDrmFormatModifierProperties_{};
+
+    struct Modifier {
+        uint64_t modifier;
+        uint32_t planes;
+    };
+
+    [[nodiscard]] std::vector<Modifier> query_modifiers(VkFormat format, VkImageUsageFlags usage) const;
+
+    [[nodiscard]] bool find_memory_type(uint32_t type_bits, uint32_t *index) const;
+};
+
+#endif // SRC_WINDOW_VULKAN_DMABUF_H_
@@ -0,0 +1,234 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "vulkan_pipeline_cache.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/logging.h"
+
+namespace {
+constexpr uint32_t kFileMagic = 0x57505643; // "WPVC"
+
+struct FileHeader {
+    uint32_t magic;
+    uint32_t driver_version;
+    uint64_t size;
+    // FNV-1a of the cache data, drivers trust the blob they are given
+    uint64_t checksum;
+};
+
+/**
+ * @brief FNV-1a 64-bit hash.
+ */
+uint64_t hash_bytes(const char *bytes, size_t length) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ static_cast<uint8_t>(bytes[i])) * 1099511628211ull;
+    }
+    return hash;
+}
+
+/**
+ * @brief Creates path and its missing parents.
+ */
+bool make_directories(const std::string &path) {
+    for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos + 1)) {
+        const auto dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+            return false;
+        }
+        if (pos == std::string::npos) {
+            return true;
+        }
+    }
+}
+}
+
+/**
+ * @class VulkanPipelineCache
+ * @brief A VkPipelineCache kept on disk, so pipelines are compiled once per driver.
+ *
+ * Pipeline compilation dominates the time to first frame on many mobile drivers. The
+ * cache file is named after the device's pipeline cache UUID and driver version, so a
+ * different GPU or a driver update starts from an empty cache rather than handing the
+ * driver data it cannot use. The file is also checked against its checksum and the
+ * Vulkan cache header before the driver sees it.
+ *
+ * The data is written by save(), which WindowVulkan calls periodically and on exit, and
+ * which skips the write when no pipeline was added since the last one.
+ *
+ * @param physical_device The device the cache belongs to.
+ * @param device          The logical device the cache is created on.
+ * @param directory       Where the cache is kept, created on the first save; empty keeps
+ *                        it in memory only.
+ */
+VulkanPipelineCache::VulkanPipelineCache(VkPhysicalDevice physical_device, VkDevice device, std::string directory) :
+        device_(device),
+        directory_(std::move(directory)) {
+    vkGetPhysicalDeviceProperties(physical_device, &properties_);
+    if (!directory_.empty()) {
+        char name[2 * VK_UUID_SIZE + 1]{};
+        for (size_t i = 0; i < VK_UUID_SIZE; i++) {
+            snprintf(name + 2 * i, 3, "%02x", properties_.pipelineCacheUUID[i]);
+        }
+        char driver[16]{};
+        snprintf(driver, sizeof(driver), "%08x", properties_.driverVersion);
+        path_ = directory_ + "/" + name + "-" + driver + ".bin";
+    }
+
+    const auto data = load();
+    VkPipelineCacheCreateInfo cache_info{};
+    cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cache_info.initialDataSize = data.size();
+    cache_info.pInitialData = data.empty() ? nullptr : data.data();
+    auto result = vkCreatePipelineCache(device_, &cache_info, nullptr, &cache_);
+    if (result != VK_SUCCESS && !data.empty()) {
+        LOG_WARN("The driver rejected the pipeline cache %s, starting empty", path_.c_str());
+        unlink(path_.c_str());
+        cache_info.initialDataSize = 0;
+        cache_info.pInitialData = nullptr;
+        result = vkCreatePipelineCache(device_, &cache_info, nullptr, &cache_);
+    }
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error("vkCreatePipelineCache failed: " + std::to_string(result));
+    }
+    if (cache_info.pInitialData) {
+        loaded_size_ = data.size();
+        saved_size_ = data.size();
+    }
+}
+
+/**
+ * @brief Saves and destroys the cache; the device has to be idle.
+ */
+VulkanPipelineCache::~VulkanPipelineCache() {
+    save();
+    vkDestroyPipelineCache(device_, cache_, nullptr);
+}
+
+/**
+ * @return $XDG_CACHE_HOME/waypp/pipelines, or ~/.cache/waypp/pipelines.
+ */
+std::string VulkanPipelineCache::default_directory() {
+    if (const auto cache_home = getenv("XDG_CACHE_HOME"); cache_home && *cache_home) {
+        return std::string(cache_home) + "/waypp/pipelines";
+    }
+    if (const auto home = getenv("HOME"); home && *home) {
+        return std::string(home) + "/.cache/waypp/pipelines";
+    }
+    return "/tmp/waypp/pipelines";
+}
+
+/**
+ * @brief Writes the cache to disk if pipelines were added since the last save.
+ *
+ * The file is written next to its final name and renamed, so a concurrent or
+ * interrupted writer never leaves a truncated cache.
+ *
+ * @return false if the data could not be retrieved or written.
+ */
+bool VulkanPipelineCache::save() {
+    if (path_.empty()) {
+        return false;
+    }
+    size_t size = 0;
+    if (vkGetPipelineCacheData(device_, cache_, &size, nullptr) != VK_SUCCESS) {
+        return false;
+    }
+    if (size == saved_size_) {
+        return true;
+    }
+    std::vector<char> data(size);
+    // VK_INCOMPLETE if pipelines were added from another thread since the size query
+    if (vkGetPipelineCacheData(device_, cache_, &size, data.data()) != VK_SUCCESS) {
+        return false;
+    }
+    data.resize(size);
+
+    if (!make_directories(directory_)) {
+        LOG_ERROR("Cannot create pipeline cache %s: %s", directory_.c_str(), strerror(errno));
+        return false;
+    }
+    const auto temp = path_ + "." + std::to_string(getpid());
+    {
+        std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+        const FileHeader header{kFileMagic, properties_.driverVersion, data.size(),
+                                hash_bytes(data.data(), data.size())};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (!file) {
+            unlink(temp.c_str());
+            return false;
+        }
+    }
+    if (rename(temp.c_str(), path_.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+    saved_size_ = data.size();
+    return true;
+}
+
+/**
+ * @return The cache data from disk, empty on a miss or if the file does not match the device.
+ */
+std::vector<char> VulkanPipelineCache::load() const {
+    if (path_.empty()) {
+        return {};
+    }
+    std::ifstream file(path_, std::ios::binary);
+    if (!file) {
+        return {};
+    }
+    FileHeader header{};
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (!file.eof() || header.magic != kFileMagic || header.driver_version != properties_.driverVersion ||
+        header.size != data.size() || header.checksum != hash_bytes(data.data(), data.size()) ||
+        !is_compatible(data)) {
+        LOG_WARN("Discarding stale pipeline cache %s", path_.c_str());
+        unlink(path_.c_str());
+        return {};
+    }
+    return data;
+}
+
+/**
+ * @return true if the Vulkan cache header names this device.
+ */
+bool VulkanPipelineCache::is_compatible(const std::vector<char> &data) const {
+    VkPipelineCacheHeaderVersionOne header{};
+    if (data.size() < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    return header.headerSize >= sizeof(header) && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           header.vendorID == properties_.vendorID && header.deviceID == properties_.deviceID &&
+           memcmp(header.pipelineCacheUUID, properties_.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
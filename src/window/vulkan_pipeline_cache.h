@@ -0,0 +1,68 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_VULKAN_PIPELINE_CACHE_H_
+#define SRC_WINDOW_VULKAN_PIPELINE_CACHE_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT VulkanPipelineCache {
+public:
+    explicit VulkanPipelineCache(VkPhysicalDevice physical_device, VkDevice device,
+                                 std::string directory = default_directory());
+
+    ~VulkanPipelineCache();
+
+    VulkanPipelineCache(const VulkanPipelineCache &) = delete;
+
+    VulkanPipelineCache &operator=(const VulkanPipelineCache &) = delete;
+
+    bool save();
+
+    // pass to vkCreateGraphicsPipelines() and vkCreateComputePipelines()
+    [[nodiscard]] VkPipelineCache get_cache() const { return cache_; }
+
+    // empty when persistence is disabled
+    [[nodiscard]] const std::string &get_path() const { return path_; }
+
+    // bytes loaded at startup, 0 on a miss
+    [[nodiscard]] size_t get_loaded_size() const { return loaded_size_; }
+
+    static std::string default_directory();
+
+private:
+    VkDevice device_;
+    VkPipelineCache cache_{};
+    std::string directory_;
+    std::string path_;
+    VkPhysicalDeviceProperties properties_{};
+    size_t loaded_size_{};
+    // size of the data last written, drivers only ever grow a cache
+    size_t saved_size_{};
+
+    [[nodiscard]] std::vector<char> load() const;
+
+    [[nodiscard]] bool is_compatible(const std::vector<char> &data) const;
+};
+
+#endif // SRC_WINDOW_VULKAN_PIPELINE_CACHE_H_
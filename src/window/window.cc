@@ -16,7 +16,21 @@
 
 #include "window.h"
 
+#include <algorithm>
+#include <cerrno>
+
+#include <sys/timerfd.h>
+#include <unistd.h>
+
 #include <wayland-client.h>
+#include <glib-2.0/glib-unix.h>
+
+#include "frame_group.h"
+#include "window_manager/display.h"
+#include "utils/listener.h"
+#include "utils/logging.h"
+#include "utils/startup_profiler.h"
+#include "utils/trace.h"
 
 /**
  * @class Window
@@ -31,6 +45,8 @@ Window::Window(struct wl_compositor *compositor, ShellType shell_type,
         shell_type_(shell_type),
         draw_callback_(draw_callback) {
     wl_surface_ = wl_compositor_create_surface(compositor);
+    claim_surface(wl_surface_);
+    trace_track_ = "window " + std::to_string(wl_proxy_get_id(reinterpret_cast<struct wl_proxy *>(wl_surface_)));
     start_frames();
 }
 
@@ -43,7 +59,883 @@ Window::Window(struct wl_compositor *compositor, ShellType shell_type,
  * @see stop_frames()
  */
 Window::~Window() {
+    if (frame_group_) {
+        group_pending_ = false;
+        frame_group_->remove(this);
+    }
     stop_frames();
+    // the derived window is gone already, a scheduled frame is dropped rather than drawn
+    (void) close_frame_scheduler();
+
+    for (const auto &pending: pending_feedback_) {
+        wp_presentation_feedback_destroy(pending.feedback);
+    }
+
+    if (wp_presentation_wrapper_) {
+        wl_proxy_wrapper_destroy(wp_presentation_wrapper_);
+    }
+
+#if defined(ENABLE_CONTENT_TYPE)
+    if (wp_content_type_) {
+        wp_content_type_v1_destroy(wp_content_type_);
+    }
+#endif
+#if defined(ENABLE_ALPHA_MODIFIER)
+    alpha_modifier_.reset();
+#endif
+#if defined(ENABLE_COLOR_MANAGEMENT)
+    color_surface_.reset();
+#endif
+
+#if defined(ENABLE_FIFO)
+    if (wp_fifo_) {
+        wp_fifo_v1_destroy(wp_fifo_);
+    }
+#endif
+
+#if defined(ENABLE_COMMIT_TIMING)
+    if (wp_commit_timer_) {
+        wp_commit_timer_v1_destroy(wp_commit_timer_);
+    }
+#endif
+
+    if (wl_surface_wrapper_) {
+        wl_proxy_wrapper_destroy(wl_surface_wrapper_);
+    }
+
+    if (wl_event_queue_ && owns_event_queue_) {
+        wl_event_queue_destroy(wl_event_queue_);
+    }
+}
+
+const char *const Window::surface_tag_ = "waypp-window";
+
+/**
+ * @brief Returns the window a surface belongs to, e.g. the one an enter event names.
+ *
+ * Reads the surface's user data, so focus routing costs the same however many
+ * windows and subsurfaces there are. Surfaces that are not claimed by a window,
+ * such as cursor surfaces or those of other toolkits, are recognized by their
+ * missing tag and give nullptr.
+ *
+ * @param surface The surface, may be nullptr.
+ * @return The owning window, or nullptr.
+ */
+Window *Window::from_surface(struct wl_surface *surface) {
+    if (!surface) {
+        return nullptr;
+    }
+    const auto proxy = reinterpret_cast<struct wl_proxy *>(surface);
+    if (wl_proxy_get_tag(proxy) != &surface_tag_) {
+        return nullptr;
+    }
+    return static_cast<Window *>(wl_proxy_get_user_data(proxy));
+}
+
+/**
+ * @brief Makes from_surface() return this window for surface, e.g. one of its subsurfaces.
+ *
+ * The user data of surface is set to the window, so it must not carry a listener of
+ * its own; a listener added later must pass the Window pointer as its data.
+ */
+void Window::claim_surface(struct wl_surface *surface) {
+    const auto proxy = reinterpret_cast<struct wl_proxy *>(surface);
+    wl_proxy_set_user_data(proxy, this);
+    wl_proxy_set_tag(proxy, &surface_tag_);
+}
+
+/**
+ * @brief Moves this window's frame callbacks onto a dedicated event queue.
+ *
+ * Frame callbacks are requested through a proxy wrapper of the window surface,
+ * so they are created directly on the window's queue without racing the thread
+ * dispatching the default queue. The window is then driven by calling
+ * dispatch_queue() from its own render thread, independent of input, output and
+ * other windows' events.
+ *
+ * @param display The Wayland display the surface belongs to.
+ */
+void Window::create_event_queue(struct wl_display *display) {
+    if (wl_event_queue_) {
+        return;
+    }
+    set_event_queue(display, wl_display_create_queue(display));
+    owns_event_queue_ = true;
+}
+
+/**
+ * @brief Moves this window's frame callbacks onto queue, which other windows may share.
+ *
+ * Like create_event_queue(), but the queue stays owned by the caller, e.g. a
+ * RenderPool worker dispatching several windows, and must outlive the window.
+ *
+ * @param display The Wayland display the surface belongs to.
+ * @param queue   The queue to dispatch the window's frame and presentation events on.
+ */
+void Window::set_event_queue(struct wl_display *display, struct wl_event_queue *queue) {
+    if (wl_event_queue_) {
+        return;
+    }
+    queue_display_ = display;
+    wl_event_queue_ = queue;
+    wl_surface_wrapper_ = static_cast<struct wl_surface *>(wl_proxy_create_wrapper(wl_surface_));
+    wl_proxy_set_queue(reinterpret_cast<struct wl_proxy *>(wl_surface_wrapper_), wl_event_queue_);
+
+    if (wp_presentation_ && !wp_presentation_wrapper_) {
+        wp_presentation_wrapper_ = static_cast<struct wp_presentation *>(wl_proxy_create_wrapper(wp_presentation_));
+        wl_proxy_set_queue(reinterpret_cast<struct wl_proxy *>(wp_presentation_wrapper_), wl_event_queue_);
+    }
+
+    // re-arm the pending frame callback on the new queue
+    start_frames();
+}
+
+/**
+ * @brief Waits for and dispatches the events of this window's queue.
+ *
+ * Intended to be called in a loop from the window's render thread after
+ * create_event_queue().
+ *
+ * @param timeout The maximum amount of time to wait for events, in milliseconds.
+ * @return The number of events dispatched on success, or a negative error code on failure.
+ */
+int Window::dispatch_queue(int timeout) {
+    if (!wl_event_queue_) {
+        return -EINVAL;
+    }
+    return Display::poll_dispatch(queue_display_, wl_event_queue_, timeout,
+                                  schedule_fd_, &Window::dispatch_schedule, this);
+}
+
+/**
+ * @brief Requests presentation feedback for every commit made by the frame loop.
+ *
+ * Each result is stored as the last presentation, counted, and passed to the
+ * presentation callback if one is set.
+ *
+ * @param presentation The wp_presentation global, see Display::get_presentation().
+ * @param clock        The presentation clock, see Display::get_presentation_clock().
+ */
+void Window::enable_presentation_feedback(struct wp_presentation *presentation, clockid_t clock) {
+    if (!presentation || wp_presentation_) {
+        return;
+    }
+    wp_presentation_ = presentation;
+    presentation_clock_ = clock;
+
+    if (wl_event_queue_) {
+        wp_presentation_wrapper_ = static_cast<struct wp_presentation *>(wl_proxy_create_wrapper(wp_presentation_));
+        wl_proxy_set_queue(reinterpret_cast<struct wl_proxy *>(wp_presentation_wrapper_), wl_event_queue_);
+    }
+}
+
+/**
+ * @brief Makes set_content_type() available.
+ *
+ * @param manager The wp_content_type_manager_v1 global, see Display::get_content_type_manager().
+ */
+void Window::enable_content_type(struct wp_content_type_manager_v1 *manager) {
+    wp_content_type_manager_ = manager;
+}
+
+/**
+ * @brief Tells the compositor what kind of content the surface shows.
+ *
+ * Compositors use it to choose the output's scheduling policy, e.g. variable refresh
+ * and low latency for CONTENT_GAME, or a refresh rate matching the frame rate for
+ * CONTENT_VIDEO. The hint is applied with the next commit.
+ *
+ * @param content_type The content type, CONTENT_NONE for no preference.
+ * @return false if the compositor has no wp_content_type_manager_v1, or it is not built in.
+ */
+bool Window::set_content_type(ContentType content_type) {
+#if defined(ENABLE_CONTENT_TYPE)
+    if (!wp_content_type_manager_) {
+        return false;
+    }
+    if (!wp_content_type_) {
+        wp_content_type_ = wp_content_type_manager_v1_get_surface_content_type(wp_content_type_manager_, wl_surface_);
+    } else if (content_type == content_type_) {
+        return true;
+    }
+    content_type_ = content_type;
+    uint32_t type = WP_CONTENT_TYPE_V1_TYPE_NONE;
+    switch (content_type) {
+        case CONTENT_PHOTO:
+            type = WP_CONTENT_TYPE_V1_TYPE_PHOTO;
+            break;
+        case CONTENT_VIDEO:
+            type = WP_CONTENT_TYPE_V1_TYPE_VIDEO;
+            break;
+        case CONTENT_GAME:
+            type = WP_CONTENT_TYPE_V1_TYPE_GAME;
+            break;
+        case CONTENT_NONE:
+            break;
+    }
+    wp_content_type_v1_set_content_type(wp_content_type_, type);
+    request_redraw();
+    return true;
+#else
+    (void) content_type;
+    return false;
+#endif
+}
+
+/**
+ * @brief Makes set_opacity() available.
+ *
+ * @param manager The wp_alpha_modifier_v1 global, see Display::get_alpha_modifier().
+ */
+void Window::enable_alpha_modifier(struct wp_alpha_modifier_v1 *manager) {
+    wp_alpha_modifier_ = manager;
+}
+
+/**
+ * @brief Has the compositor fade the whole surface, without drawing it again.
+ *
+ * The multiplier applies on top of the buffer's alpha. A window drawing continuously
+ * commits it with its next frame; one rendering on demand has it committed right
+ * away, on its own, so a fade costs no redraws at all.
+ *
+ * @param opacity 0 for fully transparent to 1 for opaque.
+ * @return false if the compositor has no wp_alpha_modifier_v1, or it is not built in.
+ */
+bool Window::set_opacity(float opacity) {
+#if defined(ENABLE_ALPHA_MODIFIER)
+    if (!wp_alpha_modifier_) {
+        return false;
+    }
+    if (!alpha_modifier_) {
+        alpha_modifier_ = std::make_unique<AlphaModifier>(wp_alpha_modifier_, wl_surface_);
+    }
+    if (alpha_modifier_->set_opacity(opacity)) {
+        commit_state();
+    }
+    return true;
+#else
+    (void) opacity;
+    return false;
+#endif
+}
+
+/**
+ * @brief Commits surface state that needs no new buffer, when no frame will commit it soon.
+ *
+ * A window drawing continuously commits it with its next frame; one rendering on demand
+ * has it committed right away, on its own.
+ */
+void Window::commit_state() {
+    // before the first frame the commit would be the surface's initial one
+    if (on_demand_ && !rendering_ && !redraw_requested_ && animation_clock_.get_frame_count()) {
+        wl_surface_commit(wl_surface_);
+        if (flush_display_) {
+            Display::flush(flush_display_);
+        }
+    }
+}
+
+/**
+ * @brief Makes set_color_description() available.
+ *
+ * @param manager The color manager, see Display::get_color_manager(); nullptr without one.
+ */
+void Window::enable_color_management(const ColorManager *manager) {
+    color_manager_ = manager;
+}
+
+/**
+ * @brief Hands the buffers to the compositor in their own color space, with wp_color_manager_v1.
+ *
+ * HDR video or wide gamut content is drawn as it is, e.g. PQ encoded BT.2020 into a 10 bit
+ * EGL config, and the compositor maps it to the output, often on the display plane. That
+ * saves the client's full-screen tone mapping or conversion pass every frame. The description
+ * is created asynchronously and applies from the first commit after the compositor accepted
+ * it; a window rendering on demand has it committed then on its own.
+ *
+ * @param description The color space the buffers are in.
+ * @return false if the compositor has no color management or cannot convert from it,
+ *         or it is not built in; the client has to convert to sRGB itself then.
+ */
+bool Window::set_color_description(const ColorDescription &description) {
+#if defined(ENABLE_COLOR_MANAGEMENT)
+    if (!color_manager_ || !color_manager_->supports(description)) {
+        return false;
+    }
+    if (!color_surface_) {
+        color_surface_ = std::make_unique<ColorSurface>(color_manager_, wl_surface_, wl_event_queue_);
+        color_surface_->set_ready_callback([this](bool ready) {
+            if (ready) {
+                commit_state();
+            }
+        });
+    }
+    return color_surface_->set_description(description);
+#else
+    (void) description;
+    return false;
+#endif
+}
+
+/**
+ * @brief Has the compositor take the buffers as sRGB again.
+ */
+void Window::unset_color_description() {
+#if defined(ENABLE_COLOR_MANAGEMENT)
+    if (color_surface_) {
+        color_surface_->unset_description();
+        commit_state();
+    }
+#endif
+}
+
+/**
+ * @brief Makes set_fifo() available.
+ *
+ * @param manager The wp_fifo_manager_v1 global, see Display::get_fifo_manager().
+ */
+void Window::enable_fifo(struct wp_fifo_manager_v1 *manager) {
+    wp_fifo_manager_ = manager;
+}
+
+/**
+ * @brief Makes set_commit_timing() available.
+ *
+ * @param manager The wp_commit_timing_manager_v1 global, see Display::get_commit_timing_manager().
+ */
+void Window::enable_commit_timing(struct wp_commit_timing_manager_v1 *manager) {
+    wp_commit_timing_manager_ = manager;
+}
+
+/**
+ * @brief Has the compositor show each frame for at least one refresh, with wp_fifo_v1.
+ *
+ * Every frame's commit waits for the barrier the previous frame set, which the
+ * compositor clears at its next refresh. That is vsync at the compositor, independent
+ * of the driver's swap interval, and without blocking in eglSwapBuffers(); the frame
+ * is queued instead of replacing the one before it. Frame callbacks still pace the
+ * loop, which keeps the queue from growing. The compositor drops the barrier of a
+ * surface that is not shown, so a hidden window does not stall.
+ *
+ * @param fifo true to queue frames, false to let each commit replace the previous one.
+ * @return false if the compositor has no wp_fifo_manager_v1, or it is not built in.
+ */
+bool Window::set_fifo(bool fifo) {
+#if defined(ENABLE_FIFO)
+    if (!wp_fifo_manager_) {
+        return false;
+    }
+    if (fifo && !wp_fifo_) {
+        // one per surface for its lifetime, it stays once created
+        wp_fifo_ = wp_fifo_manager_v1_get_fifo(wp_fifo_manager_, wl_surface_);
+    }
+    fifo_ = fifo;
+    return true;
+#else
+    (void) fifo;
+    return false;
+#endif
+}
+
+/**
+ * @brief Tags each frame's commit with its target presentation time, with wp_commit_timer_v1.
+ *
+ * The target is the vblank the frame scheduler predicted for the frame, see
+ * FrameInput::target_present_ns, so a frame finished early is still shown when its
+ * animations were computed for instead of a refresh sooner. Frames without a
+ * prediction, e.g. the first ones or those of a window without presentation feedback,
+ * are not tagged.
+ *
+ * @param commit_timing true to tag commits.
+ * @return false if the compositor has no wp_commit_timing_manager_v1, or it is not built in.
+ */
+bool Window::set_commit_timing(bool commit_timing) {
+#if defined(ENABLE_COMMIT_TIMING)
+    if (!wp_commit_timing_manager_) {
+        return false;
+    }
+    if (commit_timing && !wp_commit_timer_) {
+        wp_commit_timer_ = wp_commit_timing_manager_v1_get_timer(wp_commit_timing_manager_, wl_surface_);
+    }
+    commit_timing_ = commit_timing;
+    return true;
+#else
+    (void) commit_timing;
+    return false;
+#endif
+}
+
+/**
+ * @brief Sets the FIFO barrier and the timestamp for the frame's first commit.
+ *
+ * Set before the draw, so an EGL or Vulkan swap that commits the buffer carries them;
+ * otherwise the frame's own commit in render_frame() does.
+ *
+ * @param target_present_ns The predicted presentation time, 0 if unknown.
+ */
+void Window::prepare_commit_timing(uint64_t target_present_ns) {
+#if defined(ENABLE_FIFO)
+    if (fifo_) {
+        wp_fifo_v1_wait_barrier(wp_fifo_);
+        wp_fifo_v1_set_barrier(wp_fifo_);
+    }
+#endif
+#if defined(ENABLE_COMMIT_TIMING)
+    if (commit_timing_ && target_present_ns) {
+        // half a refresh early, so clock jitter between the prediction and the compositor
+        // never makes it miss the vblank it was meant for
+        const uint64_t refresh = get_refresh_interval_ns();
+        const uint64_t timestamp = target_present_ns - std::min(target_present_ns, refresh / 2);
+        const uint64_t sec = timestamp / 1000000000ULL;
+        wp_commit_timer_v1_set_timestamp(wp_commit_timer_, static_cast<uint32_t>(sec >> 32),
+                                         static_cast<uint32_t>(sec & 0xffffffff),
+                                         static_cast<uint32_t>(timestamp % 1000000000ULL));
+    }
+#else
+    (void) target_present_ns;
+#endif
+}
+
+/**
+ * @brief Defers the draw callback to just before the predicted next vblank.
+ *
+ * The next vblank is predicted from the last presentation feedback and the refresh
+ * interval, falling back to the refresh hint. When a frame callback arrives, the
+ * draw is delayed until "vblank - render time - margin" by a timerfd, so input is
+ * sampled as late as possible. Without a prediction the frame is drawn immediately.
+ *
+ * The timerfd must be serviced by the event loop: WindowManager::poll_events() and
+ * dispatch_queue() poll it, and if a GMainContext is given it is attached there too.
+ *
+ * @param margin_us Safety margin between the end of rendering and the vblank, in microseconds.
+ * @param context   Optional GMainContext to attach the timer to.
+ * @return true if the scheduler is active.
+ */
+bool Window::enable_frame_scheduler(uint32_t margin_us, GMainContext *context) {
+    scheduler_margin_ns_ = static_cast<uint64_t>(margin_us) * 1000;
+    if (schedule_fd_ >= 0) {
+        return true;
+    }
+
+    schedule_fd_ = timerfd_create(presentation_clock_, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (schedule_fd_ < 0) {
+        return false;
+    }
+
+    if (context) {
+        schedule_source_ = g_unix_fd_source_new(schedule_fd_, G_IO_IN);
+        GUnixFDSourceFunc callback = [](gint /* fd */, GIOCondition /* condition */, gpointer data) -> gboolean {
+            dispatch_schedule(data);
+            return G_SOURCE_CONTINUE;
+        };
+        g_source_set_callback(schedule_source_, G_SOURCE_FUNC(callback), this, nullptr);
+        g_source_set_name(schedule_source_, "waypp frame scheduler");
+        g_source_attach(schedule_source_, context);
+    }
+    return true;
+}
+
+/**
+ * @brief Stops deferring frames; a frame waiting on the timer is rendered now.
+ */
+void Window::disable_frame_scheduler() {
+    if (close_frame_scheduler()) {
+        render_frame(scheduled_time_);
+    }
+}
+
+/**
+ * @brief Destroys the scheduler's timer without drawing.
+ *
+ * @return true if a frame was waiting on the timer.
+ */
+bool Window::close_frame_scheduler() {
+    if (schedule_source_) {
+        g_source_destroy(schedule_source_);
+        g_source_unref(schedule_source_);
+        schedule_source_ = nullptr;
+    }
+    if (schedule_fd_ >= 0) {
+        close(schedule_fd_);
+        schedule_fd_ = -1;
+    }
+    const bool scheduled = frame_scheduled_;
+    frame_scheduled_ = false;
+    return scheduled;
+}
+
+/**
+ * @brief Sets the refresh rate used before presentation feedback is available.
+ *
+ * @param refresh_mhz Refresh rate in mHz, as reported by Output::get_mode().
+ */
+void Window::set_refresh_hint(int refresh_mhz) {
+    refresh_hint_ns_ = refresh_mhz > 0 ? 1000000000000ULL / static_cast<uint64_t>(refresh_mhz) : 0;
+}
+
+/**
+ * @brief Sets the refresh range of a variable refresh rate output.
+ *
+ * Wayland does not report it. Without a range the fastest rate is the one in the
+ * presentation feedback or the refresh hint, and intervals of up to four
+ * refreshes count when detecting variable refresh.
+ *
+ * @param min_mhz Lowest refresh rate in mHz, 0 if unknown.
+ * @param max_mhz Highest refresh rate in mHz, 0 if unknown.
+ */
+void Window::set_refresh_range(int min_mhz, int max_mhz) {
+    max_interval_ns_ = min_mhz > 0 ? 1000000000000ULL / static_cast<uint64_t>(min_mhz) : 0;
+    min_interval_ns_ = max_mhz > 0 ? 1000000000000ULL / static_cast<uint64_t>(max_mhz) : 0;
+}
+
+/**
+ * @brief Limits how many commits may wait for presentation when a frame is about to be drawn.
+ *
+ * Each waiting commit holds a buffer, so the limit sets how many buffers the window
+ * cycles through: 1 is double buffering, 2 triple buffering. A frame callback arriving
+ * at the limit is passed up and the next one awaited, instead of drawing into a buffer
+ * the driver has to wait for, or allocate, on the thread dispatching the display.
+ * Needs presentation feedback, see enable_presentation_feedback(); without it frames
+ * are not limited.
+ *
+ * @param commits The commits allowed to wait, 0 for no limit.
+ */
+void Window::set_max_queued_commits(uint32_t commits) {
+    max_queued_commits_ = commits;
+}
+
+/**
+ * @brief Caps the frame rate, e.g. to 30 on battery or for slow animations.
+ *
+ * On a fixed rate output frames are drawn every n-th vblank, the smallest n that keeps
+ * the rate at or below fps, so motion stays evenly spaced. Frame callbacks arriving
+ * early are skipped, or with the frame scheduler enabled the frame is deferred to the
+ * vblank it is due at.
+ *
+ * @param fps The highest frame rate, 0 to draw on every vblank.
+ */
+void Window::set_max_fps(uint32_t fps) {
+    requested_max_fps_ = fps;
+    update_frame_rate();
+}
+
+/**
+ * @brief Lowers the frame rate while the window is not focused.
+ *
+ * The focused window keeps drawing at the rate set by set_max_fps(), others visible
+ * next to it drop to unfocused_fps, or only draw once invalidated. Focus is set with
+ * set_focused(), e.g. by WindowManager from the activated state and keyboard focus.
+ *
+ * @param unfocused_fps       The highest frame rate while unfocused, 0 to keep set_max_fps().
+ * @param unfocused_on_demand true to only draw after request_redraw() while unfocused.
+ */
+void Window::set_focus_throttle(uint32_t unfocused_fps, bool unfocused_on_demand) {
+    focus_throttle_ = true;
+    unfocused_fps_ = unfocused_fps;
+    unfocused_on_demand_ = unfocused_on_demand;
+    update_frame_rate();
+}
+
+/**
+ * @brief Draws at the requested rate regardless of focus again.
+ */
+void Window::disable_focus_throttle() {
+    focus_throttle_ = false;
+    update_frame_rate();
+}
+
+/**
+ * @brief Tells the window whether it has focus, windows start out focused.
+ *
+ * @param focused true while the window is activated or has keyboard focus.
+ */
+void Window::set_focused(bool focused) {
+    if (focused_ == focused) {
+        return;
+    }
+    focused_ = focused;
+    update_frame_rate();
+}
+
+/**
+ * @brief Lowers the frame rate while the user is idle, e.g. signage nobody touched for minutes.
+ *
+ * Applies on top of the focus throttle, the lower of the rates wins. Idleness is set
+ * with set_idle(), e.g. by WindowManager from the seats' idle notifications.
+ *
+ * @param idle_fps       The highest frame rate while idle, 0 to keep the other caps.
+ * @param idle_on_demand true to only draw after request_redraw() while idle.
+ */
+void Window::set_idle_throttle(uint32_t idle_fps, bool idle_on_demand) {
+    idle_throttle_ = true;
+    idle_fps_ = idle_fps;
+    idle_on_demand_ = idle_on_demand;
+    update_frame_rate();
+}
+
+/**
+ * @brief Draws at the requested rate regardless of idleness again.
+ */
+void Window::disable_idle_throttle() {
+    idle_throttle_ = false;
+    update_frame_rate();
+}
+
+/**
+ * @brief Tells the window whether the user is idle, windows start out active.
+ */
+void Window::set_idle(bool idle) {
+    if (idle_ == idle) {
+        return;
+    }
+    idle_ = idle;
+    update_frame_rate();
+}
+
+/**
+ * @brief Notices an output that stopped showing the window, e.g. a display blanked by DPMS.
+ *
+ * Some compositors keep sending frame callbacks to a powered off output, so the loop
+ * would go on drawing for nothing. Once frames have been committed for timeout_ms
+ * without presentation feedback reporting one of them presented, the window counts
+ * as blanked and draws at kBlankedFps; the first frame presented again lifts it. Needs
+ * enable_presentation_feedback(). Compositors with zwlr_output_power_manager_v1 tell
+ * directly, see Output::is_powered().
+ *
+ * @param timeout_ms How long frames may go unpresented.
+ */
+void Window::enable_blank_detection(uint32_t timeout_ms) {
+    blank_timeout_ns_ = static_cast<uint64_t>(timeout_ms) * 1000000ULL;
+    unpresented_since_ns_ = 0;
+}
+
+/**
+ * @brief Stops looking at presentation feedback for a blanked output, and lifts the throttle.
+ */
+void Window::disable_blank_detection() {
+    blank_timeout_ns_ = 0;
+    unpresented_since_ns_ = 0;
+    if (blanked_) {
+        blanked_ = false;
+        update_frame_rate();
+    }
+}
+
+/**
+ * @brief Applies set_max_fps() and set_render_on_demand(), tightened by the focus and idle throttles.
+ *
+ * Leaving render-on-demand restarts the continuous loop; entering it lets the pending
+ * frame finish and then waits for request_redraw().
+ */
+void Window::update_frame_rate() {
+    const bool throttled = focus_throttle_ && !focused_;
+    const bool idle = idle_throttle_ && idle_;
+    uint32_t fps = requested_max_fps_;
+    if (throttled && unfocused_fps_ && (!fps || unfocused_fps_ < fps)) {
+        fps = unfocused_fps_;
+    }
+    if (idle && idle_fps_ && (!fps || idle_fps_ < fps)) {
+        fps = idle_fps_;
+    }
+    if (blanked_ && (!fps || kBlankedFps < fps)) {
+        fps = kBlankedFps;
+    }
+    max_fps_ = fps;
+    frame_stats_.set_vblanks_per_frame(get_frame_divisor());
+
+    const bool on_demand = requested_on_demand_ || (throttled && unfocused_on_demand_) || (idle && idle_on_demand_);
+    if (on_demand == on_demand_) {
+        return;
+    }
+    on_demand_ = on_demand;
+    if (!on_demand_ && !paused_ && !wl_callback_ && !frame_scheduled_ && !group_pending_) {
+        start_frames();
+    }
+}
+
+/**
+ * @return The number of vblanks per frame under the frame rate cap, 1 without one.
+ */
+uint32_t Window::get_frame_divisor() const {
+    return FrameClock::frame_divisor(get_refresh_interval_ns(), max_fps_);
+}
+
+/**
+ * @return When the next frame is due under the frame rate cap, 0 if it is due now.
+ */
+uint64_t Window::get_frame_due_ns() const {
+    if (!max_fps_ || !last_frame_start_ns_ || frames_restarted_) {
+        return 0;
+    }
+    const uint64_t refresh = get_refresh_interval_ns();
+    const uint64_t interval = refresh && refresh_mode_ == REFRESH_FIXED
+                              ? get_frame_divisor() * refresh
+                              : 1000000000ULL / max_fps_;
+    // frame callbacks jitter around the vblank they belong to
+    const uint64_t slack = refresh ? refresh / 2 : interval / 10;
+    return last_frame_start_ns_ + interval - slack;
+}
+
+/**
+ * @return The shortest interval between two presentations, the period of the highest refresh rate.
+ */
+uint64_t Window::get_min_interval_ns() const {
+    if (min_interval_ns_) {
+        return min_interval_ns_;
+    }
+    uint64_t refresh, last;
+    get_vblank_timing(refresh, last);
+    return refresh;
+}
+
+/**
+ * @brief Detects variable refresh from the spacing of vsynced presentations.
+ *
+ * At a fixed rate consecutive frames are a whole number of refresh periods
+ * apart. With variable refresh the output waits for the frame, so the interval
+ * is wherever rendering finished. A few intervals off the grid switch to
+ * REFRESH_VARIABLE, and a longer run on the grid switches back.
+ *
+ * @param previous The feedback before current.
+ * @param current  The feedback of a presented commit.
+ */
+void Window::update_refresh_mode(const PresentationFeedback &previous, const PresentationFeedback &current) {
+    static constexpr int kVariableEvidence = 8;
+    static constexpr int kMaxEvidence = 16;
+
+    // without vsync the time is when the compositor flipped, not a refresh
+    if (!(current.flags & WP_PRESENTATION_FEEDBACK_KIND_VSYNC) || !previous.presented ||
+        current.time_ns <= previous.time_ns) {
+        return;
+    }
+    const uint64_t refresh = current.refresh_ns ? current.refresh_ns : refresh_hint_ns_;
+    if (!refresh) {
+        return;
+    }
+    const uint64_t interval = current.time_ns - previous.time_ns;
+    // longer gaps are pauses in rendering, they say nothing about the output
+    if (interval > (max_interval_ns_ ? max_interval_ns_ : 4 * refresh)) {
+        return;
+    }
+    const uint64_t phase = interval % refresh;
+    const bool on_grid = std::min(phase, refresh - phase) < refresh / 10;
+    vrr_evidence_ = on_grid ? std::max(vrr_evidence_ - 1, 0) : std::min(vrr_evidence_ + 2, kMaxEvidence);
+    if (vrr_evidence_ >= kVariableEvidence) {
+        refresh_mode_ = REFRESH_VARIABLE;
+    } else if (vrr_evidence_ == 0) {
+        refresh_mode_ = REFRESH_FIXED;
+    }
+}
+
+/**
+ * @brief Services the frame scheduler timerfd.
+ *
+ * Suitable as the extra_ready callback of Display::poll_dispatch().
+ *
+ * @param data Pointer to the Window object.
+ */
+void Window::dispatch_schedule(void *data) {
+    auto *obj = static_cast<Window *>(data);
+    uint64_t expirations;
+    if (read(obj->schedule_fd_, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        return;
+    }
+    if (obj->frame_scheduled_) {
+        obj->frame_scheduled_ = false;
+        obj->render_frame(obj->scheduled_time_);
+    }
+}
+
+/**
+ * @return The current time in the presentation clock domain, in nanoseconds.
+ */
+uint64_t Window::now_ns() const {
+    struct timespec ts{};
+    clock_gettime(presentation_clock_, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+/**
+ * @return The vblank period the window is scheduled at, 0 if unknown.
+ */
+uint64_t Window::get_refresh_interval_ns() const {
+    uint64_t refresh, last;
+    get_vblank_timing(refresh, last);
+    return refresh;
+}
+
+/**
+ * @brief The period and phase deadlines are predicted from.
+ *
+ * The frame clock of the primary output wins over the window's own feedback, so
+ * a window moved between outputs retimes to the new one at once. Until that
+ * output presented a frame, its period is combined with the window's last
+ * presentation.
+ *
+ * @param refresh_ns Receives the vblank period, 0 if unknown.
+ * @param last_ns    Receives the time of a past vblank, 0 if unknown.
+ */
+void Window::get_vblank_timing(uint64_t &refresh_ns, uint64_t &last_ns) const {
+    refresh_ns = last_presentation_.refresh_ns ? last_presentation_.refresh_ns : refresh_hint_ns_;
+    last_ns = last_presentation_.presented ? last_presentation_.time_ns : 0;
+    if (frame_clock_) {
+        if (const uint64_t period = frame_clock_->get_period_ns()) {
+            refresh_ns = period;
+        }
+        if (const uint64_t vblank = frame_clock_->get_last_vblank_ns()) {
+            last_ns = vblank;
+        }
+    }
+}
+
+/**
+ * @brief Predicts when the next frame has to start rendering.
+ *
+ * @param now The current time in the presentation clock domain.
+ * @return The absolute start deadline, or 0 if no vblank can be predicted.
+ */
+uint64_t Window::next_deadline_ns(uint64_t now) const {
+    uint64_t refresh, last;
+    get_vblank_timing(refresh, last);
+    if (!refresh || !last || last > now) {
+        return 0;
+    }
+
+    const uint64_t budget = render_time_ns_ + scheduler_margin_ns_;
+    if (refresh_mode_ == REFRESH_VARIABLE) {
+        // present as soon as ready, but no faster than the highest refresh rate
+        const uint64_t earliest = last + get_min_interval_ns();
+        return earliest > now + budget ? earliest - budget : 0;
+    }
+    if (budget >= refresh) {
+        return 0;
+    }
+
+    // first predicted vblank whose start deadline is still ahead of us
+    uint64_t vblank = last + ((now - last) / refresh + 1) * refresh;
+    if (vblank - budget <= now) {
+        vblank += refresh;
+    }
+    return vblank - budget;
+}
+
+/**
+ * @brief Predicts when a frame started now will be presented.
+ *
+ * @param now The current time in the presentation clock domain.
+ * @return The first predicted vblank after the estimated render time, or 0 if no vblank can be predicted.
+ */
+uint64_t Window::predict_presentation_ns(uint64_t now) const {
+    uint64_t refresh, last;
+    get_vblank_timing(refresh, last);
+    if (!refresh || !last || last > now) {
+        return 0;
+    }
+    const uint64_t ready = now + render_time_ns_;
+    if (refresh_mode_ == REFRESH_VARIABLE) {
+        return std::max(ready, last + get_min_interval_ns());
+    }
+    return last + ((ready - last) / refresh + 1) * refresh;
 }
 
 /**
@@ -55,16 +947,24 @@ Window::~Window() {
  */
 void Window::start_frames() {
     stop_frames();
-    on_frame(this, nullptr, 0);
+    // drawn right away instead of with the group
+    group_pending_ = false;
+    frames_restarted_ = true;
+    // frames held back while paused do not count against the output
+    unpresented_since_ns_ = 0;
+    if (!paused_) {
+        on_frame(nullptr, 0);
+    }
 }
 
 /**
  * Stops the frame rendering by destroying the wl_callback object if it exists.
  * This function is intended to be called from outside the Window class.
  */
-void Window::stop_frames() const {
+void Window::stop_frames() {
     if (wl_callback_) {
         wl_callback_destroy(wl_callback_);
+        wl_callback_ = nullptr;
     }
 }
 
@@ -72,33 +972,468 @@ void Window::stop_frames() const {
  * @brief Callback function for frame completion event
  *
  * This function is called when a frame completion event is received.
- * It updates the state of the Window object and invokes the draw_callback_ function.
+ * It updates the state of the Window object and invokes the frame handler, falling
+ * back to the draw_callback_ function when no handler is set.
  *
- * @param data Pointer to the Window object
  * @param callback Pointer to the wl_callback object (unused)
  * @param time Timestamp of the frame completion event
  */
-void Window::on_frame(void *data,
-                      struct wl_callback *callback,
+void Window::on_frame(struct wl_callback *callback,
                       const uint32_t time) {
-    const auto obj = static_cast<Window *>(data);
-
-    obj->wl_callback_ = nullptr;
+    TRACE_TRACK_SCOPE(trace_track_, "Window::on_frame");
+    wl_callback_ = nullptr;
 
     if (callback) {
         wl_callback_destroy(callback);
     }
 
-    if (obj->draw_callback_) {
-        obj->draw_callback_(data, time);
+    if (max_queued_commits_ && pending_feedback_.size() >= max_queued_commits_) {
+        // the buffers of earlier commits are still with the compositor: drawing now would
+        // have the driver block for one in the swap, or allocate another
+        throttled_count_++;
+        arm_frame_callback();
+        return;
+    }
+
+    if (const uint64_t due = get_frame_due_ns(); due > now_ns()) {
+        struct itimerspec its{};
+        its.it_value.tv_sec = static_cast<time_t>(due / 1000000000ULL);
+        its.it_value.tv_nsec = static_cast<long>(due % 1000000000ULL);
+        if (schedule_fd_ >= 0 && timerfd_settime(schedule_fd_, TFD_TIMER_ABSTIME, &its, nullptr) == 0) {
+            frame_scheduled_ = true;
+            scheduled_time_ = time;
+        } else {
+            // skip this vblank, the next callback comes with the next one
+            arm_frame_callback();
+        }
+        return;
+    }
+
+    if (schedule_fd_ >= 0) {
+        const uint64_t now = now_ns();
+        const uint64_t deadline = next_deadline_ns(now);
+        if (deadline > now) {
+            struct itimerspec its{};
+            its.it_value.tv_sec = static_cast<time_t>(deadline / 1000000000ULL);
+            its.it_value.tv_nsec = static_cast<long>(deadline % 1000000000ULL);
+            if (timerfd_settime(schedule_fd_, TFD_TIMER_ABSTIME, &its, nullptr) == 0) {
+                frame_scheduled_ = true;
+                scheduled_time_ = time;
+                return;
+            }
+        }
     }
 
-    obj->wl_callback_ = wl_surface_frame(obj->wl_surface_);
-    wl_callback_add_listener(obj->wl_callback_, &Window::frame_listener_, data);
+    if (frame_group_ && callback) {
+        group_pending_ = true;
+        group_time_ = time;
+        frame_group_->queue(this);
+        return;
+    }
+
+    render_frame(time);
+}
+
+/**
+ * @brief Runs the draw callback, then requests the next frame and commits.
+ *
+ * The duration of the draw callback feeds the render time estimate used by
+ * the frame scheduler and the resolution governor. The estimate follows increases immediately and decays
+ * slowly, so a single fast frame does not cause the next deadline to be missed.
+ * Both the duration and the frame interval are also kept in the frame statistics.
+ *
+ * @param time Timestamp of the frame callback that triggered this frame.
+ */
+void Window::render_frame(uint32_t time) {
+    const uint64_t start = now_ns();
+    StartupProfiler::begin(StartupProfiler::FIRST_FRAME);
+
+    // invalidations made from here on belong to the next frame
+    redraw_requested_ = false;
+    // as does input arriving during the draw
+    const uint64_t input_ns = pending_input_ns_.exchange(0, std::memory_order_relaxed);
+    const uint64_t target_present_ns = predict_presentation_ns(start);
+    animation_clock_.begin_frame(start, target_present_ns);
+    prepare_commit_timing(target_present_ns);
+
+    rendering_ = true;
+    {
+        TRACE_TRACK_SCOPE(trace_track_, "draw");
+        prepare_frame();
+        if (input_frame_handler_) {
+            size_t count = 0;
+            frame_motion_.clear();
+            (void) input_ring_.drain([this, &count](const InputEvent &event) {
+                frame_events_[count++] = event;
+                (void) frame_motion_.append(event);
+            });
+            const FrameInput frame{
+                    .time = time,
+                    .time_ns = start,
+                    .target_present_ns = target_present_ns,
+                    .last_present_ns = last_presentation_.presented ? last_presentation_.time_ns : 0,
+                    .events = frame_events_.data(),
+                    .event_count = count,
+                    .motion = &frame_motion_,
+                    .arena = &frame_arena_,
+            };
+            input_frame_handler_(frame_handler_data_, frame);
+        } else if (frame_handler_) {
+            frame_handler_(frame_handler_data_, time);
+        } else if (draw_callback_) {
+            draw_callback_(this, time);
+        }
+    }
+    rendering_ = false;
+
+    const uint64_t elapsed = now_ns() - start;
+    last_render_time_ns_ = elapsed;
+    if (elapsed > render_time_ns_) {
+        render_time_ns_ = elapsed;
+    } else {
+        render_time_ns_ -= (render_time_ns_ - elapsed) / 8;
+    }
+    const uint32_t divisor = get_frame_divisor();
+    frame_stats_.set_vblanks_per_frame(divisor);
+    frame_stats_.record_frame(start, elapsed, divisor * get_refresh_interval_ns(), !on_demand_ && !frames_restarted_);
+    last_frame_start_ns_ = start;
+    frames_restarted_ = false;
+
+    if (!paused_ && (!on_demand_ || redraw_requested_)) {
+        wl_callback_ = wl_surface_frame(wl_surface_wrapper_ ? wl_surface_wrapper_ : wl_surface_);
+        wl_callback_add_listener(wl_callback_, &Window::frame_listener_, this);
+    }
+
+    request_presentation_feedback(start, input_ns);
+    if (blank_timeout_ns_ && wp_presentation_) {
+        if (!unpresented_since_ns_) {
+            unpresented_since_ns_ = start;
+        } else if (!blanked_ && start - unpresented_since_ns_ > blank_timeout_ns_) {
+            LOG_DEBUG("Window: no frame presented for %llu ms, throttling to %u fps",
+                      static_cast<unsigned long long>((start - unpresented_since_ns_) / 1000000), kBlankedFps);
+            blanked_ = true;
+            update_frame_rate();
+        }
+    }
+
+    if (transaction_.empty()) {
+        wl_surface_commit(wl_surface_);
+    } else {
+        // subsurface changes from the draw go out first, committed by the parent commit below
+        transaction_.commit_surface(wl_surface_).commit();
+    }
+    // a group flushes once after its last member
+    if (flush_display_ && !frame_group_) {
+        Display::flush(flush_display_);
+    }
+    if (!wp_presentation_) {
+        // without feedback the commit is as close to the screen as can be seen
+        StartupProfiler::end(StartupProfiler::FIRST_FRAME);
+    }
+    frame_committed();
+    frame_arena_.reset();
+
+    if (!frame_waiters_.empty()) {
+        // waiters may wait again, for the frame after this one
+        const auto waiters = std::move(frame_waiters_);
+        frame_waiters_.clear();
+        for (const auto &waiter: waiters) {
+            waiter(time);
+        }
+    }
+}
+
+/**
+ * @brief Calls callback once, after the next frame is drawn and committed.
+ *
+ * In render-on-demand mode a redraw is requested. The callback runs on the thread
+ * drawing the window; see awaitables.h for the coroutine form.
+ *
+ * @param callback Called with the timestamp of the frame callback.
+ */
+void Window::on_next_frame(const std::function<void(uint32_t time)> &callback) {
+    frame_waiters_.push_back(callback);
+    request_redraw();
+}
+
+/**
+ * @brief Calls callback once, with the next presentation feedback that arrives.
+ *
+ * Unlike set_presentation_callback() it does not replace the presentation callback.
+ * Needs enable_presentation_feedback(), or the callback never runs.
+ */
+void Window::on_next_presentation(const std::function<void(const PresentationFeedback &feedback)> &callback) {
+    presentation_waiters_.push_back(callback);
+}
+
+/**
+ * @brief Switches between the continuous frame loop and render-on-demand.
+ *
+ * In render-on-demand mode a frame is only drawn after request_redraw(); with nothing
+ * invalidated no frame callback is pending and the event loop sleeps.
+ *
+ * @param on_demand true for render-on-demand, false for the continuous loop.
+ */
+void Window::set_render_on_demand(bool on_demand) {
+    requested_on_demand_ = on_demand;
+    update_frame_rate();
+}
+
+/**
+ * @brief Schedules one frame in render-on-demand mode.
+ *
+ * Arms a single frame callback, so the draw callback runs at the compositor's next
+ * frame. Calls made while a frame is pending, or from the draw callback itself,
+ * are coalesced into one further frame.
+ */
+void Window::request_redraw() {
+    if (!on_demand_) {
+        return;
+    }
+    redraw_requested_ = true;
+    if (wl_callback_ || frame_scheduled_ || group_pending_ || rendering_ || paused_) {
+        return;
+    }
+    arm_frame_callback();
+}
+
+/**
+ * @brief Schedules one frame in render-on-demand mode for content changed by input.
+ *
+ * For input handlers, e.g. after a click that changes what is shown. A window that
+ * drew nothing for a frame interval is not waiting on the compositor, so asking it for
+ * a frame callback first would only delay the draw by an idle vblank. Instead the frame
+ * is drawn at the frame scheduler's next deadline, with all input up to then coalesced
+ * into it, or right away without the scheduler. Within a frame interval of the last
+ * frame it behaves like request_redraw(), so a burst of motion still draws once per
+ * vblank.
+ */
+void Window::request_input_redraw() {
+    if (!on_demand_) {
+        return;
+    }
+    if (wl_callback_ || frame_scheduled_ || group_pending_ || rendering_ || paused_) {
+        redraw_requested_ = true;
+        return;
+    }
+    const uint64_t now = now_ns();
+    const uint64_t interval = get_frame_divisor() * get_refresh_interval_ns();
+    const bool queue_full = max_queued_commits_ && pending_feedback_.size() >= max_queued_commits_;
+    // a grouped window draws with its group's frame callbacks
+    if (!interval || queue_full || frame_group_ || (last_frame_start_ns_ && now - last_frame_start_ns_ < interval)) {
+        request_redraw();
+        return;
+    }
+    input_redraws_++;
+    const auto time = static_cast<uint32_t>(now / 1000000ULL);
+    if (schedule_fd_ >= 0) {
+        if (const uint64_t deadline = next_deadline_ns(now); deadline > now) {
+            struct itimerspec its{};
+            its.it_value.tv_sec = static_cast<time_t>(deadline / 1000000000ULL);
+            its.it_value.tv_nsec = static_cast<long>(deadline % 1000000000ULL);
+            if (timerfd_settime(schedule_fd_, TFD_TIMER_ABSTIME, &its, nullptr) == 0) {
+                redraw_requested_ = true;
+                frame_scheduled_ = true;
+                scheduled_time_ = time;
+                return;
+            }
+        }
+    }
+    render_frame(time);
+}
+
+/**
+ * @brief Pauses or resumes the frame loop.
+ *
+ * Pausing drops the pending frame callback and any frame waiting on the scheduler,
+ * so a hidden window stops drawing even if the compositor keeps sending callbacks.
+ * Resuming restarts the continuous loop, or in render-on-demand mode draws once
+ * if a redraw was requested while paused.
+ *
+ * @param paused true to pause.
+ */
+void Window::set_paused(bool paused) {
+    if (paused_ == paused) {
+        return;
+    }
+    paused_ = paused;
 
-    wl_surface_commit(obj->wl_surface_);
+    if (paused_) {
+        stop_frames();
+        group_pending_ = false;
+        if (frame_scheduled_) {
+            frame_scheduled_ = false;
+            const struct itimerspec disarm{};
+            timerfd_settime(schedule_fd_, 0, &disarm, nullptr);
+        }
+    } else if (!on_demand_) {
+        start_frames();
+    } else if (redraw_requested_) {
+        arm_frame_callback();
+    }
+}
+
+/**
+ * @brief Requests a frame callback and commits so the compositor sends it.
+ */
+void Window::arm_frame_callback() {
+    wl_callback_ = wl_surface_frame(wl_surface_wrapper_ ? wl_surface_wrapper_ : wl_surface_);
+    wl_callback_add_listener(wl_callback_, &Window::frame_listener_, this);
+    wl_surface_commit(wl_surface_);
 }
 
 const struct wl_callback_listener Window::frame_listener_ = {
-        .done = on_frame
+        .done = listener_thunk<&Window::on_frame>
+};
+
+/**
+ * @brief Requests feedback for the commit that is about to be made.
+ *
+ * @param start_ns When rendering of the commit started.
+ * @param input_ns The earliest input the commit may respond to, 0 if none.
+ */
+void Window::request_presentation_feedback(uint64_t start_ns, uint64_t input_ns) {
+    if (!wp_presentation_) {
+        return;
+    }
+    auto feedback = wp_presentation_feedback(wp_presentation_wrapper_ ? wp_presentation_wrapper_ : wp_presentation_,
+                                             wl_surface_);
+    wp_presentation_feedback_add_listener(feedback, &feedback_listener_, this);
+    pending_feedback_.push_back({feedback, ++commit_count_, start_ns, input_ns});
+}
+
+/**
+ * @brief Records an input event for the input-to-photon latency statistics.
+ *
+ * The first frame rendered after the event is taken to show its effect; its
+ * presentation time minus time_ns is recorded as FrameStats input latency. Of several
+ * events before a frame only the earliest counts. Safe to call from the input thread.
+ *
+ * @param time_ns The event time in the CLOCK_MONOTONIC domain, as reported by Display::set_input_callback().
+ */
+void Window::record_input(uint64_t time_ns) {
+    if (presentation_clock_ != CLOCK_MONOTONIC) {
+        struct timespec ts{};
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        const uint64_t monotonic = static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+        time_ns += now_ns() - monotonic;
+    }
+    uint64_t expected = 0;
+    pending_input_ns_.compare_exchange_strong(expected, time_ns, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Retires a feedback object and publishes its result.
+ *
+ * @param feedback The feedback object, destroyed by this call.
+ * @param result   The result, the commit field is filled in here.
+ */
+void Window::complete_feedback(struct wp_presentation_feedback *feedback, const PresentationFeedback &result) {
+    last_presentation_ = result;
+    for (auto it = pending_feedback_.begin(); it != pending_feedback_.end(); ++it) {
+        if (it->feedback == feedback) {
+            last_presentation_.commit = it->commit;
+            if (result.presented) {
+                StartupProfiler::end(StartupProfiler::FIRST_FRAME);
+                frame_stats_.record_presentation(it->start_ns, result.time_ns, result.msc);
+                if (it->input_ns && result.time_ns > it->input_ns) {
+                    frame_stats_.record_input_latency(result.time_ns - it->input_ns);
+                }
+            } else {
+                frame_stats_.record_discarded();
+            }
+            pending_feedback_.erase(it);
+            break;
+        }
+    }
+    wp_presentation_feedback_destroy(feedback);
+
+    if (presentation_callback_) {
+        presentation_callback_(last_presentation_);
+    }
+    if (!presentation_waiters_.empty()) {
+        const auto waiters = std::move(presentation_waiters_);
+        presentation_waiters_.clear();
+        for (const auto &waiter: waiters) {
+            waiter(last_presentation_);
+        }
+    }
+}
+
+/**
+ * @brief Handles the output the commit was synchronized to, sent before presented.
+ */
+void Window::handle_sync_output(struct wp_presentation_feedback * /* feedback */,
+                                struct wl_output *output) {
+    sync_output_ = output;
+}
+
+/**
+ * @brief Handles a commit that reached the screen.
+ *
+ * @param feedback  The feedback object.
+ * @param tv_sec_hi High 32 bits of the presentation time seconds.
+ * @param tv_sec_lo Low 32 bits of the presentation time seconds.
+ * @param tv_nsec   Nanoseconds part of the presentation time.
+ * @param refresh   Refresh interval in nanoseconds, 0 if unknown.
+ * @param seq_hi    High 32 bits of the vertical retrace counter.
+ * @param seq_lo    Low 32 bits of the vertical retrace counter.
+ * @param flags     WP_PRESENTATION_FEEDBACK_KIND_* flags.
+ */
+void Window::handle_presented(struct wp_presentation_feedback *feedback,
+                              uint32_t tv_sec_hi,
+                              uint32_t tv_sec_lo,
+                              uint32_t tv_nsec,
+                              uint32_t refresh,
+                              uint32_t seq_hi,
+                              uint32_t seq_lo,
+                              uint32_t flags) {
+    const uint64_t tv_sec = (static_cast<uint64_t>(tv_sec_hi) << 32) | tv_sec_lo;
+    const uint64_t msc = (static_cast<uint64_t>(seq_hi) << 32) | seq_lo;
+    // set by Output as its listener data
+    if (const auto output = sync_output_ ? static_cast<Output *>(wl_output_get_user_data(sync_output_)) : nullptr) {
+        output->get_frame_clock().record_presentation(tv_sec * 1000000000ULL + tv_nsec, refresh, msc);
+    }
+    sync_output_ = nullptr;
+    presented_count_++;
+    unpresented_since_ns_ = 0;
+    if (blanked_) {
+        LOG_DEBUG("Window: presented again, no longer blanked");
+        blanked_ = false;
+        update_frame_rate();
+    }
+    const PresentationFeedback result{
+            .presented = true,
+            .commit = 0,
+            .time_ns = tv_sec * 1000000000ULL + tv_nsec,
+            .refresh_ns = refresh,
+            .msc = msc,
+            .flags = flags,
+    };
+    update_refresh_mode(last_presentation_, result);
+    complete_feedback(feedback, result);
+}
+
+/**
+ * @brief Handles a commit that was never shown.
+ *
+ * @param feedback The feedback object.
+ */
+void Window::handle_discarded(struct wp_presentation_feedback *feedback) {
+    sync_output_ = nullptr;
+    discarded_count_++;
+    complete_feedback(feedback, {
+            .presented = false,
+            .commit = 0,
+            .time_ns = 0,
+            .refresh_ns = 0,
+            .msc = 0,
+            .flags = 0,
+    });
+}
+
+const struct wp_presentation_feedback_listener Window::feedback_listener_ = {
+        .sync_output = listener_thunk<&Window::handle_sync_output>,
+        .presented = listener_thunk<&Window::handle_presented>,
+        .discarded = listener_thunk<&Window::handle_discarded>,
 };
@@ -17,13 +17,48 @@
 #ifndef SRC_WINDOW_WINDOW_H_
 #define SRC_WINDOW_WINDOW_H_
 
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
 #include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <wayland-client.h>
+#include <glib-2.0/glib.h>
+
+#include "presentation-time-client-protocol.h"
+
+#include "alpha_modifier.h"
+#include "animation_clock.h"
+#include "color_management.h"
+#include "frame_arena.h"
+#include "frame_clock.h"
+#if defined(ENABLE_CONTENT_TYPE)
+#include "content-type-v1-client-protocol.h"
+#endif
+#if defined(ENABLE_FIFO)
+#include "fifo-v1-client-protocol.h"
+#endif
+#if defined(ENABLE_COMMIT_TIMING)
+#include "commit-timing-v1-client-protocol.h"
+#endif
+
+#include "seat/input_event.h"
+#include "seat/motion_batch.h"
+#include "utils/listener.h"
+#include "frame_stats.h"
+#include "surface_transaction.h"
+#include "utils/export.h"
 
 class Display;
 
-class Window {
+class FrameGroup;
+
+class WAYPP_EXPORT Window {
 public:
     typedef enum {
         AGL,
@@ -32,32 +67,542 @@ public:
         NONE,
     } ShellType;
 
+    // what the surface shows, lets the compositor pick e.g. VRR or power saving
+    typedef enum {
+        CONTENT_NONE,
+        CONTENT_PHOTO,
+        CONTENT_VIDEO,
+        CONTENT_GAME,
+    } ContentType;
+
+    // how the output the window is on refreshes, see get_refresh_mode()
+    typedef enum {
+        REFRESH_FIXED,
+        // variable refresh rate: the output refreshes when a frame is ready
+        REFRESH_VARIABLE,
+    } RefreshMode;
+
+    struct PresentationFeedback {
+        // false if the compositor discarded the commit
+        bool presented;
+        // commit sequence number the feedback belongs to
+        uint64_t commit;
+        // presentation time in the Display::get_presentation_clock() domain
+        uint64_t time_ns;
+        // output refresh interval, 0 if unknown
+        uint32_t refresh_ns;
+        // output vertical retrace counter
+        uint64_t msc;
+        // WP_PRESENTATION_FEEDBACK_KIND_* flags
+        uint32_t flags;
+    };
+
+    // what an input frame handler gets every frame
+    struct FrameInput {
+        // timestamp of the frame callback, in milliseconds; wraps, prefer time_ns
+        uint32_t time;
+        // when the frame started, in the presentation clock domain (CLOCK_MONOTONIC unless the compositor
+        // reports another)
+        uint64_t time_ns;
+        // predicted presentation time of this frame in the presentation clock domain, 0 if unknown
+        uint64_t target_present_ns;
+        // presentation time of the last frame the compositor reported on, 0 before the first feedback
+        uint64_t last_present_ns;
+        // input received since the previous frame, oldest first
+        const InputEvent *events;
+        size_t event_count;
+        // the motion samples among events, as arrays
+        const MotionBatch *motion;
+        // for the frame's temporaries, reset after the frame is committed
+        FrameArena *arena;
+    };
+
     explicit Window(struct wl_compositor *compositor, ShellType shell_type = XDG,
                     const std::function<void(void *data, uint32_t time)> &draw_callback = nullptr);
 
     virtual ~Window() = 0;
 
+protected:
+    /**
+     * @brief Called right before the draw callback of every frame.
+     *
+     * Lets subclasses apply state that changed since the last frame, such as a
+     * pending resize, exactly once per frame.
+     */
+    virtual void prepare_frame() {}
+
+    /**
+     * @brief Called after every frame's commit, e.g. to tell a shell the first frame is there.
+     */
+    virtual void frame_committed() {}
+
+public:
+    [[nodiscard]] struct wl_surface *get_surface() const { return wl_surface_; }
+
+    [[nodiscard]] static Window *from_surface(struct wl_surface *surface);
+
+    void claim_surface(struct wl_surface *surface);
+
+    /**
+     * @brief Changes staged here during a draw are committed with the frame.
+     *
+     * The window's own commit goes last, after its subsurfaces.
+     */
+    [[nodiscard]] SurfaceTransaction &get_transaction() { return transaction_; }
+
+    void create_event_queue(struct wl_display *display);
+
+    void set_event_queue(struct wl_display *display, struct wl_event_queue *queue);
+
+    [[nodiscard]] int dispatch_queue(int timeout);
+
+    [[nodiscard]] struct wl_event_queue *get_event_queue() const { return wl_event_queue_; }
+
+    void set_render_on_demand(bool on_demand);
+
+    // flushes right after each frame's commit instead of with the event loop, nullptr to stop
+    void set_flush_on_commit(struct wl_display *display) { flush_display_ = display; }
+
+    void request_redraw();
+
+    void request_input_redraw();
+
+    // frames request_input_redraw() drew without waiting for a frame callback
+    [[nodiscard]] uint64_t get_input_redraw_count() const { return input_redraws_; }
+
+    void set_paused(bool paused);
+
+    [[nodiscard]] bool is_paused() const { return paused_; }
+
+    void enable_presentation_feedback(struct wp_presentation *presentation, clockid_t clock = CLOCK_MONOTONIC);
+
+    void enable_content_type(struct wp_content_type_manager_v1 *manager);
+
+    bool set_content_type(ContentType content_type);
+
+    [[nodiscard]] ContentType get_content_type() const { return content_type_; }
+
+    void enable_alpha_modifier(struct wp_alpha_modifier_v1 *manager);
+
+    bool set_opacity(float opacity);
+
+#if defined(ENABLE_ALPHA_MODIFIER)
+    [[nodiscard]] float get_opacity() const { return alpha_modifier_ ? alpha_modifier_->get_opacity() : 1.0f; }
+#else
+    [[nodiscard]] float get_opacity() const { return 1.0f; }
+#endif
+
+    void enable_color_management(const ColorManager *manager);
+
+    bool set_color_description(const ColorDescription &description);
+
+    void unset_color_description();
+
+    // the compositor converts from the description set, see set_color_description()
+#if defined(ENABLE_COLOR_MANAGEMENT)
+    [[nodiscard]] bool is_color_managed() const { return color_surface_ && color_surface_->is_set(); }
+#else
+    [[nodiscard]] bool is_color_managed() const { return false; }
+#endif
+
+    void enable_fifo(struct wp_fifo_manager_v1 *manager);
+
+    void enable_commit_timing(struct wp_commit_timing_manager_v1 *manager);
+
+    bool set_fifo(bool fifo);
+
+    [[nodiscard]] bool is_fifo() const { return fifo_; }
+
+    bool set_commit_timing(bool commit_timing);
+
+    [[nodiscard]] bool is_commit_timing() const { return commit_timing_; }
+
+    bool enable_frame_scheduler(uint32_t margin_us = 1000, GMainContext *context = nullptr);
+
+    void disable_frame_scheduler();
+
+    void set_refresh_hint(int refresh_mhz);
+
+    void set_refresh_range(int min_mhz, int max_mhz);
+
+    void set_max_fps(uint32_t fps);
+
+    [[nodiscard]] uint32_t get_max_fps() const { return requested_max_fps_; }
+
+    void set_focus_throttle(uint32_t unfocused_fps, bool unfocused_on_demand = false);
+
+    void disable_focus_throttle();
+
+    void set_focused(bool focused);
+
+    [[nodiscard]] bool is_focused() const { return focused_; }
+
+    void set_idle_throttle(uint32_t idle_fps, bool idle_on_demand = false);
+
+    void disable_idle_throttle();
+
+    void set_idle(bool idle);
+
+    [[nodiscard]] bool is_idle() const { return idle_; }
+
+    // while blanked, frames go on at this rate to notice the output showing them again
+    static constexpr uint32_t kBlankedFps = 1;
+
+    void enable_blank_detection(uint32_t timeout_ms = 2000);
+
+    void disable_blank_detection();
+
+    // frames were committed for the blank detection timeout without one being presented
+    [[nodiscard]] bool is_blanked() const { return blanked_; }
+
+    // the frame rate cap and render-on-demand mode in effect, including the focus and idle throttles
+    [[nodiscard]] uint32_t get_effective_max_fps() const { return max_fps_; }
+
+    [[nodiscard]] bool is_render_on_demand() const { return on_demand_; }
+
+    void set_max_queued_commits(uint32_t commits);
+
+    [[nodiscard]] uint32_t get_max_queued_commits() const { return max_queued_commits_; }
+
+    // frame callbacks passed up because max_queued_commits were still waiting for presentation
+    [[nodiscard]] uint64_t get_throttled_count() const { return throttled_count_; }
+
+    [[nodiscard]] RefreshMode get_refresh_mode() const { return refresh_mode_; }
+
+    [[nodiscard]] int get_schedule_fd() const { return schedule_fd_; }
+
+    [[nodiscard]] uint64_t get_render_time_ns() const { return render_time_ns_; }
+
+    [[nodiscard]] uint64_t get_last_render_time_ns() const { return last_render_time_ns_; }
+
+    [[nodiscard]] uint64_t get_refresh_interval_ns() const;
+
+    void set_frame_clock(const FrameClock *clock) { frame_clock_ = clock; }
+
+    [[nodiscard]] const FrameClock *get_frame_clock() const { return frame_clock_; }
+
+    // the group drawing this window together with the others on its output, see FrameGroup::add()
+    [[nodiscard]] FrameGroup *get_frame_group() const { return frame_group_; }
+
+    static void dispatch_schedule(void *data);
+
+    void set_presentation_callback(const std::function<void(const PresentationFeedback &feedback)> &callback) {
+        presentation_callback_ = callback;
+    }
+
+    [[nodiscard]] const PresentationFeedback &get_last_presentation() const { return last_presentation_; }
+
+    void on_next_frame(const std::function<void(uint32_t time)> &callback);
+
+    void on_next_presentation(const std::function<void(const PresentationFeedback &feedback)> &callback);
+
+    [[nodiscard]] uint64_t get_presented_count() const { return presented_count_; }
+
+    [[nodiscard]] uint64_t get_discarded_count() const { return discarded_count_; }
+
+    /**
+     * @brief Frame time, render time and latency percentiles, missed vblanks and FPS.
+     *
+     * Safe to read from any thread, e.g. a monitoring thread taking get_snapshot().
+     */
+    [[nodiscard]] const FrameStats &get_frame_stats() const { return frame_stats_; }
+
+    // set before each draw to the frame's predicted presentation, see AnimationClock
+    [[nodiscard]] const AnimationClock &get_animation_clock() const { return animation_clock_; }
+
+    void reset_frame_stats() { frame_stats_.reset(); }
+
+    void record_input(uint64_t time_ns);
+
+    /**
+     * @brief Input events for this window, pushed by the thread dispatching the default queue.
+     *
+     * The render thread is the single consumer: drain it at the start of each draw callback.
+     *
+     * @code
+     * wm->get_input_ring().drain([&](const InputEvent &event) { app.handle(event); });
+     * @endcode
+     */
+    [[nodiscard]] InputRing &get_input_ring() { return input_ring_; }
+
+    /**
+     * @brief Scratch memory for the frame being drawn, freed after its commit.
+     *
+     * Only valid from the frame handlers and draw callback, see FrameArena.
+     */
+    [[nodiscard]] FrameArena &get_frame_arena() { return frame_arena_; }
+
+    /**
+     * @brief Sets a member function of obj as the frame handler.
+     *
+     * Fn is bound at compile time, so the frame path calls it through a plain
+     * function pointer instead of the type-erased draw callback.
+     *
+     * @code
+     * window->set_frame_handler<&Renderer::draw>(&renderer);
+     * @endcode
+     */
+    template<auto Fn, typename T>
+    void set_frame_handler(T *obj) {
+        frame_handler_ = listener_thunk<Fn>;
+        input_frame_handler_ = nullptr;
+        frame_handler_data_ = obj;
+    }
+
+    /**
+     * @brief Sets a member function of obj as the frame handler, receiving the frame's input.
+     *
+     * Replaces the other frame handlers. Before each draw the window drains its input
+     * ring and passes the events together with the target presentation time, so input
+     * is processed once per frame alongside rendering. Don't drain get_input_ring()
+     * elsewhere while this is set.
+     *
+     * @code
+     * window->set_input_frame_handler<&Renderer::draw>(&renderer);
+     * // void Renderer::draw(const Window::FrameInput &frame)
+     * @endcode
+     */
+    template<auto Fn, typename T>
+    void set_input_frame_handler(T *obj) {
+        input_frame_handler_ = listener_thunk<Fn>;
+        frame_handler_ = nullptr;
+        frame_handler_data_ = obj;
+    }
+
+    /**
+     * @brief Sets a callable, e.g. a lambda, as the frame handler without taking ownership.
+     *
+     * Nothing is copied or allocated, whatever the captures; the call goes through a
+     * thunk generated for F, into which the callable's body can be inlined. The
+     * callable must outlive the window, or be replaced first.
+     *
+     * @code
+     * auto draw = [&](uint32_t time) { renderer.draw(time); };
+     * window->set_frame_handler(draw);
+     * @endcode
+     */
+    template<typename F>
+    void set_frame_handler(F &callable) {
+        frame_handler_ = [](void *data, uint32_t time) { (*static_cast<F *>(data))(time); };
+        input_frame_handler_ = nullptr;
+        frame_handler_data_ = &callable;
+    }
+
+    /**
+     * @brief Sets a callable taking the frame's input as the frame handler, without taking ownership.
+     *
+     * See set_input_frame_handler() and set_frame_handler(F &).
+     */
+    template<typename F>
+    void set_input_frame_handler(F &callable) {
+        input_frame_handler_ = [](void *data, const FrameInput &frame) { (*static_cast<F *>(data))(frame); };
+        frame_handler_ = nullptr;
+        frame_handler_data_ = &callable;
+    }
+
     friend class WindowEgl;
 
     friend class WindowVulkan;
 
     friend class WindowManager;
 
+    friend class FrameGroup;
+
 private:
     struct wl_surface *wl_surface_{};
     struct wl_callback *wl_callback_{};
 
+    struct wl_display *queue_display_{};
+    struct wl_event_queue *wl_event_queue_{};
+    // false if the queue is shared, e.g. by a RenderPool worker
+    bool owns_event_queue_{};
+    // wl_surface_ proxy wrapper whose new objects are assigned to wl_event_queue_
+    struct wl_surface *wl_surface_wrapper_{};
+
+    struct wp_presentation *wp_presentation_{};
+    // wp_presentation_ proxy wrapper whose feedback objects are assigned to wl_event_queue_
+    struct wp_presentation *wp_presentation_wrapper_{};
+    struct PendingFeedback {
+        struct wp_presentation_feedback *feedback;
+        uint64_t commit;
+        // when rendering of the commit started, for the latency statistics
+        uint64_t start_ns;
+        // earliest input event handled before the commit was rendered, 0 if none
+        uint64_t input_ns;
+    };
+    // outstanding feedback objects and the commit each was requested for
+    std::vector<PendingFeedback> pending_feedback_;
+    uint64_t commit_count_{};
+    uint64_t presented_count_{};
+    uint64_t discarded_count_{};
+    // 0 without blank detection
+    uint64_t blank_timeout_ns_{};
+    // start of the oldest frame committed since the last presented one, 0 if there is none
+    uint64_t unpresented_since_ns_{};
+    bool blanked_{};
+    PresentationFeedback last_presentation_{};
+    std::function<void(const PresentationFeedback &feedback)> presentation_callback_;
+    // one-shot callbacks, see on_next_frame() and on_next_presentation()
+    std::vector<std::function<void(uint32_t time)>> frame_waiters_;
+    std::vector<std::function<void(const PresentationFeedback &feedback)>> presentation_waiters_;
+    clockid_t presentation_clock_{CLOCK_MONOTONIC};
+    // output the commit of the feedback being handled was synchronized to
+    struct wl_output *sync_output_{};
+    // of the primary output, the deadlines follow it rather than this window's own feedback
+    const FrameClock *frame_clock_{};
+    FrameGroup *frame_group_{};
+    // the frame callback arrived and the group has yet to draw it
+    bool group_pending_{};
+    uint32_t group_time_{};
+    RefreshMode refresh_mode_{REFRESH_FIXED};
+    // feedback intervals off the vblank grid count up, ones on it count down
+    int vrr_evidence_{};
+    // shortest and longest frame interval of the output, 0 to derive them from the refresh rate
+    uint64_t min_interval_ns_{};
+    uint64_t max_interval_ns_{};
+    // frame rate cap in effect, 0 for none; the one set by set_max_fps() and tightened while unfocused or idle
+    uint32_t max_fps_{};
+    uint32_t requested_max_fps_{};
+    // applied while the window has neither the activated state nor keyboard focus
+    bool focus_throttle_{};
+    uint32_t unfocused_fps_{};
+    bool unfocused_on_demand_{};
+    bool focused_{true};
+    // applied while nobody used any seat for a while, see set_idle()
+    bool idle_throttle_{};
+    uint32_t idle_fps_{};
+    bool idle_on_demand_{};
+    bool idle_{};
+    // commits waiting for presentation before a frame callback is passed up, 0 for no limit
+    uint32_t max_queued_commits_{};
+    uint64_t throttled_count_{};
+    uint64_t last_frame_start_ns_{};
+    uint64_t input_redraws_{};
+
+    struct wp_content_type_manager_v1 *wp_content_type_manager_{};
+    struct wp_content_type_v1 *wp_content_type_{};
+    ContentType content_type_{CONTENT_NONE};
+    struct wp_alpha_modifier_v1 *wp_alpha_modifier_{};
+#if defined(ENABLE_ALPHA_MODIFIER)
+    // created with the first set_opacity()
+    std::unique_ptr<AlphaModifier> alpha_modifier_;
+#endif
+    const ColorManager *color_manager_{};
+#if defined(ENABLE_COLOR_MANAGEMENT)
+    // created with the first set_color_description()
+    std::unique_ptr<ColorSurface> color_surface_;
+#endif
+    // applied to the first commit of each frame, usually the buffer's
+    struct wp_fifo_manager_v1 *wp_fifo_manager_{};
+    struct wp_fifo_v1 *wp_fifo_{};
+    bool fifo_{};
+    struct wp_commit_timing_manager_v1 *wp_commit_timing_manager_{};
+    struct wp_commit_timer_v1 *wp_commit_timer_{};
+    bool commit_timing_{};
+
+    // deadline scheduler: timerfd that fires at "predicted vblank - render time - margin"
+    int schedule_fd_{-1};
+    GSource *schedule_source_{};
+    bool frame_scheduled_{};
+    uint32_t scheduled_time_{};
+    uint64_t scheduler_margin_ns_{};
+    uint64_t refresh_hint_ns_{};
+    // peak-tracking average and last value of the time spent in the draw callback
+    uint64_t render_time_ns_{};
+    uint64_t last_render_time_ns_{};
+
+    FrameStats frame_stats_;
+    AnimationClock animation_clock_;
+    // earliest input not yet followed by a frame, in the presentation clock domain
+    std::atomic<uint64_t> pending_input_ns_{};
+    InputRing input_ring_;
+    // the next frame does not follow the previous one, its interval is not a frame time
+    bool frames_restarted_{true};
+
+    // render-on-demand: frame callbacks are only requested after request_redraw()
+    bool on_demand_{};
+    bool requested_on_demand_{};
+    // latency-critical windows flush their frame commit themselves, see Display::set_flush_policy()
+    struct wl_display *flush_display_{};
+    bool redraw_requested_{};
+    bool rendering_{};
+    // no frame callbacks are requested while paused, e.g. when the window is hidden
+    bool paused_{};
+
+    // committed by render_frame together with the window surface
+    SurfaceTransaction transaction_;
+
     ShellType shell_type_;
 
+    // name of the window's trace track
+    std::string trace_track_;
+
     std::function<void(void *data, uint32_t time)> draw_callback_;
+    void (*frame_handler_)(void *data, uint32_t time){};
+    void *frame_handler_data_{};
+    void (*input_frame_handler_)(void *data, const FrameInput &frame){};
+    // events drained from input_ring_ for the current frame
+    std::array<InputEvent, InputRing::capacity()> frame_events_{};
+    MotionBatch frame_motion_;
+    FrameArena frame_arena_;
 
     void start_frames();
 
-    void stop_frames() const;
+    void stop_frames();
+
+    void update_frame_rate();
+
+    void on_frame(struct wl_callback *callback, uint32_t time);
+
+    void render_frame(uint32_t time);
+
+    void arm_frame_callback();
+
+    [[nodiscard]] uint64_t now_ns() const;
+
+    void get_vblank_timing(uint64_t &refresh_ns, uint64_t &last_ns) const;
 
-    static void on_frame(void *data, struct wl_callback *callback, uint32_t time);
+    void update_refresh_mode(const PresentationFeedback &previous, const PresentationFeedback &current);
+
+    [[nodiscard]] uint64_t get_min_interval_ns() const;
+
+    [[nodiscard]] uint32_t get_frame_divisor() const;
+
+    [[nodiscard]] uint64_t get_frame_due_ns() const;
+
+    [[nodiscard]] uint64_t next_deadline_ns(uint64_t now) const;
+
+    [[nodiscard]] uint64_t predict_presentation_ns(uint64_t now) const;
+
+    void prepare_commit_timing(uint64_t target_present_ns);
+
+    void commit_state();
+
+    [[nodiscard]] bool close_frame_scheduler();
 
     static const struct wl_callback_listener frame_listener_;
+
+    // marks the surfaces whose user data is a Window, see from_surface()
+    static const char *const surface_tag_;
+
+    void request_presentation_feedback(uint64_t start_ns, uint64_t input_ns);
+
+    void complete_feedback(struct wp_presentation_feedback *feedback, const PresentationFeedback &result);
+
+    void handle_sync_output(struct wp_presentation_feedback *feedback, struct wl_output *output);
+
+    void handle_presented(struct wp_presentation_feedback *feedback,
+                          uint32_t tv_sec_hi,
+                          uint32_t tv_sec_lo,
+                          uint32_t tv_nsec,
+                          uint32_t refresh,
+                          uint32_t seq_hi,
+                          uint32_t seq_lo,
+                          uint32_t flags);
+
+    void handle_discarded(struct wp_presentation_feedback *feedback);
+
+    static const struct wp_presentation_feedback_listener feedback_listener_;
 };
 
 #endif // SRC_WINDOW_WINDOW_H_
\ No newline at end of file
@@ -0,0 +1,341 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "window_dmabuf.h"
+
+#include <climits>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "window_manager/display.h"
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+/**
+ * @class WindowDmabuf
+ * @brief Presents externally allocated dmabufs on a surface without a copy.
+ *
+ * Buffers from GBM, V4L2 or a hardware decoder are imported once as wl_buffers through
+ * zwp_linux_dmabuf_v1 and attached directly, so the compositor samples or scans out the
+ * producer's memory. The release callback reports when a buffer may be written again.
+ *
+ * With linux-dmabuf v4 the window tracks the feedback for its surface. The compositor
+ * sends a scanout tranche once the surface could be put on a plane, typically when it
+ * goes fullscreen; the reallocate callback then asks the producer for buffers in the
+ * preferred format and modifier, so composition can be skipped altogether.
+ *
+ * enable_explicit_sync() replaces implicit dmabuf fences with syncobj acquire and
+ * release points where the compositor supports wp_linux_drm_syncobj_v1.
+ *
+ * @param display The display the linux-dmabuf global was bound on.
+ * @param surface The surface whose role the caller manages, e.g. an xdg_toplevel.
+ */
+WindowDmabuf::WindowDmabuf(const Display *display, struct wl_surface *surface) :
+        display_(display),
+        wl_surface_(surface) {
+    if (!display_->get_linux_dmabuf()) {
+        throw std::runtime_error("zwp_linux_dmabuf_v1 is not available.");
+    }
+    if (display_->get_linux_dmabuf_version() >= ZWP_LINUX_DMABUF_V1_GET_SURFACE_FEEDBACK_SINCE_VERSION) {
+        surface_feedback_ = std::make_unique<DmabufFeedback>(
+                zwp_linux_dmabuf_v1_get_surface_feedback(display_->get_linux_dmabuf(), wl_surface_));
+        surface_feedback_->set_done_callback([this]() { handle_surface_feedback(); });
+    }
+}
+
+/**
+ * @brief Destroys every buffer that was imported and not yet destroyed.
+ */
+WindowDmabuf::~WindowDmabuf() {
+    surface_feedback_.reset();
+    syncobj_surface_.reset();
+    timeline_.reset();
+    for (const auto &[buffer, state]: buffers_) {
+        wl_buffer_destroy(buffer);
+        zwp_linux_buffer_params_v1_destroy(state.params);
+    }
+}
+
+/**
+ * @brief Imports a dmabuf as a wl_buffer.
+ *
+ * Uses create_immed, so the buffer is usable without a round trip; the format and
+ * modifier are checked against the advertised pairs beforehand. A compositor may still
+ * reject the import later, then the buffer is never attached and the import failed
+ * callback reports it.
+ *
+ * @param attributes The dmabuf planes and layout.
+ * @return The buffer, owned by this window until destroy_buffer(), or nullptr if the
+ *         format and modifier pair is not supported.
+ */
+struct wl_buffer *WindowDmabuf::import(const DmabufAttributes &attributes) {
+    if (!display_->supports_dmabuf_format(attributes.format, attributes.modifier) &&
+        !(surface_feedback_ && surface_feedback_->supports(attributes.format, attributes.modifier))) {
+        LOG_ERROR("dmabuf format 0x%x modifier 0x%llx is not supported by the compositor", attributes.format,
+                  static_cast<unsigned long long>(attributes.modifier));
+        return nullptr;
+    }
+    if (display_->get_linux_dmabuf_version() < ZWP_LINUX_BUFFER_PARAMS_V1_CREATE_IMMED_SINCE_VERSION) {
+        LOG_ERROR("zwp_linux_dmabuf_v1 version %u lacks create_immed", display_->get_linux_dmabuf_version());
+        return nullptr;
+    }
+    if (attributes.num_planes == 0 || attributes.num_planes > DmabufAttributes::kMaxPlanes) {
+        return nullptr;
+    }
+
+    auto params = zwp_linux_dmabuf_v1_create_params(display_->get_linux_dmabuf());
+    const auto modifier_hi = static_cast<uint32_t>(attributes.modifier >> 32);
+    const auto modifier_lo = static_cast<uint32_t>(attributes.modifier & 0xffffffff);
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < attributes.num_planes; i++) {
+        zwp_linux_buffer_params_v1_add(params, attributes.fd[i], i, attributes.offset[i], attributes.stride[i],
+                                       modifier_hi, modifier_lo);
+        bytes += static_cast<uint64_t>(attributes.stride[i]) * static_cast<uint64_t>(attributes.height);
+    }
+    // a rejected import is reported on params, so they live as long as the buffer
+    zwp_linux_buffer_params_v1_add_listener(params, &params_listener_, this);
+    auto buffer = zwp_linux_buffer_params_v1_create_immed(params, attributes.width, attributes.height,
+                                                          attributes.format, attributes.flags);
+
+    wl_buffer_add_listener(buffer, &buffer_listener_, this);
+    buffers_[buffer] = {false, 0, bytes, params, false};
+    imported_bytes_ += bytes;
+    return buffer;
+}
+
+/**
+ * @brief Destroys an imported buffer.
+ *
+ * Destroying a buffer the compositor still holds is allowed; the surface keeps its
+ * contents until another buffer is attached.
+ *
+ * @param buffer A buffer returned by import().
+ */
+void WindowDmabuf::destroy_buffer(struct wl_buffer *buffer) {
+    const auto it = buffers_.find(buffer);
+    if (it != buffers_.end()) {
+        imported_bytes_ -= it->second.bytes;
+        zwp_linux_buffer_params_v1_destroy(it->second.params);
+        buffers_.erase(it);
+        wl_buffer_destroy(buffer);
+    }
+}
+
+/**
+ * @brief Attaches a buffer and damages the whole surface.
+ *
+ * The buffer is shown with the next surface commit, made by the frame loop after the
+ * draw callback, and stays busy until the compositor releases it.
+ *
+ * With explicit sync the compositor waits for acquire_fence before reading the buffer,
+ * so the producer does not have to finish rendering first; without a fence the buffer
+ * must be complete when attached. Without explicit sync the fence is not needed, the
+ * kernel tracks the dmabuf's implicit fences.
+ *
+ * A buffer whose import the compositor rejected is not attached.
+ *
+ * @param buffer        A buffer returned by import().
+ * @param acquire_fence A sync_file fd signalled when the buffer is written, e.g. from
+ *                      Egl::create_native_fence(), always consumed; -1 for none.
+ */
+void WindowDmabuf::attach(struct wl_buffer *buffer, int acquire_fence) {
+    const auto it = buffers_.find(buffer);
+    if (it == buffers_.end() || it->second.failed) {
+        if (acquire_fence >= 0) {
+            close(acquire_fence);
+        }
+        return;
+    }
+    it->second.busy = true;
+    wl_surface_attach(wl_surface_, buffer, 0, 0);
+    if (wl_surface_get_version(wl_surface_) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+        wl_surface_damage_buffer(wl_surface_, 0, 0, INT32_MAX, INT32_MAX);
+    } else {
+        wl_surface_damage(wl_surface_, 0, 0, INT32_MAX, INT32_MAX);
+    }
+
+    if (!syncobj_surface_) {
+        if (acquire_fence >= 0) {
+            close(acquire_fence);
+        }
+        return;
+    }
+    // every commit with a buffer needs both points; release must come after acquire on a shared timeline
+    const auto acquire_point = ++timeline_point_;
+    if (acquire_fence < 0 || !timeline_->import_sync_file(acquire_point, acquire_fence)) {
+        (void) timeline_->signal(acquire_point);
+    }
+    it->second.release_point = ++timeline_point_;
+    syncobj_surface_->set_acquire_point(*timeline_, acquire_point);
+    syncobj_surface_->set_release_point(*timeline_, it->second.release_point);
+}
+
+/**
+ * @return true while the compositor may still read from buffer.
+ */
+bool WindowDmabuf::is_busy(struct wl_buffer *buffer) const {
+    const auto it = buffers_.find(buffer);
+    if (it == buffers_.end()) {
+        return false;
+    }
+    return it->second.busy ||
+           (syncobj_surface_ && it->second.release_point && !timeline_->is_signaled(it->second.release_point));
+}
+
+/**
+ * @brief Switches the surface to explicit synchronization with wp_linux_drm_syncobj_v1.
+ *
+ * Call before the first attach. From then on buffers are reused on their release point
+ * rather than on implicit dmabuf fences, which some drivers, e.g. NVIDIA, implement at a
+ * cost or not at all.
+ *
+ * @return false if the compositor or the DRM device lacks timeline syncobjs.
+ */
+bool WindowDmabuf::enable_explicit_sync() {
+    if (syncobj_surface_) {
+        return true;
+    }
+    const auto manager = display_->get_drm_syncobj_manager();
+    const auto feedback = surface_feedback_ ? surface_feedback_.get() : display_->get_dmabuf_feedback();
+    if (!manager || !feedback) {
+        return false;
+    }
+    try {
+        timeline_ = std::make_unique<DrmSyncobjTimeline>(manager, feedback->get_main_device());
+    } catch (const std::runtime_error &e) {
+        LOG_WARN("explicit sync unavailable: %s", e.what());
+        return false;
+    }
+    syncobj_surface_ = std::make_unique<DrmSyncobjSurface>(manager, wl_surface_);
+    return true;
+}
+
+/**
+ * @brief Returns a fence signalled when the compositor is done reading buffer.
+ *
+ * Lets a GPU producer wait for the release on the GPU, e.g. with
+ * Egl::wait_native_fence(), instead of waiting on the CPU for is_busy() to clear. The
+ * compositor attaches the fence to the release point once it has used the buffer, so
+ * call this after the wl_buffer.release callback.
+ *
+ * @param buffer A buffer returned by import().
+ * @return A sync_file fd owned by the caller, or -1 without explicit sync.
+ */
+int WindowDmabuf::get_release_fence(struct wl_buffer *buffer) const {
+    const auto it = buffers_.find(buffer);
+    if (!syncobj_surface_ || it == buffers_.end() || !it->second.release_point) {
+        return -1;
+    }
+    return timeline_->export_sync_file(it->second.release_point);
+}
+
+/**
+ * @brief Returns the tranche buffers should currently be allocated from.
+ *
+ * That is the scanout tranche when the compositor offers one, otherwise the first,
+ * most preferred, tranche of the surface feedback.
+ *
+ * @return The tranche, or nullptr without surface feedback.
+ */
+const DmabufFeedback::Tranche *WindowDmabuf::get_preferred_tranche() const {
+    if (!surface_feedback_ || surface_feedback_->get_tranches().empty()) {
+        return nullptr;
+    }
+    const auto &tranches = surface_feedback_->get_tranches();
+    for (const auto &tranche: tranches) {
+        if (tranche.flags & ZWP_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_FLAGS_SCANOUT) {
+            return &tranche;
+        }
+    }
+    return &tranches.front();
+}
+
+/**
+ * @return true if the compositor currently offers the surface a scanout tranche.
+ */
+bool WindowDmabuf::is_scanout_candidate() const {
+    const auto tranche = get_preferred_tranche();
+    return tranche && (tranche->flags & ZWP_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_FLAGS_SCANOUT);
+}
+
+/**
+ * @brief Requests a reallocation when the preferred tranche changed.
+ *
+ * The compositor resends the whole feedback on every change, so an unchanged
+ * preferred tranche, e.g. after a main device update alone, is ignored.
+ */
+void WindowDmabuf::handle_surface_feedback() {
+    const auto tranche = get_preferred_tranche();
+    if (!tranche) {
+        return;
+    }
+    if (tranche->target_device == last_preferred_.target_device &&
+        tranche->flags == last_preferred_.flags &&
+        tranche->formats == last_preferred_.formats) {
+        return;
+    }
+    last_preferred_ = *tranche;
+    if (reallocate_callback_) {
+        reallocate_callback_(last_preferred_);
+    }
+}
+
+void WindowDmabuf::handle_release(struct wl_buffer *buffer) {
+    const auto it = buffers_.find(buffer);
+    if (it == buffers_.end()) {
+        return;
+    }
+    it->second.busy = false;
+    if (release_callback_) {
+        release_callback_(buffer);
+    }
+}
+
+void WindowDmabuf::handle_params_created(struct zwp_linux_buffer_params_v1 * /* params */,
+                                         struct wl_buffer * /* buffer */) {
+    // only sent for create, a create_immed buffer exists from the request
+}
+
+/**
+ * @brief Marks the buffer of a rejected import failed and reports it.
+ *
+ * The compositor sends failed rather than raising a protocol error; the wl_buffer
+ * cannot be used from then on, attaching it would be one.
+ */
+void WindowDmabuf::handle_params_failed(struct zwp_linux_buffer_params_v1 *params) {
+    for (auto &[buffer, state]: buffers_) {
+        if (state.params != params) {
+            continue;
+        }
+        LOG_ERROR("compositor rejected dmabuf import");
+        state.failed = true;
+        if (import_failed_callback_) {
+            import_failed_callback_(buffer);
+        }
+        return;
+    }
+}
+
+const struct wl_buffer_listener WindowDmabuf::buffer_listener_ = {
+        .release = listener_thunk<&WindowDmabuf::handle_release>,
+};
+
+const struct zwp_linux_buffer_params_v1_listener WindowDmabuf::params_listener_ = {
+        .created = listener_thunk<&WindowDmabuf::handle_params_created>,
+        .failed = listener_thunk<&WindowDmabuf::handle_params_failed>,
+};
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_WINDOW_DMABUF_H_
+#define SRC_WINDOW_WINDOW_DMABUF_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+
+#include <wayland-client.h>
+
+#include "linux-dmabuf-unstable-v1-client-protocol.h"
+
+#include "window_manager/dmabuf_feedback.h"
+#include "drm_syncobj.h"
+#include "utils/export.h"
+
+class Display;
+
+struct DmabufAttributes {
+    static constexpr uint32_t kMaxPlanes = 4;
+
+    int32_t width;
+    int32_t height;
+    // DRM fourcc format
+    uint32_t format;
+    // DRM format modifier shared by all planes, kDrmFormatModInvalid for an implicit modifier
+    uint64_t modifier;
+    // ZWP_LINUX_BUFFER_PARAMS_V1_FLAGS_* flags
+    uint32_t flags;
+    uint32_t num_planes;
+    // the fds stay owned by the caller, the compositor receives duplicates
+    int fd[kMaxPlanes];
+    uint32_t offset[kMaxPlanes];
+    uint32_t stride[kMaxPlanes];
+};
+
+class WAYPP_EXPORT WindowDmabuf {
+public:
+    explicit WindowDmabuf(const Display *display, struct wl_surface *surface);
+
+    ~WindowDmabuf();
+
+    WindowDmabuf(const WindowDmabuf &) = delete;
+
+    WindowDmabuf &operator=(const WindowDmabuf &) = delete;
+
+    [[nodiscard]] struct wl_buffer *import(const DmabufAttributes &attributes);
+
+    void destroy_buffer(struct wl_buffer *buffer);
+
+    void attach(struct wl_buffer *buffer, int acquire_fence = -1);
+
+    [[nodiscard]] bool is_busy(struct wl_buffer *buffer) const;
+
+    bool enable_explicit_sync();
+
+    [[nodiscard]] bool is_explicit_sync() const { return syncobj_surface_ != nullptr; }
+
+    [[nodiscard]] int get_release_fence(struct wl_buffer *buffer) const;
+
+    void set_release_callback(const std::function<void(struct wl_buffer *buffer)> &callback) {
+        release_callback_ = callback;
+    }
+
+    // the compositor rejected an import; the buffer is never shown and should be destroyed
+    void set_import_failed_callback(const std::function<void(struct wl_buffer *buffer)> &callback) {
+        import_failed_callback_ = callback;
+    }
+
+    void set_reallocate_callback(const std::function<void(const DmabufFeedback::Tranche &tranche)> &callback) {
+        reallocate_callback_ = callback;
+    }
+
+    [[nodiscard]] const DmabufFeedback *get_surface_feedback() const { return surface_feedback_.get(); }
+
+    [[nodiscard]] const DmabufFeedback::Tranche *get_preferred_tranche() const;
+
+    [[nodiscard]] bool is_scanout_candidate() const;
+
+    // stride times height of every plane of the imported buffers, an upper bound for subsampled planes
+    [[nodiscard]] uint64_t get_imported_bytes() const { return imported_bytes_; }
+
+private:
+    const Display *display_;
+    struct wl_surface *wl_surface_;
+
+    struct BufferState {
+        // attached and not yet released by the compositor
+        bool busy;
+        // signalled once the compositor is done reading, with explicit sync
+        uint64_t release_point;
+        uint64_t bytes;
+        // the import, kept with the buffer to hear if the compositor rejects it
+        struct zwp_linux_buffer_params_v1 *params;
+        bool failed;
+    };
+
+    // imported buffers and whether the compositor still holds each
+    std::map<struct wl_buffer *, BufferState> buffers_;
+    uint64_t imported_bytes_{};
+    std::function<void(struct wl_buffer *buffer)> release_callback_;
+    std::function<void(struct wl_buffer *buffer)> import_failed_callback_;
+
+    // per-surface feedback, v4 and later
+    std::unique_ptr<DmabufFeedback> surface_feedback_;
+    // preferred tranche the buffers were last (re)allocated for
+    DmabufFeedback::Tranche last_preferred_{};
+    std::function<void(const DmabufFeedback::Tranche &tranche)> reallocate_callback_;
+
+    // explicit sync, acquire and release points share one timeline
+    std::unique_ptr<DrmSyncobjTimeline> timeline_;
+    std::unique_ptr<DrmSyncobjSurface> syncobj_surface_;
+    uint64_t timeline_point_{};
+
+    void handle_surface_feedback();
+
+    void handle_release(struct wl_buffer *buffer);
+
+    void handle_params_created(struct zwp_linux_buffer_params_v1 *params, struct wl_buffer *buffer);
+
+    void handle_params_failed(struct zwp_linux_buffer_params_v1 *params);
+
+    static const struct wl_buffer_listener buffer_listener_;
+
+    static const struct zwp_linux_buffer_params_v1_listener params_listener_;
+};
+
+#endif // SRC_WINDOW_WINDOW_DMABUF_H_
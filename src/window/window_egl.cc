@@ -16,45 +16,79 @@
 
 #include "window_egl.h"
 
-#include <iostream>
+#include <algorithm>
+#include <cmath>
 
 #include <wayland-egl.h>
 
+#include "utils/logging.h"
+#include "utils/startup_profiler.h"
+
 /**
  * @class WindowEgl
  * @brief The WindowEgl class represents a window using EGL for rendering.
  *
- * This class is responsible for managing an EGL window surface for rendering on a Wayland compositor. It creates an EGL window surface and initializes the EGL context. It also provides
+ * This class is responsible for managing an EGL window surface for rendering on a Wayland compositor. It creates an EGL window surface
+* on the shared EglDisplay, so creating a window does not re-initialize EGL. It also provides
 * a callback for rendering the window contents.
  */
-WindowEgl::WindowEgl(struct wl_display *display, struct wl_compositor * /* compositor */, struct wl_surface *surface,
+WindowEgl::WindowEgl(const EglDisplay *egl_display, struct wl_compositor *compositor,
+                     struct wl_surface *surface,
                      int width, int height,
                      Window::ShellType /* shell_type */,
-                     const std::function<void(void *data, uint32_t time)> & /* draw_callback */) :
-        Egl(display) {
+                     const std::function<void(void *data, uint32_t time)> & /* draw_callback */,
+                     const WindowEglConfig &config) :
+        Egl(egl_display, egl_attribs(config), config.own_context),
+        wl_compositor_(compositor),
+        opaque_(config.opaque),
+        buffering_(config.buffering),
+        width_(width),
+        height_(height),
+        buffer_width_(width),
+        buffer_height_(height) {
 
-    std::cout << "width: " << width << std::endl;
-    std::cout << "height: " << height << std::endl;
+    LOG_DEBUG("width: %d, height: %d", width, height);
 
-    if (egl_window_) {
-        wl_egl_window_destroy(egl_window_);
+    wl_surface_ = surface;
+    update_opaque_region(width, height);
+    (void) create_surface();
+    if (config.present_thread) {
+        (void) enable_present_thread();
     }
-    egl_window_ = wl_egl_window_create(surface, width, height);
+}
 
-    if (egl_surface_) {
-        eglDestroySurface(dpy_, egl_surface_);
-    }
+/**
+ * @brief Creates the wl_egl_window and EGL window surface at the current buffer size.
+ *
+ * @return false if the EGL surface could not be created.
+ */
+bool WindowEgl::create_surface() {
+    egl_window_ = wl_egl_window_create(wl_surface_, buffer_width_, buffer_height_);
 
-    auto create_platform_window =
-            reinterpret_cast<PFNEGLCREATEPLATFORMWINDOWSURFACEEXTPROC>(
-                    eglGetProcAddress("eglCreatePlatformWindowSurfaceEXT"));
+    const auto create_platform_window = egl_display_->get_dispatch().create_platform_window_surface;
 
+    StartupProfiler::begin(StartupProfiler::EGL_CREATE_SURFACE);
     if (create_platform_window) {
         egl_surface_ = create_platform_window(dpy_, config_, egl_window_, nullptr);
     } else {
         egl_surface_ = eglCreateWindowSurface(
                 dpy_, config_, reinterpret_cast<EGLNativeWindowType>(egl_window_), nullptr);
     }
+    StartupProfiler::end(StartupProfiler::EGL_CREATE_SURFACE);
+    if (egl_surface_ == EGL_NO_SURFACE) {
+        LOG_ERROR("eglCreateWindowSurface failed: 0x%x", eglGetError());
+        return false;
+    }
+
+    // frames are paced by Window's frame callbacks; a non-zero interval makes
+    // eglSwapBuffers wait on its own frame callback as well, costing a frame of latency
+    if (make_current()) {
+        if (eglSwapInterval(dpy_, 0) == EGL_FALSE) {
+            LOG_WARN("eglSwapInterval(0) failed: 0x%x", eglGetError());
+        }
+        (void) clear_current();
+    }
+    return true;
 }
 
 /**
@@ -65,9 +99,337 @@ WindowEgl::WindowEgl(struct wl_display *display, struct wl_compositor * /* compo
  * It provides functionality to destroy the EGL surface and associated resources.
  */
 WindowEgl::~WindowEgl() {
-    eglDestroySurface(dpy_, egl_surface_);
+    disable_present_thread();
+    disable_gpu_timer();
+    release_surface();
+}
 
+/**
+ * @brief Destroys the EGL window surface and its wl_egl_window, freeing the buffers behind them.
+ *
+ * The context, and with it every texture, buffer and shader object, is kept, as are
+ * size, scale and viewport, so restore_surface() brings the window back without the
+ * application reloading anything. Nothing is drawn until then; the compositor keeps
+ * showing the last frame.
+ */
+void WindowEgl::release_surface() {
+    if (!egl_window_) {
+        return;
+    }
+    if (present_thread_) {
+        present_thread_->wait_idle();
+    }
+    if (egl_surface_ != EGL_NO_SURFACE) {
+        release_current(egl_surface_, EGL_NO_CONTEXT);
+        eglDestroySurface(dpy_, egl_surface_);
+        egl_surface_ = EGL_NO_SURFACE;
+    }
+    wl_egl_window_destroy(egl_window_);
+    egl_window_ = nullptr;
+    // the new surface's buffers hold no earlier frame
+    damage_tracker_.reset();
+}
+
+/**
+ * @brief Recreates the surface released by release_surface(), before the next frame is drawn.
+ *
+ * @return false if the EGL surface could not be created.
+ */
+bool WindowEgl::restore_surface() {
     if (egl_window_) {
-        wl_egl_window_destroy(egl_window_);
+        return true;
+    }
+    return create_surface();
+}
+
+/**
+ * @brief Makes the context current on the window and sets its damage region, see Egl::begin_frame().
+ *
+ * @param damage The regions that change in this frame, empty for all of it.
+ * @return The regions to repaint; empty while the surface is released, no frame is drawn then.
+ */
+std::vector<WindowEgl::Rect> WindowEgl::begin_frame(const std::vector<Rect> &damage) {
+    if (present_thread_ && present_thread_->is_busy()) {
+        // still waiting for a buffer to draw into; the next frame callback tries again
+        present_skips_++;
+        return {};
+    }
+    if (!egl_window_ || !make_current()) {
+        return {};
+    }
+    return Egl::begin_frame(damage);
+}
+
+/**
+ * @brief Swaps with the damage passed to begin_frame(), on the present thread if enabled.
+ *
+ * @return false if the swap failed.
+ */
+bool WindowEgl::end_frame(const std::vector<Rect> &damage) {
+    if (present_thread_) {
+        (void) clear_current();
+        return present_thread_->present(damage);
+    }
+    return swap_buffers(damage);
+}
+
+/**
+ * @brief Moves the swap, and the wait for the next back buffer, to a thread of its own.
+ *
+ * Only frames drawn through begin_frame() and end_frame() go through the present
+ * thread; begin_frame() returns no region while it is busy, so the frame loop goes
+ * back to dispatching input instead of waiting for the compositor to release a buffer.
+ * Compare get_last_swap_time_ns() and get_blocked_swap_count() with and without it.
+ *
+ * @param attributes Priority and CPUs of the present thread.
+ * @return true once the thread runs.
+ */
+bool WindowEgl::enable_present_thread(const ThreadAttributes &attributes) {
+    if (!present_thread_) {
+        present_thread_ = std::make_unique<PresentThread>(this, attributes);
+    }
+    return true;
+}
+
+/**
+ * @brief Swaps on the drawing thread again, after the frame in flight.
+ */
+void WindowEgl::disable_present_thread() {
+    present_thread_.reset();
+}
+
+/**
+ * @brief The buffers the window's buffering needs: the one on screen, those queued and the one drawn.
+ *
+ * A get_max_buffer_age() above this means the compositor held buffers past their
+ * presentation, and the driver allocated more instead of blocking in the swap.
+ */
+EGLint WindowEgl::get_expected_buffer_count() const {
+    switch (buffering_) {
+        case WindowEglConfig::BUFFERING_DOUBLE:
+        case WindowEglConfig::BUFFERING_MIN_LATENCY:
+            return 2;
+        case WindowEglConfig::BUFFERING_TRIPLE:
+            return 3;
+        case WindowEglConfig::BUFFERING_DEFAULT:
+            break;
+    }
+    return 0;
+}
+
+/**
+ * @brief Estimates what the surface's buffers cost, from the config's sizes and the buffers seen in rotation.
+ *
+ * Drivers round pixels up to a power of two bytes, e.g. XRGB8888 or a 24-bit depth with
+ * a stencil to 4. The multisampled color and the depth and stencil buffers exist once
+ * per surface, not per swap buffer. With the driver left to pick the buffering and no
+ * buffer age yet, three buffers are assumed. A released surface costs nothing.
+ */
+RenderSurface::MemoryUsage WindowEgl::get_memory_usage() const {
+    if (!egl_window_) {
+        return {};
+    }
+    const auto round_bytes = [](EGLint bits) -> uint64_t {
+        uint64_t bytes = 1;
+        while (bytes * 8 < static_cast<uint64_t>(bits)) {
+            bytes *= 2;
+        }
+        return bits > 0 ? bytes : 0;
+    };
+    EGLint color_bits = 0, depth_bits = 0, stencil_bits = 0, samples = 0;
+    eglGetConfigAttrib(dpy_, config_, EGL_BUFFER_SIZE, &color_bits);
+    eglGetConfigAttrib(dpy_, config_, EGL_DEPTH_SIZE, &depth_bits);
+    eglGetConfigAttrib(dpy_, config_, EGL_STENCIL_SIZE, &stencil_bits);
+    eglGetConfigAttrib(dpy_, config_, EGL_SAMPLES, &samples);
+
+    EGLint buffers = std::max(get_expected_buffer_count(), max_buffer_age_);
+    if (!buffers) {
+        buffers = 3;
+    }
+    const uint64_t pixels = static_cast<uint64_t>(buffer_width_) * static_cast<uint64_t>(buffer_height_);
+    const uint64_t color = pixels * round_bytes(color_bits);
+    const uint64_t sample_count = samples > 1 ? static_cast<uint64_t>(samples) : 1;
+    return {color * static_cast<uint64_t>(buffers), samples > 1 ? color * sample_count : 0,
+            pixels * round_bytes(depth_bits + stencil_bits) * sample_count, static_cast<uint32_t>(buffers)};
+}
+
+/**
+ * @brief Resizes the EGL window, keeping the opaque region in sync.
+ *
+ * The new size takes effect with the next eglSwapBuffers.
+ *
+ * @param width  The new width in surface coordinates.
+ * @param height The new height in surface coordinates.
+ */
+void WindowEgl::resize(int width, int height) {
+    width_ = width;
+    height_ = height;
+    update_buffer_size();
+    update_opaque_region(width, height);
+}
+
+/**
+ * @brief Lets the window render at a different resolution than its surface size.
+ *
+ * Without a viewport the render scale is fixed at 1.
+ *
+ * @param viewporter The wp_viewporter global, may be nullptr.
+ */
+void WindowEgl::enable_viewport(struct wp_viewporter *viewporter) {
+    if (!viewporter || viewport_) {
+        return;
+    }
+    viewport_ = std::make_unique<Viewport>(viewporter, wl_surface_);
+}
+
+/**
+ * @brief Renders into buffers scaled by scale while the surface keeps its size.
+ *
+ * The compositor scales the buffer back up to the surface size, so e.g. a scale of 0.5
+ * renders a 3840x2160 window at 1920x1080. The new buffer size takes effect with the
+ * next eglSwapBuffers; query it with get_buffer_width() and get_buffer_height() to set
+ * the GL viewport.
+ *
+ * @param scale The render scale, in (0, 1] to save fill rate.
+ * @return false if scale is out of range or no viewport is available.
+ */
+bool WindowEgl::set_render_scale(double scale) {
+    if (scale <= 0.0 || scale > 1.0 || (!viewport_ && scale != 1.0)) {
+        return false;
+    }
+    render_scale_ = scale;
+    update_buffer_size();
+    return true;
+}
+
+/**
+ * @brief Renders at the preferred scale of the outputs the surface is on.
+ *
+ * With a viewport any scale is honoured, e.g. a 1000x800 surface on a 1.5x output gets
+ * 1500x1200 buffers that the compositor maps 1:1 to device pixels. Without one the scale
+ * is rounded to an integer and set with wl_surface_set_buffer_scale. The buffers are only
+ * resized when the effective scale changes.
+ *
+ * @param scale The preferred scale, e.g. from wp_fractional_scale_v1 or wl_surface v6.
+ */
+void WindowEgl::set_output_scale(double scale) {
+    if (scale <= 0.0) {
+        return;
+    }
+    if (!viewport_) {
+        if (wl_surface_get_version(wl_surface_) < WL_SURFACE_SET_BUFFER_SCALE_SINCE_VERSION) {
+            return;
+        }
+        scale = std::max(1.0, std::round(scale));
+    }
+    if (scale == output_scale_) {
+        return;
+    }
+    output_scale_ = scale;
+    if (!viewport_) {
+        wl_surface_set_buffer_scale(wl_surface_, static_cast<int32_t>(scale));
+    }
+    update_buffer_size();
+}
+
+/**
+ * @brief Adjusts the render scale from the measured frame time.
+ *
+ * Requires a viewport. While enabled, set_render_scale() values are overridden.
+ *
+ * @param config The scale bounds and thresholds.
+ * @return false if no viewport is available.
+ */
+bool WindowEgl::enable_resolution_governor(const ResolutionGovernorConfig &config) {
+    if (!viewport_) {
+        return false;
+    }
+    governor_ = std::make_unique<ResolutionGovernor>(config);
+    set_render_scale(governor_->get_scale());
+    return true;
+}
+
+/**
+ * @brief Stops the governor and renders at full resolution again.
+ */
+void WindowEgl::disable_resolution_governor() {
+    governor_.reset();
+    set_render_scale(1.0);
+}
+
+/**
+ * @brief Feeds a frame time to the governor, rescaling the buffers if it decides to.
+ *
+ * Called by WindowManager before every frame.
+ *
+ * @param frame_time_ns The time the last frame took to render.
+ * @param refresh_ns    The refresh interval of the output the window is on.
+ */
+void WindowEgl::report_frame_time(uint64_t frame_time_ns, uint64_t refresh_ns) {
+    if (!governor_) {
+        return;
+    }
+    const double scale = governor_->update(frame_time_ns, refresh_ns);
+    if (scale != render_scale_) {
+        set_render_scale(scale);
+    }
+}
+
+/**
+ * @brief Resizes the EGL window to the scaled size and points the viewport at the surface size.
+ *
+ * Without a viewport the buffer scale set by set_output_scale() maps the buffer back
+ * to the surface size.
+ */
+void WindowEgl::update_buffer_size() {
+    const double scale = output_scale_ * render_scale_;
+    const int width = std::max(1, static_cast<int>(width_ * scale + 0.5));
+    const int height = std::max(1, static_cast<int>(height_ * scale + 0.5));
+    if (width != buffer_width_ || height != buffer_height_) {
+        buffer_width_ = width;
+        buffer_height_ = height;
+        if (egl_window_) {
+            if (present_thread_) {
+                // the driver reads the size while it dequeues
+                present_thread_->wait_idle();
+            }
+            wl_egl_window_resize(egl_window_, buffer_width_, buffer_height_, 0, 0);
+        }
+    }
+    if (viewport_) {
+        if (buffer_width_ == width_ && buffer_height_ == height_) {
+            viewport_->clear_destination();
+        } else {
+            viewport_->set_destination(width_, height_);
+        }
+    }
+}
+
+/**
+ * @brief Returns the EGL attributes for config, without alpha for opaque windows.
+ */
+EglConfigAttribs WindowEgl::egl_attribs(const WindowEglConfig &config) {
+    auto attribs = config.egl;
+    if (config.opaque) {
+        attribs.alpha_size = 0;
+    }
+    return attribs;
+}
+
+/**
+ * @brief Marks the whole surface as opaque for opaque windows.
+ *
+ * The region is double-buffered state, applied with the next commit.
+ *
+ * @param width  The surface width.
+ * @param height The surface height.
+ */
+void WindowEgl::update_opaque_region(int width, int height) const {
+    if (!opaque_ || !wl_compositor_ || !wl_surface_) {
+        return;
     }
+    auto region = wl_compositor_create_region(wl_compositor_);
+    wl_region_add(region, 0, 0, width, height);
+    wl_surface_set_opaque_region(wl_surface_, region);
+    wl_region_destroy(region);
 }
@@ -17,22 +17,133 @@
 #ifndef SRC_WINDOW_WINDOW_EGL_H_
 #define SRC_WINDOW_WINDOW_EGL_H_
 
+#include <memory>
+
 #include "window.h"
 #include "egl.h"
+#include "present_thread.h"
+#include "render_surface.h"
+#include "viewport.h"
+#include "resolution_governor.h"
+#include "utils/export.h"
+
+struct WindowEglConfig {
+    // how far frames may run ahead of the screen, see Window::set_max_queued_commits()
+    typedef enum {
+        // whatever the frame callbacks allow; the driver allocates up to four buffers when the compositor holds them
+        BUFFERING_DEFAULT,
+        // one commit waits for presentation at a time
+        BUFFERING_DOUBLE,
+        // two commits wait for presentation, hides a late compositor at a frame of latency
+        BUFFERING_TRIPLE,
+        // like double buffering, drawing as close to the vblank as the frame scheduler allows
+        BUFFERING_MIN_LATENCY,
+    } Buffering;
 
-class WindowEgl : public Egl {
+    // defaults to RGBA8888 with a 16-bit depth, 8-bit stencil and 4x MSAA
+    EglConfigAttribs egl{};
+    // render with a context of its own instead of the shared context
+    bool own_context{};
+    // alpha-less config plus a full-surface opaque region, so the compositor can skip what is below
+    bool opaque{};
+    Buffering buffering{BUFFERING_DEFAULT};
+    // swap on a PresentThread, so the drawing thread never waits for a free buffer
+    bool present_thread{};
+};
+
+class WAYPP_EXPORT WindowEgl : public Egl, public RenderSurface {
 public:
-    explicit WindowEgl(struct wl_display *display, struct wl_compositor *compositor, struct wl_surface *surface,
+    typedef DamageRect Rect;
+
+    explicit WindowEgl(const EglDisplay *egl_display, struct wl_compositor *compositor, struct wl_surface *surface,
                        int width, int height,
                        Window::ShellType shell_type = Window::ShellType::XDG,
-                       const std::function<void(void *data, uint32_t time)> &draw_callback = nullptr);
+                       const std::function<void(void *data, uint32_t time)> &draw_callback = nullptr,
+                       const WindowEglConfig &config = {});
+
+    ~WindowEgl() override;
+
+    [[nodiscard]] Backend get_backend() const override { return EGL; }
+
+    [[nodiscard]] std::vector<Rect> begin_frame(const std::vector<Rect> &damage) override;
+
+    bool end_frame(const std::vector<Rect> &damage) override;
+
+    void resize(int width, int height) override;
+
+    void enable_viewport(struct wp_viewporter *viewporter);
+
+    bool set_render_scale(double scale);
+
+    [[nodiscard]] double get_render_scale() const { return render_scale_; }
+
+    void set_output_scale(double scale) override;
+
+    [[nodiscard]] double get_output_scale() const { return output_scale_; }
+
+    bool enable_resolution_governor(const ResolutionGovernorConfig &config = {});
+
+    void disable_resolution_governor();
+
+    void report_frame_time(uint64_t frame_time_ns, uint64_t refresh_ns) override;
 
-    ~WindowEgl();
+    [[nodiscard]] uint64_t get_last_gpu_time_ns() const override { return Egl::get_last_gpu_time_ns(); }
+
+    [[nodiscard]] int get_buffer_width() const override { return buffer_width_; }
+
+    [[nodiscard]] int get_buffer_height() const override { return buffer_height_; }
+
+    void release_surface();
+
+    bool restore_surface();
+
+    [[nodiscard]] bool is_surface_released() const { return !egl_window_; }
+
+    [[nodiscard]] WindowEglConfig::Buffering get_buffering() const { return buffering_; }
+
+    bool enable_present_thread(const ThreadAttributes &attributes = {});
+
+    void disable_present_thread();
+
+    [[nodiscard]] bool has_present_thread() const { return present_thread_ != nullptr; }
+
+    // frames begin_frame() skipped because the present thread was still busy with the last one
+    [[nodiscard]] uint64_t get_present_skip_count() const { return present_skips_; }
+
+    // buffers in rotation for the buffering, 0 if left to the driver
+    [[nodiscard]] EGLint get_expected_buffer_count() const;
+
+    [[nodiscard]] MemoryUsage get_memory_usage() const override;
 
     friend class Egl;
 
 private:
+    struct wl_compositor *wl_compositor_;
     struct wl_egl_window *egl_window_{};
+    bool opaque_;
+    WindowEglConfig::Buffering buffering_;
+
+    // surface size in surface coordinates
+    int width_;
+    int height_;
+    // size of the buffers rendered, width_ * height_ scaled by output_scale_ and render_scale_
+    int buffer_width_;
+    int buffer_height_;
+    double render_scale_{1.0};
+    // preferred scale of the outputs the surface is on, integral without a viewport
+    double output_scale_{1.0};
+    std::unique_ptr<Viewport> viewport_;
+    std::unique_ptr<ResolutionGovernor> governor_;
+    std::unique_ptr<PresentThread> present_thread_;
+    uint64_t present_skips_{};
+
+    void update_buffer_size();
+
+    bool create_surface();
+
+    static EglConfigAttribs egl_attribs(const WindowEglConfig &config);
+
+    void update_opaque_region(int width, int height) const;
 };
 
 #endif // SRC_WINDOW_WINDOW_EGL_H_
\ No newline at end of file
@@ -0,0 +1,154 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "window_headless.h"
+
+#include <array>
+#include <stdexcept>
+#include <thread>
+
+/**
+ * @class WindowHeadless
+ * @brief Renders into a pbuffer on a headless EglDisplay, driven by synthetic frame callbacks.
+ *
+ * It runs the draw callbacks written for WindowEgl, make_current(), begin_frame() and
+ * swap_buffers() included, on build machines without a compositor, so performance
+ * regressions show up in automated runs. Frames are paced by a steady clock at the
+ * configured rate instead of the compositor's frame callbacks; the callback gets the
+ * window, as an Egl pointer, and the milliseconds since the window was created, like
+ * wl_callback.done.
+ *
+ * @code
+ * auto display = EglDisplay::create_headless();
+ * WindowHeadlessConfig config;
+ * config.frame_rate = 0;
+ * WindowHeadless window(display.get(), 1920, 1080, draw_frame, config);
+ * window.run(1000);
+ * @endcode
+ */
+WindowHeadless::WindowHeadless(const EglDisplay *egl_display, int width, int height,
+                               const std::function<void(void *data, uint32_t time)> &draw_callback,
+                               const WindowHeadlessConfig &config) :
+        Egl(egl_display, config.egl, config.own_context),
+        draw_callback_(draw_callback),
+        width_(width),
+        height_(height),
+        frame_rate_(config.frame_rate),
+        start_(std::chrono::steady_clock::now()),
+        next_frame_(start_) {
+    create_surface();
+}
+
+/**
+ * @brief Destroys the pbuffer surface.
+ */
+WindowHeadless::~WindowHeadless() {
+    disable_gpu_timer();
+    release_current(egl_surface_, EGL_NO_CONTEXT);
+    eglDestroySurface(dpy_, egl_surface_);
+}
+
+/**
+ * @brief Replaces the pbuffer with one of the new size.
+ *
+ * Pbuffers cannot be resized, so the next frame renders to a new surface.
+ */
+void WindowHeadless::resize(int width, int height) {
+    if (width == width_ && height == height_) {
+        return;
+    }
+    width_ = width;
+    height_ = height;
+    release_current(egl_surface_, EGL_NO_CONTEXT);
+    eglDestroySurface(dpy_, egl_surface_);
+    create_surface();
+}
+
+/**
+ * @brief Sets the rate of the synthetic frame callbacks.
+ *
+ * @param frame_rate Frames per second, 0 renders each frame as soon as the previous one is done.
+ */
+void WindowHeadless::set_frame_rate(uint32_t frame_rate) {
+    frame_rate_ = frame_rate;
+    next_frame_ = std::chrono::steady_clock::now();
+}
+
+/**
+ * @brief Waits for the next frame deadline and renders one frame.
+ *
+ * A frame that finishes after the following deadline counts the deadlines it
+ * overran as missed, and pacing restarts from the current time instead of
+ * rendering the backlog back to back.
+ *
+ * @return false if there is no draw callback.
+ */
+bool WindowHeadless::run_frame() {
+    if (!draw_callback_) {
+        return false;
+    }
+
+    if (frame_rate_ != 0) {
+        const auto period = std::chrono::nanoseconds(std::chrono::seconds(1)) / frame_rate_;
+        const auto now = std::chrono::steady_clock::now();
+        if (now < next_frame_) {
+            std::this_thread::sleep_until(next_frame_);
+        } else if (const auto late = now - next_frame_; late >= period) {
+            missed_frames_ += static_cast<uint64_t>(late / period);
+            next_frame_ = now;
+        }
+        next_frame_ += period;
+    }
+
+    const auto to_ns = [](std::chrono::steady_clock::duration d) {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    };
+    const auto frame_start = std::chrono::steady_clock::now();
+    const auto time = std::chrono::duration_cast<std::chrono::milliseconds>(frame_start - start_).count();
+    // a paced frame stands for the end of its period, one rendered back to back for its start
+    animation_clock_.begin_frame(to_ns(frame_start.time_since_epoch()),
+                                 frame_rate_ ? to_ns(next_frame_.time_since_epoch()) : 0);
+    draw_callback_(static_cast<Egl *>(this), static_cast<uint32_t>(time));
+    frame_count_++;
+
+    const uint64_t refresh_ns = frame_rate_ ? 1000000000ULL / frame_rate_ : 0;
+    frame_stats_.record_frame(to_ns(frame_start.time_since_epoch()),
+                              to_ns(std::chrono::steady_clock::now() - frame_start), refresh_ns, true);
+    return true;
+}
+
+/**
+ * @brief Renders frames at the configured rate.
+ *
+ * @param frames The number of frames to render.
+ * @return The number of frames rendered, fewer than frames only without a draw callback.
+ */
+uint64_t WindowHeadless::run(uint64_t frames) {
+    uint64_t rendered = 0;
+    while (rendered < frames && run_frame()) {
+        rendered++;
+    }
+    return rendered;
+}
+
+void WindowHeadless::create_surface() {
+    const std::array<EGLint, 5> attribs = {EGL_WIDTH, width_, EGL_HEIGHT, height_, EGL_NONE};
+    egl_surface_ = eglCreatePbufferSurface(dpy_, config_, attribs.data());
+    if (egl_surface_ == EGL_NO_SURFACE) {
+        throw std::runtime_error("eglCreatePbufferSurface failed.");
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_WINDOW_HEADLESS_H_
+#define SRC_WINDOW_WINDOW_HEADLESS_H_
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include "animation_clock.h"
+#include "egl.h"
+#include "frame_stats.h"
+#include "utils/export.h"
+
+struct WindowHeadlessConfig {
+    EglConfigAttribs egl{};
+    // render with a context of its own instead of the shared context
+    bool own_context{};
+    // synthetic frame callbacks per second, 0 renders back to back
+    uint32_t frame_rate{60};
+};
+
+class WAYPP_EXPORT WindowHeadless : public Egl {
+public:
+    explicit WindowHeadless(const EglDisplay *egl_display, int width, int height,
+                            const std::function<void(void *data, uint32_t time)> &draw_callback,
+                            const WindowHeadlessConfig &config = {});
+
+    ~WindowHeadless();
+
+    WindowHeadless(const WindowHeadless &) = delete;
+
+    WindowHeadless &operator=(const WindowHeadless &) = delete;
+
+    void resize(int width, int height);
+
+    void set_frame_rate(uint32_t frame_rate);
+
+    [[nodiscard]] uint32_t get_frame_rate() const { return frame_rate_; }
+
+    bool run_frame();
+
+    uint64_t run(uint64_t frames);
+
+    [[nodiscard]] uint64_t get_frame_count() const { return frame_count_; }
+
+    // frames whose deadline had passed before the previous frame finished
+    [[nodiscard]] uint64_t get_missed_frames() const { return missed_frames_; }
+
+    [[nodiscard]] const FrameStats &get_frame_stats() const { return frame_stats_; }
+
+    // advanced by one frame period per frame, see AnimationClock
+    [[nodiscard]] const AnimationClock &get_animation_clock() const { return animation_clock_; }
+
+    void reset_frame_stats() { frame_stats_.reset(); }
+
+    [[nodiscard]] int get_width() const { return width_; }
+
+    [[nodiscard]] int get_height() const { return height_; }
+
+private:
+    std::function<void(void *data, uint32_t time)> draw_callback_;
+    int width_;
+    int height_;
+
+    uint32_t frame_rate_;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point next_frame_;
+    uint64_t frame_count_{};
+    uint64_t missed_frames_{};
+    FrameStats frame_stats_;
+    AnimationClock animation_clock_;
+
+    void create_surface();
+};
+
+#endif // SRC_WINDOW_WINDOW_HEADLESS_H_
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "window_pool.h"
+
+#include <utility>
+
+#include "utils/logging.h"
+
+/**
+ * @class WindowPool
+ * @brief Surfaces with their EGL window surface already created, for windows that must show at once.
+ *
+ * Creating an EGL window does not touch the GPU's buffers, those come with the first
+ * swap, but the wl_surface, wl_egl_window, EGLSurface and, with own_context, the
+ * context take noticeable time. A pool pays for them up front; acquire() then only
+ * resizes, and presenting the new popup or subsurface costs its first commit.
+ *
+ * The pool is refilled one window at a time with warm_one(), e.g. once per frame
+ * after the commit, so no frame pays for more than one window. It is not refilled
+ * from another thread, as EGL surfaces are made current while created.
+ *
+ * @param egl_display The EGL display the windows share with the rest of the application.
+ * @param compositor  The wl_compositor used to create the surfaces.
+ * @param config      How many windows to keep ready, and how they are created.
+ */
+WindowPool::WindowPool(const EglDisplay *egl_display, struct wl_compositor *compositor,
+                       const WindowPoolConfig &config) :
+        egl_display_(egl_display),
+        wl_compositor_(compositor),
+        config_(config) {
+    entries_.reserve(config_.count);
+}
+
+WindowPool::~WindowPool() {
+    for (auto &entry: entries_) {
+        entry.window.reset();
+        wl_surface_destroy(entry.surface);
+    }
+}
+
+RenderSurface::MemoryUsage WindowPool::get_memory_usage() const {
+    RenderSurface::MemoryUsage usage{};
+    for (const auto &entry: entries_) {
+        usage += entry.window->get_memory_usage();
+    }
+    return usage;
+}
+
+/**
+ * @brief Creates one window if the pool is short of its count.
+ *
+ * @return true if a window was created.
+ */
+bool WindowPool::warm_one() {
+    if (entries_.size() >= config_.count) {
+        return false;
+    }
+    entries_.emplace_back(create(config_.width, config_.height));
+    return true;
+}
+
+/**
+ * @brief Fills the pool, e.g. during start-up before the first frame.
+ */
+void WindowPool::warm_all() {
+    while (warm_one()) {
+    }
+}
+
+/**
+ * @brief Hands out a ready window, or creates one right away if the pool is empty.
+ *
+ * The surface has no role yet and nothing attached. The caller takes ownership and
+ * must destroy the window before the surface.
+ */
+WindowPool::Entry WindowPool::acquire(int width, int height) {
+    if (entries_.empty()) {
+        LOG_DEBUG("WindowPool: empty, creating a window");
+        return create(width, height);
+    }
+    auto entry = std::move(entries_.back());
+    entries_.pop_back();
+    entry.window->resize(width, height);
+    return entry;
+}
+
+WindowPool::Entry WindowPool::create(int width, int height) const {
+    Entry entry{};
+    entry.surface = wl_compositor_create_surface(wl_compositor_);
+    entry.window = std::make_unique<WindowEgl>(egl_display_, wl_compositor_, entry.surface, width, height,
+                                               Window::ShellType::NONE, nullptr, config_.egl);
+    return entry;
+}
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_WINDOW_POOL_H_
+#define SRC_WINDOW_WINDOW_POOL_H_
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "egl_display.h"
+#include "window_egl.h"
+#include "utils/export.h"
+
+struct WindowPoolConfig {
+    // windows kept ready
+    size_t count{2};
+    // size they are created at, a different size on acquire costs only a wl_egl_window resize
+    int width{640};
+    int height{480};
+    WindowEglConfig egl{};
+};
+
+class WAYPP_EXPORT WindowPool {
+public:
+    // a surface without a role and the EGL window on it, owned by whoever acquired it
+    struct Entry {
+        struct wl_surface *surface;
+        std::unique_ptr<WindowEgl> window;
+    };
+
+    WindowPool(const EglDisplay *egl_display, struct wl_compositor *compositor, const WindowPoolConfig &config = {});
+
+    ~WindowPool();
+
+    WindowPool(const WindowPool &) = delete;
+
+    WindowPool &operator=(const WindowPool &) = delete;
+
+    bool warm_one();
+
+    void warm_all();
+
+    [[nodiscard]] size_t get_available() const { return entries_.size(); }
+
+    // of the windows kept ready
+    [[nodiscard]] RenderSurface::MemoryUsage get_memory_usage() const;
+
+    [[nodiscard]] Entry acquire(int width, int height);
+
+private:
+    const EglDisplay *egl_display_;
+    struct wl_compositor *wl_compositor_;
+    WindowPoolConfig config_;
+    std::vector<Entry> entries_;
+
+    [[nodiscard]] Entry create(int width, int height) const;
+};
+
+#endif // SRC_WINDOW_WINDOW_POOL_H_
@@ -0,0 +1,334 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "window_shm.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "utils/listener.h"
+
+/**
+ * @class WindowShm
+ * @brief A software rendering window backed by a single memfd wl_shm_pool.
+ *
+ * The pool is sliced into a ring of wl_buffers that are recycled on wl_buffer.release,
+ * so drawing a frame neither maps memory nor creates buffers. The pool is only
+ * reallocated when the window is resized.
+ *
+ * @param shm     The wl_shm global.
+ * @param surface The surface whose role the caller manages, e.g. an xdg_toplevel.
+ * @param width   The surface width, equal to the buffer width until set_buffer_scale().
+ * @param height  The surface height, equal to the buffer height until set_buffer_scale().
+ * @param config  The pixel format and number of buffers in the ring.
+ */
+WindowShm::WindowShm(struct wl_shm *shm, struct wl_surface *surface, int width, int height,
+                     const WindowShmConfig &config) :
+        wl_shm_(shm),
+        wl_surface_(surface),
+        format_(config.format),
+        width_(width),
+        height_(height),
+        buffers_(config.buffer_count ? config.buffer_count : WindowShmConfig{}.buffer_count) {
+    if (!wl_shm_) {
+        throw std::runtime_error("wl_shm is not available.");
+    }
+    fd_ = memfd_create("waypp-shm", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd_ < 0) {
+        throw std::runtime_error(std::string("memfd_create failed: ") + strerror(errno));
+    }
+    // the compositor maps the pool too; it must never shrink under it
+    fcntl(fd_, F_ADD_SEALS, F_SEAL_SHRINK);
+    create_buffers();
+}
+
+WindowShm::~WindowShm() {
+    destroy_buffers(false);
+    for (auto wl_buffer: retired_) {
+        wl_buffer_destroy(wl_buffer);
+    }
+    if (pool_) {
+        wl_shm_pool_destroy(pool_);
+    }
+    if (pool_data_) {
+        munmap(pool_data_, pool_size_);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+/**
+ * @brief Returns the next buffer the compositor is not reading from.
+ *
+ * @return A buffer to draw into, or nullptr if every buffer is still busy.
+ */
+WindowShm::Buffer *WindowShm::acquire() {
+    for (size_t i = 0; i < buffers_.size(); i++) {
+        auto &buffer = buffers_[(next_ + i) % buffers_.size()];
+        if (!buffer.busy) {
+            next_ = (next_ + i + 1) % buffers_.size();
+            return &buffer;
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Attaches a buffer returned by acquire() and damages the whole surface.
+ *
+ * The buffer is shown with the next surface commit, made by the frame loop after the
+ * draw callback, and is busy until the compositor releases it.
+ *
+ * @param buffer The buffer to attach.
+ */
+void WindowShm::attach(Buffer *buffer) {
+    attach(buffer, {});
+}
+
+/**
+ * @brief Attaches a buffer returned by acquire(), damaging only what was drawn.
+ *
+ * Without wl_surface.damage_buffer the whole surface is damaged, damage in surface
+ * coordinates would round outwards at fractional positions anyway.
+ *
+ * @param buffer The buffer to attach.
+ * @param damage The changed regions in buffer coordinates, empty for all of the buffer.
+ */
+void WindowShm::attach(Buffer *buffer, const std::vector<Rect> &damage) {
+    buffer->busy = true;
+    buffer->frame = ++frame_count_;
+    damage_tracker_.record(damage);
+    wl_surface_attach(wl_surface_, buffer->wl_buffer, 0, 0);
+    if (damage.empty() || wl_surface_get_version(wl_surface_) < WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+        wl_surface_damage(wl_surface_, 0, 0, INT32_MAX, INT32_MAX);
+        return;
+    }
+    for (const auto &rect: damage) {
+        wl_surface_damage_buffer(wl_surface_, rect.x, rect.y, rect.width, rect.height);
+    }
+}
+
+/**
+ * @brief Acquires the buffer for the next frame and works out what of it is stale.
+ *
+ * The buffer still holds the frame it was last attached with, so only the damage of the
+ * frames attached since, and of this one, needs to be drawn again.
+ *
+ * @param damage The regions that change in this frame, empty for all of it.
+ * @return The regions of get_current_buffer() to repaint, empty if every buffer is busy.
+ */
+std::vector<WindowShm::Rect> WindowShm::begin_frame(const std::vector<Rect> &damage) {
+    current_ = acquire();
+    if (!current_) {
+        return {};
+    }
+    const auto age = current_->frame ? static_cast<int>(frame_count_ + 1 - current_->frame) : 0;
+    return damage_tracker_.get_repaint(damage, age, current_->width, current_->height);
+}
+
+/**
+ * @brief Attaches the buffer drawn since begin_frame(); the frame loop commits it.
+ *
+ * @param damage The damage passed to begin_frame().
+ * @return false outside a frame.
+ */
+bool WindowShm::end_frame(const std::vector<Rect> &damage) {
+    if (!current_) {
+        return false;
+    }
+    attach(current_, damage);
+    current_ = nullptr;
+    return true;
+}
+
+/**
+ * @brief Reallocates the ring for a new size.
+ *
+ * Buffers still held by the compositor stay alive until it releases them, and the
+ * new ring is placed past them in the pool, so the surface keeps showing the last
+ * attached contents intact until a new buffer is attached.
+ *
+ * @param width  The new width in surface coordinates.
+ * @param height The new height in surface coordinates.
+ */
+void WindowShm::resize(int width, int height) {
+    if (width == width_ && height == height_) {
+        return;
+    }
+    width_ = width;
+    height_ = height;
+    destroy_buffers(true);
+    create_buffers();
+}
+
+/**
+ * @brief Draws at an integer multiple of the surface size for high density outputs.
+ *
+ * The ring is reallocated at width * scale x height * scale pixels and the scale is
+ * set on the surface, applied with the buffer attached next.
+ *
+ * @param scale The buffer scale, at least 1.
+ * @return false if the surface predates wl_surface.set_buffer_scale.
+ */
+bool WindowShm::set_buffer_scale(int scale) {
+    if (scale < 1 || wl_surface_get_version(wl_surface_) < WL_SURFACE_SET_BUFFER_SCALE_SINCE_VERSION) {
+        return false;
+    }
+    if (scale == scale_) {
+        return true;
+    }
+    scale_ = scale;
+    wl_surface_set_buffer_scale(wl_surface_, scale_);
+    destroy_buffers(true);
+    create_buffers();
+    return true;
+}
+
+/**
+ * @brief Follows the output's preferred scale, rounded to the integer buffer scale wl_shm is limited to.
+ */
+void WindowShm::set_output_scale(double scale) {
+    (void) set_buffer_scale(std::max(1, static_cast<int>(std::lround(scale))));
+}
+
+/**
+ * @return The size of a pixel of format, 0 for formats WindowShm does not handle.
+ */
+int WindowShm::bytes_per_pixel(uint32_t format) {
+    switch (format) {
+        case WL_SHM_FORMAT_ARGB8888:
+        case WL_SHM_FORMAT_XRGB8888:
+        case WL_SHM_FORMAT_ABGR8888:
+        case WL_SHM_FORMAT_XBGR8888:
+            return 4;
+        case WL_SHM_FORMAT_RGB565:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @brief Sizes the pool for the ring and creates a wl_buffer per slice.
+ *
+ * The memfd and the pool only grow; shrinking keeps the existing mapping. While
+ * retired buffers are held, the ring starts past them.
+ */
+void WindowShm::create_buffers() {
+    const int bpp = bytes_per_pixel(format_);
+    if (!bpp) {
+        throw std::runtime_error("Unsupported wl_shm format " + std::to_string(format_));
+    }
+    const int32_t width = width_ * scale_;
+    const int32_t height = height_ * scale_;
+    const int32_t stride = width * bpp;
+    const size_t buffer_size = static_cast<size_t>(stride) * static_cast<size_t>(height);
+    const size_t base = retired_end_;
+    const size_t size = base + buffer_size * buffers_.size();
+    if (size > INT32_MAX) {
+        throw std::runtime_error("wl_shm pool too large");
+    }
+
+    if (size > pool_size_) {
+        if (ftruncate(fd_, static_cast<off_t>(size)) < 0) {
+            throw std::runtime_error(std::string("ftruncate failed: ") + strerror(errno));
+        }
+        if (pool_data_) {
+            munmap(pool_data_, pool_size_);
+        }
+        pool_data_ = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (pool_data_ == MAP_FAILED) {
+            pool_data_ = nullptr;
+            pool_size_ = 0;
+            throw std::runtime_error(std::string("mmap failed: ") + strerror(errno));
+        }
+        if (pool_) {
+            wl_shm_pool_resize(pool_, static_cast<int32_t>(size));
+        } else {
+            pool_ = wl_shm_create_pool(wl_shm_, fd_, static_cast<int32_t>(size));
+        }
+        pool_size_ = size;
+    }
+
+    for (size_t i = 0; i < buffers_.size(); i++) {
+        const auto offset = base + i * buffer_size;
+        auto &buffer = buffers_[i];
+        buffer.wl_buffer = wl_shm_pool_create_buffer(pool_, static_cast<int32_t>(offset), width, height, stride,
+                                                     format_);
+        wl_buffer_add_listener(buffer.wl_buffer, &buffer_listener_, this);
+        buffer.data = static_cast<uint8_t *>(pool_data_) + offset;
+        buffer.width = width;
+        buffer.height = height;
+        buffer.stride = stride;
+        buffer.format = format_;
+        buffer.busy = false;
+        buffer.frame = 0;
+    }
+    next_ = 0;
+    damage_tracker_.reset();
+}
+
+/**
+ * @param defer_busy Keep the buffers the compositor holds until their release, instead of destroying them.
+ */
+void WindowShm::destroy_buffers(bool defer_busy) {
+    for (auto &buffer: buffers_) {
+        if (buffer.wl_buffer && defer_busy && buffer.busy) {
+            retired_.push_back(buffer.wl_buffer);
+            const auto end = static_cast<size_t>(static_cast<uint8_t *>(buffer.data) -
+                                                 static_cast<uint8_t *>(pool_data_)) +
+                             static_cast<size_t>(buffer.stride) * static_cast<size_t>(buffer.height);
+            retired_end_ = std::max(retired_end_, end);
+        } else if (buffer.wl_buffer) {
+            wl_buffer_destroy(buffer.wl_buffer);
+        }
+        buffer = {};
+    }
+    current_ = nullptr;
+}
+
+void WindowShm::handle_release(struct wl_buffer *wl_buffer) {
+    for (auto &buffer: buffers_) {
+        if (buffer.wl_buffer == wl_buffer) {
+            buffer.busy = false;
+            return;
+        }
+    }
+    const auto it = std::find(retired_.begin(), retired_.end(), wl_buffer);
+    if (it != retired_.end()) {
+        wl_buffer_destroy(wl_buffer);
+        retired_.erase(it);
+        if (retired_.empty()) {
+            // the next ring may start at the front of the pool again
+            retired_end_ = 0;
+        }
+    }
+}
+
+const struct wl_buffer_listener WindowShm::buffer_listener_ = {
+        .release = listener_thunk<&WindowShm::handle_release>,
+};
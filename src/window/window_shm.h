@@ -0,0 +1,138 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_WINDOW_SHM_H_
+#define SRC_WINDOW_WINDOW_SHM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "damage_tracker.h"
+#include "render_surface.h"
+#include "utils/export.h"
+
+struct WindowShmConfig {
+    // WL_SHM_FORMAT_XRGB8888 and WL_SHM_FORMAT_ARGB8888 are supported by every compositor
+    uint32_t format{WL_SHM_FORMAT_XRGB8888};
+    // buffers in the ring, 0 for the default: triple buffering, so one is free to draw into
+    // while the compositor holds the one shown and the one queued; 2 saves memory on
+    // compositors that release a buffer once the next is committed
+    uint32_t buffer_count{3};
+};
+
+class WAYPP_EXPORT WindowShm : public RenderSurface {
+public:
+    struct Buffer {
+        struct wl_buffer *wl_buffer;
+        // mapping of the buffer in the pool, stride * height bytes
+        void *data;
+        int32_t width;
+        int32_t height;
+        int32_t stride;
+        uint32_t format;
+        // attached and not yet released by the compositor
+        bool busy;
+        // value of the attach counter when last attached, 0 while the contents are undefined
+        uint64_t frame;
+    };
+
+    explicit WindowShm(struct wl_shm *shm, struct wl_surface *surface, int width, int height,
+                       const WindowShmConfig &config = {});
+
+    ~WindowShm() override;
+
+    WindowShm(const WindowShm &) = delete;
+
+    WindowShm &operator=(const WindowShm &) = delete;
+
+    [[nodiscard]] Buffer *acquire();
+
+    void attach(Buffer *buffer);
+
+    void attach(Buffer *buffer, const std::vector<Rect> &damage);
+
+    [[nodiscard]] Backend get_backend() const override { return SHM; }
+
+    [[nodiscard]] std::vector<Rect> begin_frame(const std::vector<Rect> &damage) override;
+
+    bool end_frame(const std::vector<Rect> &damage) override;
+
+    // the buffer acquired by begin_frame(), nullptr outside a frame
+    [[nodiscard]] Buffer *get_current_buffer() const { return current_; }
+
+    void resize(int width, int height) override;
+
+    bool set_buffer_scale(int scale);
+
+    void set_output_scale(double scale) override;
+
+    [[nodiscard]] int get_buffer_scale() const { return scale_; }
+
+    [[nodiscard]] int get_width() const { return width_; }
+
+    [[nodiscard]] int get_height() const { return height_; }
+
+    [[nodiscard]] int get_buffer_width() const override { return width_ * scale_; }
+
+    [[nodiscard]] int get_buffer_height() const override { return height_ * scale_; }
+
+    [[nodiscard]] uint32_t get_format() const { return format_; }
+
+    [[nodiscard]] MemoryUsage get_memory_usage() const override {
+        return {pool_size_, 0, 0, static_cast<uint32_t>(buffers_.size())};
+    }
+
+private:
+    struct wl_shm *wl_shm_;
+    struct wl_surface *wl_surface_;
+    uint32_t format_;
+    // surface size, the buffers are scale_ times larger
+    int width_;
+    int height_;
+    int scale_{1};
+
+    int fd_{-1};
+    struct wl_shm_pool *pool_{};
+    void *pool_data_{};
+    size_t pool_size_{};
+    std::vector<Buffer> buffers_;
+    // buffers of a previous size the compositor still holds, destroyed on their release
+    std::vector<struct wl_buffer *> retired_;
+    // end of the pool bytes the retired buffers occupy, new rings are placed past it
+    size_t retired_end_{};
+    // next buffer to try in acquire(), so buffers are reused round-robin
+    size_t next_{};
+    // attaches since the ring was created, the age of a buffer is counted in them
+    uint64_t frame_count_{};
+    DamageTracker damage_tracker_;
+    Buffer *current_{};
+
+    static int bytes_per_pixel(uint32_t format);
+
+    void create_buffers();
+
+    void destroy_buffers(bool defer_busy);
+
+    void handle_release(struct wl_buffer *buffer);
+
+    static const struct wl_buffer_listener buffer_listener_;
+};
+
+#endif // SRC_WINDOW_WINDOW_SHM_H_
@@ -0,0 +1,210 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "window_solid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "window_manager/display.h"
+#include "utils/logging.h"
+
+namespace {
+double clamp_unit(float value) {
+    return std::clamp(static_cast<double>(value), 0.0, 1.0);
+}
+
+uint32_t to_u32(double value) {
+    return static_cast<uint32_t>(std::llround(value * 4294967295.0));
+}
+
+uint32_t to_u8(double value) {
+    return static_cast<uint32_t>(std::lround(value * 255.0));
+}
+}
+
+/**
+ * @class WindowSolid
+ * @brief A surface showing one color, for backgrounds, letterbox bars and fade overlays.
+ *
+ * With wp_single_pixel_buffer_manager_v1 the content is a 1x1 buffer without any
+ * memory behind it, scaled to the surface size by a viewport. The compositor knows
+ * the surface is a solid color and draws it as such, often without sampling or a
+ * composition pass at all. Without the protocol the pixel is a 1x1 shm buffer, and
+ * without wp_viewporter a shm buffer of the full size. Opaque colors also set the
+ * opaque region, so what is below is not drawn.
+ *
+ * Like all surface state, the color and size apply with the next commit of the surface.
+ *
+ * @param display    The display providing the globals.
+ * @param compositor The wl_compositor, for the opaque region.
+ * @param surface    The surface, which must not have a viewport or another content.
+ * @param width      The surface width.
+ * @param height     The surface height.
+ * @param color      The initial color.
+ */
+WindowSolid::WindowSolid(const Display *display, struct wl_compositor *compositor, struct wl_surface *surface,
+                         int width, int height, const Color &color) :
+        wl_compositor_(compositor),
+        wl_surface_(surface),
+        single_pixel_manager_(display->get_single_pixel_buffer_manager()),
+        width_(width),
+        height_(height),
+        color_(color) {
+    if (display->get_viewporter()) {
+        viewport_ = std::make_unique<Viewport>(display->get_viewporter(), wl_surface_);
+        viewport_->set_destination(width_, height_);
+        mode_ = single_pixel_manager_ ? SINGLE_PIXEL : SHM_PIXEL;
+    } else {
+        mode_ = SHM_FILL;
+    }
+    if (mode_ != SINGLE_PIXEL) {
+        if (!display->get_shm()) {
+            throw std::runtime_error("wl_shm is not available.");
+        }
+        shm_pool_ = std::make_unique<ShmPool>(display->get_shm(), "waypp-solid",
+                                              mode_ == SHM_PIXEL ? 4096 : ShmPool::kDefaultMaxSize);
+    }
+    attach();
+}
+
+WindowSolid::~WindowSolid() {
+    for (auto buffer: retired_) {
+        wl_buffer_destroy(buffer);
+    }
+    if (single_pixel_buffer_) {
+        wl_buffer_destroy(single_pixel_buffer_);
+    }
+    if (shm_buffer_) {
+        shm_pool_->destroy_buffer(shm_buffer_);
+    }
+    // the next content of the surface starts without one
+    if (opaque_) {
+        wl_surface_set_opaque_region(wl_surface_, nullptr);
+    }
+    viewport_.reset();
+}
+
+/**
+ * @brief Changes the color, a new buffer is attached.
+ *
+ * Cheap enough to call every frame of a fade; with the single pixel protocol no
+ * memory is allocated or written.
+ */
+void WindowSolid::set_color(const Color &color) {
+    if (color == color_) {
+        return;
+    }
+    color_ = color;
+    attach();
+}
+
+/**
+ * @brief Changes the surface size; only the viewport, unless the buffer is of the full size.
+ */
+void WindowSolid::resize(int width, int height) {
+    if (width == width_ && height == height_) {
+        return;
+    }
+    width_ = width;
+    height_ = height;
+    if (mode_ == SHM_FILL) {
+        attach();
+        return;
+    }
+    viewport_->set_destination(width_, height_);
+    update_opaque_region(opaque_);
+}
+
+void WindowSolid::attach() {
+    const double alpha = clamp_unit(color_.alpha);
+    // both buffer types take premultiplied components
+    const double red = clamp_unit(color_.red) * alpha;
+    const double green = clamp_unit(color_.green) * alpha;
+    const double blue = clamp_unit(color_.blue) * alpha;
+
+    if (mode_ == SINGLE_PIXEL) {
+        // only chosen with the manager, which a build without ENABLE_SINGLE_PIXEL_BUFFER never binds
+#if defined(ENABLE_SINGLE_PIXEL_BUFFER)
+        auto *buffer = wp_single_pixel_buffer_manager_v1_create_u32_rgba_buffer(
+                single_pixel_manager_, to_u32(red), to_u32(green), to_u32(blue), to_u32(alpha));
+        wl_buffer_add_listener(buffer, &buffer_listener_, this);
+        if (single_pixel_buffer_) {
+            retired_.push_back(single_pixel_buffer_);
+        }
+        single_pixel_buffer_ = buffer;
+        wl_surface_attach(wl_surface_, buffer, 0, 0);
+#endif
+    } else {
+        const int32_t width = mode_ == SHM_FILL ? std::max(width_, 1) : 1;
+        const int32_t height = mode_ == SHM_FILL ? std::max(height_, 1) : 1;
+        auto *buffer = shm_pool_->create_buffer(width, height, width * 4, WL_SHM_FORMAT_ARGB8888);
+        if (!buffer) {
+            LOG_ERROR("No shm buffer for a %dx%d solid surface", width, height);
+            return;
+        }
+        const uint32_t pixel = to_u8(alpha) << 24 | to_u8(red) << 16 | to_u8(green) << 8 | to_u8(blue);
+        std::fill_n(static_cast<uint32_t *>(buffer->data), static_cast<size_t>(width) * static_cast<size_t>(height),
+                    pixel);
+        // a busy one is reclaimed by the pool once released
+        if (shm_buffer_) {
+            shm_pool_->destroy_buffer(shm_buffer_);
+        }
+        shm_buffer_ = buffer;
+        buffer->busy = true;
+        wl_surface_attach(wl_surface_, buffer->wl_buffer, 0, 0);
+    }
+    if (wl_surface_get_version(wl_surface_) >= WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
+        wl_surface_damage_buffer(wl_surface_, 0, 0, INT32_MAX, INT32_MAX);
+    } else {
+        wl_surface_damage(wl_surface_, 0, 0, INT32_MAX, INT32_MAX);
+    }
+    update_opaque_region(alpha >= 1.0);
+}
+
+/**
+ * @brief Marks the whole surface opaque, or clears the opaque region again; unchanged state is not resent.
+ */
+void WindowSolid::update_opaque_region(bool opaque) {
+    if (opaque == opaque_ && (!opaque || (opaque_width_ == width_ && opaque_height_ == height_))) {
+        return;
+    }
+    if (opaque) {
+        auto *region = wl_compositor_create_region(wl_compositor_);
+        wl_region_add(region, 0, 0, width_, height_);
+        wl_surface_set_opaque_region(wl_surface_, region);
+        wl_region_destroy(region);
+        opaque_width_ = width_;
+        opaque_height_ = height_;
+    } else {
+        wl_surface_set_opaque_region(wl_surface_, nullptr);
+    }
+    opaque_ = opaque;
+}
+
+void WindowSolid::handle_release(void *data, struct wl_buffer *buffer) {
+    auto *obj = static_cast<WindowSolid *>(data);
+    const auto it = std::find(obj->retired_.begin(), obj->retired_.end(), buffer);
+    if (it != obj->retired_.end()) {
+        wl_buffer_destroy(buffer);
+        obj->retired_.erase(it);
+    }
+}
+
+const struct wl_buffer_listener WindowSolid::buffer_listener_ = {
+        .release = handle_release,
+};
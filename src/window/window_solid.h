@@ -0,0 +1,106 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_WINDOW_SOLID_H_
+#define SRC_WINDOW_WINDOW_SOLID_H_
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "shm_pool.h"
+#include "viewport.h"
+#include "utils/export.h"
+
+class Display;
+
+class WAYPP_EXPORT WindowSolid {
+public:
+    // straight, not premultiplied, alpha; each component in [0, 1]
+    struct Color {
+        float red;
+        float green;
+        float blue;
+        float alpha;
+
+        bool operator==(const Color &other) const {
+            return red == other.red && green == other.green && blue == other.blue && alpha == other.alpha;
+        }
+    };
+
+    typedef enum {
+        // wp_single_pixel_buffer_manager_v1, no buffer memory at all
+        SINGLE_PIXEL,
+        // a 1x1 shm buffer scaled by the viewport
+        SHM_PIXEL,
+        // no viewporter, a shm buffer of the full size
+        SHM_FILL,
+    } Mode;
+
+    explicit WindowSolid(const Display *display, struct wl_compositor *compositor, struct wl_surface *surface,
+                         int width, int height, const Color &color);
+
+    ~WindowSolid();
+
+    WindowSolid(const WindowSolid &) = delete;
+
+    WindowSolid &operator=(const WindowSolid &) = delete;
+
+    void set_color(const Color &color);
+
+    [[nodiscard]] const Color &get_color() const { return color_; }
+
+    void resize(int width, int height);
+
+    [[nodiscard]] int get_width() const { return width_; }
+
+    [[nodiscard]] int get_height() const { return height_; }
+
+    [[nodiscard]] Mode get_mode() const { return mode_; }
+
+private:
+    struct wl_compositor *wl_compositor_;
+    struct wl_surface *wl_surface_;
+    struct wp_single_pixel_buffer_manager_v1 *single_pixel_manager_;
+    Mode mode_;
+    std::unique_ptr<Viewport> viewport_;
+    std::unique_ptr<ShmPool> shm_pool_;
+    int width_;
+    int height_;
+    Color color_;
+    bool opaque_{};
+    // size of the opaque region set last
+    int opaque_width_{};
+    int opaque_height_{};
+
+    // the buffer attached last; single pixel buffers are destroyed once released
+    struct wl_buffer *single_pixel_buffer_{};
+    // replaced and not yet released
+    std::vector<struct wl_buffer *> retired_;
+    ShmPool::Buffer *shm_buffer_{};
+
+    void attach();
+
+    void update_opaque_region(bool opaque);
+
+    static void handle_release(void *data, struct wl_buffer *buffer);
+
+    static const struct wl_buffer_listener buffer_listener_;
+};
+
+#endif // SRC_WINDOW_WINDOW_SOLID_H_
@@ -14,26 +14,762 @@
  * limitations under the License.
  */
 
+
 #include "window_vulkan.h"
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+
+#include "utils/logging.h"
+
+namespace {
+void check(VkResult result, const char *what) {
+    if (result != VK_SUCCESS) {
+        throw std::runtime_error(std::string(what) + " failed: " + std::to_string(result));
+    }
+}
+
+uint64_t monotonic_ns() {
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+}
+
 /**
  * @class WindowVulkan
  * @brief Class representing a Vulkan window.
  *
- * This class is a specialized subclass of Window that is specifically designed for Vulkan rendering.
- * It provides functionality to create and manage a Vulkan surface.
+ * Creates a VkSurfaceKHR for the given wl_surface with VK_KHR_wayland_surface, a device
+ * with a queue that can both render and present to it, and a swapchain using the
+ * configured present mode. Rendering is paced by the owning Window's frame callbacks,
+ * the same as an EGL window.
+ *
+ * Up to frames_in_flight frames are recorded ahead of the GPU. Each frame slot owns a
+ * command pool, and a single timeline semaphore tracks completion, so recording
+ * frame N+1 only waits for the frame that last used the same slot.
+ *
+ * With VK_KHR_present_wait, begin_frame() waits until no more than present_latency
+ * presents are queued ahead of the screen, so frames start right after a vblank like
+ * the frame callbacks of an EGL window, and the completions feed get_frame_stats().
+ *
+ * Through the RenderSurface interface, begin_frame(damage) also returns the region of
+ * the acquired image to repaint, from how many frames ago it was last rendered. The
+ * image only keeps those contents when the frame transitions it from
+ * VK_IMAGE_LAYOUT_PRESENT_SRC_KHR and loads the attachment; with
+ * VK_KHR_incremental_present the damage also reaches the compositor.
+ *
+ * Pipelines created with get_pipeline_cache() are kept on disk between runs, see
+ * VulkanPipelineCache. The cache is saved every kPipelineCacheSaveInterval frames in
+ * which it grew, and on destruction.
+ *
+ * @param display The Wayland display.
+ * @param surface The surface whose role the caller manages, e.g. an xdg_toplevel.
+ * @param width   The initial swapchain width, used when the surface leaves the extent to the client.
+ * @param height  The initial swapchain height.
+ * @param config  The present mode, swapchain image count, frames in flight, present latency and pipeline
+ *                cache location.
  */
-WindowVulkan::WindowVulkan(struct wl_display * /* display */, struct wl_compositor *compositor, int /* width */,
-                           int /* height */,
-                           Window::ShellType shell_type, const std::function<void(void *, uint32_t)> &draw_callback) :
-        Window(compositor, shell_type, draw_callback) {
+WindowVulkan::WindowVulkan(struct wl_display *display, struct wl_surface *surface, int width, int height,
+                           const WindowVulkanConfig &config) :
+        present_latency_(config.present_latency),
+        requested_present_mode_(config.present_mode),
+        requested_image_count_(config.image_count),
+        extent_{static_cast<uint32_t>(width), static_cast<uint32_t>(height)} {
+    create_instance();
+    VkWaylandSurfaceCreateInfoKHR surface_info{};
+    surface_info.sType = VK_STRUCTURE_TYPE_WAYLAND_SURFACE_CREATE_INFO_KHR;
+    surface_info.display = display;
+    surface_info.surface = surface;
+    check(vkCreateWaylandSurfaceKHR(instance_, &surface_info, nullptr, &surface_), "vkCreateWaylandSurfaceKHR");
+    pick_physical_device();
+    create_device();
+    pipeline_cache_ = std::make_unique<VulkanPipelineCache>(physical_device_, device_,
+                                                            config.pipeline_cache_directory);
+    create_swapchain();
+    create_frames(std::clamp(config.frames_in_flight, kMinFramesInFlight, kMaxFramesInFlight));
 }
 
 /**
- * @class WindowVulkan
- * @brief Class representing a Vulkan window
+ * @brief Saves the pipeline cache, then destroys the swapchain, device, surface and instance once the GPU is idle.
+ */
+WindowVulkan::~WindowVulkan() {
+    if (device_) {
+        vkDeviceWaitIdle(device_);
+        destroy_frames();
+        destroy_swapchain_resources();
+        if (swapchain_) {
+            vkDestroySwapchainKHR(device_, swapchain_, nullptr);
+        }
+        // saves what was compiled this run
+        pipeline_cache_.reset();
+        vkDestroyDevice(device_, nullptr);
+    }
+    if (surface_) {
+        vkDestroySurfaceKHR(instance_, surface_, nullptr);
+    }
+    if (instance_) {
+        vkDestroyInstance(instance_, nullptr);
+    }
+}
+
+/**
+ * @brief Records a new size; the swapchain is recreated before the next acquire.
+ *
+ * Wayland surfaces report no current extent, so the size from the toplevel configure
+ * is what determines the swapchain extent.
+ *
+ * @param width  The new width in buffer pixels.
+ * @param height The new height in buffer pixels.
+ */
+void WindowVulkan::resize(int width, int height) {
+    const VkExtent2D extent{static_cast<uint32_t>(width), static_cast<uint32_t>(height)};
+    if (extent.width == extent_.width && extent.height == extent_.height) {
+        return;
+    }
+    extent_ = extent;
+    swapchain_dirty_ = true;
+}
+
+/**
+ * @brief Requests another present mode; the swapchain is recreated before the next acquire.
+ *
+ * VK_PRESENT_MODE_IMMEDIATE_KHR together with the async presentation hint, see
+ * WindowManager::set_presentation_hint(), lets frames flip without waiting for vblank.
+ * Unsupported modes fall back to FIFO.
+ *
+ * @param present_mode The present mode.
+ */
+void WindowVulkan::set_present_mode(VkPresentModeKHR present_mode) {
+    if (present_mode == requested_present_mode_) {
+        return;
+    }
+    requested_present_mode_ = present_mode;
+    swapchain_dirty_ = true;
+}
+
+/**
+ * @brief Acquires the next swapchain image, recreating the swapchain when needed.
+ *
+ * @param signal      The semaphore signaled once the image may be rendered to.
+ * @param image_index Receives the index into get_images() and get_image_views().
+ * @return VK_SUCCESS or VK_SUBOPTIMAL_KHR when an image was acquired, an error otherwise.
+ */
+VkResult WindowVulkan::acquire_next_image(VkSemaphore signal, uint32_t *image_index) {
+    if (swapchain_dirty_) {
+        create_swapchain();
+    }
+    auto result = vkAcquireNextImageKHR(device_, swapchain_, UINT64_MAX, signal, VK_NULL_HANDLE, image_index);
+    if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+        create_swapchain();
+        result = vkAcquireNextImageKHR(device_, swapchain_, UINT64_MAX, signal, VK_NULL_HANDLE, image_index);
+    }
+    if (result == VK_SUBOPTIMAL_KHR) {
+        swapchain_dirty_ = true;
+    }
+    return result;
+}
+
+/**
+ * @brief Queues an acquired image for presentation.
  *
- * The WindowVulkan class provides functionality to create and manage a Vulkan window.
- * It is primarily used for rendering graphics using the Vulkan API.
+ * An out-of-date or suboptimal swapchain is rebuilt on the next acquire_next_image().
+ *
+ * @param image_index The image returned by acquire_next_image().
+ * @param wait        The semaphore signaled when rendering to the image completes.
+ * @return The vkQueuePresentKHR result.
+ */
+VkResult WindowVulkan::present(uint32_t image_index, VkSemaphore wait) {
+    VkPresentInfoKHR present_info{};
+    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    present_info.waitSemaphoreCount = wait ? 1 : 0;
+    present_info.pWaitSemaphores = &wait;
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = &swapchain_;
+    present_info.pImageIndices = &image_index;
+    std::vector<VkRectLayerKHR> rects;
+    VkPresentRegionKHR region{};
+    VkPresentRegionsKHR regions{};
+    if (incremental_present_ && !frame_damage_.empty()) {
+        rects.reserve(frame_damage_.size());
+        for (const auto &rect: frame_damage_) {
+            VkRectLayerKHR layer_rect{};
+            layer_rect.offset = {rect.x, rect.y};
+            layer_rect.extent = {static_cast<uint32_t>(rect.width), static_cast<uint32_t>(rect.height)};
+            rects.push_back(layer_rect);
+        }
+        region.rectangleCount = static_cast<uint32_t>(rects.size());
+        region.pRectangles = rects.data();
+        regions.sType = VK_STRUCTURE_TYPE_PRESENT_REGIONS_KHR;
+        regions.swapchainCount = 1;
+        regions.pRegions = &region;
+        present_info.pNext = &regions;
+    }
+    VkPresentIdKHR present_id{};
+    if (pfWaitForPresent_) {
+        present_id.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+        present_id.pNext = present_info.pNext;
+        present_id.swapchainCount = 1;
+        present_id.pPresentIds = &++present_id_;
+        present_info.pNext = &present_id;
+    }
+    const auto result = vkQueuePresentKHR(queue_, &present_info);
+    if (pfWaitForPresent_ && (result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR)) {
+        pending_presents_.push_back({present_id_, frame_start_ns_ ? frame_start_ns_ : monotonic_ns()});
+        frame_start_ns_ = 0;
+    }
+    if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+        swapchain_dirty_ = true;
+    }
+    return result;
+}
+
+/**
+ * @brief Retires completed presents, waiting while more than present_latency are queued.
+ *
+ * A completion is only observed here, so its time is when the wait returned: exact when
+ * the wait blocked, late by however long the application was busy otherwise. Present
+ * times are turned into vblank counts with the frame clock's period, without one the
+ * statistics estimate missed vblanks from the frame intervals instead.
+ */
+void WindowVulkan::wait_for_presents() {
+    while (!pending_presents_.empty()) {
+        const auto present = pending_presents_.front();
+        const bool block = present_latency_ && pending_presents_.size() > present_latency_;
+        const auto result = pfWaitForPresent_(device_, swapchain_, present.id, block ? kPresentWaitTimeoutNs : 0);
+        if (result == VK_TIMEOUT && !block) {
+            return;
+        }
+        pending_presents_.pop_front();
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            // timed out while blocking, or the surface went away; the frame never showed
+            frame_stats_.record_discarded();
+            continue;
+        }
+        last_present_ns_ = monotonic_ns();
+        if (const uint64_t period = frame_clock_ ? frame_clock_->get_period_ns() : 0) {
+            frame_stats_.record_presentation(present.start_ns, last_present_ns_, (last_present_ns_ + period / 2) / period);
+        }
+    }
+}
+
+/**
+ * @brief Starts recording the next frame.
+ *
+ * Waits until the GPU has finished the frame that last used the same slot, resets its
+ * command pool, acquires a swapchain image and begins the command buffer. With present
+ * wait, it first waits for the screen to catch up, see WindowVulkanConfig::present_latency.
+ * The caller
+ * records into Frame::command_buffer, including the transition of Frame::image to
+ * VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, and hands the frame to end_frame().
+ *
+ * @return The frame to record, or nullptr if no image could be acquired.
  */
-WindowVulkan::~WindowVulkan() = default;
\ No newline at end of file
+WindowVulkan::Frame *WindowVulkan::begin_frame() {
+    if (pfWaitForPresent_) {
+        wait_for_presents();
+    }
+    auto &frame = frames_[frame_count_ % frames_.size()];
+
+    if (frame.number) {
+        VkSemaphoreWaitInfo wait_info{};
+        wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        wait_info.semaphoreCount = 1;
+        wait_info.pSemaphores = &timeline_;
+        wait_info.pValues = &frame.number;
+        if (vkWaitSemaphores(device_, &wait_info, UINT64_MAX) != VK_SUCCESS) {
+            return nullptr;
+        }
+    }
+
+    const auto result = acquire_next_image(frame.acquire_semaphore, &frame.image_index);
+    if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+        LOG_ERROR("vkAcquireNextImageKHR failed: %d", static_cast<int>(result));
+        return nullptr;
+    }
+
+    vkResetCommandPool(device_, frame.command_pool, 0);
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    check(vkBeginCommandBuffer(frame.command_buffer, &begin_info), "vkBeginCommandBuffer");
+
+    frame.number = ++frame_count_;
+    frame.image = images_[frame.image_index];
+    frame.image_view = image_views_[frame.image_index];
+    frame.extent = extent_;
+    frame.start_ns = monotonic_ns();
+    frame_start_ns_ = frame.start_ns;
+    return &frame;
+}
+
+/**
+ * @brief Submits a frame recorded after begin_frame() and presents its image.
+ *
+ * The submission signals the timeline semaphore with Frame::number, which the CPU
+ * waits on only when the slot comes around again.
+ *
+ * @param frame The frame returned by begin_frame().
+ * @return The vkQueueSubmit error, or the vkQueuePresentKHR result.
+ */
+VkResult WindowVulkan::end_frame(Frame *frame) {
+    check(vkEndCommandBuffer(frame->command_buffer), "vkEndCommandBuffer");
+
+    auto present_semaphore = present_semaphores_[frame->image_index];
+    const VkSemaphore signal[] = {present_semaphore, timeline_};
+    // the value for the binary present semaphore is ignored
+    const uint64_t signal_values[] = {0, frame->number};
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.signalSemaphoreValueCount = static_cast<uint32_t>(std::size(signal_values));
+    timeline_info.pSignalSemaphoreValues = signal_values;
+
+    const VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = 1;
+    submit_info.pWaitSemaphores = &frame->acquire_semaphore;
+    submit_info.pWaitDstStageMask = &wait_stage;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &frame->command_buffer;
+    submit_info.signalSemaphoreCount = static_cast<uint32_t>(std::size(signal));
+    submit_info.pSignalSemaphores = signal;
+    const auto result = vkQueueSubmit(queue_, 1, &submit_info, VK_NULL_HANDLE);
+    if (result != VK_SUCCESS) {
+        return result;
+    }
+    if (frame->number % kPipelineCacheSaveInterval == 0) {
+        // a no-op unless pipelines were created since the last save
+        pipeline_cache_->save();
+    }
+    damage_tracker_.record(frame_damage_);
+    image_frames_[frame->image_index] = frame->number;
+    const auto present_result = present(frame->image_index, present_semaphore);
+    frame_damage_.clear();
+    return present_result;
+}
+
+/**
+ * @brief Begins a frame like begin_frame() and works out what of the acquired image is stale.
+ *
+ * @param damage The regions that change in this frame, empty for all of it.
+ * @return The regions of get_current_frame()'s image to repaint, empty if no image could be acquired.
+ */
+std::vector<WindowVulkan::Rect> WindowVulkan::begin_frame(const std::vector<Rect> &damage) {
+    current_frame_ = begin_frame();
+    if (!current_frame_) {
+        return {};
+    }
+    const auto last = image_frames_[current_frame_->image_index];
+    const auto age = last ? static_cast<int>(current_frame_->number - last) : 0;
+    return damage_tracker_.get_repaint(damage, age, static_cast<int32_t>(current_frame_->extent.width),
+                                       static_cast<int32_t>(current_frame_->extent.height));
+}
+
+/**
+ * @brief Submits and presents the frame begun by begin_frame(damage).
+ *
+ * @param damage The damage passed to begin_frame().
+ * @return true if the frame was submitted.
+ */
+bool WindowVulkan::end_frame(const std::vector<Rect> &damage) {
+    if (!current_frame_) {
+        return false;
+    }
+    auto frame = current_frame_;
+    current_frame_ = nullptr;
+    frame_damage_ = damage;
+    const auto result = end_frame(frame);
+    return result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR;
+}
+
+/**
+ * @brief Records and presents one frame through the draw callback.
+ *
+ * Meant to be called from the owning Window's frame handler.
+ *
+ * @param time The frame callback timestamp, passed on to the draw callback.
+ * @return true if the frame was submitted.
+ */
+bool WindowVulkan::draw_frame(uint32_t time) {
+    auto frame = begin_frame();
+    if (!frame) {
+        return false;
+    }
+    if (draw_handler_) {
+        draw_handler_(draw_handler_data_, *frame, time);
+    } else if (draw_callback_) {
+        draw_callback_(*frame, time);
+    }
+    frame_stats_.record_frame(frame->start_ns, monotonic_ns() - frame->start_ns,
+                              frame_clock_ ? frame_clock_->get_period_ns() : 0, true);
+    const auto result = end_frame(frame);
+    return result == VK_SUCCESS || result == VK_SUBOPTIMAL_KHR || result == VK_ERROR_OUT_OF_DATE_KHR;
+}
+
+/**
+ * @brief Creates an instance with the surface extensions Wayland presentation needs.
+ */
+void WindowVulkan::create_instance() {
+    VkApplicationInfo app_info{};
+    app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+    app_info.pEngineName = "waypp";
+    app_info.apiVersion = VK_API_VERSION_1_2;
+
+    const char *extensions[] = {
+            VK_KHR_SURFACE_EXTENSION_NAME,
+            VK_KHR_WAYLAND_SURFACE_EXTENSION_NAME,
+    };
+    VkInstanceCreateInfo instance_info{};
+    instance_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+    instance_info.pApplicationInfo = &app_info;
+    instance_info.enabledExtensionCount = static_cast<uint32_t>(std::size(extensions));
+    instance_info.ppEnabledExtensionNames = extensions;
+    check(vkCreateInstance(&instance_info, nullptr, &instance_), "vkCreateInstance");
+}
+
+/**
+ * @brief Picks a device with a queue family that can render and present to the surface.
+ *
+ * The device has to support Vulkan 1.2 timeline semaphores. Discrete GPUs are
+ * preferred over integrated ones when several qualify.
+ */
+void WindowVulkan::pick_physical_device() {
+    uint32_t count = 0;
+    check(vkEnumeratePhysicalDevices(instance_, &count, nullptr), "vkEnumeratePhysicalDevices");
+    std::vector<VkPhysicalDevice> devices(count);
+    check(vkEnumeratePhysicalDevices(instance_, &count, devices.data()), "vkEnumeratePhysicalDevices");
+
+    bool found = false;
+    for (auto device: devices) {
+        VkPhysicalDeviceProperties properties{};
+        vkGetPhysicalDeviceProperties(device, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_2) {
+            continue;
+        }
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &features12;
+        vkGetPhysicalDeviceFeatures2(device, &features);
+        if (!features12.timelineSemaphore) {
+            continue;
+        }
+
+        uint32_t family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &family_count, nullptr);
+        std::vector<VkQueueFamilyProperties> families(family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(device, &family_count, families.data());
+
+        for (uint32_t i = 0; i < family_count; i++) {
+            VkBool32 present_support = VK_FALSE;
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface_, &present_support);
+            if (!(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) || !present_support) {
+                continue;
+            }
+            if (!found || properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
+                physical_device_ = device;
+                queue_family_ = i;
+                found = true;
+            }
+            break;
+        }
+    }
+    if (!found) {
+        throw std::runtime_error("No Vulkan device can present to the Wayland surface");
+    }
+}
+
+/**
+ * @brief Creates the logical device with a single graphics and present queue.
+ *
+ * Timeline semaphores are enabled for frame pacing, and present id and present wait
+ * when the device has them. The dmabuf interop extensions are enabled when the device
+ * has all of them, see has_dmabuf_interop().
+ */
+void WindowVulkan::create_device() {
+    const float priority = 1.0f;
+    VkDeviceQueueCreateInfo queue_info{};
+    queue_info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_info.queueFamilyIndex = queue_family_;
+    queue_info.queueCount = 1;
+    queue_info.pQueuePriorities = &priority;
+
+    uint32_t available_count = 0;
+    check(vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &available_count, nullptr),
+          "vkEnumerateDeviceExtensionProperties");
+    std::vector<VkExtensionProperties> available(available_count);
+    check(vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &available_count, available.data()),
+          "vkEnumerateDeviceExtensionProperties");
+    const auto supported = [&available](const char *name) {
+        return std::any_of(available.begin(), available.end(), [name](const VkExtensionProperties &extension) {
+            return std::strcmp(extension.extensionName, name) == 0;
+        });
+    };
+
+    std::vector<const char *> extensions{VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+    const char *interop_extensions[] = {
+            VK_KHR_EXTERNAL_MEMORY_FD_EXTENSION_NAME,
+            VK_EXT_EXTERNAL_MEMORY_DMA_BUF_EXTENSION_NAME,
+            VK_EXT_IMAGE_DRM_FORMAT_MODIFIER_EXTENSION_NAME,
+            VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME,
+    };
+    dmabuf_interop_ = std::all_of(std::begin(interop_extensions), std::end(interop_extensions), supported);
+    if (dmabuf_interop_) {
+        extensions.insert(extensions.end(), std::begin(interop_extensions), std::end(interop_extensions));
+        // without it ownership goes to VK_QUEUE_FAMILY_EXTERNAL, which assumes the same driver
+        queue_family_foreign_ = supported(VK_EXT_QUEUE_FAMILY_FOREIGN_EXTENSION_NAME);
+        if (queue_family_foreign_) {
+            extensions.push_back(VK_EXT_QUEUE_FAMILY_FOREIGN_EXTENSION_NAME);
+        }
+    }
+
+    incremental_present_ = supported(VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+    if (incremental_present_) {
+        extensions.push_back(VK_KHR_INCREMENTAL_PRESENT_EXTENSION_NAME);
+    }
+
+    // present wait needs present ids, and both have to be enabled as features too
+    VkPhysicalDevicePresentWaitFeaturesKHR present_wait{};
+    present_wait.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+    VkPhysicalDevicePresentIdFeaturesKHR present_id{};
+    present_id.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+    present_id.pNext = &present_wait;
+    bool present_wait_supported = false;
+    if (supported(VK_KHR_PRESENT_ID_EXTENSION_NAME) && supported(VK_KHR_PRESENT_WAIT_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 features{};
+        features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features.pNext = &present_id;
+        vkGetPhysicalDeviceFeatures2(physical_device_, &features);
+        present_wait_supported = present_id.presentId && present_wait.presentWait;
+        if (present_wait_supported) {
+            extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+            extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+        }
+    }
+
+    VkPhysicalDeviceVulkan12Features features12{};
+    features12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    features12.timelineSemaphore = VK_TRUE;
+    if (present_wait_supported) {
+        features12.pNext = &present_id;
+    }
+    VkDeviceCreateInfo device_info{};
+    device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+    device_info.pNext = &features12;
+    device_info.queueCreateInfoCount = 1;
+    device_info.pQueueCreateInfos = &queue_info;
+    device_info.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+    device_info.ppEnabledExtensionNames = extensions.data();
+    check(vkCreateDevice(physical_device_, &device_info, nullptr, &device_), "vkCreateDevice");
+    vkGetDeviceQueue(device_, queue_family_, 0, &queue_);
+    if (present_wait_supported) {
+        pfWaitForPresent_ = reinterpret_cast<PFN_vkWaitForPresentKHR>(
+                vkGetDeviceProcAddr(device_, "vkWaitForPresentKHR"));
+    }
+}
+
+/**
+ * @brief Creates the swapchain, or replaces the current one after a resize.
+ *
+ * The old swapchain is passed as oldSwapchain so images already queued to the
+ * compositor are still presented, and is destroyed once the device is idle.
+ */
+void WindowVulkan::create_swapchain() {
+    VkSurfaceCapabilitiesKHR caps{};
+    check(vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device_, surface_, &caps),
+          "vkGetPhysicalDeviceSurfaceCapabilitiesKHR");
+
+    // 0xFFFFFFFF means the extent follows the swapchain, which is always the case on Wayland
+    if (caps.currentExtent.width != UINT32_MAX) {
+        extent_ = caps.currentExtent;
+    }
+    extent_.width = std::clamp(extent_.width, caps.minImageExtent.width, caps.maxImageExtent.width);
+    extent_.height = std::clamp(extent_.height, caps.minImageExtent.height, caps.maxImageExtent.height);
+
+    uint32_t image_count = requested_image_count_ ? requested_image_count_ : caps.minImageCount + 1;
+    image_count = std::max(image_count, caps.minImageCount);
+    if (caps.maxImageCount) {
+        image_count = std::min(image_count, caps.maxImageCount);
+    }
+
+    surface_format_ = choose_surface_format();
+    present_mode_ = choose_present_mode();
+
+    VkCompositeAlphaFlagBitsKHR composite_alpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+    if (!(caps.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR) &&
+        (caps.supportedCompositeAlpha & VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR)) {
+        composite_alpha = VK_COMPOSITE_ALPHA_PRE_MULTIPLIED_BIT_KHR;
+    }
+
+    auto old_swapchain = swapchain_;
+    VkSwapchainCreateInfoKHR swapchain_info{};
+    swapchain_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+    swapchain_info.surface = surface_;
+    swapchain_info.minImageCount = image_count;
+    swapchain_info.imageFormat = surface_format_.format;
+    swapchain_info.imageColorSpace = surface_format_.colorSpace;
+    swapchain_info.imageExtent = extent_;
+    swapchain_info.imageArrayLayers = 1;
+    swapchain_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    swapchain_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    swapchain_info.preTransform = caps.currentTransform;
+    swapchain_info.compositeAlpha = composite_alpha;
+    swapchain_info.presentMode = present_mode_;
+    swapchain_info.clipped = VK_TRUE;
+    swapchain_info.oldSwapchain = old_swapchain;
+    check(vkCreateSwapchainKHR(device_, &swapchain_info, nullptr, &swapchain_), "vkCreateSwapchainKHR");
+
+    if (old_swapchain) {
+        // ids queued to the old swapchain complete with it, or never
+        pending_presents_.clear();
+        vkDeviceWaitIdle(device_);
+        destroy_swapchain_resources();
+        vkDestroySwapchainKHR(device_, old_swapchain, nullptr);
+    }
+
+    uint32_t count = 0;
+    check(vkGetSwapchainImagesKHR(device_, swapchain_, &count, nullptr), "vkGetSwapchainImagesKHR");
+    images_.resize(count);
+    check(vkGetSwapchainImagesKHR(device_, swapchain_, &count, images_.data()), "vkGetSwapchainImagesKHR");
+    // the new images have no contents to build on
+    image_frames_.assign(count, 0);
+    damage_tracker_.reset();
+
+    image_views_.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        VkImageViewCreateInfo view_info{};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = images_[i];
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = surface_format_.format;
+        view_info.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        check(vkCreateImageView(device_, &view_info, nullptr, &image_views_[i]), "vkCreateImageView");
+    }
+
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    present_semaphores_.resize(count);
+    for (auto &semaphore: present_semaphores_) {
+        check(vkCreateSemaphore(device_, &semaphore_info, nullptr, &semaphore), "vkCreateSemaphore");
+    }
+    swapchain_dirty_ = false;
+}
+
+/**
+ * @brief Destroys the image views and present semaphores of the current swapchain.
+ */
+void WindowVulkan::destroy_swapchain_resources() {
+    for (auto view: image_views_) {
+        vkDestroyImageView(device_, view, nullptr);
+    }
+    image_views_.clear();
+    for (auto semaphore: present_semaphores_) {
+        vkDestroySemaphore(device_, semaphore, nullptr);
+    }
+    present_semaphores_.clear();
+}
+
+/**
+ * @brief Creates the timeline semaphore and the per-frame command pools.
+ *
+ * @param count The number of frames in flight.
+ */
+void WindowVulkan::create_frames(uint32_t count) {
+    VkSemaphoreTypeCreateInfo type_info{};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+    VkSemaphoreCreateInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    timeline_info.pNext = &type_info;
+    check(vkCreateSemaphore(device_, &timeline_info, nullptr, &timeline_), "vkCreateSemaphore");
+
+    frames_.resize(count);
+    for (uint32_t i = 0; i < count; i++) {
+        auto &frame = frames_[i];
+        frame = {};
+        frame.index = i;
+
+        VkCommandPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        pool_info.queueFamilyIndex = queue_family_;
+        check(vkCreateCommandPool(device_, &pool_info, nullptr, &frame.command_pool), "vkCreateCommandPool");
+
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = frame.command_pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
+        check(vkAllocateCommandBuffers(device_, &alloc_info, &frame.command_buffer), "vkAllocateCommandBuffers");
+
+        VkSemaphoreCreateInfo semaphore_info{};
+        semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        check(vkCreateSemaphore(device_, &semaphore_info, nullptr, &frame.acquire_semaphore), "vkCreateSemaphore");
+    }
+}
+
+/**
+ * @brief Destroys the per-frame resources; the device must be idle.
+ */
+void WindowVulkan::destroy_frames() {
+    for (auto &frame: frames_) {
+        if (frame.acquire_semaphore) {
+            vkDestroySemaphore(device_, frame.acquire_semaphore, nullptr);
+        }
+        if (frame.command_pool) {
+            vkDestroyCommandPool(device_, frame.command_pool, nullptr);
+        }
+    }
+    frames_.clear();
+    if (timeline_) {
+        vkDestroySemaphore(device_, timeline_, nullptr);
+        timeline_ = VK_NULL_HANDLE;
+    }
+}
+
+/**
+ * @brief Returns the requested present mode if the surface supports it, FIFO otherwise.
+ *
+ * MAILBOX and IMMEDIATE never block in vkQueuePresentKHR, FIFO_RELAXED tears only when
+ * a frame misses its vblank.
+ */
+VkPresentModeKHR WindowVulkan::choose_present_mode() const {
+    uint32_t count = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device_, surface_, &count, nullptr);
+    std::vector<VkPresentModeKHR> modes(count);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device_, surface_, &count, modes.data());
+    if (std::find(modes.begin(), modes.end(), requested_present_mode_) != modes.end()) {
+        return requested_present_mode_;
+    }
+    LOG_WARN("Vulkan present mode %d not supported, using FIFO", static_cast<int>(requested_present_mode_));
+    return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+/**
+ * @brief Prefers an 8-bit BGRA or RGBA sRGB-nonlinear format, else the first one offered.
+ */
+VkSurfaceFormatKHR WindowVulkan::choose_surface_format() const {
+    uint32_t count = 0;
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device_, surface_, &count, nullptr);
+    std::vector<VkSurfaceFormatKHR> formats(count);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device_, surface_, &count, formats.data());
+    for (const auto &format: formats) {
+        if ((format.format == VK_FORMAT_B8G8R8A8_UNORM || format.format == VK_FORMAT_R8G8B8A8_UNORM) &&
+            format.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+            return format;
+        }
+    }
+    if (formats.empty()) {
+        throw std::runtime_error("Vulkan surface reports no formats");
+    }
+    return formats.front();
+}
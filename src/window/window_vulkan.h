@@ -14,21 +14,258 @@
  * limitations under the License.
  */
 
+
 #ifndef SRC_WINDOW_WINDOW_VULKAN_H_
 #define SRC_WINDOW_WINDOW_VULKAN_H_
 
-#include "window.h"
+#ifndef VK_USE_PLATFORM_WAYLAND_KHR
+#define VK_USE_PLATFORM_WAYLAND_KHR
+#endif
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.h>
+#include <wayland-client.h>
+
+#include "frame_clock.h"
+#include "frame_stats.h"
+#include "render_surface.h"
+#include "utils/listener.h"
+#include "vulkan_pipeline_cache.h"
+#include "utils/export.h"
 
+struct WindowVulkanConfig {
+    // falls back to FIFO, the only mode every implementation has to support
+    VkPresentModeKHR present_mode{VK_PRESENT_MODE_FIFO_KHR};
+    // swapchain images, 0 picks one more than the surface minimum
+    uint32_t image_count{};
+    // frames the CPU may record ahead of the GPU, clamped to [2, 3]
+    uint32_t frames_in_flight{2};
+    // presents queued ahead of the screen before begin_frame() waits, with VK_KHR_present_wait;
+    // 0 renders as fast as the swapchain allows
+    uint32_t present_latency{1};
+    // where the pipeline cache persists across runs, empty keeps it in memory only
+    std::string pipeline_cache_directory{VulkanPipelineCache::default_directory()};
+};
 
-class WindowVulkan : public Window {
+class WAYPP_EXPORT WindowVulkan : public RenderSurface {
 public:
-    explicit WindowVulkan(struct wl_display *display, struct wl_compositor *compositor, int width, int height,
-                          ShellType shell_type = XDG,
-                          const std::function<void(void *data, uint32_t time)> &draw_callback = nullptr);
+    static constexpr uint32_t kMinFramesInFlight = 2;
+    static constexpr uint32_t kMaxFramesInFlight = 3;
+    // frames between pipeline cache saves, so a killed process keeps what it compiled
+    static constexpr uint64_t kPipelineCacheSaveInterval = 600;
+    // a present that takes longer is given up on, e.g. while the surface is hidden
+    static constexpr uint64_t kPresentWaitTimeoutNs = 1000000000;
+
+    struct Frame {
+        // frame slot in [0, frames in flight), selects the per-frame resources
+        uint32_t index;
+        // frame counter, the timeline value signaled once the GPU has finished the frame
+        uint64_t number;
+        // reset when the frame begins, command buffers allocated from it stay valid
+        VkCommandPool command_pool;
+        // primary command buffer, in the recording state between begin_frame() and end_frame()
+        VkCommandBuffer command_buffer;
+        // acquired swapchain image, in VK_IMAGE_LAYOUT_UNDEFINED or as presented last time
+        uint32_t image_index;
+        VkImage image;
+        VkImageView image_view;
+        VkExtent2D extent;
+        // signaled by the acquire, waited on by the submit in end_frame()
+        VkSemaphore acquire_semaphore;
+        // CLOCK_MONOTONIC time begin_frame() returned, after any present wait
+        uint64_t start_ns;
+    };
+
+    explicit WindowVulkan(struct wl_display *display, struct wl_surface *surface, int width, int height,
+                          const WindowVulkanConfig &config = {});
 
     ~WindowVulkan() override;
 
+    WindowVulkan(const WindowVulkan &) = delete;
+
+    WindowVulkan &operator=(const WindowVulkan &) = delete;
+
+    void resize(int width, int height) override;
+
+    void set_present_mode(VkPresentModeKHR present_mode);
+
+    [[nodiscard]] VkResult acquire_next_image(VkSemaphore signal, uint32_t *image_index);
+
+    [[nodiscard]] VkResult present(uint32_t image_index, VkSemaphore wait);
+
+    [[nodiscard]] Frame *begin_frame();
+
+    [[nodiscard]] VkResult end_frame(Frame *frame);
+
+    [[nodiscard]] Backend get_backend() const override { return VULKAN; }
+
+    // begin_frame() for callers that track damage, the frame is then get_current_frame()
+    [[nodiscard]] std::vector<Rect> begin_frame(const std::vector<Rect> &damage) override;
+
+    bool end_frame(const std::vector<Rect> &damage) override;
+
+    // the frame begun by begin_frame(damage), nullptr outside one
+    [[nodiscard]] Frame *get_current_frame() const { return current_frame_; }
+
+    [[nodiscard]] int get_buffer_width() const override { return static_cast<int>(extent_.width); }
+
+    [[nodiscard]] int get_buffer_height() const override { return static_cast<int>(extent_.height); }
+
+    bool draw_frame(uint32_t time);
+
+    void set_draw_callback(const std::function<void(const Frame &frame, uint32_t time)> &callback) {
+        draw_callback_ = callback;
+        draw_handler_ = nullptr;
+    }
+
+    // like set_draw_callback() with Fn bound at compile time, called without type erasure or allocation
+    template<auto Fn, typename T>
+    void set_draw_handler(T *obj) {
+        draw_handler_ = listener_thunk<Fn>;
+        draw_handler_data_ = obj;
+        draw_callback_ = nullptr;
+    }
+
+    [[nodiscard]] uint32_t get_frames_in_flight() const { return static_cast<uint32_t>(frames_.size()); }
+
+    [[nodiscard]] VkSemaphore get_timeline_semaphore() const { return timeline_; }
+
+    [[nodiscard]] VkInstance get_instance() const { return instance_; }
+
+    [[nodiscard]] VkPhysicalDevice get_physical_device() const { return physical_device_; }
+
+    [[nodiscard]] VkDevice get_device() const { return device_; }
+
+    [[nodiscard]] VkQueue get_queue() const { return queue_; }
+
+    // persistent across runs, pass it to every pipeline creation
+    [[nodiscard]] VkPipelineCache get_pipeline_cache() const { return pipeline_cache_->get_cache(); }
+
+    bool save_pipeline_cache() { return pipeline_cache_->save(); }
+
+    [[nodiscard]] uint32_t get_queue_family() const { return queue_family_; }
+
+    [[nodiscard]] VkFormat get_format() const { return surface_format_.format; }
+
+    [[nodiscard]] VkExtent2D get_extent() const { return extent_; }
+
+    [[nodiscard]] VkPresentModeKHR get_present_mode() const { return present_mode_; }
+
+    [[nodiscard]] const std::vector<VkImage> &get_images() const { return images_; }
+
+    // only 8-bit RGBA swapchain formats are picked, so 4 bytes a pixel
+    [[nodiscard]] MemoryUsage get_memory_usage() const override {
+        return {static_cast<uint64_t>(extent_.width) * extent_.height * 4 * images_.size(), 0, 0,
+                static_cast<uint32_t>(images_.size())};
+    }
+
+    [[nodiscard]] const std::vector<VkImageView> &get_image_views() const { return image_views_; }
+
+    // VK_KHR_present_id and VK_KHR_present_wait, begin_frame() is paced by presentation
+    [[nodiscard]] bool has_present_wait() const { return pfWaitForPresent_ != nullptr; }
+
+    // the output the window is shown on, its period turns present times into vblank counts
+    void set_frame_clock(const FrameClock *clock) override { frame_clock_ = clock; }
+
+    [[nodiscard]] const FrameClock *get_frame_clock() const { return frame_clock_; }
+
+    [[nodiscard]] const FrameStats &get_frame_stats() const { return frame_stats_; }
+
+    [[nodiscard]] const FrameStats *get_present_stats() const override { return &frame_stats_; }
+
+    void reset_frame_stats() { frame_stats_.reset(); }
+
+    // CLOCK_MONOTONIC time the last present was seen to complete, 0 without present wait
+    [[nodiscard]] uint64_t get_last_present_ns() const { return last_present_ns_; }
+
+    // dmabuf export and sync_file semaphores are available, see VulkanDmabuf
+    [[nodiscard]] bool has_dmabuf_interop() const { return dmabuf_interop_; }
+
+    // queue family images are released to and acquired from when shared outside Vulkan
+    [[nodiscard]] uint32_t get_foreign_queue_family() const {
+        return queue_family_foreign_ ? VK_QUEUE_FAMILY_FOREIGN_EXT : VK_QUEUE_FAMILY_EXTERNAL;
+    }
+
 private:
+    VkInstance instance_{};
+    VkSurfaceKHR surface_{};
+    VkPhysicalDevice physical_device_{};
+    uint32_t queue_family_{};
+    VkDevice device_{};
+    VkQueue queue_{};
+    bool dmabuf_interop_{};
+    bool queue_family_foreign_{};
+    std::unique_ptr<VulkanPipelineCache> pipeline_cache_;
+
+    struct PendingPresent {
+        uint64_t id;
+        uint64_t start_ns;
+    };
+
+    PFN_vkWaitForPresentKHR pfWaitForPresent_{};
+    uint32_t present_latency_;
+    // present ids are only waited on for the swapchain they were queued to
+    uint64_t present_id_{};
+    std::deque<PendingPresent> pending_presents_;
+    uint64_t last_present_ns_{};
+    uint64_t frame_start_ns_{};
+    const FrameClock *frame_clock_{};
+    FrameStats frame_stats_;
+
+    VkSwapchainKHR swapchain_{};
+    VkSurfaceFormatKHR surface_format_{};
+    VkPresentModeKHR requested_present_mode_;
+    VkPresentModeKHR present_mode_{VK_PRESENT_MODE_FIFO_KHR};
+    uint32_t requested_image_count_;
+    VkExtent2D extent_{};
+    std::vector<VkImage> images_;
+    std::vector<VkImageView> image_views_;
+    // signaled by the submit, waited on by the present; one per image since an image
+    // may be re-acquired before the presentation engine is done with its semaphore
+    std::vector<VkSemaphore> present_semaphores_;
+    // set on resize or a suboptimal present, the swapchain is rebuilt before the next acquire
+    bool swapchain_dirty_{};
+    // VK_KHR_incremental_present, the damage passed to end_frame() is handed to the compositor
+    bool incremental_present_{};
+    // Frame::number each image was last rendered in, 0 while its contents are undefined
+    std::vector<uint64_t> image_frames_;
+    DamageTracker damage_tracker_;
+    // damage of the frame being submitted, empty for all of it
+    std::vector<Rect> frame_damage_;
+    Frame *current_frame_{};
+
+    std::vector<Frame> frames_;
+    // signaled with Frame::number when a frame's submission completes
+    VkSemaphore timeline_{};
+    uint64_t frame_count_{};
+    std::function<void(const Frame &frame, uint32_t time)> draw_callback_;
+    void (*draw_handler_)(void *data, const Frame &frame, uint32_t time){};
+    void *draw_handler_data_{};
+
+    void create_instance();
+
+    void pick_physical_device();
+
+    void create_device();
+
+    void create_swapchain();
+
+    void create_frames(uint32_t count);
+
+    void wait_for_presents();
+
+    void destroy_frames();
+
+    void destroy_swapchain_resources();
+
+    VkPresentModeKHR choose_present_mode() const;
+
+    VkSurfaceFormatKHR choose_surface_format() const;
 };
 
-#endif // SRC_WINDOW_WINDOW_VULKAN_H_
\ No newline at end of file
+#endif // SRC_WINDOW_WINDOW_VULKAN_H_
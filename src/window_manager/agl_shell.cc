@@ -0,0 +1,189 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "agl_shell.h"
+
+#include <algorithm>
+#include <ctime>
+#include <stdexcept>
+
+#include "display.h"
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+namespace {
+uint64_t monotonic_ns() {
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+}
+
+/**
+ * @class AglShell
+ *
+ * @brief The agl_shell client of an AGL homescreen.
+ *
+ * The homescreen gives the compositor its background and panel surfaces, then
+ * signals ready; until then the compositor shows nothing. Applications started
+ * up front stay hidden until activate_app() brings one to the front, so
+ * switching apps is a single request with no surface to create or configure.
+ *
+ * Only one client may be the shell. From version 2 the compositor confirms the
+ * bind, which takes one roundtrip in the constructor.
+ */
+AglShell::AglShell(const Display *display) {
+    agl_shell_ = static_cast<struct agl_shell *>(
+            display->bind_global(&agl_shell_interface,
+                                 std::min(10u, static_cast<uint32_t>(agl_shell_interface.version)),
+                                 &version_));
+    if (!agl_shell_) {
+        throw std::runtime_error("agl_shell is not available.");
+    }
+    agl_shell_add_listener(agl_shell_, &listener_, this);
+
+    if (version_ >= AGL_SHELL_BOUND_OK_SINCE_VERSION) {
+        while (!bound_ && !bound_failed_) {
+            if (wl_display_roundtrip(display->get_display()) < 0) {
+                throw std::runtime_error("agl_shell bind not confirmed.");
+            }
+        }
+        if (bound_failed_) {
+            agl_shell_destroy(agl_shell_);
+            throw std::runtime_error("agl_shell is bound by another client.");
+        }
+    } else {
+        bound_ = true;
+    }
+}
+
+AglShell::~AglShell() {
+    if (version_ >= AGL_SHELL_DESTROY_SINCE_VERSION) {
+        agl_shell_destroy(agl_shell_);
+    } else {
+        wl_proxy_destroy(reinterpret_cast<struct wl_proxy *>(agl_shell_));
+    }
+}
+
+/**
+ * @brief Makes surface the background of output, sized by the compositor to the whole output.
+ *
+ * Only valid before ready().
+ */
+void AglShell::set_background(struct wl_surface *surface, struct wl_output *output) {
+    agl_shell_set_background(agl_shell_, surface, output);
+}
+
+/**
+ * @brief Makes surface a panel along an edge of output, sized by its buffer.
+ *
+ * Requests the compositor would answer with a protocol error are not sent.
+ *
+ * @param edge An agl_shell_edge.
+ * @return false after ready(), for an unknown edge, or if the edge of output has a panel already.
+ */
+bool AglShell::set_panel(struct wl_surface *surface, struct wl_output *output, uint32_t edge) {
+    if (ready_) {
+        LOG_ERROR("AglShell: panels must be set before ready");
+        return false;
+    }
+    if (!surface || !output || edge > AGL_SHELL_EDGE_RIGHT) {
+        LOG_ERROR("AglShell: invalid panel for edge %u", edge);
+        return false;
+    }
+    if (!panels_.emplace(output, edge).second) {
+        LOG_ERROR("AglShell: edge %u of the output has a panel already", edge);
+        return false;
+    }
+    agl_shell_set_panel(agl_shell_, surface, output, edge);
+    return true;
+}
+
+/**
+ * @brief Tells the compositor the shell surfaces are set up and may be shown.
+ *
+ * Call it as soon as the first frame of the background is committed, anything
+ * later only delays the first picture. Sent once, later calls do nothing.
+ */
+void AglShell::ready() {
+    if (ready_) {
+        return;
+    }
+    ready_ = true;
+    agl_shell_ready(agl_shell_);
+}
+
+/**
+ * @brief Brings a running application to the front of output.
+ *
+ * The time until the compositor reports the app activated is logged as the
+ * switch latency, from version 3.
+ *
+ * @param app_id The xdg app id of the application.
+ * @param output The output to show it on.
+ */
+void AglShell::activate_app(const char *app_id, struct wl_output *output) {
+    activations_[app_id] = monotonic_ns();
+    agl_shell_activate_app(agl_shell_, app_id, output);
+}
+
+/**
+ * @brief Hides an application, showing the one before it, from version 5.
+ *
+ * @param app_id The xdg app id of the application.
+ * @return false if the compositor does not support deactivation.
+ */
+bool AglShell::deactivate_app(const char *app_id) {
+    if (version_ < AGL_SHELL_DEACTIVATE_APP_SINCE_VERSION) {
+        return false;
+    }
+    agl_shell_deactivate_app(agl_shell_, app_id);
+    return true;
+}
+
+void AglShell::handle_bound_ok(struct agl_shell * /* shell */) {
+    bound_ = true;
+}
+
+void AglShell::handle_bound_fail(struct agl_shell * /* shell */) {
+    // not thrown here, this runs inside libwayland
+    bound_failed_ = true;
+}
+
+void AglShell::handle_app_state(struct agl_shell * /* shell */, const char *app_id, uint32_t state) {
+    if (state == AGL_SHELL_APP_STATE_ACTIVATED) {
+        if (const auto it = activations_.find(app_id); it != activations_.end()) {
+            LOG_DEBUG("AglShell: %s activated in %.3f ms", app_id,
+                      static_cast<double>(monotonic_ns() - it->second) / 1e6);
+            activations_.erase(it);
+        }
+    }
+    if (app_state_callback_) {
+        app_state_callback_(app_id, state);
+    }
+}
+
+void AglShell::handle_app_on_output(struct agl_shell * /* shell */, const char *app_id, const char *output_name) {
+    LOG_DEBUG("AglShell: %s on %s", app_id, output_name);
+}
+
+const struct agl_shell_listener AglShell::listener_ = {
+        .bound_ok = listener_thunk<&AglShell::handle_bound_ok>,
+        .bound_fail = listener_thunk<&AglShell::handle_bound_fail>,
+        .app_state = listener_thunk<&AglShell::handle_app_state>,
+        .app_on_output = listener_thunk<&AglShell::handle_app_on_output>,
+};
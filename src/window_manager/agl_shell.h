@@ -0,0 +1,85 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_AGL_SHELL_H_
+#define SRC_WINDOW_MANAGER_AGL_SHELL_H_
+
+#include <cstdint>
+#include <functional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "agl-shell-client-protocol.h"
+#include "utils/export.h"
+
+class Display;
+
+class WAYPP_EXPORT AglShell {
+public:
+    explicit AglShell(const Display *display);
+
+    ~AglShell();
+
+    AglShell(const AglShell &) = delete;
+
+    AglShell &operator=(const AglShell &) = delete;
+
+    [[nodiscard]] uint32_t get_version() const { return version_; }
+
+    void set_background(struct wl_surface *surface, struct wl_output *output);
+
+    bool set_panel(struct wl_surface *surface, struct wl_output *output, uint32_t edge);
+
+    void ready();
+
+    [[nodiscard]] bool is_ready() const { return ready_; }
+
+    void activate_app(const char *app_id, struct wl_output *output);
+
+    bool deactivate_app(const char *app_id);
+
+    // agl_shell_app_state; started, terminated, activated and deactivated, from version 3
+    void set_app_state_callback(const std::function<void(const std::string &app_id, uint32_t state)> &callback) {
+        app_state_callback_ = callback;
+    }
+
+private:
+    struct agl_shell *agl_shell_{};
+    uint32_t version_{};
+    bool bound_{};
+    bool bound_failed_{};
+    bool ready_{};
+    std::function<void(const std::string &app_id, uint32_t state)> app_state_callback_;
+    // edges of each output given a panel, a second one is a protocol error
+    std::set<std::pair<struct wl_output *, uint32_t>> panels_;
+    // when activate_app was sent, by app id, for the switch latency
+    std::unordered_map<std::string, uint64_t> activations_;
+
+    void handle_bound_ok(struct agl_shell *shell);
+
+    void handle_bound_fail(struct agl_shell *shell);
+
+    void handle_app_state(struct agl_shell *shell, const char *app_id, uint32_t state);
+
+    void handle_app_on_output(struct agl_shell *shell, const char *app_id, const char *output_name);
+
+    static const struct agl_shell_listener listener_;
+};
+
+#endif // SRC_WINDOW_MANAGER_AGL_SHELL_H_
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_AWAITABLES_H_
+#define SRC_WINDOW_MANAGER_AWAITABLES_H_
+
+// the library builds as C++17; applications built as C++20 get these on top of the callbacks
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <exception>
+
+#include "window_manager.h"
+
+/**
+ * @brief A coroutine that starts right away and frees itself when it returns.
+ *
+ * It is resumed from the Wayland callbacks it waits on, on the thread dispatching
+ * them, so no threads are involved. The objects it waits on must outlive it; a
+ * coroutine still waiting when they are destroyed is never resumed, nor freed.
+ *
+ * @code
+ * AsyncTask startup(WindowManager &wm) {
+ *     co_await configured(wm);
+ *     co_await sync(wm);
+ *     for (int i = 0; i < 60; i++) {
+ *         const uint32_t time = co_await next_frame(wm);
+ *         animate(time);
+ *     }
+ * }
+ * @endcode
+ */
+struct AsyncTask {
+    struct promise_type {
+        AsyncTask get_return_object() noexcept { return {}; }
+
+        std::suspend_never initial_suspend() noexcept { return {}; }
+
+        std::suspend_never final_suspend() noexcept { return {}; }
+
+        void return_void() noexcept {}
+
+        // resumed from libwayland callbacks, which cannot unwind
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+// resumes after the window's next frame is committed, with the frame callback timestamp
+struct NextFrameAwaiter {
+    Window &window;
+    uint32_t time{};
+
+    [[nodiscard]] bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        window.on_next_frame([this, handle](uint32_t frame_time) {
+            time = frame_time;
+            handle.resume();
+        });
+    }
+
+    [[nodiscard]] uint32_t await_resume() const noexcept { return time; }
+};
+
+inline NextFrameAwaiter next_frame(Window &window) { return {window}; }
+
+// resumes with the next presentation feedback, see Window::on_next_presentation()
+struct PresentationAwaiter {
+    Window &window;
+    Window::PresentationFeedback feedback{};
+
+    [[nodiscard]] bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        window.on_next_presentation([this, handle](const Window::PresentationFeedback &presented) {
+            feedback = presented;
+            handle.resume();
+        });
+    }
+
+    [[nodiscard]] const Window::PresentationFeedback &await_resume() const noexcept { return feedback; }
+};
+
+inline PresentationAwaiter next_presentation(Window &window) { return {window}; }
+
+// resumes once the toplevel is configured, right away if it already is; replaces the configure callback
+struct ConfiguredAwaiter {
+    WindowManager &wm;
+
+    [[nodiscard]] bool await_ready() const noexcept { return wm.configured(); }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        wm.set_configure_callback([handle]() { handle.resume(); });
+    }
+
+    void await_resume() const noexcept {}
+};
+
+inline ConfiguredAwaiter configured(WindowManager &wm) { return {wm}; }
+
+// resumes once the compositor has processed the requests sent so far, see Display::sync()
+struct SyncAwaiter {
+    const Display &display;
+
+    [[nodiscard]] bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) const {
+        display.sync([handle]() { handle.resume(); });
+    }
+
+    void await_resume() const noexcept {}
+};
+
+inline SyncAwaiter sync(const Display &display) { return {display}; }
+
+#endif
+
+#endif // SRC_WINDOW_MANAGER_AWAITABLES_H_
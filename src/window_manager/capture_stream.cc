@@ -0,0 +1,478 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "capture_stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "display.h"
+#include "output.h"
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+namespace {
+// 32 bits per pixel formats in order of preference; XRGB8888 and ARGB8888 need no swizzle in most encoders
+constexpr uint32_t kShmFormats[] = {
+        WL_SHM_FORMAT_XRGB8888,
+        WL_SHM_FORMAT_ARGB8888,
+        WL_SHM_FORMAT_XBGR8888,
+        WL_SHM_FORMAT_ABGR8888,
+};
+}
+
+/**
+ * @class CaptureStream
+ * @brief Continuous capture of an output through ext_image_copy_capture_v1.
+ *
+ * The compositor copies each new output frame into the next free buffer of a
+ * small ring and the frame callback gets it, so frames arrive at the output's
+ * rate and only when its content changed. With a dmabuf allocator and a
+ * compositor offering dmabuf capture, the ring is dmabufs the compositor
+ * writes on the GPU, ready for a hardware encoder with no readback; otherwise
+ * it is shm buffers sliced from one growable memfd, see ShmPool.
+ *
+ * Each buffer tracks what changed on the output since it was last captured
+ * and sends that as buffer damage, so the compositor copies only those
+ * regions into it instead of the whole output.
+ *
+ * The consumer owns a delivered buffer until release(). Buffers are
+ * reallocated when the compositor changes the constraints; one still held is
+ * destroyed on release. A dmabuf import the compositor rejects drops the ring
+ * to shm until the constraints change.
+ */
+CaptureStream::CaptureStream(const Display *display, const Output *output, const CaptureStreamConfig &config) :
+        display_(display), config_(config) {
+    source_manager_ = static_cast<struct ext_output_image_capture_source_manager_v1 *>(
+            display->bind_global(&ext_output_image_capture_source_manager_v1_interface, 1));
+    capture_manager_ = static_cast<struct ext_image_copy_capture_manager_v1 *>(
+            display->bind_global(&ext_image_copy_capture_manager_v1_interface, 1));
+    if (!source_manager_ || !capture_manager_) {
+        if (source_manager_) {
+            ext_output_image_capture_source_manager_v1_destroy(source_manager_);
+        }
+        if (capture_manager_) {
+            ext_image_copy_capture_manager_v1_destroy(capture_manager_);
+        }
+        throw std::runtime_error("ext_image_copy_capture_manager_v1 is not available.");
+    }
+    if (config_.buffer_count == 0) {
+        config_.buffer_count = 1;
+    }
+    source_ = ext_output_image_capture_source_manager_v1_create_source(source_manager_, output->get_output());
+}
+
+/**
+ * @brief Ends the stream; buffers still held by the consumer are destroyed too.
+ */
+CaptureStream::~CaptureStream() {
+    stop();
+    while (!buffers_.empty()) {
+        destroy_buffer(buffers_.back().get());
+    }
+    ext_image_capture_source_v1_destroy(source_);
+    ext_image_copy_capture_manager_v1_destroy(capture_manager_);
+    ext_output_image_capture_source_manager_v1_destroy(source_manager_);
+}
+
+/**
+ * @brief Starts a capture session; frames follow once the compositor sent its constraints.
+ */
+void CaptureStream::start() {
+    if (running_) {
+        return;
+    }
+    running_ = true;
+    pending_ = {};
+    constraints_valid_ = false;
+    uint32_t options = config_.paint_cursors ? EXT_IMAGE_COPY_CAPTURE_MANAGER_V1_OPTIONS_PAINT_CURSORS : 0;
+    session_ = ext_image_copy_capture_manager_v1_create_session(capture_manager_, source_, options);
+    ext_image_copy_capture_session_v1_add_listener(session_, &session_listener_, this);
+}
+
+/**
+ * @brief Ends the session; the ring is kept for a later start().
+ */
+void CaptureStream::stop() {
+    running_ = false;
+    if (frame_) {
+        ext_image_copy_capture_frame_v1_destroy(frame_);
+        frame_ = nullptr;
+        if (frame_buffer_ && frame_buffer_->retired) {
+            destroy_buffer(frame_buffer_);
+        }
+        frame_buffer_ = nullptr;
+    }
+    if (session_) {
+        ext_image_copy_capture_session_v1_destroy(session_);
+        session_ = nullptr;
+    }
+}
+
+/**
+ * @brief Returns a delivered buffer to the ring.
+ */
+void CaptureStream::release(Buffer *buffer) {
+    if (!buffer || !buffer->held) {
+        return;
+    }
+    buffer->held = false;
+    if (buffer->retired) {
+        destroy_buffer(buffer);
+    }
+    capture_next();
+}
+
+void CaptureStream::allocate_buffers() {
+    retire_buffers();
+    bool dmabuf = !dmabuf_rejected_ && dmabuf_allocator_.allocate && !current_.dmabuf.formats.empty() &&
+                  display_->get_linux_dmabuf() &&
+                  display_->get_linux_dmabuf_version() >= ZWP_LINUX_BUFFER_PARAMS_V1_CREATE_IMMED_SINCE_VERSION;
+    if (dmabuf && allocate_dmabufs()) {
+        return;
+    }
+    if (!allocate_shm()) {
+        LOG_ERROR("No capture buffers for %dx%d", current_.width, current_.height);
+    }
+}
+
+bool CaptureStream::allocate_dmabufs() {
+    std::vector<Buffer *> created;
+    for (uint32_t i = 0; i < config_.buffer_count; i++) {
+        DmabufAttributes attributes{};
+        if (!dmabuf_allocator_.allocate(current_.width, current_.height, current_.dmabuf, attributes) ||
+            attributes.num_planes == 0 || attributes.num_planes > DmabufAttributes::kMaxPlanes) {
+            LOG_WARN("dmabuf capture buffer allocation failed, capturing to shm");
+            for (auto buffer: created) {
+                destroy_buffer(buffer);
+            }
+            return false;
+        }
+
+        auto params = zwp_linux_dmabuf_v1_create_params(display_->get_linux_dmabuf());
+        const auto modifier_hi = static_cast<uint32_t>(attributes.modifier >> 32);
+        const auto modifier_lo = static_cast<uint32_t>(attributes.modifier & 0xffffffff);
+        for (uint32_t plane = 0; plane < attributes.num_planes; plane++) {
+            zwp_linux_buffer_params_v1_add(params, attributes.fd[plane], plane, attributes.offset[plane],
+                                           attributes.stride[plane], modifier_hi, modifier_lo);
+        }
+        // a rejected import is reported on params, so they live as long as the buffer
+        zwp_linux_buffer_params_v1_add_listener(params, &params_listener_, this);
+        auto wl_buffer = zwp_linux_buffer_params_v1_create_immed(params, attributes.width, attributes.height,
+                                                                 attributes.format, attributes.flags);
+
+        buffers_.push_back(std::make_unique<Buffer>(Buffer{
+                .wl_buffer = wl_buffer,
+                .data = nullptr,
+                .width = attributes.width,
+                .height = attributes.height,
+                .stride = static_cast<int32_t>(attributes.stride[0]),
+                .format = attributes.format,
+                .dmabuf = true,
+                .attributes = attributes,
+                .params = params,
+                .fd = -1,
+                .offset = 0,
+                .shm = nullptr,
+                .damage = {{0, 0, attributes.width, attributes.height}},
+                .held = false,
+                .retired = false,
+        }));
+        created.push_back(buffers_.back().get());
+    }
+    return true;
+}
+
+bool CaptureStream::allocate_shm() {
+    const auto &offered = current_.shm_formats;
+    auto it = std::find_if(std::begin(kShmFormats), std::end(kShmFormats), [&](uint32_t format) {
+        return std::find(offered.begin(), offered.end(), format) != offered.end();
+    });
+    if (it == std::end(kShmFormats) || !display_->get_shm()) {
+        return false;
+    }
+    const uint32_t format = *it;
+    const int32_t stride = current_.width * 4;
+
+    if (!shm_pool_) {
+        try {
+            shm_pool_ = std::make_unique<ShmPool>(display_->get_shm(), "waypp-capture-stream");
+        } catch (const std::exception &e) {
+            LOG_ERROR("Capture buffer allocation failed: %s", e.what());
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < config_.buffer_count; i++) {
+        auto shm = shm_pool_->create_buffer(current_.width, current_.height, stride, format);
+        if (!shm) {
+            LOG_ERROR("Capture buffer allocation failed");
+            return !buffers_.empty();
+        }
+        buffers_.push_back(std::make_unique<Buffer>(Buffer{
+                .wl_buffer = shm->wl_buffer,
+                .data = shm->data,
+                .width = current_.width,
+                .height = current_.height,
+                .stride = stride,
+                .format = format,
+                .dmabuf = false,
+                .attributes = {},
+                .params = nullptr,
+                .fd = shm_pool_->get_fd(),
+                .offset = shm->offset,
+                .shm = shm,
+                .damage = {{0, 0, current_.width, current_.height}},
+                .held = false,
+                .retired = false,
+        }));
+    }
+    return true;
+}
+
+void CaptureStream::retire_buffers() {
+    std::vector<Buffer *> unused;
+    for (auto &buffer: buffers_) {
+        if (buffer->held || buffer.get() == frame_buffer_) {
+            buffer->retired = true;
+        } else {
+            unused.push_back(buffer.get());
+        }
+    }
+    for (auto buffer: unused) {
+        destroy_buffer(buffer);
+    }
+}
+
+void CaptureStream::destroy_buffer(Buffer *buffer) {
+    if (buffer->dmabuf) {
+        wl_buffer_destroy(buffer->wl_buffer);
+        zwp_linux_buffer_params_v1_destroy(buffer->params);
+        if (dmabuf_allocator_.free) {
+            dmabuf_allocator_.free(buffer->attributes);
+        }
+    } else {
+        shm_pool_->destroy_buffer(buffer->shm);
+    }
+    buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+                                  [buffer](const std::unique_ptr<Buffer> &b) { return b.get() == buffer; }),
+                   buffers_.end());
+}
+
+CaptureStream::Buffer *CaptureStream::get_free_buffer() const {
+    for (const auto &buffer: buffers_) {
+        if (!buffer->held && !buffer->retired && buffer.get() != frame_buffer_) {
+            return buffer.get();
+        }
+    }
+    return nullptr;
+}
+
+void CaptureStream::capture_next() {
+    if (!running_ || frame_ || !constraints_valid_) {
+        return;
+    }
+    auto buffer = get_free_buffer();
+    if (!buffer) {
+        // every buffer is with the consumer, release() resumes
+        return;
+    }
+    frame_ = ext_image_copy_capture_session_v1_create_frame(session_);
+    ext_image_copy_capture_frame_v1_add_listener(frame_, &frame_listener_, this);
+    ext_image_copy_capture_frame_v1_attach_buffer(frame_, buffer->wl_buffer);
+    for (const auto &rect: buffer->damage) {
+        ext_image_copy_capture_frame_v1_damage_buffer(frame_, rect.x, rect.y, rect.width, rect.height);
+    }
+    ext_image_copy_capture_frame_v1_capture(frame_);
+    frame_buffer_ = buffer;
+    frame_damage_.clear();
+    frame_transform_ = WL_OUTPUT_TRANSFORM_NORMAL;
+    frame_presentation_ns_ = 0;
+}
+
+void CaptureStream::add_damage(Buffer &buffer, const Rect &rect) {
+    if (buffer.damage.size() < kMaxDamageRects) {
+        buffer.damage.push_back(rect);
+        return;
+    }
+    auto &box = buffer.damage.front();
+    auto x0 = rect.x, y0 = rect.y, x1 = rect.x + rect.width, y1 = rect.y + rect.height;
+    for (const auto &r: buffer.damage) {
+        x0 = std::min(x0, r.x);
+        y0 = std::min(y0, r.y);
+        x1 = std::max(x1, r.x + r.width);
+        y1 = std::max(y1, r.y + r.height);
+    }
+    box = {x0, y0, x1 - x0, y1 - y0};
+    buffer.damage.resize(1);
+}
+
+void CaptureStream::handle_buffer_size(struct ext_image_copy_capture_session_v1 * /* session */, uint32_t width,
+                                       uint32_t height) {
+    pending_.width = static_cast<int32_t>(width);
+    pending_.height = static_cast<int32_t>(height);
+}
+
+void CaptureStream::handle_shm_format(struct ext_image_copy_capture_session_v1 * /* session */, uint32_t format) {
+    pending_.shm_formats.push_back(format);
+}
+
+void CaptureStream::handle_dmabuf_device(struct ext_image_copy_capture_session_v1 * /* session */,
+                                         struct wl_array *device) {
+    if (device->size == sizeof(pending_.dmabuf.target_device)) {
+        memcpy(&pending_.dmabuf.target_device, device->data, sizeof(pending_.dmabuf.target_device));
+    }
+}
+
+void CaptureStream::handle_dmabuf_format(struct ext_image_copy_capture_session_v1 * /* session */,
+                                         uint32_t format, struct wl_array *modifiers) {
+    auto data = static_cast<const uint64_t *>(modifiers->data);
+    for (size_t i = 0; i < modifiers->size / sizeof(uint64_t); i++) {
+        pending_.dmabuf.formats.emplace_back(format, data[i]);
+    }
+}
+
+void CaptureStream::handle_session_done(struct ext_image_copy_capture_session_v1 * /* session */) {
+    // every batch of constraints is complete, the next one starts over
+    bool changed = !constraints_valid_ || pending_.width != current_.width || pending_.height != current_.height ||
+                   pending_.shm_formats != current_.shm_formats ||
+                   pending_.dmabuf.target_device != current_.dmabuf.target_device ||
+                   pending_.dmabuf.formats != current_.dmabuf.formats;
+    current_ = std::move(pending_);
+    pending_ = {};
+    constraints_valid_ = true;
+    if (changed) {
+        dmabuf_rejected_ = false;
+    }
+    if (changed || buffers_.empty()) {
+        allocate_buffers();
+    }
+    capture_next();
+}
+
+void CaptureStream::handle_stopped(struct ext_image_copy_capture_session_v1 * /* session */) {
+    stop();
+    if (stopped_callback_) {
+        stopped_callback_();
+    }
+}
+
+void CaptureStream::handle_transform(struct ext_image_copy_capture_frame_v1 * /* frame */, uint32_t transform) {
+    frame_transform_ = transform;
+}
+
+void CaptureStream::handle_damage(struct ext_image_copy_capture_frame_v1 * /* frame */, int32_t x, int32_t y,
+                                  int32_t width, int32_t height) {
+    frame_damage_.push_back({x, y, width, height});
+}
+
+void CaptureStream::handle_presentation_time(struct ext_image_copy_capture_frame_v1 * /* frame */,
+                                             uint32_t tv_sec_hi, uint32_t tv_sec_lo, uint32_t tv_nsec) {
+    const uint64_t sec = (static_cast<uint64_t>(tv_sec_hi) << 32) | tv_sec_lo;
+    frame_presentation_ns_ = sec * 1000000000ULL + tv_nsec;
+}
+
+void CaptureStream::handle_ready(struct ext_image_copy_capture_frame_v1 * /* frame */) {
+    ext_image_copy_capture_frame_v1_destroy(frame_);
+    frame_ = nullptr;
+    auto buffer = frame_buffer_;
+    frame_buffer_ = nullptr;
+
+    // the buffer is current now, every other one misses this frame's changes
+    buffer->damage.clear();
+    for (auto &other: buffers_) {
+        if (other.get() != buffer) {
+            for (const auto &rect: frame_damage_) {
+                add_damage(*other, rect);
+            }
+        }
+    }
+
+    if (buffer->retired) {
+        destroy_buffer(buffer);
+    } else if (frame_callback_) {
+        buffer->held = true;
+        frame_callback_({
+                .buffer = buffer,
+                .damage = frame_damage_,
+                .transform = frame_transform_,
+                .presentation_ns = frame_presentation_ns_,
+        });
+    }
+    capture_next();
+}
+
+void CaptureStream::handle_failed(struct ext_image_copy_capture_frame_v1 * /* frame */, uint32_t reason) {
+    ext_image_copy_capture_frame_v1_destroy(frame_);
+    frame_ = nullptr;
+    auto buffer = frame_buffer_;
+    frame_buffer_ = nullptr;
+    if (buffer && buffer->retired) {
+        destroy_buffer(buffer);
+    }
+
+    switch (reason) {
+        case EXT_IMAGE_COPY_CAPTURE_FRAME_V1_FAILURE_REASON_BUFFER_CONSTRAINTS:
+            // new constraints follow with session done, which reallocates and resumes
+            constraints_valid_ = false;
+            break;
+        case EXT_IMAGE_COPY_CAPTURE_FRAME_V1_FAILURE_REASON_STOPPED:
+            break;
+        default:
+            LOG_WARN("Capture frame failed, retrying");
+            capture_next();
+            break;
+    }
+}
+
+void CaptureStream::handle_params_created(struct zwp_linux_buffer_params_v1 * /* params */,
+                                          struct wl_buffer * /* buffer */) {
+    // only sent for create, a create_immed buffer exists from the request
+}
+
+void CaptureStream::handle_params_failed(struct zwp_linux_buffer_params_v1 * /* params */) {
+    // the rejected wl_buffer is unusable, and the rest of the ring shares its format and modifier
+    if (dmabuf_rejected_) {
+        return;
+    }
+    LOG_WARN("Compositor rejected a dmabuf capture buffer, capturing to shm");
+    dmabuf_rejected_ = true;
+    allocate_buffers();
+    capture_next();
+}
+
+const struct ext_image_copy_capture_session_v1_listener CaptureStream::session_listener_ = {
+        .buffer_size = listener_thunk<&CaptureStream::handle_buffer_size>,
+        .shm_format = listener_thunk<&CaptureStream::handle_shm_format>,
+        .dmabuf_device = listener_thunk<&CaptureStream::handle_dmabuf_device>,
+        .dmabuf_format = listener_thunk<&CaptureStream::handle_dmabuf_format>,
+        .done = listener_thunk<&CaptureStream::handle_session_done>,
+        .stopped = listener_thunk<&CaptureStream::handle_stopped>,
+};
+
+const struct ext_image_copy_capture_frame_v1_listener CaptureStream::frame_listener_ = {
+        .transform = listener_thunk<&CaptureStream::handle_transform>,
+        .damage = listener_thunk<&CaptureStream::handle_damage>,
+        .presentation_time = listener_thunk<&CaptureStream::handle_presentation_time>,
+        .ready = listener_thunk<&CaptureStream::handle_ready>,
+        .failed = listener_thunk<&CaptureStream::handle_failed>,
+};
+
+const struct zwp_linux_buffer_params_v1_listener CaptureStream::params_listener_ = {
+        .created = listener_thunk<&CaptureStream::handle_params_created>,
+        .failed = listener_thunk<&CaptureStream::handle_params_failed>,
+};
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_CAPTURE_STREAM_H_
+#define SRC_WINDOW_MANAGER_CAPTURE_STREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "ext-image-capture-source-v1-client-protocol.h"
+#include "ext-image-copy-capture-v1-client-protocol.h"
+
+#include "dmabuf_feedback.h"
+#include "window/shm_pool.h"
+#include "window/window_dmabuf.h"
+#include "utils/export.h"
+
+class Display;
+
+class Output;
+
+struct CaptureStreamConfig {
+    // buffers in the ring; one is captured into while the consumer holds the others
+    uint32_t buffer_count{3};
+    bool paint_cursors{};
+};
+
+// allocates dmabufs for the ring, on the device and with a format the compositor can write
+struct CaptureDmabufAllocator {
+    std::function<bool(int32_t width, int32_t height, const DmabufFeedback::Tranche &constraints,
+                       DmabufAttributes &attributes)> allocate;
+    std::function<void(const DmabufAttributes &attributes)> free;
+};
+
+class WAYPP_EXPORT CaptureStream {
+public:
+    struct Rect {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    };
+
+    struct Buffer {
+        struct wl_buffer *wl_buffer;
+        // mapping of a shm buffer, stride * height bytes; nullptr for a dmabuf
+        void *data;
+        int32_t width;
+        int32_t height;
+        int32_t stride;
+        // wl_shm format, or DRM fourcc for a dmabuf
+        uint32_t format;
+        bool dmabuf;
+        // the allocation of a dmabuf
+        DmabufAttributes attributes;
+        // the import of a dmabuf, kept with the buffer to hear if the compositor rejects it
+        struct zwp_linux_buffer_params_v1 *params;
+        // a shm buffer's memfd, shared by the ring, and where the buffer starts in it
+        int fd;
+        size_t offset;
+        // the slice of the stream's ShmPool
+        ShmPool::Buffer *shm;
+        // regions changed since this buffer was last captured
+        std::vector<Rect> damage;
+        // handed to the consumer and not yet released
+        bool held;
+        // from a previous allocation, destroyed once released
+        bool retired;
+    };
+
+    struct Frame {
+        Buffer *buffer;
+        // what changed since the previous frame, in buffer coordinates
+        const std::vector<Rect> &damage;
+        // wl_output_transform of the content
+        uint32_t transform;
+        // CLOCK_MONOTONIC time the content was presented, 0 if unknown
+        uint64_t presentation_ns;
+    };
+
+    explicit CaptureStream(const Display *display, const Output *output, const CaptureStreamConfig &config = {});
+
+    ~CaptureStream();
+
+    CaptureStream(const CaptureStream &) = delete;
+
+    CaptureStream &operator=(const CaptureStream &) = delete;
+
+    // the ring uses dmabufs from allocator when the compositor offers dmabuf capture; set before start()
+    void set_dmabuf_allocator(const CaptureDmabufAllocator &allocator) { dmabuf_allocator_ = allocator; }
+
+    // the buffer belongs to the consumer until release()
+    void set_frame_callback(const std::function<void(const Frame &frame)> &callback) { frame_callback_ = callback; }
+
+    // the source went away or the compositor ended the session
+    void set_stopped_callback(const std::function<void()> &callback) { stopped_callback_ = callback; }
+
+    void start();
+
+    void stop();
+
+    void release(Buffer *buffer);
+
+    [[nodiscard]] bool is_running() const { return running_; }
+
+    [[nodiscard]] bool is_dmabuf() const { return !buffers_.empty() && buffers_.front()->dmabuf; }
+
+private:
+    // beyond this the damage of a buffer is its bounding box
+    static constexpr size_t kMaxDamageRects = 16;
+
+    const Display *display_;
+    CaptureStreamConfig config_;
+    struct ext_output_image_capture_source_manager_v1 *source_manager_{};
+    struct ext_image_copy_capture_manager_v1 *capture_manager_{};
+    struct ext_image_capture_source_v1 *source_{};
+    struct ext_image_copy_capture_session_v1 *session_{};
+    struct ext_image_copy_capture_frame_v1 *frame_{};
+    Buffer *frame_buffer_{};
+
+    CaptureDmabufAllocator dmabuf_allocator_;
+    std::function<void(const Frame &frame)> frame_callback_;
+    std::function<void()> stopped_callback_;
+    bool running_{};
+
+    // buffer constraints, collected until session done
+    struct Constraints {
+        int32_t width;
+        int32_t height;
+        std::vector<uint32_t> shm_formats;
+        DmabufFeedback::Tranche dmabuf;
+    };
+    Constraints pending_{};
+    Constraints current_{};
+    bool constraints_valid_{};
+    // the compositor rejected a dmabuf import, capture to shm until the constraints change
+    bool dmabuf_rejected_{};
+
+    // the ring, pointers stay stable until a buffer is destroyed
+    std::vector<std::unique_ptr<Buffer>> buffers_;
+    // every shm ring, across reallocations, lives in one memfd
+    std::unique_ptr<ShmPool> shm_pool_;
+
+    // frame state, collected until ready
+    std::vector<Rect> frame_damage_;
+    uint32_t frame_transform_{};
+    uint64_t frame_presentation_ns_{};
+
+    void allocate_buffers();
+
+    bool allocate_dmabufs();
+
+    bool allocate_shm();
+
+    void retire_buffers();
+
+    void destroy_buffer(Buffer *buffer);
+
+    [[nodiscard]] Buffer *get_free_buffer() const;
+
+    void capture_next();
+
+    static void add_damage(Buffer &buffer, const Rect &rect);
+
+    void handle_buffer_size(struct ext_image_copy_capture_session_v1 *session, uint32_t width, uint32_t height);
+
+    void handle_shm_format(struct ext_image_copy_capture_session_v1 *session, uint32_t format);
+
+    void handle_dmabuf_device(struct ext_image_copy_capture_session_v1 *session, struct wl_array *device);
+
+    void handle_dmabuf_format(struct ext_image_copy_capture_session_v1 *session, uint32_t format,
+                              struct wl_array *modifiers);
+
+    void handle_session_done(struct ext_image_copy_capture_session_v1 *session);
+
+    void handle_stopped(struct ext_image_copy_capture_session_v1 *session);
+
+    void handle_transform(struct ext_image_copy_capture_frame_v1 *frame, uint32_t transform);
+
+    void handle_damage(struct ext_image_copy_capture_frame_v1 *frame, int32_t x, int32_t y, int32_t width,
+                       int32_t height);
+
+    void handle_presentation_time(struct ext_image_copy_capture_frame_v1 *frame, uint32_t tv_sec_hi,
+                                  uint32_t tv_sec_lo, uint32_t tv_nsec);
+
+    void handle_ready(struct ext_image_copy_capture_frame_v1 *frame);
+
+    void handle_failed(struct ext_image_copy_capture_frame_v1 *frame, uint32_t reason);
+
+    void handle_params_created(struct zwp_linux_buffer_params_v1 *params, struct wl_buffer *buffer);
+
+    void handle_params_failed(struct zwp_linux_buffer_params_v1 *params);
+
+    static const struct ext_image_copy_capture_session_v1_listener session_listener_;
+
+    static const struct ext_image_copy_capture_frame_v1_listener frame_listener_;
+
+    static const struct zwp_linux_buffer_params_v1_listener params_listener_;
+};
+
+#endif // SRC_WINDOW_MANAGER_CAPTURE_STREAM_H_
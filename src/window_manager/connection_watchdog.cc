@@ -0,0 +1,285 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "connection_watchdog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "display.h"
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+namespace {
+uint64_t now_ns() {
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+double to_ms(uint64_t ns) {
+    return static_cast<double>(ns) / 1e6;
+}
+}
+
+/**
+ * @class ConnectionWatchdog
+ * @brief Measures the health of the Wayland connection and reports stalls as they happen.
+ *
+ * A thread of its own sends two wl_display.sync requests back to back every probe
+ * interval. The compositor answers them in order: the first answer is dispatched on a
+ * private queue by the watchdog thread, which gives the round trip time to the
+ * compositor, the second on the default queue by the application's event loop, and
+ * the difference is how long events wait before the application reads them.
+ *
+ * A round trip still outstanding after rtt_threshold_ms is reported as a compositor
+ * stall, the default queue answer still outstanding event_latency_threshold_ms after
+ * the first as an event loop stall. Both are reported while the stall lasts, once per
+ * probe, so a hung compositor or a blocked event loop is noticed without a debugger.
+ * A threshold of 0 disables its check.
+ *
+ * The stall callback runs on the watchdog thread.
+ *
+ * @param display        The Wayland display.
+ * @param config         Probe interval and stall thresholds.
+ * @param stall_callback Called with the kind of stall and how long it has lasted.
+ */
+ConnectionWatchdog::ConnectionWatchdog(struct wl_display *display, const ConnectionWatchdogConfig &config,
+                                       const std::function<void(Stall stall,
+                                                                double duration_ms)> &stall_callback)
+        : wl_display_(display), config_(config), stall_callback_(stall_callback) {
+    wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (wake_fd_ < 0) {
+        throw std::runtime_error(std::string("eventfd: ") + strerror(errno));
+    }
+    wl_event_queue_ = wl_display_create_queue(wl_display_);
+    wl_display_wrapper_ = static_cast<struct wl_display *>(wl_proxy_create_wrapper(wl_display_));
+    wl_proxy_set_queue(reinterpret_cast<struct wl_proxy *>(wl_display_wrapper_), wl_event_queue_);
+
+    next_probe_ns_ = now_ns();
+    running_ = true;
+    thread_ = std::thread([this]() { run(); });
+}
+
+/**
+ * @brief Stops the watchdog thread.
+ *
+ * Destroy the watchdog on the thread that dispatches the default queue, or while no
+ * thread does, since the probe answered on that queue may still be outstanding.
+ */
+ConnectionWatchdog::~ConnectionWatchdog() {
+    running_ = false;
+    const uint64_t value = 1;
+    if (write(wake_fd_, &value, sizeof(value)) < 0) {
+        LOG_WARN("ConnectionWatchdog: %s", strerror(errno));
+    }
+    thread_.join();
+
+    if (rtt_callback_) {
+        wl_callback_destroy(rtt_callback_);
+    }
+    if (loop_callback_) {
+        wl_callback_destroy(loop_callback_);
+    }
+    wl_proxy_wrapper_destroy(wl_display_wrapper_);
+    wl_event_queue_destroy(wl_event_queue_);
+    close(wake_fd_);
+}
+
+/**
+ * @brief Records an xdg_wm_base.ping from the compositor.
+ *
+ * Compositors ping to find out whether a client is responsive; the gaps between
+ * pings show how often, and how early, a compositor is about to consider us hung.
+ */
+void ConnectionWatchdog::record_ping() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    const uint64_t now = now_ns();
+    if (last_ping_ns_) {
+        stats_.last_ping_gap_ms = to_ms(now - last_ping_ns_);
+        stats_.max_ping_gap_ms = std::max(stats_.max_ping_gap_ms, stats_.last_ping_gap_ms);
+    }
+    last_ping_ns_ = now;
+    stats_.pings++;
+}
+
+/**
+ * @return The round trip, event latency and ping statistics.
+ */
+ConnectionWatchdog::Stats ConnectionWatchdog::get_stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+/**
+ * @brief The watchdog thread: sends probes, dispatches the private queue and checks for stalls.
+ */
+void ConnectionWatchdog::run() {
+    const uint32_t tick_ms = std::max(1u, std::min({config_.probe_interval_ms,
+                                                    config_.rtt_threshold_ms ? config_.rtt_threshold_ms : ~0u,
+                                                    config_.event_latency_threshold_ms
+                                                    ? config_.event_latency_threshold_ms : ~0u}) / 4);
+    while (running_) {
+        int timeout;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            uint64_t now = now_ns();
+            check_probe(now, lock);
+            now = now_ns();
+            if (!probe_sent_ns_ && now >= next_probe_ns_) {
+                send_probe(now);
+            }
+            timeout = probe_sent_ns_ ? static_cast<int>(tick_ms)
+                                     : static_cast<int>((next_probe_ns_ - now + 999999) / 1000000);
+        }
+        if (Display::poll_dispatch(wl_display_, wl_event_queue_, timeout, wake_fd_, &drain_wake, this) < 0) {
+            LOG_ERROR("ConnectionWatchdog: %s", strerror(errno));
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Sends the two round trip requests of a probe.
+ *
+ * The first is created on the private queue, the second on the default queue
+ * directly: moving a callback between queues after creation races the reader of
+ * the event thread, which may already have queued its done event.
+ */
+void ConnectionWatchdog::send_probe(uint64_t now_ns) {
+    rtt_callback_ = wl_display_sync(wl_display_wrapper_);
+    wl_callback_add_listener(rtt_callback_, &rtt_listener_, this);
+    loop_callback_ = wl_display_sync(wl_display_);
+    wl_callback_add_listener(loop_callback_, &loop_listener_, this);
+
+    probe_sent_ns_ = now_ns;
+    rtt_done_ns_ = 0;
+    loop_done_ns_ = 0;
+    rtt_reported_ = false;
+    loop_reported_ = false;
+    stats_.probes++;
+}
+
+/**
+ * @brief Reports stalls of the probe in flight, and records it once both answers are in.
+ */
+void ConnectionWatchdog::check_probe(uint64_t now_ns, std::unique_lock<std::mutex> &lock) {
+    if (!probe_sent_ns_) {
+        return;
+    }
+    const uint64_t rtt_threshold_ns = config_.rtt_threshold_ms * 1000000ULL;
+    const uint64_t latency_threshold_ns = config_.event_latency_threshold_ms * 1000000ULL;
+
+    if (!rtt_done_ns_) {
+        if (rtt_threshold_ns && !rtt_reported_ && now_ns - probe_sent_ns_ > rtt_threshold_ns) {
+            rtt_reported_ = true;
+            report(lock, COMPOSITOR_STALL, now_ns - probe_sent_ns_);
+        }
+        return;
+    }
+
+    const uint64_t rtt = rtt_done_ns_ - probe_sent_ns_;
+    if (rtt_threshold_ns && !rtt_reported_ && rtt > rtt_threshold_ns) {
+        rtt_reported_ = true;
+        report(lock, COMPOSITOR_STALL, rtt);
+    }
+
+    if (!loop_done_ns_) {
+        if (latency_threshold_ns && !loop_reported_ && now_ns - rtt_done_ns_ > latency_threshold_ns) {
+            loop_reported_ = true;
+            report(lock, EVENT_LOOP_STALL, now_ns - rtt_done_ns_);
+        }
+        return;
+    }
+
+    // the event loop may dispatch its answer before the watchdog thread gets to the first
+    const uint64_t latency = loop_done_ns_ > rtt_done_ns_ ? loop_done_ns_ - rtt_done_ns_ : 0;
+    if (latency_threshold_ns && !loop_reported_ && latency > latency_threshold_ns) {
+        loop_reported_ = true;
+        report(lock, EVENT_LOOP_STALL, latency);
+    }
+
+    stats_.rtt_ms = to_ms(rtt);
+    stats_.max_rtt_ms = std::max(stats_.max_rtt_ms, stats_.rtt_ms);
+    stats_.event_latency_ms = to_ms(latency);
+    stats_.max_event_latency_ms = std::max(stats_.max_event_latency_ms, stats_.event_latency_ms);
+    next_probe_ns_ = probe_sent_ns_ + config_.probe_interval_ms * 1000000ULL;
+    probe_sent_ns_ = 0;
+}
+
+/**
+ * @brief Counts a stall and calls the stall callback without holding the lock.
+ */
+void ConnectionWatchdog::report(std::unique_lock<std::mutex> &lock, Stall stall, uint64_t duration_ns) {
+    if (stall == COMPOSITOR_STALL) {
+        stats_.compositor_stalls++;
+    } else {
+        stats_.event_loop_stalls++;
+    }
+    LOG_WARN("ConnectionWatchdog: %s stalled for %.1f ms",
+             stall == COMPOSITOR_STALL ? "compositor" : "event loop", to_ms(duration_ns));
+    if (stall_callback_) {
+        lock.unlock();
+        stall_callback_(stall, to_ms(duration_ns));
+        lock.lock();
+    }
+}
+
+/**
+ * @brief Clears the wake eventfd.
+ */
+void ConnectionWatchdog::drain_wake(void *data) {
+    auto *self = static_cast<ConnectionWatchdog *>(data);
+    uint64_t value;
+    if (read(self->wake_fd_, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        LOG_WARN("ConnectionWatchdog: %s", strerror(errno));
+    }
+}
+
+/**
+ * @brief Handles the answer on the private queue, completing the round trip.
+ */
+void ConnectionWatchdog::handle_rtt_done(struct wl_callback *callback, uint32_t /* time */) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    rtt_done_ns_ = now_ns();
+    wl_callback_destroy(callback);
+    rtt_callback_ = nullptr;
+}
+
+const struct wl_callback_listener ConnectionWatchdog::rtt_listener_ = {
+        .done = listener_thunk<&ConnectionWatchdog::handle_rtt_done>,
+};
+
+/**
+ * @brief Handles the answer on the default queue, dispatched by the application's event loop.
+ */
+void ConnectionWatchdog::handle_loop_done(struct wl_callback *callback, uint32_t /* time */) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    loop_done_ns_ = now_ns();
+    wl_callback_destroy(callback);
+    loop_callback_ = nullptr;
+}
+
+const struct wl_callback_listener ConnectionWatchdog::loop_listener_ = {
+        .done = listener_thunk<&ConnectionWatchdog::handle_loop_done>,
+};
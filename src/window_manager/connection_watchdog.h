@@ -0,0 +1,118 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_CONNECTION_WATCHDOG_H_
+#define SRC_WINDOW_MANAGER_CONNECTION_WATCHDOG_H_
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include <wayland-client.h>
+
+#include "utils/export.h"
+
+struct ConnectionWatchdogConfig {
+    // how often a round trip is measured
+    uint32_t probe_interval_ms{1000};
+    // a round trip taking longer is reported as a compositor stall
+    uint32_t rtt_threshold_ms{250};
+    // events waiting longer on the default queue are reported as an event loop stall
+    uint32_t event_latency_threshold_ms{100};
+};
+
+class WAYPP_EXPORT ConnectionWatchdog {
+public:
+    typedef enum {
+        COMPOSITOR_STALL,
+        EVENT_LOOP_STALL,
+    } Stall;
+
+    struct Stats {
+        uint64_t probes;
+        double rtt_ms;
+        double max_rtt_ms;
+        double event_latency_ms;
+        double max_event_latency_ms;
+        uint64_t compositor_stalls;
+        uint64_t event_loop_stalls;
+        uint64_t pings;
+        double last_ping_gap_ms;
+        double max_ping_gap_ms;
+    };
+
+    ConnectionWatchdog(struct wl_display *display, const ConnectionWatchdogConfig &config,
+                       const std::function<void(Stall stall, double duration_ms)> &stall_callback);
+
+    ~ConnectionWatchdog();
+
+    ConnectionWatchdog(const ConnectionWatchdog &) = delete;
+
+    ConnectionWatchdog &operator=(const ConnectionWatchdog &) = delete;
+
+    void record_ping();
+
+    [[nodiscard]] Stats get_stats() const;
+
+private:
+    struct wl_display *wl_display_;
+    struct wl_event_queue *wl_event_queue_{};
+    // creates the probe callbacks on wl_event_queue_
+    struct wl_display *wl_display_wrapper_{};
+    ConnectionWatchdogConfig config_;
+    std::function<void(Stall stall, double duration_ms)> stall_callback_;
+
+    std::thread thread_;
+    std::atomic<bool> running_{};
+    int wake_fd_{-1};
+
+    mutable std::mutex mutex_;
+    Stats stats_{};
+
+    // the probe in flight, answered once on the private queue and once on the default queue
+    struct wl_callback *rtt_callback_{};
+    struct wl_callback *loop_callback_{};
+    uint64_t probe_sent_ns_{};
+    uint64_t rtt_done_ns_{};
+    uint64_t loop_done_ns_{};
+    bool rtt_reported_{};
+    bool loop_reported_{};
+    uint64_t next_probe_ns_{};
+    uint64_t last_ping_ns_{};
+
+    void run();
+
+    void send_probe(uint64_t now_ns);
+
+    void check_probe(uint64_t now_ns, std::unique_lock<std::mutex> &lock);
+
+    void report(std::unique_lock<std::mutex> &lock, Stall stall, uint64_t duration_ns);
+
+    static void drain_wake(void *data);
+
+    void handle_rtt_done(struct wl_callback *callback, uint32_t time);
+
+    static const struct wl_callback_listener rtt_listener_;
+
+    void handle_loop_done(struct wl_callback *callback, uint32_t time);
+
+    static const struct wl_callback_listener loop_listener_;
+};
+
+#endif // SRC_WINDOW_MANAGER_CONNECTION_WATCHDOG_H_
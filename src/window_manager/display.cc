@@ -17,26 +17,79 @@
 #include "display.h"
 #include "output.h"
 
-#include <iostream>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <cerrno>
+#include <stdexcept>
 
+#include <poll.h>
+
+#include "utils/logging.h"
+#include "utils/startup_profiler.h"
+#include "utils/trace.h"
+
+namespace {
+/**
+ * @brief FNV-1a hash of an interface name.
+ *
+ * constexpr so the registry can switch on interface names; a matching hash is
+ * always confirmed with strcmp before binding.
+ */
+constexpr uint32_t interface_hash(const char *str) {
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash = (hash ^ static_cast<uint8_t>(*str++)) * 16777619u;
+    }
+    return hash;
+}
+
+// wl_surface v6 adds preferred_buffer_scale; binding above what libwayland was built
+// with would make it reject the new events
+#if defined(WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION)
+constexpr uint32_t kCompositorMaxVersion = WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION;
+#else
+constexpr uint32_t kCompositorMaxVersion = WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION;
+#endif
+}
+
+
+namespace {
+struct wl_display *connect(const char *name) {
+    StartupScope scope(StartupProfiler::CONNECT);
+    return wl_display_connect(name);
+}
+}
 
 /**
  * @class Display
  * Represents a Wayland display connection.
  */
-Display::Display(GMainContext *context, bool enable_cursor, const char *name) :
-        wl_display_(wl_display_connect(name)),
+Display::Display(GMainContext *context, bool enable_cursor, const char *name, uint32_t input_devices,
+                 BindPolicy bind_policy) :
+        wl_display_(connect(name)),
         context_(context),
-        enable_cursor_(enable_cursor) {
+        enable_cursor_(enable_cursor),
+        input_devices_(input_devices),
+        bind_policy_(bind_policy),
+        outputs_requested_(bind_policy == BIND_EAGER),
+        seats_requested_(bind_policy == BIND_EAGER) {
     if (wl_display_ == nullptr) {
-        std::cerr << "Failed to connect to Wayland display. " << strerror(errno) << std::endl;
-        exit(EXIT_FAILURE);
+        // no compositor yet, or one being restarted; the caller decides whether to retry
+        throw std::runtime_error(std::string("Failed to connect to Wayland display: ") + strerror(errno));
+    }
+    {
+        StartupScope scope(StartupProfiler::REGISTRY_ROUNDTRIP);
+        wl_registry_ = wl_display_get_registry(wl_display_);
+        wl_registry_add_listener(wl_registry_, &listener_, this);
+        wl_display_roundtrip(wl_display_);
+        // the initial events of the globals bound above, e.g. the dmabuf formats
+        wl_display_roundtrip(wl_display_);
+    }
+
+    if (context_) {
+        attach_wayland_source();
     }
-    wl_registry_ = wl_display_get_registry(wl_display_);
-    wl_registry_add_listener(wl_registry_, &listener_, this);
-    wl_display_roundtrip(wl_display_);
 }
 
 /**
@@ -50,6 +103,11 @@ Display::Display(GMainContext *context, bool enable_cursor, const char *name) :
  * @see Display(), wl_registry_destroy(), wl_shm_destroy(), wl_subcompositor_destroy(), wl_compositor_destroy()
  */
 Display::~Display() {
+    if (wayland_source_) {
+        g_source_destroy(wayland_source_);
+        g_source_unref(wayland_source_);
+    }
+
     if (wl_registry_) {
         wl_registry_destroy(wl_registry_);
     }
@@ -58,6 +116,124 @@ Display::~Display() {
         wl_shm_destroy(wl_shm_);
     }
 
+    if (wp_presentation_) {
+        wp_presentation_destroy(wp_presentation_);
+    }
+
+#if defined(ENABLE_CONTENT_TYPE)
+    if (wp_content_type_manager_) {
+        wp_content_type_manager_v1_destroy(wp_content_type_manager_);
+    }
+#endif
+
+    if (zwp_input_timestamps_manager_) {
+        zwp_input_timestamps_manager_v1_destroy(zwp_input_timestamps_manager_);
+    }
+
+    if (zwp_relative_pointer_manager_) {
+        zwp_relative_pointer_manager_v1_destroy(zwp_relative_pointer_manager_);
+    }
+
+    if (zwp_pointer_constraints_) {
+        zwp_pointer_constraints_v1_destroy(zwp_pointer_constraints_);
+    }
+
+    if (wp_cursor_shape_manager_) {
+        wp_cursor_shape_manager_v1_destroy(wp_cursor_shape_manager_);
+    }
+
+    if (zwp_text_input_manager_) {
+        zwp_text_input_manager_v3_destroy(zwp_text_input_manager_);
+    }
+
+    if (wl_data_device_manager_) {
+        wl_data_device_manager_destroy(wl_data_device_manager_);
+    }
+
+    if (zwp_primary_selection_manager_) {
+        zwp_primary_selection_device_manager_v1_destroy(zwp_primary_selection_manager_);
+    }
+
+    if (zwp_tablet_manager_) {
+        zwp_tablet_manager_v2_destroy(zwp_tablet_manager_);
+    }
+
+#if defined(ENABLE_IDLE_NOTIFY)
+    if (ext_idle_notifier_) {
+        ext_idle_notifier_v1_destroy(ext_idle_notifier_);
+    }
+#endif
+
+    // the outputs' zwlr_output_power_v1 and zxdg_output_v1 go with the map, after these
+#if defined(ENABLE_OUTPUT_POWER)
+    if (zwlr_output_power_manager_) {
+        zwlr_output_power_manager_v1_destroy(zwlr_output_power_manager_);
+    }
+#endif
+
+    if (zxdg_output_manager_) {
+        zxdg_output_manager_v1_destroy(zxdg_output_manager_);
+    }
+
+    if (zwp_pointer_gestures_) {
+        if (pointer_gestures_version_ >= ZWP_POINTER_GESTURES_V1_RELEASE_SINCE_VERSION) {
+            zwp_pointer_gestures_v1_release(zwp_pointer_gestures_);
+        } else {
+            zwp_pointer_gestures_v1_destroy(zwp_pointer_gestures_);
+        }
+    }
+
+#if defined(ENABLE_TEARING_CONTROL)
+    if (wp_tearing_control_manager_) {
+        wp_tearing_control_manager_v1_destroy(wp_tearing_control_manager_);
+    }
+#endif
+
+    if (wp_drm_syncobj_manager_) {
+        wp_linux_drm_syncobj_manager_v1_destroy(wp_drm_syncobj_manager_);
+    }
+
+    if (wp_fractional_scale_manager_) {
+        wp_fractional_scale_manager_v1_destroy(wp_fractional_scale_manager_);
+    }
+
+    if (wp_viewporter_) {
+        wp_viewporter_destroy(wp_viewporter_);
+    }
+
+#if defined(ENABLE_SINGLE_PIXEL_BUFFER)
+    if (wp_single_pixel_buffer_manager_) {
+        wp_single_pixel_buffer_manager_v1_destroy(wp_single_pixel_buffer_manager_);
+    }
+#endif
+
+#if defined(ENABLE_ALPHA_MODIFIER)
+    if (wp_alpha_modifier_) {
+        wp_alpha_modifier_v1_destroy(wp_alpha_modifier_);
+    }
+#endif
+
+#if defined(ENABLE_COLOR_MANAGEMENT)
+    color_manager_.reset();
+#endif
+
+#if defined(ENABLE_FIFO)
+    if (wp_fifo_manager_) {
+        wp_fifo_manager_v1_destroy(wp_fifo_manager_);
+    }
+#endif
+
+#if defined(ENABLE_COMMIT_TIMING)
+    if (wp_commit_timing_manager_) {
+        wp_commit_timing_manager_v1_destroy(wp_commit_timing_manager_);
+    }
+#endif
+
+    dmabuf_feedback_.reset();
+    if (zwp_linux_dmabuf_) {
+        zwp_linux_dmabuf_v1_destroy(zwp_linux_dmabuf_);
+    }
+
     if (wl_subcompositor_) {
         wl_subcompositor_destroy(wl_subcompositor_);
     }
@@ -65,6 +241,12 @@ Display::~Display() {
     if (wl_compositor_) {
         wl_compositor_destroy(wl_compositor_);
     }
+
+    // everything holding a proxy goes before the connection, seats before the cursor themes they use
+    wl_seats_.clear();
+    wl_outputs_.clear();
+    cursor_theme_cache_.clear();
+    wl_display_disconnect(wl_display_);
 }
 
 /**
@@ -87,6 +269,189 @@ const struct wl_shm_listener Display::shm_listener_ = {
         .format = shm_format
 };
 
+/**
+ * @brief Records the clock domain of presentation timestamps.
+ *
+ * @param data            A pointer to the Display object.
+ * @param wp_presentation The presentation object.
+ * @param clk_id          The clockid_t used for presentation feedback timestamps.
+ */
+void Display::presentation_clock_id(void *data,
+                                    struct wp_presentation * /* wp_presentation */,
+                                    uint32_t clk_id) {
+    const auto obj = static_cast<Display *>(data);
+    obj->presentation_clock_id_ = static_cast<clockid_t>(clk_id);
+}
+
+const struct wp_presentation_listener Display::presentation_listener_ = {
+        .clock_id = presentation_clock_id
+};
+
+/**
+ * @brief Calls callback once the compositor has processed every request sent before this one.
+ *
+ * Unlike wl_display_roundtrip() nothing blocks; the callback runs on whichever thread
+ * dispatches the default queue, after the events those requests caused. For several
+ * callbacks, or one added later, use fence().
+ */
+void Display::sync(const std::function<void()> &callback) const {
+    // nobody holds the fence, it frees itself once done
+    auto fence = new Fence(wl_display_);
+    fence->on_done([fence, callback]() {
+        // the waiters were taken out of the fence before they run, so it can go
+        delete fence;
+        if (callback) {
+            callback();
+        }
+    });
+}
+
+/**
+ * @brief Returns the error the connection failed with, 0 while it is usable.
+ *
+ * EPIPE or ECONNRESET once the compositor went away, EPROTO after a protocol error,
+ * see wl_display_get_error(). Every request and dispatch fails from then on.
+ */
+int Display::get_connection_error() const {
+    return wl_display_get_error(wl_display_);
+}
+
+/**
+ * @brief Sets a callback for the connection failing while it is dispatched.
+ *
+ * Called once, from the GLib source, which is removed afterwards, or from
+ * WindowManager::dispatch() and poll_events(), which also return the negative error.
+ * The Display must not be destroyed from within the callback; defer that to an idle
+ * source or the caller of the dispatch.
+ *
+ * @param callback Receives get_connection_error().
+ */
+void Display::set_disconnect_callback(const std::function<void(int error)> &callback) {
+    disconnect_callback_ = callback;
+}
+
+void Display::report_disconnect() {
+    if (disconnect_reported_) {
+        return;
+    }
+    disconnect_reported_ = true;
+    if (disconnect_callback_) {
+        disconnect_callback_(get_connection_error());
+    }
+}
+
+/**
+ * @brief Selects the input devices of every seat, see Seat::set_input_devices().
+ *
+ * @param input_devices A mask of InputDevices.
+ */
+void Display::set_input_devices(uint32_t input_devices) {
+    input_devices_ = input_devices;
+    for (const auto &[wl_seat, seat]: wl_seats_) {
+        seat->set_input_devices(input_devices);
+    }
+}
+
+/**
+ * @brief Sets a callback invoked with the CLOCK_MONOTONIC time of every input event, on all seats.
+ *
+ * Times are nanosecond precise when the compositor has zwp_input_timestamps_manager_v1.
+ *
+ * @param callback The function to invoke, on the thread dispatching the default queue.
+ */
+void Display::set_input_callback(const std::function<void(uint64_t time_ns)> &callback) {
+    input_callback_ = callback;
+    for (const auto &[wl_seat, seat]: wl_seats_) {
+        seat->set_input_callback(callback);
+    }
+}
+
+/**
+ * @brief Sets a callback invoked with every pointer button on all seats, see Seat::set_pointer_button_callback().
+ */
+void Display::set_pointer_button_callback(
+        const std::function<void(Seat &seat, const PointerButton &button)> &callback) {
+    pointer_button_callback_ = callback;
+    for (const auto &[wl_seat, seat]: wl_seats_) {
+        seat->set_pointer_button_callback(callback);
+    }
+}
+
+/**
+ * @brief Sets a callback invoked as a keyboard of any seat enters or leaves a surface.
+ */
+void Display::set_keyboard_focus_callback(
+        const std::function<void(struct wl_surface *surface, bool focused)> &callback) {
+    keyboard_focus_callback_ = callback;
+    for (const auto &[wl_seat, seat]: wl_seats_) {
+        seat->set_keyboard_focus_callback(callback);
+    }
+}
+
+/**
+ * @brief Sets a callback invoked as any seat goes idle and resumes, see Seat::set_idle_callback().
+ *
+ * Needs the compositor's ext_idle_notifier_v1; without it the callback is never invoked.
+ */
+void Display::set_idle_callback(uint32_t timeout_ms, const std::function<void(Seat &seat, bool idle)> &callback,
+                                bool respect_inhibitors) {
+    idle_timeout_ms_ = timeout_ms;
+    idle_callback_ = callback;
+    idle_respect_inhibitors_ = respect_inhibitors;
+    for (const auto &[wl_seat, seat]: wl_seats_) {
+        seat->set_idle_callback(timeout_ms, callback, respect_inhibitors);
+    }
+}
+
+/**
+ * @brief Checks whether dmabufs of format with modifier can be imported.
+ *
+ * @param format   The DRM fourcc format.
+ * @param modifier The DRM format modifier, kDrmFormatModInvalid for an implicit modifier.
+ * @return true if the compositor advertised the pair.
+ */
+bool Display::supports_dmabuf_format(uint32_t format, uint64_t modifier) const {
+    const auto it = dmabuf_formats_.find(format);
+    return it != dmabuf_formats_.end() &&
+           std::find(it->second.begin(), it->second.end(), modifier) != it->second.end();
+}
+
+void Display::add_dmabuf_format(uint32_t format, uint64_t modifier) {
+    auto &modifiers = dmabuf_formats_[format];
+    if (std::find(modifiers.begin(), modifiers.end(), modifier) == modifiers.end()) {
+        modifiers.push_back(modifier);
+    }
+}
+
+/**
+ * @brief Records a dmabuf format without modifiers, sent by version 1 and 2 globals.
+ */
+void Display::linux_dmabuf_format(void *data,
+                                  struct zwp_linux_dmabuf_v1 * /* zwp_linux_dmabuf */,
+                                  uint32_t format) {
+    const auto obj = static_cast<Display *>(data);
+    if (obj->linux_dmabuf_version_ < ZWP_LINUX_DMABUF_V1_MODIFIER_SINCE_VERSION) {
+        obj->add_dmabuf_format(format, kDrmFormatModInvalid);
+    }
+}
+
+/**
+ * @brief Records a dmabuf format and modifier pair, sent by version 3 globals.
+ */
+void Display::linux_dmabuf_modifier(void *data,
+                                    struct zwp_linux_dmabuf_v1 * /* zwp_linux_dmabuf */,
+                                    uint32_t format,
+                                    uint32_t modifier_hi,
+                                    uint32_t modifier_lo) {
+    const auto obj = static_cast<Display *>(data);
+    obj->add_dmabuf_format(format, (static_cast<uint64_t>(modifier_hi) << 32) | modifier_lo);
+}
+
+const struct zwp_linux_dmabuf_v1_listener Display::linux_dmabuf_listener_ = {
+        .format = linux_dmabuf_format,
+        .modifier = linux_dmabuf_modifier,
+};
+
 /**
  * @brief Handles the global objects registered with the Wayland display.
  *
@@ -104,39 +469,331 @@ void Display::registry_handle_global(void *data,
                                      uint32_t name,
                                      const char *interface,
                                      uint32_t version) {
+    TRACE_SCOPE("Display::registry_handle_global");
     const auto obj = static_cast<Display *>(data);
 
-    if (strcmp(interface, wl_compositor_interface.name) == 0) {
-        obj->compositor_version_ = version;
-        obj->wl_compositor_ = static_cast<struct wl_compositor *>(
-                wl_registry_bind(registry, name, &wl_compositor_interface,
-                                 std::min(static_cast<uint32_t>(1), version)));
-        obj->buffer_scaling_enabled_ = (obj->compositor_version_ >= 3);
-
-    } else if (strcmp(interface, wl_subcompositor_interface.name) == 0) {
-        obj->subcompositor_version_ = version;
-        obj->wl_subcompositor_ = static_cast<struct wl_subcompositor *>(
-                wl_registry_bind(registry, name, &wl_subcompositor_interface,
-                                 std::min(static_cast<uint32_t>(1), version)));
-
-    } else if (strcmp(interface, wl_shm_interface.name) == 0) {
-        obj->wl_shm_ = static_cast<struct wl_shm *>(
-                wl_registry_bind(registry, name, &wl_shm_interface,
-                                 std::min(static_cast<uint32_t>(1), version)));
-        wl_shm_add_listener(obj->wl_shm_, &shm_listener_, obj);
-
-    } else if (strcmp(interface, wl_output_interface.name) == 0) {
-        auto output = static_cast<struct wl_output *>(
-                wl_registry_bind(registry, name, &wl_output_interface,
-                                 std::min(static_cast<uint32_t>(2), version)));
-        obj->wl_outputs_[output] = std::make_unique<Output>(output, version);
-
-    } else if (strcmp(interface, wl_seat_interface.name) == 0) {
-        auto seat = static_cast<wl_seat *>(
-                wl_registry_bind(registry, name, &wl_seat_interface,
-                                 std::min(static_cast<uint32_t>(5), version)));
-        obj->wl_seats_[seat] = std::make_unique<Seat>(seat, obj->wl_shm_, obj->wl_compositor_, obj->enable_cursor_,
-                                                      version);
+    obj->globals_[name] = {interface, version};
+
+    const auto hash = interface_hash(interface);
+    switch (hash) {
+        case interface_hash("wl_compositor"):
+            if (strcmp(interface, wl_compositor_interface.name) != 0)
+                break;
+            obj->compositor_version_ = std::min(kCompositorMaxVersion, version);
+            obj->wl_compositor_ = static_cast<struct wl_compositor *>(
+                    wl_registry_bind(registry, name, &wl_compositor_interface, obj->compositor_version_));
+            obj->buffer_scaling_enabled_ =
+                    (obj->compositor_version_ >= WL_SURFACE_SET_BUFFER_SCALE_SINCE_VERSION);
+            break;
+
+        case interface_hash("wl_subcompositor"):
+            if (strcmp(interface, wl_subcompositor_interface.name) != 0)
+                break;
+            obj->subcompositor_version_ = version;
+            obj->wl_subcompositor_ = static_cast<struct wl_subcompositor *>(
+                    wl_registry_bind(registry, name, &wl_subcompositor_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            break;
+
+        case interface_hash("wl_shm"):
+            if (strcmp(interface, wl_shm_interface.name) != 0)
+                break;
+            obj->wl_shm_ = static_cast<struct wl_shm *>(
+                    wl_registry_bind(registry, name, &wl_shm_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            wl_shm_add_listener(obj->wl_shm_, &shm_listener_, obj);
+            break;
+
+        case interface_hash("wl_output"):
+            if (strcmp(interface, wl_output_interface.name) != 0)
+                break;
+            if (obj->bind_policy_ == BIND_ON_FIRST_USE && !obj->outputs_requested_) {
+                obj->pending_outputs_[name] = version;
+                break;
+            }
+            (void) obj->bind_output(registry, name, version);
+            break;
+
+        case interface_hash("wl_seat"):
+            if (strcmp(interface, wl_seat_interface.name) != 0)
+                break;
+            if (obj->bind_policy_ == BIND_ON_FIRST_USE && !obj->seats_requested_) {
+                obj->pending_seats_[name] = version;
+                break;
+            }
+            obj->bind_seat(registry, name, version);
+            break;
+
+        case interface_hash("wp_presentation"):
+            if (strcmp(interface, wp_presentation_interface.name) != 0)
+                break;
+            obj->wp_presentation_ = static_cast<struct wp_presentation *>(
+                    wl_registry_bind(registry, name, &wp_presentation_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            wp_presentation_add_listener(obj->wp_presentation_, &presentation_listener_, obj);
+            break;
+
+        case interface_hash("wp_viewporter"):
+            if (strcmp(interface, wp_viewporter_interface.name) != 0)
+                break;
+            obj->wp_viewporter_ = static_cast<struct wp_viewporter *>(
+                    wl_registry_bind(registry, name, &wp_viewporter_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            break;
+
+#if defined(ENABLE_SINGLE_PIXEL_BUFFER)
+        case interface_hash("wp_single_pixel_buffer_manager_v1"):
+            if (strcmp(interface, wp_single_pixel_buffer_manager_v1_interface.name) != 0)
+                break;
+            obj->wp_single_pixel_buffer_manager_ = static_cast<struct wp_single_pixel_buffer_manager_v1 *>(
+                    wl_registry_bind(registry, name, &wp_single_pixel_buffer_manager_v1_interface, 1));
+            break;
+#endif
+
+#if defined(ENABLE_ALPHA_MODIFIER)
+        case interface_hash("wp_alpha_modifier_v1"):
+            if (strcmp(interface, wp_alpha_modifier_v1_interface.name) != 0)
+                break;
+            obj->wp_alpha_modifier_ = static_cast<struct wp_alpha_modifier_v1 *>(
+                    wl_registry_bind(registry, name, &wp_alpha_modifier_v1_interface, 1));
+            break;
+#endif
+
+#if defined(ENABLE_COLOR_MANAGEMENT)
+        case interface_hash("wp_color_manager_v1"):
+            if (strcmp(interface, wp_color_manager_v1_interface.name) != 0)
+                break;
+            // the supported_* events follow, dispatched by the constructor's second roundtrip
+            obj->color_manager_ = std::make_unique<ColorManager>(static_cast<struct wp_color_manager_v1 *>(
+                    wl_registry_bind(registry, name, &wp_color_manager_v1_interface, 1)));
+            break;
+#endif
+
+#if defined(ENABLE_FIFO)
+        case interface_hash("wp_fifo_manager_v1"):
+            if (strcmp(interface, wp_fifo_manager_v1_interface.name) != 0)
+                break;
+            obj->wp_fifo_manager_ = static_cast<struct wp_fifo_manager_v1 *>(
+                    wl_registry_bind(registry, name, &wp_fifo_manager_v1_interface, 1));
+            break;
+#endif
+
+#if defined(ENABLE_COMMIT_TIMING)
+        case interface_hash("wp_commit_timing_manager_v1"):
+            if (strcmp(interface, wp_commit_timing_manager_v1_interface.name) != 0)
+                break;
+            obj->wp_commit_timing_manager_ = static_cast<struct wp_commit_timing_manager_v1 *>(
+                    wl_registry_bind(registry, name, &wp_commit_timing_manager_v1_interface, 1));
+            break;
+#endif
+
+        case interface_hash("wp_fractional_scale_manager_v1"):
+            if (strcmp(interface, wp_fractional_scale_manager_v1_interface.name) != 0)
+                break;
+            obj->wp_fractional_scale_manager_ = static_cast<struct wp_fractional_scale_manager_v1 *>(
+                    wl_registry_bind(registry, name, &wp_fractional_scale_manager_v1_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            break;
+
+        case interface_hash("wp_linux_drm_syncobj_manager_v1"):
+            if (strcmp(interface, wp_linux_drm_syncobj_manager_v1_interface.name) != 0)
+                break;
+            obj->wp_drm_syncobj_manager_ = static_cast<struct wp_linux_drm_syncobj_manager_v1 *>(
+                    wl_registry_bind(registry, name, &wp_linux_drm_syncobj_manager_v1_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            break;
+
+#if defined(ENABLE_TEARING_CONTROL)
+        case interface_hash("wp_tearing_control_manager_v1"):
+            if (strcmp(interface, wp_tearing_control_manager_v1_interface.name) != 0)
+                break;
+            obj->wp_tearing_control_manager_ = static_cast<struct wp_tearing_control_manager_v1 *>(
+                    wl_registry_bind(registry, name, &wp_tearing_control_manager_v1_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            break;
+#endif
+
+#if defined(ENABLE_CONTENT_TYPE)
+        case interface_hash("wp_content_type_manager_v1"):
+            if (strcmp(interface, wp_content_type_manager_v1_interface.name) != 0)
+                break;
+            obj->wp_content_type_manager_ = static_cast<struct wp_content_type_manager_v1 *>(
+                    wl_registry_bind(registry, name, &wp_content_type_manager_v1_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            break;
+#endif
+
+        case interface_hash("zwp_input_timestamps_manager_v1"):
+            if (strcmp(interface, zwp_input_timestamps_manager_v1_interface.name) != 0)
+                break;
+            obj->zwp_input_timestamps_manager_ = static_cast<struct zwp_input_timestamps_manager_v1 *>(
+                    wl_registry_bind(registry, name, &zwp_input_timestamps_manager_v1_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            for (const auto &[wl_seat, seat]: obj->wl_seats_) {
+                seat->set_input_timestamps_manager(obj->zwp_input_timestamps_manager_);
+            }
+            break;
+
+        case interface_hash("zwp_relative_pointer_manager_v1"):
+            if (strcmp(interface, zwp_relative_pointer_manager_v1_interface.name) != 0)
+                break;
+            obj->zwp_relative_pointer_manager_ = static_cast<struct zwp_relative_pointer_manager_v1 *>(
+                    wl_registry_bind(registry, name, &zwp_relative_pointer_manager_v1_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            for (const auto &[wl_seat, seat]: obj->wl_seats_) {
+                seat->set_relative_pointer_manager(obj->zwp_relative_pointer_manager_);
+            }
+            break;
+
+        case interface_hash("zwp_pointer_constraints_v1"):
+            if (strcmp(interface, zwp_pointer_constraints_v1_interface.name) != 0)
+                break;
+            obj->zwp_pointer_constraints_ = static_cast<struct zwp_pointer_constraints_v1 *>(
+                    wl_registry_bind(registry, name, &zwp_pointer_constraints_v1_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            for (const auto &[wl_seat, seat]: obj->wl_seats_) {
+                seat->set_pointer_constraints(obj->zwp_pointer_constraints_);
+            }
+            break;
+
+        case interface_hash("wp_cursor_shape_manager_v1"):
+            if (strcmp(interface, wp_cursor_shape_manager_v1_interface.name) != 0)
+                break;
+            obj->wp_cursor_shape_manager_ = static_cast<struct wp_cursor_shape_manager_v1 *>(
+                    wl_registry_bind(registry, name, &wp_cursor_shape_manager_v1_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            for (const auto &[wl_seat, seat]: obj->wl_seats_) {
+                seat->set_cursor_shape_manager(obj->wp_cursor_shape_manager_);
+            }
+            break;
+
+#if defined(ENABLE_IDLE_NOTIFY)
+        case interface_hash("ext_idle_notifier_v1"):
+            if (strcmp(interface, ext_idle_notifier_v1_interface.name) != 0)
+                break;
+            // version 2 adds idle notifications that ignore idle inhibitors
+            obj->idle_notifier_version_ = std::min(static_cast<uint32_t>(2), version);
+            obj->ext_idle_notifier_ = static_cast<struct ext_idle_notifier_v1 *>(
+                    wl_registry_bind(registry, name, &ext_idle_notifier_v1_interface, obj->idle_notifier_version_));
+            for (const auto &[wl_seat, seat]: obj->wl_seats_) {
+                seat->set_idle_notifier(obj->ext_idle_notifier_, obj->idle_notifier_version_);
+            }
+            break;
+#endif
+
+        case interface_hash("zwp_text_input_manager_v3"):
+            if (strcmp(interface, zwp_text_input_manager_v3_interface.name) != 0)
+                break;
+            obj->zwp_text_input_manager_ = static_cast<struct zwp_text_input_manager_v3 *>(
+                    wl_registry_bind(registry, name, &zwp_text_input_manager_v3_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            for (const auto &[wl_seat, seat]: obj->wl_seats_) {
+                seat->set_text_input_manager(obj->zwp_text_input_manager_);
+            }
+            break;
+
+        case interface_hash("wl_data_device_manager"):
+            if (strcmp(interface, wl_data_device_manager_interface.name) != 0)
+                break;
+            // version 3 adds the drag-and-drop actions
+            obj->wl_data_device_manager_ = static_cast<struct wl_data_device_manager *>(
+                    wl_registry_bind(registry, name, &wl_data_device_manager_interface,
+                                     std::min(static_cast<uint32_t>(3), version)));
+            for (const auto &[wl_seat, seat]: obj->wl_seats_) {
+                seat->set_data_device_manager(obj->wl_data_device_manager_);
+            }
+            break;
+
+        case interface_hash("zwp_primary_selection_device_manager_v1"):
+            if (strcmp(interface, zwp_primary_selection_device_manager_v1_interface.name) != 0)
+                break;
+            obj->zwp_primary_selection_manager_ = static_cast<struct zwp_primary_selection_device_manager_v1 *>(
+                    wl_registry_bind(registry, name, &zwp_primary_selection_device_manager_v1_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            for (const auto &[wl_seat, seat]: obj->wl_seats_) {
+                seat->set_primary_selection_manager(obj->zwp_primary_selection_manager_);
+            }
+            break;
+
+        case interface_hash("zxdg_output_manager_v1"):
+            if (strcmp(interface, zxdg_output_manager_v1_interface.name) != 0)
+                break;
+            // version 3 applies the logical geometry with wl_output.done
+            obj->zxdg_output_manager_ = static_cast<struct zxdg_output_manager_v1 *>(
+                    wl_registry_bind(registry, name, &zxdg_output_manager_v1_interface,
+                                     std::min(static_cast<uint32_t>(3), version)));
+            for (const auto &[wl_output, output]: obj->wl_outputs_) {
+                output->set_xdg_output_manager(obj->zxdg_output_manager_);
+            }
+            break;
+
+#if defined(ENABLE_OUTPUT_POWER)
+        case interface_hash("zwlr_output_power_manager_v1"):
+            if (strcmp(interface, zwlr_output_power_manager_v1_interface.name) != 0)
+                break;
+            obj->zwlr_output_power_manager_ = static_cast<struct zwlr_output_power_manager_v1 *>(
+                    wl_registry_bind(registry, name, &zwlr_output_power_manager_v1_interface, 1));
+            for (const auto &[wl_output, output]: obj->wl_outputs_) {
+                output->set_power_manager(obj->zwlr_output_power_manager_);
+            }
+            break;
+#endif
+
+        case interface_hash("zwp_tablet_manager_v2"):
+            if (strcmp(interface, zwp_tablet_manager_v2_interface.name) != 0)
+                break;
+            obj->zwp_tablet_manager_ = static_cast<struct zwp_tablet_manager_v2 *>(
+                    wl_registry_bind(registry, name, &zwp_tablet_manager_v2_interface,
+                                     std::min(static_cast<uint32_t>(1), version)));
+            for (const auto &[wl_seat, seat]: obj->wl_seats_) {
+                seat->set_tablet_manager(obj->zwp_tablet_manager_);
+            }
+            break;
+
+        case interface_hash("zwp_pointer_gestures_v1"):
+            if (strcmp(interface, zwp_pointer_gestures_v1_interface.name) != 0)
+                break;
+            obj->pointer_gestures_version_ = std::min(static_cast<uint32_t>(3), version);
+            obj->zwp_pointer_gestures_ = static_cast<struct zwp_pointer_gestures_v1 *>(
+                    wl_registry_bind(registry, name, &zwp_pointer_gestures_v1_interface,
+                                     obj->pointer_gestures_version_));
+            for (const auto &[wl_seat, seat]: obj->wl_seats_) {
+                seat->set_pointer_gestures(obj->zwp_pointer_gestures_, obj->pointer_gestures_version_);
+            }
+            break;
+
+        case interface_hash("zwp_linux_dmabuf_v1"):
+            if (strcmp(interface, zwp_linux_dmabuf_v1_interface.name) != 0)
+                break;
+            obj->linux_dmabuf_version_ = std::min(static_cast<uint32_t>(4), version);
+            obj->zwp_linux_dmabuf_ = static_cast<struct zwp_linux_dmabuf_v1 *>(
+                    wl_registry_bind(registry, name, &zwp_linux_dmabuf_v1_interface, obj->linux_dmabuf_version_));
+            if (obj->linux_dmabuf_version_ >= ZWP_LINUX_DMABUF_V1_GET_DEFAULT_FEEDBACK_SINCE_VERSION) {
+                // v4 globals no longer send format events, the default feedback replaces them
+                obj->dmabuf_feedback_ = std::make_unique<DmabufFeedback>(
+                        zwp_linux_dmabuf_v1_get_default_feedback(obj->zwp_linux_dmabuf_));
+                obj->dmabuf_feedback_->set_done_callback([obj]() {
+                    obj->dmabuf_formats_.clear();
+                    for (const auto &tranche: obj->dmabuf_feedback_->get_tranches()) {
+                        for (const auto &[format, modifier]: tranche.formats) {
+                            obj->add_dmabuf_format(format, modifier);
+                        }
+                    }
+                });
+            } else {
+                zwp_linux_dmabuf_v1_add_listener(obj->zwp_linux_dmabuf_, &linux_dmabuf_listener_, obj);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    const auto range = obj->interface_callbacks_.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->second.interface == interface) {
+            it->second.callback(it->second.data, registry, name, interface, version);
+        }
     }
 
     for (const auto &callback: obj->callbacks_) {
@@ -144,6 +801,156 @@ void Display::registry_handle_global(void *data,
     }
 }
 
+/**
+ * @brief Binds an output global and creates its Output.
+ *
+ * @param registry The registry, or a wrapper of it on the queue the output's first events go to.
+ * @param name     The global name.
+ * @param version  The version advertised.
+ * @return The bound wl_output.
+ */
+struct wl_output *Display::bind_output(struct wl_registry *registry, uint32_t name, uint32_t version) {
+    // name and description are sent from version 4
+    const auto bound = std::min(static_cast<uint32_t>(4), version);
+    auto output = static_cast<struct wl_output *>(
+            wl_registry_bind(registry, name, &wl_output_interface, bound));
+    output_globals_[name] = output;
+    auto &entry = wl_outputs_[output];
+    entry = std::make_unique<Output>(output, bound);
+    entry->set_xdg_output_manager(zxdg_output_manager_);
+    entry->set_power_manager(zwlr_output_power_manager_);
+    entry->set_change_callback([this](const Output &changed, uint32_t changes) {
+        for (const auto &callback: output_change_callbacks_) {
+            callback(changed, changes);
+        }
+    });
+    return output;
+}
+
+/**
+ * @brief Binds a seat global and creates its Seat with the input managers bound so far.
+ *
+ * @param registry The registry.
+ * @param name     The global name.
+ * @param version  The version advertised.
+ */
+void Display::bind_seat(struct wl_registry *registry, uint32_t name, uint32_t version) {
+    auto seat = static_cast<wl_seat *>(
+            wl_registry_bind(registry, name, &wl_seat_interface,
+                             std::min(static_cast<uint32_t>(9), version)));
+    seat_globals_[name] = seat;
+    auto &entry = wl_seats_[seat];
+    entry = std::make_unique<Seat>(seat, wl_shm_, wl_compositor_, enable_cursor_,
+                                   version, context_, input_devices_);
+    entry->set_input_callback(input_callback_);
+    entry->set_pointer_button_callback(pointer_button_callback_);
+    entry->set_keyboard_focus_callback(keyboard_focus_callback_);
+    if (idle_callback_) {
+        entry->set_idle_callback(idle_timeout_ms_, idle_callback_, idle_respect_inhibitors_);
+    }
+    if (ext_idle_notifier_) {
+        entry->set_idle_notifier(ext_idle_notifier_, idle_notifier_version_);
+    }
+    entry->set_input_router(&input_router_, next_device_index_++);
+    entry->set_keymap_cache(keymap_cache_);
+    if (!compose_table_) {
+        compose_table_ = &ComposeTable::get_default();
+    }
+    entry->set_compose_table(compose_table_);
+    entry->set_cursor_theme_cache(&cursor_theme_cache_);
+    entry->set_cursor_shape_manager(wp_cursor_shape_manager_);
+    if (zwp_relative_pointer_manager_) {
+        entry->set_relative_pointer_manager(zwp_relative_pointer_manager_);
+    }
+    if (zwp_pointer_constraints_) {
+        entry->set_pointer_constraints(zwp_pointer_constraints_);
+    }
+    if (zwp_text_input_manager_) {
+        entry->set_text_input_manager(zwp_text_input_manager_);
+    }
+    if (wl_data_device_manager_) {
+        entry->set_data_device_manager(wl_data_device_manager_);
+    }
+    if (zwp_primary_selection_manager_) {
+        entry->set_primary_selection_manager(zwp_primary_selection_manager_);
+    }
+    if (zwp_tablet_manager_) {
+        entry->set_tablet_manager(zwp_tablet_manager_);
+    }
+    if (zwp_pointer_gestures_) {
+        entry->set_pointer_gestures(zwp_pointer_gestures_, pointer_gestures_version_);
+    }
+    if (zwp_input_timestamps_manager_) {
+        entry->set_input_timestamps_manager(zwp_input_timestamps_manager_);
+    }
+}
+
+/**
+ * @brief Binds the outputs left by BIND_ON_FIRST_USE and waits for their initial state.
+ *
+ * The outputs are bound on a private queue that is round-tripped, so their mode,
+ * scale and name are known when get_outputs() returns, without dispatching the
+ * default queue under another thread's feet; afterwards they move to the default queue.
+ * Outputs hotplugged later are bound as they appear.
+ */
+void Display::bind_outputs() {
+    outputs_requested_ = true;
+    if (pending_outputs_.empty()) {
+        return;
+    }
+    TRACE_SCOPE("Display::bind_outputs");
+    auto queue = wl_display_create_queue(wl_display_);
+    auto registry = static_cast<struct wl_registry *>(wl_proxy_create_wrapper(wl_registry_));
+    wl_proxy_set_queue(reinterpret_cast<struct wl_proxy *>(registry), queue);
+    std::vector<struct wl_output *> bound;
+    for (const auto &[name, version]: pending_outputs_) {
+        bound.push_back(bind_output(registry, name, version));
+    }
+    pending_outputs_.clear();
+    wl_proxy_wrapper_destroy(registry);
+    // geometry, mode, scale and done of each output
+    wl_display_roundtrip_queue(wl_display_, queue);
+    for (auto output: bound) {
+        wl_proxy_set_queue(reinterpret_cast<struct wl_proxy *>(output), nullptr);
+    }
+    wl_event_queue_destroy(queue);
+}
+
+/**
+ * @brief Binds the seats left by BIND_ON_FIRST_USE.
+ *
+ * Their capabilities, and with them the keyboard and pointer, arrive with the next
+ * dispatch of the default queue. Seats hotplugged later are bound as they appear.
+ */
+void Display::bind_seats() {
+    seats_requested_ = true;
+    for (const auto &[name, version]: pending_seats_) {
+        bind_seat(wl_registry_, name, version);
+    }
+    pending_seats_.clear();
+}
+
+/**
+ * @return The outputs, bound on this first call with BIND_ON_FIRST_USE.
+ */
+const FlatMap<struct wl_output *, std::unique_ptr<Output>> &Display::get_outputs() const {
+    if (!outputs_requested_) {
+        // binding is what the policy defers to here, the outputs themselves are not changed
+        const_cast<Display *>(this)->bind_outputs();
+    }
+    return wl_outputs_;
+}
+
+/**
+ * @return The seats, bound on this first call with BIND_ON_FIRST_USE.
+ */
+const FlatMap<struct wl_seat *, std::unique_ptr<Seat>> &Display::get_seats() const {
+    if (!seats_requested_) {
+        const_cast<Display *>(this)->bind_seats();
+    }
+    return wl_seats_;
+}
+
 /**
  * @brief Handles the removal of global objects from the registry.
  *
@@ -155,9 +962,75 @@ void Display::registry_handle_global(void *data,
  *
  * @return None.
  */
-void Display::registry_handle_global_remove(void * /* data */,
+void Display::registry_handle_global_remove(void *data,
                                             struct wl_registry * /* reg */,
-                                            uint32_t /* id */) {
+                                            uint32_t id) {
+    TRACE_SCOPE("Display::registry_handle_global_remove");
+    const auto obj = static_cast<Display *>(data);
+    obj->globals_.erase(id);
+    obj->pending_outputs_.erase(id);
+    obj->pending_seats_.erase(id);
+
+    // hotplugged outputs and seats; other globals are not expected to go away
+    if (const auto it = obj->output_globals_.find(id); it != obj->output_globals_.end()) {
+        const auto output = obj->wl_outputs_.find(it->second);
+        obj->output_globals_.erase(it);
+        if (output == obj->wl_outputs_.end()) {
+            return;
+        }
+        LOG_DEBUG("Display: output %u \"%s\" removed", id, output->second->get_name().c_str());
+        // the compositor does not always send leave first
+        for (const auto &[wl_seat, seat]: obj->wl_seats_) {
+            seat->remove_output(output->first);
+        }
+        for (const auto &callback: obj->output_remove_callbacks_) {
+            callback(*output->second);
+        }
+        obj->wl_outputs_.erase(output);
+        return;
+    }
+    if (const auto it = obj->seat_globals_.find(id); it != obj->seat_globals_.end()) {
+        LOG_DEBUG("Display: seat %u removed", id);
+        obj->wl_seats_.erase(it->second);
+        obj->seat_globals_.erase(it);
+    }
+}
+
+/**
+ * @brief Adds a callback invoked before an output that was unplugged is destroyed.
+ *
+ * Windows drop it from the outputs they are on, whether or not the compositor sent
+ * wl_surface.leave.
+ *
+ * @param callback The function to invoke with the output, valid until it returns.
+ */
+void Display::add_output_remove_callback(const std::function<void(const Output &output)> &callback) {
+    output_remove_callbacks_.push_back(callback);
+}
+
+/**
+ * @brief Binds a global recorded during the initial registry enumeration.
+ *
+ * Shells and other components bind their globals through the Display's registry,
+ * so startup needs exactly one registry enumeration and one roundtrip.
+ *
+ * @param interface     The interface to bind.
+ * @param max_version   The highest version the caller supports.
+ * @param bound_version Optional, receives the version actually bound.
+ * @return The bound proxy, or nullptr if the compositor does not advertise the interface.
+ */
+void *Display::bind_global(const struct wl_interface *interface, uint32_t max_version,
+                           uint32_t *bound_version) const {
+    for (const auto &[name, global]: globals_) {
+        if (global.interface == interface->name) {
+            const auto version = std::min(max_version, global.version);
+            if (bound_version) {
+                *bound_version = version;
+            }
+            return wl_registry_bind(wl_registry_, name, interface, version);
+        }
+    }
+    return nullptr;
 }
 
 const struct wl_registry_listener Display::listener_ = {
@@ -179,9 +1052,437 @@ const struct wl_registry_listener Display::listener_ = {
  * @see wl_registry_add_listener
  * @see struct wl_registry_listener
  */
-void Display::add_registrar_callback(const std::function<void(void *data, struct wl_registry *registry,
-                                                              uint32_t name,
-                                                              const char *interface,
-                                                              uint32_t version)> &callback, void *data) {
+void Display::add_registrar_callback(const RegistrarCallback &callback, void *data) {
     callbacks_.emplace_back(std::move(std::make_pair(callback, data)));
 }
+
+/**
+ * @brief Adds a callback invoked when a wl_output.done changed an output, see Output::Change.
+ *
+ * Each callback sees the whole update of a hotplug or mode switch at once.
+ *
+ * @param callback The function to invoke with the output and its Change bits.
+ */
+void Display::add_output_change_callback(const std::function<void(const Output &output, uint32_t changes)> &callback) {
+    output_change_callbacks_.push_back(callback);
+}
+
+/**
+ * @brief Adds a registrar callback for a single interface.
+ *
+ * Unlike the catch-all overload, the callback is only invoked for globals whose
+ * interface name matches, and lookup is a hash probe rather than a call per subscriber.
+ *
+ * @param interface The interface name to subscribe to, e.g. "zwp_linux_dmabuf_v1".
+ * @param callback  The callback function to register.
+ * @param data      The data to associate with the callback.
+ */
+void Display::add_registrar_callback(const char *interface, const RegistrarCallback &callback, void *data) {
+    interface_callbacks_.emplace(interface_hash(interface), InterfaceCallback{interface, callback, data});
+}
+
+/**
+ * @brief Prepares the Wayland event source for a main loop iteration.
+ *
+ * Queued events make the source ready immediately. Otherwise the display is
+ * prepared for reading and outgoing requests are flushed before GLib polls.
+ * If the socket is full, POLLOUT is added so the flush is retried once it drains.
+ *
+ * @param source  The WaylandSource.
+ * @param timeout Set to -1, the source has no timeout of its own.
+ * @return TRUE if events are already queued and dispatch should run.
+ */
+gboolean Display::wayland_source_prepare(GSource *source, gint *timeout) {
+    auto *ws = reinterpret_cast<WaylandSource *>(source);
+    *timeout = -1;
+
+    if (ws->reading) {
+        return FALSE;
+    }
+
+    if (wl_display_prepare_read(ws->display) != 0) {
+        return TRUE;
+    }
+    ws->reading = true;
+
+    auto events = static_cast<GIOCondition>(G_IO_IN | G_IO_ERR | G_IO_HUP);
+    if (flush(ws->display) < 0 && errno == EAGAIN) {
+        events = static_cast<GIOCondition>(events | G_IO_OUT);
+    }
+    g_source_modify_unix_fd(source, ws->fd_tag, events);
+
+    return FALSE;
+}
+
+/**
+ * @brief Completes the read started in prepare once GLib has polled the fd.
+ *
+ * Reads events from the socket when the fd is readable, and cancels the read
+ * otherwise, so the read intent never outlives the main loop iteration.
+ *
+ * @param source The WaylandSource.
+ * @return TRUE if events were read and dispatch should run.
+ */
+gboolean Display::wayland_source_check(GSource *source) {
+    auto *ws = reinterpret_cast<WaylandSource *>(source);
+    const GIOCondition revents = g_source_query_unix_fd(source, ws->fd_tag);
+
+    if (!ws->reading) {
+        return (revents & G_IO_IN) != 0;
+    }
+    ws->reading = false;
+
+    if (revents & G_IO_OUT) {
+        flush(ws->display);
+    }
+
+    if (revents & (G_IO_IN | G_IO_ERR | G_IO_HUP)) {
+        TRACE_SCOPE("wl_display_read_events");
+        return wl_display_read_events(ws->display) == 0;
+    }
+
+    wl_display_cancel_read(ws->display);
+    return FALSE;
+}
+
+/**
+ * @brief Dispatches the events read from the Wayland socket.
+ *
+ * @param source    The WaylandSource.
+ * @param callback  Unused, the source has no user callback.
+ * @param user_data Unused.
+ * @return G_SOURCE_CONTINUE, or G_SOURCE_REMOVE if the connection failed.
+ */
+gboolean Display::wayland_source_dispatch(GSource *source, GSourceFunc /* callback */, gpointer /* user_data */) {
+    const auto *ws = reinterpret_cast<WaylandSource *>(source);
+
+    if (wl_display_dispatch_pending(ws->display) < 0 ||
+        drain_events(ws->display, nullptr, ws->read_budget_us) < 0) {
+        LOG_ERROR("Wayland connection error: %s", strerror(errno));
+        ws->owner->report_disconnect();
+        return G_SOURCE_REMOVE;
+    }
+    if (ws->flush_after_dispatch) {
+        flush(ws->display);
+    }
+
+    return G_SOURCE_CONTINUE;
+}
+
+/**
+ * @brief Chooses when requests are sent to the compositor.
+ *
+ * Requests are buffered by libwayland until a flush. poll_dispatch() and the GLib
+ * source flush before the loop sleeps; with FLUSH_AFTER_DISPATCH the source also
+ * flushes after each dispatch. FLUSH_BEFORE_POLL drops that flush, so the commits,
+ * cursor updates and other requests made by every source during one loop iteration
+ * leave in a single sendmsg and wake the compositor once. Commits that cannot wait,
+ * e.g. a tearing game window, are flushed on their own with Window::set_flush_on_commit().
+ * EGL drivers flush in eglSwapBuffers regardless.
+ */
+void Display::set_flush_policy(FlushPolicy policy) {
+    flush_policy_ = policy;
+    if (wayland_source_) {
+        reinterpret_cast<WaylandSource *>(wayland_source_)->flush_after_dispatch = policy == FLUSH_AFTER_DISPATCH;
+    }
+}
+
+/**
+ * @brief Compiles the keymaps of this connection's keyboards in cache instead of the process wide one.
+ *
+ * The default cache is shared by every Display, so a reconnect finds its keymap
+ * compiled, but its compiles are serialized. Connections run on threads of their
+ * own, e.g. to several virtual displays, can each get a cache instead, so a keymap
+ * storm on one never waits for another. The cache must outlive the Display.
+ *
+ * @param cache The cache, nullptr for KeymapCache::get_default().
+ */
+void Display::set_keymap_cache(KeymapCache *cache) {
+    keymap_cache_ = cache ? cache : &KeymapCache::get_default();
+    for (const auto &[wl_seat, seat]: wl_seats_) {
+        seat->set_keymap_cache(keymap_cache_);
+    }
+}
+
+/**
+ * @brief Keeps reading the socket for up to budget_us after a wakeup.
+ *
+ * At high input rates, e.g. a 1000 Hz mouse, events trickle in while the first
+ * batch is dispatched. With a budget, dispatch() and the GLib source go on reading
+ * without blocking until the socket is empty or the budget is spent, instead of
+ * returning to the caller's loop, and its rendering, once per small batch. Each
+ * read is dispatched before the next, libwayland only reads into an empty queue.
+ *
+ * @param budget_us Time to keep draining, in microseconds; 0 reads once per wakeup.
+ */
+void Display::set_read_budget(uint32_t budget_us) {
+    read_budget_us_ = budget_us;
+    if (wayland_source_) {
+        reinterpret_cast<WaylandSource *>(wayland_source_)->read_budget_us = budget_us;
+    }
+}
+
+/**
+ * @brief Lets libwayland's connection buffers grow to max_buffer_size bytes.
+ *
+ * libwayland buffers requests in a fixed ring and, when a client queues more between
+ * flushes than the compositor reads, the flush fails with EAGAIN and the next one
+ * waits for the socket. Clients committing many subsurfaces or damage rectangles per
+ * frame can raise the limit to their traffic; get_flush_stats() shows whether flushes
+ * are still blocked. Needs libwayland 1.23, where the buffers became growable.
+ *
+ * @param max_buffer_size The limit in bytes, rounded up to a power of two by libwayland; 0 for no limit.
+ * @return false if libwayland is too old to support it.
+ */
+bool Display::set_max_buffer_size(size_t max_buffer_size) {
+#if WAYLAND_VERSION_MAJOR > 1 || (WAYLAND_VERSION_MAJOR == 1 && WAYLAND_VERSION_MINOR >= 23)
+    wl_display_set_max_buffer_size(wl_display_, max_buffer_size);
+    max_buffer_size_ = max_buffer_size;
+    return true;
+#else
+    (void) max_buffer_size;
+    LOG_WARN("Display: libwayland %s has fixed size connection buffers", WAYLAND_VERSION);
+    return false;
+#endif
+}
+
+std::atomic<uint64_t> Display::flush_count_{};
+std::atomic<uint64_t> Display::flush_blocked_count_{};
+
+/**
+ * @brief Sends buffered requests, counting the flushes the socket could not take in full.
+ *
+ * A blocked flush means the compositor is reading more slowly than requests are made,
+ * or the connection buffers are too small, see set_max_buffer_size(). errno is left
+ * as set by wl_display_flush().
+ *
+ * @param display The Wayland display.
+ * @return The result of wl_display_flush().
+ */
+int Display::flush(struct wl_display *display) {
+    flush_count_.fetch_add(1, std::memory_order_relaxed);
+    const int ret = wl_display_flush(display);
+    if (ret < 0 && errno == EAGAIN) {
+        flush_blocked_count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ret;
+}
+
+/**
+ * @return The number of flushes and blocked flushes since the process started.
+ */
+Display::FlushStats Display::get_flush_stats() {
+    return {flush_count_.load(std::memory_order_relaxed), flush_blocked_count_.load(std::memory_order_relaxed)};
+}
+
+/**
+ * @brief Releases a pending read when the source is destroyed mid-iteration.
+ *
+ * @param source The WaylandSource.
+ */
+void Display::wayland_source_finalize(GSource *source) {
+    auto *ws = reinterpret_cast<WaylandSource *>(source);
+    if (ws->reading) {
+        wl_display_cancel_read(ws->display);
+        ws->reading = false;
+    }
+}
+
+GSourceFuncs Display::wayland_source_funcs_ = {
+        .prepare = wayland_source_prepare,
+        .check = wayland_source_check,
+        .dispatch = wayland_source_dispatch,
+        .finalize = wayland_source_finalize,
+        .closure_callback = nullptr,
+        .closure_marshal = nullptr,
+};
+
+/**
+ * @brief Attaches the Wayland connection to the GMainContext passed to Display.
+ *
+ * The display fd is polled by the context itself, so a single g_main_loop_run()
+ * services Wayland events together with every other source on the context.
+ */
+void Display::attach_wayland_source() {
+    wayland_source_ = g_source_new(&wayland_source_funcs_, sizeof(WaylandSource));
+    auto *ws = reinterpret_cast<WaylandSource *>(wayland_source_);
+    ws->display = wl_display_;
+    ws->owner = this;
+    ws->reading = false;
+    ws->flush_after_dispatch = flush_policy_ == FLUSH_AFTER_DISPATCH;
+    ws->read_budget_us = read_budget_us_;
+    ws->fd_tag = g_source_add_unix_fd(wayland_source_, wl_display_get_fd(wl_display_),
+                                      static_cast<GIOCondition>(G_IO_IN | G_IO_ERR | G_IO_HUP));
+    g_source_set_name(wayland_source_, "waypp wayland");
+    g_source_set_priority(wayland_source_, G_PRIORITY_DEFAULT);
+    g_source_attach(wayland_source_, context_);
+}
+
+namespace {
+int prepare_read(struct wl_display *display, struct wl_event_queue *queue) {
+    return queue ? wl_display_prepare_read_queue(display, queue) : wl_display_prepare_read(display);
+}
+
+int dispatch_pending(struct wl_display *display, struct wl_event_queue *queue) {
+    TRACE_SCOPE("wl_display_dispatch_pending");
+    return queue ? wl_display_dispatch_queue_pending(display, queue) : wl_display_dispatch_pending(display);
+}
+}
+
+/**
+ * @brief Waits for and dispatches Wayland events on an event queue.
+ *
+ * Follows the libwayland read protocol: pending events are dispatched until
+ * wl_display_prepare_read() succeeds, outgoing requests are flushed, and the
+ * calling thread then sleeps in poll() on the display fd until events arrive or
+ * the timeout expires. If the flush could not complete because the socket is
+ * full, the poll also waits for POLLOUT and the flush is retried.
+ *
+ * A timeout of -1 blocks until an event arrives, 0 returns immediately.
+ * A poll interrupted by a signal is reported as zero events dispatched so the
+ * caller can check its run condition.
+ *
+ * Several threads may call this concurrently on different queues of the same
+ * display; libwayland coordinates the socket reads between them.
+ *
+ * Further fds, such as a frame scheduler timerfd or the fds of a GMainContext, can be
+ * polled in the same call, so a thread with nothing to do sleeps in a single poll().
+ * fds[0] is filled in with the display fd; the caller sets up the remaining entries,
+ * whose revents are valid on return and cleared on timeout or error.
+ *
+ * @param display The Wayland display.
+ * @param queue   The event queue to dispatch, or nullptr for the default queue.
+ * @param timeout The maximum amount of time to wait for events, in milliseconds.
+ * @param fds     The display entry followed by the additional fds to poll.
+ * @param count   The number of entries in fds, at least 1.
+ * @return The number of events dispatched on success, or a negative error code on failure.
+ */
+int Display::poll_dispatch(struct wl_display *display, struct wl_event_queue *queue, int timeout,
+                           struct pollfd *fds, nfds_t count) {
+    int dispatch_count = 0;
+
+    while (prepare_read(display, queue) != 0) {
+        const int ret = dispatch_pending(display, queue);
+        if (ret < 0) {
+            return -errno;
+        }
+        dispatch_count += ret;
+    }
+
+    short events = POLLIN;
+    if (flush(display) < 0) {
+        if (errno != EAGAIN) {
+            const int error = errno;
+            wl_display_cancel_read(display);
+            return -error;
+        }
+        events |= POLLOUT;
+    }
+
+    fds[0] = {wl_display_get_fd(display), events, 0};
+
+    const int ret = poll(fds, count, timeout);
+    if (ret <= 0) {
+        const int error = errno;
+        wl_display_cancel_read(display);
+        for (nfds_t i = 0; i < count; i++) {
+            fds[i].revents = 0;
+        }
+        if (ret == 0 || error == EINTR) {
+            return dispatch_count;
+        }
+        return -error;
+    }
+
+    if (fds[0].revents & POLLOUT) {
+        flush(display);
+    }
+
+    // error and hang-up conditions are reported by wl_display_read_events()
+    if (!(fds[0].revents & (POLLIN | POLLERR | POLLHUP))) {
+        wl_display_cancel_read(display);
+        return dispatch_count;
+    }
+
+    {
+        TRACE_SCOPE("wl_display_read_events");
+        if (wl_display_read_events(display) < 0) {
+            return -errno;
+        }
+    }
+
+    const int pending = dispatch_pending(display, queue);
+    if (pending < 0) {
+        return -errno;
+    }
+    return dispatch_count + pending;
+}
+
+/**
+ * @brief Reads and dispatches events without blocking until the socket is empty or the budget is spent.
+ *
+ * @param display   The Wayland display.
+ * @param queue     The event queue to dispatch, or nullptr for the default queue.
+ * @param budget_us The time to keep reading, in microseconds; 0 returns immediately.
+ * @return The number of events dispatched on success, or a negative error code on failure.
+ *
+ * @see set_read_budget()
+ */
+int Display::drain_events(struct wl_display *display, struct wl_event_queue *queue, uint32_t budget_us) {
+    if (budget_us == 0) {
+        return 0;
+    }
+    TRACE_SCOPE("Display::drain_events");
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(budget_us);
+    int dispatch_count = 0;
+    while (std::chrono::steady_clock::now() < deadline) {
+        while (prepare_read(display, queue) != 0) {
+            const int ret = dispatch_pending(display, queue);
+            if (ret < 0) {
+                return -errno;
+            }
+            dispatch_count += ret;
+        }
+        struct pollfd fd = {wl_display_get_fd(display), POLLIN, 0};
+        if (poll(&fd, 1, 0) <= 0 || !(fd.revents & (POLLIN | POLLERR | POLLHUP))) {
+            wl_display_cancel_read(display);
+            break;
+        }
+        if (wl_display_read_events(display) < 0) {
+            return -errno;
+        }
+        const int pending = dispatch_pending(display, queue);
+        if (pending < 0) {
+            return -errno;
+        }
+        dispatch_count += pending;
+    }
+    return dispatch_count;
+}
+
+/**
+ * @brief Waits for and dispatches Wayland events, polling one additional fd.
+ *
+ * extra_ready is invoked once extra_fd becomes readable, after Wayland events have
+ * been dispatched.
+ *
+ * @param display     The Wayland display.
+ * @param queue       The event queue to dispatch, or nullptr for the default queue.
+ * @param timeout     The maximum amount of time to wait for events, in milliseconds.
+ * @param extra_fd    An additional fd to poll for POLLIN, or -1.
+ * @param extra_ready Called with extra_data when extra_fd is readable.
+ * @param extra_data  User data for extra_ready.
+ * @return The number of events dispatched on success, or a negative error code on failure.
+ */
+int Display::poll_dispatch(struct wl_display *display, struct wl_event_queue *queue, int timeout,
+                           int extra_fd, void (*extra_ready)(void *data), void *extra_data) {
+    struct pollfd fds[2] = {{-1, 0, 0},
+                            {extra_fd, POLLIN, 0}};
+
+    const int ret = poll_dispatch(display, queue, timeout, fds, extra_fd >= 0 ? 2 : 1);
+    if (ret < 0 || extra_fd < 0 || !(fds[1].revents & POLLIN) || !extra_ready) {
+        return ret;
+    }
+    extra_ready(extra_data);
+    return ret + 1;
+}
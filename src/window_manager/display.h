@@ -17,41 +17,297 @@
 #ifndef SRC_DISPLAY_H_
 #define SRC_DISPLAY_H_
 
+#include <atomic>
 #include <functional>
 #include <memory>
 #include <optional>
 #include <map>
 #include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <ctime>
+#include <poll.h>
 
 #include <wayland-client.h>
+#include <wayland-version.h>
 #include <glib-2.0/glib.h>
 
+#include "presentation-time-client-protocol.h"
+#include "linux-dmabuf-unstable-v1-client-protocol.h"
+#include "viewporter-client-protocol.h"
+#include "fractional-scale-v1-client-protocol.h"
+#include "linux-drm-syncobj-v1-client-protocol.h"
+#if defined(ENABLE_TEARING_CONTROL)
+#include "tearing-control-v1-client-protocol.h"
+#endif
+#if defined(ENABLE_CONTENT_TYPE)
+#include "content-type-v1-client-protocol.h"
+#endif
+#include "cursor-shape-v1-client-protocol.h"
+#include "input-timestamps-unstable-v1-client-protocol.h"
+#include "relative-pointer-unstable-v1-client-protocol.h"
+#include "pointer-constraints-unstable-v1-client-protocol.h"
+#include "pointer-gestures-unstable-v1-client-protocol.h"
+#include "primary-selection-unstable-v1-client-protocol.h"
+#include "text-input-unstable-v3-client-protocol.h"
+#include "tablet-unstable-v2-client-protocol.h"
+#include "xdg-output-unstable-v1-client-protocol.h"
+#if defined(ENABLE_IDLE_NOTIFY)
+#include "ext-idle-notify-v1-client-protocol.h"
+#endif
+#if defined(ENABLE_SINGLE_PIXEL_BUFFER)
+#include "single-pixel-buffer-v1-client-protocol.h"
+#endif
+#if defined(ENABLE_ALPHA_MODIFIER)
+#include "alpha-modifier-v1-client-protocol.h"
+#endif
+#if defined(ENABLE_FIFO)
+#include "fifo-v1-client-protocol.h"
+#endif
+#if defined(ENABLE_COMMIT_TIMING)
+#include "commit-timing-v1-client-protocol.h"
+#endif
+
+#include "dmabuf_feedback.h"
+#include "fence.h"
+
 #include "output.h"
+#include "seat/cursor_theme_cache.h"
+#include "window/color_management.h"
+#include "seat/input_devices.h"
 #include "seat/seat.h"
+#include "utils/flat_map.h"
+#include "utils/export.h"
 
 class Output;
 
 class Seat;
 
-class Display {
+struct PointerButton;
+
+class WAYPP_EXPORT Display {
 public:
-    explicit Display(GMainContext *context = nullptr, bool enable_cursor = true, const char *name = nullptr);
+    typedef enum {
+        // the GLib source also flushes after dispatching, so replies go out within the iteration
+        FLUSH_AFTER_DISPATCH,
+        // only before the loop sleeps, one sendmsg for every request of the iteration
+        FLUSH_BEFORE_POLL,
+    } FlushPolicy;
+
+    struct Global {
+        std::string interface;
+        uint32_t version;
+    };
+
+    typedef enum {
+        // every wl_output and wl_seat is bound during the initial registry enumeration
+        BIND_EAGER,
+        // outputs with the first get_outputs(), seats with the first get_seats() or bind_seats()
+        BIND_ON_FIRST_USE,
+    } BindPolicy;
+
+    // process-wide, every connection and thread
+    struct FlushStats {
+        uint64_t flushes;
+        // flushes that left requests behind because the socket was full (EAGAIN)
+        uint64_t blocked;
+    };
+
+    typedef std::function<void(void *data, struct wl_registry *registry,
+                               uint32_t name,
+                               const char *interface,
+                               uint32_t version)> RegistrarCallback;
+
+    explicit Display(GMainContext *context = nullptr, bool enable_cursor = true, const char *name = nullptr,
+                     uint32_t input_devices = INPUT_DEVICE_ALL, BindPolicy bind_policy = BIND_EAGER);
 
     ~Display();
 
     [[nodiscard]] struct wl_display *get_display() const { return wl_display_; }
 
-    [[nodiscard]] const std::map<struct wl_seat *, std::unique_ptr<Seat>> &get_seats() const { return wl_seats_; }
+    [[nodiscard]] const FlatMap<struct wl_seat *, std::unique_ptr<Seat>> &get_seats() const;
+
+    void bind_seats();
+
+    void bind_outputs();
+
+    [[nodiscard]] BindPolicy get_bind_policy() const { return bind_policy_; }
 
-    [[nodiscard]] const std::map<struct wl_output *, std::unique_ptr<Output>> &
-    get_outputs() const { return wl_outputs_; }
+    void set_input_devices(uint32_t input_devices);
+
+    [[nodiscard]] uint32_t get_input_devices() const { return input_devices_; }
+
+    [[nodiscard]] const FlatMap<struct wl_output *, std::unique_ptr<Output>> &get_outputs() const;
 
     struct wl_compositor *get_compositor() { return wl_compositor_; }
 
-    void add_registrar_callback(const std::function<void(void *data, struct wl_registry *registry,
-                                                         uint32_t name,
-                                                         const char *interface,
-                                                         uint32_t version)> &callback, void *data);
+    [[nodiscard]] struct wl_shm *get_shm() const { return wl_shm_; }
+
+    [[nodiscard]] GMainContext *get_context() const { return context_; }
+
+    [[nodiscard]] struct wl_registry *get_registry() const { return wl_registry_; }
+
+    void sync(const std::function<void()> &callback) const;
+
+    [[nodiscard]] int get_connection_error() const;
+
+    void set_disconnect_callback(const std::function<void(int error)> &callback);
+
+    void set_flush_policy(FlushPolicy policy);
+
+    [[nodiscard]] FlushPolicy get_flush_policy() const { return flush_policy_; }
+
+    void set_read_budget(uint32_t budget_us);
+
+    [[nodiscard]] uint32_t get_read_budget() const { return read_budget_us_; }
+
+    bool set_max_buffer_size(size_t max_buffer_size);
+
+    [[nodiscard]] size_t get_max_buffer_size() const { return max_buffer_size_; }
+
+    // orders against the requests sent so far without blocking, see Fence
+    [[nodiscard]] Fence fence(struct wl_event_queue *queue = nullptr) const { return Fence(wl_display_, queue); }
+
+    [[nodiscard]] struct wp_presentation *get_presentation() const { return wp_presentation_; }
+
+    [[nodiscard]] clockid_t get_presentation_clock() const { return presentation_clock_id_; }
+
+    [[nodiscard]] struct wp_viewporter *get_viewporter() const { return wp_viewporter_; }
+
+    [[nodiscard]] struct wp_single_pixel_buffer_manager_v1 *get_single_pixel_buffer_manager() const {
+        return wp_single_pixel_buffer_manager_;
+    }
+
+    [[nodiscard]] struct wp_alpha_modifier_v1 *get_alpha_modifier() const { return wp_alpha_modifier_; }
+
+    [[nodiscard]] struct wp_fifo_manager_v1 *get_fifo_manager() const { return wp_fifo_manager_; }
+
+    // nullptr without wp_color_manager_v1, buffers are sRGB then
+#if defined(ENABLE_COLOR_MANAGEMENT)
+    [[nodiscard]] const ColorManager *get_color_manager() const { return color_manager_.get(); }
+#else
+    [[nodiscard]] const ColorManager *get_color_manager() const { return nullptr; }
+#endif
+
+    [[nodiscard]] struct wp_commit_timing_manager_v1 *get_commit_timing_manager() const {
+        return wp_commit_timing_manager_;
+    }
+
+    [[nodiscard]] struct wp_fractional_scale_manager_v1 *get_fractional_scale_manager() const {
+        return wp_fractional_scale_manager_;
+    }
+
+    [[nodiscard]] struct wp_linux_drm_syncobj_manager_v1 *get_drm_syncobj_manager() const {
+        return wp_drm_syncobj_manager_;
+    }
+
+    [[nodiscard]] struct wp_tearing_control_manager_v1 *get_tearing_control_manager() const {
+        return wp_tearing_control_manager_;
+    }
+
+    [[nodiscard]] struct wp_content_type_manager_v1 *get_content_type_manager() const {
+        return wp_content_type_manager_;
+    }
+
+    [[nodiscard]] struct zwp_input_timestamps_manager_v1 *get_input_timestamps_manager() const {
+        return zwp_input_timestamps_manager_;
+    }
+
+    void set_input_callback(const std::function<void(uint64_t time_ns)> &callback);
+
+    void set_pointer_button_callback(const std::function<void(Seat &seat, const PointerButton &button)> &callback);
+
+    void set_keyboard_focus_callback(const std::function<void(struct wl_surface *surface, bool focused)> &callback);
+
+    void set_idle_callback(uint32_t timeout_ms, const std::function<void(Seat &seat, bool idle)> &callback,
+                           bool respect_inhibitors = false);
+
+    [[nodiscard]] struct ext_idle_notifier_v1 *get_idle_notifier() const { return ext_idle_notifier_; }
+
+    [[nodiscard]] struct zwp_relative_pointer_manager_v1 *get_relative_pointer_manager() const {
+        return zwp_relative_pointer_manager_;
+    }
+
+    [[nodiscard]] struct zwp_pointer_constraints_v1 *get_pointer_constraints() const {
+        return zwp_pointer_constraints_;
+    }
+
+    [[nodiscard]] struct zwp_pointer_gestures_v1 *get_pointer_gestures() const { return zwp_pointer_gestures_; }
+
+    [[nodiscard]] struct zwp_text_input_manager_v3 *get_text_input_manager() const { return zwp_text_input_manager_; }
+
+    [[nodiscard]] struct wl_data_device_manager *get_data_device_manager() const { return wl_data_device_manager_; }
+
+    [[nodiscard]] struct zwp_primary_selection_device_manager_v1 *get_primary_selection_manager() const {
+        return zwp_primary_selection_manager_;
+    }
+
+    [[nodiscard]] struct zwp_tablet_manager_v2 *get_tablet_manager() const { return zwp_tablet_manager_; }
+
+    [[nodiscard]] struct zxdg_output_manager_v1 *get_xdg_output_manager() const { return zxdg_output_manager_; }
+
+    [[nodiscard]] struct zwlr_output_power_manager_v1 *get_output_power_manager() const {
+        return zwlr_output_power_manager_;
+    }
+
+    [[nodiscard]] struct wp_cursor_shape_manager_v1 *get_cursor_shape_manager() const {
+        return wp_cursor_shape_manager_;
+    }
+
+    /**
+     * @brief Add a window surface and its InputRing here to receive the events of every seat.
+     */
+    [[nodiscard]] InputRouter &get_input_router() { return input_router_; }
+
+    [[nodiscard]] KeymapCache &get_keymap_cache() const { return *keymap_cache_; }
+
+    void set_keymap_cache(KeymapCache *cache);
+
+    [[nodiscard]] const CursorThemeCache &get_cursor_theme_cache() const { return cursor_theme_cache_; }
+
+    [[nodiscard]] uint32_t get_compositor_version() const { return compositor_version_; }
+
+    [[nodiscard]] bool is_buffer_scaling_enabled() const { return buffer_scaling_enabled_.value_or(false); }
+
+    [[nodiscard]] struct zwp_linux_dmabuf_v1 *get_linux_dmabuf() const { return zwp_linux_dmabuf_; }
+
+    [[nodiscard]] uint32_t get_linux_dmabuf_version() const { return linux_dmabuf_version_; }
+
+    [[nodiscard]] const DmabufFeedback *get_dmabuf_feedback() const { return dmabuf_feedback_.get(); }
+
+    [[nodiscard]] const std::map<uint32_t, std::vector<uint64_t>> &get_dmabuf_formats() const {
+        return dmabuf_formats_;
+    }
+
+    [[nodiscard]] bool supports_dmabuf_format(uint32_t format, uint64_t modifier) const;
+
+    [[nodiscard]] const std::map<uint32_t, Global> &get_globals() const { return globals_; }
+
+    void *bind_global(const struct wl_interface *interface, uint32_t max_version,
+                      uint32_t *bound_version = nullptr) const;
+
+    static int poll_dispatch(struct wl_display *display, struct wl_event_queue *queue, int timeout,
+                             int extra_fd = -1, void (*extra_ready)(void *data) = nullptr,
+                             void *extra_data = nullptr);
+
+    static int poll_dispatch(struct wl_display *display, struct wl_event_queue *queue, int timeout,
+                             struct pollfd *fds, nfds_t count);
+
+    static int flush(struct wl_display *display);
+
+    [[nodiscard]] static FlushStats get_flush_stats();
+
+    static int drain_events(struct wl_display *display, struct wl_event_queue *queue, uint32_t budget_us);
+
+    void add_registrar_callback(const RegistrarCallback &callback, void *data);
+
+    void add_registrar_callback(const char *interface, const RegistrarCallback &callback, void *data);
+
+    void add_output_change_callback(const std::function<void(const Output &output, uint32_t changes)> &callback);
+
+    void add_output_remove_callback(const std::function<void(const Output &output)> &callback);
 
     friend class Cursor;
 
@@ -71,23 +327,112 @@ private:
     struct wl_display *wl_display_{};
     struct wl_registry *wl_registry_{};
     struct wl_shm *wl_shm_{};
+    struct wp_presentation *wp_presentation_{};
+    clockid_t presentation_clock_id_{CLOCK_MONOTONIC};
+    struct wp_viewporter *wp_viewporter_{};
+    struct wp_single_pixel_buffer_manager_v1 *wp_single_pixel_buffer_manager_{};
+    struct wp_alpha_modifier_v1 *wp_alpha_modifier_{};
+#if defined(ENABLE_COLOR_MANAGEMENT)
+    std::unique_ptr<ColorManager> color_manager_;
+#endif
+    struct wp_fifo_manager_v1 *wp_fifo_manager_{};
+    struct wp_commit_timing_manager_v1 *wp_commit_timing_manager_{};
+    struct wp_fractional_scale_manager_v1 *wp_fractional_scale_manager_{};
+    struct wp_linux_drm_syncobj_manager_v1 *wp_drm_syncobj_manager_{};
+    struct wp_tearing_control_manager_v1 *wp_tearing_control_manager_{};
+    struct wp_content_type_manager_v1 *wp_content_type_manager_{};
+    struct zwp_input_timestamps_manager_v1 *zwp_input_timestamps_manager_{};
+    struct zwp_relative_pointer_manager_v1 *zwp_relative_pointer_manager_{};
+    struct zwp_pointer_constraints_v1 *zwp_pointer_constraints_{};
+    struct zwp_pointer_gestures_v1 *zwp_pointer_gestures_{};
+    uint32_t pointer_gestures_version_{};
+    struct zwp_text_input_manager_v3 *zwp_text_input_manager_{};
+    struct wl_data_device_manager *wl_data_device_manager_{};
+    struct zwp_primary_selection_device_manager_v1 *zwp_primary_selection_manager_{};
+    struct zwp_tablet_manager_v2 *zwp_tablet_manager_{};
+    struct zxdg_output_manager_v1 *zxdg_output_manager_{};
+    struct zwlr_output_power_manager_v1 *zwlr_output_power_manager_{};
+    struct wp_cursor_shape_manager_v1 *wp_cursor_shape_manager_{};
+    struct ext_idle_notifier_v1 *ext_idle_notifier_{};
+    uint32_t idle_notifier_version_{};
+    // passed to every seat, including those announced later
+    std::function<void(uint64_t time_ns)> input_callback_;
+    std::function<void(Seat &seat, const PointerButton &button)> pointer_button_callback_;
+    std::function<void(struct wl_surface *surface, bool focused)> keyboard_focus_callback_;
+    std::function<void(Seat &seat, bool idle)> idle_callback_;
+    uint32_t idle_timeout_ms_{};
+    bool idle_respect_inhibitors_{};
+    InputRouter input_router_;
+    // InputEvent::device of the next seat bound, wraps after 256 seats
+    uint8_t next_device_index_{};
+    // process wide unless set_keymap_cache() gave one, keymaps survive a reconnect
+    KeymapCache *keymap_cache_{&KeymapCache::get_default()};
+    // process wide as well, compiled in the background when the first seat is bound
+    ComposeTable *compose_table_{};
+    struct zwp_linux_dmabuf_v1 *zwp_linux_dmabuf_{};
+    uint32_t linux_dmabuf_version_{};
+    // default feedback, v4 and later
+    std::unique_ptr<DmabufFeedback> dmabuf_feedback_;
+    // DRM fourcc formats and the modifiers the compositor accepts for each
+    std::map<uint32_t, std::vector<uint64_t>> dmabuf_formats_;
 
     GMainContext *context_;
+    GSource *wayland_source_{};
+    std::function<void(int error)> disconnect_callback_;
+    bool disconnect_reported_{};
+    FlushPolicy flush_policy_{FLUSH_AFTER_DISPATCH};
+    // time spent draining the socket after a wakeup, 0 reads once, see set_read_budget()
+    uint32_t read_budget_us_{};
+    // 0 keeps libwayland's default
+    size_t max_buffer_size_{};
+    static std::atomic<uint64_t> flush_count_;
+    static std::atomic<uint64_t> flush_blocked_count_;
     bool enable_cursor_;
-
-    std::map<struct wl_output *, std::unique_ptr<Output>> wl_outputs_;
-    std::map<struct wl_seat *, std::unique_ptr<Seat>> wl_seats_;
+    // InputDevices of every seat
+    uint32_t input_devices_;
+    BindPolicy bind_policy_;
+    // cleared until first use with BIND_ON_FIRST_USE; the globals are kept by name and version meanwhile
+    bool outputs_requested_;
+    bool seats_requested_;
+    std::map<uint32_t, uint32_t> pending_outputs_;
+    std::map<uint32_t, uint32_t> pending_seats_;
+
+    // every global advertised by the registry, keyed by global name
+    std::map<uint32_t, Global> globals_;
+
+    FlatMap<struct wl_output *, std::unique_ptr<Output>> wl_outputs_;
+    std::vector<std::function<void(const Output &output, uint32_t changes)>> output_change_callbacks_;
+    std::vector<std::function<void(const Output &output)>> output_remove_callbacks_;
+    // global names of the outputs and seats, for global_remove
+    std::map<uint32_t, struct wl_output *> output_globals_;
+    std::map<uint32_t, struct wl_seat *> seat_globals_;
+    // one theme per size for the cursors of every seat, outlives the seats
+    CursorThemeCache cursor_theme_cache_;
+    FlatMap<struct wl_seat *, std::unique_ptr<Seat>> wl_seats_;
 
     bool has_xrgb_{};
     std::optional<bool> buffer_scaling_enabled_;
 
-    std::vector<std::pair<std::function<void(void * /*data */, struct wl_registry * /* registry */,
-                                             uint32_t /* name */,
-                                             const char * /* interface */,
-                                             uint32_t /* version */)>, void * /* data */>> callbacks_;
+    // subscribers to every global
+    std::vector<std::pair<RegistrarCallback, void * /* data */>> callbacks_;
+
+    struct InterfaceCallback {
+        std::string interface;
+        RegistrarCallback callback;
+        void *data;
+    };
+
+    // subscribers to a single interface, keyed by interface name hash
+    std::unordered_multimap<uint32_t, InterfaceCallback> interface_callbacks_;
 
     struct wl_compositor *get_compositor() const { return wl_compositor_; }
 
+    void report_disconnect();
+
+    struct wl_output *bind_output(struct wl_registry *registry, uint32_t name, uint32_t version);
+
+    void bind_seat(struct wl_registry *registry, uint32_t name, uint32_t version);
+
     static void registry_handle_global(void *data,
                                        struct wl_registry *registry,
                                        uint32_t name,
@@ -106,6 +451,47 @@ private:
 
     static const struct wl_shm_listener shm_listener_;
 
+    static void presentation_clock_id(void *data,
+                                      struct wp_presentation *wp_presentation,
+                                      uint32_t clk_id);
+
+    static const struct wp_presentation_listener presentation_listener_;
+
+    void add_dmabuf_format(uint32_t format, uint64_t modifier);
+
+    static void linux_dmabuf_format(void *data,
+                                    struct zwp_linux_dmabuf_v1 *zwp_linux_dmabuf,
+                                    uint32_t format);
+
+    static void linux_dmabuf_modifier(void *data,
+                                      struct zwp_linux_dmabuf_v1 *zwp_linux_dmabuf,
+                                      uint32_t format,
+                                      uint32_t modifier_hi,
+                                      uint32_t modifier_lo);
+
+    static const struct zwp_linux_dmabuf_v1_listener linux_dmabuf_listener_;
+
+    struct WaylandSource {
+        GSource source;
+        struct wl_display *display;
+        Display *owner;
+        gpointer fd_tag;
+        bool reading;
+        bool flush_after_dispatch;
+        uint32_t read_budget_us;
+    };
+
+    static gboolean wayland_source_prepare(GSource *source, gint *timeout);
+
+    static gboolean wayland_source_check(GSource *source);
+
+    static gboolean wayland_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data);
+
+    static void wayland_source_finalize(GSource *source);
+
+    static GSourceFuncs wayland_source_funcs_;
+
+    void attach_wayland_source();
 };
 
 
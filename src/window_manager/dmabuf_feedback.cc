@@ -0,0 +1,152 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "dmabuf_feedback.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+/**
+ * @class DmabufFeedback
+ * @brief Collects the format and modifier tranches of a linux-dmabuf feedback object.
+ *
+ * Used for both the default feedback and per-surface feedback. Each set of events
+ * terminated by done replaces the previous tranches; the done callback runs then.
+ *
+ * @param feedback The feedback object, destroyed with this object.
+ */
+DmabufFeedback::DmabufFeedback(struct zwp_linux_dmabuf_feedback_v1 *feedback) :
+        feedback_(feedback) {
+    zwp_linux_dmabuf_feedback_v1_add_listener(feedback_, &listener_, this);
+}
+
+DmabufFeedback::~DmabufFeedback() {
+    unmap_format_table();
+    if (feedback_) {
+        zwp_linux_dmabuf_feedback_v1_destroy(feedback_);
+    }
+}
+
+/**
+ * @brief Checks whether any tranche offers format with modifier.
+ *
+ * @param format   The DRM fourcc format.
+ * @param modifier The DRM format modifier.
+ * @return true if the compositor accepts the pair.
+ */
+bool DmabufFeedback::supports(uint32_t format, uint64_t modifier) const {
+    for (const auto &tranche: tranches_) {
+        for (const auto &[f, m]: tranche.formats) {
+            if (f == format && m == modifier) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void DmabufFeedback::unmap_format_table() {
+    if (format_table_) {
+        munmap(const_cast<FormatTableEntry *>(format_table_), format_table_size_);
+        format_table_ = nullptr;
+        format_table_size_ = 0;
+    }
+}
+
+/**
+ * @brief Reads a dev_t sent as a wl_array.
+ */
+dev_t DmabufFeedback::read_device(const struct wl_array *device) {
+    dev_t result{};
+    if (device->size == sizeof(result)) {
+        memcpy(&result, device->data, sizeof(result));
+    }
+    return result;
+}
+
+void DmabufFeedback::handle_done(struct zwp_linux_dmabuf_feedback_v1 * /* feedback */) {
+    tranches_ = std::move(pending_tranches_);
+    pending_tranches_.clear();
+    done_ = true;
+    if (done_callback_) {
+        done_callback_();
+    }
+}
+
+void DmabufFeedback::handle_format_table(struct zwp_linux_dmabuf_feedback_v1 * /* feedback */,
+                                         int32_t fd, uint32_t size) {
+    unmap_format_table();
+    // the table is read-only and has to be mapped private
+    auto table = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (table == MAP_FAILED) {
+        LOG_ERROR("Failed to map dmabuf format table: %s", strerror(errno));
+        return;
+    }
+    format_table_ = static_cast<const FormatTableEntry *>(table);
+    format_table_size_ = size;
+}
+
+void DmabufFeedback::handle_main_device(struct zwp_linux_dmabuf_feedback_v1 * /* feedback */,
+                                        struct wl_array *device) {
+    main_device_ = read_device(device);
+}
+
+void DmabufFeedback::handle_tranche_done(struct zwp_linux_dmabuf_feedback_v1 * /* feedback */) {
+    pending_tranches_.emplace_back(std::move(pending_tranche_));
+    pending_tranche_ = {};
+}
+
+void DmabufFeedback::handle_tranche_target_device(struct zwp_linux_dmabuf_feedback_v1 * /* feedback */,
+                                                  struct wl_array *device) {
+    pending_tranche_.target_device = read_device(device);
+}
+
+void DmabufFeedback::handle_tranche_formats(struct zwp_linux_dmabuf_feedback_v1 * /* feedback */,
+                                            struct wl_array *indices) {
+    if (!format_table_) {
+        return;
+    }
+    const auto count = format_table_size_ / sizeof(FormatTableEntry);
+    const auto *index = static_cast<const uint16_t *>(indices->data);
+    const auto *end = index + indices->size / sizeof(uint16_t);
+    for (; index < end; ++index) {
+        if (*index < count) {
+            pending_tranche_.formats.emplace_back(format_table_[*index].format, format_table_[*index].modifier);
+        }
+    }
+}
+
+void DmabufFeedback::handle_tranche_flags(struct zwp_linux_dmabuf_feedback_v1 * /* feedback */, uint32_t flags) {
+    pending_tranche_.flags = flags;
+}
+
+const struct zwp_linux_dmabuf_feedback_v1_listener DmabufFeedback::listener_ = {
+        .done = listener_thunk<&DmabufFeedback::handle_done>,
+        .format_table = listener_thunk<&DmabufFeedback::handle_format_table>,
+        .main_device = listener_thunk<&DmabufFeedback::handle_main_device>,
+        .tranche_done = listener_thunk<&DmabufFeedback::handle_tranche_done>,
+        .tranche_target_device = listener_thunk<&DmabufFeedback::handle_tranche_target_device>,
+        .tranche_formats = listener_thunk<&DmabufFeedback::handle_tranche_formats>,
+        .tranche_flags = listener_thunk<&DmabufFeedback::handle_tranche_flags>,
+};
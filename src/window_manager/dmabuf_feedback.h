@@ -0,0 +1,108 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_DMABUF_FEEDBACK_H_
+#define SRC_WINDOW_MANAGER_DMABUF_FEEDBACK_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include <sys/types.h>
+
+#include <wayland-client.h>
+
+#include "linux-dmabuf-unstable-v1-client-protocol.h"
+#include "utils/export.h"
+
+// DRM_FORMAT_MOD_INVALID from drm_fourcc.h, an implicit modifier chosen by the driver
+constexpr uint64_t kDrmFormatModInvalid = 0x00ffffffffffffffULL;
+
+class WAYPP_EXPORT DmabufFeedback {
+public:
+    struct Tranche {
+        // device buffers for this tranche should be allocated on
+        dev_t target_device;
+        // ZWP_LINUX_DMABUF_FEEDBACK_V1_TRANCHE_FLAGS_* flags
+        uint32_t flags;
+        // DRM fourcc format and modifier pairs, in compositor preference order
+        std::vector<std::pair<uint32_t, uint64_t>> formats;
+    };
+
+    explicit DmabufFeedback(struct zwp_linux_dmabuf_feedback_v1 *feedback);
+
+    ~DmabufFeedback();
+
+    DmabufFeedback(const DmabufFeedback &) = delete;
+
+    DmabufFeedback &operator=(const DmabufFeedback &) = delete;
+
+    [[nodiscard]] dev_t get_main_device() const { return main_device_; }
+
+    [[nodiscard]] const std::vector<Tranche> &get_tranches() const { return tranches_; }
+
+    [[nodiscard]] bool is_done() const { return done_; }
+
+    [[nodiscard]] bool supports(uint32_t format, uint64_t modifier) const;
+
+    void set_done_callback(const std::function<void()> &callback) { done_callback_ = callback; }
+
+private:
+    struct zwp_linux_dmabuf_feedback_v1 *feedback_;
+
+    // format table entry as sent by the compositor
+    struct FormatTableEntry {
+        uint32_t format;
+        uint32_t padding;
+        uint64_t modifier;
+    };
+
+    const FormatTableEntry *format_table_{};
+    size_t format_table_size_{};
+
+    dev_t main_device_{};
+    std::vector<Tranche> tranches_;
+    // tranches of the feedback being received, replacing tranches_ on done
+    std::vector<Tranche> pending_tranches_;
+    Tranche pending_tranche_{};
+    bool done_{};
+    std::function<void()> done_callback_;
+
+    void unmap_format_table();
+
+    static dev_t read_device(const struct wl_array *device);
+
+    void handle_done(struct zwp_linux_dmabuf_feedback_v1 *feedback);
+
+    void handle_format_table(struct zwp_linux_dmabuf_feedback_v1 *feedback, int32_t fd, uint32_t size);
+
+    void handle_main_device(struct zwp_linux_dmabuf_feedback_v1 *feedback, struct wl_array *device);
+
+    void handle_tranche_done(struct zwp_linux_dmabuf_feedback_v1 *feedback);
+
+    void handle_tranche_target_device(struct zwp_linux_dmabuf_feedback_v1 *feedback, struct wl_array *device);
+
+    void handle_tranche_formats(struct zwp_linux_dmabuf_feedback_v1 *feedback, struct wl_array *indices);
+
+    void handle_tranche_flags(struct zwp_linux_dmabuf_feedback_v1 *feedback, uint32_t flags);
+
+    static const struct zwp_linux_dmabuf_feedback_v1_listener listener_;
+};
+
+#endif // SRC_WINDOW_MANAGER_DMABUF_FEEDBACK_H_
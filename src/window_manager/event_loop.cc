@@ -0,0 +1,391 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "event_loop.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "display.h"
+#include "utils/logging.h"
+#include "utils/trace.h"
+
+namespace {
+int prepare_read(struct wl_display *display, struct wl_event_queue *queue) {
+    return queue ? wl_display_prepare_read_queue(display, queue) : wl_display_prepare_read(display);
+}
+
+int dispatch_pending(struct wl_display *display, struct wl_event_queue *queue) {
+    TRACE_SCOPE("wl_display_dispatch_pending");
+    return queue ? wl_display_dispatch_queue_pending(display, queue) : wl_display_dispatch_pending(display);
+}
+}
+
+/**
+ * @brief Creates the epoll instance and registers the Wayland display fd with it.
+ *
+ * @param display The Wayland display.
+ * @param queue   The event queue to dispatch, or nullptr for the default queue.
+ */
+EventLoop::EventLoop(struct wl_display *display, struct wl_event_queue *queue) :
+        wl_display_(display),
+        wl_event_queue_(queue) {
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        throw std::runtime_error(std::string("epoll_create1: ") + strerror(errno));
+    }
+    struct epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wl_display_get_fd(wl_display_), &event) < 0) {
+        const int error = errno;
+        close(epoll_fd_);
+        throw std::runtime_error(std::string("epoll_ctl: ") + strerror(error));
+    }
+    quit_source_ = add_wakeup([]() {});
+    if (!quit_source_) {
+        close(epoll_fd_);
+        throw std::runtime_error("EventLoop: failed to create the quit eventfd");
+    }
+}
+
+/**
+ * @brief Removes every source still registered and closes the epoll instance.
+ *
+ * fds passed to add_fd() stay open, they belong to the caller.
+ */
+EventLoop::~EventLoop() {
+    while (!sources_.empty()) {
+        remove(*sources_.begin());
+    }
+    for (auto source: removed_) {
+        delete source;
+    }
+    close(epoll_fd_);
+}
+
+/**
+ * @brief Registers source's fd with the epoll instance.
+ *
+ * @return The new source, or nullptr if epoll_ctl() failed.
+ */
+EventLoop::Source *EventLoop::add_source(SourceType type, int fd, uint32_t events) {
+    auto *source = new Source{type, fd, false, {}, {}};
+    struct epoll_event event{};
+    event.events = events;
+    event.data.ptr = source;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) < 0) {
+        LOG_ERROR("EventLoop: epoll_ctl(ADD, %d) failed: %s", fd, strerror(errno));
+        delete source;
+        return nullptr;
+    }
+    sources_.insert(source);
+    return source;
+}
+
+/**
+ * @brief Watches an fd the caller owns.
+ *
+ * @param fd       The fd, left open by remove().
+ * @param events   EPOLLIN, EPOLLOUT and the other epoll event flags to wait for.
+ * @param callback Called with the events that occurred.
+ * @return The source, or nullptr on failure.
+ */
+EventLoop::Source *EventLoop::add_fd(int fd, uint32_t events, const std::function<void(uint32_t events)> &callback) {
+    Source *source = add_source(FD, fd, events);
+    if (source) {
+        source->fd_callback = callback;
+    }
+    return source;
+}
+
+/**
+ * @brief Creates a disarmed timer on CLOCK_MONOTONIC, see set_timer().
+ *
+ * Each timer has a timerfd of its own, so arming one is a single syscall and
+ * dispatching does not sort or scan the other timers.
+ *
+ * @param callback Called each time the timer expires; missed expirations are merged.
+ * @return The source, or nullptr on failure.
+ */
+EventLoop::Source *EventLoop::add_timer(const std::function<void()> &callback) {
+    const int fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (fd < 0) {
+        LOG_ERROR("EventLoop: timerfd_create failed: %s", strerror(errno));
+        return nullptr;
+    }
+    Source *source = add_source(TIMER, fd, EPOLLIN);
+    if (!source) {
+        close(fd);
+        return nullptr;
+    }
+    source->callback = callback;
+    return source;
+}
+
+/**
+ * @brief Arms or disarms a timer created by add_timer().
+ *
+ * @param source      The timer.
+ * @param delay_ns    Time until the first expiration, 0 disarms the timer.
+ * @param interval_ns Period of the following expirations, 0 for a one-shot timer.
+ * @return false if source is not a timer or timerfd_settime() failed.
+ */
+bool EventLoop::set_timer(Source *source, uint64_t delay_ns, uint64_t interval_ns) {
+    if (!source || source->type != TIMER || source->removed) {
+        return false;
+    }
+    struct itimerspec spec{};
+    spec.it_value.tv_sec = static_cast<time_t>(delay_ns / 1000000000ULL);
+    spec.it_value.tv_nsec = static_cast<long>(delay_ns % 1000000000ULL);
+    spec.it_interval.tv_sec = static_cast<time_t>(interval_ns / 1000000000ULL);
+    spec.it_interval.tv_nsec = static_cast<long>(interval_ns % 1000000000ULL);
+    return timerfd_settime(source->fd, 0, &spec, nullptr) == 0;
+}
+
+/**
+ * @brief Creates an eventfd that other threads wake the loop with, see signal().
+ *
+ * @param callback Called on the loop thread once per batch of signals.
+ * @return The source, or nullptr on failure.
+ */
+EventLoop::Source *EventLoop::add_wakeup(const std::function<void()> &callback) {
+    const int fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (fd < 0) {
+        LOG_ERROR("EventLoop: eventfd failed: %s", strerror(errno));
+        return nullptr;
+    }
+    Source *source = add_source(WAKEUP, fd, EPOLLIN);
+    if (!source) {
+        close(fd);
+        return nullptr;
+    }
+    source->callback = callback;
+    return source;
+}
+
+/**
+ * @brief Wakes the loop and runs source's callback on it; safe from any thread.
+ *
+ * @param source A source created by add_wakeup().
+ */
+void EventLoop::signal(Source *source) {
+    const uint64_t value = 1;
+    if (write(source->fd, &value, sizeof(value)) < 0) {
+        LOG_ERROR("EventLoop: eventfd write failed: %s", strerror(errno));
+    }
+}
+
+/**
+ * @brief Unregisters a source, from the loop thread.
+ *
+ * Timer and wakeup fds are closed. May be called from a callback, also for a source
+ * whose event is pending in the same batch; it is freed once the batch is done.
+ *
+ * @param source The source to remove.
+ */
+void EventLoop::remove(Source *source) {
+    if (!source || source->removed) {
+        return;
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, source->fd, nullptr);
+    if (source->type != FD) {
+        close(source->fd);
+    }
+    source->removed = true;
+    sources_.erase(source);
+    if (dispatching_) {
+        removed_.push_back(source);
+    } else {
+        delete source;
+    }
+}
+
+/**
+ * @brief Switches the display fd between waiting for input and for input or output.
+ */
+bool EventLoop::watch_display_writable(bool writable) {
+    struct epoll_event event{};
+    event.events = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.ptr = nullptr;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, wl_display_get_fd(wl_display_), &event) < 0) {
+        return false;
+    }
+    display_writable_wait_ = writable;
+    return true;
+}
+
+/**
+ * @brief Consumes a timer or wakeup count and runs the source's callback.
+ */
+void EventLoop::dispatch_source(Source *source, uint32_t events) {
+    if (source->type == FD) {
+        if (source->fd_callback) {
+            source->fd_callback(events);
+        }
+        return;
+    }
+    uint64_t value;
+    if (read(source->fd, &value, sizeof(value)) != sizeof(value)) {
+        return;
+    }
+    if (source->callback) {
+        source->callback();
+    }
+}
+
+/**
+ * @brief Waits for and dispatches Wayland events and ready sources.
+ *
+ * The Wayland side follows the same read protocol as Display::poll_dispatch():
+ * queued events are dispatched until wl_display_prepare_read() succeeds, requests
+ * are flushed, and a full socket makes the wait include EPOLLOUT. The read is
+ * cancelled unless the display fd became readable. Sources are dispatched after the
+ * Wayland events, at most kMaxEvents per call; the rest are reported by the next one.
+ *
+ * @param timeout The maximum amount of time to wait, in milliseconds; -1 blocks.
+ * @return The number of events and sources dispatched, or a negative error code.
+ */
+int EventLoop::dispatch(int timeout) {
+    TRACE_SCOPE("EventLoop::dispatch");
+    // Wayland listeners may remove sources too, also after epoll_wait() filled events_
+    dispatching_ = true;
+    const int ret = dispatch_once(timeout);
+    dispatching_ = false;
+    for (auto source: removed_) {
+        delete source;
+    }
+    removed_.clear();
+    return ret;
+}
+
+/**
+ * @brief One iteration of dispatch(), run with removals deferred.
+ */
+int EventLoop::dispatch_once(int timeout) {
+    int dispatch_count = 0;
+
+    while (prepare_read(wl_display_, wl_event_queue_) != 0) {
+        const int ret = dispatch_pending(wl_display_, wl_event_queue_);
+        if (ret < 0) {
+            return -errno;
+        }
+        dispatch_count += ret;
+    }
+
+    bool writable = false;
+    if (Display::flush(wl_display_) < 0) {
+        if (errno != EAGAIN) {
+            const int error = errno;
+            wl_display_cancel_read(wl_display_);
+            return -error;
+        }
+        writable = true;
+    }
+    if (writable != display_writable_wait_) {
+        watch_display_writable(writable);
+    }
+
+    const int count = epoll_wait(epoll_fd_, events_.data(), kMaxEvents, timeout);
+    wakeup_count_++;
+    if (count < 0) {
+        const int error = errno;
+        wl_display_cancel_read(wl_display_);
+        if (error == EINTR) {
+            return dispatch_count;
+        }
+        return -error;
+    }
+
+    bool readable = false;
+    for (int i = 0; i < count; i++) {
+        if (events_[i].data.ptr) {
+            continue;
+        }
+        if (events_[i].events & EPOLLOUT) {
+            Display::flush(wl_display_);
+        }
+        // error and hang-up conditions are reported by wl_display_read_events()
+        readable = (events_[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) != 0;
+    }
+
+    if (readable) {
+        {
+            TRACE_SCOPE("wl_display_read_events");
+            if (wl_display_read_events(wl_display_) < 0) {
+                return -errno;
+            }
+        }
+        const int pending = dispatch_pending(wl_display_, wl_event_queue_);
+        if (pending < 0) {
+            return -errno;
+        }
+        dispatch_count += pending;
+        const int drained = Display::drain_events(wl_display_, wl_event_queue_, read_budget_us_);
+        if (drained < 0) {
+            return drained;
+        }
+        dispatch_count += drained;
+    } else {
+        wl_display_cancel_read(wl_display_);
+    }
+
+    for (int i = 0; i < count; i++) {
+        auto *source = static_cast<Source *>(events_[i].data.ptr);
+        if (!source || source->removed) {
+            continue;
+        }
+        dispatch_source(source, events_[i].events);
+        dispatch_count++;
+    }
+
+    if (dispatch_count == 0) {
+        idle_wakeup_count_++;
+    }
+    return dispatch_count;
+}
+
+/**
+ * @brief Dispatches until quit() is called or an error occurs.
+ *
+ * @return 0 after quit(), or the negative error code dispatch() failed with.
+ */
+int EventLoop::run() {
+    running_ = true;
+    while (running_) {
+        const int ret = dispatch(-1);
+        if (ret < 0) {
+            running_ = false;
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief Makes run() return after the current iteration; safe from any thread.
+ */
+void EventLoop::quit() {
+    running_ = false;
+    signal(quit_source_);
+}
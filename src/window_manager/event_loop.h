@@ -0,0 +1,127 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_EVENT_LOOP_H_
+#define SRC_WINDOW_MANAGER_EVENT_LOOP_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+#include <sys/epoll.h>
+#include <wayland-client.h>
+
+#include "utils/export.h"
+
+/**
+ * @brief A GLib-free event loop that waits for Wayland, fds, timers and wakeups in one epoll_wait().
+ *
+ * Every source is registered with the epoll instance once, so adding or removing one
+ * is O(1) and an iteration does not rebuild a pollfd array however many sources exist.
+ * GMainContext sources, such as the keyboard repeat timer, are not serviced; use
+ * WindowManager::dispatch() when those are needed.
+ */
+class WAYPP_EXPORT EventLoop {
+public:
+    typedef enum {
+        FD,
+        TIMER,
+        WAKEUP,
+    } SourceType;
+
+    struct Source;
+
+    explicit EventLoop(struct wl_display *display, struct wl_event_queue *queue = nullptr);
+
+    ~EventLoop();
+
+    EventLoop(const EventLoop &) = delete;
+
+    EventLoop &operator=(const EventLoop &) = delete;
+
+    Source *add_fd(int fd, uint32_t events, const std::function<void(uint32_t events)> &callback);
+
+    Source *add_timer(const std::function<void()> &callback);
+
+    bool set_timer(Source *source, uint64_t delay_ns, uint64_t interval_ns = 0);
+
+    Source *add_wakeup(const std::function<void()> &callback);
+
+    static void signal(Source *source);
+
+    void remove(Source *source);
+
+    int dispatch(int timeout);
+
+    int run();
+
+    void quit();
+
+    // keeps reading the display for up to budget_us after a wakeup, see Display::set_read_budget()
+    void set_read_budget(uint32_t budget_us) { read_budget_us_ = budget_us; }
+
+    // not counting the loop's own quit wakeup
+    [[nodiscard]] size_t get_source_count() const { return sources_.size() - 1; }
+
+    [[nodiscard]] uint64_t get_wakeup_count() const { return wakeup_count_; }
+
+    [[nodiscard]] uint64_t get_idle_wakeup_count() const { return idle_wakeup_count_; }
+
+private:
+    static constexpr int kMaxEvents = 64;
+
+    struct wl_display *wl_display_;
+    struct wl_event_queue *wl_event_queue_;
+    int epoll_fd_{-1};
+    // the display fd is registered with a null data.ptr; also waits for POLLOUT after a partial flush
+    bool display_writable_wait_{};
+    Source *quit_source_{};
+    std::atomic<bool> running_{};
+    uint32_t read_budget_us_{};
+
+    std::array<struct epoll_event, kMaxEvents> events_{};
+    // removed while their events may still be pending in events_, freed after the batch
+    std::vector<Source *> removed_;
+    std::unordered_set<Source *> sources_;
+    bool dispatching_{};
+    std::atomic<uint64_t> wakeup_count_{};
+    std::atomic<uint64_t> idle_wakeup_count_{};
+
+    Source *add_source(SourceType type, int fd, uint32_t events);
+
+    bool watch_display_writable(bool writable);
+
+    void dispatch_source(Source *source, uint32_t events);
+
+    int dispatch_once(int timeout);
+};
+
+/**
+ * @brief A registered fd, timerfd or eventfd and its callback.
+ */
+struct EventLoop::Source {
+    SourceType type;
+    int fd;
+    bool removed;
+    std::function<void(uint32_t events)> fd_callback;
+    std::function<void()> callback;
+};
+
+#endif // SRC_WINDOW_MANAGER_EVENT_LOOP_H_
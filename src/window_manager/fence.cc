@@ -0,0 +1,110 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "fence.h"
+
+#include <utility>
+
+/**
+ * @class Fence
+ * @brief Notifies once the compositor has processed every request sent before it.
+ *
+ * A wl_display.sync without the wait: issue any number of requests, take a fence,
+ * and be called back when its done event arrives, while the event loop keeps
+ * running. Events those requests caused, e.g. the first configure of a surface or
+ * the formats of a newly bound global, have been dispatched by then.
+ *
+ * @code
+ * auto fence = display.fence();
+ * bind_more_globals();
+ * fence.on_done([&]() { finish_startup(); });
+ * @endcode
+ *
+ * Destroying the fence before it is done drops its callbacks.
+ *
+ * @param display The Wayland display.
+ * @param queue   The queue the done event is dispatched on, nullptr for the default queue.
+ */
+Fence::Fence(struct wl_display *display, struct wl_event_queue *queue) :
+        state_(std::make_unique<State>()) {
+    if (queue) {
+        auto wrapper = static_cast<struct wl_display *>(wl_proxy_create_wrapper(display));
+        wl_proxy_set_queue(reinterpret_cast<struct wl_proxy *>(wrapper), queue);
+        state_->callback = wl_display_sync(wrapper);
+        wl_proxy_wrapper_destroy(wrapper);
+    } else {
+        state_->callback = wl_display_sync(display);
+    }
+    wl_callback_add_listener(state_->callback, &listener_, state_.get());
+}
+
+Fence::~Fence() {
+    if (state_ && state_->callback) {
+        wl_callback_destroy(state_->callback);
+    }
+}
+
+/**
+ * @brief Takes over other's fence; a pending one this held is destroyed first, dropping its callbacks.
+ */
+Fence &Fence::operator=(Fence &&other) noexcept {
+    if (this != &other) {
+        if (state_ && state_->callback) {
+            wl_callback_destroy(state_->callback);
+        }
+        state_ = std::move(other.state_);
+    }
+    return *this;
+}
+
+/**
+ * @brief Adds a callback run on the thread dispatching the fence's queue, right away if already done.
+ */
+void Fence::on_done(const std::function<void()> &callback) {
+    {
+        const std::lock_guard lock(state_->mutex);
+        if (!state_->done) {
+            state_->waiters.push_back(callback);
+            return;
+        }
+    }
+    callback();
+}
+
+bool Fence::is_done() const {
+    const std::lock_guard lock(state_->mutex);
+    return state_->done;
+}
+
+void Fence::handle_done(void *data, struct wl_callback *callback, uint32_t /* serial */) {
+    auto state = static_cast<State *>(data);
+    wl_callback_destroy(callback);
+    std::vector<std::function<void()>> waiters;
+    {
+        const std::lock_guard lock(state->mutex);
+        state->callback = nullptr;
+        state->done = true;
+        waiters.swap(state->waiters);
+    }
+    for (const auto &waiter: waiters) {
+        waiter();
+    }
+}
+
+const struct wl_callback_listener Fence::listener_ = {
+        .done = handle_done,
+};
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_FENCE_H_
+#define SRC_WINDOW_MANAGER_FENCE_H_
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT Fence {
+public:
+    Fence(struct wl_display *display, struct wl_event_queue *queue = nullptr);
+
+    ~Fence();
+
+    Fence(Fence &&) noexcept = default;
+
+    Fence &operator=(Fence &&other) noexcept;
+
+    Fence(const Fence &) = delete;
+
+    Fence &operator=(const Fence &) = delete;
+
+    void on_done(const std::function<void()> &callback);
+
+    [[nodiscard]] bool is_done() const;
+
+private:
+    // stays put while the Fence moves, it is the callback's listener data
+    struct State {
+        mutable std::mutex mutex;
+        struct wl_callback *callback{};
+        bool done{};
+        std::vector<std::function<void()>> waiters;
+    };
+
+    std::unique_ptr<State> state_;
+
+    static void handle_done(void *data, struct wl_callback *callback, uint32_t serial);
+
+    static const struct wl_callback_listener listener_;
+};
+
+#endif // SRC_WINDOW_MANAGER_FENCE_H_
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ivi_shell.h"
+
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "display.h"
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+// weston's ivi clients use this base plus their pid when no id is assigned
+static constexpr uint32_t kDefaultIviIdBase = 9000;
+
+/**
+ * @class IviShell
+ *
+ * @brief The ivi_application client of an ivi-shell compositor.
+ *
+ * ivi-shell layouts are driven by a controller client, over ivi-wm, that places
+ * surfaces by their numeric ivi id. There is no configure handshake, a surface
+ * may attach and commit its first buffer right after it is given its id.
+ */
+IviShell::IviShell(const Display *display) {
+    ivi_application_ = static_cast<struct ivi_application *>(
+            display->bind_global(&ivi_application_interface, 1));
+    if (!ivi_application_) {
+        throw std::runtime_error("ivi_application is not available.");
+    }
+}
+
+IviShell::~IviShell() {
+    ivi_application_destroy(ivi_application_);
+}
+
+/**
+ * @brief Gives surface the ivi surface role with the id ivi_id.
+ *
+ * Must happen before the surface's first buffer. The compositor disconnects the
+ * client if the surface already has a role or another surface holds ivi_id.
+ */
+std::unique_ptr<IviSurface> IviShell::create_surface(uint32_t ivi_id, struct wl_surface *surface) const {
+    return std::make_unique<IviSurface>(ivi_application_, ivi_id, surface);
+}
+
+/**
+ * @brief An id for clients the layout controller has no predefined id for.
+ */
+uint32_t IviShell::get_default_id() {
+    return kDefaultIviIdBase + static_cast<uint32_t>(getpid());
+}
+
+IviSurface::IviSurface(struct ivi_application *application, uint32_t ivi_id, struct wl_surface *surface) :
+        wl_surface_(surface), ivi_id_(ivi_id) {
+    ivi_surface_ = ivi_application_surface_create(application, ivi_id, surface);
+    ivi_surface_add_listener(ivi_surface_, &listener_, this);
+    LOG_DEBUG("IviSurface: id %u", ivi_id);
+}
+
+IviSurface::~IviSurface() {
+    ivi_surface_destroy(ivi_surface_);
+}
+
+void IviSurface::handle_configure(struct ivi_surface * /* surface */, int32_t width, int32_t height) {
+    if (configure_callback_ && width > 0 && height > 0) {
+        configure_callback_(width, height);
+    }
+}
+
+const struct ivi_surface_listener IviSurface::listener_ = {
+        .configure = listener_thunk<&IviSurface::handle_configure>,
+};
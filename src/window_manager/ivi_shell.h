@@ -0,0 +1,77 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_MANAGER_IVI_SHELL_H_
+#define SRC_WINDOW_MANAGER_IVI_SHELL_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "ivi-application-client-protocol.h"
+#include "utils/export.h"
+
+class Display;
+
+class WAYPP_EXPORT IviSurface {
+public:
+    IviSurface(struct ivi_application *application, uint32_t ivi_id, struct wl_surface *surface);
+
+    ~IviSurface();
+
+    IviSurface(const IviSurface &) = delete;
+
+    IviSurface &operator=(const IviSurface &) = delete;
+
+    [[nodiscard]] uint32_t get_id() const { return ivi_id_; }
+
+    [[nodiscard]] struct wl_surface *get_surface() const { return wl_surface_; }
+
+    // a size hint from the layout controller, in surface local coordinates
+    void set_configure_callback(const std::function<void(int width, int height)> &callback) {
+        configure_callback_ = callback;
+    }
+
+private:
+    struct ivi_surface *ivi_surface_{};
+    struct wl_surface *wl_surface_{};
+    uint32_t ivi_id_;
+    std::function<void(int width, int height)> configure_callback_;
+
+    void handle_configure(struct ivi_surface *surface, int32_t width, int32_t height);
+
+    static const struct ivi_surface_listener listener_;
+};
+
+class WAYPP_EXPORT IviShell {
+public:
+    explicit IviShell(const Display *display);
+
+    ~IviShell();
+
+    IviShell(const IviShell &) = delete;
+
+    IviShell &operator=(const IviShell &) = delete;
+
+    [[nodiscard]] std::unique_ptr<IviSurface> create_surface(uint32_t ivi_id, struct wl_surface *surface) const;
+
+    [[nodiscard]] static uint32_t get_default_id();
+
+private:
+    struct ivi_application *ivi_application_{};
+};
+
+#endif // SRC_WINDOW_MANAGER_IVI_SHELL_H_
@@ -0,0 +1,392 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "ivi_wm_controller.h"
+
+#include <stdexcept>
+
+#include "display.h"
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+/**
+ * @class IviWmController
+ *
+ * @brief An ivi-wm layout controller that applies its changes in batches.
+ *
+ * Visibility, opacity, rectangles and z-order of layers and surfaces are only
+ * staged by the setters. commit() sends what differs from the last sent state
+ * and applies all of it with one commit_changes, so the compositor never shows
+ * a transition half done and repaints once for it. Call commit() once per frame,
+ * e.g. from the draw callback, however many surfaces moved.
+ *
+ * Setting a property back to its sent value before commit() drops the change.
+ * The sent state is this controller's own, so a property another controller
+ * changed since is not resent when set back to the same value.
+ */
+IviWmController::IviWmController(const Display *display) {
+    ivi_wm_ = static_cast<struct ivi_wm *>(display->bind_global(&ivi_wm_interface, 1));
+    if (!ivi_wm_) {
+        throw std::runtime_error("ivi_wm is not available.");
+    }
+    ivi_wm_add_listener(ivi_wm_, &listener_, this);
+}
+
+IviWmController::~IviWmController() {
+    for (auto &[output, screen]: screens_) {
+        ivi_wm_screen_destroy(screen);
+    }
+    wl_proxy_destroy(reinterpret_cast<struct wl_proxy *>(ivi_wm_));
+}
+
+/**
+ * @brief Creates a layer of the given size; it goes on screen with set_screen_layers().
+ *
+ * Sent right away so later changes may refer to it, applied with the next commit().
+ */
+void IviWmController::create_layer(uint32_t layer_id, int32_t width, int32_t height) {
+    ivi_wm_create_layout_layer(ivi_wm_, layer_id, width, height);
+    pending_structure_ = true;
+}
+
+/**
+ * @brief Destroys a layer, dropping its staged changes. Applied with the next commit().
+ */
+void IviWmController::destroy_layer(uint32_t layer_id) {
+    pending_layers_.erase(layer_id);
+    layers_.erase(layer_id);
+    ivi_wm_destroy_layout_layer(ivi_wm_, layer_id);
+    pending_structure_ = true;
+}
+
+void IviWmController::set_surface_visibility(uint32_t surface_id, bool visible) {
+    stage(pending_surfaces_[surface_id].visible, surfaces_[surface_id].visible, visible);
+}
+
+/**
+ * @param opacity From 0.0, transparent, to 1.0, opaque.
+ */
+void IviWmController::set_surface_opacity(uint32_t surface_id, double opacity) {
+    stage(pending_surfaces_[surface_id].opacity, surfaces_[surface_id].opacity, wl_fixed_from_double(opacity));
+}
+
+/**
+ * @brief Crops the surface to rect, in buffer coordinates.
+ */
+void IviWmController::set_surface_source(uint32_t surface_id, const Rect &rect) {
+    stage(pending_surfaces_[surface_id].source, surfaces_[surface_id].source, rect);
+}
+
+/**
+ * @brief Places and scales the surface to rect, in layer coordinates.
+ */
+void IviWmController::set_surface_destination(uint32_t surface_id, const Rect &rect) {
+    stage(pending_surfaces_[surface_id].destination, surfaces_[surface_id].destination, rect);
+}
+
+void IviWmController::set_layer_visibility(uint32_t layer_id, bool visible) {
+    stage(pending_layers_[layer_id].visible, layers_[layer_id].visible, visible);
+}
+
+void IviWmController::set_layer_opacity(uint32_t layer_id, double opacity) {
+    stage(pending_layers_[layer_id].opacity, layers_[layer_id].opacity, wl_fixed_from_double(opacity));
+}
+
+void IviWmController::set_layer_source(uint32_t layer_id, const Rect &rect) {
+    stage(pending_layers_[layer_id].source, layers_[layer_id].source, rect);
+}
+
+/**
+ * @brief Places and scales the layer to rect, in screen coordinates.
+ */
+void IviWmController::set_layer_destination(uint32_t layer_id, const Rect &rect) {
+    stage(pending_layers_[layer_id].destination, layers_[layer_id].destination, rect);
+}
+
+/**
+ * @brief Sets the surfaces of a layer and their z-order, bottom first.
+ */
+void IviWmController::set_layer_surfaces(uint32_t layer_id, const std::vector<uint32_t> &surface_ids) {
+    stage(pending_layers_[layer_id].order, layers_[layer_id].order, surface_ids);
+}
+
+/**
+ * @brief Sets the layers shown on an output and their z-order, bottom first.
+ */
+void IviWmController::set_screen_layers(struct wl_output *output, const std::vector<uint32_t> &layer_ids) {
+    const auto it = screen_layers_.find(output);
+    if (it != screen_layers_.end() && it->second == layer_ids) {
+        pending_screens_.erase(output);
+    } else {
+        pending_screens_[output] = layer_ids;
+    }
+}
+
+/**
+ * @return true if commit() has anything to send.
+ */
+bool IviWmController::has_pending() const {
+    if (pending_structure_ || !pending_screens_.empty()) {
+        return true;
+    }
+    for (const auto *pending: {&pending_surfaces_, &pending_layers_}) {
+        for (const auto &[id, properties]: *pending) {
+            if (properties.visible || properties.opacity || properties.source || properties.destination ||
+                properties.order) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Sends the staged changes and applies them together with one commit_changes.
+ *
+ * Does nothing if nothing changed since the last commit.
+ *
+ * @return The number of property requests sent.
+ */
+size_t IviWmController::commit() {
+    size_t sent = 0;
+    // layers first, then what goes on them, so each request refers to its parent's new state
+    for (const auto &[id, pending]: pending_layers_) {
+        sent += flush_layer(id, pending);
+    }
+    for (const auto &[id, pending]: pending_surfaces_) {
+        sent += flush_surface(id, pending);
+    }
+    for (const auto &[output, layer_ids]: pending_screens_) {
+        auto *screen = get_screen(output);
+        ivi_wm_screen_clear(screen);
+        for (const auto layer_id: layer_ids) {
+            ivi_wm_screen_add_layer(screen, layer_id);
+        }
+        screen_layers_[output] = layer_ids;
+        sent += 1 + layer_ids.size();
+    }
+    pending_layers_.clear();
+    pending_surfaces_.clear();
+    pending_screens_.clear();
+
+    if (sent || pending_structure_) {
+        ivi_wm_commit_changes(ivi_wm_);
+        pending_structure_ = false;
+    }
+    return sent;
+}
+
+struct ivi_wm_screen *IviWmController::get_screen(struct wl_output *output) {
+    if (const auto it = screens_.find(output); it != screens_.end()) {
+        return it->second;
+    }
+    auto *screen = ivi_wm_create_screen(ivi_wm_, output);
+    ivi_wm_screen_add_listener(screen, &screen_listener_, this);
+    screens_[output] = screen;
+    return screen;
+}
+
+size_t IviWmController::flush_surface(uint32_t id, const Properties &pending) {
+    auto &applied = surfaces_[id];
+    size_t sent = 0;
+    if (pending.visible) {
+        ivi_wm_set_surface_visibility(ivi_wm_, id, *pending.visible);
+        applied.visible = pending.visible;
+        sent++;
+    }
+    if (pending.opacity) {
+        ivi_wm_set_surface_opacity(ivi_wm_, id, *pending.opacity);
+        applied.opacity = pending.opacity;
+        sent++;
+    }
+    if (pending.source) {
+        const auto &r = *pending.source;
+        ivi_wm_set_surface_source_rectangle(ivi_wm_, id, r.x, r.y, r.width, r.height);
+        applied.source = pending.source;
+        sent++;
+    }
+    if (pending.destination) {
+        const auto &r = *pending.destination;
+        ivi_wm_set_surface_destination_rectangle(ivi_wm_, id, r.x, r.y, r.width, r.height);
+        applied.destination = pending.destination;
+        sent++;
+    }
+    return sent;
+}
+
+size_t IviWmController::flush_layer(uint32_t id, const Properties &pending) {
+    auto &applied = layers_[id];
+    size_t sent = 0;
+    if (pending.visible) {
+        ivi_wm_set_layer_visibility(ivi_wm_, id, *pending.visible);
+        applied.visible = pending.visible;
+        sent++;
+    }
+    if (pending.opacity) {
+        ivi_wm_set_layer_opacity(ivi_wm_, id, *pending.opacity);
+        applied.opacity = pending.opacity;
+        sent++;
+    }
+    if (pending.source) {
+        const auto &r = *pending.source;
+        ivi_wm_set_layer_source_rectangle(ivi_wm_, id, r.x, r.y, r.width, r.height);
+        applied.source = pending.source;
+        sent++;
+    }
+    if (pending.destination) {
+        const auto &r = *pending.destination;
+        ivi_wm_set_layer_destination_rectangle(ivi_wm_, id, r.x, r.y, r.width, r.height);
+        applied.destination = pending.destination;
+        sent++;
+    }
+    if (pending.order) {
+        ivi_wm_layer_clear(ivi_wm_, id);
+        for (const auto surface_id: *pending.order) {
+            ivi_wm_layer_add_surface(ivi_wm_, id, surface_id);
+        }
+        applied.order = pending.order;
+        sent += 1 + pending.order->size();
+    }
+    return sent;
+}
+
+// reports only arrive for ids synced with ivi_wm_surface_sync or ivi_wm_layer_sync, which the controller never
+// requests; for those they correct the sent state, for the rest it is what this controller last sent
+
+void IviWmController::handle_surface_visibility(struct ivi_wm * /* wm */, uint32_t surface_id, int32_t visibility) {
+    surfaces_[surface_id].visible = visibility != 0;
+}
+
+void IviWmController::handle_layer_visibility(struct ivi_wm * /* wm */, uint32_t layer_id, int32_t visibility) {
+    layers_[layer_id].visible = visibility != 0;
+}
+
+void IviWmController::handle_surface_opacity(struct ivi_wm * /* wm */, uint32_t surface_id, wl_fixed_t opacity) {
+    surfaces_[surface_id].opacity = opacity;
+}
+
+void IviWmController::handle_layer_opacity(struct ivi_wm * /* wm */, uint32_t layer_id, wl_fixed_t opacity) {
+    layers_[layer_id].opacity = opacity;
+}
+
+void IviWmController::handle_surface_source_rectangle(struct ivi_wm * /* wm */, uint32_t surface_id,
+                                                      int32_t x, int32_t y, int32_t width, int32_t height) {
+    surfaces_[surface_id].source = Rect{x, y, width, height};
+}
+
+void IviWmController::handle_layer_source_rectangle(struct ivi_wm * /* wm */, uint32_t layer_id,
+                                                    int32_t x, int32_t y, int32_t width, int32_t height) {
+    layers_[layer_id].source = Rect{x, y, width, height};
+}
+
+void IviWmController::handle_surface_destination_rectangle(struct ivi_wm * /* wm */, uint32_t surface_id,
+                                                           int32_t x, int32_t y, int32_t width, int32_t height) {
+    surfaces_[surface_id].destination = Rect{x, y, width, height};
+}
+
+void IviWmController::handle_layer_destination_rectangle(struct ivi_wm * /* wm */, uint32_t layer_id,
+                                                         int32_t x, int32_t y, int32_t width, int32_t height) {
+    layers_[layer_id].destination = Rect{x, y, width, height};
+}
+
+void IviWmController::handle_surface_created(struct ivi_wm * /* wm */, uint32_t surface_id) {
+    if (surface_callback_) {
+        surface_callback_(surface_id, true);
+    }
+}
+
+void IviWmController::handle_layer_created(struct ivi_wm * /* wm */, uint32_t layer_id) {
+    LOG_DEBUG("IviWmController: layer %u created", layer_id);
+}
+
+void IviWmController::handle_surface_destroyed(struct ivi_wm * /* wm */, uint32_t surface_id) {
+    // a surface coming back under the same id starts from the compositor's defaults
+    surfaces_.erase(surface_id);
+    pending_surfaces_.erase(surface_id);
+    if (surface_callback_) {
+        surface_callback_(surface_id, false);
+    }
+}
+
+void IviWmController::handle_layer_destroyed(struct ivi_wm * /* wm */, uint32_t layer_id) {
+    layers_.erase(layer_id);
+    pending_layers_.erase(layer_id);
+}
+
+void IviWmController::handle_surface_error(struct ivi_wm * /* wm */, uint32_t object_id, uint32_t error,
+                                           const char *message) {
+    LOG_ERROR("IviWmController: surface %u error %u: %s", object_id, error, message);
+}
+
+void IviWmController::handle_layer_error(struct ivi_wm * /* wm */, uint32_t object_id, uint32_t error,
+                                         const char *message) {
+    LOG_ERROR("IviWmController: layer %u error %u: %s", object_id, error, message);
+}
+
+void IviWmController::handle_surface_size(struct ivi_wm * /* wm */, uint32_t /* surface_id */,
+                                          int32_t /* width */, int32_t /* height */) {
+}
+
+void IviWmController::handle_surface_stats(struct ivi_wm * /* wm */, uint32_t /* surface_id */,
+                                           uint32_t /* frame_count */, uint32_t /* pid */) {
+}
+
+void IviWmController::handle_layer_surface_added(struct ivi_wm * /* wm */, uint32_t /* layer_id */,
+                                                 uint32_t /* surface_id */) {
+}
+
+const struct ivi_wm_listener IviWmController::listener_ = {
+        .surface_visibility = listener_thunk<&IviWmController::handle_surface_visibility>,
+        .layer_visibility = listener_thunk<&IviWmController::handle_layer_visibility>,
+        .surface_opacity = listener_thunk<&IviWmController::handle_surface_opacity>,
+        .layer_opacity = listener_thunk<&IviWmController::handle_layer_opacity>,
+        .surface_source_rectangle = listener_thunk<&IviWmController::handle_surface_source_rectangle>,
+        .layer_source_rectangle = listener_thunk<&IviWmController::handle_layer_source_rectangle>,
+        .surface_destination_rectangle = listener_thunk<&IviWmController::handle_surface_destination_rectangle>,
+        .layer_destination_rectangle = listener_thunk<&IviWmController::handle_layer_destination_rectangle>,
+        .surface_created = listener_thunk<&IviWmController::handle_surface_created>,
+        .layer_created = listener_thunk<&IviWmController::handle_layer_created>,
+        .surface_destroyed = listener_thunk<&IviWmController::handle_surface_destroyed>,
+        .layer_destroyed = listener_thunk<&IviWmController::handle_layer_destroyed>,
+        .surface_error = listener_thunk<&IviWmController::handle_surface_error>,
+        .layer_error = listener_thunk<&IviWmController::handle_layer_error>,
+        .surface_size = listener_thunk<&IviWmController::handle_surface_size>,
+        .surface_stats = listener_thunk<&IviWmController::handle_surface_stats>,
+        .layer_surface_added = listener_thunk<&IviWmController::handle_layer_surface_added>,
+};
+
+void IviWmController::handle_screen_id(struct ivi_wm_screen * /* screen */, uint32_t id) {
+    LOG_DEBUG("IviWmController: screen %u", id);
+}
+
+void IviWmController::handle_screen_layer_added(struct ivi_wm_screen * /* screen */, uint32_t /* layer_id */) {
+}
+
+void IviWmController::handle_screen_connector_name(struct ivi_wm_screen * /* screen */, const char *name) {
+    LOG_DEBUG("IviWmController: screen on %s", name);
+}
+
+void IviWmController::handle_screen_error(struct ivi_wm_screen * /* screen */, uint32_t error, const char *message) {
+    LOG_ERROR("IviWmController: screen error %u: %s", error, message);
+}
+
+const struct ivi_wm_screen_listener IviWmController::screen_listener_ = {
+        .screen_id = listener_thunk<&IviWmController::handle_screen_id>,
+        .layer_added = listener_thunk<&IviWmController::handle_screen_layer_added>,
+        .connector_name = listener_thunk<&IviWmController::handle_screen_connector_name>,
+        .error = listener_thunk<&IviWmController::handle_screen_error>,
+};
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_MANAGER_IVI_WM_CONTROLLER_H_
+#define SRC_WINDOW_MANAGER_IVI_WM_CONTROLLER_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <optional>
+#include <vector>
+
+#include "ivi-wm-client-protocol.h"
+#include "utils/export.h"
+
+class Display;
+
+class WAYPP_EXPORT IviWmController {
+public:
+    // a source or destination rectangle
+    struct Rect {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+
+        bool operator==(const Rect &other) const {
+            return x == other.x && y == other.y && width == other.width && height == other.height;
+        }
+    };
+
+    explicit IviWmController(const Display *display);
+
+    ~IviWmController();
+
+    IviWmController(const IviWmController &) = delete;
+
+    IviWmController &operator=(const IviWmController &) = delete;
+
+    void create_layer(uint32_t layer_id, int32_t width, int32_t height);
+
+    void destroy_layer(uint32_t layer_id);
+
+    void set_surface_visibility(uint32_t surface_id, bool visible);
+
+    void set_surface_opacity(uint32_t surface_id, double opacity);
+
+    void set_surface_source(uint32_t surface_id, const Rect &rect);
+
+    void set_surface_destination(uint32_t surface_id, const Rect &rect);
+
+    void set_layer_visibility(uint32_t layer_id, bool visible);
+
+    void set_layer_opacity(uint32_t layer_id, double opacity);
+
+    void set_layer_source(uint32_t layer_id, const Rect &rect);
+
+    void set_layer_destination(uint32_t layer_id, const Rect &rect);
+
+    void set_layer_surfaces(uint32_t layer_id, const std::vector<uint32_t> &surface_ids);
+
+    void set_screen_layers(struct wl_output *output, const std::vector<uint32_t> &layer_ids);
+
+    [[nodiscard]] bool has_pending() const;
+
+    size_t commit();
+
+    // surfaces appearing and going away, e.g. to place an app as soon as it starts
+    void set_surface_callback(const std::function<void(uint32_t surface_id, bool created)> &callback) {
+        surface_callback_ = callback;
+    }
+
+private:
+    struct Properties {
+        std::optional<bool> visible;
+        std::optional<wl_fixed_t> opacity;
+        std::optional<Rect> source;
+        std::optional<Rect> destination;
+        // z-order of the children, bottom first
+        std::optional<std::vector<uint32_t>> order;
+    };
+
+    struct ivi_wm *ivi_wm_{};
+    std::map<struct wl_output *, struct ivi_wm_screen *> screens_;
+
+    // staged since the last commit, and as last sent, by id
+    std::map<uint32_t, Properties> pending_surfaces_;
+    std::map<uint32_t, Properties> pending_layers_;
+    std::map<struct wl_output *, std::vector<uint32_t>> pending_screens_;
+    std::map<uint32_t, Properties> surfaces_;
+    std::map<uint32_t, Properties> layers_;
+    std::map<struct wl_output *, std::vector<uint32_t>> screen_layers_;
+    bool pending_structure_{};
+
+    std::function<void(uint32_t surface_id, bool created)> surface_callback_;
+
+    struct ivi_wm_screen *get_screen(struct wl_output *output);
+
+    template<typename T>
+    static void stage(std::optional<T> &pending, const std::optional<T> &applied, const T &value) {
+        pending = applied == value ? std::nullopt : std::optional<T>(value);
+    }
+
+    size_t flush_surface(uint32_t id, const Properties &pending);
+
+    size_t flush_layer(uint32_t id, const Properties &pending);
+
+    void handle_surface_visibility(struct ivi_wm *wm, uint32_t surface_id, int32_t visibility);
+
+    void handle_layer_visibility(struct ivi_wm *wm, uint32_t layer_id, int32_t visibility);
+
+    void handle_surface_opacity(struct ivi_wm *wm, uint32_t surface_id, wl_fixed_t opacity);
+
+    void handle_layer_opacity(struct ivi_wm *wm, uint32_t layer_id, wl_fixed_t opacity);
+
+    void handle_surface_source_rectangle(struct ivi_wm *wm, uint32_t surface_id,
+                                         int32_t x, int32_t y, int32_t width, int32_t height);
+
+    void handle_layer_source_rectangle(struct ivi_wm *wm, uint32_t layer_id,
+                                       int32_t x, int32_t y, int32_t width, int32_t height);
+
+    void handle_surface_destination_rectangle(struct ivi_wm *wm, uint32_t surface_id,
+                                              int32_t x, int32_t y, int32_t width, int32_t height);
+
+    void handle_layer_destination_rectangle(struct ivi_wm *wm, uint32_t layer_id,
+                                            int32_t x, int32_t y, int32_t width, int32_t height);
+
+    void handle_surface_created(struct ivi_wm *wm, uint32_t surface_id);
+
+    void handle_layer_created(struct ivi_wm *wm, uint32_t layer_id);
+
+    void handle_surface_destroyed(struct ivi_wm *wm, uint32_t surface_id);
+
+    void handle_layer_destroyed(struct ivi_wm *wm, uint32_t layer_id);
+
+    void handle_surface_error(struct ivi_wm *wm, uint32_t object_id, uint32_t error, const char *message);
+
+    void handle_layer_error(struct ivi_wm *wm, uint32_t object_id, uint32_t error, const char *message);
+
+    void handle_surface_size(struct ivi_wm *wm, uint32_t surface_id, int32_t width, int32_t height);
+
+    void handle_surface_stats(struct ivi_wm *wm, uint32_t surface_id, uint32_t frame_count, uint32_t pid);
+
+    void handle_layer_surface_added(struct ivi_wm *wm, uint32_t layer_id, uint32_t surface_id);
+
+    static const struct ivi_wm_listener listener_;
+
+    void handle_screen_id(struct ivi_wm_screen *screen, uint32_t id);
+
+    void handle_screen_layer_added(struct ivi_wm_screen *screen, uint32_t layer_id);
+
+    void handle_screen_connector_name(struct ivi_wm_screen *screen, const char *name);
+
+    void handle_screen_error(struct ivi_wm_screen *screen, uint32_t error, const char *message);
+
+    static const struct ivi_wm_screen_listener screen_listener_;
+};
+
+#endif // SRC_WINDOW_MANAGER_IVI_WM_CONTROLLER_H_
@@ -0,0 +1,152 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "metrics_export.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "utils/logging.h"
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "the sequence is shared with other processes");
+
+namespace {
+uint64_t now_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void copy_percentiles(uint64_t (&dst)[3], const FrameStats::Percentiles &src) {
+    dst[0] = src.p50_ns;
+    dst[1] = src.p95_ns;
+    dst[2] = src.p99_ns;
+}
+}
+
+/**
+ * @brief Creates and maps the segment.
+ *
+ * @param name A shm_open() name such as "/waypp-metrics-1234", replaced if it exists and
+ * unlinked again on destruction. nullptr creates an anonymous memfd instead; a monitor
+ * finds it through get_fd() or /proc/<pid>/fd.
+ */
+MetricsExport::MetricsExport(const char *name) {
+    if (name) {
+        name_ = name;
+        fd_ = shm_open(name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    } else {
+        fd_ = memfd_create("waypp-metrics", MFD_CLOEXEC);
+    }
+    if (fd_ < 0) {
+        throw std::runtime_error(std::string("MetricsExport: failed to create the segment: ") + strerror(errno));
+    }
+    void *base = MAP_FAILED;
+    if (ftruncate(fd_, sizeof(Segment)) == 0) {
+        base = mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    }
+    if (base == MAP_FAILED) {
+        const int error = errno;
+        close(fd_);
+        if (!name_.empty()) {
+            shm_unlink(name_.c_str());
+        }
+        throw std::runtime_error(std::string("MetricsExport: failed to map the segment: ") + strerror(error));
+    }
+    // the fresh mapping is zero filled, the sequence starts even
+    segment_ = static_cast<Segment *>(base);
+    auto &header = segment_->header;
+    header.version = kVersion;
+    header.size = sizeof(Segment);
+    header.window_capacity = kMaxWindows;
+    header.pid = static_cast<uint32_t>(getpid());
+    // readers treat the segment as valid once the magic is set
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header.magic, "WPMX", 4);
+    LOG_DEBUG("MetricsExport: %zu bytes, %s", sizeof(Segment), name_.empty() ? "memfd" : name_.c_str());
+}
+
+MetricsExport::~MetricsExport() {
+    munmap(segment_, sizeof(Segment));
+    close(fd_);
+    if (!name_.empty()) {
+        shm_unlink(name_.c_str());
+    }
+}
+
+/**
+ * @brief Marks the segment as being updated.
+ *
+ * @return false if another thread is in the middle of an update; that one publishes
+ * recent enough values, so the caller skips its own.
+ */
+bool MetricsExport::begin() {
+    if (writing_.exchange(true, std::memory_order_acquire)) {
+        return false;
+    }
+    auto &sequence = segment_->header.sequence;
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    // the odd sequence is visible before any of the field writes
+    std::atomic_thread_fence(std::memory_order_release);
+    windows_ = 0;
+    return true;
+}
+
+/**
+ * @brief Finishes the update begin() started, clearing the window slots it did not fill.
+ */
+void MetricsExport::end() {
+    for (auto i = windows_; i < segment_->windows; i++) {
+        segment_->window[i].surface_id = 0;
+    }
+    segment_->windows = windows_;
+    segment_->header.update_ns = now_ns();
+    segment_->header.updates++;
+    auto &sequence = segment_->header.sequence;
+    sequence.store(sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    writing_.store(false, std::memory_order_release);
+}
+
+bool MetricsExport::add_window(uint32_t surface_id, const FrameStats &stats) {
+    if (windows_ >= kMaxWindows) {
+        return false;
+    }
+    const auto snapshot = stats.get_snapshot();
+    auto &window = segment_->window[windows_++];
+    window.surface_id = surface_id;
+    window.frames = snapshot.frames;
+    window.fps_milli = static_cast<uint64_t>(std::lround(snapshot.fps * 1000.0));
+    copy_percentiles(window.frame_time_ns, snapshot.frame_time);
+    copy_percentiles(window.render_time_ns, snapshot.render_time);
+    copy_percentiles(window.latency_ns, snapshot.latency);
+    copy_percentiles(window.input_latency_ns, snapshot.input_latency);
+    window.inputs = snapshot.inputs;
+    window.missed_vblanks = snapshot.missed_vblanks;
+    window.discarded = snapshot.discarded;
+    window.input_bucket_width_ns = FrameStats::kInputBucketWidthNs;
+    std::array<uint32_t, kHistogramBuckets> buckets{};
+    stats.get_input_latency_histogram(buckets);
+    memcpy(window.input_latency_histogram, buckets.data(), sizeof(window.input_latency_histogram));
+    return true;
+}
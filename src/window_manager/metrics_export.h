@@ -0,0 +1,146 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_METRICS_EXPORT_H_
+#define SRC_WINDOW_MANAGER_METRICS_EXPORT_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "utils/export.h"
+#include "window/frame_stats.h"
+
+/**
+ * @brief Publishes the client's metrics into a shared memory segment for an external monitor.
+ *
+ * The segment is a fixed layout: a Header, the event loop and protocol totals, and one
+ * WindowMetrics slot per window. A monitoring daemon maps it read-only (a named segment
+ * from /dev/shm, or a memfd through /proc/<pid>/fd) and reads it at any time, without
+ * IPC or anything from the client but the writes it does anyway.
+ *
+ * There is one writer. Readers never block it, consistency comes from a sequence lock:
+ * @code
+ *   do {
+ *       seq = header->sequence;            // acquire
+ *       if (seq & 1) continue;             // update in progress
+ *       copy the fields;
+ *       acquire fence;
+ *   } while (header->sequence != seq);
+ * @endcode
+ * Readers check magic and version first, and use window_capacity and size rather than
+ * the constants they were built with.
+ */
+class WAYPP_EXPORT MetricsExport {
+public:
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kMaxWindows = 16;
+    static constexpr size_t kHistogramBuckets = FrameStats::kBucketCount;
+
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        // bytes of the whole segment
+        uint32_t size;
+        uint32_t window_capacity;
+        // odd while an update is in progress
+        std::atomic<uint32_t> sequence;
+        uint32_t pid;
+        // CLOCK_MONOTONIC of the last update
+        uint64_t update_ns;
+        uint64_t updates;
+    };
+
+    struct LoopMetrics {
+        uint64_t wakeups;
+        // wakeups that dispatched nothing
+        uint64_t idle_wakeups;
+        uint64_t flushes;
+        // flushes that left requests behind because the socket was full
+        uint64_t blocked_flushes;
+    };
+
+    struct ProtocolMetrics {
+        uint64_t requests;
+        uint64_t events;
+        uint64_t bytes_sent;
+        uint64_t bytes_received;
+    };
+
+    struct WindowMetrics {
+        // 0 for an unused slot
+        uint32_t surface_id;
+        uint32_t reserved;
+        uint64_t frames;
+        // in thousandths of a frame per second
+        uint64_t fps_milli;
+        uint64_t frame_time_ns[3];
+        uint64_t render_time_ns[3];
+        uint64_t latency_ns[3];
+        uint64_t input_latency_ns[3];
+        uint64_t inputs;
+        uint64_t missed_vblanks;
+        uint64_t discarded;
+        // samples per FrameStats::kInputBucketWidthNs, the last bucket collects everything slower
+        uint64_t input_bucket_width_ns;
+        uint32_t input_latency_histogram[kHistogramBuckets];
+    };
+
+    struct Segment {
+        Header header;
+        LoopMetrics loop;
+        ProtocolMetrics protocol;
+        uint32_t windows;
+        uint32_t reserved;
+        WindowMetrics window[kMaxWindows];
+    };
+
+    explicit MetricsExport(const char *name = nullptr);
+
+    ~MetricsExport();
+
+    MetricsExport(const MetricsExport &) = delete;
+
+    MetricsExport &operator=(const MetricsExport &) = delete;
+
+    // starts an update, the calls between begin() and end() must come from one thread
+    [[nodiscard]] bool begin();
+
+    void end();
+
+    void set_loop(const LoopMetrics &loop) { segment_->loop = loop; }
+
+    void set_protocol(const ProtocolMetrics &protocol) { segment_->protocol = protocol; }
+
+    // fills the next window slot, returns false once all kMaxWindows are used
+    bool add_window(uint32_t surface_id, const FrameStats &stats);
+
+    [[nodiscard]] int get_fd() const { return fd_; }
+
+    // the shm_open() name, empty for an anonymous memfd
+    [[nodiscard]] const std::string &get_name() const { return name_; }
+
+private:
+    int fd_{-1};
+    std::string name_;
+    Segment *segment_{};
+    uint32_t windows_{};
+    std::atomic<bool> writing_{};
+};
+
+#endif // SRC_WINDOW_MANAGER_METRICS_EXPORT_H_
@@ -19,6 +19,9 @@
 #include <wayland-client-protocol.h>
 
 #include <cassert>
+#include <utility>
+
+#include "utils/logging.h"
 
 /**
  * @class Output
@@ -27,6 +30,11 @@
  * This class manages the state and listeners for a Wayland output, providing
  * access to the output's properties such as geometry and mode. It also handles
  * the events emitted by the output.
+ *
+ * From version 2 the state is double-buffered like the protocol's: geometry, mode,
+ * scale, name and description are collected until done and then applied together,
+ * so a mode switch or hotplug is seen as one consistent change, reported to the
+ * change callback with the Change bits that differ.
  */
 Output::Output(struct wl_output *output, uint32_t version) : version_(
         version), wl_output_(output) {
@@ -40,8 +48,80 @@ Output::Output(struct wl_output *output, uint32_t version) : version_(
  * The Output class provides methods to manage Wayland outputs, such as releasing and destroying the output.
  */
 Output::~Output() {
-    wl_output_release(wl_output_);
-    wl_output_destroy(wl_output_);
+#if defined(ENABLE_OUTPUT_POWER)
+    if (output_power_) {
+        zwlr_output_power_v1_destroy(output_power_);
+    }
+#endif
+    if (xdg_output_) {
+        zxdg_output_v1_destroy(xdg_output_);
+    }
+    if (version_ >= WL_OUTPUT_RELEASE_SINCE_VERSION) {
+        wl_output_release(wl_output_);
+    } else {
+        wl_output_destroy(wl_output_);
+    }
+}
+
+/**
+ * @brief Makes the state received since the last done current.
+ *
+ * Fields that were not resent keep their values. The change callback only sees
+ * the fields whose values differ, or, on the first done, everything received.
+ */
+void Output::apply_pending() {
+    uint32_t changes = 0;
+    if (pending_changes_ & GEOMETRY) {
+        const auto &a = pending_.geometry;
+        const auto &b = current_.geometry;
+        if (a.x != b.x || a.y != b.y || a.physical_width != b.physical_width ||
+            a.physical_height != b.physical_height || a.subpixel != b.subpixel || a.transform != b.transform ||
+            pending_.make != current_.make || pending_.model != current_.model) {
+            changes |= GEOMETRY;
+        }
+        current_.geometry = pending_.geometry;
+        current_.make = pending_.make;
+        current_.model = pending_.model;
+        current_.geometry.make = current_.make.c_str();
+        current_.geometry.model = current_.model.c_str();
+    }
+    if (pending_changes_ & MODE) {
+        const auto &a = pending_.mode;
+        const auto &b = current_.mode;
+        if (a.flags != b.flags || a.width != b.width || a.height != b.height || a.refresh != b.refresh) {
+            changes |= MODE;
+        }
+        current_.mode = pending_.mode;
+        frame_clock_.set_nominal_refresh(current_.mode.refresh);
+    }
+    if ((pending_changes_ & SCALE) && pending_.scale != current_.scale) {
+        changes |= SCALE;
+        current_.scale = pending_.scale;
+    }
+    if ((pending_changes_ & NAME) && pending_.name != current_.name) {
+        changes |= NAME;
+        current_.name = pending_.name;
+    }
+    if ((pending_changes_ & DESCRIPTION) && pending_.description != current_.description) {
+        changes |= DESCRIPTION;
+        current_.description = pending_.description;
+    }
+    if (pending_changes_ & LOGICAL) {
+        const auto &a = pending_.logical;
+        const auto &b = current_.logical;
+        if (!b || a->x != b->x || a->y != b->y || a->width != b->width || a->height != b->height) {
+            changes |= LOGICAL;
+        }
+        current_.logical = pending_.logical;
+    }
+    if (!done_) {
+        changes = pending_changes_;
+        done_ = true;
+    }
+    pending_changes_ = 0;
+    if (changes && change_callback_) {
+        change_callback_(*this, changes);
+    }
 }
 
 /**
@@ -49,7 +129,7 @@ Output::~Output() {
  *
  * This function is called when the wl_output interface emits the
  * geometry event, indicating changes in the output's position, size,
- * and physical properties.
+ * and physical properties. The values are staged until done.
  *
  * @param data              Pointer to the Output object.
  * @param wl_output         The wl_output object.
@@ -74,29 +154,30 @@ void Output::handle_geometry(void *data,
                              int transform) {
     const auto obj = static_cast<Output *>(data);
     assert(obj->wl_output_ == wl_output);
-    obj->output_ = {
-            .geometry = {
-                    .x = x,
-                    .y = y,
-                    .physical_width = physical_width,
-                    .physical_height = physical_height,
-                    .subpixel = subpixel,
-                    .make = make,
-                    .model = model,
-                    .transform = transform
-            },
-            .mode = {},
-            .done{},
-            .name{},
-            .description{},
+    // make and model are only valid during the event, geometry.make and .model point to copies
+    obj->pending_.make = make ? make : "";
+    obj->pending_.model = model ? model : "";
+    obj->pending_.geometry = {
+            .x = x,
+            .y = y,
+            .physical_width = physical_width,
+            .physical_height = physical_height,
+            .subpixel = subpixel,
+            .make = nullptr,
+            .model = nullptr,
+            .transform = transform
     };
+    obj->pending_changes_ |= GEOMETRY;
+    if (obj->version_ < WL_OUTPUT_DONE_SINCE_VERSION) {
+        obj->apply_pending();
+    }
 }
 
 /**
 * @brief This function is responsible for handling the mode of the output.
 *
-* The handle_mode function is called when the mode of the output is updated. It sets the mode of the output
-* structure to the provided values.
+* The handle_mode function is called when the mode of the output is updated. It stages the current mode
+* until done.
 *
 * @param data A pointer to the instance of the Output class.
 * @param wl_output A pointer to the wl_output structure.
@@ -113,18 +194,27 @@ void Output::handle_mode(void *data,
                          int refresh) {
     const auto obj = static_cast<Output *>(data);
     assert(obj->wl_output_ == wl_output);
-    obj->output_.mode = {
+    // older compositors list every mode, only the current one is of interest
+    if (!(flags & WL_OUTPUT_MODE_CURRENT)) {
+        return;
+    }
+    obj->pending_.mode = {
             .flags = flags,
             .width = width,
             .height = height,
             .refresh = refresh,
     };
+    obj->pending_changes_ |= MODE;
+    if (obj->version_ < WL_OUTPUT_DONE_SINCE_VERSION) {
+        obj->apply_pending();
+    }
 }
 
 /**
  * @brief Handle the completion of an output event.
  *
  * This function is a callback that is invoked when an output event is completed.
+ * It applies the staged state and reports what changed.
  *
  * @param data A pointer to the associated Output object.
  * @param wl_output The Wayland output object.
@@ -132,14 +222,14 @@ void Output::handle_mode(void *data,
 void Output::handle_done(void *data, struct wl_output *wl_output) {
     const auto obj = static_cast<Output *>(data);
     assert(obj->wl_output_ == wl_output);
-    obj->output_.done = true;
+    obj->apply_pending();
 }
 
 /**
  * @brief Callback function for handling output scale change.
  *
  * This function is called when the scale of the output is changed.
- * It updates the scale value of the Output object.
+ * It stages the scale value of the Output object until done.
  *
  * @param data The user data associated with the Output object.
  * @param wl_output The wl_output object associated with the event.
@@ -150,7 +240,8 @@ void Output::handle_scale(void *data,
                           int scale) {
     const auto obj = static_cast<Output *>(data);
     assert(obj->wl_output_ == wl_output);
-    obj->output_.scale = scale;
+    obj->pending_.scale = scale;
+    obj->pending_changes_ |= SCALE;
 }
 
 /**
@@ -167,14 +258,15 @@ void Output::handle_name(void *data,
                          const char *name) {
     const auto obj = static_cast<Output *>(data);
     assert(obj->wl_output_ == wl_output);
-    obj->output_.name = name;
+    obj->pending_.name = name;
+    obj->pending_changes_ |= NAME;
 }
 
 /**
  * @brief Handles the description of an output.
  *
- * This function is invoked when a description is received for a specific output. It updates the description in the
- * `output_` member of the `Output` object.
+ * This function is invoked when a description is received for a specific output. It stages the description
+ * until done.
  *
  * @param data      A pointer to the `Output` object.
  * @param wl_output A pointer to the `wl_output` object.
@@ -185,7 +277,100 @@ void Output::handle_description(void *data,
                                 const char *description) {
     const auto obj = static_cast<Output *>(data);
     assert(obj->wl_output_ == wl_output);
-    obj->output_.description = description;
+    obj->pending_.description = description;
+    obj->pending_changes_ |= DESCRIPTION;
+}
+
+/**
+ * @brief Adds the logical position and size of the output, see get_logical().
+ *
+ * From zxdg_output_v1 version 3 they are applied together with the rest of the
+ * state on wl_output.done.
+ *
+ * @param manager The compositor's zxdg_output_manager_v1.
+ */
+void Output::set_xdg_output_manager(struct zxdg_output_manager_v1 *manager) {
+    if (xdg_output_ || !manager) {
+        return;
+    }
+    xdg_output_ = zxdg_output_manager_v1_get_xdg_output(manager, wl_output_);
+    zxdg_output_v1_add_listener(xdg_output_, &xdg_output_listener_, this);
+}
+
+/**
+ * @brief Follows the output's power mode, e.g. a display blanked at night.
+ *
+ * The compositor sends the current mode right away and every change after; each one
+ * that differs reaches the change callback as POWER. The output is only watched, its
+ * mode is never set.
+ *
+ * @param manager The zwlr_output_power_manager_v1 global, nullptr leaves the output powered;
+ *                as does a build without ENABLE_OUTPUT_POWER.
+ */
+void Output::set_power_manager(struct zwlr_output_power_manager_v1 *manager) {
+#if defined(ENABLE_OUTPUT_POWER)
+    if (output_power_ || !manager) {
+        return;
+    }
+    output_power_ = zwlr_output_power_manager_v1_get_output_power(manager, wl_output_);
+    zwlr_output_power_v1_add_listener(output_power_, &power_listener_, this);
+#else
+    (void) manager;
+#endif
+}
+
+#if defined(ENABLE_OUTPUT_POWER)
+
+void Output::handle_power_mode(void *data, struct zwlr_output_power_v1 * /* output_power */, uint32_t mode) {
+    const auto obj = static_cast<Output *>(data);
+    const bool powered = mode != ZWLR_OUTPUT_POWER_V1_MODE_OFF;
+    if (powered == obj->powered_) {
+        return;
+    }
+    obj->powered_ = powered;
+    LOG_DEBUG("Output %s powered %s", obj->current_.name.c_str(), powered ? "on" : "off");
+    if (obj->change_callback_) {
+        obj->change_callback_(*obj, POWER);
+    }
+}
+
+/**
+ * @brief The mode can no longer be followed, e.g. no power management; assumed on from then on.
+ */
+void Output::handle_power_failed(void *data, struct zwlr_output_power_v1 * /* output_power */) {
+    const auto obj = static_cast<Output *>(data);
+    zwlr_output_power_v1_destroy(obj->output_power_);
+    obj->output_power_ = nullptr;
+    handle_power_mode(data, nullptr, ZWLR_OUTPUT_POWER_V1_MODE_ON);
+}
+
+const struct zwlr_output_power_v1_listener Output::power_listener_ = {
+        .mode = handle_power_mode,
+        .failed = handle_power_failed,
+};
+#endif
+
+/**
+ * @brief The area the output covers in the compositor's scaled coordinate space.
+ *
+ * This is what a fullscreen surface on the output is sized to. Without
+ * zxdg_output_v1 it is derived from the current mode, the transform and the
+ * integer scale, which is wrong for fractionally scaled outputs.
+ *
+ * @return The logical position and size.
+ */
+struct Output::logical Output::get_logical() const {
+    if (current_.logical) {
+        return *current_.logical;
+    }
+    const int scale = get_scale();
+    int width = current_.mode.width / scale;
+    int height = current_.mode.height / scale;
+    // 90, 270 and their flipped variants are odd
+    if (current_.geometry.transform & 1) {
+        std::swap(width, height);
+    }
+    return {.x = current_.geometry.x, .y = current_.geometry.y, .width = width, .height = height};
 }
 
 const struct wl_output_listener Output::listener_ = {
@@ -196,3 +381,103 @@ const struct wl_output_listener Output::listener_ = {
         .name = handle_name,
         .description = handle_description,
 };
+
+/**
+ * @brief Stages the logical position of the output until done.
+ *
+ * @param data       A pointer to the Output object.
+ * @param xdg_output The zxdg_output_v1 of the output.
+ * @param x          The x position in the global compositor space.
+ * @param y          The y position in the global compositor space.
+ */
+void Output::handle_logical_position(void *data,
+                                     struct zxdg_output_v1 *xdg_output,
+                                     int x,
+                                     int y) {
+    const auto obj = static_cast<Output *>(data);
+    assert(obj->xdg_output_ == xdg_output);
+    if (!obj->pending_.logical) {
+        obj->pending_.logical = obj->current_.logical.value_or(logical{});
+    }
+    obj->pending_.logical->x = x;
+    obj->pending_.logical->y = y;
+    obj->pending_changes_ |= LOGICAL;
+}
+
+/**
+ * @brief Stages the logical size of the output until done.
+ *
+ * @param data       A pointer to the Output object.
+ * @param xdg_output The zxdg_output_v1 of the output.
+ * @param width      The width in the global compositor space.
+ * @param height     The height in the global compositor space.
+ */
+void Output::handle_logical_size(void *data,
+                                 struct zxdg_output_v1 *xdg_output,
+                                 int width,
+                                 int height) {
+    const auto obj = static_cast<Output *>(data);
+    assert(obj->xdg_output_ == xdg_output);
+    if (!obj->pending_.logical) {
+        obj->pending_.logical = obj->current_.logical.value_or(logical{});
+    }
+    obj->pending_.logical->width = width;
+    obj->pending_.logical->height = height;
+    obj->pending_changes_ |= LOGICAL;
+}
+
+/**
+ * @brief Applies the staged state, sent by zxdg_output_v1 before version 3 only.
+ *
+ * @param data       A pointer to the Output object.
+ * @param xdg_output The zxdg_output_v1 of the output.
+ */
+void Output::handle_xdg_done(void *data, struct zxdg_output_v1 *xdg_output) {
+    const auto obj = static_cast<Output *>(data);
+    assert(obj->xdg_output_ == xdg_output);
+    obj->apply_pending();
+}
+
+/**
+ * @brief Stages the name of the output, unless wl_output v4 sends it.
+ *
+ * @param data       A pointer to the Output object.
+ * @param xdg_output The zxdg_output_v1 of the output.
+ * @param name       The name of the output.
+ */
+void Output::handle_xdg_name(void *data,
+                             struct zxdg_output_v1 *xdg_output,
+                             const char *name) {
+    const auto obj = static_cast<Output *>(data);
+    assert(obj->xdg_output_ == xdg_output);
+    if (obj->version_ < WL_OUTPUT_NAME_SINCE_VERSION) {
+        obj->pending_.name = name;
+        obj->pending_changes_ |= NAME;
+    }
+}
+
+/**
+ * @brief Stages the description of the output, unless wl_output v4 sends it.
+ *
+ * @param data        A pointer to the Output object.
+ * @param xdg_output  The zxdg_output_v1 of the output.
+ * @param description The description of the output.
+ */
+void Output::handle_xdg_description(void *data,
+                                    struct zxdg_output_v1 *xdg_output,
+                                    const char *description) {
+    const auto obj = static_cast<Output *>(data);
+    assert(obj->xdg_output_ == xdg_output);
+    if (obj->version_ < WL_OUTPUT_DESCRIPTION_SINCE_VERSION) {
+        obj->pending_.description = description;
+        obj->pending_changes_ |= DESCRIPTION;
+    }
+}
+
+const struct zxdg_output_v1_listener Output::xdg_output_listener_ = {
+        .logical_position = handle_logical_position,
+        .logical_size = handle_logical_size,
+        .done = handle_xdg_done,
+        .name = handle_xdg_name,
+        .description = handle_xdg_description,
+};
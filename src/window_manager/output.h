@@ -18,14 +18,22 @@
 #define SRC_OUTPUT_H_
 
 #include <cstdint>
+#include <functional>
 #include <memory>
 #include <optional>
 #include <string>
 
 #include <wayland-client.h>
 
+#include "xdg-output-unstable-v1-client-protocol.h"
+#if defined(ENABLE_OUTPUT_POWER)
+#include "wlr-output-power-management-unstable-v1-client-protocol.h"
+#endif
 
-class Output {
+#include "window/frame_clock.h"
+#include "utils/export.h"
+
+class WAYPP_EXPORT Output {
 public:
     struct geometry {
         int x;
@@ -45,28 +53,100 @@ public:
         int refresh;
     };
 
+    // position and size in the compositor's global, scaled coordinate space
+    struct logical {
+        int x;
+        int y;
+        int width;
+        int height;
+    };
+
+    // the parts of the state a done changed
+    typedef enum {
+        GEOMETRY = 1 << 0,
+        MODE = 1 << 1,
+        SCALE = 1 << 2,
+        NAME = 1 << 3,
+        DESCRIPTION = 1 << 4,
+        LOGICAL = 1 << 5,
+        // zwlr_output_power_v1, reported on its own rather than with a done
+        POWER = 1 << 6,
+    } Change;
+
     Output(struct wl_output *output, uint32_t version);
 
     ~Output();
 
-    [[nodiscard]] const struct geometry &get_geometry() const { return output_.geometry; }
+    Output(const Output &) = delete;
+
+    Output &operator=(const Output &) = delete;
 
-    [[nodiscard]] const struct mode &get_mode() const { return output_.mode; }
+    [[nodiscard]] const struct geometry &get_geometry() const { return current_.geometry; }
+
+    [[nodiscard]] const struct mode &get_mode() const { return current_.mode; }
 
     [[nodiscard]] uint32_t get_version() const { return version_; }
 
+    [[nodiscard]] int get_scale() const { return current_.scale.value_or(1); }
+
+    [[nodiscard]] struct logical get_logical() const;
+
+    void set_xdg_output_manager(struct zxdg_output_manager_v1 *manager);
+
+    void set_power_manager(struct zwlr_output_power_manager_v1 *manager);
+
+    // false while the compositor has the output powered off, true without zwlr_output_power_manager_v1
+    [[nodiscard]] bool is_powered() const { return powered_; }
+
+    [[nodiscard]] const std::string &get_name() const { return current_.name; }
+
+    [[nodiscard]] const std::string &get_description() const { return current_.description; }
+
+    // the first done was received
+    [[nodiscard]] bool is_done() const { return done_; }
+
+    [[nodiscard]] struct wl_output *get_output() const { return wl_output_; }
+
+    // vblank timing observed on this output, see Window::set_frame_clock()
+    [[nodiscard]] const FrameClock &get_frame_clock() const { return frame_clock_; }
+
+    [[nodiscard]] FrameClock &get_frame_clock() { return frame_clock_; }
+
+    void set_change_callback(const std::function<void(const Output &output, uint32_t changes)> &callback) {
+        change_callback_ = callback;
+    }
+
 private:
-    struct {
+    struct State {
         struct geometry geometry;
+        // geometry.make and geometry.model point into these
+        std::string make;
+        std::string model;
         struct mode mode;
-        bool done;
         std::optional<int> scale;
         std::string name;
         std::string description;
-    } output_;
+        // from zxdg_output_v1
+        std::optional<struct logical> logical;
+    };
+
+    // what get_*() return, replaced on done
+    State current_{};
+    // received since the last done
+    State pending_{};
+    // Change bits of pending_
+    uint32_t pending_changes_{};
+    bool done_{};
+    std::function<void(const Output &output, uint32_t changes)> change_callback_;
+    FrameClock frame_clock_;
 
     uint32_t version_;
     struct wl_output *wl_output_;
+    struct zxdg_output_v1 *xdg_output_{};
+    struct zwlr_output_power_v1 *output_power_{};
+    bool powered_{true};
+
+    void apply_pending();
 
     static void handle_geometry(void *data,
                                 struct wl_output *wl_output,
@@ -101,6 +181,36 @@ private:
                                    const char *description);
 
     static const struct wl_output_listener listener_;
+
+    static void handle_logical_position(void *data,
+                                        struct zxdg_output_v1 *xdg_output,
+                                        int x,
+                                        int y);
+
+    static void handle_logical_size(void *data,
+                                    struct zxdg_output_v1 *xdg_output,
+                                    int width,
+                                    int height);
+
+    static void handle_xdg_done(void *data, struct zxdg_output_v1 *xdg_output);
+
+    static void handle_xdg_name(void *data,
+                                struct zxdg_output_v1 *xdg_output,
+                                const char *name);
+
+    static void handle_xdg_description(void *data,
+                                       struct zxdg_output_v1 *xdg_output,
+                                       const char *description);
+
+    static const struct zxdg_output_v1_listener xdg_output_listener_;
+
+#if defined(ENABLE_OUTPUT_POWER)
+    static void handle_power_mode(void *data, struct zwlr_output_power_v1 *output_power, uint32_t mode);
+
+    static void handle_power_failed(void *data, struct zwlr_output_power_v1 *output_power);
+
+    static const struct zwlr_output_power_v1_listener power_listener_;
+#endif
 };
 
 #endif //SRC_OUTPUT_H_
\ No newline at end of file
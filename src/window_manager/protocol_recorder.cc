@@ -0,0 +1,566 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "protocol_recorder.h"
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils/logging.h"
+
+#if defined(ENABLE_PROTOCOL_STATS)
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+// WL_CLOSURE_MAX_ARGS of libwayland
+constexpr size_t kMaxArgs = 20;
+
+struct Tracked {
+    struct wl_proxy *proxy;
+    const struct wl_interface *interface;
+};
+
+std::atomic<bool> recording;
+std::mutex record_mutex;
+int record_fd = -1;
+uint8_t *record_base;
+size_t record_capacity;
+std::unordered_map<const char *, uint16_t> record_interfaces;
+
+std::mutex tracked_mutex;
+std::unordered_map<uint32_t, Tracked> tracked;
+
+size_t pad4(size_t size) {
+    return (size + 3) & ~static_cast<size_t>(3);
+}
+
+template<typename F>
+void for_each_arg(const char *signature, F &&f) {
+    size_t i = 0;
+    for (auto c = signature; *c && i < kMaxArgs; c++) {
+        if (*c == '?' || (*c >= '0' && *c <= '9')) {
+            continue;
+        }
+        f(i++, *c);
+    }
+}
+
+ProtocolRecorder::FileHeader *file_header() {
+    return reinterpret_cast<ProtocolRecorder::FileHeader *>(record_base);
+}
+
+/**
+ * @return size bytes at the end of the recording, or nullptr once the file is full.
+ */
+uint8_t *reserve(size_t size) {
+    auto header = file_header();
+    if (header->size + size > record_capacity) {
+        header->dropped++;
+        return nullptr;
+    }
+    uint8_t *p = record_base + header->size;
+    header->size += size;
+    return p;
+}
+
+void put_u32(uint8_t *&p, uint32_t value) {
+    memcpy(p, &value, sizeof(value));
+    p += sizeof(value);
+}
+
+/**
+ * @return The index of the interface called name, written to the recording on first use.
+ */
+bool interface_index(const char *name, uint16_t &index) {
+    auto it = record_interfaces.find(name);
+    if (it != record_interfaces.end()) {
+        index = it->second;
+        return true;
+    }
+    if (record_interfaces.size() > UINT16_MAX) {
+        return false;
+    }
+    const size_t length = strlen(name) + 1;
+    const size_t size = sizeof(ProtocolRecorder::RecordHeader) + pad4(length);
+    uint8_t *p = reserve(size);
+    if (!p) {
+        return false;
+    }
+    index = static_cast<uint16_t>(record_interfaces.size());
+    ProtocolRecorder::RecordHeader record{};
+    record.size = static_cast<uint32_t>(size);
+    record.type = ProtocolRecorder::RECORD_INTERFACE;
+    record.interface = index;
+    memcpy(p, &record, sizeof(record));
+    memcpy(p + sizeof(record), name, length);
+    record_interfaces.emplace(name, index);
+    return true;
+}
+
+uint32_t object_id(struct wl_object *object) {
+    return object ? wl_proxy_get_id(reinterpret_cast<struct wl_proxy *>(object)) : 0;
+}
+
+uint64_t monotonic_ns() {
+    struct timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+}
+
+#endif
+
+/**
+ * @return true if the library was built with ENABLE_PROTOCOL_STATS.
+ */
+bool ProtocolRecorder::is_available() {
+#if defined(ENABLE_PROTOCOL_STATS)
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Creates the recording file and starts recording every event.
+ *
+ * @param path     The file to create, replaced if it exists.
+ * @param capacity The file size; recording stops and counts dropped events once it is full.
+ * @return false if not available or the file could not be created and mapped.
+ */
+bool ProtocolRecorder::start(const char *path, size_t capacity) {
+#if defined(ENABLE_PROTOCOL_STATS)
+    stop();
+    std::lock_guard<std::mutex> lock(record_mutex);
+    if (capacity < sizeof(FileHeader)) {
+        return false;
+    }
+    record_fd = open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (record_fd < 0) {
+        LOG_ERROR("ProtocolRecorder: failed to create %s: %s", path, strerror(errno));
+        return false;
+    }
+    void *base = MAP_FAILED;
+    if (ftruncate(record_fd, static_cast<off_t>(capacity)) == 0) {
+        base = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, record_fd, 0);
+    }
+    if (base == MAP_FAILED) {
+        LOG_ERROR("ProtocolRecorder: failed to map %s: %s", path, strerror(errno));
+        close(record_fd);
+        record_fd = -1;
+        return false;
+    }
+    record_base = static_cast<uint8_t *>(base);
+    record_capacity = capacity;
+    record_interfaces.clear();
+    auto header = file_header();
+    memcpy(header->magic, "WPRC", 4);
+    header->version = kVersion;
+    header->start_ns = monotonic_ns();
+    header->size = sizeof(FileHeader);
+    header->events = 0;
+    header->dropped = 0;
+    recording = true;
+    return true;
+#else
+    (void) path;
+    (void) capacity;
+    return false;
+#endif
+}
+
+/**
+ * @brief Stops recording and truncates the file to the records written.
+ */
+void ProtocolRecorder::stop() {
+#if defined(ENABLE_PROTOCOL_STATS)
+    std::lock_guard<std::mutex> lock(record_mutex);
+    if (!record_base) {
+        return;
+    }
+    recording = false;
+    const auto header = file_header();
+    const auto size = static_cast<off_t>(header->size);
+    LOG_DEBUG("ProtocolRecorder: %llu events, %llu dropped",
+              static_cast<unsigned long long>(header->events), static_cast<unsigned long long>(header->dropped));
+    munmap(record_base, record_capacity);
+    if (ftruncate(record_fd, size) < 0) {
+        LOG_WARN("ProtocolRecorder: failed to truncate the recording: %s", strerror(errno));
+    }
+    close(record_fd);
+    record_fd = -1;
+    record_base = nullptr;
+#endif
+}
+
+/**
+ * @return true between start() and stop().
+ */
+bool ProtocolRecorder::is_recording() {
+#if defined(ENABLE_PROTOCOL_STATS)
+    return recording;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Appends an event to the recording, from the thread dispatching it.
+ */
+void ProtocolRecorder::record_event(struct wl_proxy *proxy, uint32_t opcode, const struct wl_message *message,
+                                    const union wl_argument *args) {
+#if defined(ENABLE_PROTOCOL_STATS)
+    if (!recording.load(std::memory_order_relaxed)) {
+        return;
+    }
+    const uint64_t now = monotonic_ns();
+    size_t payload = 0;
+    for_each_arg(message->signature, [&](size_t i, char type) {
+        switch (type) {
+            case 's':
+                payload += 4 + (args[i].s ? pad4(strlen(args[i].s) + 1) : 0);
+                break;
+            case 'a':
+                payload += 4 + (args[i].a ? pad4(args[i].a->size) : 0);
+                break;
+            default:
+                payload += 4;
+                break;
+        }
+    });
+
+    std::lock_guard<std::mutex> lock(record_mutex);
+    uint16_t index;
+    if (!record_base || !interface_index(wl_proxy_get_class(proxy), index)) {
+        return;
+    }
+    const size_t size = sizeof(RecordHeader) + payload;
+    uint8_t *p = reserve(size);
+    if (!p) {
+        return;
+    }
+    auto header = file_header();
+    RecordHeader record{};
+    record.size = static_cast<uint32_t>(size);
+    record.type = RECORD_EVENT;
+    record.opcode = static_cast<uint16_t>(opcode);
+    record.time_ns = now - header->start_ns;
+    record.object_id = wl_proxy_get_id(proxy);
+    record.interface = index;
+    memcpy(p, &record, sizeof(record));
+    p += sizeof(record);
+    for_each_arg(message->signature, [&](size_t i, char type) {
+        switch (type) {
+            case 's': {
+                const size_t length = args[i].s ? strlen(args[i].s) + 1 : 0;
+                put_u32(p, static_cast<uint32_t>(length));
+                if (length) {
+                    memset(p, 0, pad4(length));
+                    memcpy(p, args[i].s, length);
+                    p += pad4(length);
+                }
+                break;
+            }
+            case 'a': {
+                const size_t length = args[i].a ? args[i].a->size : 0;
+                put_u32(p, static_cast<uint32_t>(length));
+                if (length) {
+                    memset(p, 0, pad4(length));
+                    memcpy(p, args[i].a->data, length);
+                    p += pad4(length);
+                }
+                break;
+            }
+            case 'o':
+            case 'n':
+                put_u32(p, object_id(args[i].o));
+                break;
+            case 'h':
+                put_u32(p, UINT32_MAX);
+                break;
+            default:
+                put_u32(p, args[i].u);
+                break;
+        }
+    });
+    header->events++;
+#else
+    (void) proxy;
+    (void) opcode;
+    (void) message;
+    (void) args;
+#endif
+}
+
+/**
+ * @brief Makes a proxy with a listener known to the replayer by its id.
+ */
+void ProtocolRecorder::track(struct wl_proxy *proxy, const struct wl_interface *interface) {
+#if defined(ENABLE_PROTOCOL_STATS)
+    std::lock_guard<std::mutex> lock(tracked_mutex);
+    tracked[wl_proxy_get_id(proxy)] = {proxy, interface};
+#else
+    (void) proxy;
+    (void) interface;
+#endif
+}
+
+/**
+ * @brief Forgets a proxy that is being destroyed.
+ */
+void ProtocolRecorder::untrack(struct wl_proxy *proxy) {
+#if defined(ENABLE_PROTOCOL_STATS)
+    std::lock_guard<std::mutex> lock(tracked_mutex);
+    auto it = tracked.find(wl_proxy_get_id(proxy));
+    if (it != tracked.end() && it->second.proxy == proxy) {
+        tracked.erase(it);
+    }
+#else
+    (void) proxy;
+#endif
+}
+
+/**
+ * @brief Maps a recording made by ProtocolRecorder.
+ *
+ * @param path The recording.
+ * @throws std::runtime_error if not available, or the file cannot be read or is no recording.
+ */
+ProtocolReplayer::ProtocolReplayer(const char *path) {
+#if defined(ENABLE_PROTOCOL_STATS)
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error(std::string("ProtocolReplayer: ") + path + ": " + strerror(errno));
+    }
+    struct stat st{};
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(ProtocolRecorder::FileHeader)) {
+        data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error(std::string("ProtocolReplayer: failed to map ") + path);
+    }
+    data_ = static_cast<const uint8_t *>(data);
+    mapped_size_ = static_cast<size_t>(st.st_size);
+    ProtocolRecorder::FileHeader header{};
+    memcpy(&header, data_, sizeof(header));
+    if (memcmp(header.magic, "WPRC", 4) != 0 || header.version != ProtocolRecorder::kVersion ||
+        header.size > mapped_size_) {
+        munmap(const_cast<uint8_t *>(data_), mapped_size_);
+        throw std::runtime_error(std::string("ProtocolReplayer: not a recording: ") + path);
+    }
+    size_ = header.size;
+    offset_ = sizeof(header);
+    stats_.events = header.events;
+#else
+    (void) path;
+    throw std::runtime_error("ProtocolReplayer: built without ENABLE_PROTOCOL_STATS");
+#endif
+}
+
+ProtocolReplayer::~ProtocolReplayer() {
+    if (data_) {
+        munmap(const_cast<uint8_t *>(data_), mapped_size_);
+    }
+}
+
+/**
+ * @brief Starts the replay clock.
+ *
+ * @param speed 1 for the recorded pace, 2 for twice as fast, 0 to replay every event at once.
+ */
+void ProtocolReplayer::start(double speed) {
+#if defined(ENABLE_PROTOCOL_STATS)
+    speed_ = speed;
+    start_ns_ = monotonic_ns();
+#else
+    (void) speed;
+#endif
+}
+
+/**
+ * @return When record is due, on CLOCK_MONOTONIC.
+ */
+uint64_t ProtocolReplayer::due_ns(const ProtocolRecorder::RecordHeader &record) const {
+    if (speed_ <= 0) {
+        return start_ns_;
+    }
+    return start_ns_ + static_cast<uint64_t>(static_cast<double>(record.time_ns) / speed_);
+}
+
+/**
+ * @brief Delivers the events that are due, from the thread that dispatches their objects.
+ *
+ * @return The number of events replayed.
+ */
+int ProtocolReplayer::dispatch_due() {
+    int count = 0;
+#if defined(ENABLE_PROTOCOL_STATS)
+    const uint64_t now = monotonic_ns();
+    while (offset_ + sizeof(ProtocolRecorder::RecordHeader) <= size_) {
+        ProtocolRecorder::RecordHeader record{};
+        memcpy(&record, data_ + offset_, sizeof(record));
+        if (record.size < sizeof(record) || offset_ + record.size > size_) {
+            // truncated, nothing after it can be trusted
+            offset_ = size_;
+            break;
+        }
+        if (record.type == ProtocolRecorder::RECORD_INTERFACE) {
+            if (interfaces_.size() <= record.interface) {
+                interfaces_.resize(record.interface + 1u);
+            }
+            interfaces_[record.interface] = reinterpret_cast<const char *>(data_ + offset_ + sizeof(record));
+        } else {
+            if (due_ns(record) > now) {
+                break;
+            }
+            if (replay(record)) {
+                stats_.replayed++;
+                count++;
+            } else {
+                stats_.skipped++;
+            }
+        }
+        offset_ += record.size;
+    }
+#endif
+    return count;
+}
+
+/**
+ * @return Milliseconds until the next event is due, for the caller's poll timeout; -1 once finished.
+ */
+int ProtocolReplayer::get_timeout() const {
+#if defined(ENABLE_PROTOCOL_STATS)
+    for (size_t offset = offset_; offset + sizeof(ProtocolRecorder::RecordHeader) <= size_;) {
+        ProtocolRecorder::RecordHeader record{};
+        memcpy(&record, data_ + offset, sizeof(record));
+        if (record.size < sizeof(record)) {
+            break;
+        }
+        if (record.type == ProtocolRecorder::RECORD_EVENT) {
+            const uint64_t now = monotonic_ns();
+            const uint64_t due = due_ns(record);
+            return due <= now ? 0 : static_cast<int>(std::ceil(static_cast<double>(due - now) / 1e6));
+        }
+        offset += record.size;
+    }
+#endif
+    return -1;
+}
+
+/**
+ * @brief Decodes one event and calls the listener of the live object with its id.
+ *
+ * @return false if the event was skipped.
+ */
+bool ProtocolReplayer::replay(const ProtocolRecorder::RecordHeader &record) {
+#if defined(ENABLE_PROTOCOL_STATS)
+    if (record.interface >= interfaces_.size() || !interfaces_[record.interface]) {
+        return false;
+    }
+    Tracked target{};
+    {
+        std::lock_guard<std::mutex> lock(tracked_mutex);
+        auto it = tracked.find(record.object_id);
+        if (it == tracked.end()) {
+            return false;
+        }
+        target = it->second;
+    }
+    if (strcmp(target.interface->name, interfaces_[record.interface]) != 0 ||
+        record.opcode >= target.interface->event_count) {
+        return false;
+    }
+    const struct wl_message *message = &target.interface->events[record.opcode];
+
+    std::array<union wl_argument, kMaxArgs> args{};
+    std::array<struct wl_array, kMaxArgs> arrays{};
+    const uint8_t *p = data_ + offset_ + sizeof(record);
+    const uint8_t *end = data_ + offset_ + record.size;
+    bool ok = true;
+    for_each_arg(message->signature, [&](size_t i, char type) {
+        uint32_t value;
+        if (!ok || p + sizeof(value) > end) {
+            ok = false;
+            return;
+        }
+        memcpy(&value, p, sizeof(value));
+        p += sizeof(value);
+        switch (type) {
+            case 's':
+            case 'a':
+                if (p + pad4(value) > end) {
+                    ok = false;
+                    return;
+                }
+                if (type == 's') {
+                    args[i].s = value ? reinterpret_cast<const char *>(p) : nullptr;
+                } else {
+                    arrays[i] = {value, value, const_cast<uint8_t *>(p)};
+                    args[i].a = &arrays[i];
+                }
+                p += pad4(value);
+                break;
+            case 'o': {
+                if (!value) {
+                    args[i].o = nullptr;
+                    break;
+                }
+                std::lock_guard<std::mutex> lock(tracked_mutex);
+                auto it = tracked.find(value);
+                if (it == tracked.end()) {
+                    ok = false;
+                    return;
+                }
+                args[i].o = reinterpret_cast<struct wl_object *>(it->second.proxy);
+                break;
+            }
+            case 'n':
+            case 'h':
+                // objects are not created and fds not reproduced
+                ok = false;
+                return;
+            default:
+                args[i].u = value;
+                break;
+        }
+    });
+    if (!ok) {
+        return false;
+    }
+    call_listener(wl_proxy_get_listener(target.proxy), target.proxy, record.opcode, message, args.data());
+    return true;
+#else
+    (void) record;
+    return false;
+#endif
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_PROTOCOL_RECORDER_H_
+#define SRC_WINDOW_MANAGER_PROTOCOL_RECORDER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <wayland-client.h>
+
+#include "utils/export.h"
+
+/**
+ * @brief Records the events the compositor sends to a compact binary file.
+ *
+ * Uses the dispatcher ProtocolStats installs, so like it needs ENABLE_PROTOCOL_STATS.
+ * The file is mapped and written in place: a record is a header with the time,
+ * object id, interface and opcode, followed by the arguments in wire encoding.
+ * Objects are recorded by id, file descriptors as -1, as they cannot be reproduced.
+ * Recording stops once the file is full. One connection should be recorded at a time.
+ */
+class WAYPP_EXPORT ProtocolRecorder {
+public:
+    struct FileHeader {
+        char magic[4];
+        uint32_t version;
+        // CLOCK_MONOTONIC at start(), record times are relative to it
+        uint64_t start_ns;
+        // bytes used, including this header
+        uint64_t size;
+        uint64_t events;
+        uint64_t dropped;
+    };
+
+    typedef enum {
+        // names an interface, the payload is its NUL-terminated name
+        RECORD_INTERFACE,
+        RECORD_EVENT,
+    } RecordType;
+
+    struct RecordHeader {
+        // including this header and the payload, a multiple of 4
+        uint32_t size;
+        uint16_t type;
+        uint16_t opcode;
+        uint64_t time_ns;
+        uint32_t object_id;
+        uint16_t interface;
+        uint16_t reserved;
+    };
+
+    static constexpr uint32_t kVersion = 1;
+
+    [[nodiscard]] static bool is_available();
+
+    static bool start(const char *path, size_t capacity = 64 * 1024 * 1024);
+
+    static void stop();
+
+    [[nodiscard]] static bool is_recording();
+
+    // called by the protocol stats hooks
+    static void record_event(struct wl_proxy *proxy, uint32_t opcode, const struct wl_message *message,
+                             const union wl_argument *args);
+
+    static void track(struct wl_proxy *proxy, const struct wl_interface *interface);
+
+    static void untrack(struct wl_proxy *proxy);
+};
+
+/**
+ * @brief Feeds a recording back to the listeners of the live connection's objects.
+ *
+ * Events are delivered by object id to the proxies of the running client, through the
+ * same dispatcher as real events, at the recorded pace or scaled by speed. Replaying
+ * against the same start-up sequence gives the same ids, so an input burst or a
+ * configure storm from the field can be reproduced deterministically. Events that
+ * created objects or carried fds, and events for objects that do not exist, are
+ * skipped and counted.
+ */
+class WAYPP_EXPORT ProtocolReplayer {
+public:
+    struct Stats {
+        uint64_t events;
+        uint64_t replayed;
+        uint64_t skipped;
+    };
+
+    explicit ProtocolReplayer(const char *path);
+
+    ~ProtocolReplayer();
+
+    ProtocolReplayer(const ProtocolReplayer &) = delete;
+
+    ProtocolReplayer &operator=(const ProtocolReplayer &) = delete;
+
+    void start(double speed = 1.0);
+
+    int dispatch_due();
+
+    [[nodiscard]] int get_timeout() const;
+
+    [[nodiscard]] bool finished() const { return offset_ >= size_; }
+
+    [[nodiscard]] Stats get_stats() const { return stats_; }
+
+private:
+    const uint8_t *data_{};
+    size_t mapped_size_{};
+    size_t size_{};
+    size_t offset_{};
+    // interface names by the index the recording gave them
+    std::vector<const char *> interfaces_;
+    double speed_{1.0};
+    uint64_t start_ns_{};
+    Stats stats_{};
+
+    [[nodiscard]] uint64_t due_ns(const ProtocolRecorder::RecordHeader &record) const;
+
+    bool replay(const ProtocolRecorder::RecordHeader &record);
+};
+
+#if defined(ENABLE_PROTOCOL_STATS)
+
+int call_listener(const void *implementation, struct wl_proxy *proxy, uint32_t opcode,
+                  const struct wl_message *message, union wl_argument *args);
+
+#endif
+
+#endif // SRC_WINDOW_MANAGER_PROTOCOL_RECORDER_H_
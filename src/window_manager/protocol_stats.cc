@@ -0,0 +1,347 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "protocol_stats.h"
+#include "protocol_recorder.h"
+
+#if defined(ENABLE_PROTOCOL_STATS)
+
+#include <array>
+#include <chrono>
+#include <cstdarg>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#include <ffi.h>
+#include <wayland-client.h>
+
+namespace {
+// WL_CLOSURE_MAX_ARGS of libwayland
+constexpr size_t kMaxArgs = 20;
+
+struct Entry {
+    const char *interface;
+    const char *message;
+    uint32_t opcode;
+    bool request;
+    uint64_t count;
+    uint64_t bytes;
+};
+
+struct Window {
+    std::chrono::steady_clock::time_point start;
+    uint64_t sent;
+    uint64_t received;
+};
+
+// describes calling a listener member for one event
+struct Call {
+    ffi_cif cif;
+    std::array<ffi_type *, kMaxArgs + 2> types;
+};
+
+std::mutex mutex;
+std::unordered_map<const struct wl_message *, Entry> entries;
+std::unordered_map<const struct wl_message *, std::unique_ptr<Call>> calls;
+uint64_t requests;
+uint64_t events;
+uint64_t bytes_sent;
+uint64_t bytes_received;
+Window window{std::chrono::steady_clock::now(), 0, 0};
+double sent_per_second;
+double received_per_second;
+
+/**
+ * @return The interface of proxy.
+ *
+ * libwayland has no accessor before 1.24; every wl_proxy begins with its wl_object,
+ * which begins with the interface, a layout libwayland has kept since 1.0 and that
+ * language bindings rely on as well.
+ */
+const struct wl_interface *interface_of(struct wl_proxy *proxy) {
+    return *reinterpret_cast<const struct wl_interface *const *>(proxy);
+}
+
+/**
+ * @brief Walks the argument types of a message signature, skipping versions and nullability.
+ */
+template<typename F>
+void for_each_arg(const char *signature, F &&f) {
+    size_t i = 0;
+    for (auto c = signature; *c && i < kMaxArgs; c++) {
+        if (*c == '?' || (*c >= '0' && *c <= '9')) {
+            continue;
+        }
+        f(i++, *c);
+    }
+}
+
+/**
+ * @return The wire size of a message, 8 bytes of header plus padded arguments.
+ */
+uint64_t message_size(const struct wl_message *message, const union wl_argument *args) {
+    uint64_t size = 8;
+    for_each_arg(message->signature, [&](size_t i, char type) {
+        switch (type) {
+            case 's':
+                size += 4 + (args[i].s ? (strlen(args[i].s) + 1 + 3) & ~static_cast<size_t>(3) : 0);
+                break;
+            case 'a':
+                size += 4 + (args[i].a ? (args[i].a->size + 3) & ~static_cast<size_t>(3) : 0);
+                break;
+            case 'h':
+                // passed out of band
+                break;
+            default:
+                size += 4;
+                break;
+        }
+    });
+    return size;
+}
+
+void record(const struct wl_interface *interface, uint32_t opcode, const struct wl_message *message,
+            const union wl_argument *args, bool request) {
+    const auto size = message_size(message, args);
+    const auto now = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &entry = entries.try_emplace(message, Entry{interface->name, message->name, opcode, request, 0, 0})
+            .first->second;
+    entry.count++;
+    entry.bytes += size;
+    if (request) {
+        requests++;
+        bytes_sent += size;
+    } else {
+        events++;
+        bytes_received += size;
+    }
+
+    const auto elapsed = std::chrono::duration<double>(now - window.start).count();
+    if (elapsed >= 1.0) {
+        sent_per_second = static_cast<double>(bytes_sent - window.sent) / elapsed;
+        received_per_second = static_cast<double>(bytes_received - window.received) / elapsed;
+        window = {now, bytes_sent, bytes_received};
+    }
+}
+
+/**
+ * @return The ffi description of the listener member for message, built on first use.
+ */
+Call *call_for(const struct wl_message *message) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &call = calls[message];
+    if (!call) {
+        call = std::make_unique<Call>();
+        // data and the proxy come first
+        call->types[0] = &ffi_type_pointer;
+        call->types[1] = &ffi_type_pointer;
+        unsigned count = 2;
+        for_each_arg(message->signature, [&](size_t, char type) {
+            switch (type) {
+                case 'i':
+                case 'f':
+                case 'h':
+                    call->types[count++] = &ffi_type_sint32;
+                    break;
+                case 'u':
+                    call->types[count++] = &ffi_type_uint32;
+                    break;
+                default:
+                    call->types[count++] = &ffi_type_pointer;
+                    break;
+            }
+        });
+        if (ffi_prep_cif(&call->cif, FFI_DEFAULT_ABI, count, &ffi_type_void, call->types.data()) != FFI_OK) {
+            call.reset();
+            return nullptr;
+        }
+    }
+    return call.get();
+}
+
+/**
+ * @brief Counts and records an event, then calls the listener member as libwayland would have.
+ */
+int dispatch_event(const void *implementation, void *target, uint32_t opcode, const struct wl_message *message,
+                   union wl_argument *args) {
+    auto proxy = static_cast<struct wl_proxy *>(target);
+    record(interface_of(proxy), opcode, message, args, false);
+    ProtocolRecorder::record_event(proxy, opcode, message, args);
+    return call_listener(implementation, proxy, opcode, message, args);
+}
+}
+
+/**
+ * @brief Calls the listener member for an event through libffi.
+ *
+ * Shared by the stats dispatcher and ProtocolReplayer.
+ */
+int call_listener(const void *implementation, struct wl_proxy *proxy, uint32_t opcode,
+                  const struct wl_message *message, union wl_argument *args) {
+    const auto listener = static_cast<void (*const *)(void)>(implementation);
+    const auto function = listener ? listener[opcode] : nullptr;
+    const auto call = function ? call_for(message) : nullptr;
+    if (!call) {
+        return 0;
+    }
+
+    void *data = wl_proxy_get_user_data(proxy);
+    std::array<void *, kMaxArgs + 2> values{};
+    values[0] = &data;
+    values[1] = &proxy;
+    // every union member starts at the union's address, the cif picks the width
+    for (unsigned i = 2; i < call->cif.nargs; i++) {
+        values[i] = &args[i - 2];
+    }
+    ffi_call(&call->cif, function, nullptr, values.data());
+    return 0;
+}
+
+extern "C" {
+/**
+ * @brief Replaces wl_proxy_add_listener, linked with --wrap, to count each event before dispatching it.
+ */
+WAYPP_EXPORT int __wrap_wl_proxy_add_listener(struct wl_proxy *proxy, void (**implementation)(void), void *data) {
+    ProtocolRecorder::track(proxy, interface_of(proxy));
+    return wl_proxy_add_dispatcher(proxy, dispatch_event, reinterpret_cast<const void *>(implementation), data);
+}
+
+/**
+ * @brief Replaces wl_proxy_marshal_flags, linked with --wrap, to count each request before sending it.
+ */
+WAYPP_EXPORT struct wl_proxy *__wrap_wl_proxy_marshal_flags(struct wl_proxy *proxy, uint32_t opcode,
+                                                            const struct wl_interface *interface, uint32_t version,
+                                                            uint32_t flags, ...) {
+    const auto proxy_interface = interface_of(proxy);
+    const auto message = &proxy_interface->methods[opcode];
+
+    std::array<union wl_argument, kMaxArgs> args{};
+    va_list ap;
+    va_start(ap, flags);
+    for_each_arg(message->signature, [&](size_t i, char type) {
+        switch (type) {
+            case 'i':
+            case 'h':
+                args[i].i = va_arg(ap, int32_t);
+                break;
+            case 'u':
+                args[i].u = va_arg(ap, uint32_t);
+                break;
+            case 'f':
+                args[i].f = va_arg(ap, wl_fixed_t);
+                break;
+            case 's':
+                args[i].s = va_arg(ap, const char *);
+                break;
+            case 'a':
+                args[i].a = va_arg(ap, struct wl_array *);
+                break;
+            default:
+                // 'o' and 'n', the placeholder of a new id is a null object
+                args[i].o = va_arg(ap, struct wl_object *);
+                break;
+        }
+    });
+    va_end(ap);
+
+    record(proxy_interface, opcode, message, args.data(), true);
+    if (flags & WL_MARSHAL_FLAG_DESTROY) {
+        ProtocolRecorder::untrack(proxy);
+    }
+    return wl_proxy_marshal_array_flags(proxy, opcode, interface, version, flags, args.data());
+}
+
+void __real_wl_proxy_destroy(struct wl_proxy *proxy);
+
+/**
+ * @brief Replaces wl_proxy_destroy, linked with --wrap, so the replayer forgets the proxy.
+ */
+WAYPP_EXPORT void __wrap_wl_proxy_destroy(struct wl_proxy *proxy) {
+    ProtocolRecorder::untrack(proxy);
+    __real_wl_proxy_destroy(proxy);
+}
+}
+
+#endif
+
+/**
+ * @class ProtocolStats
+ * @brief Counts the requests and events of every interface and message, and the bytes they take on the wire.
+ *
+ * Built with ENABLE_PROTOCOL_STATS the library is linked with --wrap for
+ * wl_proxy_add_listener and wl_proxy_marshal_flags: requests are counted as they are
+ * marshalled, and every listener is installed as a dispatcher that counts the event
+ * and then calls the listener through libffi, the way libwayland itself does. Unlike
+ * WAYLAND_DEBUG nothing is formatted, so it can stay on in production to find which
+ * protocol floods the connection. Proxies created by other libraries, such as the
+ * EGL driver's, are not seen.
+ */
+
+/**
+ * @return true if the library was built with ENABLE_PROTOCOL_STATS.
+ */
+bool ProtocolStats::is_available() {
+#if defined(ENABLE_PROTOCOL_STATS)
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @return A counter for every message seen so far.
+ */
+std::vector<ProtocolStats::Counter> ProtocolStats::get_counters() {
+    std::vector<Counter> result;
+#if defined(ENABLE_PROTOCOL_STATS)
+    std::lock_guard<std::mutex> lock(mutex);
+    result.reserve(entries.size());
+    for (const auto &[message, entry]: entries) {
+        result.push_back({entry.interface, entry.message, entry.opcode, entry.request, entry.count, entry.bytes});
+    }
+#endif
+    return result;
+}
+
+/**
+ * @return The totals over all interfaces.
+ */
+ProtocolStats::Totals ProtocolStats::get_totals() {
+#if defined(ENABLE_PROTOCOL_STATS)
+    std::lock_guard<std::mutex> lock(mutex);
+    return {requests, events, bytes_sent, bytes_received, sent_per_second, received_per_second};
+#else
+    return {};
+#endif
+}
+
+/**
+ * @brief Zeroes every counter.
+ */
+void ProtocolStats::reset() {
+#if defined(ENABLE_PROTOCOL_STATS)
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    requests = events = bytes_sent = bytes_received = 0;
+    window = {std::chrono::steady_clock::now(), 0, 0};
+    sent_per_second = received_per_second = 0;
+#endif
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_PROTOCOL_STATS_H_
+#define SRC_WINDOW_MANAGER_PROTOCOL_STATS_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "utils/export.h"
+
+class WAYPP_EXPORT ProtocolStats {
+public:
+    struct Counter {
+        const char *interface;
+        const char *message;
+        uint32_t opcode;
+        // a request sent, or an event received
+        bool request;
+        uint64_t count;
+        // wire size, file descriptors passed alongside are not counted
+        uint64_t bytes;
+    };
+
+    struct Totals {
+        uint64_t requests;
+        uint64_t events;
+        uint64_t bytes_sent;
+        uint64_t bytes_received;
+        // over the last full second
+        double sent_per_second;
+        double received_per_second;
+    };
+
+    [[nodiscard]] static bool is_available();
+
+    [[nodiscard]] static std::vector<Counter> get_counters();
+
+    [[nodiscard]] static Totals get_totals();
+
+    static void reset();
+};
+
+#endif // SRC_WINDOW_MANAGER_PROTOCOL_STATS_H_
@@ -0,0 +1,308 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "reconnect_session.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include "utils/logging.h"
+
+namespace {
+uint64_t now_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + static_cast<uint64_t>(ts.tv_nsec);
+}
+}
+
+/**
+ * @class ReconnectSession
+ * @brief Keeps an application running across compositor restarts.
+ *
+ * A WindowManager is tied to its connection: its surfaces, buffers, seats and the
+ * EGL display of its windows go with it. The session owns the WindowManager and
+ * builds a new one with the factory once the connection is lost, then hands it to
+ * the restore callback to recreate the surfaces. Keymaps and the compose table are
+ * process wide and survive.
+ *
+ * What should not be reloaded lives on get_gpu_display(), a headless EGL display on
+ * the device or surfaceless platform that does not depend on the connection. Its
+ * textures reach the compositor through dmabufs, e.g. rendered into a VulkanDmabuf
+ * image imported with EglDmabufImage and presented through WindowDmabuf; after a
+ * reconnect only the WindowDmabuf imports are repeated. Contexts of the Wayland EGL
+ * platform cannot share with it and are rebuilt with their window.
+ *
+ * Reconnecting from poll_events(), dispatch() or reconnect() blocks the calling thread
+ * until the compositor is back or ReconnectConfig::timeout_ms passed. On a GMainContext
+ * each attempt runs from a timeout source instead, so the loop keeps running meanwhile.
+ */
+
+/**
+ * @brief Connects and calls restore with reconnected false.
+ *
+ * @throws std::runtime_error if there is no compositor within ReconnectConfig::timeout_ms.
+ */
+ReconnectSession::ReconnectSession(const Factory &factory, const Restore &restore, const ReconnectConfig &config) :
+        factory_(factory),
+        restore_(restore),
+        config_(config) {
+    wm_ = connect(deadline());
+    if (!wm_) {
+        throw std::runtime_error("No Wayland compositor to connect to.");
+    }
+    if (config_.persistent_gpu) {
+        // on the compositor's GPU, so its dmabufs need no copy
+        const auto *feedback = wm_->get_dmabuf_feedback();
+        try {
+            gpu_display_ = EglDisplay::create_headless(config_.gpu_attribs, EGL_CONTEXT_PRIORITY_MEDIUM_IMG,
+                                                       feedback ? feedback->get_main_device() : 0);
+        } catch (const std::runtime_error &e) {
+            LOG_WARN("No persistent GPU display: %s", e.what());
+        }
+    }
+    attach(false);
+}
+
+ReconnectSession::~ReconnectSession() {
+    if (reconnect_source_) {
+        g_source_destroy(reconnect_source_);
+        g_source_unref(reconnect_source_);
+    }
+    wm_.reset();
+}
+
+/**
+ * @brief Calls the factory until it returns a WindowManager, backing off between attempts.
+ *
+ * @param deadline_ns CLOCK_MONOTONIC to give up at, 0 for never.
+ * @return nullptr once the deadline passed.
+ */
+std::unique_ptr<WindowManager> ReconnectSession::connect(uint64_t deadline_ns) {
+    uint32_t interval_ms = std::max(config_.retry_interval_ms, 1u);
+    for (;;) {
+        if (auto wm = try_connect()) {
+            return wm;
+        }
+        const uint64_t now = now_ns();
+        if (deadline_ns && now >= deadline_ns) {
+            return nullptr;
+        }
+        uint64_t sleep_ns = interval_ms * 1000000ull;
+        if (deadline_ns) {
+            sleep_ns = std::min(sleep_ns, deadline_ns - now);
+        }
+        const timespec ts{static_cast<time_t>(sleep_ns / 1000000000ull), static_cast<long>(sleep_ns % 1000000000ull)};
+        nanosleep(&ts, nullptr);
+        interval_ms = next_interval(interval_ms);
+    }
+}
+
+/**
+ * @brief Calls the factory once.
+ *
+ * @return nullptr if it threw.
+ */
+std::unique_ptr<WindowManager> ReconnectSession::try_connect() {
+    try {
+        return factory_();
+    } catch (const std::runtime_error &e) {
+        // the socket appears before the compositor announces its globals
+        LOG_DEBUG("Connecting: %s", e.what());
+    }
+    return nullptr;
+}
+
+/**
+ * @return The interval after a failed attempt, doubled up to ReconnectConfig::max_retry_interval_ms.
+ */
+uint32_t ReconnectSession::next_interval(uint32_t interval_ms) const {
+    return std::min(interval_ms * 2, std::max(config_.max_retry_interval_ms, interval_ms));
+}
+
+/**
+ * @return CLOCK_MONOTONIC to give up reconnecting at, 0 for never.
+ */
+uint64_t ReconnectSession::deadline() const {
+    return config_.timeout_ms ? now_ns() + config_.timeout_ms * 1000000ull : 0;
+}
+
+/**
+ * @brief Watches the new WindowManager's connection and restores its surfaces.
+ */
+void ReconnectSession::attach(bool reconnected) {
+    wm_->set_disconnect_callback([this](int error) {
+        if (!lost_ns_) {
+            lost_ns_ = now_ns();
+        }
+        LOG_WARN("Wayland connection lost: %s", strerror(error));
+        GMainContext *context = wm_->get_context();
+        if (!context || reconnect_source_) {
+            return;
+        }
+        // for applications running the GLib loop themselves
+        schedule_retry(context, g_idle_source_new());
+    });
+    if (restore_) {
+        restore_(*wm_, reconnected);
+    }
+}
+
+/**
+ * @brief Hands the lost WindowManager to the disconnect callback and destroys it.
+ */
+void ReconnectSession::release_window_manager() {
+    if (!wm_) {
+        return;
+    }
+    if (disconnect_callback_) {
+        disconnect_callback_(*wm_, wm_->get_connection_error());
+    }
+    wm_.reset();
+}
+
+/**
+ * @brief Restores the surfaces on the new WindowManager and records the reconnect.
+ */
+void ReconnectSession::restored() {
+    reconnects_++;
+    attach(true);
+    last_reconnect_ns_ = now_ns() - lost_ns_;
+    lost_ns_ = 0;
+    LOG_INFO("Reconnected in %.1f ms", static_cast<double>(last_reconnect_ns_) / 1e6);
+}
+
+/**
+ * @brief Makes the next reconnect attempt from source on context.
+ *
+ * @param source An idle or timeout source, owned by the session until it fired.
+ */
+void ReconnectSession::schedule_retry(GMainContext *context, GSource *source) {
+    reconnect_source_ = source;
+    g_source_set_callback(reconnect_source_, [](gpointer data) -> gboolean {
+        auto *session = static_cast<ReconnectSession *>(data);
+        GMainContext *context = g_source_get_context(session->reconnect_source_);
+        g_source_unref(session->reconnect_source_);
+        session->reconnect_source_ = nullptr;
+        // otherwise poll_events() or dispatch() reconnects once the WindowManager returned
+        if (!session->dispatching_) {
+            session->retry(context);
+        }
+        return G_SOURCE_REMOVE;
+    }, this, nullptr);
+    g_source_set_name(reconnect_source_, "waypp reconnect");
+    g_source_attach(reconnect_source_, context);
+}
+
+/**
+ * @brief One reconnect attempt on the GLib loop, scheduling the next one if it fails.
+ *
+ * The first attempt destroys the lost WindowManager, later ones back off as connect() does
+ * but return to the loop in between.
+ */
+void ReconnectSession::retry(GMainContext *context) {
+    if (wm_) {
+        release_window_manager();
+        retry_deadline_ns_ = deadline();
+        retry_interval_ms_ = std::max(config_.retry_interval_ms, 1u);
+    }
+    wm_ = try_connect();
+    if (wm_) {
+        restored();
+        return;
+    }
+    const uint64_t now = now_ns();
+    if (retry_deadline_ns_ && now >= retry_deadline_ns_) {
+        LOG_ERROR("No Wayland compositor within %u ms", config_.timeout_ms);
+        return;
+    }
+    uint64_t interval_ms = retry_interval_ms_;
+    if (retry_deadline_ns_) {
+        interval_ms = std::min(interval_ms, (retry_deadline_ns_ - now + 999999) / 1000000);
+    }
+    schedule_retry(context, g_timeout_source_new(static_cast<guint>(interval_ms)));
+    retry_interval_ms_ = next_interval(retry_interval_ms_);
+}
+
+/**
+ * @brief Replaces the WindowManager with one on a new connection.
+ *
+ * Called by poll_events() and dispatch() once the connection failed, or directly,
+ * e.g. from an application's own loop. The old WindowManager and everything created
+ * through it are destroyed first; the persistent GPU display stays.
+ *
+ * @return false if the compositor did not come back within ReconnectConfig::timeout_ms,
+ * get_window_manager() is nullptr until a later call succeeds.
+ */
+bool ReconnectSession::reconnect() {
+    if (reconnect_source_) {
+        g_source_destroy(reconnect_source_);
+        g_source_unref(reconnect_source_);
+        reconnect_source_ = nullptr;
+    }
+    if (!lost_ns_) {
+        lost_ns_ = now_ns();
+    }
+    release_window_manager();
+
+    wm_ = connect(deadline());
+    if (!wm_) {
+        LOG_ERROR("No Wayland compositor within %u ms", config_.timeout_ms);
+        return false;
+    }
+    restored();
+    return true;
+}
+
+int ReconnectSession::after_dispatch(int result) {
+    if (!lost_ns_ && (result >= 0 || !wm_->get_connection_error())) {
+        return result;
+    }
+    return reconnect() ? 0 : result;
+}
+
+/**
+ * @brief WindowManager::poll_events(), reconnecting if the connection failed.
+ *
+ * @return As WindowManager::poll_events(), 0 after a successful reconnect.
+ */
+int ReconnectSession::poll_events(int timeout) {
+    if (!wm_) {
+        return reconnect() ? 0 : -ENOTCONN;
+    }
+    dispatching_ = true;
+    const int result = wm_->poll_events(timeout);
+    dispatching_ = false;
+    return after_dispatch(result);
+}
+
+/**
+ * @brief WindowManager::dispatch(), reconnecting if the connection failed.
+ *
+ * @return As WindowManager::dispatch(), 0 after a successful reconnect.
+ */
+int ReconnectSession::dispatch(int timeout) {
+    if (!wm_) {
+        return reconnect() ? 0 : -ENOTCONN;
+    }
+    dispatching_ = true;
+    const int result = wm_->dispatch(timeout);
+    dispatching_ = false;
+    return after_dispatch(result);
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_MANAGER_RECONNECT_SESSION_H_
+#define SRC_WINDOW_MANAGER_RECONNECT_SESSION_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include "window/egl_display.h"
+#include "window_manager.h"
+#include "utils/export.h"
+
+struct ReconnectConfig {
+    // how long a restarting compositor gets to come back, 0 waits forever
+    uint32_t timeout_ms{10000};
+    // between connection attempts, doubled after each failure up to max_retry_interval_ms
+    uint32_t retry_interval_ms{10};
+    uint32_t max_retry_interval_ms{250};
+    // a headless EGL display for the textures and buffers that outlive a connection
+    bool persistent_gpu{true};
+    EglConfigAttribs gpu_attribs{};
+};
+
+class WAYPP_EXPORT ReconnectSession {
+public:
+    // builds the WindowManager for each connection, it may throw std::runtime_error while there is no compositor
+    typedef std::function<std::unique_ptr<WindowManager>()> Factory;
+
+    // recreates the surfaces on a new WindowManager, reconnected is false for the first one
+    typedef std::function<void(WindowManager &wm, bool reconnected)> Restore;
+
+    ReconnectSession(const Factory &factory, const Restore &restore, const ReconnectConfig &config = {});
+
+    ~ReconnectSession();
+
+    ReconnectSession(const ReconnectSession &) = delete;
+
+    ReconnectSession &operator=(const ReconnectSession &) = delete;
+
+    // nullptr only if the compositor did not come back, see reconnect()
+    [[nodiscard]] WindowManager *get_window_manager() const { return wm_.get(); }
+
+    // nullptr without persistent_gpu or a headless EGL platform
+    [[nodiscard]] const EglDisplay *get_gpu_display() const { return gpu_display_.get(); }
+
+    int poll_events(int timeout);
+
+    int dispatch(int timeout);
+
+    bool reconnect();
+
+    // called with the connection error before the WindowManager is destroyed
+    void set_disconnect_callback(const std::function<void(WindowManager &wm, int error)> &callback) {
+        disconnect_callback_ = callback;
+    }
+
+    [[nodiscard]] uint32_t get_reconnect_count() const { return reconnects_; }
+
+    // from losing the connection until the surfaces were restored, 0 before the first reconnect
+    [[nodiscard]] uint64_t get_last_reconnect_ns() const { return last_reconnect_ns_; }
+
+private:
+    Factory factory_;
+    Restore restore_;
+    ReconnectConfig config_;
+    std::function<void(WindowManager &wm, int error)> disconnect_callback_;
+
+    // outlives every WindowManager, so it is declared first
+    std::unique_ptr<EglDisplay> gpu_display_;
+    std::unique_ptr<WindowManager> wm_;
+    // an idle source on the GMainContext, the WindowManager is not destroyed from within its own dispatch,
+    // then a timeout source per further attempt
+    GSource *reconnect_source_{};
+    // of the attempts made from reconnect_source_
+    uint64_t retry_deadline_ns_{};
+    uint32_t retry_interval_ms_{};
+    // inside the WindowManager's dispatch, reconnecting waits until it returned
+    bool dispatching_{};
+    uint64_t lost_ns_{};
+    uint32_t reconnects_{};
+    uint64_t last_reconnect_ns_{};
+
+    std::unique_ptr<WindowManager> connect(uint64_t deadline_ns);
+
+    std::unique_ptr<WindowManager> try_connect();
+
+    [[nodiscard]] uint32_t next_interval(uint32_t interval_ms) const;
+
+    [[nodiscard]] uint64_t deadline() const;
+
+    void attach(bool reconnected);
+
+    void release_window_manager();
+
+    void restored();
+
+    void schedule_retry(GMainContext *context, GSource *source);
+
+    void retry(GMainContext *context);
+
+    int after_dispatch(int result);
+};
+
+#endif // SRC_WINDOW_MANAGER_RECONNECT_SESSION_H_
@@ -0,0 +1,193 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "screenshooter.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "display.h"
+#include "output.h"
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+/**
+ * @class Screenshooter
+ * @brief Output captures through agl_screenshooter.
+ *
+ * The compositor writes a shot into a wl_shm buffer the size of the output's
+ * current mode. Each output keeps its buffer, in a memfd pool of its own, and
+ * reuses it for every capture until the mode changes, so continuous capture
+ * allocates nothing after the first shot. The image handed to the callback is
+ * the mapping of that buffer and stays valid until the next capture of the
+ * same output; its fd and offset let another process or API import it without
+ * a copy.
+ *
+ * The compositor takes one shot at a time. Captures requested while one is in
+ * flight queue up and are sent as the previous ones complete.
+ */
+Screenshooter::Screenshooter(const Display *display, uint32_t format) :
+        wl_shm_(display->get_shm()), format_(format) {
+    if (!wl_shm_) {
+        throw std::runtime_error("wl_shm is not available.");
+    }
+    if (format_ != WL_SHM_FORMAT_XRGB8888 && format_ != WL_SHM_FORMAT_ARGB8888) {
+        throw std::runtime_error("Unsupported capture format " + std::to_string(format_));
+    }
+    agl_screenshooter_ = static_cast<struct agl_screenshooter *>(
+            display->bind_global(&agl_screenshooter_interface, 1));
+    if (!agl_screenshooter_) {
+        throw std::runtime_error("agl_screenshooter is not available.");
+    }
+    agl_screenshooter_add_listener(agl_screenshooter_, &listener_, this);
+}
+
+Screenshooter::~Screenshooter() {
+    agl_screenshooter_destroy(agl_screenshooter_);
+    for (auto &[wl_output, target]: targets_) {
+        destroy_target(target);
+    }
+}
+
+/**
+ * @brief Captures output into its reusable shm buffer.
+ *
+ * @param output The output to capture, at the size of its current mode.
+ * @param callback Gets the status and, on success, the mapped image.
+ * @return false if the buffer could not be created.
+ */
+bool Screenshooter::capture(const Output *output, const CaptureCallback &callback) {
+    auto target = get_target(output);
+    if (!target) {
+        return false;
+    }
+    submit({
+            .output = output->get_output(),
+            .buffer = target->image.wl_buffer,
+            .image = target->image,
+            .callback = callback,
+    });
+    return true;
+}
+
+/**
+ * @brief Captures output into a buffer of the caller's.
+ *
+ * The compositor writes only wl_shm buffers of the output's size; others
+ * complete with AGL_SCREENSHOOTER_DONE_STATUS_BAD_BUFFER.
+ *
+ * @param callback Gets the status and, on success, an image naming the buffer, without a mapping.
+ */
+void Screenshooter::capture(const Output *output, struct wl_buffer *buffer, const CaptureCallback &callback) {
+    const auto &mode = output->get_mode();
+    submit({
+            .output = output->get_output(),
+            .buffer = buffer,
+            .image = {
+                    .data = nullptr,
+                    .width = mode.width,
+                    .height = mode.height,
+                    .stride = 0,
+                    .format = 0,
+                    .fd = -1,
+                    .offset = 0,
+                    .wl_buffer = buffer,
+            },
+            .callback = callback,
+    });
+}
+
+Screenshooter::Target *Screenshooter::get_target(const Output *output) {
+    const auto &mode = output->get_mode();
+    if (mode.width <= 0 || mode.height <= 0) {
+        LOG_ERROR("Output has no mode to capture");
+        return nullptr;
+    }
+    auto &target = targets_[output->get_output()];
+    if (target.image.wl_buffer && target.image.width == mode.width && target.image.height == mode.height) {
+        return &target;
+    }
+
+    bool in_flight = std::any_of(requests_.begin(), requests_.end(), [&](const Request &request) {
+        return target.image.wl_buffer && request.buffer == target.image.wl_buffer;
+    });
+    if (in_flight) {
+        // the mode changed with a shot of the old size queued; it completes before a new buffer is made
+        LOG_ERROR("Capture of the previous mode still pending");
+        return nullptr;
+    }
+    destroy_target(target);
+
+    auto stride = mode.width * 4;
+    if (!shm_pool_) {
+        try {
+            // one memfd for every output's target, grown as outputs are added or change modes
+            shm_pool_ = std::make_unique<ShmPool>(wl_shm_, "waypp-capture");
+        } catch (const std::exception &e) {
+            LOG_ERROR("Capture buffer allocation failed: %s", e.what());
+            return nullptr;
+        }
+    }
+    target.shm = shm_pool_->create_buffer(mode.width, mode.height, stride, format_);
+    if (!target.shm) {
+        LOG_ERROR("Capture buffer allocation failed");
+        return nullptr;
+    }
+    target.image = {
+            .data = target.shm->data,
+            .width = mode.width,
+            .height = mode.height,
+            .stride = stride,
+            .format = format_,
+            .fd = shm_pool_->get_fd(),
+            .offset = target.shm->offset,
+            .wl_buffer = target.shm->wl_buffer,
+    };
+    return &target;
+}
+
+void Screenshooter::destroy_target(Target &target) {
+    if (target.shm) {
+        shm_pool_->destroy_buffer(target.shm);
+    }
+    target = {};
+}
+
+void Screenshooter::submit(Request request) {
+    requests_.push_back(std::move(request));
+    if (requests_.size() == 1) {
+        agl_screenshooter_take_shot(agl_screenshooter_, requests_.front().output, requests_.front().buffer);
+    }
+}
+
+void Screenshooter::handle_done(struct agl_screenshooter * /* screenshooter */, uint32_t status) {
+    if (requests_.empty()) {
+        return;
+    }
+    auto request = std::move(requests_.front());
+    requests_.pop_front();
+    if (!requests_.empty()) {
+        agl_screenshooter_take_shot(agl_screenshooter_, requests_.front().output, requests_.front().buffer);
+    }
+    if (request.callback) {
+        request.callback(status, status == AGL_SCREENSHOOTER_DONE_STATUS_SUCCESS ? &request.image : nullptr);
+    }
+}
+
+const struct agl_screenshooter_listener Screenshooter::listener_ = {
+        .done = listener_thunk<&Screenshooter::handle_done>,
+};
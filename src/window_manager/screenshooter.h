@@ -0,0 +1,105 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_SCREENSHOOTER_H_
+#define SRC_WINDOW_MANAGER_SCREENSHOOTER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+
+#include <wayland-client.h>
+
+#include "agl-screenshooter-client-protocol.h"
+
+#include "utils/flat_map.h"
+#include "window/shm_pool.h"
+#include "utils/export.h"
+
+class Display;
+
+class Output;
+
+struct CaptureImage {
+    // mapping of the pixels, stride * height bytes; nullptr for a buffer of the caller's
+    const void *data;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    uint32_t format;
+    // the memfd and offset of the pixels, to import the image elsewhere without a copy
+    int fd;
+    size_t offset;
+    struct wl_buffer *wl_buffer;
+};
+
+class WAYPP_EXPORT Screenshooter {
+public:
+    // AGL_SCREENSHOOTER_DONE_STATUS_* , and nullptr unless it succeeded
+    typedef std::function<void(uint32_t status, const CaptureImage *image)> CaptureCallback;
+
+    explicit Screenshooter(const Display *display, uint32_t format = WL_SHM_FORMAT_XRGB8888);
+
+    ~Screenshooter();
+
+    Screenshooter(const Screenshooter &) = delete;
+
+    Screenshooter &operator=(const Screenshooter &) = delete;
+
+    bool capture(const Output *output, const CaptureCallback &callback);
+
+    void capture(const Output *output, struct wl_buffer *buffer, const CaptureCallback &callback);
+
+    [[nodiscard]] size_t get_pending() const { return requests_.size(); }
+
+private:
+    // one output's capture target, reused until its mode changes
+    struct Target {
+        ShmPool::Buffer *shm{};
+        CaptureImage image{};
+    };
+
+    struct Request {
+        struct wl_output *output;
+        struct wl_buffer *buffer;
+        // the image handed to callback, a target's or one describing a buffer of the caller's
+        CaptureImage image;
+        CaptureCallback callback;
+    };
+
+    struct agl_screenshooter *agl_screenshooter_{};
+    struct wl_shm *wl_shm_;
+    uint32_t format_;
+    FlatMap<struct wl_output *, Target> targets_;
+    std::unique_ptr<ShmPool> shm_pool_;
+    // the compositor takes one shot at a time, the front one is in flight
+    std::deque<Request> requests_;
+
+    Target *get_target(const Output *output);
+
+    void destroy_target(Target &target);
+
+    void submit(Request request);
+
+    void handle_done(struct agl_screenshooter *screenshooter, uint32_t status);
+
+    static const struct agl_screenshooter_listener listener_;
+};
+
+#endif // SRC_WINDOW_MANAGER_SCREENSHOOTER_H_
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_WINDOW_CONFIG_H_
+#define SRC_WINDOW_MANAGER_WINDOW_CONFIG_H_
+
+#include <cstdint>
+
+#include <EGL/egl.h>
+#include <wayland-client.h>
+
+#include "window/egl_display.h"
+#include "window/render_surface.h"
+#include "window/window.h"
+
+/**
+ * @brief Everything WindowManager::create_window(const WindowConfig &) sets up, in one aggregate.
+ *
+ * A literal type, so a config known at build time is checked at build time:
+ *
+ * @code
+ * static constexpr WindowConfig kConfig{.backend = RenderSurface::SHM, .width = 320, .height = 240, .opaque = true};
+ * static_assert(kConfig.valid(), "bad window config");
+ * @endcode
+ *
+ * create_window() runs the same check on configs made at run time.
+ */
+struct WindowConfig {
+    typedef enum {
+        // render at the surface size times the output scale
+        SCALE_FIXED,
+        // lower the render resolution when frames miss the refresh, see ResolutionGovernor
+        SCALE_GOVERNED,
+    } ScalePolicy;
+
+    typedef enum {
+        // draw as soon as the compositor's frame callback arrives
+        SCHEDULE_FRAME_CALLBACK,
+        // draw at the latest time that still makes the next vblank, see Window::enable_frame_scheduler()
+        SCHEDULE_DEADLINE,
+        // draw only after Window::request_redraw()
+        SCHEDULE_ON_DEMAND,
+    } SchedulerMode;
+
+    RenderSurface::Backend backend{RenderSurface::EGL};
+    int width{640};
+    int height{480};
+    // nullptr keeps the toplevel's title and app id
+    const char *title{};
+    const char *app_id{};
+
+    // EGL color, depth and stencil sizes and samples
+    EglConfigAttribs egl{};
+    // wl_shm format of an SHM window
+    uint32_t shm_format{WL_SHM_FORMAT_XRGB8888};
+    // SHM ring or Vulkan swapchain size, 0 for the backend's default; 2 or 3 for EGL, see WindowEglConfig::Buffering
+    uint32_t buffer_count{};
+    // no alpha, and a full-surface opaque region so the compositor can skip what is below
+    bool opaque{};
+    // EGL windows only: a context of their own instead of the shared one
+    bool own_context{};
+    // EGL windows only: swap on a present thread, see WindowEgl::enable_present_thread()
+    bool present_thread{};
+
+    ScalePolicy scale_policy{SCALE_FIXED};
+    // EGL windows only, in (0, 1]: render below the surface size and let the viewport scale up
+    double render_scale{1.0};
+
+    // false presents without waiting for vblank: the async tearing hint, and IMMEDIATE for Vulkan
+    bool vsync{true};
+    // vsync in the compositor with wp_fifo_v1 when available, see Window::set_fifo()
+    bool fifo{};
+    // commits tagged with the predicted presentation time when available, see Window::set_commit_timing()
+    bool commit_timing{};
+    // EGL_CONTEXT_PRIORITY_*_IMG for the EGL contexts, 0 to keep the default; only before the first EGL window
+    EGLint context_priority{};
+    Window::ContentType content_type{Window::CONTENT_NONE};
+    // the color space drawn in, nullptr for sRGB; see Window::set_color_description()
+    const ColorDescription *color{};
+
+    SchedulerMode scheduler{SCHEDULE_FRAME_CALLBACK};
+    // time kept free before the vblank with SCHEDULE_DEADLINE
+    uint32_t scheduler_margin_us{1000};
+    // frame rate cap, 0 for none
+    uint32_t max_fps{};
+
+    /**
+     * @return Why the combination cannot work, nullptr if it can.
+     */
+    [[nodiscard]] constexpr const char *get_error() const {
+        if (width <= 0 || height <= 0) {
+            return "width and height must be positive";
+        }
+        if (fifo && !vsync) {
+            return "fifo holds every frame for a refresh, which is vsync";
+        }
+        if (buffer_count == 1) {
+            return "a single buffer cannot be drawn while the compositor shows it";
+        }
+        if (buffer_count > 3 && backend == RenderSurface::EGL) {
+            return "EGL windows are double or triple buffered";
+        }
+        if (opaque && backend == RenderSurface::SHM &&
+            (shm_format == WL_SHM_FORMAT_ARGB8888 || shm_format == WL_SHM_FORMAT_ABGR8888)) {
+            return "an opaque window needs a format without alpha";
+        }
+        if (render_scale <= 0.0 || render_scale > 1.0) {
+            return "render_scale must be in (0, 1]";
+        }
+        if (backend != RenderSurface::EGL) {
+            if (render_scale != 1.0 || scale_policy == SCALE_GOVERNED) {
+                return "only EGL windows render below the surface size";
+            }
+            if (own_context) {
+                return "own_context is for EGL windows";
+            }
+            if (present_thread) {
+                return "present_thread is for EGL windows";
+            }
+            if (context_priority) {
+                return "context_priority is for EGL windows";
+            }
+        }
+        return nullptr;
+    }
+
+    [[nodiscard]] constexpr bool valid() const { return get_error() == nullptr; }
+};
+
+#endif // SRC_WINDOW_MANAGER_WINDOW_CONFIG_H_
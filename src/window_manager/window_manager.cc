@@ -16,12 +16,24 @@
 
 #include "window_manager.h"
 
-#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
 
-#include <poll.h>
+#include <linux/input-event-codes.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <wayland-client.h>
 
-#include "window/window_vulkan.h"
+#include "protocol_stats.h"
+#include "utils/listener.h"
+#include "utils/logging.h"
+#include "utils/startup_profiler.h"
+#include "utils/trace.h"
 
 
 /**
@@ -31,31 +43,183 @@
  *
  * The WindowManager class extends the Display and Window classes and is used to create and manage windows in a graphical user interface application.
  *
+ * When wait_for_configure is false the constructor returns as soon as the toplevel is
+ * created, so EGL setup and asset loading can overlap the compositor round trip, see
+ * start_async(). Use configured(), wait_for_configure() or set_configure_callback() before
+ * the first buffer is attached.
+ *
+ * With BIND_ON_FIRST_USE outputs and seats are not bound until the application asks
+ * for them, see Display::BindPolicy; surface enter events and input need them bound.
+ *
+ * A fullscreen or maximized initial_state, optionally on a named output, is sent before
+ * the first commit, so windows created after the configure start at the final size
+ * instead of mapping at their requested size and reallocating, see resolve_initial_size().
+ *
+ * With ShellType IVI the toplevel becomes the ivi surface ivi_id, or
+ * IviShell::get_default_id() if 0. Its layout comes from the controller and
+ * there is no configure to wait for, so the first frame goes out right away.
+ *
  * @see Display
  * @see Window
  * @see XdgWm
  */
 WindowManager::WindowManager(Window::ShellType shell_type, GMainContext *context, bool enable_cursor,
-                             const char *name) :
-        Display(context, enable_cursor, name),
+                             const char *name, bool wait_for_configure, uint32_t input_devices,
+                             uint32_t ivi_id, BindPolicy bind_policy, const XdgWm::InitialState &initial_state) :
+        Display(context, enable_cursor, name, input_devices, bind_policy),
         Window(wl_compositor_, shell_type,
-               [&](void * /* data */, uint32_t /* time */) { std::cerr << "base draw" << std::endl; }),
+               [&](void * /* data */, uint32_t /* time */) { LOG_DEBUG("base draw"); }),
         shell_type_(shell_type) {
 
+    post_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (post_fd_ < 0) {
+        throw std::runtime_error(std::string("eventfd: ") + strerror(errno));
+    }
+    post_source_ = g_source_new(&post_source_funcs_, sizeof(GSource));
+    g_source_add_unix_fd(post_source_, post_fd_, G_IO_IN);
+    g_source_set_callback(post_source_, [](gpointer data) -> gboolean {
+        static_cast<WindowManager *>(data)->run_posted_tasks();
+        return G_SOURCE_CONTINUE;
+    }, this, nullptr);
+    g_source_set_name(post_source_, "waypp posted tasks");
+    g_source_attach(post_source_, context_);
+
+    // the Window pointer stays the user data, see Window::from_surface()
+    wl_surface_add_listener(this->wl_surface_, &surface_listener_, static_cast<Window *>(this));
+    // a mode switch or rescale of an output the window is on repaints and rescales it once
+    add_output_change_callback([this](const Output &output, uint32_t changes) {
+        if (changes & Output::POWER) {
+            update_hidden();
+        }
+        if (!(changes & (Output::MODE | Output::SCALE)) ||
+            std::find(entered_outputs_.begin(), entered_outputs_.end(), output.get_output()) ==
+            entered_outputs_.end()) {
+            return;
+        }
+        if (&output == primary_output_) {
+            primary_output_ = nullptr;
+        }
+        update_primary_output();
+    });
+    add_output_remove_callback([this](const Output &output) {
+        // its members draw ungrouped from now on
+        frame_groups_.erase(&output);
+        entered_outputs_.erase(std::remove(entered_outputs_.begin(), entered_outputs_.end(), output.get_output()),
+                               entered_outputs_.end());
+        if (&output == primary_output_) {
+            primary_output_ = nullptr;
+            set_frame_clock(nullptr);
+            for (auto surface: render_surfaces_) {
+                surface->set_frame_clock(nullptr);
+            }
+            for (const auto &toplevel: toplevels_) {
+                toplevel->set_frame_clock(nullptr);
+                if (toplevel->get_content()) {
+                    toplevel->get_content()->set_frame_clock(nullptr);
+                }
+            }
+        }
+        update_primary_output();
+        update_hidden();
+    });
+
+    // fractional scales are applied through a viewport, so the protocol is only useful together
+    if (get_fractional_scale_manager() && get_viewporter()) {
+        wp_fractional_scale_ = wp_fractional_scale_manager_v1_get_fractional_scale(get_fractional_scale_manager(),
+                                                                                   this->wl_surface_);
+        wp_fractional_scale_v1_add_listener(wp_fractional_scale_, &fractional_scale_listener_, this);
+    }
+
     if (shell_type == XDG) {
-        xdg_wm_ = std::make_unique<XdgWm>(this->wl_display_, this->wl_surface_);
+        XdgWm::InitialState state = initial_state;
+        if (state.output_name && !state.output) {
+            for (const auto &[wl_output, output]: get_outputs()) {
+                if (output->get_name() == state.output_name) {
+                    state.output = wl_output;
+                    break;
+                }
+            }
+            if (!state.output) {
+                LOG_WARN("WindowManager: no output named %s, the compositor picks one", state.output_name);
+            }
+        }
+        xdg_wm_ = std::make_unique<XdgWm>(this, this->wl_surface_, state);
+        xdg_wm_->set_suspended_callback([this](bool /* suspended */) { update_hidden(); });
+        // configures are acked by the frame that applies them, or at once while no frames are drawn
+        xdg_wm_->set_deferred_ack(true);
+        xdg_wm_->set_state_callback([this]() {
+            update_focus();
+            if (decorations_) {
+                decorations_state_pending_ = true;
+            }
+            if (is_paused()) {
+                (void) xdg_wm_->ack_configure();
+            } else if (decorations_ || xdg_wm_->has_pending_ack()) {
+                request_redraw();
+            }
+        });
+        set_pointer_button_callback([this](Seat &seat, const PointerButton &button) {
+            handle_pointer_button(seat, button);
+        });
+        xdg_wm_->set_ping_callback([this]() {
+            if (watchdog_) {
+                watchdog_->record_ping();
+            }
+        });
+        // configures arriving in a burst, e.g. during an interactive resize, only keep the latest size
+        xdg_wm_->set_resize_callback([this](int width, int height) {
+            pending_size_ = {width, height, true};
+            request_redraw();
+        });
 
         // this makes the start-up from the beginning with the correct dimensions
         // like starting as maximized/fullscreen, rather than starting up as floating
         // width, height then performing a resize
-        while (xdg_wm_->get_wait_for_configure()) {
-            wl_display_dispatch(wl_display_);
-
-            // wait until xdg_surface::configure ACKs the new dimensions
-            if (xdg_wm_->get_wait_for_configure())
-                continue;
+        if (wait_for_configure && this->wait_for_configure(-1)) {
+            LOG_DEBUG("configured.");
+        }
+    } else if (shell_type == AGL) {
+#if defined(ENABLE_AGL_SHELL_CLIENT)
+        // the toplevel surface is the homescreen background, the compositor sizes it to the output
+        agl_shell_ = std::make_unique<AglShell>(this);
+        if (get_outputs().empty()) {
+            throw std::runtime_error("agl_shell needs an output.");
         }
-        std::cout << "configured." << std::endl;
+        agl_shell_->set_background(wl_surface_, get_outputs().begin()->first);
+#else
+        throw std::runtime_error("built without ENABLE_AGL_SHELL_CLIENT.");
+#endif
+    } else if (shell_type == IVI) {
+#if defined(ENABLE_IVI_SHELL_CLIENT)
+        ivi_shell_ = std::make_unique<IviShell>(this);
+        ivi_surface_ = ivi_shell_->create_surface(ivi_id ? ivi_id : IviShell::get_default_id(), wl_surface_);
+        ivi_surface_->set_configure_callback([this](int width, int height) {
+            pending_size_ = {width, height, true};
+            request_redraw();
+        });
+#else
+        throw std::runtime_error("built without ENABLE_IVI_SHELL_CLIENT.");
+#endif
+    }
+#if !defined(ENABLE_IVI_SHELL_CLIENT)
+    (void) ivi_id;
+#endif
+
+    enable_presentation_feedback(get_presentation(), get_presentation_clock());
+    // input on any seat is attributed to the toplevel, the surface every window draws to
+    set_input_callback([this](uint64_t time_ns) { record_input(time_ns); });
+    set_keyboard_focus_callback([this](struct wl_surface *surface, bool focused) {
+        handle_keyboard_focus(surface, focused);
+    });
+    get_input_router().add(wl_surface_, &get_input_ring());
+    enable_content_type(get_content_type_manager());
+    enable_alpha_modifier(get_alpha_modifier());
+    enable_color_management(get_color_manager());
+    enable_fifo(get_fifo_manager());
+    enable_commit_timing(get_commit_timing_manager());
+    // the outputs bound so far, so BIND_ON_FIRST_USE does not bind them here
+    if (!wl_outputs_.empty()) {
+        set_refresh_hint(wl_outputs_.begin()->second->get_mode().refresh);
     }
 
     start_frames();
@@ -64,59 +228,592 @@ WindowManager::WindowManager(Window::ShellType shell_type, GMainContext *context
 /**
  * @brief Destructor for the WindowManager class.
  *
- * This destructor stops rendering frames for all windows controlled by the WindowManager.
- * It calls the stop_frames() function to stop rendering frames.
+ * This destructor joins the event thread, if running, and stops rendering frames for all
+ * windows controlled by the WindowManager. It calls the stop_frames() function to stop rendering frames.
  */
 WindowManager::~WindowManager() {
+    stop_event_thread();
+    if (egl_init_thread_.joinable()) {
+        egl_init_thread_.join();
+    }
+    if (asset_thread_.joinable()) {
+        asset_thread_.join();
+    }
+    set_event_loop(nullptr);
+    watchdog_.reset();
+    // the window outlives the groups, which are members of the WindowManager
+    if (get_frame_group()) {
+        group_pending_ = false;
+        get_frame_group()->remove(this);
+    }
+    get_input_router().remove(wl_surface_);
+    for (const auto &toplevel: toplevels_) {
+        get_input_router().remove(toplevel->get_surface());
+    }
     stop_frames();
+    // topmost first
+    while (!popups_.empty()) {
+        popups_.pop_back();
+    }
+    if (wp_fractional_scale_) {
+        wp_fractional_scale_v1_destroy(wp_fractional_scale_);
+    }
+#if defined(ENABLE_TEARING_CONTROL)
+    tearing_control_.reset();
+#endif
+    if (post_source_) {
+        g_source_destroy(post_source_);
+        g_source_unref(post_source_);
+    }
+    close(post_fd_);
+}
+
+/**
+ * @brief Chooses between tear-free and lowest latency presentation of the toplevel.
+ *
+ * EGL windows already swap with interval 0, so with the async hint a fullscreen window's
+ * frames are flipped as soon as they are committed. Vulkan windows also need
+ * VK_PRESENT_MODE_IMMEDIATE_KHR, see WindowVulkan::set_present_mode(). Takes effect
+ * with the next frame.
+ *
+ * @param hint TearingControl::ASYNC to allow tearing, TearingControl::VSYNC to wait for vblank.
+ * @return false if the compositor has no wp_tearing_control_manager_v1, or it is not built in.
+ */
+bool WindowManager::set_presentation_hint(TearingControl::PresentationHint hint) {
+#if defined(ENABLE_TEARING_CONTROL)
+    if (!get_tearing_control_manager()) {
+        return false;
+    }
+    if (!tearing_control_) {
+        tearing_control_ = std::make_unique<TearingControl>(get_tearing_control_manager(), this->wl_surface_);
+    }
+    tearing_control_->set_presentation_hint(hint);
+    // a frame meant to tear in should not wait for the loop's batched flush
+    set_flush_on_commit(hint == TearingControl::ASYNC ? this->wl_display_ : nullptr);
+    request_redraw();
+    return true;
+#else
+    (void) hint;
+    return false;
+#endif
+}
+
+/**
+ * @brief Reports whether the toplevel has received its initial configure.
+ *
+ * Shells without a configure handshake are always considered configured.
+ *
+ * @return true once xdg_surface::configure has been acknowledged.
+ */
+bool WindowManager::configured() const {
+    return !xdg_wm_ || xdg_wm_->configured();
+}
+
+/**
+ * @brief Dispatches the default queue until the toplevel is configured.
+ *
+ * Must not be called while the event thread is running; use set_configure_callback()
+ * in that case.
+ *
+ * @param timeout The maximum time to wait in milliseconds, or -1 to wait indefinitely.
+ * @return true if the toplevel is configured, false on timeout or display error.
+ */
+bool WindowManager::wait_for_configure(int timeout) {
+    StartupScope scope(StartupProfiler::CONFIGURE_WAIT);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+    while (!configured()) {
+        int remaining = -1;
+        if (timeout >= 0) {
+            remaining = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - std::chrono::steady_clock::now()).count());
+            if (remaining <= 0)
+                return false;
+        }
+        if (poll_events(remaining) < 0)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Sets a callback invoked once the toplevel receives its initial configure.
+ *
+ * The callback runs on whichever thread dispatches the default queue. If the toplevel
+ * is already configured the callback is invoked immediately. Set it before calling
+ * start_event_thread().
+ *
+ * @param callback The function to invoke.
+ */
+void WindowManager::set_configure_callback(const std::function<void()> &callback) {
+    if (configured()) {
+        if (callback)
+            callback();
+        return;
+    }
+    xdg_wm_->set_configure_callback(callback);
+}
+
+/**
+ * @brief Handles the surface entering an output.
+ *
+ * @param surface The surface that entered the output.
+ * @param output  The output the surface entered.
+ */
+void WindowManager::handle_surface_enter(struct wl_surface * /* surface */,
+                                         struct wl_output *output) {
+    entered_outputs_.push_back(output);
+    has_entered_output_ = true;
+    update_primary_output();
+    update_hidden();
+}
+
+/**
+ * @brief Handles the surface leaving an output.
+ *
+ * @param surface The surface that left the output.
+ * @param output  The output the surface left.
+ */
+void WindowManager::handle_surface_leave(struct wl_surface * /* surface */,
+                                         struct wl_output *output) {
+    entered_outputs_.erase(std::remove(entered_outputs_.begin(), entered_outputs_.end(), output),
+                           entered_outputs_.end());
+    update_primary_output();
+    update_hidden();
+}
+
+/**
+ * @return The outputs the toplevel surface is currently on, in the order it entered them.
+ */
+std::vector<const Output *> WindowManager::get_entered_outputs() const {
+    std::vector<const Output *> outputs;
+    for (const auto output: entered_outputs_) {
+        const auto it = get_outputs().find(output);
+        if (it != get_outputs().end()) {
+            outputs.push_back(it->second.get());
+        }
+    }
+    return outputs;
+}
+
+/**
+ * @brief Picks the output the window is paced and scaled for, and adapts to it.
+ *
+ * Wayland does not tell clients how much of the surface is on each output, so of the
+ * outputs entered the one with the largest scale wins, then the one with the highest
+ * refresh rate: rendering for it looks right everywhere, and the compositor paces
+ * frame callbacks of a surface spanning outputs by the fastest one.
+ *
+ * The frame scheduler follows the refresh rate of the primary output, the cursor its
+ * scale. The buffer scale follows it too unless the compositor sends a preferred scale
+ * of its own.
+ */
+void WindowManager::update_primary_output() {
+    const Output *primary = nullptr;
+    for (const auto output: get_entered_outputs()) {
+        if (!primary || output->get_scale() > primary->get_scale() ||
+            (output->get_scale() == primary->get_scale() &&
+             output->get_mode().refresh > primary->get_mode().refresh)) {
+            primary = output;
+        }
+    }
+    // keep the last primary while hidden, so the window comes back as it was
+    if (!primary || primary == primary_output_) {
+        return;
+    }
+    primary_output_ = primary;
+
+    set_frame_clock(&primary->get_frame_clock());
+    for (auto surface: render_surfaces_) {
+        surface->set_frame_clock(&primary->get_frame_clock());
+    }
+    for (const auto &toplevel: toplevels_) {
+        toplevel->set_frame_clock(&primary->get_frame_clock());
+        if (toplevel->get_content()) {
+            toplevel->get_content()->set_frame_clock(&primary->get_frame_clock());
+        }
+    }
+    set_refresh_hint(primary->get_mode().refresh);
+
+    bool compositor_scale = wp_fractional_scale_ != nullptr;
+#if defined(WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION)
+    compositor_scale |= get_compositor_version() >= WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION;
+#endif
+    if (!compositor_scale) {
+        set_preferred_scale(static_cast<uint32_t>(primary->get_scale()) * 120);
+    }
+
+    for (const auto &[wl_seat, seat]: wl_seats_) {
+        if (seat->get_pointer()) {
+            (void) seat->get_pointer()->set_cursor_scale(primary->get_scale());
+        }
+    }
+}
+
+#if defined(WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION)
+/**
+ * @brief Handles the integer scale preferred by the compositor, sent by wl_surface v6.
+ *
+ * Ignored when wp_fractional_scale_v1 is in use, it reports the same scale more precisely.
+ *
+ * @param surface The toplevel surface.
+ * @param factor  The preferred buffer scale.
+ */
+void WindowManager::handle_preferred_buffer_scale(struct wl_surface * /* surface */, int32_t factor) {
+    if (wp_fractional_scale_ || factor < 1) {
+        return;
+    }
+    set_preferred_scale(static_cast<uint32_t>(factor) * 120);
+}
+
+/**
+ * @brief Handles the preferred buffer transform, sent by wl_surface v6.
+ *
+ * Buffers are always rendered untransformed.
+ */
+void WindowManager::handle_preferred_buffer_transform(struct wl_surface * /* surface */,
+                                                      uint32_t /* transform */) {
+}
+#endif
+
+/**
+ * @brief Handles the fractional scale preferred by the compositor.
+ *
+ * @param fractional_scale The fractional scale object of the toplevel surface.
+ * @param scale            The preferred scale, times 120.
+ */
+void WindowManager::handle_fractional_scale(struct wp_fractional_scale_v1 * /* fractional_scale */,
+                                            uint32_t scale) {
+    set_preferred_scale(scale);
+}
+
+/**
+ * @brief Records a new preferred scale, applied to the windows before the next draw.
+ *
+ * Repeats of the current scale are dropped, so buffers are only reallocated when the
+ * scale actually changes.
+ *
+ * @param scale The preferred scale, times 120.
+ */
+void WindowManager::set_preferred_scale(uint32_t scale) {
+    if (scale == 0 || scale == preferred_scale_) {
+        return;
+    }
+    preferred_scale_ = scale;
+    scale_pending_ = true;
+    request_redraw();
+}
+
+/**
+ * @brief Signals the AGL shell ready once the first frame is committed.
+ *
+ * Panels set with AglShell::set_panel() must be set up before it.
+ */
+void WindowManager::frame_committed() {
+#if defined(ENABLE_AGL_SHELL_CLIENT)
+    if (agl_shell_) {
+        agl_shell_->ready();
+    }
+#endif
+    // refill after the commit, so the frame itself never waits for it
+    if (window_pool_) {
+        window_pool_->warm_one();
+    }
+    if (metrics_export_) {
+        publish_metrics();
+    }
+}
+
+/**
+ * @brief Applies the latest preferred scale, configured size and governed render scale to the windows before a
+ * draw.
+ *
+ * wl_egl_window_resize takes effect on the next eglSwapBuffers, so the draw that
+ * follows renders at the new size without recreating any surface. Vulkan windows
+ * recreate their swapchain on the next acquire, SHM windows reallocate their pool.
+ * The preferred scale is not applied to Vulkan and dmabuf windows, see get_preferred_scale().
+ */
+void WindowManager::prepare_frame() {
+    // the first frame draws with the assets start_async() loaded
+    if (asset_thread_.joinable()) {
+        asset_thread_.join();
+    }
+
+    // before the configured size is taken, so the size applied is never older than the serial acked
+    if (xdg_wm_) {
+        (void) xdg_wm_->ack_configure();
+    }
+
+    // the first frame after being hidden past the release delay
+    if (surfaces_released_.exchange(false)) {
+        for (const auto &window: windows_) {
+            (void) window->restore_surface();
+        }
+    }
+
+    for (auto surface: render_surfaces_) {
+        // a GPU-bound frame can take longer on the GPU than its draw callback took on the CPU
+        surface->report_frame_time(std::max(get_last_render_time_ns(), surface->get_last_gpu_time_ns()),
+                                   get_refresh_interval_ns());
+    }
+
+    if (scale_pending_) {
+        scale_pending_ = false;
+        for (auto surface: render_surfaces_) {
+            surface->set_output_scale(get_preferred_scale());
+        }
+    }
+
+    if (decorations_ && decorations_state_pending_ &&
+        xdg_wm_->get_decoration_mode() == XdgWm::DECORATION_SERVER_SIDE) {
+        decorations_.reset();
+        xdg_wm_->set_window_geometry(0, 0, content_size_.width, content_size_.height);
+    }
+    if (decorations_ && decorations_state_pending_.exchange(false)) {
+        const bool visible = decorations_->is_visible();
+        decorations_->set_state(xdg_wm_->is_activated(), xdg_wm_->is_maximized());
+        decorations_->set_visible(!xdg_wm_->is_fullscreen());
+        if (visible != decorations_->is_visible() && !pending_size_.pending) {
+            update_decorations();
+        }
+    }
+
+    if (pending_size_.pending) {
+        pending_size_.pending = false;
+        // the configured size is that of the window geometry, which includes the titlebar
+        const int titlebar = decorations_ ? decorations_->get_height() : 0;
+        content_size_ = {pending_size_.width, std::max(1, pending_size_.height - titlebar)};
+        for (auto surface: render_surfaces_) {
+            surface->resize(content_size_.width, content_size_.height);
+        }
+        if (decorations_) {
+            update_decorations();
+        }
+    }
+
+    // only renders when the title, state or width changed
+    if (decorations_) {
+        (void) decorations_->update(content_size_.width);
+    }
+    if (input_region_) {
+        (void) input_region_->update(content_size_.width, content_size_.height);
+    }
+}
+
+/**
+ * @brief Limits pointer and touch input to parts of the toplevel surface, e.g. inside its drop shadow.
+ *
+ * Rectangles anchored to the right or bottom edge follow resizes, the region is
+ * re-sent only when a resize changes it. Applied with the next frame.
+ *
+ * @code
+ * wm.set_input_region({InputRegion::inset(24, 24, 24, 24)});
+ * @endcode
+ *
+ * @param rects The rectangles, see InputRegion::Rect; empty for the whole surface.
+ */
+void WindowManager::set_input_region(const std::vector<InputRegion::Rect> &rects) {
+    if (!input_region_) {
+        input_region_ = std::make_unique<InputRegion>(this->wl_compositor_, this->wl_surface_);
+    }
+    input_region_->set_rects(rects);
+    request_redraw();
+}
+
+/**
+ * @brief Draws a titlebar on a subsurface, if the compositor does not decorate the window.
+ *
+ * Does nothing once server-side decorations were negotiated, and drops the
+ * titlebar if they are granted later. The titlebar is redrawn only when the
+ * toplevel's state or width changes, never as part of the window's draw.
+ *
+ * @param width  The current width of the toplevel surface.
+ * @param height The current height of the toplevel surface.
+ * @param config Titlebar size and colors.
+ * @return false for shells other than XDG, or with server-side decorations.
+ */
+bool WindowManager::enable_decorations(int width, int height, const DecorationsConfig &config) {
+    if (!xdg_wm_ || xdg_wm_->get_decoration_mode() == XdgWm::DECORATION_SERVER_SIDE) {
+        return false;
+    }
+    decorations_ = std::make_unique<Decorations>(this->wl_compositor_, this->wl_subcompositor_, this->wl_shm_,
+                                                 this->wl_surface_, config);
+    claim_surface(decorations_->get_surface());
+    decorations_->set_state(xdg_wm_->is_activated(), xdg_wm_->is_maximized());
+    decorations_->set_visible(!xdg_wm_->is_fullscreen());
+    // possibly on the event thread, the titlebar is dropped before the next frame
+    xdg_wm_->set_decoration_callback([this](XdgWm::DecorationMode /* mode */) {
+        decorations_state_pending_ = true;
+        request_redraw();
+    });
+    content_size_ = {width, height};
+    update_decorations();
+    (void) decorations_->update(width);
+    request_redraw();
+    return true;
+}
+
+/**
+ * @brief Sets a callback invoked when the compositor or the titlebar's close button asks to quit.
+ */
+void WindowManager::set_close_callback(const std::function<void()> &callback) {
+    if (xdg_wm_) {
+        xdg_wm_->set_close_callback(callback);
+    }
 }
 
 /**
+ * @brief Starts compositor-driven moves and resizes from left presses, and runs the titlebar buttons.
+ *
+ * A press on the titlebar moves the window, one within the resize margin of the
+ * border resizes it. The compositor then tracks the pointer itself until the
+ * release, so no motion reaches the client during the drag.
+ */
+void WindowManager::handle_pointer_button(Seat &seat, const PointerButton &button) {
+    if (button.button != BTN_LEFT || button.state != WL_POINTER_BUTTON_STATE_PRESSED || !button.surface) {
+        return;
+    }
+    const int x = static_cast<int>(button.x);
+    int y = static_cast<int>(button.y);
+    const bool on_titlebar = decorations_ && button.surface == decorations_->get_surface();
+    const int titlebar = decorations_ ? decorations_->get_height() : 0;
+    if (on_titlebar) {
+        switch (decorations_->hit_test(x, y)) {
+            case Decorations::PART_CLOSE:
+                xdg_wm_->close();
+                return;
+            case Decorations::PART_MAXIMIZE:
+                xdg_wm_->set_maximized(!xdg_wm_->is_maximized());
+                return;
+            case Decorations::PART_MINIMIZE:
+                xdg_wm_->set_minimized();
+                return;
+            case Decorations::PART_TITLEBAR:
+                break;
+            case Decorations::PART_NONE:
+                return;
+        }
+    } else if (button.surface == wl_surface_) {
+        // into window geometry coordinates, which start at the titlebar
+        y += titlebar;
+    } else {
+        return;
+    }
+
+    const int margin = resize_margin_;
+    if (margin > 0 && content_size_.width > 0 && !xdg_wm_->is_maximized() && !xdg_wm_->is_fullscreen() &&
+        xdg_wm_->toplevel_resize(seat.get_seat(), button.serial, x, y, content_size_.width,
+                                 content_size_.height + titlebar, margin)) {
+        return;
+    }
+    if (on_titlebar) {
+        xdg_wm_->toplevel_move(seat.get_seat(), button.serial);
+    }
+}
 
-   * @brief Handles the event when a surface enters the window manager
+/**
+ * @brief Picks the size a new window's first buffers are allocated at, and records it as the toplevel's.
+ *
+ * A size from the initial configure, e.g. for a window that starts maximized or
+ * fullscreen, replaces the requested one; otherwise the request is clamped to the
+ * configure bounds. Either way the first buffers are the right size and are not
+ * reallocated by the first resize.
+ *
+ * @param width, height The requested size, updated in place.
+ */
+void WindowManager::resolve_initial_size(int &width, int &height) {
+    if (xdg_wm_ && xdg_wm_->configured()) {
+        const int titlebar = decorations_ ? decorations_->get_height() : 0;
+        int configured_width, configured_height;
+        if (xdg_wm_->get_configured_size(configured_width, configured_height)) {
+            width = configured_width;
+            height = std::max(1, configured_height - titlebar);
+        } else if (xdg_wm_->get_bounds(configured_width, configured_height)) {
+            width = std::min(width, configured_width);
+            height = std::min(height, std::max(1, configured_height - titlebar));
+        }
+    }
+    if (content_size_.width <= 0) {
+        content_size_ = {width, height};
+    }
+}
 
-   *
-   * @param data The data associated with the event
-   * @param surface The surface that enters the window manager
-   * @param output The output associated with the surface
-   *
-   * This function is called when a surface enters the window manager. It prints a message indicating that the surface has entered.
-   *
-   * Example Usage:
-   *
-   * ```
-   * WindowManager wm;
-   * wl_surface *surface;
-   * wl_output *output;
-   * wm.handle_surface_enter(nullptr, surface, output);
-   * ```
-   *
-   */
-void WindowManager::handle_surface_enter(void * /* data */,
-                                         struct wl_surface * /* surface */,
-                                         struct wl_output * /* output */) {
-    std::cout << "WindowManager::handle_surface_enter" << std::endl;
+/**
+ * @brief Makes the window geometry span the titlebar and the toplevel surface.
+ */
+void WindowManager::update_decorations() {
+    const int titlebar = decorations_->get_height();
+    xdg_wm_->set_window_geometry(0, -titlebar, content_size_.width, content_size_.height + titlebar);
 }
 
 /**
- * @brief Handles the event when a surface leaves an output.
+ * @brief Pauses the frame loop while the window cannot be seen.
  *
- * This function is called when a surface leaves an output. It prints a message
- * to the console indicating that the surface has left the output.
+ * The window is hidden while the toplevel is suspended, once it has been shown
+ * and then left every output, or while every output it is on is powered off, see
+ * Output::is_powered(). The hidden callback can release GPU resources.
+ */
+void WindowManager::update_hidden() {
+    // some compositors keep sending frame callbacks to a blanked output
+    const bool powered_off = !entered_outputs_.empty() &&
+                             std::none_of(entered_outputs_.begin(), entered_outputs_.end(),
+                                          [this](struct wl_output *wl_output) {
+                                              const auto it = wl_outputs_.find(wl_output);
+                                              return it == wl_outputs_.end() || it->second->is_powered();
+                                          });
+    const bool hidden = (xdg_wm_ && xdg_wm_->is_suspended()) ||
+                        (has_entered_output_ && entered_outputs_.empty()) || powered_off;
+    if (hidden == hidden_) {
+        return;
+    }
+    hidden_ = hidden;
+    if (hidden_) {
+        hidden_since_ = std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+    set_paused(hidden_);
+    // no frame is coming to ack a deferred configure
+    if (hidden_ && xdg_wm_) {
+        (void) xdg_wm_->ack_configure();
+    }
+    if (hidden_callback_) {
+        hidden_callback_(hidden_);
+    }
+}
+
+/**
+ * @brief Frees the EGL windows' buffers once the window has been hidden for the release delay.
  *
- * @param data    A pointer to the data associated with the event (unused).
- * @param surface The surface that has left the output.
- * @param output  The output that the surface has left.
+ * Only the wl_egl_window and EGL surface go, see WindowEgl::release_surface(); the
+ * next frame after the window is shown again recreates them in prepare_frame(). A
+ * 4K window with three buffers holds about 100 MB, which on SoCs sharing memory with
+ * the CPU otherwise pushes the visible application into swap.
  */
-void WindowManager::handle_surface_leave(void * /* data */,
-                                         struct wl_surface * /* surface */,
-                                         struct wl_output * /* output */) {
-    std::cout << "WindowManager::handle_surface_leave" << std::endl;
+void WindowManager::release_hidden_surfaces() {
+    const int delay_ms = surface_release_delay_ms_;
+    if (delay_ms <= 0 || !hidden_ || surfaces_released_) {
+        return;
+    }
+    const auto hidden_since = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(hidden_since_));
+    if (std::chrono::steady_clock::now() - hidden_since < std::chrono::milliseconds(delay_ms)) {
+        return;
+    }
+    LOG_DEBUG("WindowManager: hidden for %d ms, releasing EGL surfaces", delay_ms);
+    for (const auto &window: windows_) {
+        window->release_surface();
+    }
+    surfaces_released_ = true;
 }
 
 const struct wl_surface_listener WindowManager::surface_listener_ = {
-        .enter = handle_surface_enter,
-        .leave = handle_surface_leave,
+        .enter = base_listener_thunk<Window, &WindowManager::handle_surface_enter>,
+        .leave = base_listener_thunk<Window, &WindowManager::handle_surface_leave>,
+#if defined(WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION)
+        .preferred_buffer_scale = base_listener_thunk<Window, &WindowManager::handle_preferred_buffer_scale>,
+        .preferred_buffer_transform = base_listener_thunk<Window, &WindowManager::handle_preferred_buffer_transform>,
+#endif
+};
+
+const struct wp_fractional_scale_v1_listener WindowManager::fractional_scale_listener_ = {
+        .preferred_scale = listener_thunk<&WindowManager::handle_fractional_scale>,
 };
 
 /**
@@ -125,32 +822,63 @@ const struct wl_surface_listener WindowManager::surface_listener_ = {
  * The function creates a new window based on the given parameters and adds it to the list of windows managed by the
  * WindowManager. The type of the window can be either EGL or VULKAN. If the window type is EGL, a WindowEgl object is
  * created using the provided display, compositor, surface, width, height, shell type, and draw callback. If the shell
- * type is XDG, additional actions can be performed. If the window type is VULKAN, a WindowVulkan object can be
- * created, but this part of the code is currently commented out.
+ * type is XDG, additional actions can be performed. If the window type is VULKAN, a WindowVulkan is created with
+ * its default config; it is not returned, use create_render_surface() or create_vulkan_window() to get at it. SHM
+ * windows are handled the same way, see create_shm_window().
+ *
+ * Once the toplevel is configured, a size the compositor asked for replaces width and
+ * height, and the configure bounds cap them, so the first buffers are never reallocated.
  *
  * @param width The width of the window.
  * @param height The height of the window.
- * @param window_type The type of the window (EGL or VULKAN).
+ * @param window_type The type of the window (EGL, VULKAN or SHM).
  * @param draw_callback The function to be called when the window needs to be drawn.
+ * @param config The EGL config attributes, context ownership and buffering of an EGL window.
  * @return A pointer to the created window object, or nullptr if no window was created.
  */
 WindowEgl *WindowManager::create_window(int width, int height, WindowType window_type,
-                                        const std::function<void(void *data, uint32_t)> &draw_callback) {
+                                        const std::function<void(void *data, uint32_t)> &draw_callback,
+                                        const WindowEglConfig &config) {
     WindowEgl *result = nullptr;
+    resolve_initial_size(width, height);
 
     std::unique_ptr<WindowEgl> window;
     if (window_type == EGL) {
-        window = std::make_unique<WindowEgl>(this->wl_display_, this->wl_compositor_, this->wl_surface_, width, height,
+        window = std::make_unique<WindowEgl>(get_egl_display(), this->wl_compositor_, this->wl_surface_, width,
+                                             height,
                                              shell_type_,
-                                             draw_callback);
+                                             draw_callback, config);
+        window->enable_viewport(get_viewporter());
+        window->set_output_scale(get_preferred_scale());
+        // every EGL window draws to the toplevel surface, whose commits the frame loop counts
+        switch (config.buffering) {
+            case WindowEglConfig::BUFFERING_DOUBLE:
+                set_max_queued_commits(1);
+                break;
+            case WindowEglConfig::BUFFERING_TRIPLE:
+                set_max_queued_commits(2);
+                break;
+            case WindowEglConfig::BUFFERING_MIN_LATENCY:
+                set_max_queued_commits(1);
+                (void) enable_frame_scheduler();
+                break;
+            case WindowEglConfig::BUFFERING_DEFAULT:
+                break;
+        }
         if (shell_type_ == Window::ShellType::XDG) {
         }
     } else if (window_type == VULKAN) {
-        //window = std::make_unique<WindowVulkan>(this->wl_display_, this->wl_compositor_, width, height, shell_type_,
-        //draw_callback);
+#if defined(ENABLE_VULKAN)
+        (void) create_vulkan_window(width, height);
+#else
+        LOG_ERROR("Vulkan support is not enabled, build with ENABLE_VULKAN");
+#endif
+    } else if (window_type == SHM) {
+        (void) create_shm_window(width, height);
     }
     if (window) {
         result = window.get();
+        render_surfaces_.push_back(result);
         windows_.emplace_back(std::move(window));
     }
 
@@ -159,61 +887,1199 @@ WindowEgl *WindowManager::create_window(int width, int height, WindowType window
 }
 
 /**
- * @brief Dispatches events from the Wayland display.
+ * @brief Creates a window of any backend on the toplevel surface, with its default config.
  *
- * This function dispatches events from the Wayland display with a specified timeout.
+ * Code drawing through the RenderSurface interface runs unchanged on each backend;
+ * resizes, output scale changes and frame times reach the window the same way.
  *
- * @param timeout The maximum amount of time to wait for events, in milliseconds.
- * @return The number of events dispatched on success, or a negative error code on failure.
+ * @param width       The width of the window.
+ * @param height      The height of the window.
+ * @param window_type The backend (EGL, VULKAN or SHM).
+ * @return The created window, owned by the WindowManager, or nullptr if the backend is not built in.
  */
-int WindowManager::dispatch(int timeout) const {
-    struct pollfd fds[1];
-    int dispatch_count = 0;
+RenderSurface *WindowManager::create_render_surface(int width, int height, WindowType window_type) {
+    switch (window_type) {
+        case EGL:
+            return create_window(width, height, EGL);
+        case VULKAN:
+#if defined(ENABLE_VULKAN)
+            return create_vulkan_window(width, height);
+#else
+            LOG_ERROR("Vulkan support is not enabled, build with ENABLE_VULKAN");
+            return nullptr;
+#endif
+        case SHM:
+            return create_shm_window(width, height);
+    }
+    return nullptr;
+}
 
-    while (g_main_context_iteration(nullptr, FALSE));
+/**
+ * @brief Creates a window of any backend as described by config, and sets up the toplevel and frame loop for it.
+ *
+ * The shell gets the title and app id, the frame loop the scheduler mode, frame rate
+ * cap and content type; vsync off sets the async presentation hint and, for Vulkan,
+ * VK_PRESENT_MODE_IMMEDIATE_KHR. See WindowConfig for what each backend takes.
+ *
+ * @param config The window to create; invalid combinations are rejected, see WindowConfig::get_error().
+ * @return The created window, owned by the WindowManager, or nullptr if config is invalid or its backend is
+ * not built in.
+ */
+RenderSurface *WindowManager::create_window(const WindowConfig &config) {
+    if (const auto error = config.get_error()) {
+        LOG_ERROR("Invalid window config: %s", error);
+        return nullptr;
+    }
+    if (xdg_wm_ && config.title) {
+        xdg_wm_->set_title(config.title);
+    }
+    if (xdg_wm_ && config.app_id) {
+        xdg_wm_->set_app_id(config.app_id);
+    }
+    if (config.context_priority && !set_context_priority(config.context_priority)) {
+        LOG_WARN("context priority is only applied before the first EGL window");
+    }
 
-    while (wl_display_prepare_read(wl_display_) != 0)
-        dispatch_count += wl_display_dispatch_pending(wl_display_);
+    RenderSurface *result = nullptr;
+    switch (config.backend) {
+        case RenderSurface::EGL: {
+            WindowEglConfig egl_config{};
+            egl_config.egl = config.egl;
+            egl_config.own_context = config.own_context;
+            egl_config.opaque = config.opaque;
+            egl_config.present_thread = config.present_thread;
+            if (config.buffer_count) {
+                egl_config.buffering = config.buffer_count == 2 ? WindowEglConfig::BUFFERING_DOUBLE
+                                                                : WindowEglConfig::BUFFERING_TRIPLE;
+            }
+            auto window = create_window(config.width, config.height, EGL, nullptr, egl_config);
+            (void) window->set_render_scale(config.render_scale);
+            if (config.scale_policy == WindowConfig::SCALE_GOVERNED) {
+                (void) window->enable_resolution_governor();
+            }
+            result = window;
+            break;
+        }
+        case RenderSurface::VULKAN: {
+#if defined(ENABLE_VULKAN)
+            WindowVulkanConfig vulkan_config{};
+            vulkan_config.image_count = config.buffer_count;
+            if (!config.vsync) {
+                vulkan_config.present_mode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            }
+            result = create_vulkan_window(config.width, config.height, vulkan_config);
+#else
+            LOG_ERROR("Vulkan support is not enabled, build with ENABLE_VULKAN");
+            return nullptr;
+#endif
+            break;
+        }
+        case RenderSurface::SHM: {
+            WindowShmConfig shm_config{};
+            shm_config.format = config.shm_format;
+            if (config.buffer_count) {
+                shm_config.buffer_count = config.buffer_count;
+            }
+            result = create_shm_window(config.width, config.height, shm_config);
+            break;
+        }
+    }
 
-    if (wl_display_flush(wl_display_) < 0 &&
-        errno != EAGAIN) {
-        wl_display_cancel_read(wl_display_);
-        return -errno;
+    if (!config.vsync) {
+        (void) set_presentation_hint(TearingControl::ASYNC);
+    }
+    if (config.content_type != CONTENT_NONE) {
+        (void) set_content_type(config.content_type);
+    }
+    if (config.color && !set_color_description(*config.color)) {
+        LOG_WARN("compositor cannot convert from the color description, buffers are taken as sRGB");
+    }
+    if (config.fifo && !set_fifo(true)) {
+        LOG_DEBUG("no wp_fifo_manager_v1, frames replace each other");
+    }
+    if (config.commit_timing && !set_commit_timing(true)) {
+        LOG_DEBUG("no wp_commit_timing_manager_v1, commits are not timed");
     }
+    if (config.max_fps) {
+        set_max_fps(config.max_fps);
+    }
+    switch (config.scheduler) {
+        case WindowConfig::SCHEDULE_FRAME_CALLBACK:
+            break;
+        case WindowConfig::SCHEDULE_DEADLINE:
+            if (!enable_frame_scheduler(config.scheduler_margin_us)) {
+                LOG_WARN("frame scheduler unavailable, drawing on frame callbacks");
+            }
+            break;
+        case WindowConfig::SCHEDULE_ON_DEMAND:
+            set_render_on_demand(true);
+            break;
+    }
+    return result;
+}
+
+/**
+ * @brief Creates a window presenting externally allocated dmabufs on the toplevel surface.
+ *
+ * Buffers are attached from the frame handler and committed by the frame loop.
+ *
+ * @return The created window, owned by the WindowManager.
+ * @throws std::runtime_error if the compositor has no zwp_linux_dmabuf_v1 global.
+ */
+WindowDmabuf *WindowManager::create_dmabuf_window() {
+    auto window = std::make_unique<WindowDmabuf>(this, this->wl_surface_);
+    auto result = window.get();
+    dmabuf_windows_.emplace_back(std::move(window));
 
-    fds[0] = (struct pollfd) {wl_display_get_fd(wl_display_), POLLIN};
+    start_frames();
+    return result;
+}
 
-    const int ret = poll(fds, std::size(fds), timeout);
-    if (ret > 0) {
-        if (fds[0].revents & POLLIN) {
-            wl_display_read_events(wl_display_);
-            dispatch_count += wl_display_dispatch_pending(wl_display_);
-            return dispatch_count;
-        } else {
-            wl_display_cancel_read(wl_display_);
-            return dispatch_count;
+/**
+ * @brief Returns the EGL display shared by all EGL windows, initializing it on first use.
+ *
+ * Pass it to SubSurface::create_egl_window() to host GL content on a subsurface.
+ */
+const EglDisplay *WindowManager::get_egl_display() {
+    if (egl_init_thread_.joinable()) {
+        egl_init_thread_.join();
+        if (egl_init_error_) {
+            std::rethrow_exception(std::exchange(egl_init_error_, nullptr));
         }
-    } else if (ret == 0) {
-        wl_display_cancel_read(wl_display_);
-        return dispatch_count;
-    } else {
-        wl_display_cancel_read(wl_display_);
-        return -errno;
     }
+    if (!egl_display_) {
+        // render on the GPU the compositor composites on, not whichever the driver lists first
+        const auto feedback = get_dmabuf_feedback();
+        egl_display_ = std::make_unique<EglDisplay>(this->wl_display_, EglConfigAttribs{}, context_priority_,
+                                                    feedback ? feedback->get_main_device() : 0);
+    }
+    return egl_display_.get();
 }
 
 /**
- * @class WindowManager
- * @brief Class for managing windows and handling event polling
+ * @brief Starts the EGL display setup and the caller's asset loading on worker threads.
+ *
+ * Meant for a WindowManager constructed with wait_for_configure false: the registry
+ * round trip is done by then, so the dmabuf feedback picks the GPU, and eglInitialize(),
+ * config selection and context creation overlap the configure wait that follows.
+ * get_egl_display(), and so create_window(), joins the EGL worker; the asset worker is
+ * joined by the first frame, before its draw callback swaps. Neither worker may dispatch
+ * the display's queue.
+ *
+ * @code
+ * WindowManager wm(Window::ShellType::XDG, nullptr, true, nullptr, false);
+ * wm.start_async([&]() { textures = decode_textures(); });
+ * wm.wait_for_configure(-1);
+ * auto window = wm.create_window(width, height, WindowManager::EGL, draw);
+ * @endcode
+ *
+ * @param load_assets Runs on its own thread, may be empty.
+ * @return false if the EGL display exists already or a startup is in flight.
+ */
+bool WindowManager::start_async(const std::function<void()> &load_assets) {
+    if (egl_display_ || egl_init_thread_.joinable() || asset_thread_.joinable()) {
+        return false;
+    }
+    const auto feedback = get_dmabuf_feedback();
+    const dev_t device = feedback ? feedback->get_main_device() : 0;
+    egl_init_thread_ = std::thread([this, device]() {
+        try {
+            egl_display_ = std::make_unique<EglDisplay>(this->wl_display_, EglConfigAttribs{}, context_priority_,
+                                                        device);
+        } catch (...) {
+            egl_init_error_ = std::current_exception();
+        }
+    });
+    if (load_assets) {
+        asset_thread_ = std::thread([load_assets]() {
+            load_assets();
+        });
+    }
+    return true;
+}
+
+/**
+ * @brief Waits for the workers start_async() started.
  *
- * The WindowManager class provides functionality for managing windows and handling events using Wayland protocol.
+ * Rethrows what the EGL display setup threw, e.g. std::runtime_error without a usable config.
  */
-int WindowManager::poll_events(int /* timeout */) const {
-    while (wl_display_prepare_read(wl_display_) != 0) {
-        wl_display_dispatch_pending(wl_display_);
+void WindowManager::join_startup() {
+    if (asset_thread_.joinable()) {
+        asset_thread_.join();
+    }
+    if (egl_init_thread_.joinable()) {
+        (void) get_egl_display();
     }
-    wl_display_flush(wl_display_);
+}
 
-    wl_display_read_events(wl_display_);
-    return wl_display_dispatch_pending(wl_display_);
+/**
+ * @brief Makes all EGL windows created from now on render with the one shared context.
+ *
+ * Windows asking for a config the shared context cannot render to, on drivers without
+ * EGL_KHR_no_config_context, get the default config instead of a context of their own.
+ * Windows created with WindowEglConfig::own_context still get their own. Shader, texture
+ * and buffer objects then exist once, and moving between windows costs only a surface
+ * rebind.
+ */
+void WindowManager::set_single_context(bool single_context) {
+    (void) get_egl_display();
+    egl_display_->set_single_context(single_context);
+}
+
+/**
+ * @brief Sets the GPU scheduling priority the EGL contexts ask for.
+ *
+ * Must be called before the first EGL window or get_egl_display(), the contexts are
+ * created with the display. EGL_CONTEXT_PRIORITY_HIGH_IMG lets frames preempt other
+ * GPU clients; the resource context stays at low priority. Check the level actually
+ * granted with get_egl_display()->get_context_priority().
+ *
+ * @param priority One of the EGL_CONTEXT_PRIORITY_*_IMG levels, or EGL_CONTEXT_PRIORITY_REALTIME_NV.
+ * @return false if the EGL display already exists.
+ */
+bool WindowManager::set_context_priority(EGLint priority) {
+    if (egl_display_ || egl_init_thread_.joinable()) {
+        return false;
+    }
+    context_priority_ = priority;
+    return true;
+}
+
+/**
+ * @brief Returns the worker uploading GL resources in the background, starting it on first use.
+ *
+ * @return The worker, or nullptr if EGL cannot give it a context current without a surface.
+ */
+EglUploadWorker *WindowManager::get_upload_worker() {
+    if (!upload_worker_) {
+        try {
+            upload_worker_ = std::make_unique<EglUploadWorker>(get_egl_display());
+        } catch (const std::runtime_error &e) {
+            LOG_WARN("No upload worker: %s", e.what());
+            return nullptr;
+        }
+    }
+    return upload_worker_.get();
+}
+
+/**
+ * @brief Creates a subsurface of the toplevel or of another surface.
+ *
+ * @code
+ * auto video = wm.create_subsurface(nullptr, false);
+ * video->place_below(wm.get_surface());
+ * auto decoder_output = video->create_dmabuf_window(&wm);
+ * @endcode
+ *
+ * @param parent The parent surface, nullptr for the toplevel surface.
+ * @param sync   true for synchronized mode, false for desynchronized.
+ * @return The subsurface, owned by the WindowManager until destroy_subsurface().
+ */
+SubSurface *WindowManager::create_subsurface(struct wl_surface *parent, bool sync) {
+    auto subsurface = std::make_unique<SubSurface>(this->wl_compositor_, this->wl_subcompositor_,
+                                                   parent ? parent : this->wl_surface_, sync);
+    auto result = subsurface.get();
+    result->enable_alpha_modifier(get_alpha_modifier());
+    claim_surface(result->get_surface());
+    subsurfaces_.emplace_back(std::move(subsurface));
+    return result;
+}
+
+/**
+ * @brief Destroys a subsurface created by create_subsurface(), and its content.
+ */
+void WindowManager::destroy_subsurface(SubSurface *subsurface) {
+    subsurfaces_.erase(std::remove_if(subsurfaces_.begin(), subsurfaces_.end(),
+                                     [subsurface](const auto &item) { return item.get() == subsurface; }),
+                      subsurfaces_.end());
+}
+
+/**
+ * @brief Creates an atlas of tiles sharing one buffer, shown as subsurfaces of the toplevel or another surface.
+ *
+ * @code
+ * auto atlas = wm.create_surface_atlas({.width = 2048, .height = 1024});
+ * const int tile = atlas->add_tile(128, 96);
+ * atlas->set_tile_position(tile, 16, 16);
+ * atlas->update([](const SurfaceAtlas::TileView &view) { draw_tile(view); });
+ * @endcode
+ *
+ * @param config The atlas size, pixel format and commit mode.
+ * @param parent The surface the tiles are placed on, nullptr for the toplevel surface.
+ * @return The atlas, owned by the WindowManager until destroy_surface_atlas(), nullptr without wp_viewporter.
+ */
+SurfaceAtlas *WindowManager::create_surface_atlas(const SurfaceAtlasConfig &config, struct wl_surface *parent) {
+    if (!get_viewporter()) {
+        return nullptr;
+    }
+    auto atlas = std::make_unique<SurfaceAtlas>(this->wl_compositor_, this->wl_subcompositor_, get_viewporter(),
+                                                this->wl_shm_, parent ? parent : this->wl_surface_, config);
+    auto result = atlas.get();
+    surface_atlases_.emplace_back(std::move(atlas));
+    return result;
+}
+
+/**
+ * @brief Destroys an atlas created by create_surface_atlas(), and its tiles.
+ */
+void WindowManager::destroy_surface_atlas(SurfaceAtlas *atlas) {
+    surface_atlases_.erase(std::remove_if(surface_atlases_.begin(), surface_atlases_.end(),
+                                         [atlas](const auto &item) { return item.get() == atlas; }),
+                          surface_atlases_.end());
+}
+
+/**
+ * @brief Opens a popup, a menu or tooltip, on the toplevel or on another popup.
+ *
+ * Host its content with XdgPopup::create_egl_window(), passing get_egl_display() so
+ * it shares the toplevel's EGL display and context, or with
+ * XdgPopup::create_shm_window(). Draw from the popup's configure callback.
+ *
+ * @code
+ * XdgPositionerConfig where{.width = 200, .height = 120, .anchor_rect = {x, y, 1, 1}};
+ * auto menu = wm.create_popup(where, nullptr, seat, serial);
+ * auto content = menu->create_shm_window(wm.get_shm());
+ * @endcode
+ *
+ * @param config      Where the popup goes, relative to the parent's window geometry.
+ * @param parent      The parent popup, nullptr for the toplevel.
+ * @param grab_seat   For menus, the seat of the press that opens it.
+ * @param grab_serial The serial of that press.
+ * @return The popup, owned by the WindowManager until destroy_popup(), or nullptr for shells other than XDG.
+ */
+XdgPopup *WindowManager::create_popup(const XdgPositionerConfig &config, const XdgPopup *parent,
+                                      struct wl_seat *grab_seat, uint32_t grab_serial) {
+    if (!xdg_wm_) {
+        return nullptr;
+    }
+    auto popup = std::make_unique<XdgPopup>(this->wl_compositor_, xdg_wm_->get_wm_base(),
+                                            parent ? parent->get_xdg_surface() : xdg_wm_->get_xdg_surface(),
+                                            config, grab_seat, grab_serial);
+    auto result = popup.get();
+    claim_surface(result->get_surface());
+    popups_.emplace_back(std::move(popup));
+    return result;
+}
+
+/**
+ * @brief Opens another toplevel window, with a surface and frame loop of its own.
+ *
+ * Windows from create_window() all draw to the WindowManager's surface, so they are
+ * presented together; a toplevel is paced and damaged on its own. Create its content
+ * with XdgToplevel::create_egl_window() and friends, and draw it from draw_callback.
+ * Input on its surface goes to the toplevel's input ring.
+ *
+ * @code
+ * auto toplevel = wm.create_toplevel(640, 480);
+ * auto window = toplevel->create_egl_window(wm.get_egl_display());
+ * toplevel->set_frame_handler(draw);
+ * @endcode
+ *
+ * @param width         The size used until the compositor configures one.
+ * @param height        The size used until the compositor configures one.
+ * @param draw_callback Called for every frame of the toplevel.
+ * @return The toplevel, owned by the WindowManager until destroy_toplevel(), or nullptr for shells other than
+ * XDG.
+ */
+XdgToplevel *WindowManager::create_toplevel(int width, int height,
+                                            const std::function<void(void *data, uint32_t time)> &draw_callback) {
+    if (!xdg_wm_) {
+        return nullptr;
+    }
+    auto toplevel = std::make_unique<XdgToplevel>(this, width, height, draw_callback);
+    toplevel->set_frame_clock(get_frame_clock());
+    if (focus_throttle_.enabled) {
+        toplevel->set_focus_throttle(focus_throttle_.fps, focus_throttle_.on_demand);
+    }
+    if (idle_throttle_.enabled) {
+        toplevel->set_idle_throttle(idle_throttle_.fps, idle_throttle_.on_demand);
+        toplevel->set_idle(is_idle());
+    }
+    get_input_router().add(toplevel->get_surface(), &toplevel->get_input_ring());
+    auto result = toplevel.get();
+    toplevels_.emplace_back(std::move(toplevel));
+    return result;
+}
+
+/**
+ * @brief Chooses which devices push events to the input ring of the window or one of its toplevels.
+ *
+ * Both start with InputRouter::SOURCE_ALL. A keyboard focused on a surface without
+ * InputRouter::SOURCE_KEYBOARD skips its XKB processing, compose and repeat entirely;
+ * the focus callbacks still run, and so do the input callbacks used for frame timing.
+ *
+ * @param sources  InputRouter::Source bits.
+ * @param toplevel A toplevel from create_toplevel(), nullptr for the window itself.
+ * @return false if toplevel is not routed.
+ */
+bool WindowManager::set_input_sources(uint8_t sources, const XdgToplevel *toplevel) {
+    return get_input_router().set_sources(toplevel ? toplevel->get_surface() : wl_surface_, sources);
+}
+
+/**
+ * @brief Closes a toplevel from create_toplevel(), destroying its content.
+ */
+void WindowManager::destroy_toplevel(XdgToplevel *toplevel) {
+    const auto it = std::find_if(toplevels_.begin(), toplevels_.end(),
+                                 [toplevel](const auto &item) { return item.get() == toplevel; });
+    if (it == toplevels_.end()) {
+        return;
+    }
+    get_input_router().remove(toplevel->get_surface());
+    toplevels_.erase(it);
+}
+
+/**
+ * @brief Returns the frame group of an output, creating it on first use.
+ *
+ * Add the windows shown on the output, e.g. get_output_frame_group(output)->add(toplevel),
+ * and the frame callbacks the compositor sends for one repaint are drawn back-to-back
+ * and flushed together, so no window slips into the next vblank behind the others.
+ * The group is dropped with the output.
+ *
+ * @param output The output, nullptr for the primary one.
+ * @return The group, owned by the WindowManager, or nullptr without an output.
+ */
+FrameGroup *WindowManager::get_output_frame_group(const Output *output) {
+    if (!output) {
+        output = primary_output_;
+    }
+    if (!output) {
+        return nullptr;
+    }
+    auto &group = frame_groups_[output];
+    if (!group) {
+        group = std::make_unique<FrameGroup>(get_display(), [this](std::function<void()> task) {
+            post(std::move(task));
+        });
+    }
+    return group.get();
+}
+
+/**
+ * @brief Throttles the window and its toplevels while they are not focused, see Window::set_focus_throttle().
+ *
+ * A toplevel is focused while the compositor marks it activated or a seat's keyboard
+ * is on it, so the window the user interacts with keeps its full rate and the others
+ * visible next to it draw at unfocused_fps, or only once invalidated. Windows of shells
+ * without an activated state count as focused while no keyboard is on another surface.
+ *
+ * @param unfocused_fps       The highest frame rate while unfocused, 0 to keep set_max_fps().
+ * @param unfocused_on_demand true to only draw after request_redraw() while unfocused.
+ */
+void WindowManager::enable_focus_throttle(uint32_t unfocused_fps, bool unfocused_on_demand) {
+    focus_throttle_ = {true, unfocused_fps, unfocused_on_demand};
+    set_focus_throttle(unfocused_fps, unfocused_on_demand);
+    for (const auto &toplevel: toplevels_) {
+        toplevel->set_focus_throttle(unfocused_fps, unfocused_on_demand);
+    }
+    update_focus();
+}
+
+/**
+ * @brief Draws every window at its requested rate regardless of focus again.
+ */
+void WindowManager::disable_focus_throttle() {
+    focus_throttle_ = {};
+    Window::disable_focus_throttle();
+    for (const auto &toplevel: toplevels_) {
+        toplevel->disable_focus_throttle();
+    }
+}
+
+/**
+ * @brief Throttles the window and its toplevels while the user is idle, see Window::set_idle_throttle().
+ *
+ * The user is idle once every seat went timeout_ms without input, reported by the
+ * compositor's ext_idle_notifier_v1, and active again with the next input on any seat.
+ * Without the notifier the windows never throttle. set_user_idle_callback() hears of
+ * both transitions, e.g. to pause animations until someone touches the screen again.
+ *
+ * @param timeout_ms         The time without input before the user counts as idle.
+ * @param idle_fps           The highest frame rate while idle, 0 to keep the other caps.
+ * @param idle_on_demand     true to only draw after request_redraw() while idle.
+ * @param respect_inhibitors true to stay active while a surface inhibits idle, e.g. a playing video.
+ */
+void WindowManager::enable_idle_throttle(uint32_t timeout_ms, uint32_t idle_fps, bool idle_on_demand,
+                                         bool respect_inhibitors) {
+    idle_throttle_ = {true, idle_fps, idle_on_demand};
+    set_idle_throttle(idle_fps, idle_on_demand);
+    for (const auto &toplevel: toplevels_) {
+        toplevel->set_idle_throttle(idle_fps, idle_on_demand);
+    }
+    set_idle_callback(timeout_ms, [this](Seat & /* seat */, bool /* idle */) { update_idle(); }, respect_inhibitors);
+}
+
+/**
+ * @brief Draws every window at its requested rate regardless of idleness again.
+ */
+void WindowManager::disable_idle_throttle() {
+    set_idle_callback(0, nullptr);
+    idle_throttle_ = {};
+    Window::disable_idle_throttle();
+    for (const auto &toplevel: toplevels_) {
+        toplevel->disable_idle_throttle();
+    }
+    update_idle();
+}
+
+/**
+ * @brief Marks the windows idle while every seat is, and active on input on any of them.
+ */
+void WindowManager::update_idle() {
+    const auto &seats = get_seats();
+    const bool idle = idle_throttle_.enabled && !seats.empty() &&
+                      std::all_of(seats.begin(), seats.end(), [](const auto &entry) { return entry.second->is_idle(); });
+    if (idle == is_idle()) {
+        return;
+    }
+    LOG_DEBUG("User %s", idle ? "idle" : "active");
+    set_idle(idle);
+    for (const auto &toplevel: toplevels_) {
+        toplevel->set_idle(idle);
+    }
+    if (user_idle_callback_) {
+        user_idle_callback_(idle);
+    }
+}
+
+/**
+ * @brief Derives the window's focus from the activated state and the keyboards on its surface.
+ */
+void WindowManager::update_focus() {
+    if (xdg_wm_) {
+        set_focused(xdg_wm_->is_activated() || keyboard_focus_ > 0);
+    } else {
+        set_focused(keyboard_focus_ > 0 || keyboard_focus_total_ == 0);
+    }
+}
+
+/**
+ * @brief Tracks keyboard enter and leave on the window's surface and its toplevels.
+ *
+ * @param surface The surface entered or left.
+ * @param focused true on enter, false on leave.
+ */
+void WindowManager::handle_keyboard_focus(struct wl_surface *surface, bool focused) {
+    const int delta = focused ? 1 : -1;
+    keyboard_focus_total_ = std::max(keyboard_focus_total_ + delta, 0);
+    if (surface == wl_surface_) {
+        keyboard_focus_ = std::max(keyboard_focus_ + delta, 0);
+    } else {
+        for (const auto &toplevel: toplevels_) {
+            if (toplevel->get_surface() == surface) {
+                toplevel->set_keyboard_focus(focused);
+                break;
+            }
+        }
+    }
+    update_focus();
+}
+
+/**
+ * @brief Closes a popup created by create_popup(), and the popups opened on it, topmost first.
+ */
+void WindowManager::destroy_popup(XdgPopup *popup) {
+    // children are created after their parent, so one pass collects the whole chain
+    std::vector<struct xdg_surface *> closing;
+    for (const auto &item: popups_) {
+        if (item.get() == popup ||
+            std::find(closing.begin(), closing.end(), item->get_parent()) != closing.end()) {
+            closing.push_back(item->get_xdg_surface());
+        }
+    }
+    for (auto it = closing.rbegin(); it != closing.rend(); ++it) {
+        popups_.erase(std::remove_if(popups_.begin(), popups_.end(),
+                                     [surface = *it](const auto &item) { return item->get_xdg_surface() == surface; }),
+                      popups_.end());
+    }
+}
+
+/**
+ * @brief Keeps EGL windows ready for create_egl_subsurface() and create_egl_popup().
+ *
+ * The pool is refilled one window per frame, after the frame is committed. Windows
+ * come from the shared EGL display, so the pool is cheapest with set_single_context().
+ * Calling it again replaces the pool and its ready windows.
+ *
+ * @param config How many windows to keep ready, at which size and EGL config.
+ */
+void WindowManager::enable_window_pool(const WindowPoolConfig &config) {
+    window_pool_ = std::make_unique<WindowPool>(get_egl_display(), this->wl_compositor_, config);
+    // frames may not be running yet, the first window should not wait for them
+    window_pool_->warm_one();
+}
+
+/**
+ * @brief Creates a subsurface with an EGL window taken from the window pool.
+ *
+ * Without enable_window_pool(), the EGL window is created right away.
+ *
+ * @return The subsurface, its window is get_egl_window(); owned by the WindowManager until destroy_subsurface().
+ */
+SubSurface *WindowManager::create_egl_subsurface(int width, int height, struct wl_surface *parent, bool sync) {
+    if (!window_pool_) {
+        auto result = create_subsurface(parent, sync);
+        result->create_egl_window(get_egl_display(), width, height);
+        return result;
+    }
+    if (!this->wl_subcompositor_) {
+        throw std::runtime_error("wl_subcompositor is not available.");
+    }
+    auto subsurface = std::make_unique<SubSurface>(this->wl_compositor_, this->wl_subcompositor_,
+                                                   parent ? parent : this->wl_surface_,
+                                                   window_pool_->acquire(width, height), sync);
+    auto result = subsurface.get();
+    result->enable_alpha_modifier(get_alpha_modifier());
+    claim_surface(result->get_surface());
+    subsurfaces_.emplace_back(std::move(subsurface));
+    return result;
+}
+
+/**
+ * @brief Opens a popup with an EGL window taken from the window pool.
+ *
+ * Presenting it costs the first draw and commit from its configure callback. Without
+ * enable_window_pool(), the EGL window is created right away.
+ *
+ * @return The popup, its window is get_egl_window(); owned by the WindowManager until destroy_popup(), or
+ * nullptr for shells other than XDG.
+ */
+XdgPopup *WindowManager::create_egl_popup(const XdgPositionerConfig &config, const XdgPopup *parent,
+                                          struct wl_seat *grab_seat, uint32_t grab_serial) {
+    if (!xdg_wm_) {
+        return nullptr;
+    }
+    if (!window_pool_) {
+        auto result = create_popup(config, parent, grab_seat, grab_serial);
+        result->create_egl_window(get_egl_display());
+        return result;
+    }
+    auto popup = std::make_unique<XdgPopup>(this->wl_compositor_, xdg_wm_->get_wm_base(),
+                                            parent ? parent->get_xdg_surface() : xdg_wm_->get_xdg_surface(),
+                                            config, window_pool_->acquire(config.width, config.height),
+                                            grab_seat, grab_serial);
+    auto result = popup.get();
+    claim_surface(result->get_surface());
+    popups_.emplace_back(std::move(popup));
+    return result;
+}
+
+/**
+ * @brief Creates a software rendering window on the toplevel surface.
+ *
+ * Buffers are acquired, drawn and attached from the frame handler and committed by
+ * the frame loop.
+ *
+ * @param width  The surface width.
+ * @param height The surface height.
+ * @param config The pixel format and number of buffers in the ring.
+ * @return The created window, owned by the WindowManager.
+ */
+WindowShm *WindowManager::create_shm_window(int width, int height, const WindowShmConfig &config) {
+    resolve_initial_size(width, height);
+    auto window = std::make_unique<WindowShm>(this->wl_shm_, this->wl_surface_, width, height, config);
+    if (preferred_scale_ != 120) {
+        (void) window->set_buffer_scale(std::max(1, static_cast<int>(std::lround(get_preferred_scale()))));
+    }
+    auto result = window.get();
+    render_surfaces_.push_back(result);
+    shm_windows_.emplace_back(std::move(window));
+
+    start_frames();
+    return result;
+}
+
+#if defined(ENABLE_VULKAN)
+/**
+ * @brief Creates a Vulkan window on the toplevel surface.
+ *
+ * The swapchain follows the toplevel size, and is recreated on the first acquire after
+ * a configure changes it.
+ *
+ * @param width  The initial swapchain width.
+ * @param height The initial swapchain height.
+ * @param config The present mode and swapchain image count.
+ * @return The created window, owned by the WindowManager.
+ */
+WindowVulkan *WindowManager::create_vulkan_window(int width, int height, const WindowVulkanConfig &config) {
+    resolve_initial_size(width, height);
+    auto window = std::make_unique<WindowVulkan>(this->wl_display_, this->wl_surface_, width, height, config);
+    // present times are turned into vblank counts with the primary output's period
+    window->set_frame_clock(get_frame_clock());
+    auto result = window.get();
+    render_surfaces_.push_back(result);
+    vulkan_windows_.emplace_back(std::move(window));
+
+    start_frames();
+    return result;
+}
+#endif
+
+/**
+ * @brief Dispatches events from the Wayland display.
+ *
+ * When the Wayland source is attached to the GMainContext passed at construction,
+ * a single context iteration polls the display fd together with every other
+ * source, bounded by the timeout. Otherwise the display fd, the frame scheduler
+ * timer and the fds of the context, such as the keyboard repeat timer, are polled
+ * in one call; see dispatch_with_context(). Either way a client with no frame
+ * pending, no key held and no timer armed sleeps in a single blocking poll until
+ * the timeout, so dispatch(-1) never wakes up on its own.
+ * Afterwards EGL windows hidden for longer than set_surface_release_delay() release
+ * their surfaces, on this thread, as it is the one drawing them; the wait is cut
+ * short for that once, rather than polling for the deadline.
+ *
+ * get_wakeup_count() and get_idle_wakeup_count() count the returns, so a loop that
+ * spins can be told from one that sleeps.
+ *
+ * @param timeout The maximum amount of time to wait for events, in milliseconds.
+ * @return The number of events dispatched on success, or a negative error code on failure.
+ */
+int WindowManager::dispatch(int timeout) {
+    TRACE_SCOPE("WindowManager::dispatch");
+    timeout = get_release_timeout(timeout);
+    if (wayland_source_) {
+        GSource *timeout_source = nullptr;
+        if (timeout > 0) {
+            timeout_source = g_timeout_source_new(static_cast<guint>(timeout));
+            g_source_set_callback(timeout_source, [](gpointer) -> gboolean { return G_SOURCE_REMOVE; }, nullptr,
+                                  nullptr);
+            g_source_attach(timeout_source, context_);
+        }
+        const gboolean dispatched = g_main_context_iteration(context_, timeout != 0);
+        if (timeout_source) {
+            g_source_destroy(timeout_source);
+            g_source_unref(timeout_source);
+        }
+        release_hidden_surfaces();
+        return count_wakeup(dispatched ? 1 : 0);
+    }
+
+    const int result = dispatch_with_context(timeout);
+    if (result < 0 && get_connection_error()) {
+        report_disconnect();
+    }
+    release_hidden_surfaces();
+    return count_wakeup(result);
+}
+
+/**
+ * @brief Polls the Wayland display together with the GMainContext's sources.
+ *
+ * Runs one iteration of the context by hand: the context is prepared and queried
+ * for its fds and timeout, the fds are handed to Display::poll_dispatch() next to
+ * the display fd and the frame scheduler timer, and the ready sources are
+ * dispatched after the Wayland events. If another thread owns the context, only
+ * the display and the scheduler timer are polled.
+ *
+ * Wayland events already queued are dispatched before the context is prepared, so
+ * sources their handlers add are part of the same poll.
+ *
+ * @param timeout The maximum amount of time to wait for events, in milliseconds.
+ * @return The number of events dispatched on success, or a negative error code on failure.
+ */
+int WindowManager::dispatch_with_context(int timeout) {
+    // the frame scheduler timer is serviced here unless the window has its own queue
+    const int schedule_fd = get_event_queue() ? -1 : get_schedule_fd();
+    if (!g_main_context_acquire(context_)) {
+        return poll_dispatch(wl_display_, nullptr, timeout, schedule_fd, &Window::dispatch_schedule,
+                             static_cast<Window *>(this));
+    }
+
+    int result = wl_display_dispatch_pending(wl_display_);
+    if (result < 0) {
+        g_main_context_release(context_);
+        return -errno;
+    }
+
+    gint max_priority = 0;
+    g_main_context_prepare(context_, &max_priority);
+    gint context_timeout = -1;
+    auto capacity = static_cast<gint>(context_fds_.size());
+    gint n_fds;
+    while ((n_fds = g_main_context_query(context_, max_priority, &context_timeout, context_fds_.data(),
+                                         capacity)) > capacity) {
+        context_fds_.resize(static_cast<size_t>(n_fds));
+        capacity = n_fds;
+    }
+    if (result > 0) {
+        context_timeout = 0;
+    }
+    if (context_timeout >= 0 && (timeout < 0 || context_timeout < timeout)) {
+        timeout = context_timeout;
+    }
+
+    poll_fds_.resize(2 + static_cast<size_t>(n_fds));
+    poll_fds_[1] = {schedule_fd, POLLIN, 0};
+    for (gint i = 0; i < n_fds; i++) {
+        poll_fds_[2 + i] = {context_fds_[i].fd, static_cast<short>(context_fds_[i].events), 0};
+    }
+
+    const int ret = poll_dispatch(wl_display_, nullptr, timeout, poll_fds_.data(), poll_fds_.size());
+    for (gint i = 0; i < n_fds; i++) {
+        context_fds_[i].revents = static_cast<gushort>(poll_fds_[2 + i].revents);
+    }
+    if (ret < 0) {
+        result = ret;
+    } else {
+        result += ret;
+        if (poll_fds_[0].revents & POLLIN) {
+            const int drained = drain_events(wl_display_, nullptr, read_budget_us_);
+            result = drained < 0 ? drained : result + drained;
+        }
+        if (result >= 0 && (poll_fds_[1].revents & POLLIN)) {
+            Window::dispatch_schedule(static_cast<Window *>(this));
+            result++;
+        }
+    }
+
+    if (g_main_context_check(context_, max_priority, context_fds_.data(), n_fds)) {
+        g_main_context_dispatch(context_);
+        if (result >= 0) {
+            result++;
+        }
+    }
+    g_main_context_release(context_);
+    return result;
+}
+
+/**
+ * @brief Bounds a dispatch timeout by the time left until hidden windows release their surfaces.
+ *
+ * @param timeout The requested timeout in milliseconds, -1 for none.
+ * @return The timeout to wait for.
+ */
+int WindowManager::get_release_timeout(int timeout) const {
+    const int delay_ms = surface_release_delay_ms_;
+    if (delay_ms <= 0 || !hidden_ || surfaces_released_) {
+        return timeout;
+    }
+    const auto hidden_since = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(hidden_since_));
+    const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                               hidden_since).count();
+    const int remaining = elapsed >= delay_ms ? 0 : delay_ms - static_cast<int>(elapsed);
+    return timeout < 0 ? remaining : std::min(timeout, remaining);
+}
+
+/**
+ * @brief Counts a return from dispatch() or poll_events().
+ *
+ * @param result The number of events dispatched, or a negative error code.
+ * @return result, unchanged.
+ */
+int WindowManager::count_wakeup(int result) {
+    wakeup_count_++;
+    if (result == 0) {
+        idle_wakeup_count_++;
+    }
+    // the event thread does not own the toplevels, the render loop publishes for it
+    if (metrics_export_ && !event_thread_running_) {
+        publish_metrics();
+    }
+    return result;
+}
+
+/**
+ * @brief Estimates the memory the windows' buffers and the input caches take.
+ *
+ * What a window costs with the config attributes it was created with is in its
+ * RenderSurface::get_memory_usage(); this sums them up with the pool, the imported
+ * dmabufs, the cursor images and the keymaps, e.g. to see what releasing hidden
+ * surfaces (set_surface_release_delay()) or a smaller pool would save.
+ */
+WindowManager::MemoryUsage WindowManager::get_memory_usage() const {
+    MemoryUsage usage{};
+    for (const auto surface: render_surfaces_) {
+        usage.surfaces += surface->get_memory_usage();
+    }
+    for (const auto &toplevel: toplevels_) {
+        if (toplevel->get_content()) {
+            usage.surfaces += toplevel->get_content()->get_memory_usage();
+        }
+    }
+    for (const auto &popup: popups_) {
+        if (popup->get_egl_window()) {
+            usage.surfaces += popup->get_egl_window()->get_memory_usage();
+        }
+    }
+    for (const auto &subsurface: subsurfaces_) {
+        if (subsurface->get_egl_window()) {
+            usage.surfaces += subsurface->get_egl_window()->get_memory_usage();
+        }
+    }
+    for (const auto &atlas: surface_atlases_) {
+        usage.surfaces += atlas->get_memory_usage();
+    }
+    if (window_pool_) {
+        usage.pool = window_pool_->get_memory_usage();
+        usage.surfaces += usage.pool;
+    }
+    for (const auto &window: dmabuf_windows_) {
+        usage.dmabuf_bytes += window->get_imported_bytes();
+    }
+    usage.cursor_bytes = get_cursor_theme_cache().get_memory_usage();
+    usage.keymap_bytes = get_keymap_cache().get_memory_usage();
+    return usage;
+}
+
+/**
+ * @brief Creates the shared memory segment a monitoring daemon reads the metrics from.
+ *
+ * The frame stats of the window and its toplevels, the protocol totals (with
+ * ENABLE_PROTOCOL_STATS) and the wakeup and flush counts are copied into it at most
+ * every interval_ms, after a commit or a return from dispatch() or poll_events(). The
+ * copy is a few kilobytes of plain stores, nothing is exchanged with the reader.
+ *
+ * @param name        A shm_open() name such as "/waypp-metrics", nullptr for an anonymous memfd.
+ * @param interval_ms The minimum time between updates, 0 updates on every opportunity.
+ * @return false if the segment could not be created, or the export is already enabled.
+ *
+ * @see MetricsExport for the layout and how to read it consistently.
+ */
+bool WindowManager::enable_metrics_export(const char *name, uint32_t interval_ms) {
+    if (metrics_export_) {
+        return false;
+    }
+    try {
+        metrics_export_ = std::make_unique<MetricsExport>(name);
+    } catch (const std::exception &e) {
+        LOG_ERROR("%s", e.what());
+        return false;
+    }
+    metrics_interval_ns_ = static_cast<uint64_t>(interval_ms) * 1000000;
+    publish_metrics();
+    return true;
+}
+
+/**
+ * @brief Copies the current metrics into the export segment, unless the last copy is recent.
+ */
+void WindowManager::publish_metrics() {
+    const auto now = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    const auto published = metrics_published_ns_.load(std::memory_order_relaxed);
+    if (published && now - published < metrics_interval_ns_) {
+        return;
+    }
+    if (!metrics_export_->begin()) {
+        return;
+    }
+    metrics_published_ns_.store(now, std::memory_order_relaxed);
+
+    const auto flush = Display::get_flush_stats();
+    metrics_export_->set_loop({wakeup_count_, idle_wakeup_count_, flush.flushes, flush.blocked});
+    const auto protocol = ProtocolStats::get_totals();
+    metrics_export_->set_protocol({protocol.requests, protocol.events, protocol.bytes_sent,
+                                   protocol.bytes_received});
+    if (wl_surface_) {
+        metrics_export_->add_window(wl_proxy_get_id(reinterpret_cast<struct wl_proxy *>(wl_surface_)),
+                                    get_frame_stats());
+    }
+    for (const auto &toplevel: toplevels_) {
+        if (!metrics_export_->add_window(
+                wl_proxy_get_id(reinterpret_cast<struct wl_proxy *>(toplevel->get_surface())),
+                toplevel->get_frame_stats())) {
+            break;
+        }
+    }
+    metrics_export_->end();
+}
+
+/**
+ * @brief Waits for and dispatches Wayland events on the default queue.
+ *
+ * A timeout of -1 blocks until an event arrives, 0 returns immediately. Sources on
+ * the GMainContext are not serviced; use dispatch() for a loop that sleeps on both.
+ * Tasks handed to post() are, so they also reach the event thread.
+ *
+ * @param timeout The maximum amount of time to wait for events, in milliseconds.
+ * @return The number of events dispatched on success, or a negative error code on failure.
+ *
+ * @see Display::poll_dispatch()
+ */
+int WindowManager::poll_events(int timeout) {
+    // the frame scheduler timer is serviced here unless the window has its own queue
+    struct pollfd fds[3] = {{-1, 0, 0},
+                            {get_event_queue() ? -1 : get_schedule_fd(), POLLIN, 0},
+                            {post_fd_, POLLIN, 0}};
+    int ret = poll_dispatch(wl_display_, nullptr, timeout, fds, 3);
+    if (ret >= 0 && (fds[0].revents & POLLIN)) {
+        const int drained = drain_events(wl_display_, nullptr, read_budget_us_);
+        ret = drained < 0 ? drained : ret + drained;
+    }
+    if (ret >= 0) {
+        if (fds[1].revents & POLLIN) {
+            Window::dispatch_schedule(static_cast<Window *>(this));
+            ret++;
+        }
+        if (fds[2].revents & POLLIN) {
+            run_posted_tasks();
+            ret++;
+        }
+    } else if (get_connection_error()) {
+        report_disconnect();
+    }
+    return count_wakeup(ret);
+}
+
+/**
+ * @brief Runs task on the thread dispatching the default queue, from any thread.
+ *
+ * Tasks are queued without a lock and the loop is woken through an eventfd that
+ * dispatch(), poll_events() and a GLib main loop on the context all poll, so upload,
+ * decoder or network threads can hand over results or ask for a redraw, e.g.
+ * post([w]() { w->request_redraw(); }), without waiting for the next frame callback.
+ * Tasks run in the order they were posted by each thread; posts made while the loop
+ * has not yet woken share one eventfd write.
+ *
+ * @param task The function to run.
+ */
+void WindowManager::post(std::function<void()> task) {
+    posted_tasks_.push(std::move(task));
+    if (!post_pending_.exchange(true, std::memory_order_acq_rel)) {
+        const uint64_t value = 1;
+        if (write(post_fd_, &value, sizeof(value)) < 0) {
+            LOG_ERROR("WindowManager: post wakeup failed: %s", strerror(errno));
+        }
+    }
+}
+
+/**
+ * @brief Services posted tasks and the frame scheduler timer from a native EventLoop.
+ *
+ * For applications that drive the connection with EventLoop::run() instead of
+ * dispatch(); the loop must dispatch the display's default queue. Call after
+ * enable_frame_scheduler(), as the scheduler timer is looked up here. GMainContext
+ * sources, including the keyboard repeat timer, are not part of the loop.
+ *
+ * @param loop The loop, or nullptr to detach from the current one; detach before destroying it.
+ */
+void WindowManager::set_event_loop(EventLoop *loop) {
+    if (event_loop_) {
+        for (auto source: event_loop_sources_) {
+            event_loop_->remove(source);
+        }
+    }
+    event_loop_sources_.clear();
+    event_loop_ = loop;
+    if (!loop) {
+        return;
+    }
+    if (auto source = loop->add_fd(post_fd_, EPOLLIN, [this](uint32_t) { run_posted_tasks(); })) {
+        event_loop_sources_.push_back(source);
+    }
+    if (!get_event_queue() && get_schedule_fd() >= 0) {
+        if (auto source = loop->add_fd(get_schedule_fd(), EPOLLIN, [this](uint32_t) {
+            Window::dispatch_schedule(static_cast<Window *>(this));
+        })) {
+            event_loop_sources_.push_back(source);
+        }
+    }
+}
+
+/**
+ * @brief Clears the post eventfd and runs every task queued so far.
+ *
+ * The pending flag is cleared before the queue is drained, so a task posted while
+ * draining either runs in this call or writes the eventfd again.
+ */
+void WindowManager::run_posted_tasks() {
+    TRACE_SCOPE("WindowManager::run_posted_tasks");
+    uint64_t value;
+    if (read(post_fd_, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+        LOG_ERROR("WindowManager: post eventfd read failed: %s", strerror(errno));
+    }
+    post_pending_.store(false, std::memory_order_seq_cst);
+    std::function<void()> task;
+    while (posted_tasks_.pop(task)) {
+        task();
+        task = nullptr;
+    }
+}
+
+/**
+ * @brief Dispatches the post source to its callback when the eventfd is readable.
+ */
+gboolean WindowManager::post_source_dispatch(GSource * /* source */, GSourceFunc callback, gpointer user_data) {
+    return callback ? callback(user_data) : G_SOURCE_CONTINUE;
+}
+
+GSourceFuncs WindowManager::post_source_funcs_ = {
+        .prepare = nullptr,
+        .check = nullptr,
+        .dispatch = post_source_dispatch,
+        .finalize = nullptr,
+        .closure_callback = nullptr,
+        .closure_marshal = nullptr,
+};
+
+/**
+ * @brief Starts a dedicated thread that reads and dispatches the default queue.
+ *
+ * Input, output and registry events are then handled on the event thread, while
+ * windows that own an event queue (see Window::create_event_queue()) are driven
+ * from their own render threads. The application must not dispatch the default
+ * queue itself while the event thread is running.
+ *
+ * @param attributes Priority and CPUs of the event thread, so frame callbacks and input
+ *                   are not delayed by background load; see ThreadAttributes::apply().
+ */
+void WindowManager::start_event_thread(const ThreadAttributes &attributes) {
+    if (event_thread_.joinable()) {
+        return;
+    }
+    event_thread_running_ = true;
+    event_thread_ = std::thread([this, attributes]() {
+        if (!attributes.is_default()) {
+            (void) attributes.apply();
+        }
+        while (event_thread_running_) {
+            if (poll_events(-1) < 0) {
+                LOG_ERROR("Wayland event thread: %s", strerror(errno));
+                break;
+            }
+        }
+    });
+}
+
+/**
+ * @brief Starts watching round trips to the compositor and the latency of the default queue.
+ *
+ * Stalls are reported through callback on the watchdog thread; see ConnectionWatchdog.
+ * xdg_wm_base pings are recorded as well. Call before start_event_thread(), and only
+ * from the thread dispatching the default queue once it runs.
+ *
+ * @param config   Probe interval and stall thresholds.
+ * @param callback Called with the kind of stall and how long it has lasted.
+ */
+void WindowManager::enable_watchdog(const ConnectionWatchdogConfig &config,
+                                    const std::function<void(ConnectionWatchdog::Stall stall,
+                                                             double duration_ms)> &callback) {
+    watchdog_.reset();
+    watchdog_ = std::make_unique<ConnectionWatchdog>(wl_display_, config, callback);
+}
+
+/**
+ * @brief Stops the watchdog started by enable_watchdog().
+ */
+void WindowManager::disable_watchdog() {
+    watchdog_.reset();
+}
+
+/**
+ * @brief Stops and joins the event thread.
+ *
+ * The thread is woken by a wl_display.sync round trip rather than a periodic
+ * timeout, so a running event thread never wakes up on its own.
+ */
+void WindowManager::stop_event_thread() {
+    if (!event_thread_.joinable()) {
+        return;
+    }
+    event_thread_running_ = false;
+    auto *callback = wl_display_sync(wl_display_);
+    flush(wl_display_);
+    event_thread_.join();
+    wl_callback_destroy(callback);
 }
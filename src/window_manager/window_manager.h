@@ -19,12 +19,46 @@
 
 #include "display.h"
 
-#include <list>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <thread>
+#include <vector>
 
 #include "window/window.h"
+#include "window/frame_group.h"
 #include "window/window_egl.h"
+#include "window/egl_upload_worker.h"
+#include "window/window_dmabuf.h"
+#include "window/window_shm.h"
+#include "window/subsurface.h"
+#include "window/surface_atlas.h"
+#include "window/window_pool.h"
+#include "utils/mpsc_queue.h"
+#include "utils/thread_attributes.h"
+#include "window/decorations.h"
+#include "window/input_region.h"
+#include "window/tearing_control.h"
 
+#if defined(ENABLE_VULKAN)
+#include "window/window_vulkan.h"
+#endif
+
+#if defined(ENABLE_AGL_SHELL_CLIENT)
+#include "agl_shell.h"
+#endif
+#include "connection_watchdog.h"
+#include "event_loop.h"
+#include "metrics_export.h"
+#if defined(ENABLE_IVI_SHELL_CLIENT)
+#include "ivi_shell.h"
+#endif
+#include "window_config.h"
+#include "xdg_popup.h"
+#include "xdg_toplevel.h"
 #include "xdg_wm.h"
+#include "utils/export.h"
 
 
 class Display;
@@ -33,43 +67,390 @@ class WindowEgl;
 
 class Window;
 
-class WindowManager : public Display, public Window {
+class WAYPP_EXPORT WindowManager : public Display, public Window {
 public:
     typedef enum {
         EGL,
         VULKAN,
+        SHM,
     } WindowType;
 
     explicit WindowManager(Window::ShellType shell_type = Window::ShellType::XDG, GMainContext *context = nullptr,
                            bool enable_cursor = true,
-                           const char *name = nullptr);
+                           const char *name = nullptr,
+                           bool wait_for_configure = true,
+                           uint32_t input_devices = INPUT_DEVICE_ALL,
+                           uint32_t ivi_id = 0,
+                           BindPolicy bind_policy = BIND_EAGER,
+                           const XdgWm::InitialState &initial_state = {});
 
     ~WindowManager() override;
 
     WindowEgl *
     create_window(int width, int height, WindowType window_type = WindowType::EGL,
-                  const std::function<void(void *data, uint32_t time)> &draw_callback = nullptr);
+                  const std::function<void(void *data, uint32_t time)> &draw_callback = nullptr,
+                  const WindowEglConfig &config = {});
+
+    RenderSurface *create_render_surface(int width, int height, WindowType window_type = WindowType::EGL);
+
+    RenderSurface *create_window(const WindowConfig &config);
+
+    WindowDmabuf *create_dmabuf_window();
+
+    WindowShm *create_shm_window(int width, int height, const WindowShmConfig &config = {});
+
+    SubSurface *create_subsurface(struct wl_surface *parent = nullptr, bool sync = true);
+
+    void destroy_subsurface(SubSurface *subsurface);
+
+    SurfaceAtlas *create_surface_atlas(const SurfaceAtlasConfig &config = {}, struct wl_surface *parent = nullptr);
+
+    void destroy_surface_atlas(SurfaceAtlas *atlas);
+
+    XdgPopup *create_popup(const XdgPositionerConfig &config, const XdgPopup *parent = nullptr,
+                           struct wl_seat *grab_seat = nullptr, uint32_t grab_serial = 0);
+
+    void destroy_popup(XdgPopup *popup);
+
+    XdgToplevel *create_toplevel(int width, int height,
+                                 const std::function<void(void *data, uint32_t time)> &draw_callback = nullptr);
+
+    void destroy_toplevel(XdgToplevel *toplevel);
+
+    bool set_input_sources(uint8_t sources, const XdgToplevel *toplevel = nullptr);
+
+    [[nodiscard]] FrameGroup *get_output_frame_group(const Output *output = nullptr);
+
+    // the window and its toplevels drop to unfocused_fps, or render on demand, while not focused
+    void enable_focus_throttle(uint32_t unfocused_fps, bool unfocused_on_demand = false);
+
+    void disable_focus_throttle();
+
+    // the window and its toplevels drop to idle_fps, or render on demand, once no seat had input for timeout_ms
+    void enable_idle_throttle(uint32_t timeout_ms, uint32_t idle_fps, bool idle_on_demand = false,
+                              bool respect_inhibitors = false);
+
+    void disable_idle_throttle();
+
+    // invoked as the user goes idle and returns, e.g. to pause animations nobody watches
+    void set_user_idle_callback(const std::function<void(bool idle)> &callback) { user_idle_callback_ = callback; }
+
+    void enable_window_pool(const WindowPoolConfig &config = {});
+
+    [[nodiscard]] const WindowPool *get_window_pool() const { return window_pool_.get(); }
+
+    // like create_subsurface() and create_popup(), with an EGL window from the pool
+    SubSurface *create_egl_subsurface(int width, int height, struct wl_surface *parent = nullptr, bool sync = true);
+
+    XdgPopup *create_egl_popup(const XdgPositionerConfig &config, const XdgPopup *parent = nullptr,
+                               struct wl_seat *grab_seat = nullptr, uint32_t grab_serial = 0);
+
+    [[nodiscard]] const EglDisplay *get_egl_display();
+
+    // EGL setup and load_assets run on workers while the caller waits for the configure
+    bool start_async(const std::function<void()> &load_assets = nullptr);
+
+    // joins what start_async() started and rethrows an EGL setup failure
+    void join_startup();
+
+    [[nodiscard]] EglUploadWorker *get_upload_worker();
+
+    void set_single_context(bool single_context);
+
+    bool set_context_priority(EGLint priority);
+
+#if defined(ENABLE_VULKAN)
+    WindowVulkan *create_vulkan_window(int width, int height, const WindowVulkanConfig &config = {});
+#endif
+
+    [[nodiscard]] int poll_events(int timeout);
+
+    [[nodiscard]] int dispatch(int timeout);
+
+    // times dispatch() or poll_events() returned, and how many of those dispatched nothing
+    [[nodiscard]] uint64_t get_wakeup_count() const { return wakeup_count_; }
+
+    [[nodiscard]] uint64_t get_idle_wakeup_count() const { return idle_wakeup_count_; }
+
+    struct MemoryUsage {
+        // every EGL, Vulkan and SHM window, including those of toplevels, popups, subsurfaces and the pool
+        RenderSurface::MemoryUsage surfaces;
+        // the pooled windows alone, already part of surfaces
+        RenderSurface::MemoryUsage pool;
+        // buffers imported into the dmabuf windows
+        uint64_t dmabuf_bytes;
+        uint64_t cursor_bytes;
+        uint64_t keymap_bytes;
+
+        [[nodiscard]] uint64_t total() const { return surfaces.total() + dmabuf_bytes + cursor_bytes + keymap_bytes; }
+    };
+
+    [[nodiscard]] MemoryUsage get_memory_usage() const;
+
+    // publishes the frame, protocol and loop metrics to shared memory for an external monitor
+    bool enable_metrics_export(const char *name = nullptr, uint32_t interval_ms = 1000);
+
+    [[nodiscard]] const MetricsExport *get_metrics_export() const { return metrics_export_.get(); }
+
+    [[nodiscard]] bool configured() const;
+
+    bool wait_for_configure(int timeout = -1);
+
+    void set_configure_callback(const std::function<void()> &callback);
+
+    [[nodiscard]] bool is_hidden() const { return hidden_; }
+
+    void set_hidden_callback(const std::function<void(bool hidden)> &callback) { hidden_callback_ = callback; }
+
+    // EGL windows hidden for longer than delay_ms free their buffers until shown again, 0 keeps them
+    void set_surface_release_delay(int delay_ms) { surface_release_delay_ms_ = delay_ms; }
+
+    [[nodiscard]] double get_preferred_scale() const { return preferred_scale_ / 120.0; }
+
+    [[nodiscard]] std::vector<const Output *> get_entered_outputs() const;
+
+    [[nodiscard]] const Output *get_primary_output() const { return primary_output_; }
+
+    bool set_presentation_hint(TearingControl::PresentationHint hint);
 
-    [[nodiscard]] int poll_events(int timeout) const;
+#if defined(ENABLE_TEARING_CONTROL)
+    [[nodiscard]] TearingControl::PresentationHint get_presentation_hint() const {
+        return tearing_control_ ? tearing_control_->get_presentation_hint() : TearingControl::VSYNC;
+    }
+#else
+    [[nodiscard]] TearingControl::PresentationHint get_presentation_hint() const { return TearingControl::VSYNC; }
+#endif
 
-    [[nodiscard]] int dispatch(int timeout) const;
+    void start_event_thread(const ThreadAttributes &attributes = {});
+
+    void stop_event_thread();
+
+    void post(std::function<void()> task);
+
+    void set_event_loop(EventLoop *loop);
+
+    void enable_watchdog(const ConnectionWatchdogConfig &config,
+                         const std::function<void(ConnectionWatchdog::Stall stall, double duration_ms)> &callback);
+
+    void disable_watchdog();
+
+    [[nodiscard]] const ConnectionWatchdog *get_watchdog() const { return watchdog_.get(); }
+
+    // the compositor's hints for the toplevel, known once configured, see XdgWm
+    bool get_configure_bounds(int &width, int &height) const {
+        return xdg_wm_ && xdg_wm_->get_bounds(width, height);
+    }
+
+    [[nodiscard]] bool has_wm_capability(uint32_t capability) const {
+        return xdg_wm_ && xdg_wm_->has_capability(capability);
+    }
+
+    // who draws the toplevel's frame, DECORATION_SERVER_SIDE means nothing is left for the client
+    [[nodiscard]] XdgWm::DecorationMode get_decoration_mode() const {
+        return xdg_wm_ ? xdg_wm_->get_decoration_mode() : XdgWm::DECORATION_NONE;
+    }
+
+    bool enable_decorations(int width, int height, const DecorationsConfig &config = {});
+
+    void set_input_region(const std::vector<InputRegion::Rect> &rects);
+
+    // a left press within margin of the window border starts a resize, 0 disables it
+    void set_resize_margin(int margin) { resize_margin_ = margin; }
+
+    void set_close_callback(const std::function<void()> &callback);
+
+    // focus handoff over xdg_activation_v1, see XdgWm::activate() and XdgWm::request_activation_token()
+    bool activate(const char *token) { return xdg_wm_ && xdg_wm_->activate(token); }
+
+    bool request_activation_token(struct wl_seat *seat, uint32_t serial, const char *app_id,
+                                  const std::function<void(const std::string &token)> &callback) {
+        return xdg_wm_ && xdg_wm_->request_activation_token(seat, serial, app_id, callback);
+    }
+
+    // the client-side titlebar, if enable_decorations() created one
+    [[nodiscard]] Decorations *get_decorations() const { return decorations_.get(); }
+
+#if defined(ENABLE_AGL_SHELL_CLIENT)
+    // the AGL shell, for ShellType AGL
+    [[nodiscard]] AglShell *get_agl_shell() const { return agl_shell_.get(); }
+#endif
+
+#if defined(ENABLE_IVI_SHELL_CLIENT)
+    // ivi_application and the toplevel's ivi surface, for ShellType IVI
+    [[nodiscard]] const IviShell *get_ivi_shell() const { return ivi_shell_.get(); }
+
+    [[nodiscard]] const IviSurface *get_ivi_surface() const { return ivi_surface_.get(); }
+#endif
 
 private:
-    // list of windows for z-order control
-    std::list<std::unique_ptr<WindowEgl>> windows_;
+    std::thread event_thread_;
+    std::atomic<bool> event_thread_running_{};
+
+    // shared by all EGL windows, declared first so it outlives them
+    std::unique_ptr<EglDisplay> egl_display_;
+    // owns the display's resource context, so it must go before egl_display_
+    std::unique_ptr<EglUploadWorker> upload_worker_;
+    // windows not yet handed out, also released before egl_display_
+    std::unique_ptr<WindowPool> window_pool_;
+    EGLint context_priority_{EGL_CONTEXT_PRIORITY_MEDIUM_IMG};
+    // see start_async(), egl_display_ is only touched once egl_init_thread_ is joined
+    std::thread egl_init_thread_;
+    std::thread asset_thread_;
+    std::exception_ptr egl_init_error_;
+
+    // windows in creation order, contiguous for the per-frame loops; the windows themselves stay put
+    std::vector<std::unique_ptr<WindowEgl>> windows_;
+    std::vector<std::unique_ptr<WindowDmabuf>> dmabuf_windows_;
+    std::vector<std::unique_ptr<WindowShm>> shm_windows_;
+    std::vector<std::unique_ptr<SubSurface>> subsurfaces_;
+    std::vector<std::unique_ptr<SurfaceAtlas>> surface_atlases_;
+#if defined(ENABLE_VULKAN)
+    std::vector<std::unique_ptr<WindowVulkan>> vulkan_windows_;
+#endif
+    // the EGL, SHM and Vulkan windows above, for what the frame loop does to each alike
+    std::vector<RenderSurface *> render_surfaces_;
+    // per output, before the toplevels so those leave their group on destruction
+    FlatMap<const Output *, std::unique_ptr<FrameGroup>> frame_groups_;
+    // further toplevels, each with its own surface and frame loop
+    std::vector<std::unique_ptr<XdgToplevel>> toplevels_;
     std::unique_ptr<XdgWm> xdg_wm_;
+    // after xdg_wm_, popups go before the toplevel; in creation order, so children follow their parent
+    std::vector<std::unique_ptr<XdgPopup>> popups_;
+    std::unique_ptr<Decorations> decorations_;
+    std::atomic<bool> decorations_state_pending_{};
+    std::atomic<int> resize_margin_{};
+#if defined(ENABLE_AGL_SHELL_CLIENT)
+    std::unique_ptr<AglShell> agl_shell_;
+#endif
+#if defined(ENABLE_IVI_SHELL_CLIENT)
+    std::unique_ptr<IviShell> ivi_shell_;
+    std::unique_ptr<IviSurface> ivi_surface_;
+#endif
+    std::unique_ptr<ConnectionWatchdog> watchdog_;
 
     Window::ShellType shell_type_;
 
-    static void handle_surface_enter(void *data,
-                                     struct wl_surface *surface,
-                                     struct wl_output *output);
+    // outputs the surface is currently on, and the one it is paced and scaled for
+    std::vector<struct wl_output *> entered_outputs_;
+    const Output *primary_output_{};
+    bool has_entered_output_{};
+    bool hidden_{};
+    std::atomic<int> surface_release_delay_ms_{};
+    // when the window was last hidden, and whether the EGL windows' surfaces are released
+    std::atomic<std::chrono::steady_clock::rep> hidden_since_{};
+    // focus throttle applied to toplevels as they are created, see enable_focus_throttle()
+    struct {
+        bool enabled;
+        uint32_t fps;
+        bool on_demand;
+    } focus_throttle_{};
+    // idle throttle applied to toplevels as they are created, see enable_idle_throttle()
+    struct {
+        bool enabled;
+        uint32_t fps;
+        bool on_demand;
+    } idle_throttle_{};
+    std::function<void(bool idle)> user_idle_callback_;
+    // seats whose keyboard is on the window's surface, and on any of the surfaces
+    int keyboard_focus_{};
+    int keyboard_focus_total_{};
+    std::atomic<bool> surfaces_released_{};
+    std::function<void(bool hidden)> hidden_callback_;
+
+    std::atomic<uint64_t> wakeup_count_{};
+    std::atomic<uint64_t> idle_wakeup_count_{};
+    std::unique_ptr<MetricsExport> metrics_export_;
+    uint64_t metrics_interval_ns_{};
+    std::atomic<uint64_t> metrics_published_ns_{};
+    // reused by dispatch() when the context is polled together with the display
+    std::vector<GPollFD> context_fds_;
+    std::vector<struct pollfd> poll_fds_;
+
+    // tasks posted from other threads, run on the thread dispatching the default queue
+    MpscQueue<std::function<void()>> posted_tasks_;
+    std::atomic<bool> post_pending_{};
+    int post_fd_{-1};
+    GSource *post_source_{};
+    EventLoop *event_loop_{};
+    std::vector<EventLoop::Source *> event_loop_sources_;
+
+    // latest configured size, applied to the windows before the next draw
+    struct {
+        int width;
+        int height;
+        bool pending;
+    } pending_size_{};
+
+    // size of the toplevel surface, the window geometry less the titlebar
+    struct {
+        int width;
+        int height;
+    } content_size_{};
 
-    static void handle_surface_leave(void *data,
-                                     struct wl_surface *surface,
-                                     struct wl_output *output);
+    // preferred buffer scale in 1/120 units, as sent by wp_fractional_scale_v1
+    uint32_t preferred_scale_{120};
+    bool scale_pending_{};
+    struct wp_fractional_scale_v1 *wp_fractional_scale_{};
+#if defined(ENABLE_TEARING_CONTROL)
+    std::unique_ptr<TearingControl> tearing_control_;
+#endif
+    std::unique_ptr<InputRegion> input_region_;
+
+    void update_hidden();
+
+    void update_focus();
+
+    void handle_keyboard_focus(struct wl_surface *surface, bool focused);
+
+    void update_idle();
+
+    void release_hidden_surfaces();
+
+    [[nodiscard]] int get_release_timeout(int timeout) const;
+
+    int dispatch_with_context(int timeout);
+
+    int count_wakeup(int result);
+
+    void publish_metrics();
+
+    void run_posted_tasks();
+
+    static gboolean post_source_dispatch(GSource *source, GSourceFunc callback, gpointer user_data);
+
+    static GSourceFuncs post_source_funcs_;
+
+    void update_primary_output();
+
+    void update_decorations();
+
+    void resolve_initial_size(int &width, int &height);
+
+    void handle_pointer_button(Seat &seat, const PointerButton &button);
+
+    void set_preferred_scale(uint32_t scale);
+
+    void prepare_frame() override;
+
+    void frame_committed() override;
+
+    void handle_surface_enter(struct wl_surface *surface,
+                              struct wl_output *output);
+
+    void handle_surface_leave(struct wl_surface *surface,
+                              struct wl_output *output);
+
+#if defined(WL_SURFACE_PREFERRED_BUFFER_SCALE_SINCE_VERSION)
+    void handle_preferred_buffer_scale(struct wl_surface *surface, int32_t factor);
+
+    void handle_preferred_buffer_transform(struct wl_surface *surface, uint32_t transform);
+#endif
 
     static const struct wl_surface_listener surface_listener_;
+
+    void handle_fractional_scale(struct wp_fractional_scale_v1 *fractional_scale, uint32_t scale);
+
+    static const struct wp_fractional_scale_v1_listener fractional_scale_listener_;
 };
 
 #endif // SRC_WINDOW_WINDOW_MANAGER_H_
\ No newline at end of file
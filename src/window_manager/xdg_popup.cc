@@ -0,0 +1,203 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "xdg_popup.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "utils/listener.h"
+#include "utils/logging.h"
+
+/**
+ * @class XdgPopup
+ *
+ * @brief A menu or tooltip: an xdg_popup on a surface of its own, placed by an xdg_positioner.
+ *
+ * Popups are cheap to open. EGL content shares the parent's EglDisplay and its
+ * context, so there is no EGL initialization, config choice or context creation
+ * per popup; SHM content needs no GPU at all. The popup is mapped with the first
+ * buffer committed after its configure, typically within a frame of creation.
+ *
+ * Popups must be destroyed before their parent, the topmost first.
+ *
+ * @param compositor  The wl_compositor used to create the surface.
+ * @param wm_base     The xdg_wm_base the parent was created with.
+ * @param parent      The xdg_surface of the parent toplevel or popup.
+ * @param config      Where the popup goes.
+ * @param grab_seat   For menus, the seat of the press that opens it; nullptr for no grab.
+ * @param grab_serial The serial of that press.
+ */
+XdgPopup::XdgPopup(struct wl_compositor *compositor, struct xdg_wm_base *wm_base, struct xdg_surface *parent,
+                   const XdgPositionerConfig &config, struct wl_seat *grab_seat, uint32_t grab_serial) :
+        XdgPopup(compositor, wm_base, parent, config, WindowPool::Entry{wl_compositor_create_surface(compositor), {}},
+                 grab_seat, grab_serial) {
+}
+
+/**
+ * @brief Opens a popup on a surface acquired from a WindowPool.
+ *
+ * The pooled EGL window is adopted as the popup's content, so get_egl_window() can
+ * draw from the first configure without creating any EGL state.
+ *
+ * @param entry The pooled surface and its EGL window, sized for config.
+ */
+XdgPopup::XdgPopup(struct wl_compositor *compositor, struct xdg_wm_base *wm_base, struct xdg_surface *parent,
+                   const XdgPositionerConfig &config, WindowPool::Entry &&entry, struct wl_seat *grab_seat,
+                   uint32_t grab_serial) :
+        wl_compositor_(compositor),
+        xdg_wm_base_(wm_base),
+        parent_(parent),
+        wl_surface_(entry.surface),
+        geometry_{0, 0, config.width, config.height},
+        egl_window_(std::move(entry.window)) {
+    xdg_surface_ = xdg_wm_base_get_xdg_surface(xdg_wm_base_, wl_surface_);
+    xdg_surface_add_listener(xdg_surface_, &xdg_surface_listener_, this);
+
+    auto positioner = create_positioner(config);
+    xdg_popup_ = xdg_surface_get_popup(xdg_surface_, parent_, positioner);
+    xdg_positioner_destroy(positioner);
+    xdg_popup_add_listener(xdg_popup_, &xdg_popup_listener_, this);
+
+    // a grab is only accepted before the first commit
+    if (grab_seat) {
+        xdg_popup_grab(xdg_popup_, grab_seat, grab_serial);
+    }
+    wl_surface_commit(wl_surface_);
+}
+
+/**
+ * @brief Destroys the content, then the popup, its xdg_surface and surface.
+ */
+XdgPopup::~XdgPopup() {
+    egl_window_.reset();
+    shm_window_.reset();
+    xdg_popup_destroy(xdg_popup_);
+    xdg_surface_destroy(xdg_surface_);
+    wl_surface_destroy(wl_surface_);
+}
+
+/**
+ * @brief Moves the popup to a new place, e.g. a tooltip following the pointer, from xdg_wm_base version 3.
+ *
+ * The new placement arrives with a configure.
+ *
+ * @return false if the compositor cannot reposition popups.
+ */
+bool XdgPopup::reposition(const XdgPositionerConfig &config) {
+#if defined(XDG_POPUP_REPOSITION_SINCE_VERSION)
+    if (xdg_popup_get_version(xdg_popup_) < XDG_POPUP_REPOSITION_SINCE_VERSION) {
+        return false;
+    }
+    auto positioner = create_positioner(config);
+    xdg_popup_reposition(xdg_popup_, positioner, ++reposition_token_);
+    xdg_positioner_destroy(positioner);
+    return true;
+#else
+    (void) config;
+    return false;
+#endif
+}
+
+/**
+ * @brief Hosts an EGL window on the popup, sharing egl_display with the parent.
+ *
+ * @return The window, owned by the popup.
+ */
+WindowEgl *XdgPopup::create_egl_window(const EglDisplay *egl_display, const WindowEglConfig &config) {
+    shm_window_.reset();
+    egl_window_ = std::make_unique<WindowEgl>(egl_display, wl_compositor_, wl_surface_, geometry_.width,
+                                              geometry_.height, Window::ShellType::NONE, nullptr, config);
+    return egl_window_.get();
+}
+
+/**
+ * @brief Hosts an SHM window on the popup.
+ *
+ * @return The window, owned by the popup.
+ */
+WindowShm *XdgPopup::create_shm_window(struct wl_shm *shm, const WindowShmConfig &config) {
+    egl_window_.reset();
+    shm_window_ = std::make_unique<WindowShm>(shm, wl_surface_, geometry_.width, geometry_.height, config);
+    return shm_window_.get();
+}
+
+struct xdg_positioner *XdgPopup::create_positioner(const XdgPositionerConfig &config) const {
+    auto positioner = xdg_wm_base_create_positioner(xdg_wm_base_);
+    xdg_positioner_set_size(positioner, config.width, config.height);
+    xdg_positioner_set_anchor_rect(positioner, config.anchor_rect.x, config.anchor_rect.y,
+                                   std::max(1, config.anchor_rect.width), std::max(1, config.anchor_rect.height));
+    xdg_positioner_set_anchor(positioner, config.anchor);
+    xdg_positioner_set_gravity(positioner, config.gravity);
+    xdg_positioner_set_constraint_adjustment(positioner, config.constraint_adjustment);
+    xdg_positioner_set_offset(positioner, config.offset_x, config.offset_y);
+#if defined(XDG_POSITIONER_SET_REACTIVE_SINCE_VERSION)
+    if (config.reactive && xdg_positioner_get_version(positioner) >= XDG_POSITIONER_SET_REACTIVE_SINCE_VERSION) {
+        xdg_positioner_set_reactive(positioner);
+    }
+#endif
+    return positioner;
+}
+
+/**
+ * @brief Acknowledges the configure and resizes the content to the placed size before reporting it.
+ */
+void XdgPopup::handle_xdg_surface_configure(struct xdg_surface *xdg_surface, uint32_t serial) {
+    xdg_surface_ack_configure(xdg_surface, serial);
+    configured_ = true;
+    if (egl_window_) {
+        egl_window_->resize(geometry_.width, geometry_.height);
+    }
+    if (shm_window_) {
+        shm_window_->resize(geometry_.width, geometry_.height);
+    }
+    if (configure_callback_) {
+        configure_callback_(geometry_);
+    }
+}
+
+const struct xdg_surface_listener XdgPopup::xdg_surface_listener_ = {
+        .configure = listener_thunk<&XdgPopup::handle_xdg_surface_configure>,
+};
+
+void XdgPopup::handle_configure(struct xdg_popup * /* popup */, int32_t x, int32_t y, int32_t width,
+                                int32_t height) {
+    // a constraint adjustment may have shrunk the popup
+    geometry_ = {x, y, width > 0 ? width : geometry_.width, height > 0 ? height : geometry_.height};
+}
+
+void XdgPopup::handle_popup_done(struct xdg_popup * /* popup */) {
+    LOG_DEBUG("XdgPopup: done");
+    if (done_callback_) {
+        done_callback_();
+    }
+}
+
+#if defined(XDG_POPUP_REPOSITIONED_SINCE_VERSION)
+
+void XdgPopup::handle_repositioned(struct xdg_popup * /* popup */, uint32_t /* token */) {
+}
+
+#endif
+
+const struct xdg_popup_listener XdgPopup::xdg_popup_listener_ = {
+        .configure = listener_thunk<&XdgPopup::handle_configure>,
+        .popup_done = listener_thunk<&XdgPopup::handle_popup_done>,
+#if defined(XDG_POPUP_REPOSITIONED_SINCE_VERSION)
+        .repositioned = listener_thunk<&XdgPopup::handle_repositioned>,
+#endif
+};
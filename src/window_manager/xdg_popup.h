@@ -0,0 +1,145 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SRC_WINDOW_MANAGER_XDG_POPUP_H_
+#define SRC_WINDOW_MANAGER_XDG_POPUP_H_
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+#include <wayland-client.h>
+
+#include "xdg-shell-client-protocol.h"
+
+#include "window/egl_display.h"
+#include "window/window_egl.h"
+#include "window/window_pool.h"
+#include "window/window_shm.h"
+#include "utils/export.h"
+
+// where a popup goes relative to its parent, see xdg_positioner
+struct XdgPositionerConfig {
+    // popup size in surface coordinates
+    int32_t width;
+    int32_t height;
+    // the rectangle of the parent's window geometry the popup is placed against, e.g. a menu button
+    struct {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    } anchor_rect;
+    uint32_t anchor{XDG_POSITIONER_ANCHOR_BOTTOM_LEFT};
+    uint32_t gravity{XDG_POSITIONER_GRAVITY_BOTTOM_RIGHT};
+    // how the compositor may move the popup to keep it on screen
+    uint32_t constraint_adjustment{XDG_POSITIONER_CONSTRAINT_ADJUSTMENT_FLIP_X |
+                                   XDG_POSITIONER_CONSTRAINT_ADJUSTMENT_FLIP_Y |
+                                   XDG_POSITIONER_CONSTRAINT_ADJUSTMENT_SLIDE_X |
+                                   XDG_POSITIONER_CONSTRAINT_ADJUSTMENT_SLIDE_Y};
+    int32_t offset_x{};
+    int32_t offset_y{};
+    // placed again as the parent moves or resizes, from xdg_wm_base version 3
+    bool reactive{};
+};
+
+class WAYPP_EXPORT XdgPopup {
+public:
+    // position relative to the parent's window geometry, and size
+    struct Geometry {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    };
+
+    XdgPopup(struct wl_compositor *compositor, struct xdg_wm_base *wm_base, struct xdg_surface *parent,
+             const XdgPositionerConfig &config, struct wl_seat *grab_seat = nullptr, uint32_t grab_serial = 0);
+
+    // on a surface from a WindowPool, its EGL window becomes the popup's content
+    XdgPopup(struct wl_compositor *compositor, struct xdg_wm_base *wm_base, struct xdg_surface *parent,
+             const XdgPositionerConfig &config, WindowPool::Entry &&entry, struct wl_seat *grab_seat = nullptr,
+             uint32_t grab_serial = 0);
+
+    ~XdgPopup();
+
+    XdgPopup(const XdgPopup &) = delete;
+
+    XdgPopup &operator=(const XdgPopup &) = delete;
+
+    [[nodiscard]] struct wl_surface *get_surface() const { return wl_surface_; }
+
+    [[nodiscard]] struct xdg_surface *get_xdg_surface() const { return xdg_surface_; }
+
+    [[nodiscard]] struct xdg_surface *get_parent() const { return parent_; }
+
+    [[nodiscard]] bool configured() const { return configured_; }
+
+    [[nodiscard]] const Geometry &get_geometry() const { return geometry_; }
+
+    // after each configure is acknowledged, the content is already resized; draw and commit here
+    void set_configure_callback(const std::function<void(const Geometry &geometry)> &callback) {
+        configure_callback_ = callback;
+    }
+
+    // the compositor dismissed the popup, e.g. after a click outside a grabbing menu
+    void set_done_callback(const std::function<void()> &callback) { done_callback_ = callback; }
+
+    bool reposition(const XdgPositionerConfig &config);
+
+    WindowEgl *create_egl_window(const EglDisplay *egl_display, const WindowEglConfig &config = {});
+
+    WindowShm *create_shm_window(struct wl_shm *shm, const WindowShmConfig &config = {});
+
+    [[nodiscard]] WindowEgl *get_egl_window() const { return egl_window_.get(); }
+
+private:
+    struct wl_compositor *wl_compositor_;
+    struct xdg_wm_base *xdg_wm_base_;
+    struct xdg_surface *parent_;
+    struct wl_surface *wl_surface_{};
+    struct xdg_surface *xdg_surface_{};
+    struct xdg_popup *xdg_popup_{};
+    bool configured_{};
+    Geometry geometry_{};
+    uint32_t reposition_token_{};
+    std::function<void(const Geometry &geometry)> configure_callback_;
+    std::function<void()> done_callback_;
+
+    // the content hosted on the surface, at most one is set
+    std::unique_ptr<WindowEgl> egl_window_;
+    std::unique_ptr<WindowShm> shm_window_;
+
+    [[nodiscard]] struct xdg_positioner *create_positioner(const XdgPositionerConfig &config) const;
+
+    void handle_xdg_surface_configure(struct xdg_surface *xdg_surface, uint32_t serial);
+
+    static const struct xdg_surface_listener xdg_surface_listener_;
+
+    void handle_configure(struct xdg_popup *popup, int32_t x, int32_t y, int32_t width, int32_t height);
+
+    void handle_popup_done(struct xdg_popup *popup);
+
+#if defined(XDG_POPUP_REPOSITIONED_SINCE_VERSION)
+
+    void handle_repositioned(struct xdg_popup *popup, uint32_t token);
+
+#endif
+
+    static const struct xdg_popup_listener xdg_popup_listener_;
+};
+
+#endif // SRC_WINDOW_MANAGER_XDG_POPUP_H_
@@ -0,0 +1,153 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "xdg_toplevel.h"
+
+#include <algorithm>
+
+#include "display.h"
+
+/**
+ * @class XdgToplevel
+ *
+ * @brief A window of its own: a wl_surface with an xdg_toplevel role and a frame callback chain.
+ *
+ * Unlike the windows of WindowManager::create_window(), which all draw to the
+ * WindowManager's surface, each toplevel is paced, damaged, resized and presented
+ * independently. The frame loop is held until the first configure, so the first frame
+ * is drawn at the size the compositor asked for.
+ *
+ * The content is any RenderSurface, created on the toplevel's surface; at most one is
+ * set. Draw it from the draw callback or a frame handler, the commit is made by the
+ * toplevel's frame loop.
+ *
+ * @param display       The display the toplevel is created on.
+ * @param width         The size used until the compositor configures one.
+ * @param height        The size used until the compositor configures one.
+ * @param draw_callback Called for every frame of this toplevel.
+ */
+XdgToplevel::XdgToplevel(Display *display, int width, int height,
+                         const std::function<void(void *data, uint32_t time)> &draw_callback) :
+        Window(display->get_compositor(), XDG, draw_callback),
+        display_(display),
+        width_(width),
+        height_(height) {
+    set_paused(true);
+    xdg_wm_ = std::make_unique<XdgWm>(display, get_surface());
+    xdg_wm_->set_resize_callback([this](int configured_width, int configured_height) {
+        width_ = configured_width;
+        height_ = configured_height;
+        resize_pending_ = true;
+        request_redraw();
+    });
+    xdg_wm_->set_configure_callback([this]() { set_paused(false); });
+    xdg_wm_->set_deferred_ack(true);
+    xdg_wm_->set_state_callback([this]() {
+        update_focus();
+        if (is_paused()) {
+            (void) xdg_wm_->ack_configure();
+        } else if (xdg_wm_->has_pending_ack()) {
+            request_redraw();
+        }
+    });
+    enable_presentation_feedback(display->get_presentation(), display->get_presentation_clock());
+    enable_alpha_modifier(display->get_alpha_modifier());
+    enable_color_management(display->get_color_manager());
+    enable_fifo(display->get_fifo_manager());
+    enable_commit_timing(display->get_commit_timing_manager());
+}
+
+/**
+ * @brief Destroys the content, then the toplevel role and the surface.
+ */
+XdgToplevel::~XdgToplevel() {
+    set_paused(true);
+    content_.reset();
+    xdg_wm_.reset();
+    wl_surface_destroy(get_surface());
+}
+
+/**
+ * @brief Counts the seats whose keyboard focuses the toplevel, see Window::set_focus_throttle().
+ *
+ * @param focused true on enter, false on leave.
+ */
+void XdgToplevel::set_keyboard_focus(bool focused) {
+    keyboard_focus_ = std::max(keyboard_focus_ + (focused ? 1 : -1), 0);
+    update_focus();
+}
+
+/**
+ * @brief Creates EGL content on the toplevel's surface.
+ *
+ * @param egl_display The EGL display, shared with the other windows.
+ * @param config      The EGL config attributes and context ownership.
+ * @return The window, owned by the toplevel.
+ */
+WindowEgl *XdgToplevel::create_egl_window(const EglDisplay *egl_display, const WindowEglConfig &config) {
+    auto window = std::make_unique<WindowEgl>(egl_display, display_->get_compositor(), get_surface(), width_, height_,
+                                              XDG, nullptr, config);
+    auto result = window.get();
+    content_ = std::move(window);
+    return result;
+}
+
+/**
+ * @brief Creates software rendering content on the toplevel's surface.
+ *
+ * @param config The pixel format and number of buffers in the ring.
+ * @return The window, owned by the toplevel.
+ */
+WindowShm *XdgToplevel::create_shm_window(const WindowShmConfig &config) {
+    auto window = std::make_unique<WindowShm>(display_->get_shm(), get_surface(), width_, height_, config);
+    auto result = window.get();
+    content_ = std::move(window);
+    return result;
+}
+
+#if defined(ENABLE_VULKAN)
+
+/**
+ * @brief Creates Vulkan content on the toplevel's surface.
+ *
+ * Call WindowVulkan::draw_frame() from the toplevel's frame handler.
+ *
+ * @param config The present mode and swapchain image count.
+ * @return The window, owned by the toplevel.
+ */
+WindowVulkan *XdgToplevel::create_vulkan_window(const WindowVulkanConfig &config) {
+    auto window = std::make_unique<WindowVulkan>(display_->get_display(), get_surface(), width_, height_, config);
+    window->set_frame_clock(get_frame_clock());
+    auto result = window.get();
+    content_ = std::move(window);
+    return result;
+}
+
+#endif
+
+/**
+ * @brief Acks the latest configure and applies its size to the content, once per frame.
+ */
+void XdgToplevel::prepare_frame() {
+    (void) xdg_wm_->ack_configure();
+    if (resize_pending_) {
+        resize_pending_ = false;
+        if (content_) {
+            content_->resize(width_, height_);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef SRC_WINDOW_MANAGER_XDG_TOPLEVEL_H_
+#define SRC_WINDOW_MANAGER_XDG_TOPLEVEL_H_
+
+#include <functional>
+#include <memory>
+
+#include <wayland-client.h>
+
+#include "window/egl_display.h"
+#include "window/render_surface.h"
+#include "window/window.h"
+#include "window/window_egl.h"
+#include "window/window_shm.h"
+
+#if defined(ENABLE_VULKAN)
+
+#include "window/window_vulkan.h"
+
+#endif
+
+#include "xdg_wm.h"
+#include "utils/export.h"
+
+class Display;
+
+class WAYPP_EXPORT XdgToplevel : public Window {
+public:
+    XdgToplevel(Display *display, int width, int height,
+                const std::function<void(void *data, uint32_t time)> &draw_callback = nullptr);
+
+    ~XdgToplevel() override;
+
+    XdgToplevel(const XdgToplevel &) = delete;
+
+    XdgToplevel &operator=(const XdgToplevel &) = delete;
+
+    // title, app id, states and the close request
+    [[nodiscard]] XdgWm &get_xdg_wm() const { return *xdg_wm_; }
+
+    [[nodiscard]] int get_width() const { return width_; }
+
+    [[nodiscard]] int get_height() const { return height_; }
+
+    WindowEgl *create_egl_window(const EglDisplay *egl_display, const WindowEglConfig &config = {});
+
+    WindowShm *create_shm_window(const WindowShmConfig &config = {});
+
+#if defined(ENABLE_VULKAN)
+
+    WindowVulkan *create_vulkan_window(const WindowVulkanConfig &config = {});
+
+#endif
+
+    // the content drawn on the surface, nullptr until one of the create functions
+    [[nodiscard]] RenderSurface *get_content() const { return content_.get(); }
+
+    // a seat's keyboard entered or left the toplevel's surface
+    void set_keyboard_focus(bool focused);
+
+protected:
+    void prepare_frame() override;
+
+private:
+    Display *display_;
+    std::unique_ptr<XdgWm> xdg_wm_;
+    std::unique_ptr<RenderSurface> content_;
+
+    // the size in surface coordinates, from the last configure
+    int width_;
+    int height_;
+    // configures coalesced until the next frame
+    bool resize_pending_{};
+    // seats whose keyboard is on the surface
+    int keyboard_focus_{};
+
+    void update_focus() { set_focused(xdg_wm_->is_activated() || keyboard_focus_ > 0); }
+};
+
+#endif // SRC_WINDOW_MANAGER_XDG_TOPLEVEL_H_
@@ -16,8 +16,14 @@
 
 #include "xdg_wm.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
-#include <iostream>
+#include <stdexcept>
+
+#include "display.h"
+#include "utils/listener.h"
+#include "utils/logging.h"
 
 // workaround for Wayland macro not compiling in C++
 #define WL_ARRAY_FOR_EACH(pos, array, type)                             \
@@ -32,13 +38,68 @@
  * @brief XdgWm represents a window manager for a Wayland-based display.
  *
  * The XdgWm class is responsible for managing application windows using the XDG Shell protocol.
+ * xdg_wm_base is bound from the globals the Display recorded during its registry roundtrip,
+ * so no second registry enumeration is needed before the toplevel is created.
+ *
+ * If the compositor offers xdg-decoration, server-side decorations are requested
+ * before the first commit, so the initial configure already carries the mode and
+ * the window never draws a frame it later drops. See get_decoration_mode().
+ *
+ * The title, app id and a fullscreen or maximized state from initial_state go out
+ * with the first commit too, so the first configure, and the first buffers allocated
+ * from it, are at the final size.
+ *
+ * A startup token from the launcher, XDG_ACTIVATION_TOKEN or DESKTOP_STARTUP_ID, is
+ * passed to xdg_activation_v1 before the first commit, so the compositor focuses and
+ * raises the window as it maps instead of after another interaction.
  */
-XdgWm::XdgWm(struct wl_display *display, struct wl_surface *base_surface) : wl_surface_(base_surface) {
-    wl_registry_ = wl_display_get_registry(display);
-    wl_registry_add_listener(wl_registry_, &registry_listener_, this);
+XdgWm::XdgWm(const Display *display, struct wl_surface *base_surface, const InitialState &initial_state) :
+        wl_surface_(base_surface) {
+    // v6 adds the suspended toplevel state; never bind above what the generated header knows
+    xdg_wm_base_ = static_cast<struct xdg_wm_base *>(
+            display->bind_global(&xdg_wm_base_interface,
+                                 std::min(6u, static_cast<uint32_t>(xdg_wm_base_interface.version))));
+    if (!xdg_wm_base_) {
+        throw std::runtime_error("xdg_wm_base is not available.");
+    }
+    xdg_wm_base_add_listener(xdg_wm_base_, &xdg_wm_base_listener_, this);
+
+    xdg_surface_ = xdg_wm_base_get_xdg_surface(xdg_wm_base_, wl_surface_);
+    xdg_surface_add_listener(xdg_surface_, &xdg_surface_listener_, this);
+
+    xdg_toplevel_ = xdg_surface_get_toplevel(xdg_surface_);
+    xdg_toplevel_add_listener(xdg_toplevel_, &xdg_toplevel_listener_, this);
+
+    xdg_toplevel_set_title(xdg_toplevel_, initial_state.title ? initial_state.title : "waypp");
+    xdg_toplevel_set_app_id(xdg_toplevel_, initial_state.app_id ? initial_state.app_id : "waypp");
+    // a kiosk window is configured at the output size right away, instead of mapping small and growing
+    if (initial_state.fullscreen) {
+        xdg_toplevel_set_fullscreen(xdg_toplevel_, initial_state.output);
+    } else if (initial_state.maximized) {
+        xdg_toplevel_set_maximized(xdg_toplevel_);
+    }
+
+#if defined(ENABLE_XDG_DECORATION)
+    decoration_manager_ = static_cast<struct zxdg_decoration_manager_v1 *>(
+            display->bind_global(&zxdg_decoration_manager_v1_interface, 1));
+    if (decoration_manager_) {
+        toplevel_decoration_ = zxdg_decoration_manager_v1_get_toplevel_decoration(decoration_manager_, xdg_toplevel_);
+        zxdg_toplevel_decoration_v1_add_listener(toplevel_decoration_, &decoration_listener_, this);
+        zxdg_toplevel_decoration_v1_set_mode(toplevel_decoration_, ZXDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE);
+    }
+#endif
+
+    xdg_activation_ = static_cast<struct xdg_activation_v1 *>(
+            display->bind_global(&xdg_activation_v1_interface, 1));
+    // a token the compositor never saw stays for whoever can still use it
+    if (const auto token = get_startup_token(); !token.empty() && activate(token.c_str())) {
+        clear_startup_token();
+    }
 
     // enables blocking caller until set false
     wait_for_configure_ = true;
+
+    wl_surface_commit(wl_surface_);
 }
 
 /**
@@ -48,12 +109,24 @@ XdgWm::XdgWm(struct wl_display *display, struct wl_surface *base_surface) : wl_s
  *
  * The XdgWm class manages the creation, destruction, configuration, and behavior of a Wayland shell window manager.
  *
- * It is responsible for handling interactions with the Wayland registry, creating and destroying the window manager base,
+ * It is responsible for creating and destroying the window manager base,
  * surface, and toplevel objects, and implementing the necessary event handling functions.
  */
 XdgWm::~XdgWm() {
-    if (wl_registry_)
-        wl_registry_destroy(wl_registry_);
+    for (const auto &request: activation_requests_) {
+        xdg_activation_token_v1_destroy(request->token);
+    }
+    if (xdg_activation_)
+        xdg_activation_v1_destroy(xdg_activation_);
+
+#if defined(ENABLE_XDG_DECORATION)
+    // the decoration must go before its toplevel
+    if (toplevel_decoration_)
+        zxdg_toplevel_decoration_v1_destroy(toplevel_decoration_);
+
+    if (decoration_manager_)
+        zxdg_decoration_manager_v1_destroy(decoration_manager_);
+#endif
 
     if (xdg_toplevel_)
         xdg_toplevel_destroy(xdg_toplevel_);
@@ -66,103 +139,306 @@ XdgWm::~XdgWm() {
 }
 
 /**
- * @brief Handles global registry events.
+ * @brief Answers the compositor's liveness check, then reports it through the ping callback.
+ */
+void XdgWm::xdg_wm_base_ping(struct xdg_wm_base *xdg_wm_base,
+                             uint32_t serial) {
+    LOG_DEBUG("XdgWm::xdg_wm_base_ping");
+    xdg_wm_base_pong(xdg_wm_base, serial);
+    if (ping_callback_) {
+        ping_callback_();
+    }
+}
+
+const struct xdg_wm_base_listener XdgWm::xdg_wm_base_listener_ = {
+        .ping = listener_thunk<&XdgWm::xdg_wm_base_ping>,
+};
+
+/**
+ * @brief Gets the size the compositor asked for, e.g. for a window starting maximized.
  *
- * This function is called when a new global object is added or removed from the registry.
- * If the added global object is of type xdg_wm_base, it sets up the necessary listeners
- * and binds the object to the XdgWm instance.
+ * @return false while the compositor leaves the size to the client.
+ */
+bool XdgWm::get_configured_size(int &width, int &height) const {
+    if (geometry_.width <= 0 || geometry_.height <= 0) {
+        return false;
+    }
+    width = geometry_.width;
+    height = geometry_.height;
+    return true;
+}
+
+/**
+ * @brief Gets the largest size the window should have, from xdg_wm_base version 4.
  *
- * @param data The user data associated with the callback (XdgWm instance).
- * @param registry The registry object.
- * @param name The name of the global object.
- * @param interface The interface name of the global object.
- * @param version The version of the global object.
+ * @return false if the compositor sent no bounds.
  */
-void XdgWm::registry_handle_global(void *data,
-                                   struct wl_registry *registry,
-                                   uint32_t name,
-                                   const char *interface,
-                                   uint32_t version) {
+bool XdgWm::get_bounds(int &width, int &height) const {
+    if (bounds_.width <= 0 || bounds_.height <= 0) {
+        return false;
+    }
+    width = bounds_.width;
+    height = bounds_.height;
+    return true;
+}
 
-    if (strcmp(interface, xdg_wm_base_interface.name) == 0) {
-        const auto obj = static_cast<XdgWm *>(data);
+/**
+ * @brief Checks whether the compositor supports a window management request, from xdg_wm_base version 5.
+ *
+ * Without the wm_capabilities event everything is assumed supported, as the protocol says.
+ *
+ * @param capability An xdg_toplevel_wm_capabilities value.
+ */
+bool XdgWm::has_capability(uint32_t capability) const {
+    return !capabilities_known_ || (capability < 32 && (capabilities_ & (1u << capability)));
+}
 
-        obj->xdg_wm_base_ = static_cast<struct xdg_wm_base *>(
-                wl_registry_bind(registry, name, &xdg_wm_base_interface,
-                                 std::min(static_cast<uint32_t>(3), version)));
-        xdg_wm_base_add_listener(obj->xdg_wm_base_, &xdg_wm_base_listener_, obj);
+/**
+ * @brief Returns the startup token the launcher passed in the environment.
+ *
+ * @return XDG_ACTIVATION_TOKEN, else DESKTOP_STARTUP_ID, empty if there is none.
+ */
+std::string XdgWm::get_startup_token() {
+    for (const auto name: {"XDG_ACTIVATION_TOKEN", "DESKTOP_STARTUP_ID"}) {
+        if (const char *value = getenv(name); value && *value) {
+            return value;
+        }
+    }
+    return {};
+}
 
-        obj->xdg_surface_ = xdg_wm_base_get_xdg_surface(obj->xdg_wm_base_, obj->wl_surface_);
-        xdg_surface_add_listener(obj->xdg_surface_, &xdg_surface_listener_, obj);
+/**
+ * @brief Clears the startup token from the environment.
+ *
+ * Call once the token was handed to the compositor, so processes started later do not
+ * inherit a used token.
+ */
+void XdgWm::clear_startup_token() {
+    unsetenv("XDG_ACTIVATION_TOKEN");
+    unsetenv("DESKTOP_STARTUP_ID");
+}
 
-        obj->xdg_toplevel_ = xdg_surface_get_toplevel(obj->xdg_surface_);
-        xdg_toplevel_add_listener(obj->xdg_toplevel_, &xdg_toplevel_listener_, obj);
+/**
+ * @brief Asks the compositor to focus and raise the toplevel.
+ *
+ * Before the first commit this maps the window focused.
+ *
+ * @param token An activation token, from the launcher or request_activation_token().
+ * @return false if the compositor has no xdg_activation_v1.
+ */
+bool XdgWm::activate(const char *token) {
+    if (!xdg_activation_) {
+        return false;
+    }
+    LOG_DEBUG("XdgWm: activating with %s", token);
+    xdg_activation_v1_activate(xdg_activation_, token, wl_surface_);
+    return true;
+}
 
-        xdg_toplevel_set_title(obj->xdg_toplevel_, "waypp");
-        xdg_toplevel_set_app_id(obj->xdg_toplevel_, "waypp");
+/**
+ * @brief Gets a token that lets another surface or a launched process take focus.
+ *
+ * Pass it to a child process in XDG_ACTIVATION_TOKEN. The compositor honours tokens
+ * tied to a recent input event, so give the seat and serial of the click or key
+ * that launches it.
+ *
+ * @param seat     The seat of the triggering input event, may be nullptr.
+ * @param serial   The serial of the triggering input event.
+ * @param app_id   The app id of what will be activated, may be nullptr.
+ * @param callback Invoked with the token, on the thread dispatching the default queue.
+ * @return false if the compositor has no xdg_activation_v1.
+ */
+bool XdgWm::request_activation_token(struct wl_seat *seat, uint32_t serial, const char *app_id,
+                                     const std::function<void(const std::string &token)> &callback) {
+    if (!xdg_activation_) {
+        return false;
+    }
+    auto request = std::make_unique<ActivationRequest>();
+    request->xdg_wm = this;
+    request->token = xdg_activation_v1_get_activation_token(xdg_activation_);
+    request->callback = callback;
+    xdg_activation_token_v1_add_listener(request->token, &activation_token_listener_, request.get());
+    if (seat) {
+        xdg_activation_token_v1_set_serial(request->token, serial, seat);
+    }
+    if (app_id) {
+        xdg_activation_token_v1_set_app_id(request->token, app_id);
+    }
+    xdg_activation_token_v1_set_surface(request->token, wl_surface_);
+    xdg_activation_token_v1_commit(request->token);
+    activation_requests_.emplace_back(std::move(request));
+    return true;
+}
+
+void XdgWm::handle_activation_token_done(void *data, struct xdg_activation_token_v1 *token, const char *name) {
+    const auto request = static_cast<ActivationRequest *>(data);
+    auto *obj = request->xdg_wm;
+    const auto callback = std::move(request->callback);
+    xdg_activation_token_v1_destroy(token);
+    obj->activation_requests_.remove_if([request](const auto &item) { return item.get() == request; });
+    if (callback) {
+        callback(name);
+    }
+}
+
+const struct xdg_activation_token_v1_listener XdgWm::activation_token_listener_ = {
+        .done = handle_activation_token_done,
+};
+
+/**
+ * @brief Asks the compositor to maximize the toplevel, or to restore it.
+ *
+ * The compositor answers with a configure, with or without the maximized state.
+ */
+void XdgWm::set_maximized(bool maximized) {
+    if (maximized) {
+        xdg_toplevel_set_maximized(xdg_toplevel_);
+    } else {
+        xdg_toplevel_unset_maximized(xdg_toplevel_);
+    }
+}
 
-        wl_surface_commit(obj->wl_surface_);
+/**
+ * @brief Asks the compositor to make the toplevel fullscreen, or to restore it.
+ *
+ * @param fullscreen true for fullscreen.
+ * @param output     The output to cover, nullptr for the compositor's choice.
+ */
+void XdgWm::set_fullscreen(bool fullscreen, struct wl_output *output) {
+    if (fullscreen) {
+        xdg_toplevel_set_fullscreen(xdg_toplevel_, output);
+    } else {
+        xdg_toplevel_unset_fullscreen(xdg_toplevel_);
     }
 }
 
 /**
- * @brief Handles the removal of a global from the registry.
+ * @brief Asks the compositor for client- or server-side decorations.
  *
- * This function is a callback that is triggered when a global object is
- * removed from the registry. It does not return anything.
+ * The compositor has the final say; the outcome arrives with the next configure
+ * and is reported through the decoration callback. DECORATION_NONE leaves the
+ * choice to the compositor.
  *
- * @param data     A pointer to user-defined data.
- * @param reg      A pointer to the registry that triggered the event.
- * @param id       The ID of the removed global.
+ * @return false if the compositor does not support xdg-decoration, or it is not built in.
  */
-void XdgWm::registry_handle_global_remove(void * /* data */,
-                                          struct wl_registry * /* reg */,
-                                          uint32_t /* id */) {
+bool XdgWm::set_decoration_mode(DecorationMode mode) {
+#if defined(ENABLE_XDG_DECORATION)
+    if (!toplevel_decoration_) {
+        return false;
+    }
+    switch (mode) {
+        case DECORATION_CLIENT_SIDE:
+            zxdg_toplevel_decoration_v1_set_mode(toplevel_decoration_, ZXDG_TOPLEVEL_DECORATION_V1_MODE_CLIENT_SIDE);
+            break;
+        case DECORATION_SERVER_SIDE:
+            zxdg_toplevel_decoration_v1_set_mode(toplevel_decoration_, ZXDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE);
+            break;
+        case DECORATION_NONE:
+            zxdg_toplevel_decoration_v1_unset_mode(toplevel_decoration_);
+            break;
+    }
+    return true;
+#else
+    (void) mode;
+    return false;
+#endif
 }
 
-const struct wl_registry_listener XdgWm::registry_listener_ = {
-        registry_handle_global,
-        registry_handle_global_remove,
-};
+#if defined(ENABLE_XDG_DECORATION)
 
 /**
- * @class XdgWm
+ * @brief Records the decoration mode the compositor chose, applied with the surrounding configure.
  *
- * The XdgWm class represents a window manager for XDG surfaces.
+ * With server-side decorations the client buffer is the whole window: no frame
+ * to draw and no subsurfaces for it.
  */
-void XdgWm::xdg_wm_base_ping(void * /* data */,
-                             struct xdg_wm_base *xdg_wm_base,
-                             uint32_t serial) {
-    std::cout << "XdgWm::xdg_wm_base_ping" << std::endl;
-    xdg_wm_base_pong(xdg_wm_base, serial);
+void XdgWm::handle_decoration_configure(struct zxdg_toplevel_decoration_v1 * /* decoration */, uint32_t mode) {
+    const DecorationMode decoration_mode =
+            mode == ZXDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE ? DECORATION_SERVER_SIDE : DECORATION_CLIENT_SIDE;
+    LOG_DEBUG("XdgWm: %s-side decorations", decoration_mode == DECORATION_SERVER_SIDE ? "server" : "client");
+    if (decoration_mode != decoration_mode_) {
+        decoration_mode_ = decoration_mode;
+        if (decoration_callback_) {
+            decoration_callback_(decoration_mode_);
+        }
+    }
 }
 
-const struct xdg_wm_base_listener XdgWm::xdg_wm_base_listener_ = {
-        .ping = xdg_wm_base_ping,
+const struct zxdg_toplevel_decoration_v1_listener XdgWm::decoration_listener_ = {
+        .configure = listener_thunk<&XdgWm::handle_decoration_configure>,
 };
+#endif
 
 /**
  * @brief Handles the configure event for xdg_surface.
  *
  * This function is a member function of the XdgWm class. It is called when the xdg_surface
- * sends a configure event. It acknowledges the configure request by calling xdg_surface_ack_configure().
- * It also sets the wait_for_configure_ variable to false.
+ * sends a configure event. It acknowledges the configure request by calling xdg_surface_ack_configure(),
+ * or with set_deferred_ack() leaves the serial for ack_configure(), so a burst of configures
+ * during an interactive resize is acked once, with the frame that applies it. The first
+ * configure and those of a suspended toplevel, which draws no frames, are acked at once.
+ * It also sets the wait_for_configure_ variable to false, and invokes the configure callback
+ * the first time the surface is configured. A changed toplevel size is reported through
+ * the resize callback, once per configure sequence.
  *
- * @param data A pointer to the XdgWm instance.
  * @param xdg_surface A pointer to the xdg_surface instance.
  * @param serial The serial number of the configure event.
  */
 void XdgWm::handle_xdg_surface_configure(
-        void *data,
         struct xdg_surface *xdg_surface,
         uint32_t serial) {
-    auto *w = static_cast<XdgWm *>(data);
-    xdg_surface_ack_configure(xdg_surface, serial);
-    w->wait_for_configure_ = false;
+    configure_count_++;
+    const bool defer = deferred_ack_ && !wait_for_configure_ && !suspended_;
+    if (!defer) {
+        ack_pending_ = false;
+        xdg_surface_ack_configure(xdg_surface, serial);
+        ack_count_++;
+    }
+
+    if (geometry_.width > 0 && geometry_.height > 0 &&
+        (geometry_.width != reported_size_.width || geometry_.height != reported_size_.height)) {
+        reported_size_.width = geometry_.width;
+        reported_size_.height = geometry_.height;
+        LOG_DEBUG("XdgWm: configured %dx%d", geometry_.width, geometry_.height);
+        if (resize_callback_) {
+            resize_callback_(geometry_.width, geometry_.height);
+        }
+    }
+
+    // published after the size, so whoever acks it applies that size or a later one
+    if (defer) {
+        pending_serial_.store(serial, std::memory_order_relaxed);
+        ack_pending_.store(true, std::memory_order_release);
+    }
+
+    if (state_callback_) {
+        state_callback_();
+    }
+
+    if (wait_for_configure_.exchange(false) && configure_callback_) {
+        configure_callback_();
+    }
+}
+
+/**
+ * @brief Acks the latest configure left by set_deferred_ack(), right before the commit applying it.
+ *
+ * Call from the frame loop after taking the configured size and before the commit;
+ * configures that arrived since the last frame are answered with a single ack.
+ *
+ * @return true if an ack was sent.
+ */
+bool XdgWm::ack_configure() {
+    if (!ack_pending_.exchange(false, std::memory_order_acquire)) {
+        return false;
+    }
+    xdg_surface_ack_configure(xdg_surface_, pending_serial_.load(std::memory_order_relaxed));
+    ack_count_++;
+    return true;
 }
 
 const struct xdg_surface_listener XdgWm::xdg_surface_listener_ = {
-        .configure = handle_xdg_surface_configure};
+        .configure = listener_thunk<&XdgWm::handle_xdg_surface_configure>};
 
 /**
  * @brief Handles the configure event for a toplevel surface.
@@ -171,67 +447,76 @@ const struct xdg_surface_listener XdgWm::xdg_surface_listener_ = {
  * It updates the internal state of the XdgWm object based on the configuration properties
  * received from the compositor.
  *
- * @param data The user data passed to the callback.
  * @param toplevel The toplevel surface that triggered the event.
  * @param width The width of the surface.
  * @param height The height of the surface.
  * @param states An array of states associated with the surface.
  */
 void XdgWm::handle_toplevel_configure(
-        void *data,
         struct xdg_toplevel * /* toplevel */,
         int32_t width,
         int32_t height,
         struct wl_array *states) {
 
-    if (width == 0 || height == 0) {
-        // Compositor is deferring to us
-        return;
-    }
-
-    auto *w = static_cast<XdgWm *>(data);
-
-    w->fullscreen_ = false;
-    w->maximized_ = false;
-    w->resize_ = false;
-    w->activated_ = false;
+    fullscreen_ = false;
+    maximized_ = false;
+    resize_ = false;
+    activated_ = false;
+    bool suspended = false;
 
     const uint32_t *state;
     WL_ARRAY_FOR_EACH(state, states, const uint32_t*) {
         switch (*state) {
             case XDG_TOPLEVEL_STATE_FULLSCREEN:
-                std::cout << "XDG_TOPLEVEL_STATE_FULLSCREEN" << std::endl;
-                w->fullscreen_ = true;
+                LOG_DEBUG("XDG_TOPLEVEL_STATE_FULLSCREEN");
+                fullscreen_ = true;
                 break;
             case XDG_TOPLEVEL_STATE_MAXIMIZED:
-                std::cout << "XDG_TOPLEVEL_STATE_MAXIMIZED" << std::endl;
-                w->maximized_ = true;
+                LOG_DEBUG("XDG_TOPLEVEL_STATE_MAXIMIZED");
+                maximized_ = true;
                 break;
             case XDG_TOPLEVEL_STATE_RESIZING:
-                std::cout << "XDG_TOPLEVEL_STATE_RESIZING" << std::endl;
-                w->resize_ = true;
+                LOG_DEBUG("XDG_TOPLEVEL_STATE_RESIZING");
+                resize_ = true;
                 break;
             case XDG_TOPLEVEL_STATE_ACTIVATED:
-                std::cout << "XDG_TOPLEVEL_STATE_ACTIVATED" << std::endl;
-                w->activated_ = true;
+                LOG_DEBUG("XDG_TOPLEVEL_STATE_ACTIVATED");
+                activated_ = true;
+                break;
+#if defined(XDG_TOPLEVEL_STATE_SUSPENDED_SINCE_VERSION)
+            case XDG_TOPLEVEL_STATE_SUSPENDED:
+                suspended = true;
+                break;
+#endif
+            default:
                 break;
         }
     }
 
+    if (suspended != suspended_) {
+        suspended_ = suspended;
+        if (suspended_callback_) {
+            suspended_callback_(suspended_);
+        }
+    }
+
+    if (width == 0 || height == 0) {
+        // Compositor is deferring to us
+        return;
+    }
+
     if (width > 0 && height > 0) {
-        if (!w->fullscreen_ && !w->maximized_) {
-            w->window_size_.width = width;
-            w->window_size_.height = height;
+        if (!fullscreen_ && !maximized_) {
+            window_size_.width = width;
+            window_size_.height = height;
         }
-        w->geometry_.width = width;
-        w->geometry_.height = height;
+        geometry_.width = width;
+        geometry_.height = height;
 
-    } else if (!w->fullscreen_ && !w->maximized_) {
-        w->geometry_.width = w->window_size_.width;
-        w->geometry_.height = w->window_size_.height;
+    } else if (!fullscreen_ && !maximized_) {
+        geometry_.width = window_size_.width;
+        geometry_.height = window_size_.height;
     }
-    std::cout << "width: " << width << std::endl;
-    std::cout << "height: " << height << std::endl;
 }
 
 /**
@@ -241,63 +526,138 @@ void XdgWm::handle_toplevel_configure(
  * the toplevel window. It sets the `running_` member variable to false, which
  * will cause the main event loop to exit.
  *
- * @param data The user data associated with the XdgWm instance.
  * @param xdg_toplevel The xdg_toplevel object that received the close request.
  */
 void XdgWm::handle_toplevel_close(
-        void *data,
         struct xdg_toplevel * /* xdg_toplevel */) {
-    std::cout << "XdgWm::handle_toplevel_close" << std::endl;
+    LOG_DEBUG("XdgWm::handle_toplevel_close");
 
-    auto *w = static_cast<XdgWm *>(data);
-    w->running_ = false;
+    close();
 }
 
-const struct xdg_toplevel_listener XdgWm::xdg_toplevel_listener_ = {
-        handle_toplevel_configure,
-        handle_toplevel_close,
-};
+#if defined(XDG_TOPLEVEL_CONFIGURE_BOUNDS_SINCE_VERSION)
 
 /**
-*
-*/
-void XdgWm::toplevel_resize(int x, int y, int width, int height, int padding) {
+ * @brief Records the largest size the window should take, e.g. the output less panels.
+ *
+ * Sent before the configure it belongs to, so it is known before the first buffer.
+ */
+void XdgWm::handle_toplevel_configure_bounds(
+        struct xdg_toplevel * /* xdg_toplevel */,
+        int32_t width,
+        int32_t height) {
+    LOG_DEBUG("XdgWm: bounds %dx%d", width, height);
+    bounds_.width = width;
+    bounds_.height = height;
+}
 
-    const bool top = y < padding;
-    const bool bottom = y > (height - padding);
-    const bool left = x < padding;
-    const bool right = x > (width - padding);
+#endif
+#if defined(XDG_TOPLEVEL_WM_CAPABILITIES_SINCE_VERSION)
 
-    auto edge = XDG_TOPLEVEL_RESIZE_EDGE_NONE;
+/**
+ * @brief Records what the compositor can do with the window: window menu, maximize, fullscreen, minimize.
+ */
+void XdgWm::handle_toplevel_wm_capabilities(
+        struct xdg_toplevel * /* xdg_toplevel */,
+        struct wl_array *capabilities) {
+    capabilities_ = 0;
+    const uint32_t *capability;
+    WL_ARRAY_FOR_EACH(capability, capabilities, const uint32_t*) {
+        if (*capability < 32) {
+            capabilities_ |= 1u << *capability;
+        }
+    }
+    capabilities_known_ = true;
+}
+
+#endif
+
+const struct xdg_toplevel_listener XdgWm::xdg_toplevel_listener_ = {
+        .configure = listener_thunk<&XdgWm::handle_toplevel_configure>,
+        .close = listener_thunk<&XdgWm::handle_toplevel_close>,
+#if defined(XDG_TOPLEVEL_CONFIGURE_BOUNDS_SINCE_VERSION)
+        .configure_bounds = listener_thunk<&XdgWm::handle_toplevel_configure_bounds>,
+#endif
+#if defined(XDG_TOPLEVEL_WM_CAPABILITIES_SINCE_VERSION)
+        .wm_capabilities = listener_thunk<&XdgWm::handle_toplevel_wm_capabilities>,
+#endif
+};
+
+/**
+ * @brief Finds the edge or corner of a width x height window that x, y is within margin of.
+ *
+ * @return XDG_TOPLEVEL_RESIZE_EDGE_NONE away from the border.
+ */
+enum xdg_toplevel_resize_edge XdgWm::get_resize_edge(int x, int y, int width, int height, int margin) {
+    const bool top = y < margin;
+    const bool bottom = y > (height - margin);
+    const bool left = x < margin;
+    const bool right = x > (width - margin);
 
     if (top)
         if (right)
-            edge = XDG_TOPLEVEL_RESIZE_EDGE_TOP_RIGHT;
+            return XDG_TOPLEVEL_RESIZE_EDGE_TOP_RIGHT;
         else if (left)
-            edge = XDG_TOPLEVEL_RESIZE_EDGE_TOP_LEFT;
+            return XDG_TOPLEVEL_RESIZE_EDGE_TOP_LEFT;
         else
-            edge = XDG_TOPLEVEL_RESIZE_EDGE_TOP;
+            return XDG_TOPLEVEL_RESIZE_EDGE_TOP;
     else if (bottom)
         if (right)
-            edge = XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM_RIGHT;
+            return XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM_RIGHT;
         else if (left)
-            edge = XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM_LEFT;
+            return XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM_LEFT;
         else
-            edge = XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM;
+            return XDG_TOPLEVEL_RESIZE_EDGE_BOTTOM;
     else if (right)
-        edge = XDG_TOPLEVEL_RESIZE_EDGE_RIGHT;
+        return XDG_TOPLEVEL_RESIZE_EDGE_RIGHT;
     else if (left)
-        edge = XDG_TOPLEVEL_RESIZE_EDGE_LEFT;
+        return XDG_TOPLEVEL_RESIZE_EDGE_LEFT;
     else
-        edge = XDG_TOPLEVEL_RESIZE_EDGE_NONE;
-
-    if (edge) {
-#if 0
-        xdg_toplevel_resize(
-                xdg_toplevel_,
-                wl_seat_,
-                0,
-                edge);
-#endif
+        return XDG_TOPLEVEL_RESIZE_EDGE_NONE;
+}
+
+/**
+ * @brief Starts a compositor-driven move of the toplevel.
+ *
+ * The compositor tracks the pointer until the button is released, the client sees
+ * no motion in the meantime.
+ *
+ * @param seat   The seat of the button press.
+ * @param serial The serial of the button press.
+ */
+void XdgWm::toplevel_move(struct wl_seat *seat, uint32_t serial) {
+    xdg_toplevel_move(xdg_toplevel_, seat, serial);
+}
+
+/**
+ * @brief Starts a compositor-driven resize if x, y is on the window border.
+ *
+ * The compositor sends configures with the new size as the pointer moves, the
+ * client just redraws at each.
+ *
+ * @param seat    The seat of the button press.
+ * @param serial  The serial of the button press.
+ * @param x, y    The press in window geometry coordinates.
+ * @param width, height The window geometry size.
+ * @param padding How far in from the edges the border reaches.
+ * @return false if x, y is not near an edge.
+ */
+bool XdgWm::toplevel_resize(struct wl_seat *seat, uint32_t serial, int x, int y, int width, int height,
+                            int padding) {
+    const auto edge = get_resize_edge(x, y, width, height, padding);
+    if (edge == XDG_TOPLEVEL_RESIZE_EDGE_NONE) {
+        return false;
+    }
+    xdg_toplevel_resize(xdg_toplevel_, seat, serial, edge);
+    return true;
+}
+
+/**
+ * @brief Asks the application to close, as xdg_toplevel.close does.
+ */
+void XdgWm::close() {
+    running_ = false;
+    if (close_callback_) {
+        close_callback_();
     }
-}
\ No newline at end of file
+}
@@ -17,42 +17,184 @@
 #ifndef SRC_WINDOW_MANAGER_XDG_WM_H_
 #define SRC_WINDOW_MANAGER_XDG_WM_H_
 
+#include <atomic>
 #include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
 #include <string>
 
 #include "xdg-shell-client-protocol.h"
+#if defined(ENABLE_XDG_DECORATION)
+#include "xdg-decoration-unstable-client-protocol.h"
+#endif
+#include "xdg-activation-v1-client-protocol.h"
+#include "utils/export.h"
 
-class XdgWm {
+class Display;
+
+class WAYPP_EXPORT XdgWm {
 public:
-    XdgWm(struct wl_display *display, struct wl_surface *base_surface);
+    // who draws the window frame, as negotiated over xdg-decoration
+    typedef enum {
+        // not negotiated, the compositor has no zxdg_decoration_manager_v1
+        DECORATION_NONE,
+        DECORATION_CLIENT_SIDE,
+        DECORATION_SERVER_SIDE,
+    } DecorationMode;
+
+    // sent before the first commit, so the initial configure already carries the final size
+    struct InitialState {
+        // nullptr keeps "waypp"
+        const char *title;
+        const char *app_id;
+        bool maximized;
+        bool fullscreen;
+        // output to go fullscreen on, nullptr for the compositor's choice
+        struct wl_output *output;
+        // connector name WindowManager resolves to output, e.g. "HDMI-A-1"
+        const char *output_name;
+    };
+
+    XdgWm(const Display *display, struct wl_surface *base_surface, const InitialState &initial_state = {});
 
     ~XdgWm();
 
-    [[nodiscard]] const bool get_wait_for_configure() const { return wait_for_configure_; }
+    // what popups of the toplevel are created from
+    [[nodiscard]] struct xdg_wm_base *get_wm_base() const { return xdg_wm_base_; }
+
+    [[nodiscard]] struct xdg_surface *get_xdg_surface() const { return xdg_surface_; }
+
+    [[nodiscard]] bool get_wait_for_configure() const { return wait_for_configure_; }
+
+    [[nodiscard]] bool configured() const { return !wait_for_configure_; }
+
+    void set_configure_callback(const std::function<void()> &callback) { configure_callback_ = callback; }
+
+    void set_deferred_ack(bool deferred) { deferred_ack_ = deferred; }
+
+    bool ack_configure();
+
+    [[nodiscard]] bool has_pending_ack() const { return ack_pending_; }
+
+    // xdg_surface configures received, and how many acks were sent for them
+    [[nodiscard]] uint64_t get_configure_count() const { return configure_count_; }
+
+    [[nodiscard]] uint64_t get_ack_count() const { return ack_count_; }
+
+    [[nodiscard]] bool is_suspended() const { return suspended_; }
+
+    [[nodiscard]] bool is_activated() const { return activated_; }
+
+    [[nodiscard]] bool is_maximized() const { return maximized_; }
+
+    [[nodiscard]] bool is_fullscreen() const { return fullscreen_; }
+
+    bool get_configured_size(int &width, int &height) const;
+
+    bool get_bounds(int &width, int &height) const;
+
+    [[nodiscard]] bool has_capability(uint32_t capability) const;
+
+    // called once per configure sequence, after the toplevel states were applied
+    void set_state_callback(const std::function<void()> &callback) { state_callback_ = callback; }
+
+    void set_resize_callback(const std::function<void(int width, int height)> &callback) {
+        resize_callback_ = callback;
+    }
+
+    void set_suspended_callback(const std::function<void(bool suspended)> &callback) {
+        suspended_callback_ = callback;
+    }
+
+    void set_ping_callback(const std::function<void()> &callback) { ping_callback_ = callback; }
 
     void set_app_id(const char *app_id) { xdg_toplevel_set_app_id(xdg_toplevel_, app_id); }
 
     void set_title(const char *title) { xdg_toplevel_set_title(xdg_toplevel_, title); }
 
-    void toplevel_resize(int x, int y, int width, int height, int padding);
+    void set_maximized(bool maximized);
+
+    void set_fullscreen(bool fullscreen, struct wl_output *output = nullptr);
+
+    void set_minimized() { xdg_toplevel_set_minimized(xdg_toplevel_); }
+
+    void set_window_geometry(int x, int y, int width, int height) {
+        xdg_surface_set_window_geometry(xdg_surface_, x, y, width, height);
+    }
+
+    static enum xdg_toplevel_resize_edge get_resize_edge(int x, int y, int width, int height, int margin);
+
+    void toplevel_move(struct wl_seat *seat, uint32_t serial);
+
+    bool toplevel_resize(struct wl_seat *seat, uint32_t serial, int x, int y, int width, int height, int padding);
+
+    // xdg_toplevel.close, the compositor or the titlebar asking the application to quit
+    void set_close_callback(const std::function<void()> &callback) { close_callback_ = callback; }
+
+    bool activate(const char *token);
+
+    bool request_activation_token(struct wl_seat *seat, uint32_t serial, const char *app_id,
+                                  const std::function<void(const std::string &token)> &callback);
+
+    [[nodiscard]] static std::string get_startup_token();
+
+    static void clear_startup_token();
+
+    void close();
+
+    bool set_decoration_mode(DecorationMode mode);
+
+    [[nodiscard]] DecorationMode get_decoration_mode() const { return decoration_mode_; }
+
+    void set_decoration_callback(const std::function<void(DecorationMode mode)> &callback) {
+        decoration_callback_ = callback;
+    }
 
 private:
     struct wl_surface *wl_surface_;
-    struct wl_registry *wl_registry_;
     struct xdg_wm_base *xdg_wm_base_{};
     struct xdg_surface *xdg_surface_{};
     struct xdg_toplevel *xdg_toplevel_{};
+    struct zxdg_decoration_manager_v1 *decoration_manager_{};
+    struct zxdg_toplevel_decoration_v1 *toplevel_decoration_{};
+    struct xdg_activation_v1 *xdg_activation_{};
+
+    // a token requested by request_activation_token(), until the compositor hands it out
+    struct ActivationRequest {
+        XdgWm *xdg_wm;
+        struct xdg_activation_token_v1 *token;
+        std::function<void(const std::string &token)> callback;
+    };
+    std::list<std::unique_ptr<ActivationRequest>> activation_requests_;
+    DecorationMode decoration_mode_{DECORATION_NONE};
+    std::function<void(DecorationMode mode)> decoration_callback_;
 
     std::string app_id_;
 
-    volatile bool wait_for_configure_{};
+    // cleared by the first xdg_surface::configure, possibly on the event thread
+    std::atomic<bool> wait_for_configure_{};
+    std::function<void()> configure_callback_;
+    // with deferred acks only the latest serial is acked, by ack_configure() before the commit
+    std::atomic<bool> deferred_ack_{};
+    std::atomic<bool> ack_pending_{};
+    std::atomic<uint32_t> pending_serial_{};
+    std::atomic<uint64_t> configure_count_{};
+    std::atomic<uint64_t> ack_count_{};
 
     bool fullscreen_{};
     bool maximized_{};
     bool resize_{};
     bool activated_{};
+    bool suspended_{};
     bool running_{};
 
+    std::function<void(bool suspended)> suspended_callback_;
+    std::function<void(int width, int height)> resize_callback_;
+    std::function<void()> ping_callback_;
+    std::function<void()> state_callback_;
+    std::function<void()> close_callback_;
+
     struct {
         int32_t width;
         int32_t height;
@@ -63,44 +205,70 @@ private:
         int32_t height;
     } window_size_{};
 
-    static void handle_xdg_surface_configure(
-            void * /* data */,
+    // largest size that fits the output's work area, from configure_bounds
+    struct {
+        int32_t width;
+        int32_t height;
+    } bounds_{};
+
+    // bits of 1 << xdg_toplevel_wm_capabilities, valid once wm_capabilities arrived
+    uint32_t capabilities_{};
+    bool capabilities_known_{};
+
+    // geometry last reported through resize_callback_
+    struct {
+        int32_t width;
+        int32_t height;
+    } reported_size_{};
+
+    void handle_xdg_surface_configure(
             struct xdg_surface * /* xdg_surface */,
             uint32_t /* serial */);
 
     static const struct xdg_surface_listener xdg_surface_listener_;
 
-    static void handle_toplevel_configure(
-            void * /* data */,
+    void handle_toplevel_configure(
             struct xdg_toplevel * /* toplevel */,
             int32_t /* width */,
             int32_t /* height */,
             struct wl_array * /* states */);
 
-    static void handle_toplevel_close(
-            void * /* data */,
+    void handle_toplevel_close(
             struct xdg_toplevel * /* xdg_toplevel */);
 
-    static const struct xdg_toplevel_listener xdg_toplevel_listener_;
+#if defined(XDG_TOPLEVEL_CONFIGURE_BOUNDS_SINCE_VERSION)
+
+    void handle_toplevel_configure_bounds(
+            struct xdg_toplevel * /* xdg_toplevel */,
+            int32_t /* width */,
+            int32_t /* height */);
+
+#endif
+#if defined(XDG_TOPLEVEL_WM_CAPABILITIES_SINCE_VERSION)
 
-    static void registry_handle_global(void *data,
-                                       struct wl_registry *registry,
-                                       uint32_t name,
-                                       const char *interface,
-                                       uint32_t version);
+    void handle_toplevel_wm_capabilities(
+            struct xdg_toplevel * /* xdg_toplevel */,
+            struct wl_array * /* capabilities */);
 
-    static void registry_handle_global_remove(void *data,
-                                              struct wl_registry *reg,
-                                              uint32_t id);
+#endif
 
-    static const struct wl_registry_listener registry_listener_;
+    static const struct xdg_toplevel_listener xdg_toplevel_listener_;
 
-    static void xdg_wm_base_ping(void *data,
-                                 struct xdg_wm_base *xdg_wm_base,
-                                 uint32_t serial);
+    void xdg_wm_base_ping(struct xdg_wm_base *xdg_wm_base,
+                          uint32_t serial);
 
     static const struct xdg_wm_base_listener xdg_wm_base_listener_;
 
+#if defined(ENABLE_XDG_DECORATION)
+    void handle_decoration_configure(struct zxdg_toplevel_decoration_v1 *decoration, uint32_t mode);
+
+    static const struct zxdg_toplevel_decoration_v1_listener decoration_listener_;
+#endif
+
+    static void handle_activation_token_done(void *data, struct xdg_activation_token_v1 *token, const char *name);
+
+    static const struct xdg_activation_token_v1_listener activation_token_listener_;
+
 };
 
 #endif // SRC_WINDOW_MANAGER_XDG_WM_H_
\ No newline at end of file
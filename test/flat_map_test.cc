@@ -0,0 +1,89 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "utils/flat_map.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+TEST(FlatMap, InsertsOnSubscript) {
+    FlatMap<int, std::string> map;
+    EXPECT_TRUE(map.empty());
+    map[3] = "three";
+    map[1] = "one";
+    EXPECT_EQ(map.size(), 2u);
+    EXPECT_EQ(map[3], "three");
+    // an existing key is not appended again
+    map[3] = "drei";
+    EXPECT_EQ(map.size(), 2u);
+    EXPECT_EQ(map.find(3)->second, "drei");
+}
+
+TEST(FlatMap, IteratesInInsertionOrder) {
+    FlatMap<int, int> map;
+    for (int key: {5, 2, 9, 1}) {
+        map[key] = key * 10;
+    }
+    std::vector<int> keys;
+    for (const auto &[key, value]: map) {
+        keys.push_back(key);
+        EXPECT_EQ(value, key * 10);
+    }
+    EXPECT_EQ(keys, (std::vector<int>{5, 2, 9, 1}));
+}
+
+TEST(FlatMap, FindMissingKeyReturnsEnd) {
+    FlatMap<int, int> map;
+    map[1] = 1;
+    EXPECT_EQ(map.find(2), map.end());
+    const auto &const_map = map;
+    EXPECT_EQ(const_map.find(2), const_map.end());
+    EXPECT_NE(const_map.find(1), const_map.end());
+}
+
+TEST(FlatMap, EraseByKeyAndIterator) {
+    FlatMap<int, int> map;
+    for (int key = 0; key < 5; key++) {
+        map[key] = key;
+    }
+    EXPECT_EQ(map.erase(2), 1u);
+    EXPECT_EQ(map.erase(2), 0u);
+    auto it = map.erase(map.find(0));
+    EXPECT_EQ(it->first, 1);
+    EXPECT_EQ(map.size(), 3u);
+    map.clear();
+    EXPECT_TRUE(map.empty());
+}
+
+TEST(FlatMap, HoldsMoveOnlyValues) {
+    // Display keeps its outputs and seats as unique_ptr values keyed by proxy
+    FlatMap<const void *, std::unique_ptr<int>> map;
+    int a;
+    int b;
+    map[&a] = std::make_unique<int>(1);
+    map[&b] = std::make_unique<int>(2);
+    map.erase(&a);
+    ASSERT_NE(map.find(&b), map.end());
+    EXPECT_EQ(*map.find(&b)->second, 2);
+}
+
+}
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "window/frame_arena.h"
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+bool is_aligned(const void *p, size_t alignment) {
+    return (reinterpret_cast<uintptr_t>(p) & (alignment - 1)) == 0;
+}
+
+TEST(FrameArena, AllocationsAreAlignedAndDisjoint) {
+    FrameArena arena(1024);
+    auto a = static_cast<char *>(arena.allocate(3, 1));
+    auto b = arena.allocate_array<uint64_t>(4);
+    auto c = arena.allocate(16, 64);
+    EXPECT_TRUE(is_aligned(b, alignof(uint64_t)));
+    EXPECT_TRUE(is_aligned(c, 64));
+    EXPECT_GE(reinterpret_cast<char *>(b), a + 3);
+    EXPECT_GE(static_cast<char *>(c), reinterpret_cast<char *>(b + 4));
+    EXPECT_EQ(arena.get_used(), 3u + 32u + 16u);
+}
+
+TEST(FrameArena, ChainsBlocksAndFoldsThemOnReset) {
+    FrameArena arena(256);
+    EXPECT_EQ(arena.get_capacity(), 256u);
+    std::vector<uint8_t *> chunks;
+    for (int i = 0; i < 10; i++) {
+        auto chunk = arena.allocate_array<uint8_t>(100);
+        memset(chunk, i, 100);
+        chunks.push_back(chunk);
+    }
+    // earlier chunks survive the chaining of new blocks
+    for (int i = 0; i < 10; i++) {
+        EXPECT_EQ(chunks[static_cast<size_t>(i)][99], i);
+    }
+    const size_t grown = arena.get_capacity();
+    EXPECT_GT(grown, 256u);
+
+    arena.reset();
+    EXPECT_EQ(arena.get_used(), 0u);
+    EXPECT_EQ(arena.get_capacity(), grown);
+    // the same frame now fits the single block
+    for (int i = 0; i < 10; i++) {
+        (void) arena.allocate_array<uint8_t>(100);
+    }
+    EXPECT_EQ(arena.get_capacity(), grown);
+}
+
+TEST(FrameArena, OversizedAllocationGetsItsOwnBlock) {
+    FrameArena arena(64);
+    auto big = arena.allocate(4096, 16);
+    ASSERT_NE(big, nullptr);
+    EXPECT_TRUE(is_aligned(big, 16));
+    memset(big, 0xab, 4096);
+    EXPECT_GE(arena.get_capacity(), 64u + 4096u);
+}
+
+TEST(FrameArena, ResetReusesTheSameMemory) {
+    FrameArena arena(1024);
+    auto first = arena.allocate(32);
+    arena.reset();
+    EXPECT_EQ(arena.allocate(32), first);
+}
+
+TEST(FrameArena, AllocatorBacksStandardContainers) {
+    FrameArena arena(64);
+    std::vector<int, FrameArena::Allocator<int>> values{FrameArena::Allocator<int>(&arena)};
+    for (int i = 0; i < 1000; i++) {
+        values.push_back(i);
+    }
+    EXPECT_EQ(values[999], 999);
+    EXPECT_GE(arena.get_used(), 1000 * sizeof(int));
+    EXPECT_TRUE(FrameArena::Allocator<int>(&arena) == FrameArena::Allocator<char>(&arena));
+}
+
+}
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "window/frame_clock.h"
+
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// periods as set_nominal_refresh() derives them from the mode's mHz
+constexpr uint64_t k60HzNs = 1000000000000ULL / 60000;
+constexpr uint64_t k5994HzNs = 1000000000000ULL / 59940;
+
+TEST(FrameClock, UncappedDrawsEveryVblank) {
+    EXPECT_EQ(FrameClock::frame_divisor(k60HzNs, 0), 1u);
+    EXPECT_EQ(FrameClock::frame_divisor(0, 30), 1u);
+}
+
+TEST(FrameClock, CapAtTheRefreshRateDrawsEveryVblank) {
+    EXPECT_EQ(FrameClock::frame_divisor(k60HzNs, 60), 1u);
+    EXPECT_EQ(FrameClock::frame_divisor(k60HzNs, 144), 1u);
+}
+
+TEST(FrameClock, CapJustAboveTheRefreshPeriodDrawsEveryVblank) {
+    EXPECT_EQ(FrameClock::frame_divisor(k5994HzNs, 60), 1u);
+}
+
+TEST(FrameClock, CapsBetweenDivisorsRoundTheRateDown) {
+    // 45 and 50 fps would be exceeded at 60, so they draw every second vblank
+    EXPECT_EQ(FrameClock::frame_divisor(k60HzNs, 55), 2u);
+    EXPECT_EQ(FrameClock::frame_divisor(k60HzNs, 50), 2u);
+    EXPECT_EQ(FrameClock::frame_divisor(k60HzNs, 45), 2u);
+    EXPECT_EQ(FrameClock::frame_divisor(k60HzNs, 29), 3u);
+}
+
+TEST(FrameClock, CapAtAnIntegerDivisorKeepsIt) {
+    EXPECT_EQ(FrameClock::frame_divisor(k60HzNs, 30), 2u);
+    EXPECT_EQ(FrameClock::frame_divisor(k60HzNs, 20), 3u);
+    EXPECT_EQ(FrameClock::frame_divisor(k60HzNs, 1), 60u);
+}
+
+TEST(FrameClock, RateStaysAtOrBelowTheCap) {
+    for (uint32_t fps = 1; fps <= 60; fps++) {
+        const uint32_t divisor = FrameClock::frame_divisor(k60HzNs, fps);
+        // at most the jitter tolerance above the cap, and one vblank less would exceed it
+        EXPECT_LE(60.0 / divisor, fps * 1.07) << fps;
+        if (divisor > 1) {
+            EXPECT_GT(60.0 / (divisor - 1), fps) << fps;
+        }
+    }
+}
+
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "window/frame_stats.h"
+
+#include <array>
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+constexpr uint64_t kRefreshNs = 16666667;
+constexpr uint64_t kMs = 1000000;
+
+TEST(FrameStats, EmptySnapshotIsZero) {
+    FrameStats stats;
+    const auto snapshot = stats.get_snapshot();
+    EXPECT_EQ(snapshot.frames, 0u);
+    EXPECT_EQ(snapshot.fps, 0.0);
+    EXPECT_EQ(snapshot.frame_time.p50_ns, 0u);
+    EXPECT_EQ(snapshot.latency.p99_ns, 0u);
+    EXPECT_EQ(snapshot.missed_vblanks, 0u);
+}
+
+TEST(FrameStats, PercentilesAreBucketUpperEdges) {
+    FrameStats stats;
+    // 100 frames rendering in 1.1 ms, 5 of those in 10.1 ms
+    uint64_t start = kMs;
+    for (int i = 0; i < 100; i++) {
+        stats.record_frame(start, i < 95 ? 1100000 : 10100000, kRefreshNs, true);
+        start += kRefreshNs;
+    }
+    const auto snapshot = stats.get_snapshot();
+    EXPECT_EQ(snapshot.frames, 100u);
+    EXPECT_EQ(snapshot.render_time.p50_ns, 1250000u);
+    EXPECT_EQ(snapshot.render_time.p95_ns, 1250000u);
+    EXPECT_EQ(snapshot.render_time.p99_ns, 10250000u);
+    EXPECT_NEAR(snapshot.fps, 60.0, 0.1);
+    EXPECT_EQ(snapshot.missed_vblanks, 0u);
+}
+
+TEST(FrameStats, SlowSamplesLandInTheLastBucket) {
+    FrameStats stats;
+    stats.record_frame(kMs, 500 * kMs, kRefreshNs, true);
+    EXPECT_EQ(stats.get_snapshot().render_time.p50_ns, FrameStats::kBucketCount * 250000u);
+}
+
+TEST(FrameStats, EstimatesMissedVblanksFromIntervals) {
+    FrameStats stats;
+    stats.record_frame(kMs, kMs, kRefreshNs, true);
+    // one frame on time, then one three refreshes later: two vblanks missed
+    stats.record_frame(kMs + kRefreshNs, kMs, kRefreshNs, true);
+    stats.record_frame(kMs + 4 * kRefreshNs, kMs, kRefreshNs, true);
+    EXPECT_EQ(stats.get_snapshot().missed_vblanks, 2u);
+}
+
+TEST(FrameStats, DiscontinuousFramesRecordNoInterval) {
+    FrameStats stats;
+    stats.record_frame(kMs, kMs, kRefreshNs, true);
+    stats.record_frame(kMs + 100 * kRefreshNs, kMs, kRefreshNs, false);
+    const auto snapshot = stats.get_snapshot();
+    EXPECT_EQ(snapshot.frames, 2u);
+    EXPECT_EQ(snapshot.frame_time.p50_ns, 0u);
+    EXPECT_EQ(snapshot.missed_vblanks, 0u);
+}
+
+TEST(FrameStats, PresentationCountsMissedVblanksFromMsc) {
+    FrameStats stats;
+    stats.record_frame(kMs, kMs, kRefreshNs, true);
+    stats.record_presentation(kMs, kMs + 2 * kMs, 100);
+    stats.record_presentation(kMs, kMs + 4 * kMs, 101);
+    stats.record_presentation(kMs, kMs + 6 * kMs, 104);
+    // feedback now decides, a late interval is not estimated a second time
+    stats.record_frame(kMs + 4 * kRefreshNs, kMs, kRefreshNs, true);
+    const auto snapshot = stats.get_snapshot();
+    EXPECT_EQ(snapshot.missed_vblanks, 2u);
+    EXPECT_EQ(snapshot.latency.p50_ns, 4 * kMs + 250000u);
+}
+
+TEST(FrameStats, VblanksPerFrameSetsTheExpectedMscStep) {
+    FrameStats stats;
+    stats.set_vblanks_per_frame(2);
+    stats.record_frame(kMs, kMs, kRefreshNs, true);
+    stats.record_presentation(kMs, 2 * kMs, 10);
+    stats.record_presentation(kMs, 2 * kMs, 12);
+    stats.record_presentation(kMs, 2 * kMs, 15);
+    EXPECT_EQ(stats.get_snapshot().missed_vblanks, 1u);
+}
+
+TEST(FrameStats, InputLatencyUsesMillisecondBuckets) {
+    FrameStats stats;
+    stats.record_input_latency(500000);
+    stats.record_input_latency(3 * kMs + 1);
+    stats.record_input_latency(1000 * kMs);
+    std::array<uint32_t, FrameStats::kBucketCount> buckets{};
+    stats.get_input_latency_histogram(buckets);
+    EXPECT_EQ(buckets[0], 1u);
+    EXPECT_EQ(buckets[3], 1u);
+    EXPECT_EQ(buckets[FrameStats::kBucketCount - 1], 1u);
+    EXPECT_EQ(stats.get_snapshot().inputs, 3u);
+}
+
+TEST(FrameStats, ResetClearsEverything) {
+    FrameStats stats;
+    stats.record_frame(kMs, kMs, kRefreshNs, true);
+    stats.record_frame(kMs + 5 * kRefreshNs, kMs, kRefreshNs, true);
+    stats.record_discarded();
+    stats.record_input_latency(kMs);
+    stats.reset();
+    const auto snapshot = stats.get_snapshot();
+    EXPECT_EQ(snapshot.frames, 0u);
+    EXPECT_EQ(snapshot.fps, 0.0);
+    EXPECT_EQ(snapshot.frame_time.p50_ns, 0u);
+    EXPECT_EQ(snapshot.missed_vblanks, 0u);
+    EXPECT_EQ(snapshot.discarded, 0u);
+    EXPECT_EQ(snapshot.inputs, 0u);
+}
+
+}
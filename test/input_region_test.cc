@@ -0,0 +1,56 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "window/input_region.h"
+
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+using Rect = InputRegion::Rect;
+
+TEST(InputRegion, AbsoluteRectsStayAsGiven) {
+    const std::vector<Rect> rects{{10, 20, 30, 40}};
+    EXPECT_EQ(InputRegion::resolve(rects, 800, 600), rects);
+}
+
+TEST(InputRegion, InsetFollowsTheSurfaceSize) {
+    const std::vector<Rect> rects{InputRegion::inset(8, 4, 12, 16)};
+    EXPECT_EQ(InputRegion::resolve(rects, 800, 600), (std::vector<Rect>{{8, 4, 780, 580}}));
+    EXPECT_EQ(InputRegion::resolve(rects, 100, 50), (std::vector<Rect>{{8, 4, 80, 30}}));
+}
+
+TEST(InputRegion, ZeroExtentsReachTheEdge) {
+    // a title bar strip across the full width
+    const std::vector<Rect> rects{{0, 0, 0, 32}};
+    EXPECT_EQ(InputRegion::resolve(rects, 640, 480), (std::vector<Rect>{{0, 0, 640, 32}}));
+}
+
+TEST(InputRegion, EmptyRectsAreDropped) {
+    const std::vector<Rect> rects{InputRegion::inset(60, 0, 60, 0), {5, 5, 10, 10}};
+    // the inset leaves nothing of a 100 pixel wide surface
+    EXPECT_EQ(InputRegion::resolve(rects, 100, 100), (std::vector<Rect>{{5, 5, 10, 10}}));
+    EXPECT_EQ(InputRegion::resolve(rects, 200, 100), (std::vector<Rect>{{60, 0, 80, 100}, {5, 5, 10, 10}}));
+}
+
+TEST(InputRegion, NoRectsResolveToNone) {
+    EXPECT_TRUE(InputRegion::resolve({}, 800, 600).empty());
+}
+
+}
@@ -0,0 +1,151 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "seat/keysym_table.h"
+
+#include <cstdio>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// self-contained, so the tests do not depend on the xkeyboard-config installed
+constexpr char kKeymap[] = R"(xkb_keymap {
+    xkb_keycodes "test" {
+        minimum = 8;
+        maximum = 255;
+        <AE01> = 10;
+        <AC01> = 38;
+        <LFSH> = 50;
+    };
+    xkb_types "test" {
+        type "ONE_LEVEL" {
+            modifiers = none;
+            level_name[Level1] = "Any";
+        };
+        type "TWO_LEVEL" {
+            modifiers = Shift;
+            map[Shift] = Level2;
+            level_name[Level1] = "Base";
+            level_name[Level2] = "Shift";
+        };
+    };
+    xkb_compatibility "test" {
+        interpret Shift_L {
+            action = SetMods(modifiers = Shift);
+        };
+    };
+    xkb_symbols "test" {
+        key <AE01> { [ 1, exclam ] };
+        key <AC01> { type = "TWO_LEVEL", [ %s, %s ] };
+        key <LFSH> { [ Shift_L ] };
+        modifier_map Shift { <LFSH> };
+    };
+};)";
+
+constexpr xkb_keycode_t kKey1 = 10;
+constexpr xkb_keycode_t kKeyA = 38;
+constexpr xkb_keycode_t kKeyShift = 50;
+
+class KeysymTableTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        context_ = xkb_context_new(XKB_CONTEXT_NO_DEFAULT_INCLUDES);
+        ASSERT_NE(context_, nullptr);
+        load("a", "A");
+    }
+
+    void TearDown() override {
+        if (state_) {
+            xkb_state_unref(state_);
+        }
+        if (keymap_) {
+            xkb_keymap_unref(keymap_);
+        }
+        xkb_context_unref(context_);
+    }
+
+    void load(const char *lower, const char *upper) {
+        char text[sizeof(kKeymap) + 32];
+        snprintf(text, sizeof(text), kKeymap, lower, upper);
+        if (state_) {
+            xkb_state_unref(state_);
+        }
+        if (keymap_) {
+            xkb_keymap_unref(keymap_);
+        }
+        keymap_ = xkb_keymap_new_from_string(context_, text, XKB_KEYMAP_FORMAT_TEXT_V1, XKB_KEYMAP_COMPILE_NO_FLAGS);
+        ASSERT_NE(keymap_, nullptr);
+        state_ = xkb_state_new(keymap_);
+        ASSERT_NE(state_, nullptr);
+    }
+
+    void set_shift(bool down) {
+        const xkb_mod_index_t shift = xkb_keymap_mod_get_index(keymap_, XKB_MOD_NAME_SHIFT);
+        xkb_state_update_mask(state_, down ? 1u << shift : 0, 0, 0, 0, 0, 0);
+    }
+
+    struct xkb_context *context_{};
+    struct xkb_keymap *keymap_{};
+    struct xkb_state *state_{};
+    KeysymTable table_;
+};
+
+TEST_F(KeysymTableTest, LooksUpKeysymAndText) {
+    const auto &a = table_.lookup(state_, kKeyA);
+    EXPECT_EQ(a.keysym, static_cast<xkb_keysym_t>(XKB_KEY_a));
+    EXPECT_STREQ(a.utf8, "a");
+    const auto &one = table_.lookup(state_, kKey1);
+    EXPECT_EQ(one.keysym, static_cast<xkb_keysym_t>(XKB_KEY_1));
+    EXPECT_STREQ(one.utf8, "1");
+}
+
+TEST_F(KeysymTableTest, ModifierKeysHaveNoText) {
+    const auto &shift = table_.lookup(state_, kKeyShift);
+    EXPECT_EQ(shift.keysym, static_cast<xkb_keysym_t>(XKB_KEY_Shift_L));
+    EXPECT_STREQ(shift.utf8, "");
+}
+
+TEST_F(KeysymTableTest, EntriesFollowTheModifiersAfterUpdate) {
+    EXPECT_STREQ(table_.lookup(state_, kKeyA).utf8, "a");
+    set_shift(true);
+    // cached until update() sees the new effective modifiers
+    EXPECT_STREQ(table_.lookup(state_, kKeyA).utf8, "a");
+    table_.update(state_);
+    EXPECT_EQ(table_.lookup(state_, kKeyA).keysym, static_cast<xkb_keysym_t>(XKB_KEY_A));
+    EXPECT_STREQ(table_.lookup(state_, kKey1).utf8, "!");
+    set_shift(false);
+    table_.update(state_);
+    EXPECT_STREQ(table_.lookup(state_, kKeyA).utf8, "a");
+}
+
+TEST_F(KeysymTableTest, InvalidateForgetsTheOldKeymap) {
+    EXPECT_STREQ(table_.lookup(state_, kKeyA).utf8, "a");
+    load("b", "B");
+    table_.invalidate();
+    table_.update(state_);
+    EXPECT_EQ(table_.lookup(state_, kKeyA).keysym, static_cast<xkb_keysym_t>(XKB_KEY_b));
+    EXPECT_STREQ(table_.lookup(state_, kKeyA).utf8, "b");
+}
+
+TEST_F(KeysymTableTest, KeycodesPastTheTableAreLookedUpDirectly) {
+    const auto &entry = table_.lookup(state_, 300);
+    EXPECT_EQ(entry.keysym, static_cast<xkb_keysym_t>(XKB_KEY_NoSymbol));
+    EXPECT_STREQ(entry.utf8, "");
+}
+
+}
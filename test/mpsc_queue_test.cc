@@ -0,0 +1,148 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "utils/mpsc_queue.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+TEST(MpscQueue, PopsInPushOrder) {
+    MpscQueue<int> queue;
+    EXPECT_TRUE(queue.empty());
+    for (int i = 0; i < 100; i++) {
+        queue.push(i);
+    }
+    EXPECT_FALSE(queue.empty());
+    for (int i = 0; i < 100; i++) {
+        int value = -1;
+        ASSERT_TRUE(queue.pop(value));
+        EXPECT_EQ(value, i);
+    }
+    int value;
+    EXPECT_FALSE(queue.pop(value));
+    EXPECT_TRUE(queue.empty());
+}
+
+TEST(MpscQueue, MovesValuesOut) {
+    MpscQueue<std::unique_ptr<int>> queue;
+    queue.push(std::make_unique<int>(7));
+    std::unique_ptr<int> value;
+    ASSERT_TRUE(queue.pop(value));
+    ASSERT_TRUE(value);
+    EXPECT_EQ(*value, 7);
+}
+
+TEST(MpscQueue, DestructorFreesQueuedValues) {
+    auto tracked = std::make_shared<int>(0);
+    {
+        MpscQueue<std::shared_ptr<int>> queue;
+        queue.push(tracked);
+        queue.push(tracked);
+        EXPECT_EQ(tracked.use_count(), 3);
+    }
+    EXPECT_EQ(tracked.use_count(), 1);
+}
+
+// the WindowManager::post() scheme: only the first push since the consumer last woke writes the eventfd
+class Mailbox {
+public:
+    Mailbox() : fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {}
+
+    ~Mailbox() { close(fd_); }
+
+    void post(uint64_t value) {
+        queue_.push(value);
+        if (!pending_.exchange(true, std::memory_order_acq_rel)) {
+            const uint64_t one = 1;
+            EXPECT_EQ(write(fd_, &one, sizeof(one)), static_cast<ssize_t>(sizeof(one)));
+            writes_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    template<typename F>
+    void run(F &&fn) {
+        uint64_t count;
+        (void) read(fd_, &count, sizeof(count));
+        pending_.store(false, std::memory_order_seq_cst);
+        uint64_t value;
+        while (queue_.pop(value)) {
+            fn(value);
+        }
+    }
+
+    [[nodiscard]] int get_fd() const { return fd_; }
+
+    [[nodiscard]] uint64_t get_writes() const { return writes_.load(std::memory_order_relaxed); }
+
+private:
+    int fd_;
+    MpscQueue<uint64_t> queue_;
+    std::atomic<bool> pending_{};
+    std::atomic<uint64_t> writes_{};
+};
+
+TEST(MpscQueue, EventfdWakeupDeliversEveryPost) {
+    constexpr uint64_t kProducers = 4;
+    constexpr uint64_t kPerProducer = 100000;
+    Mailbox mailbox;
+    ASSERT_GE(mailbox.get_fd(), 0);
+
+    std::vector<std::thread> producers;
+    for (uint64_t p = 0; p < kProducers; p++) {
+        producers.emplace_back([&mailbox, p]() {
+            for (uint64_t i = 0; i < kPerProducer; i++) {
+                mailbox.post(p << 32 | i);
+            }
+        });
+    }
+
+    // the consumer only looks at the queue when the eventfd says so, as the event loop would
+    std::vector<uint64_t> next(kProducers);
+    uint64_t received = 0;
+    bool ordered = true;
+    while (received < kProducers * kPerProducer) {
+        struct pollfd pfd{mailbox.get_fd(), POLLIN, 0};
+        ASSERT_EQ(poll(&pfd, 1, 5000), 1) << "no wakeup with " << received << " tasks received";
+        mailbox.run([&](uint64_t value) {
+            const uint64_t producer = value >> 32;
+            ordered &= (value & 0xffffffffu) == next[producer];
+            next[producer]++;
+            received++;
+        });
+    }
+    for (auto &producer: producers) {
+        producer.join();
+    }
+
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ(received, kProducers * kPerProducer);
+    // bursts share a wakeup
+    EXPECT_LT(mailbox.get_writes(), received);
+}
+
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "window/pixel_kernels.h"
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// widths around the 4 and 8 pixel vector lengths, so every head and tail path runs
+constexpr int kWidths[] = {1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 64, 67};
+constexpr int kHeight = 5;
+// a row pad keeps rows from starting on a vector boundary
+constexpr int kPad = 3;
+
+std::vector<uint32_t> random_pixels(std::mt19937 &rng, size_t count) {
+    std::vector<uint32_t> pixels(count);
+    for (auto &p: pixels) {
+        p = static_cast<uint32_t>(rng());
+    }
+    return pixels;
+}
+
+// premultiplied: no colour channel exceeds alpha
+std::vector<uint32_t> random_premultiplied(std::mt19937 &rng, size_t count) {
+    std::vector<uint32_t> pixels(count);
+    for (auto &p: pixels) {
+        const uint32_t a = rng() % 4 == 0 ? (rng() % 2) * 255 : rng() % 256;
+        p = a << 24;
+        for (int shift = 0; shift < 24; shift += 8) {
+            p |= (a ? static_cast<uint32_t>(rng() % (a + 1)) : 0u) << shift;
+        }
+    }
+    return pixels;
+}
+
+std::vector<uint16_t> random_565(std::mt19937 &rng, size_t count) {
+    std::vector<uint16_t> pixels(count);
+    for (auto &p: pixels) {
+        p = static_cast<uint16_t>(rng());
+    }
+    return pixels;
+}
+
+class PixelKernelsTest : public ::testing::TestWithParam<const char *> {
+protected:
+    void SetUp() override {
+        kernels_ = find_pixel_kernels(GetParam());
+        if (!kernels_) {
+            GTEST_SKIP() << GetParam() << " is not available on this machine";
+        }
+    }
+
+    const PixelKernels *kernels_{};
+    const PixelKernels &scalar_ = get_scalar_pixel_kernels();
+    std::mt19937 rng_{0x5741595u};
+};
+
+TEST_P(PixelKernelsTest, FillMatchesScalar) {
+    for (int width: kWidths) {
+        const int stride = (width + kPad) * 4;
+        // the padding must be left alone
+        auto expected = random_pixels(rng_, static_cast<size_t>((width + kPad) * kHeight));
+        auto actual = expected;
+        const auto color = static_cast<uint32_t>(rng_());
+        scalar_.fill(expected.data(), stride, width, kHeight, color);
+        kernels_->fill(actual.data(), stride, width, kHeight, color);
+        EXPECT_EQ(expected, actual) << "width " << width;
+    }
+}
+
+TEST_P(PixelKernelsTest, CopyMatchesScalar) {
+    for (int width: kWidths) {
+        for (int bpp: {2, 4}) {
+            const int stride = (width + kPad) * 4;
+            const auto src = random_pixels(rng_, static_cast<size_t>((width + kPad) * kHeight));
+            auto expected = random_pixels(rng_, src.size());
+            auto actual = expected;
+            scalar_.copy(expected.data(), stride, src.data(), stride, width, kHeight, bpp);
+            kernels_->copy(actual.data(), stride, src.data(), stride, width, kHeight, bpp);
+            EXPECT_EQ(expected, actual) << "width " << width << ", bpp " << bpp;
+        }
+    }
+}
+
+TEST_P(PixelKernelsTest, BlendOverMatchesScalar) {
+    for (int width: kWidths) {
+        const int stride = (width + kPad) * 4;
+        const auto src = random_premultiplied(rng_, static_cast<size_t>((width + kPad) * kHeight));
+        auto expected = random_premultiplied(rng_, src.size());
+        auto actual = expected;
+        scalar_.blend_over(expected.data(), stride, src.data(), stride, width, kHeight);
+        kernels_->blend_over(actual.data(), stride, src.data(), stride, width, kHeight);
+        EXPECT_EQ(expected, actual) << "width " << width;
+    }
+}
+
+TEST_P(PixelKernelsTest, XrgbToArgbMatchesScalar) {
+    for (int width: kWidths) {
+        const int stride = (width + kPad) * 4;
+        const auto src = random_pixels(rng_, static_cast<size_t>((width + kPad) * kHeight));
+        auto expected = random_pixels(rng_, src.size());
+        auto actual = expected;
+        scalar_.xrgb_to_argb(expected.data(), stride, src.data(), stride, width, kHeight);
+        kernels_->xrgb_to_argb(actual.data(), stride, src.data(), stride, width, kHeight);
+        EXPECT_EQ(expected, actual) << "width " << width;
+    }
+}
+
+TEST_P(PixelKernelsTest, Rgb565ToXrgbMatchesScalar) {
+    for (int width: kWidths) {
+        const auto src = random_565(rng_, static_cast<size_t>((width + kPad) * kHeight));
+        auto expected = random_pixels(rng_, src.size());
+        auto actual = expected;
+        scalar_.rgb565_to_xrgb(expected.data(), (width + kPad) * 4, src.data(), (width + kPad) * 2, width, kHeight);
+        kernels_->rgb565_to_xrgb(actual.data(), (width + kPad) * 4, src.data(), (width + kPad) * 2, width, kHeight);
+        EXPECT_EQ(expected, actual) << "width " << width;
+    }
+}
+
+TEST_P(PixelKernelsTest, XrgbToRgb565MatchesScalar) {
+    for (int width: kWidths) {
+        const auto src = random_pixels(rng_, static_cast<size_t>((width + kPad) * kHeight));
+        auto expected = random_565(rng_, src.size());
+        auto actual = expected;
+        scalar_.xrgb_to_rgb565(expected.data(), (width + kPad) * 2, src.data(), (width + kPad) * 4, width, kHeight);
+        kernels_->xrgb_to_rgb565(actual.data(), (width + kPad) * 2, src.data(), (width + kPad) * 4, width, kHeight);
+        EXPECT_EQ(expected, actual) << "width " << width;
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Variants, PixelKernelsTest, ::testing::Values("scalar", "sse2", "avx2", "neon"),
+                         [](const ::testing::TestParamInfo<const char *> &info) { return std::string(info.param); });
+
+TEST(PixelKernels, BlendOverKnownValues) {
+    const auto &kernels = get_scalar_pixel_kernels();
+    uint32_t dst[3] = {0xff204060u, 0xff204060u, 0xff000000u};
+    const uint32_t src[3] = {0xff808080u, 0x00000000u, 0x80808080u};
+    kernels.blend_over(dst, sizeof(dst), src, sizeof(src), 3, 1);
+    // opaque replaces, transparent keeps, half white over black stays half white
+    EXPECT_EQ(dst[0], 0xff808080u);
+    EXPECT_EQ(dst[1], 0xff204060u);
+    EXPECT_EQ(dst[2], 0xff808080u);
+}
+
+TEST(PixelKernels, Rgb565WhiteStaysWhite) {
+    const uint16_t src[2] = {0xffff, 0x0000};
+    uint32_t dst[2]{};
+    get_scalar_pixel_kernels().rgb565_to_xrgb(dst, sizeof(dst), src, sizeof(src), 2, 1);
+    EXPECT_EQ(dst[0], 0xffffffffu);
+    EXPECT_EQ(dst[1], 0xff000000u);
+}
+
+TEST(PixelKernels, SelectedTableIsKnown) {
+    const auto &kernels = get_pixel_kernels();
+    EXPECT_EQ(find_pixel_kernels(kernels.name), &kernels);
+    EXPECT_EQ(find_pixel_kernels("mmx"), nullptr);
+}
+
+}
@@ -0,0 +1,267 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "window/region.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+// the reference: one bit per pixel of a kSize x kSize grid starting at kOrigin
+constexpr int32_t kOrigin = -8;
+constexpr int32_t kSize = 64;
+
+using Bitmap = std::bitset<kSize * kSize>;
+
+Bitmap rasterize(const Region &region) {
+    Bitmap bits;
+    for (const auto &box: region) {
+        for (int32_t y = box.y1; y < box.y2; y++) {
+            for (int32_t x = box.x1; x < box.x2; x++) {
+                bits.set(static_cast<size_t>((y - kOrigin) * kSize + (x - kOrigin)));
+            }
+        }
+    }
+    return bits;
+}
+
+void fill(Bitmap &bits, int32_t x, int32_t y, int32_t width, int32_t height) {
+    for (int32_t j = y; j < y + height; j++) {
+        for (int32_t i = x; i < x + width; i++) {
+            bits.set(static_cast<size_t>((j - kOrigin) * kSize + (i - kOrigin)));
+        }
+    }
+}
+
+// the banding rules a canonical region keeps, see the Region class description
+void expect_canonical(const Region &region) {
+    std::vector<std::vector<Region::Box>> bands;
+    for (const auto &box: region) {
+        ASSERT_LT(box.x1, box.x2);
+        ASSERT_LT(box.y1, box.y2);
+        if (!bands.empty() && bands.back()[0].y1 == box.y1) {
+            ASSERT_EQ(box.y2, bands.back()[0].y2) << "boxes of a band share their y extent";
+            ASSERT_GT(box.x1, bands.back().back().x2) << "boxes of a band are sorted and do not touch";
+            bands.back().push_back(box);
+        } else {
+            bands.push_back({box});
+        }
+    }
+    auto same_spans = [](const std::vector<Region::Box> &a, const std::vector<Region::Box> &b) {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const Region::Box &p, const Region::Box &q) {
+            return p.x1 == q.x1 && p.x2 == q.x2;
+        });
+    };
+    Region::Box extents{};
+    for (size_t i = 0; i < bands.size(); i++) {
+        if (i > 0) {
+            ASSERT_GE(bands[i][0].y1, bands[i - 1][0].y2) << "bands are sorted and do not overlap";
+            if (bands[i][0].y1 == bands[i - 1][0].y2) {
+                ASSERT_FALSE(same_spans(bands[i - 1], bands[i])) << "touching bands with equal spans are merged";
+            }
+        }
+        const Region::Box bounds{bands[i].front().x1, bands[i][0].y1, bands[i].back().x2, bands[i][0].y2};
+        extents = i == 0 ? bounds : Region::Box{std::min(extents.x1, bounds.x1), extents.y1,
+                                                std::max(extents.x2, bounds.x2), bounds.y2};
+    }
+    EXPECT_EQ(region.get_extents(), extents);
+}
+
+class RegionRandomTest : public ::testing::Test {
+protected:
+    // a region of a few random rectangles, and its reference bitmap
+    Region random_region(Bitmap &bits) {
+        Region region;
+        const int count = static_cast<int>(rng_() % 12);
+        for (int i = 0; i < count; i++) {
+            const auto x = static_cast<int32_t>(rng_() % 48) + kOrigin;
+            const auto y = static_cast<int32_t>(rng_() % 48) + kOrigin;
+            const auto width = static_cast<int32_t>(rng_() % 16);
+            const auto height = static_cast<int32_t>(rng_() % 16);
+            region.add(x, y, width, height);
+            fill(bits, x, y, width, height);
+        }
+        return region;
+    }
+
+    std::mt19937 rng_{0x7265676eu};
+};
+
+TEST_F(RegionRandomTest, UnionMatchesBitmap) {
+    for (int i = 0; i < 500; i++) {
+        Bitmap a_bits;
+        Bitmap b_bits;
+        Region a = random_region(a_bits);
+        const Region b = random_region(b_bits);
+        a.unite(b);
+        expect_canonical(a);
+        ASSERT_EQ(rasterize(a), a_bits | b_bits) << "iteration " << i;
+    }
+}
+
+TEST_F(RegionRandomTest, IntersectMatchesBitmap) {
+    for (int i = 0; i < 500; i++) {
+        Bitmap a_bits;
+        Bitmap b_bits;
+        Region a = random_region(a_bits);
+        const Region b = random_region(b_bits);
+        a.intersect(b);
+        expect_canonical(a);
+        ASSERT_EQ(rasterize(a), a_bits & b_bits) << "iteration " << i;
+    }
+}
+
+TEST_F(RegionRandomTest, SubtractMatchesBitmap) {
+    for (int i = 0; i < 500; i++) {
+        Bitmap a_bits;
+        Bitmap b_bits;
+        Region a = random_region(a_bits);
+        const Region b = random_region(b_bits);
+        a.subtract(b);
+        expect_canonical(a);
+        ASSERT_EQ(rasterize(a), a_bits & ~b_bits) << "iteration " << i;
+    }
+}
+
+TEST_F(RegionRandomTest, EqualPixelsCompareEqual) {
+    for (int i = 0; i < 200; i++) {
+        Bitmap bits;
+        const Region a = random_region(bits);
+        // the same pixels built another way: one row of single pixels at a time
+        Region b;
+        for (int32_t y = 0; y < kSize; y++) {
+            for (int32_t x = 0; x < kSize; x++) {
+                if (bits.test(static_cast<size_t>(y * kSize + x))) {
+                    b.add(x + kOrigin, y + kOrigin, 1, 1);
+                }
+            }
+        }
+        expect_canonical(b);
+        ASSERT_EQ(a, b) << "iteration " << i;
+    }
+}
+
+TEST_F(RegionRandomTest, ContainsMatchesBitmap) {
+    for (int i = 0; i < 100; i++) {
+        Bitmap bits;
+        const Region region = random_region(bits);
+        for (int32_t y = 0; y < kSize; y++) {
+            for (int32_t x = 0; x < kSize; x++) {
+                ASSERT_EQ(region.contains(x + kOrigin, y + kOrigin), bits.test(static_cast<size_t>(y * kSize + x)));
+            }
+        }
+    }
+}
+
+TEST(Region, EmptyRectsAddNothing) {
+    Region region(0, 0, 0, 10);
+    EXPECT_TRUE(region.empty());
+    region.add(5, 5, -3, 4);
+    EXPECT_TRUE(region.empty());
+    EXPECT_EQ(region.get_extents(), (Region::Box{0, 0, 0, 0}));
+}
+
+TEST(Region, OverlappingUnionSplitsIntoBands) {
+    Region region(0, 0, 10, 10);
+    region.add(5, 5, 10, 10);
+    const std::vector<Region::Box> expected{{0, 0, 10, 5}, {0, 5, 15, 10}, {5, 10, 15, 15}};
+    EXPECT_EQ(std::vector<Region::Box>(region.begin(), region.end()), expected);
+    EXPECT_EQ(region.get_extents(), (Region::Box{0, 0, 15, 15}));
+}
+
+TEST(Region, AdjacentBandsMerge) {
+    Region region(0, 0, 10, 5);
+    region.add(0, 5, 10, 5);
+    EXPECT_EQ(region.get_box_count(), 1u);
+    EXPECT_EQ(region, Region(0, 0, 10, 10));
+}
+
+TEST(Region, SubtractingTheWholeLeavesNothing) {
+    Region region(0, 0, 10, 10);
+    region.subtract(Region(-5, -5, 20, 20));
+    EXPECT_TRUE(region.empty());
+    Region self(0, 0, 4, 4);
+    self.subtract(self);
+    EXPECT_TRUE(self.empty());
+}
+
+TEST(Region, SpillsPastTheInlineBoxes) {
+    Region region;
+    // a comb of separate teeth, one box each
+    for (int32_t i = 0; i < 40; i++) {
+        region.add(i * 3, 0, 1, 10);
+    }
+    EXPECT_EQ(region.get_box_count(), 40u);
+    expect_canonical(region);
+    Region copy = region;
+    EXPECT_EQ(copy, region);
+    region.clear();
+    EXPECT_TRUE(region.empty());
+    region.add(1, 1, 1, 1);
+    EXPECT_EQ(region, Region(1, 1, 1, 1));
+}
+
+TEST(Region, TranslateMovesBoxesAndExtents) {
+    Region region(0, 0, 4, 4);
+    region.add(10, 10, 2, 2);
+    region.translate(-3, 5);
+    EXPECT_TRUE(region.contains(-3, 5));
+    EXPECT_TRUE(region.contains(8, 16));
+    EXPECT_FALSE(region.contains(1, 9));
+    EXPECT_EQ(region.get_extents(), (Region::Box{-3, 5, 9, 17}));
+}
+
+TEST(Region, IntegerScaleKeepsTheBands) {
+    Region region(1, 1, 2, 2);
+    region.add(4, 1, 1, 2);
+    region.scale(2);
+    Region expected(2, 2, 4, 4);
+    expected.add(8, 2, 2, 4);
+    EXPECT_EQ(region, expected);
+}
+
+TEST(Region, FractionalScaleRoundsOutwards) {
+    Region region(1, 1, 1, 1);
+    region.scale(1.5);
+    // [1.5, 3) grows to [1, 3)
+    EXPECT_EQ(region, Region(1, 1, 2, 2));
+    Region gone(0, 0, 10, 10);
+    gone.scale(0);
+    EXPECT_TRUE(gone.empty());
+}
+
+TEST(Region, RectConversions) {
+    Region region(0, 0, 10, 5);
+    region.add(2, 5, 3, 5);
+    const auto rects = region.get_rects();
+    ASSERT_EQ(rects.size(), 2u);
+    EXPECT_EQ(rects[1].x, 2);
+    EXPECT_EQ(rects[1].y, 5);
+    EXPECT_EQ(rects[1].width, 3);
+    EXPECT_EQ(rects[1].height, 5);
+    // bottom-left origin in a 20 pixel high surface
+    EXPECT_EQ(region.get_egl_rects(20), (std::vector<int32_t>{0, 15, 10, 5, 2, 10, 3, 5}));
+    EXPECT_EQ(Region(rects), region);
+}
+
+}
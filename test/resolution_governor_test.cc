@@ -0,0 +1,127 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "window/resolution_governor.h"
+
+#include <algorithm>
+#include <cstdint>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+constexpr uint64_t kRefreshNs = 16666667;
+
+// a frame whose cost scales with the pixel count, full_load at scale 1
+uint64_t frame_time(double full_load, double scale) {
+    return static_cast<uint64_t>(full_load * scale * scale * static_cast<double>(kRefreshNs));
+}
+
+double run(ResolutionGovernor &governor, double full_load, int frames, int *changes = nullptr) {
+    double scale = governor.get_scale();
+    for (int i = 0; i < frames; i++) {
+        const double next = governor.update(frame_time(full_load, scale), kRefreshNs);
+        if (changes && next != scale) {
+            (*changes)++;
+        }
+        scale = next;
+    }
+    return scale;
+}
+
+TEST(ResolutionGovernor, StartsAtMaxScale) {
+    ResolutionGovernor governor;
+    EXPECT_DOUBLE_EQ(governor.get_scale(), 1.0);
+}
+
+TEST(ResolutionGovernor, IgnoresFramesWithoutTiming) {
+    ResolutionGovernor governor;
+    for (int i = 0; i < 10; i++) {
+        EXPECT_DOUBLE_EQ(governor.update(frame_time(3.0, 1.0), 0), 1.0);
+        EXPECT_DOUBLE_EQ(governor.update(0, kRefreshNs), 1.0);
+    }
+}
+
+TEST(ResolutionGovernor, SingleSpikeKeepsScale) {
+    ResolutionGovernor governor;
+    run(governor, 0.5, 10);
+    governor.update(frame_time(3.0, 1.0), kRefreshNs);
+    EXPECT_DOUBLE_EQ(run(governor, 0.5, 50), 1.0);
+}
+
+TEST(ResolutionGovernor, OverloadSettlesInTheHoldBand) {
+    const ResolutionGovernorConfig config;
+    ResolutionGovernor governor(config);
+    const double scale = run(governor, 1.5, 600);
+    EXPECT_LT(scale, 1.0);
+    EXPECT_GE(scale, config.min_scale);
+    const double load = 1.5 * scale * scale;
+    EXPECT_LE(load, config.high_water);
+    EXPECT_GE(load, config.low_water);
+}
+
+TEST(ResolutionGovernor, StopsAtMinScale) {
+    const ResolutionGovernorConfig config;
+    ResolutionGovernor governor(config);
+    EXPECT_DOUBLE_EQ(run(governor, 10.0, 600), config.min_scale);
+}
+
+TEST(ResolutionGovernor, SteadyLoadDoesNotOscillate) {
+    ResolutionGovernor governor;
+    run(governor, 1.2, 1000);
+    int changes = 0;
+    run(governor, 1.2, 2000, &changes);
+    EXPECT_EQ(changes, 0);
+}
+
+TEST(ResolutionGovernor, HeadroomRaisesScaleBackInSteps) {
+    const ResolutionGovernorConfig config;
+    ResolutionGovernor governor(config);
+    const double low = run(governor, 2.0, 600);
+    ASSERT_LT(low, 1.0);
+
+    // a lighter scene: one frame past up_frames raises the scale by at most one step
+    double scale = low;
+    double largest_step = 0;
+    for (int i = 0; i < 5000; i++) {
+        const double next = governor.update(frame_time(0.3, scale), kRefreshNs);
+        largest_step = std::max(largest_step, next - scale);
+        scale = next;
+    }
+    EXPECT_DOUBLE_EQ(scale, config.max_scale);
+    EXPECT_LE(largest_step, config.up_step + 1e-9);
+}
+
+TEST(ResolutionGovernor, DoesNotRaiseIntoOverload) {
+    const ResolutionGovernorConfig config;
+    ResolutionGovernor governor(config);
+    run(governor, 1.5, 600);
+    // the settled load is in the hold band, a step up would cross high_water
+    int changes = 0;
+    run(governor, 1.5, 3000, &changes);
+    EXPECT_EQ(changes, 0);
+}
+
+TEST(ResolutionGovernor, ResetReturnsToMaxScale) {
+    ResolutionGovernor governor;
+    run(governor, 2.0, 600);
+    ASSERT_LT(governor.get_scale(), 1.0);
+    governor.reset();
+    EXPECT_DOUBLE_EQ(governor.get_scale(), 1.0);
+}
+
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2024 Joel Winarske
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "utils/spsc_ring.h"
+
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+TEST(SpscRing, PopsInPushOrder) {
+    SpscRing<int, 8> ring;
+    EXPECT_TRUE(ring.empty());
+    for (int i = 0; i < 5; i++) {
+        EXPECT_TRUE(ring.push(i));
+    }
+    EXPECT_FALSE(ring.empty());
+    for (int i = 0; i < 5; i++) {
+        int value = -1;
+        ASSERT_TRUE(ring.pop(value));
+        EXPECT_EQ(value, i);
+    }
+    int value;
+    EXPECT_FALSE(ring.pop(value));
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST(SpscRing, FullRingDropsAndCounts) {
+    SpscRing<int, 4> ring;
+    for (int i = 0; i < 4; i++) {
+        EXPECT_TRUE(ring.push(i));
+    }
+    EXPECT_FALSE(ring.push(4));
+    EXPECT_FALSE(ring.push(5));
+    EXPECT_EQ(ring.get_dropped(), 2u);
+
+    // the oldest values are kept, and a pop makes room again
+    int value = -1;
+    ASSERT_TRUE(ring.pop(value));
+    EXPECT_EQ(value, 0);
+    EXPECT_TRUE(ring.push(6));
+    std::vector<int> rest;
+    ring.drain([&rest](const int &v) { rest.push_back(v); });
+    EXPECT_EQ(rest, (std::vector<int>{1, 2, 3, 6}));
+}
+
+TEST(SpscRing, WrapsAround) {
+    SpscRing<uint32_t, 4> ring;
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < 1000; i++) {
+        ASSERT_TRUE(ring.push(i));
+        if (i % 3 == 2) {
+            uint32_t value;
+            while (ring.pop(value)) {
+                EXPECT_EQ(value, next++);
+            }
+        }
+    }
+    EXPECT_EQ(ring.get_dropped(), 0u);
+}
+
+TEST(SpscRing, DrainReturnsTheCount) {
+    SpscRing<int, 16> ring;
+    EXPECT_EQ(ring.drain([](const int &) {}), 0u);
+    for (int i = 0; i < 10; i++) {
+        ring.push(i);
+    }
+    int sum = 0;
+    EXPECT_EQ(ring.drain([&sum](const int &v) { sum += v; }), 10u);
+    EXPECT_EQ(sum, 45);
+    EXPECT_TRUE(ring.empty());
+}
+
+TEST(SpscRing, TwoThreadsLoseNothingButDrops) {
+    struct Event {
+        uint64_t sequence;
+        uint64_t check;
+    };
+    constexpr uint64_t kCount = 1000000;
+    SpscRing<Event, 64> ring;
+
+    std::thread producer([&ring]() {
+        for (uint64_t i = 0; i < kCount; i++) {
+            ring.push({i, ~i});
+        }
+    });
+
+    // values arrive in order and intact; whatever is missing was counted as dropped
+    uint64_t received = 0;
+    uint64_t last = 0;
+    bool first = true;
+    bool ordered = true;
+    bool intact = true;
+    auto consume = [&](const Event &event) {
+        ordered &= first || event.sequence > last;
+        intact &= event.check == ~event.sequence;
+        first = false;
+        last = event.sequence;
+        received++;
+    };
+    while (received + ring.get_dropped() < kCount) {
+        Event event{};
+        if (ring.pop(event)) {
+            consume(event);
+        }
+        ring.drain(consume);
+    }
+    producer.join();
+
+    EXPECT_TRUE(ordered);
+    EXPECT_TRUE(intact);
+    EXPECT_EQ(received + ring.get_dropped(), kCount);
+    EXPECT_TRUE(ring.empty());
+}
+
+}